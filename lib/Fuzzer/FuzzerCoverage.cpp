@@ -0,0 +1,197 @@
+//===- FuzzerCoverage.cpp - Coverage run-time without a sanitizer ---------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// A minimal implementation of the coverage interface of the sanitizer
+// run-times, for code that is built with -fsanitize-coverage but without a
+// sanitizer (e.g. with -fmemsafety). It implements exactly what the fuzzer
+// uses: edge coverage, 8-bit counters and the death callback.
+//
+// Link it (LLVMFuzzerCoverage) only into fuzzers that have no sanitizer
+// run-time; the sanitizer run-times define the same functions.
+//
+// All state is plain zero-initialized data because the instrumented modules
+// register themselves from constructors that may run before ours.
+//===----------------------------------------------------------------------===//
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <signal.h>
+#include <unistd.h>
+
+namespace {
+
+// A module registered by __sanitizer_cov_module_init.
+struct Module {
+  int32_t *Guards;
+  uintptr_t NumGuards;
+  uint8_t *Counters;
+};
+
+Module *Modules;
+size_t NumModules;
+
+// The guards hit since the last reset and the PCs that hit them, in the
+// order in which they were first hit.
+int32_t **HitGuards;
+uintptr_t *HitPCs;
+size_t NumHits, HitCapacity;
+
+volatile int Lock;
+
+void (*DeathCallback)();
+
+void Acquire() {
+  while (__sync_lock_test_and_set(&Lock, 1))
+    ;
+}
+
+void Release() { __sync_lock_release(&Lock); }
+
+template <class T> void Grow(T **Array, size_t NewCapacity) {
+  *Array = static_cast<T *>(realloc(*Array, NewCapacity * sizeof(T)));
+  if (!*Array) {
+    fprintf(stderr, "ERROR: coverage run-time out of memory\n");
+    _Exit(1);
+  }
+}
+
+// Guards are negative until they are hit and positive afterwards; the
+// instrumentation only calls __sanitizer_cov while the guard is not positive.
+void RecordHit(int32_t *Guard, uintptr_t PC) {
+  int32_t G = *Guard;
+  if (G >= 0 || !__sync_bool_compare_and_swap(Guard, G, -G))
+    return;
+  Acquire();
+  if (NumHits == HitCapacity) {
+    HitCapacity = HitCapacity ? HitCapacity * 2 : 1024;
+    Grow(&HitGuards, HitCapacity);
+    Grow(&HitPCs, HitCapacity);
+  }
+  HitGuards[NumHits] = Guard;
+  HitPCs[NumHits] = PC;
+  NumHits++;
+  Release();
+}
+
+void DeadlySignalHandler(int Signal) {
+  static volatile int Dying;
+  if (__sync_lock_test_and_set(&Dying, 1))
+    _Exit(1);
+  fprintf(stderr, "==%d== ERROR: deadly signal %d\n", (int)getpid(), Signal);
+  if (DeathCallback)
+    DeathCallback();
+  _Exit(1);
+}
+
+// Installs DeadlySignalHandler for the signals that nobody else handles; the
+// program (e.g. the SAFECode run-time) may rely on its own handlers.
+void InstallDeadlySignalHandlers() {
+  const int Signals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+  for (int Signal : Signals) {
+    struct sigaction Old;
+    if (sigaction(Signal, nullptr, &Old) || Old.sa_handler != SIG_DFL ||
+        (Old.sa_flags & SA_SIGINFO))
+      continue;
+    struct sigaction New;
+    memset(&New, 0, sizeof(New));
+    New.sa_handler = DeadlySignalHandler;
+    sigaction(Signal, &New, nullptr);
+  }
+}
+
+uint8_t CounterToBit(uint8_t Counter) {
+  if (Counter >= 128) return 128;
+  if (Counter >= 32) return 64;
+  if (Counter >= 16) return 32;
+  if (Counter >= 8) return 16;
+  if (Counter >= 4) return 8;
+  if (Counter >= 3) return 4;
+  if (Counter >= 2) return 2;
+  return 1;
+}
+
+}  // namespace
+
+extern "C" {
+void __sanitizer_cov_module_init(int32_t *Guards, uintptr_t NumGuards,
+                                 uint8_t *Counters, const char *ModuleName) {
+  // Guards[0] is reserved; the instrumentation uses Guards[1..NumGuards].
+  for (uintptr_t i = 1; i <= NumGuards; i++)
+    Guards[i] = -1;
+  Acquire();
+  Grow(&Modules, NumModules + 1);
+  Modules[NumModules++] = {Guards, NumGuards, Counters};
+  Release();
+}
+
+void __sanitizer_cov(int32_t *Guard) {
+  RecordHit(Guard, reinterpret_cast<uintptr_t>(__builtin_return_address(0)));
+}
+
+void __sanitizer_cov_with_check(int32_t *Guard) {
+  RecordHit(Guard, reinterpret_cast<uintptr_t>(__builtin_return_address(0)));
+}
+
+void __sanitizer_cov_indir_call16(uintptr_t Callee, uintptr_t Cache[]) {}
+void __sanitizer_cov_trace_func_enter(int32_t *Guard) {}
+void __sanitizer_cov_trace_basic_block(int32_t *Guard) {}
+
+uintptr_t __sanitizer_get_total_unique_coverage() { return NumHits; }
+
+void __sanitizer_reset_coverage() {
+  Acquire();
+  for (size_t i = 0; i < NumHits; i++)
+    *HitGuards[i] = -*HitGuards[i];
+  NumHits = 0;
+  Release();
+}
+
+uintptr_t __sanitizer_get_coverage_guards(uintptr_t **PCs) {
+  *PCs = HitPCs;
+  return NumHits;
+}
+
+uintptr_t __sanitizer_get_number_of_counters() {
+  uintptr_t Res = 0;
+  for (size_t M = 0; M < NumModules; M++)
+    if (Modules[M].Counters)
+      Res += Modules[M].NumGuards;
+  return Res;
+}
+
+// Folds each counter into one bit of its bucket (1, 2, 3, 4-7, 8-15, 16-31,
+// 32-127, 128+), adds the bits to Bitset, clears the counters and returns the
+// number of bits that were new. A null Bitset only clears the counters.
+uintptr_t __sanitizer_update_counter_bitset_and_clear_counters(
+    uint8_t *Bitset) {
+  uintptr_t NumNewBits = 0, Idx = 0;
+  for (size_t M = 0; M < NumModules; M++) {
+    uint8_t *Counters = Modules[M].Counters;
+    if (!Counters) continue;
+    for (uintptr_t i = 0; i < Modules[M].NumGuards; i++, Idx++) {
+      uint8_t Counter = Counters[i];
+      if (!Counter) continue;
+      Counters[i] = 0;
+      if (!Bitset) continue;
+      uint8_t Bit = CounterToBit(Counter);
+      if (!(Bitset[Idx] & Bit)) {
+        Bitset[Idx] |= Bit;
+        NumNewBits++;
+      }
+    }
+  }
+  return NumNewBits;
+}
+
+void __sanitizer_set_death_callback(void (*Callback)()) {
+  DeathCallback = Callback;
+  InstallDeadlySignalHandlers();
+}
+}  // extern "C"
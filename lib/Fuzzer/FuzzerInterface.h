@@ -95,4 +95,21 @@ int FuzzerDriver(int argc, char **argv, UserSuppliedFuzzer &USF);
 
 }  // namespace fuzzer
 
+/** Hooks for checkers that run inside the code under test.
+
+Checkers that detect errors without crashing the process (e.g. the SAFECode
+run-time) can report them to the fuzzer, and can tell it about interesting
+program states that code coverage does not show. Declare the hooks weak in
+the checker so that it also works without the fuzzer.
+*/
+extern "C" {
+/// Treats the current input as a crash: prints Reason, writes the input to
+/// a crash-<sha1> file and exits.
+void LLVMFuzzerReportCrash(const char *Reason);
+/// Records that the current input reached Feature, an arbitrary value
+/// identifying a program state. Inputs that reach new features are added to
+/// the corpus like inputs that reach new code.
+void LLVMFuzzerAddFeature(uintptr_t Feature);
+}  // extern "C"
+
 #endif  // LLVM_FUZZER_INTERFACE_H
@@ -94,11 +94,15 @@ class Fuzzer {
   size_t getTotalNumberOfRuns() { return TotalNumberOfRuns; }
 
   static void StaticAlarmCallback();
+  static void StaticCrashCallback(const char *Reason);
+  static void StaticAddFeature(uintptr_t Feature);
 
   Unit SubstituteTokens(const Unit &U) const;
 
  private:
   void AlarmCallback();
+  void CrashCallback(const char *Reason);
+  void AddFeature(uintptr_t Feature);
   void ExecuteCallback(const Unit &U);
   void MutateAndTestOne(Unit *U);
   void ReportNewCoverage(size_t NewCoverage, const Unit &U);
@@ -136,6 +140,11 @@ class Fuzzer {
   std::unordered_set<std::string> UnitHashesAddedToCorpus;
   std::unordered_set<uintptr_t> FullCoverageSets;
 
+  // Features reported with LLVMFuzzerAddFeature, and how many of them the
+  // current unit has reached for the first time.
+  std::unordered_set<uintptr_t> Features;
+  size_t NumNewFeatures = 0;
+
   // For UseCounters
   std::vector<uint8_t> CounterBitmap;
   size_t TotalBits() {  // Slow. Call it only for printing stats.
@@ -10,8 +10,22 @@
 //===----------------------------------------------------------------------===//
 
 #include "FuzzerInternal.h"
-#include <sanitizer/coverage_interface.h>
 #include <algorithm>
+#include <unistd.h>
+
+// The coverage interface of the sanitizer run-times, or of FuzzerCoverage.cpp
+// when the code under test is built without a sanitizer. We declare it here
+// instead of including <sanitizer/coverage_interface.h> so that the fuzzer
+// does not need the sanitizer headers.
+extern "C" {
+void __sanitizer_set_death_callback(void (*Callback)());
+void __sanitizer_reset_coverage();
+uintptr_t __sanitizer_get_total_unique_coverage();
+uintptr_t __sanitizer_get_coverage_guards(uintptr_t **PCs);
+uintptr_t __sanitizer_get_number_of_counters();
+uintptr_t __sanitizer_update_counter_bitset_and_clear_counters(
+    uint8_t *Bitset);
+}
 
 namespace fuzzer {
 
@@ -52,6 +66,26 @@ void Fuzzer::DeathCallback() {
   WriteToCrash(CurrentUnit, "crash-");
 }
 
+void Fuzzer::StaticCrashCallback(const char *Reason) {
+  if (!F) abort();  // Not fuzzing; crash the usual way.
+  F->CrashCallback(Reason);
+}
+
+void Fuzzer::CrashCallback(const char *Reason) {
+  Printf("==%d== ERROR: %s\n", getpid(), Reason);
+  DeathCallback();
+  _Exit(1);
+}
+
+void Fuzzer::StaticAddFeature(uintptr_t Feature) {
+  if (F) F->AddFeature(Feature);
+}
+
+void Fuzzer::AddFeature(uintptr_t Feature) {
+  if (Features.insert(Feature).second)
+    NumNewFeatures++;
+}
+
 void Fuzzer::StaticAlarmCallback() {
   assert(F);
   F->AlarmCallback();
@@ -149,6 +183,7 @@ void Fuzzer::ShuffleAndMinimize() {
 size_t Fuzzer::RunOne(const Unit &U) {
   UnitStartTime = system_clock::now();
   TotalNumberOfRuns++;
+  NumNewFeatures = 0;
   size_t Res = 0;
   if (Options.UseFullCoverageSet)
     Res = RunOneMaximizeFullCoverageSet(U);
@@ -213,8 +248,9 @@ size_t Fuzzer::RunOneMaximizeFullCoverageSet(const Unit &U) {
   ExecuteCallback(U);
   uintptr_t *PCs;
   uintptr_t NumPCs =__sanitizer_get_coverage_guards(&PCs);
-  if (FullCoverageSets.insert(HashOfArrayOfPCs(PCs, NumPCs)).second)
-    return FullCoverageSets.size();
+  if (FullCoverageSets.insert(HashOfArrayOfPCs(PCs, NumPCs)).second ||
+      NumNewFeatures)
+    return FullCoverageSets.size() + Features.size();
   return 0;
 }
 
@@ -235,8 +271,8 @@ size_t Fuzzer::RunOneMaximizeTotalCoverage(const Unit &U) {
   if (!(TotalNumberOfRuns & (TotalNumberOfRuns - 1)) && Options.Verbosity)
     PrintStats("pulse ", NewCoverage);
 
-  if (NewCoverage > OldCoverage || NumNewBits)
-    return NewCoverage;
+  if (NewCoverage > OldCoverage || NumNewBits || NumNewFeatures)
+    return NewCoverage + Features.size();
   return 0;
 }
 
@@ -341,3 +377,13 @@ void Fuzzer::SyncCorpus() {
 }
 
 }  // namespace fuzzer
+
+extern "C" {
+void LLVMFuzzerReportCrash(const char *Reason) {
+  fuzzer::Fuzzer::StaticCrashCallback(Reason);
+}
+
+void LLVMFuzzerAddFeature(uintptr_t Feature) {
+  fuzzer::Fuzzer::StaticAddFeature(Feature);
+}
+}  // extern "C"
@@ -0,0 +1,20 @@
+// Test for a fuzzer: must find an input of which the first 4 bytes are "ABCD".
+// The code compares the bytes without branches, so only the features that
+// it reports with LLVMFuzzerAddFeature guide the fuzzer.
+#include <cstdint>
+#include <cstdlib>
+#include <cstddef>
+#include <iostream>
+
+#include "FuzzerInterface.h"
+
+extern "C" void LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
+  size_t Num = 0;
+  for (size_t i = 0; i < Size; i++)
+    Num += (Data[i] == 'A' + i);
+  LLVMFuzzerAddFeature(Num);
+  if (Num >= 4) {
+    std::cerr << "BINGO!\n";
+    exit(1);
+  }
+}
@@ -0,0 +1,20 @@
+// Test for a fuzzer. The fuzzer must find the string "Hi!", which the target
+// reports as a crash with LLVMFuzzerReportCrash, like a checker that finds an
+// error without crashing would.
+#include <cstdint>
+#include <cstddef>
+
+#include "FuzzerInterface.h"
+
+static volatile int Sink;
+
+extern "C" void LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
+  if (Size > 0 && Data[0] == 'H') {
+    Sink = 1;
+    if (Size > 1 && Data[1] == 'i') {
+      Sink = 2;
+      if (Size > 2 && Data[2] == '!')
+        LLVMFuzzerReportCrash("Found the target");
+    }
+  }
+}
@@ -22,6 +22,12 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/InstVisitor.h"
+#include "llvm/ADT/StringMap.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
 
 using namespace llvm;
 
@@ -42,14 +48,39 @@ namespace llvm {
       // Worklist of call sites to transform
       std::vector<Instruction *> Worklist;
 
-      // A cache of indirect call targets that have been converted already
-      std::map<const Function *, std::set<const Function *> > bounceCache;
+      // The position of each indirect call site among those of its function
+      std::map<const Instruction *, unsigned> SiteIndex;
+
+      // Number of indirect call sites found so far in each function
+      std::map<const Function *, unsigned> NumSites;
+
+      // Key of the bounce function cache: the type of the bounce function and
+      // a hash of the targets in the order in which it compares them
+      typedef std::pair<FunctionType *, size_t> BounceKey;
+
+      // A cache of the bounce functions built so far
+      std::map<BounceKey, std::vector<const Function *> > bounceCache;
+
+      // The targets of each bounce function in the order it compares them
+      std::map<const Function *, std::vector<const Function *> > bounceTargets;
+
+      // Number of calls of each target at each profiled call site
+      StringMap<uint64_t> TargetCounts;
 
     protected:
+      void loadProfile (void);
+      std::string getSiteName (const CallSite & CS);
+      void orderTargets (const CallSite & CS,
+                         std::vector<const Function*>& Targets,
+                         std::vector<uint64_t>& Counts);
       void makeDirectCall (CallSite & CS);
+      void promoteHotTarget (CallSite & CS, const Function * Hot,
+                             Function * Bounce, uint64_t HotCount,
+                             uint64_t OtherCount);
       Function* buildBounce (CallSite cs,std::vector<const Function*>& Targets);
-      const Function* findInCache (const CallSite & CS,
-                                   std::set<const Function*>& Targets);
+      const Function* findInCache (FunctionType * BounceTy,
+                                   std::vector<const Function*>& Targets);
+      FunctionType * getBounceType (const CallSite & CS);
 
     public:
       static char ID;
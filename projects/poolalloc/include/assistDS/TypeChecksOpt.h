@@ -35,6 +35,10 @@ private:
   dsa::TypeSafety<TDDataStructures> *TS;
   std::list<Instruction *> toDelete;
 
+  void specializeBySize(Module &M, Constant *F, StringRef Name,
+                        unsigned SizeArg);
+  void inlineFastPaths(Module &M);
+
 public:
   static char ID;
   TypeChecksOpt() : ModulePass(ID) {}
@@ -21,6 +21,7 @@
 #include "llvm/Support/raw_ostream.h"
 #include "dsa/svset.h"
 #include "dsa/super_set.h"
+#include "dsa/cow_set.h"
 #include "dsa/keyiterator.h"
 #include "dsa/DSGraph.h"
 #include "dsa/DSSupport.h"
@@ -81,9 +82,10 @@ private:
   ///
   LinkMapTy Links;
 
-  /// Globals - The list of global values that are merged into this node.
+  /// Globals - The list of global values that are merged into this node.  The
+  /// copies of a node share the list until one of them changes.
   ///
-  svset<const GlobalValue*> Globals;
+  cow_set<const GlobalValue*> Globals;
 
   void operator=(const DSNode &); // DO NOT IMPLEMENT
   DSNode(const DSNode &);         // DO NOT IMPLEMENT
@@ -344,7 +346,7 @@ public:
   /// value leaders set that is merged into this node.  Like the getGlobalsList
   /// method, these iterators do not return globals that are part of the
   /// equivalence classes for globals in this node, but aren't leaders.
-  typedef svset<const GlobalValue*>::const_iterator globals_iterator;
+  typedef cow_set<const GlobalValue*>::const_iterator globals_iterator;
   globals_iterator globals_begin() const { return Globals.begin(); }
   globals_iterator globals_end() const { return Globals.end(); }
 
@@ -448,6 +450,7 @@ public:
   void checkOffsetFoldIfNeeded(int Offset);
 private:
   friend class DSNodeHandle;
+  friend class DSSummaryCache;
 
   // static mergeNodes - Helper for mergeWith()
   static void MergeNodes(DSNodeHandle& CurNodeH, DSNodeHandle& NH);
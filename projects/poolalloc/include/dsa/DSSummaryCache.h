@@ -0,0 +1,121 @@
+//===- DSSummaryCache.h - On-disk cache of bottom-up DSGraphs ---*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the DSSummaryCache class, which serializes the bottom-up
+// DSGraph computed for an SCC of the call graph into a compact binary file so
+// that a later compilation of an unchanged SCC can load the graph instead of
+// recomputing it.
+//
+// Graphs are keyed by a content hash of the functions in the SCC, of the
+// summaries of every function they (transitively) call directly, and of the
+// module-level environment (globals, declarations, and the bodies of all
+// address-taken functions, which may become indirect call targets).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_ANALYSIS_DSSUMMARYCACHE_H
+#define LLVM_ANALYSIS_DSSUMMARYCACHE_H
+
+#include "dsa/super_set.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/EquivalenceClasses.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+class DataLayout;
+class DSGraph;
+class Function;
+class GlobalValue;
+class Instruction;
+class Module;
+class Type;
+class Value;
+
+class DSSummaryCache {
+  /// Module - The module whose graphs are cached.
+  Module &M;
+
+  /// CacheDir - The directory holding one file per cached SCC graph.
+  std::string CacheDir;
+
+  /// Salt - Hash of the analysis name, the options of the DSA passes, the
+  /// module-level environment and the keys of the address-taken functions.
+  /// Every key is salted with it.
+  std::string Salt;
+
+  /// FunctionKeys - The content key of each defined function: its own body
+  /// plus the keys of everything it calls directly.
+  std::map<const Function*, std::string> FunctionKeys;
+
+  /// InstNumbers/InstTable - Stable names for instructions, computed lazily
+  /// per function.
+  DenseMap<const Value*, unsigned> InstNumbers;
+  std::map<const Function*, std::vector<Instruction*> > InstTable;
+
+  /// TypeTable - Printed type name to Type, used when loading.
+  StringMap<Type*> TypeTable;
+  bool TypeTableBuilt;
+
+  void computeFunctionKeys();
+  void numberInstructions(const Function &F);
+  void buildTypeTable();
+
+  /// decodeGraph - Rebuild a graph from its encoding.  Returns null if the
+  /// encoding is malformed or names something missing from the module.
+  DSGraph *decodeGraph(StringRef Data,
+                       EquivalenceClasses<const GlobalValue*> &ECs,
+                       const DataLayout &TD, SuperSet<Type*> &TypeSS,
+                       DSGraph *GlobalsGraph);
+
+  std::string getPath(const std::string &Key) const;
+
+public:
+  DSSummaryCache(Module &M, const std::string &Dir, const char *PassName);
+
+  /// getKey - Return the cache key for the graph holding the given functions.
+  std::string getKey(const std::vector<const Function*> &Functions) const;
+
+  /// getValueRef - Name V in a way that survives recompilation: globals by
+  /// name, arguments and instructions by their position in a named function.
+  /// Returns false if V cannot be named.
+  bool getValueRef(const Value *V, unsigned &Kind, std::string &Name,
+                   unsigned &Index);
+
+  /// load - Read the entry stored under Key.  On success, returns a new graph
+  /// for exactly the given functions and sets Contribution to the nodes and
+  /// call sites the SCC added to the globals graph.  Returns null if no
+  /// usable entry exists.
+  DSGraph *load(const std::string &Key,
+                const std::vector<const Function*> &Functions,
+                EquivalenceClasses<const GlobalValue*> &ECs,
+                const DataLayout &TD, SuperSet<Type*> &TypeSS,
+                DSGraph *GlobalsGraph, DSGraph *&Contribution);
+
+  /// store - Write G and its globals graph contribution to the cache under
+  /// Key.  Returns false if either graph could not be encoded or written.
+  bool store(const std::string &Key, const DSGraph &G,
+             const DSGraph &Contribution);
+
+  /// remove - Delete the entry stored under Key, if any.
+  void remove(const std::string &Key);
+
+  /// isEquivalent - Return true if the two graphs have identical canonical
+  /// encodings.  Used to validate cached graphs against fresh ones.
+  bool isEquivalent(const DSGraph &G1, const DSGraph &G2);
+};
+
+} // End llvm namespace
+
+#endif
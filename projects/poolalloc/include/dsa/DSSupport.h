@@ -287,6 +287,10 @@ public:
     CallArgs.push_back(NH);
   }
 
+  void addMappedSite(CallSite CS) {
+    MappedSites.insert(CS);
+  }
+
   void swap(DSCallSite &CS) {
     if (this != &CS) {
       std::swap(Site, CS.Site);
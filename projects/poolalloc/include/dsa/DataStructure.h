@@ -27,6 +27,8 @@
 #include "llvm/ADT/DenseSet.h"
 
 #include <map>
+#include <set>
+#include <string>
 
 namespace llvm {
 
@@ -37,6 +39,7 @@ class DSGraph;
 class DSCallSite;
 class DSNode;
 class DSNodeHandle;
+class DSSummaryCache;
 
 FunctionPass *createDataStructureStatsPass();
 FunctionPass *createDataStructureGraphCheckerPass();
@@ -229,16 +232,25 @@ protected:
   // from the CallGraph.  This is useful while doing original BU,
   // but might be undesirable in other passes such as CBU/EQBU.
   bool filterCallees;
+
+  // SummaryCache -- The on-disk cache of SCC graphs, if one was requested.
+  // Only the original BU pass uses it; CBU and EQBU leave it null.
+  DSSummaryCache *SummaryCache;
+
+  // CachedKeys -- The cache keys already looked up during this run.  An SCC
+  // that is recalculated is always computed rather than reloaded.
+  std::set<std::string> CachedKeys;
 public:
   static char ID;
   //Child constructor (CBU)
   BUDataStructures(char & CID, const char* name, const char* printname,
       bool filter)
-    : DataStructures(CID, printname), debugname(name), filterCallees(filter) {}
+    : DataStructures(CID, printname), debugname(name), filterCallees(filter),
+      SummaryCache(0) {}
   //main constructor
   BUDataStructures()
     : DataStructures(ID, "bu."), debugname("dsa-bu"),
-    filterCallees(true) {}
+    filterCallees(true), SummaryCache(0) {}
   ~BUDataStructures() { releaseMemory(); }
 
   virtual bool runOnModule(Module &M);
@@ -264,6 +276,8 @@ private:
                             TarjanMap & ValMap);
 
   void calculateGraph(DSGraph* G);
+  bool calculateGraphCached(DSGraph*& G);
+  void mergeGlobalsContribution(const DSGraph* Contribution);
 
   void CloneAuxIntoGlobal(DSGraph* G);
 
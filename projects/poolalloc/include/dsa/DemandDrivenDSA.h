@@ -0,0 +1,123 @@
+//===- DemandDrivenDSA.h - Answer DSA queries on demand ----------*- C++ -*--//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This analysis pass answers questions about the DSNodes of pointers without
+// analyzing the whole program.  Clients that only query the pointers of a few
+// functions pay for the functions that can affect the answers instead of for
+// the bottom-up and top-down closure of the entire module.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef DSA_DEMANDDRIVENDSA_H
+#define DSA_DEMANDDRIVENDSA_H
+
+#include "dsa/DataStructure.h"
+#include "dsa/DSGraph.h"
+#include "dsa/DSNode.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Pass.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+using namespace llvm;
+
+namespace dsa {
+
+//
+// Pass: DemandDrivenDSA
+//
+// Description:
+//  This pass answers queries about the DSNode of a pointer within a function.
+//  The first query about a function computes EQTD DSA for a slice of the
+//  module: the function, the functions that can call it, and the functions
+//  that any of those can call.  A function whose address is taken may be
+//  called by any function with an indirect call, and such a function may call
+//  any function whose address is taken.  The bodies of all other functions are
+//  dropped, and the values of the slice that they could use are treated as
+//  externally visible, so the answers are conservative.  Later queries reuse
+//  a slice holding every function that can affect them.
+//
+//  The slices are copies of the module taken when they are built; values
+//  created afterwards have no DSNode and are never type-safe or complete.
+//
+struct DemandDrivenDSA : public ModulePass {
+  public:
+    static char ID;
+    DemandDrivenDSA() : ModulePass(ID), M(0) {}
+    virtual ~DemandDrivenDSA() { releaseMemory(); }
+    virtual bool runOnModule (Module & M);
+
+    const char *getPassName() const {
+      return "Demand-Driven DSA Queries";
+    }
+
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.setPreservesAll();
+    }
+
+    virtual void releaseMemory ();
+    virtual void print (raw_ostream & O, const Module * M) const;
+
+    // Methods for clients to use
+    bool getNodeFlags (const Value * V, const Function * F, unsigned & Flags);
+    bool isTypeSafe (const Value * V, const Function * F);
+    bool isComplete (const Value * V, const Function * F);
+    bool isHeapOnly (const Value * V, const Function * F);
+
+  private:
+    //
+    // Structure: Answer
+    //
+    // Description:
+    //  What the slice analyzing a function found about a pointer.
+    //
+    struct Answer {
+      bool HasNode;
+      bool TypeSafe;
+      unsigned Flags;
+    };
+
+    struct Slice;
+
+    // Methods
+    Answer getAnswer (const Value * V, const Function * F);
+    void findSlice (const Function * F,
+                    std::set<const Function *> & Functions);
+    Slice * getSlice (const Function * F);
+    Slice * buildSlice (const std::set<const Function *> & Functions);
+    bool isUsedOutside (const Value * V,
+                        const std::set<const Function *> & Functions);
+
+    // The module being analyzed
+    Module * M;
+
+    // The direct callers and callees of each function
+    std::map<const Function *, std::vector<const Function *> > Callers;
+    std::map<const Function *, std::vector<const Function *> > Callees;
+
+    // The functions with indirect calls and the functions whose address is
+    // taken
+    std::set<const Function *> IndirectCallers;
+    std::set<const Function *> AddressTaken;
+
+    // Number of functions defined in the module
+    unsigned NumDefined;
+
+    // The slices built so far
+    std::vector<Slice *> Slices;
+
+    // The answers computed so far
+    DenseMap<std::pair<const Value *, const Function *>, Answer> Answers;
+};
+
+}
+#endif
@@ -0,0 +1,126 @@
+//===- cow_set.h - Copy-on-write sorted vector set --------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A set whose contents are shared by its copies until one of them changes.
+// DSNodes are copied every time a graph is cloned into another one; with this
+// set, the copies of a node share its list of globals instead of copying it.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _COW_SET_H
+#define	_COW_SET_H
+
+#include "dsa/svset.h"
+
+template<typename Ty>
+class cow_set {
+  typedef svset<Ty> InnerSetTy;
+
+  // The shared contents and the number of sets sharing them
+  struct rep {
+    unsigned refs;
+    InnerSetTy set;
+    rep() : refs(1) { }
+    rep(const InnerSetTy &S) : refs(1), set(S) { }
+  };
+  rep *R;
+
+  static const InnerSetTy &empty_set() {
+    static const InnerSetTy Empty;
+    return Empty;
+  }
+
+  void release() {
+    if (R && --R->refs == 0)
+      delete R;
+    R = 0;
+  }
+
+  /// mutate - Return the contents for modification, copying them first if
+  /// another set shares them.
+  InnerSetTy &mutate() {
+    if (!R) {
+      R = new rep();
+    } else if (R->refs > 1) {
+      rep *Copy = new rep(R->set);
+      --R->refs;
+      R = Copy;
+    }
+    return R->set;
+  }
+
+public:
+  typedef Ty key_type;
+  typedef Ty value_type;
+  typedef typename InnerSetTy::const_iterator const_iterator;
+  typedef typename InnerSetTy::size_type size_type;
+
+  cow_set() : R(0) { }
+
+  cow_set(const cow_set &rhs) : R(rhs.R) {
+    if (R) ++R->refs;
+  }
+
+  cow_set &operator=(const cow_set &rhs) {
+    if (R != rhs.R) {
+      if (rhs.R) ++rhs.R->refs;
+      release();
+      R = rhs.R;
+    }
+    return *this;
+  }
+
+  ~cow_set() { release(); }
+
+  const InnerSetTy &get() const { return R ? R->set : empty_set(); }
+
+  const_iterator begin() const { return get().begin(); }
+  const_iterator end() const { return get().end(); }
+  bool empty() const { return get().empty(); }
+  size_type size() const { return get().size(); }
+  bool count(const Ty &x) const { return get().count(x); }
+
+  /// shares - Return true if both sets use the same contents.  Sets that
+  /// share their contents are equal.
+  bool shares(const cow_set &rhs) const { return R == rhs.R; }
+
+  bool operator==(const cow_set &rhs) const {
+    return shares(rhs) || get() == rhs.get();
+  }
+
+  void insert(const Ty &x) {
+    if (!count(x))
+      mutate().insert(x);
+  }
+
+  /// insert - Add the elements of another set.  An empty set takes over the
+  /// contents of the other set without copying them.
+  void insert(const cow_set &rhs) {
+    if (shares(rhs) || rhs.empty())
+      return;
+    if (empty()) {
+      *this = rhs;
+      return;
+    }
+    const InnerSetTy &S = rhs.get();
+    mutate().insert(S.begin(), S.end());
+  }
+
+  size_type erase(const Ty &x) {
+    if (!count(x))
+      return 0;
+    return mutate().erase(x);
+  }
+
+  void swap(cow_set &rhs) { std::swap(R, rhs.R); }
+
+  void clear() { release(); }
+};
+
+#endif	/* _COW_SET_H */
@@ -1,4 +1,4 @@
-/* 
+/*
  * File:   super_set.h
  * Author: andrew
  *
@@ -9,35 +9,77 @@
 #define	_SUPER_SET_H
 
 #include "dsa/svset.h"
-#include <set>
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Hashing.h"
+
+#include <unordered_set>
+#include <utility>
 
 // Contains stable references to a set
 // The sets can be grown.
+//
+// Each distinct set is stored once, so sets are equal exactly when their
+// pointers are.  The results of adding an element to a set and of the union of
+// two sets are remembered, so repeating them does not build a set again.
 
 template<typename Ty>
 class SuperSet {
-  //std::set provides stable iterators, and that matters a lot
   typedef svset<Ty> InnerSetTy;
-  typedef std::set<InnerSetTy> OuterSetTy;
+
+  struct HashSet {
+    size_t operator()(const InnerSetTy &S) const {
+      return llvm::hash_combine_range(S.begin(), S.end());
+    }
+  };
+
+  //std::unordered_set provides stable references, and that matters a lot
+  typedef std::unordered_set<InnerSetTy, HashSet> OuterSetTy;
   OuterSetTy container;
+
 public:
   typedef const typename OuterSetTy::value_type* setPtr;
 
+private:
+  // Memoized results of getOrCreate(setPtr, Ty) and getOrCreateUnion()
+  llvm::DenseMap<std::pair<setPtr, Ty>, setPtr> Inserts;
+  llvm::DenseMap<std::pair<setPtr, setPtr>, setPtr> Unions;
+
+public:
   setPtr getOrCreate(svset<Ty>& S) {
     if (S.empty()) return 0;
     return &(*container.insert(S).first);
   }
 
   setPtr getOrCreate(setPtr P, Ty t) {
-    svset<Ty> s;
-    if (P)
-      s.insert(P->begin(), P->end());
-    s.insert(t);
-    return getOrCreate(s);
+    if (P && P->count(t))
+      return P;
+
+    setPtr &Result = Inserts[std::make_pair(P, t)];
+    if (!Result) {
+      svset<Ty> s;
+      if (P)
+        s.insert(P->begin(), P->end());
+      s.insert(t);
+      Result = getOrCreate(s);
+    }
+    return Result;
+  }
+
+  setPtr getOrCreateUnion(setPtr P, setPtr Q) {
+    if (!P || P == Q) return Q;
+    if (!Q) return P;
+    if (Q < P) std::swap(P, Q);
+
+    setPtr &Result = Unions[std::make_pair(P, Q)];
+    if (!Result) {
+      svset<Ty> s(*P);
+      s.insert(Q->begin(), Q->end());
+      Result = getOrCreate(s);
+    }
+    return Result;
   }
 };
 
 
 
 #endif	/* _SUPER_SET_H */
-
@@ -27,6 +27,7 @@
 namespace llvm {
   class Value;
   class Function;
+  class Instruction;
   class Module;
   class DSGraph;
   class DSNode;
@@ -412,6 +413,103 @@ namespace PA {
       virtual void HackFunctionBody(Function &F, std::map<const DSNode*, Value*> &PDs);
   };
 
+  //===-- SizeClass Heuristic ---------------------------------------------===//
+  //
+  // This heuristic uses the object sizes that DSA infers and an estimate of
+  // how often each node is allocated and freed to pick the kind of pool that
+  // suits each node: a bump pointer pool for nodes that are never freed, a
+  // pool of fixed-size nodes for objects of one small size, or a general pool.
+  // Rarely allocated nodes of the same kind and size class share a pool when
+  // the cost of creating a pool of their own exceeds the fragmentation and
+  // locality cost of sharing one.
+  //
+  // Allocation frequencies come from the block frequencies of the allocation
+  // sites; when the program was compiled with a profile, the function entry
+  // counts of the profile scale them.  Merging nodes into one pool is not
+  // type-safe, so this heuristic is not meant for use with SAFECode.
+  //
+  class SizeClassHeuristic : public Heuristic, public ModulePass {
+    public:
+      // The kinds of pools that the heuristic chooses between
+      enum PoolKind {
+        BumpPool,
+        SlabPool,
+        GeneralPool
+      };
+
+      // The allocation behavior of the objects of a DSNode
+      struct NodeProfile {
+        // Estimated number of allocations and deallocations of the objects
+        double Allocs;
+        double Frees;
+
+        // Number of allocation sites found for the node
+        unsigned AllocSites;
+
+        // Size of the objects if every allocation site allocates the same
+        // constant size
+        unsigned ObjSize;
+        bool VariableSize;
+
+        NodeProfile() : Allocs(0), Frees(0), AllocSites(0), ObjSize(0),
+                        VariableSize(false) {}
+      };
+
+    protected:
+      // The allocation behavior of the DSNodes in the function graphs and the
+      // globals graph
+      std::map<const DSNode *, NodeProfile> Profiles;
+
+      // The estimated number of calls to each function
+      std::map<const Function *, double> EntryFreqs;
+
+      // The estimated number of times the objects of each DSNode of a
+      // function's graph are freed by the function and its callees
+      typedef std::map<const DSNode *, double> FreeMapTy;
+      std::map<const Function *, FreeMapTy> FuncFrees;
+
+      // The calls made by each function and their estimated frequencies
+      typedef std::vector<std::pair<Instruction *, double> > CallListTy;
+      std::map<const Function *, CallListTy> FuncCalls;
+
+      void profileFunction (Function & F);
+      void propagateFrees (const Function * F,
+                           std::set<const Function *> & Visited);
+      void addSite (DSGraph * G, DSGraph::NodeMapTy & GGMap,
+                    const DSNode * N, double Freq, bool IsFree,
+                    unsigned Size);
+      PoolKind getPoolKind (const DSNode * N, unsigned & Size);
+
+    public:
+      static char ID;
+      virtual void *getAdjustedAnalysisPointer(AnalysisID ID) {
+        if (ID == &Heuristic::ID)
+          return (Heuristic*)this;
+        return this;
+      }
+
+      SizeClassHeuristic (char & IDp = ID) : ModulePass (IDp) { }
+      virtual ~SizeClassHeuristic () {return;}
+      virtual bool runOnModule (Module & M);
+      virtual void getAnalysisUsage(AnalysisUsage &AU) const;
+      virtual const char * getPassName () const {
+        return "Size Class Pool Allocation Heuristic";
+      }
+
+      void releaseMemory () {
+        Profiles.clear();
+        EntryFreqs.clear();
+        FuncFrees.clear();
+        FuncCalls.clear();
+        GlobalPoolNodes.clear();
+        return;
+      }
+
+      virtual void AssignToPools(const DSNodeList_t &NodesToPA,
+                                 Function *F, DSGraph* G,
+                                 std::vector<OnePool> &ResultPools);
+  };
+
   //===-- NoNodes Heuristic -----------------------------------------------===//
   //
   // This dummy heuristic chooses to not pool allocate anything.
@@ -231,6 +231,11 @@ public:
 protected:
   std::map<const Function*, PA::FuncInfo> FunctionInfo;
 
+  /// LocalPoolSizes - The element size and alignment which the heuristic chose
+  /// for each pool descriptor allocated on the stack.  These are passed into
+  /// the poolinit calls for the pool.
+  std::map<const Value*, std::pair<unsigned, unsigned> > LocalPoolSizes;
+
  public:
   static char ID;
 
@@ -313,6 +318,7 @@ protected:
     FunctionInfo.clear();
     GlobalNodes.clear();
     CloneToOrigMap.clear();
+    LocalPoolSizes.clear();
   }
 
 
@@ -6,13 +6,31 @@
 // the University of Illinois Open Source License. See LICENSE.TXT for details.
 //
 //===----------------------------------------------------------------------===//
+//
+// The targets of an indirect call site can be ordered with a profile of the
+// calls of each target.  The profile is a text file with one line per target
+// of each call site:
+//
+//    <count> <site name> <target name>
+//
+// A site is named by the function containing it and the position of the call
+// among the indirect calls of that function, e.g., "main:2".  Functions with
+// internal linkage are qualified with the module name.  Lines naming the same
+// target of the same site are summed.
+//
+//===----------------------------------------------------------------------===//
 
 #define DEBUG_TYPE "devirt"
 
 #include "assistDS/Devirt.h"
 
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
 #include <iostream>
 #include <algorithm>
@@ -26,6 +44,20 @@ char Devirtualize::ID = 0;
 // Pass statistics
 STATISTIC(FuncAdded, "Number of bounce functions added");
 STATISTIC(CSConvert, "Number of call sites converted");
+STATISTIC(CSPromote, "Number of call sites calling their hot target directly");
+
+namespace {
+  cl::opt<std::string>
+  ProfileFile ("devirt-profile-file",
+               cl::desc("Read indirect call target counts from this file"),
+               cl::init(""));
+
+  cl::opt<double>
+  PromoteRatio ("devirt-promote-ratio",
+                cl::desc("Fraction of the calls of a site above which its "
+                         "hottest target is called directly"),
+                cl::init(0.5));
+}
 
 // Pass registration
 RegisterPass<Devirtualize>
@@ -74,12 +106,164 @@ castTo (Value * V, Type * Ty, std::string Name, Instruction * InsertPt) {
   return CastInst::CreateZExtOrBitCast (V, Ty, Name, InsertPt);
 }
 
+//
+// Function: hashTargets()
+//
+// Description:
+//  Hash the targets of a bounce function in the order in which it compares
+//  them.
+//
+static inline size_t
+hashTargets (const std::vector<const Function*>& Targets) {
+  return hash_combine_range (Targets.begin(), Targets.end());
+}
+
+//
+// Function: targetNameOrder()
+//
+// Description:
+//  Order call targets by name, so that the order does not depend on where the
+//  functions happen to be allocated.  Only unnamed functions fall back to
+//  their addresses.
+//
+static bool
+targetNameOrder (const Function * A, const Function * B) {
+  int Cmp = A->getName().compare (B->getName());
+  if (Cmp)
+    return Cmp < 0;
+  return A < B;
+}
+
+//
+// Function: hotterTarget()
+//
+// Description:
+//  Order call targets by decreasing number of calls.
+//
+static bool
+hotterTarget (const std::pair<uint64_t, const Function *> & A,
+              const std::pair<uint64_t, const Function *> & B) {
+  return A.first > B.first;
+}
+
+//
+// Method: loadProfile()
+//
+// Description:
+//  Read the number of calls of each target of the profiled call sites.  A
+//  missing or malformed profile is reported and treated as empty.
+//
+void
+Devirtualize::loadProfile (void) {
+  TargetCounts.clear();
+  if (ProfileFile.empty())
+    return;
+
+  ErrorOr<std::unique_ptr<MemoryBuffer> > Buffer =
+    MemoryBuffer::getFile (ProfileFile);
+  if (!Buffer) {
+    errs() << "devirt: cannot read indirect call profile " << ProfileFile
+           << ": " << Buffer.getError().message() << "\n";
+    return;
+  }
+
+  SmallVector<StringRef, 64> Lines;
+  (*Buffer)->getBuffer().split (Lines, "\n", -1, false);
+  for (unsigned index = 0; index < Lines.size(); ++index) {
+    std::pair<StringRef, StringRef> Fields = Lines[index].trim().split (' ');
+    std::pair<StringRef, StringRef> Names = Fields.second.trim().split (' ');
+    uint64_t Count;
+    if (Names.second.empty() || Fields.first.getAsInteger (10, Count)) {
+      errs() << "devirt: ignoring malformed line " << (index + 1)
+             << " of indirect call profile " << ProfileFile << "\n";
+      continue;
+    }
+
+    TargetCounts[(Names.first + " " + Names.second.trim()).str()] += Count;
+  }
+}
+
+//
+// Method: getSiteName()
+//
+// Description:
+//  Return the name under which the profile records the specified indirect
+//  call site.
+//
+std::string
+Devirtualize::getSiteName (const CallSite & CS) {
+  const Function * F = CS.getInstruction()->getParent()->getParent();
+  std::string Name;
+  raw_string_ostream OS (Name);
+  if (F->hasLocalLinkage())
+    OS << F->getParent()->getModuleIdentifier() << ":";
+  OS << F->getName() << ":" << SiteIndex[CS.getInstruction()];
+  return OS.str();
+}
+
+//
+// Method: orderTargets()
+//
+// Description:
+//  Put the targets of an indirect call site in the order in which the bounce
+//  function should compare them: the targets called most often in the profile
+//  come first.  Targets with the same number of calls are ordered by name so
+//  that the output does not change from run to run and call sites with the
+//  same targets share a bounce function.
+//
+// Outputs:
+//  Counts - The number of calls of each target in the profile.
+//
+void
+Devirtualize::orderTargets (const CallSite & CS,
+                            std::vector<const Function*>& Targets,
+                            std::vector<uint64_t>& Counts) {
+  std::sort (Targets.begin(), Targets.end(), targetNameOrder);
+  Targets.erase (std::unique (Targets.begin(), Targets.end()), Targets.end());
+  Counts.assign (Targets.size(), 0);
+  if (TargetCounts.empty())
+    return;
+
+  std::string Site = getSiteName (CS) + " ";
+  std::vector<std::pair<uint64_t, const Function *> > Ordered;
+  for (unsigned index = 0; index < Targets.size(); ++index) {
+    std::string Key = Site + Targets[index]->getName().str();
+    Ordered.push_back (std::make_pair (TargetCounts.lookup (Key),
+                                       Targets[index]));
+  }
+  std::stable_sort (Ordered.begin(), Ordered.end(), hotterTarget);
+
+  for (unsigned index = 0; index < Ordered.size(); ++index) {
+    Counts[index] = Ordered[index].first;
+    Targets[index] = Ordered[index].second;
+  }
+}
+
+//
+// Method: getBounceType()
+//
+// Description:
+//  Return the type of the bounce function for the specified call site.  It is
+//  almost identical to the type of the function being called; the only
+//  difference is an additional pointer argument at the beginning of its
+//  argument list that is the function to call.
+//
+FunctionType *
+Devirtualize::getBounceType (const CallSite & CS) {
+  std::vector<Type *> TP;
+  TP.push_back (CS.getCalledValue()->getType());
+  for (CallSite::arg_iterator i = CS.arg_begin(); i != CS.arg_end(); ++i)
+    TP.push_back ((*i)->getType());
+  return FunctionType::get (CS.getType(), TP, false);
+}
+
 //
 // Method: findInCache()
 //
 // Description:
-//  This method looks through the cache of bounce functions to see if there
-//  exists a bounce function for the specified call site.
+//  This method looks up the cache of bounce functions to see if there exists
+//  a bounce function of the specified type that compares the function pointer
+//  to the specified targets in the same order.
 //
 // Return value:
 //  0 - No usable bounce function has been created.
@@ -87,35 +271,21 @@ castTo (Value * V, Type * Ty, std::string Name, Instruction * InsertPt) {
 //  returned.
 //
 const Function *
-Devirtualize::findInCache (const CallSite & CS,
-                           std::set<const Function*>& Targets) {
+Devirtualize::findInCache (FunctionType * BounceTy,
+                           std::vector<const Function*>& Targets) {
+  std::map<BounceKey, std::vector<const Function *> >::iterator I;
+  I = bounceCache.find (BounceKey (BounceTy, hashTargets (Targets)));
+  if (I == bounceCache.end())
+    return 0;
+
   //
-  // Iterate through all of the existing bounce functions to see if one of them
-  // can be resued.
+  // Different target lists may hash to the same value; compare the targets of
+  // the bounce functions found.
   //
-  std::map<const Function *, std::set<const Function *> >::iterator I;
-  for (I = bounceCache.begin(); I != bounceCache.end(); ++I) {
-    //
-    // If the bounce function and the function pointer have different types,
-    // then skip this bounce function because it is incompatible.
-    //
-    const Function * bounceFunc = I->first;
-
-    // Check the return type
-    if (CS.getType() != bounceFunc->getReturnType())
-      continue;
-
-    // Check the type of the function pointer and the arguments
-    if (CS.getCalledValue()->stripPointerCasts()->getType() !=
-        bounceFunc->arg_begin()->getType())
-      continue;
-
-    //
-    // Determine whether the targets are identical.  If so, then this function
-    // can be used as a bounce function for this call site.
-    //
-    if (Targets == I->second)
-      return I->first;
+  for (unsigned index = 0; index < I->second.size(); ++index) {
+    const Function * bounceFunc = I->second[index];
+    if (bounceTargets[bounceFunc] == Targets)
+      return bounceFunc;
   }
 
   //
@@ -146,16 +316,7 @@ Devirtualize::buildBounce (CallSite CS, std::vector<const Function*>& Targets) {
   // an additional pointer argument at the beginning of its argument list that
   // will be the function to call.
   //
-  Value* ptr = CS.getCalledValue();
-  std::vector<Type *> TP;
-  TP.insert (TP.begin(), ptr->getType());
-  for (CallSite::arg_iterator i = CS.arg_begin();
-       i != CS.arg_end();
-       ++i) {
-    TP.push_back ((*i)->getType());
-  }
-
-  FunctionType* NewTy = FunctionType::get(CS.getType(), TP, false);
+  FunctionType* NewTy = getBounceType (CS);
   Module * M = CS.getInstruction()->getParent()->getParent()->getParent();
   Function* F = Function::Create (NewTy,
                                   GlobalValue::InternalLinkage,
@@ -222,11 +383,13 @@ Devirtualize::buildBounce (CallSite CS, std::vector<const Function*>& Targets) {
   //
   // Create basic blocks which will test the value of the incoming function
   // pointer and branch to the appropriate basic block to call the function.
+  // The blocks are created from the last comparison to the first, so that the
+  // function pointer is compared to the targets in their order in the list.
   //
   Type * VoidPtrType = getVoidPtrType (M->getContext());
   Value * FArg = castTo (F->arg_begin(), VoidPtrType, "", InsertPt);
   BasicBlock * tailBB = failBB;
-  for (unsigned index = 0; index < Targets.size(); ++index) {
+  for (unsigned index = Targets.size(); index-- > 0; ) {
     //
     // Cast the function pointer to an integer.  This can go in the entry
     // block.
@@ -273,6 +436,84 @@ Devirtualize::buildBounce (CallSite CS, std::vector<const Function*>& Targets) {
   return F;
 }
 
+//
+// Method: promoteHotTarget()
+//
+// Description:
+//  Replace the specified call site with a comparison of the function pointer
+//  to its hottest target.  The hottest target is called directly when they
+//  match; the other targets are called through the bounce function.
+//
+// Inputs:
+//  CS         - The indirect call site, which must be a call instruction.
+//  Hot        - The target called most often by the call site.
+//  Bounce     - The bounce function for the targets of the call site.
+//  HotCount   - The number of calls of the hottest target in the profile.
+//  OtherCount - The number of calls of the other targets in the profile.
+//
+void
+Devirtualize::promoteHotTarget (CallSite & CS, const Function * Hot,
+                                Function * Bounce, uint64_t HotCount,
+                                uint64_t OtherCount) {
+  CallInst * CI = cast<CallInst>(CS.getInstruction());
+  LLVMContext & Context = CI->getContext();
+  Value * FuncPtr = CS.getCalledValue();
+
+  //
+  // Compare the function pointer to the hottest target.  Branch weights only
+  // hold 32 bits, so scale the counts down until they fit.
+  //
+  Type * VoidPtrType = getVoidPtrType (Context);
+  Value * IsHot = new ICmpInst (CI,
+                                ICmpInst::ICMP_EQ,
+                                castTo (FuncPtr, VoidPtrType, "", CI),
+                                castTo (const_cast<Function*>(Hot),
+                                        VoidPtrType,
+                                        "",
+                                        CI),
+                                "hot");
+  while ((HotCount | OtherCount) > UINT32_MAX) {
+    HotCount >>= 1;
+    OtherCount >>= 1;
+  }
+  MDNode * Weights = MDBuilder (Context).createBranchWeights (HotCount,
+                                                              OtherCount);
+
+  TerminatorInst * ThenTerm;
+  TerminatorInst * ElseTerm;
+  SplitBlockAndInsertIfThenElse (IsHot, CI, &ThenTerm, &ElseTerm, Weights);
+
+  //
+  // Call the hottest target directly.
+  //
+  std::vector<Value*> Args (CS.arg_begin(), CS.arg_end());
+  Value * Callee = castTo (const_cast<Function*>(Hot),
+                           FuncPtr->getType(),
+                           "",
+                           ThenTerm);
+  CallInst * Direct = CallInst::Create (Callee, Args, "", ThenTerm);
+  Direct->setCallingConv (CI->getCallingConv());
+  Direct->setAttributes (CI->getAttributes());
+
+  //
+  // Call the other targets through the bounce function.
+  //
+  Args.insert (Args.begin(), FuncPtr);
+  CallInst * Other = CallInst::Create (Bounce, Args, "", ElseTerm);
+
+  //
+  // Merge the results of the two calls.
+  //
+  if (!CI->getType()->isVoidTy()) {
+    std::string name = CI->hasName() ? CI->getName().str() + ".dv" : "";
+    PHINode * Result = PHINode::Create (CI->getType(), 2, name, CI);
+    Result->addIncoming (Direct, ThenTerm->getParent());
+    Result->addIncoming (Other, ElseTerm->getParent());
+    CI->replaceAllUsesWith (Result);
+  }
+  CI->eraseFromParent();
+}
+
 //
 // Method: makeDirectCall()
 //
@@ -299,11 +540,14 @@ Devirtualize::makeDirectCall (CallSite & CS) {
   if (CTF->size(CS)) {
     std::vector<const Function*> Targets;
     Targets.insert (Targets.begin(), CTF->begin(CS), CTF->end(CS));
+    std::vector<uint64_t> Counts;
+    orderTargets (CS, Targets, Counts);
+
     //
     // Determine if an existing bounce function can be used for this call site.
     //
-    std::set<const Function *> targetSet (Targets.begin(), Targets.end());
-    const Function * NF = findInCache (CS, targetSet);
+    FunctionType * BounceTy = getBounceType (CS);
+    const Function * NF = findInCache (BounceTy, Targets);
 
     //
     // If no cached bounce function was found, build a function which will
@@ -313,14 +557,36 @@ Devirtualize::makeDirectCall (CallSite & CS) {
     if (!NF) {
       // Build the bounce function and add it to the cache
       NF = buildBounce (CS, Targets);
-      bounceCache[NF] = targetSet;
+      bounceCache[BounceKey (BounceTy, hashTargets (Targets))].push_back (NF);
+      bounceTargets[NF] = Targets;
     }
 
     //
-    // Replace the original call with a call to the bounce function.
+    // The bounce function takes the function pointer followed by the
+    // arguments of the call.
+    //
+    std::vector<Value*> Params;
+    Params.push_back (CS.getCalledValue());
+    Params.insert (Params.end(), CS.arg_begin(), CS.arg_end());
+
+    uint64_t TotalCount = 0;
+    for (unsigned index = 0; index < Counts.size(); ++index)
+      TotalCount += Counts[index];
+
+    //
+    // If the profile shows that most calls go to one target, call it directly
+    // at the call site.  Otherwise, replace the original call with a call to
+    // the bounce function.
     //
-    if (CallInst* CI = dyn_cast<CallInst>(CS.getInstruction())) {
-      std::vector<Value*> Params (CI->op_begin(), CI->op_end());
+    if (isa<CallInst>(CS.getInstruction()) &&
+        TotalCount && Counts[0] >= PromoteRatio * TotalCount) {
+      promoteHotTarget (CS,
+                        Targets[0],
+                        const_cast<Function*>(NF),
+                        Counts[0],
+                        TotalCount - Counts[0]);
+      ++CSPromote;
+    } else if (CallInst* CI = dyn_cast<CallInst>(CS.getInstruction())) {
       std::string name = CI->hasName() ? CI->getName().str() + ".dv" : "";
       CallInst* CN = CallInst::Create (const_cast<Function*>(NF),
                                        Params,
@@ -329,7 +595,6 @@ Devirtualize::makeDirectCall (CallSite & CS) {
       CI->replaceAllUsesWith(CN);
       CI->eraseFromParent();
     } else if (InvokeInst* CI = dyn_cast<InvokeInst>(CS.getInstruction())) {
-      std::vector<Value*> Params (CI->op_begin(), CI->op_end());
       std::string name = CI->hasName() ? CI->getName().str() + ".dv" : "";
       InvokeInst* CN = InvokeInst::Create(const_cast<Function*>(NF),
                                           CI->getNormalDest(),
@@ -366,6 +631,12 @@ Devirtualize::visitCallSite (CallSite &CS) {
   if (isa<Function>(CalledValue->stripPointerCasts()))
     return;
 
+  //
+  // Number the indirect call sites of each function for the profile.
+  //
+  const Function * F = CS.getInstruction()->getParent()->getParent();
+  SiteIndex[CS.getInstruction()] = NumSites[F]++;
+
   //
   // Second, we will only transform those call sites which are complete (i.e.,
   // for which we know all of the call targets).
@@ -395,6 +666,11 @@ Devirtualize::runOnModule (Module & M) {
   //
   CTF = &getAnalysis<dsa::CallTargetFinder<EQTDDataStructures> >();
 
+  //
+  // Read the profile of the indirect call targets, if any.
+  //
+  loadProfile();
+
   // Visit all of the call instructions in this function and record those that
   // are indirect function calls.
   //
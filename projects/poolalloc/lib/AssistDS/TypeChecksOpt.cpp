@@ -22,8 +22,12 @@
 #include "llvm/IR/InstIterator.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
 #include <vector>
 
@@ -36,6 +40,18 @@ TC("typechecks-opt", "Remove safe runtime type checks", false, true);
 
 // Pass statistics
 STATISTIC(numSafe,  "Number of statically proven safe type checks");
+STATISTIC(numSpecialized, "Number of type checks specialized by size");
+STATISTIC(numInlined, "Number of type checks inlined");
+
+static cl::opt<bool> SpecializeSizes("typechecks-specialize-sizes",
+       cl::desc("Call size-specialized runtime checks for 1, 2, 4, 8 and "
+                "16 byte accesses"),
+       cl::Hidden, cl::init(true));
+
+static cl::opt<bool> InlineFastPaths("typechecks-inline-fast-paths",
+       cl::desc("Inline the size-specialized runtime checks and the "
+                "trackInitInst calls of 1, 2, 4, 8 and 16 bytes"),
+       cl::Hidden, cl::init(true));
 
 static Type *VoidTy = 0;
 static Type *Int8Ty = 0;
@@ -264,7 +280,236 @@ bool TypeChecksOpt::runOnModule(Module &M) {
     I->eraseFromParent();
   }
 
-  return (numSafe > 0);
+  if (SpecializeSizes) {
+    specializeBySize(M, trackStoreInst, "trackStoreInst", 2);
+    specializeBySize(M, checkTypeInst, "checkType", 1);
+    if (InlineFastPaths)
+      inlineFastPaths(M);
+  }
+
+  return (numSafe > 0) || (numSpecialized > 0) || (numInlined > 0);
+}
+
+//
+// Method: specializeBySize()
+//
+// Description:
+//  Make every call to the runtime function F whose size operand is a constant
+//  1, 2, 4, 8 or 16 call the runtime's "<Name>_<size>" version instead.  The
+//  specialized versions take the same arguments but compare or fill the
+//  shadow memory with a fixed number of word accesses.
+//
+// Inputs:
+//  M        - The module being transformed.
+//  F        - The generic runtime function.
+//  Name     - The name of the generic runtime function.
+//  SizeArg  - The index of the size argument of F.
+//
+void TypeChecksOpt::specializeBySize(Module &M, Constant *F, StringRef Name,
+                                     unsigned SizeArg) {
+  std::vector<CallInst *> Calls;
+  for(Value::user_iterator User = F->user_begin(); User != F->user_end(); ++User)
+    if (CallInst *CI = dyn_cast<CallInst>(*User))
+      if (CI->getCalledValue() == F)
+        Calls.push_back(CI);
+
+  Function *Generic = dyn_cast<Function>(F);
+  if (!Generic)
+    return;
+
+  for (unsigned i = 0; i < Calls.size(); ++i) {
+    CallInst *CI = Calls[i];
+    ConstantInt *Size = dyn_cast<ConstantInt>(CI->getArgOperand(SizeArg));
+    if (!Size)
+      continue;
+    uint64_t N = Size->getZExtValue();
+    if (N != 1 && N != 2 && N != 4 && N != 8 && N != 16)
+      continue;
+
+    Constant *Specialized =
+      M.getOrInsertFunction((Name + "_" + Twine(N)).str(),
+                            Generic->getFunctionType());
+    CI->setCalledFunction(Specialized);
+    ++numSpecialized;
+  }
+}
+
+
+
+//
+// Function: getCalls()
+//
+// Description:
+//  Return the calls of the named function whose size operand SizeArg is a
+//  constant 1, 2, 4, 8 or 16, or all of its calls if SizeArg is negative.
+//
+static std::vector<CallInst *>
+getCalls(Module &M, StringRef Name, int SizeArg = -1) {
+  std::vector<CallInst *> Calls;
+  Function *F = M.getFunction(Name);
+  if (!F)
+    return Calls;
+
+  for(Value::user_iterator User = F->user_begin(); User != F->user_end(); ++User) {
+    CallInst *CI = dyn_cast<CallInst>(*User);
+    if (!CI || CI->getCalledValue() != F)
+      continue;
+    if (SizeArg >= 0) {
+      ConstantInt *Size = dyn_cast<ConstantInt>(CI->getArgOperand(SizeArg));
+      if (!Size)
+        continue;
+      uint64_t N = Size->getZExtValue();
+      if (N != 1 && N != 2 && N != 4 && N != 8 && N != 16)
+        continue;
+    }
+    Calls.push_back(CI);
+  }
+  return Calls;
+}
+
+//
+// Function: getShadowPattern()
+//
+// Description:
+//  Build the shadow of an N-byte object of the given type as one integer:
+//  the type number followed by N-1 bytes of 0xFE in memory order.
+//
+static Value *
+getShadowPattern(IRBuilder<> &B, const DataLayout &DL, Value *TypeNumber,
+                 unsigned N) {
+  IntegerType *Ty = B.getIntNTy(N * 8);
+  APInt Tail(N * 8, 0);
+  for (unsigned i = 1; i < N; ++i) {
+    unsigned Shift = DL.isLittleEndian() ? i * 8 : (N - 1 - i) * 8;
+    Tail |= APInt(N * 8, 0xFE).shl(Shift);
+  }
+
+  Value *Type = B.CreateZExt(TypeNumber, Ty);
+  if (!DL.isLittleEndian() && N > 1)
+    Type = B.CreateShl(Type, (N - 1) * 8);
+  return B.CreateOr(Type, ConstantInt::get(Ty, Tail));
+}
+
+//
+// Function: getShadowAddress()
+//
+// Description:
+//  Compute the address of the shadow of Ptr the way maskAddress() in the
+//  runtime does.  The runtime exports the base and size of the shadow memory
+//  so that they are defined in one place.
+//
+static Value *
+getShadowAddress(IRBuilder<> &B, Module &M, Value *Ptr) {
+  Type *IntPtrTy = M.getDataLayout().getIntPtrType(M.getContext());
+  Constant *BaseVar = M.getOrInsertGlobal("TypeShadowBase", TypeTagPtrTy);
+  Constant *SizeVar = M.getOrInsertGlobal("TypeShadowSize", IntPtrTy);
+  if (GlobalVariable *GV = dyn_cast<GlobalVariable>(BaseVar))
+    GV->setConstant(true);
+  if (GlobalVariable *GV = dyn_cast<GlobalVariable>(SizeVar))
+    GV->setConstant(true);
+
+  Value *Base = B.CreateLoad(BaseVar, "shadow.base");
+  Value *Size = B.CreateLoad(SizeVar, "shadow.size");
+  Value *P = B.CreatePtrToInt(Ptr, IntPtrTy);
+  Value *Below = B.CreateICmpULT(P, B.CreatePtrToInt(Base, IntPtrTy));
+  Value *Offset = B.CreateSelect(Below, P, B.CreateSub(P, Size));
+  return B.CreateGEP(Base, Offset, "shadow");
 }
 
+//
+// Function: storeShadow()
+//
+// Description:
+//  Store the N-byte integer V to the shadow memory at Shadow.
+//
+static void
+storeShadow(IRBuilder<> &B, Value *Shadow, Value *V, unsigned N) {
+  Type *PtrTy = PointerType::getUnqual(B.getIntNTy(N * 8));
+  B.CreateAlignedStore(V, B.CreateBitCast(Shadow, PtrTy), 1);
+}
 
+//
+// Function: insertIfNotNull()
+//
+// Description:
+//  Split the block of I before I and insert a block that is executed only
+//  if Ptr is not null.
+//
+// Return value:
+//  The terminator of the new block.
+//
+static TerminatorInst *
+insertIfNotNull(Instruction *I, Value *Ptr) {
+  MDBuilder MDB(I->getContext());
+  Value *NotNull = new ICmpInst(I, ICmpInst::ICMP_NE, Ptr,
+                                Constant::getNullValue(Ptr->getType()));
+  return SplitBlockAndInsertIfThen(NotNull, I, false,
+                                   MDB.createBranchWeights(1000, 1));
+}
+
+//
+// Method: inlineFastPaths()
+//
+// Description:
+//  Inline the size-specialized runtime functions into the program, along
+//  with calls to trackInitInst with a constant size of 1, 2, 4, 8 or 16
+//  bytes.  Stores fill the shadow memory with a single store.  Checks
+//  compare the shadow with a single load and call the runtime's checkType_N
+//  only when the comparison fails; it reports the mismatch or retypes
+//  initialized memory.
+//
+void TypeChecksOpt::inlineFastPaths(Module &M) {
+  const DataLayout &DL = M.getDataLayout();
+  MDBuilder MDB(M.getContext());
+  static const unsigned Sizes[] = {1, 2, 4, 8, 16};
+
+  for (unsigned s = 0; s < sizeof(Sizes) / sizeof(Sizes[0]); ++s) {
+    unsigned N = Sizes[s];
+
+    std::vector<CallInst *> Checks = getCalls(M, "checkType_" + utostr(N));
+    for (unsigned i = 0; i < Checks.size(); ++i) {
+      CallInst *CI = Checks[i];
+      TerminatorInst *Check = insertIfNotNull(CI, CI->getArgOperand(2));
+      IRBuilder<> B(Check);
+      Type *PtrTy = PointerType::getUnqual(B.getIntNTy(N * 8));
+      Value *MD = B.CreateBitCast(CI->getArgOperand(2), PtrTy);
+      Value *Shadow = B.CreateAlignedLoad(MD, 1, "shadow.type");
+      Value *Expected = getShadowPattern(B, DL, CI->getArgOperand(0), N);
+      Value *Mismatch = B.CreateICmpNE(Shadow, Expected);
+      TerminatorInst *Slow =
+        SplitBlockAndInsertIfThen(Mismatch, Check, false,
+                                  MDB.createBranchWeights(1, 1000));
+      CI->getParent()->setName("typecheck.done");
+      Check->getParent()->setName("typecheck.merge");
+      CI->moveBefore(Slow);
+      Slow->getParent()->setName("typecheck.fail");
+      cast<Instruction>(Mismatch)->getParent()->setName("typecheck");
+      ++numInlined;
+    }
+
+    std::vector<CallInst *> Stores = getCalls(M, "trackStoreInst_" + utostr(N));
+    for (unsigned i = 0; i < Stores.size(); ++i) {
+      CallInst *CI = Stores[i];
+      IRBuilder<> B(CI);
+      Value *Shadow = getShadowAddress(B, M, CI->getArgOperand(0));
+      storeShadow(B, Shadow, getShadowPattern(B, DL, CI->getArgOperand(1), N),
+                  N);
+      CI->eraseFromParent();
+      ++numInlined;
+    }
+  }
+
+  std::vector<CallInst *> Inits = getCalls(M, "trackInitInst", 1);
+  for (unsigned i = 0; i < Inits.size(); ++i) {
+    CallInst *CI = Inits[i];
+    unsigned N = cast<ConstantInt>(CI->getArgOperand(1))->getZExtValue();
+    TerminatorInst *Init = insertIfNotNull(CI, CI->getArgOperand(0));
+    Init->getParent()->setName("typeinit");
+    CI->getParent()->setName("typeinit.done");
+    IRBuilder<> B(Init);
+    Value *Shadow = getShadowAddress(B, M, CI->getArgOperand(0));
+    storeShadow(B, Shadow, B.getInt(APInt::getAllOnesValue(N * 8)), N);
+    CI->eraseFromParent();
+    ++numInlined;
+  }
+}
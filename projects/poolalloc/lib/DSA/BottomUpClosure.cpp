@@ -18,8 +18,10 @@
 #include "llvm/IR/Constants.h"
 #include "dsa/DataStructure.h"
 #include "dsa/DSGraph.h"
+#include "dsa/DSSummaryCache.h"
 #include "llvm/IR/Module.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/FormattedStream.h"
 
@@ -35,6 +37,17 @@ namespace {
   STATISTIC (NumEmptyCalls, "Number of calls we know nothing about");
   STATISTIC (NumRecalculations, "Number of DSGraph recalculations");
   STATISTIC (NumRecalculationsSkipped, "Number of DSGraph recalculations skipped");
+  STATISTIC (NumCacheHits, "Number of SCC graphs loaded from the cache");
+  STATISTIC (NumCacheMisses, "Number of SCC graphs computed and cached");
+  STATISTIC (NumCacheMismatches, "Number of cached SCC graphs found stale");
+
+  static cl::opt<std::string> CacheDir("dsa-bu-cache-dir",
+         cl::desc("Directory in which to cache bottom-up DSGraphs of SCCs"),
+         cl::Hidden, cl::init(""));
+  static cl::opt<bool> VerifyCache("dsa-bu-cache-verify",
+         cl::desc("Recompute cached bottom-up DSGraphs and compare them "
+                  "with the cache"),
+         cl::Hidden, cl::init(false));
 
   RegisterPass<BUDataStructures>
   X("dsa-bu", "Bottom-up Data Structure Analysis");
@@ -48,7 +61,15 @@ char BUDataStructures::ID;
 bool BUDataStructures::runOnModule(Module &M) {
   init(&getAnalysis<StdLibDataStructures>(), true, true, false, false );
 
-  return runOnModuleInternal(M);
+  if (!CacheDir.empty())
+    SummaryCache = new DSSummaryCache(M, CacheDir, "dsa-bu");
+
+  bool Changed = runOnModuleInternal(M);
+
+  delete SummaryCache;
+  SummaryCache = 0;
+  CachedKeys.clear();
+  return Changed;
 }
 
 // BU:
@@ -438,7 +459,7 @@ BUDataStructures::calculateGraphs (const Function *F,
     Stack.pop_back();
     DEBUG(errs() << "  [BU] Calculating graph for: " << F->getName()<< "\n");
     DSGraph* G = getOrCreateGraph(F);
-    calculateGraph(G);
+    bool Loaded = calculateGraphCached(G);
     DEBUG(errs() << "  [BU] Done inlining: " << F->getName() << " ["
 	  << G->getGraphSize() << "+" << G->getAuxFunctionCalls().size()
 	  << "]\n");
@@ -447,10 +468,10 @@ BUDataStructures::calculateGraphs (const Function *F,
 
     //
     // Should we revisit the graph?  Only do it if there are now new resolvable
-    // callees.
+    // callees.  A graph loaded from the cache is already the final one.
     FuncSet NewCallees;
     getAllAuxCallees(G, NewCallees);
-    if (!NewCallees.empty()) {
+    if (!Loaded && !NewCallees.empty()) {
       if (hasNewCallees(NewCallees, CalleeFunctions)) {
         DEBUG(errs() << "Recalculating " << F->getName() << " due to new knowledge\n");
         ValMap.erase(F);
@@ -506,13 +527,13 @@ BUDataStructures::calculateGraphs (const Function *F,
 
     // Now that we have one big happy family, resolve all of the call sites in
     // the graph...
-    calculateGraph(SCCGraph);
+    bool Loaded = calculateGraphCached(SCCGraph);
     DEBUG(errs() << "  [BU] Done inlining SCC  [" << SCCGraph->getGraphSize()
 	  << "+" << SCCGraph->getAuxFunctionCalls().size() << "]\n"
 	  << "DONE with SCC #: " << MyID << "\n");
     FuncSet NewCallees;
     getAllAuxCallees(SCCGraph, NewCallees);
-    if (!NewCallees.empty()) {
+    if (!Loaded && !NewCallees.empty()) {
       if (hasNewCallees(NewCallees, CalleeFunctions)) {
         DEBUG(errs() << "Recalculating SCC Graph " << F->getName() << " due to new knowledge\n");
         ValMap.erase(F);
@@ -724,3 +745,118 @@ void BUDataStructures::calculateGraph(DSGraph* Graph) {
   //Graph->writeGraphToFile(cerr, "bu_" + F.getName());
 }
 
+//
+// Method: calculateGraphCached()
+//
+// Description:
+//  Compute the bottom-up graph of an SCC like calculateGraph(), consulting
+//  the on-disk summary cache first if one is in use.
+//
+//  calculateGraph() also adds nodes and unresolved call sites to the globals
+//  graph.  To be able to replay that on a cache hit, the graph is computed
+//  against an empty shadow globals graph, which is stored next to the graph
+//  and then merged into the real globals graph.
+//
+//  With -dsa-bu-cache-verify, a cached graph is checked against the graph an
+//  uncached run computes and never used.
+//
+// Inputs:
+//  G - The graph of the SCC.  On a cache hit, it is deleted and replaced by
+//      the cached graph.
+//
+// Return value:
+//  true  - G was loaded from the cache and is final.
+//  false - G was computed.
+//
+bool BUDataStructures::calculateGraphCached(DSGraph*& G) {
+  if (!SummaryCache) {
+    calculateGraph(G);
+    return false;
+  }
+
+  std::vector<const Function*> Functions;
+  for (DSGraph::retnodes_iterator I = G->retnodes_begin(),
+       E = G->retnodes_end(); I != E; ++I)
+    Functions.push_back(I->first);
+
+  //
+  // An SCC that is being recalculated has a partially inlined graph, so its
+  // result must be computed; the final result then replaces the cached one.
+  //
+  std::string Key = SummaryCache->getKey(Functions);
+  DSGraph *Cached = 0, *CachedContribution = 0;
+  if (CachedKeys.insert(Key).second)
+    Cached = SummaryCache->load(Key, Functions, GlobalECs, getDataLayout(),
+                                *TypeSS, GlobalsGraph, CachedContribution);
+
+  if (Cached && VerifyCache) {
+    //
+    // Check the entry against exactly what an uncached run computes, i.e.,
+    // against the real globals graph rather than a shadow one.  A stale entry
+    // is removed so that the next run recomputes and stores it.
+    //
+    calculateGraph(G);
+    if (!SummaryCache->isEquivalent(*G, *Cached)) {
+      ++NumCacheMismatches;
+      errs() << "dsa-bu: cached graph for '" << G->getFunctionNames()
+             << "' does not match the computed graph; removing it\n";
+      SummaryCache->remove(Key);
+    }
+    delete Cached;
+    delete CachedContribution;
+    return false;
+  }
+
+  if (Cached) {
+    ++NumCacheHits;
+    for (unsigned i = 0, e = Functions.size(); i != e; ++i)
+      setDSGraph(*Functions[i], Cached);
+    delete G;
+    G = Cached;
+
+    // The call graph edges of the SCC are normally added by calculateGraph().
+    G->buildCallGraph(callgraph, GlobalFunctionList, filterCallees);
+    mergeGlobalsContribution(CachedContribution);
+    delete CachedContribution;
+    return true;
+  }
+
+  DSGraph *RealGlobalsGraph = GlobalsGraph;
+  DSGraph *Contribution = new DSGraph(GlobalECs, getDataLayout(), *TypeSS);
+  Contribution->setUseAuxCalls();
+  GlobalsGraph = Contribution;
+  G->setGlobalsGraph(Contribution);
+  calculateGraph(G);
+  GlobalsGraph = RealGlobalsGraph;
+  G->setGlobalsGraph(RealGlobalsGraph);
+
+  ++NumCacheMisses;
+  SummaryCache->store(Key, *G, *Contribution);
+
+  mergeGlobalsContribution(Contribution);
+  delete Contribution;
+  return false;
+}
+
+//
+// Method: mergeGlobalsContribution()
+//
+// Description:
+//  Merge the global nodes and unresolved call sites that an SCC added to a
+//  shadow globals graph into the real globals graph, the same way
+//  calculateGraph() adds them: removeDeadNodes() appends the dead unresolved
+//  call sites without merging them with existing ones, and the flags of the
+//  nodes were already stripped when they were cloned into the shadow graph.
+//
+void BUDataStructures::mergeGlobalsContribution(const DSGraph* Contribution) {
+  ReachabilityCloner RC(GlobalsGraph, Contribution, DSGraph::StripAllocaBit);
+
+  const DSScalarMap &SM = Contribution->getScalarMap();
+  for (DSScalarMap::const_iterator I = SM.begin(), E = SM.end(); I != E; ++I)
+    RC.getClonedNH(I->second);
+
+  for (DSGraph::afc_const_iterator I = Contribution->afc_begin(),
+       E = Contribution->afc_end(); I != E; ++I)
+    GlobalsGraph->getAuxFunctionCalls().push_back(DSCallSite(*I, RC));
+}
+
@@ -46,25 +46,26 @@ namespace {
   STATISTIC (NumTrivialDNE                    , "Number of nodes trivially removed");
   STATISTIC (NumTrivialGlobalDNE              , "Number of globals trivially removed");
   STATISTIC (NumFiltered                      , "Number of calls filtered");
-  
-  static cl::opt<bool> noDSACallConv("dsa-no-filter-callcc",
-         cl::desc("Don't filter call sites based on calling convention."),
-         cl::Hidden,
-         cl::init(false));
-  static cl::opt<bool> noDSACallNumArgs("dsa-no-filter-numargs",
-         cl::desc("Don't filter call sites based on number of arguments."),
-         cl::Hidden,
-         cl::init(false));
-  static cl::opt<bool> noDSACallVA("dsa-no-filter-vararg",
-         cl::desc("Don't filter call sites based on vararg presense"),
-         cl::Hidden,
-         cl::init(true));
-  static cl::opt<bool> noDSACallFP("dsa-no-filter-intfp",
-         cl::desc("Don't filter call sites based on implicit integer to FP conversion"),
-         cl::Hidden,
-         cl::init(false));
 }
 
+// These are not static because the BU summary cache hashes them.
+cl::opt<bool> noDSACallConv("dsa-no-filter-callcc",
+       cl::desc("Don't filter call sites based on calling convention."),
+       cl::Hidden,
+       cl::init(false));
+cl::opt<bool> noDSACallNumArgs("dsa-no-filter-numargs",
+       cl::desc("Don't filter call sites based on number of arguments."),
+       cl::Hidden,
+       cl::init(false));
+cl::opt<bool> noDSACallVA("dsa-no-filter-vararg",
+       cl::desc("Don't filter call sites based on vararg presense"),
+       cl::Hidden,
+       cl::init(true));
+cl::opt<bool> noDSACallFP("dsa-no-filter-intfp",
+       cl::desc("Don't filter call sites based on implicit integer to FP conversion"),
+       cl::Hidden,
+       cl::init(false));
+
 extern cl::opt<bool> TypeInferenceOptimize;
 
 // Determines if the DSGraph 'should' have a node for a given value.
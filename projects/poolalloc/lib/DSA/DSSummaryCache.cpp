@@ -0,0 +1,1054 @@
+//===- DSSummaryCache.cpp - On-disk cache of bottom-up DSGraphs -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the DSSummaryCache class.  Each cache entry is a file
+// named after the key of an SCC and holds two graphs: the bottom-up DSGraph of
+// the SCC and the part of the globals graph that computing it produced.
+//
+// Graphs are encoded canonically: nodes are numbered in the order they are
+// reached from the return nodes, var-arg nodes, scalar map and call sites, and
+// every set is written in sorted order.  Two graphs with the same shape
+// therefore have identical encodings, which is what the validation mode
+// compares.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "dsa-cache"
+
+#include "dsa/DSSummaryCache.h"
+#include "dsa/DSGraph.h"
+#include "dsa/DSNode.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <set>
+
+using namespace llvm;
+
+// The options of the DSA passes that change the graphs BU computes.
+extern cl::opt<bool> noDSACallConv;
+extern cl::opt<bool> noDSACallNumArgs;
+extern cl::opt<bool> noDSACallVA;
+extern cl::opt<bool> noDSACallFP;
+extern cl::opt<bool> noStdLibFold;
+extern cl::opt<bool> DisableStdLib;
+extern cl::opt<bool> TypeInferenceOptimize;
+extern cl::opt<std::string> hasMagicSections;
+
+namespace {
+  // Bump this whenever the encoding changes so that stale entries are ignored.
+  const unsigned FormatVersion = 1;
+  const char Magic[] = "DSBU";
+
+  // The kinds of values that may appear in a scalar map or call site.
+  enum ValueRefKind { GlobalRef = 0, ArgumentRef = 1, InstructionRef = 2 };
+
+  struct ValueRef {
+    unsigned Kind;
+    std::string Name;   // The global, or the function holding the value.
+    unsigned Index;     // Argument or instruction number within Name.
+
+    bool operator<(const ValueRef &RHS) const {
+      if (Kind != RHS.Kind) return Kind < RHS.Kind;
+      if (Name != RHS.Name) return Name < RHS.Name;
+      return Index < RHS.Index;
+    }
+  };
+
+  std::string hashString(StringRef S) {
+    MD5 Hash;
+    Hash.update(S);
+    MD5::MD5Result Result;
+    Hash.final(Result);
+    SmallString<32> Str;
+    MD5::stringifyResult(Result, Str);
+    return Str.str();
+  }
+
+  void writeVBR(std::string &Out, uint64_t V) {
+    do {
+      unsigned char Byte = V & 0x7f;
+      V >>= 7;
+      if (V) Byte |= 0x80;
+      Out.push_back(Byte);
+    } while (V);
+  }
+
+  void writeBlob(std::string &Out, StringRef S) {
+    writeVBR(Out, S.size());
+    Out.append(S.begin(), S.end());
+  }
+
+  //
+  // Class: Reader
+  //
+  // Description:
+  //  Reads the values written by writeVBR() and writeBlob().  Any attempt to
+  //  read past the end of the data sets a sticky failure flag and returns 0.
+  //
+  class Reader {
+    const unsigned char *Cur, *End;
+    bool Failed;
+  public:
+    explicit Reader(StringRef Data)
+      : Cur((const unsigned char *)Data.data()),
+        End((const unsigned char *)Data.data() + Data.size()),
+        Failed(false) {}
+
+    bool failed() const { return Failed; }
+    bool atEnd() const { return Cur == End; }
+
+    uint64_t readVBR() {
+      uint64_t V = 0;
+      for (unsigned Shift = 0; !Failed; Shift += 7) {
+        if (Cur == End || Shift > 63) break;
+        unsigned char Byte = *Cur++;
+        V |= uint64_t(Byte & 0x7f) << Shift;
+        if (!(Byte & 0x80)) return V;
+      }
+      Failed = true;
+      return 0;
+    }
+
+    StringRef readBlob() {
+      uint64_t Len = readVBR();
+      if (Failed || uint64_t(End - Cur) < Len) {
+        Failed = true;
+        return StringRef();
+      }
+      StringRef S((const char *)Cur, Len);
+      Cur += Len;
+      return S;
+    }
+  };
+
+  //
+  // Class: GraphEncoder
+  //
+  // Description:
+  //  Produces the canonical encoding of a single DSGraph.  Strings (names and
+  //  printed types) are collected into a table that precedes the body.
+  //
+  class GraphEncoder {
+    DSSummaryCache &Cache;
+    std::vector<std::string> Strings;
+    StringMap<unsigned> StringIDs;
+    DenseMap<Type*, unsigned> TypeIDs;
+    DenseMap<const DSNode*, unsigned> NodeIDs;
+    std::vector<const DSNode*> Nodes;
+    std::string Body;
+    bool Failed;
+
+    unsigned getStringID(StringRef S) {
+      StringMap<unsigned>::iterator I = StringIDs.find(S);
+      if (I != StringIDs.end())
+        return I->second;
+      StringIDs[S] = Strings.size();
+      Strings.push_back(S);
+      return Strings.size() - 1;
+    }
+
+    unsigned getTypeID(Type *Ty) {
+      DenseMap<Type*, unsigned>::iterator I = TypeIDs.find(Ty);
+      if (I != TypeIDs.end())
+        return I->second;
+      std::string Str;
+      raw_string_ostream OS(Str);
+      Ty->print(OS);
+      return TypeIDs[Ty] = getStringID(OS.str());
+    }
+
+    bool getRef(const Value *V, ValueRef &R) {
+      return Cache.getValueRef(V, R.Kind, R.Name, R.Index);
+    }
+
+    void numberNodes(const DSNode *N);
+    void numberCallSite(const DSCallSite &CS);
+    void writeRef(const ValueRef &R);
+    void writeHandle(const DSNodeHandle &NH);
+    void writeNode(const DSNode &N);
+    void writeCalls(const DSGraph::FunctionListTy &Calls);
+
+  public:
+    explicit GraphEncoder(DSSummaryCache &C) : Cache(C), Failed(false) {}
+
+    bool encode(const DSGraph &G, std::string &Out);
+  };
+}
+
+//
+// Method: numberNodes()
+//
+// Description:
+//  Assign IDs to N and every node reachable from it that has not been
+//  numbered yet.  Links are followed in increasing offset order.
+//
+void GraphEncoder::numberNodes(const DSNode *N) {
+  std::vector<const DSNode*> Worklist;
+  if (N) Worklist.push_back(N);
+  while (!Worklist.empty()) {
+    const DSNode *Cur = Worklist.back();
+    Worklist.pop_back();
+    if (NodeIDs.count(Cur))
+      continue;
+    Nodes.push_back(Cur);
+    NodeIDs[Cur] = Nodes.size();
+
+    for (DSNode::const_edge_iterator I = Cur->edge_end(), B = Cur->edge_begin();
+         I != B; ) {
+      --I;
+      if (const DSNode *Link = I->second.getNode())
+        if (!NodeIDs.count(Link))
+          Worklist.push_back(Link);
+    }
+  }
+}
+
+void GraphEncoder::numberCallSite(const DSCallSite &CS) {
+  if (CS.isIndirectCall())
+    numberNodes(CS.getCalleeNode());
+  numberNodes(CS.getRetVal().getNode());
+  numberNodes(CS.getVAVal().getNode());
+  for (unsigned i = 0, e = CS.getNumPtrArgs(); i != e; ++i)
+    numberNodes(CS.getPtrArg(i).getNode());
+}
+
+void GraphEncoder::writeRef(const ValueRef &R) {
+  writeVBR(Body, R.Kind);
+  writeVBR(Body, getStringID(R.Name));
+  writeVBR(Body, R.Index);
+}
+
+void GraphEncoder::writeHandle(const DSNodeHandle &NH) {
+  DSNode *N = NH.getNode();
+  if (!N) {
+    writeVBR(Body, 0);
+    return;
+  }
+  assert(NodeIDs.count(N) && "Handle to a node that was not numbered!");
+  writeVBR(Body, NodeIDs[N]);
+  writeVBR(Body, NH.getOffset());
+}
+
+void GraphEncoder::writeNode(const DSNode &N) {
+  // Type records, with each type set in a canonical order.
+  writeVBR(Body, std::distance(N.type_begin(), N.type_end()));
+  for (DSNode::const_type_iterator I = N.type_begin(), E = N.type_end();
+       I != E; ++I) {
+    writeVBR(Body, I->first);
+    if (!I->second) {
+      writeVBR(Body, 0);
+      continue;
+    }
+    std::vector<std::string> Types;
+    for (svset<Type*>::const_iterator TI = I->second->begin(),
+         TE = I->second->end(); TI != TE; ++TI)
+      Types.push_back(Strings[getTypeID(*TI)]);
+    std::sort(Types.begin(), Types.end());
+    writeVBR(Body, Types.size());
+    for (unsigned i = 0, e = Types.size(); i != e; ++i)
+      writeVBR(Body, getStringID(Types[i]));
+  }
+
+  // Outgoing edges.  Null links carry no information and are skipped.
+  unsigned NumLinks = 0;
+  for (DSNode::const_edge_iterator I = N.edge_begin(), E = N.edge_end();
+       I != E; ++I)
+    if (!I->second.isNull())
+      ++NumLinks;
+  writeVBR(Body, NumLinks);
+  for (DSNode::const_edge_iterator I = N.edge_begin(), E = N.edge_end();
+       I != E; ++I)
+    if (!I->second.isNull()) {
+      writeVBR(Body, I->first);
+      writeHandle(I->second);
+    }
+
+  // Globals, by name.
+  std::vector<std::string> Globals;
+  for (DSNode::globals_iterator I = N.globals_begin(), E = N.globals_end();
+       I != E; ++I) {
+    if (!(*I)->hasName()) {
+      Failed = true;
+      return;
+    }
+    Globals.push_back((*I)->getName());
+  }
+  std::sort(Globals.begin(), Globals.end());
+  writeVBR(Body, Globals.size());
+  for (unsigned i = 0, e = Globals.size(); i != e; ++i)
+    writeVBR(Body, getStringID(Globals[i]));
+}
+
+void GraphEncoder::writeCalls(const DSGraph::FunctionListTy &Calls) {
+  // Order the call sites by the instruction they belong to.
+  std::vector<std::pair<ValueRef, const DSCallSite*> > Sorted;
+  for (DSGraph::FunctionListTy::const_iterator I = Calls.begin(),
+       E = Calls.end(); I != E; ++I) {
+    ValueRef R;
+    if (!getRef(I->getCallSite().getInstruction(), R)) {
+      Failed = true;
+      return;
+    }
+    Sorted.push_back(std::make_pair(R, &*I));
+  }
+  std::stable_sort(Sorted.begin(), Sorted.end(),
+                   [](const std::pair<ValueRef, const DSCallSite*> &A,
+                      const std::pair<ValueRef, const DSCallSite*> &B) {
+                     return A.first < B.first;
+                   });
+
+  writeVBR(Body, Sorted.size());
+  for (unsigned i = 0, e = Sorted.size(); i != e; ++i) {
+    const DSCallSite &CS = *Sorted[i].second;
+    writeRef(Sorted[i].first);
+    writeVBR(Body, CS.isDirectCall());
+    if (CS.isDirectCall())
+      writeVBR(Body, getStringID(CS.getCalleeFunc()->getName()));
+    else
+      writeHandle(DSNodeHandle(CS.getCalleeNode()));
+    writeHandle(CS.getRetVal());
+    writeHandle(CS.getVAVal());
+    writeVBR(Body, CS.getNumPtrArgs());
+    for (unsigned a = 0, ae = CS.getNumPtrArgs(); a != ae; ++a)
+      writeHandle(CS.getPtrArg(a));
+
+    std::vector<ValueRef> Mapped;
+    for (DSCallSite::MappedSites_t::iterator MI = CS.ms_begin(),
+         ME = CS.ms_end(); MI != ME; ++MI) {
+      ValueRef R;
+      if (!getRef(MI->getInstruction(), R)) {
+        Failed = true;
+        return;
+      }
+      Mapped.push_back(R);
+    }
+    std::sort(Mapped.begin(), Mapped.end());
+    writeVBR(Body, Mapped.size());
+    for (unsigned m = 0, me = Mapped.size(); m != me; ++m)
+      writeRef(Mapped[m]);
+  }
+}
+
+//
+// Method: encode()
+//
+// Description:
+//  Encode G into Out.  Returns false if G refers to something that cannot be
+//  named across compilations (e.g., an unnamed global), in which case it must
+//  not be cached.
+//
+bool GraphEncoder::encode(const DSGraph &G, std::string &Out) {
+  //
+  // Gather the roots of the graph in canonical order.
+  //
+  std::vector<std::pair<std::string, const DSNodeHandle*> > Returns, VANodes;
+  for (DSGraph::retnodes_iterator I = G.retnodes_begin(),
+       E = G.retnodes_end(); I != E; ++I)
+    Returns.push_back(std::make_pair(I->first->getName().str(), &I->second));
+  for (DSGraph::vanodes_iterator I = G.vanodes_begin(),
+       E = G.vanodes_end(); I != E; ++I)
+    VANodes.push_back(std::make_pair(I->first->getName().str(), &I->second));
+  std::sort(Returns.begin(), Returns.end());
+  std::sort(VANodes.begin(), VANodes.end());
+
+  std::vector<std::pair<ValueRef, const DSNodeHandle*> > Scalars;
+  for (DSScalarMap::const_iterator I = G.getScalarMap().begin(),
+       E = G.getScalarMap().end(); I != E; ++I) {
+    ValueRef R;
+    if (!getRef(I->first, R))
+      return false;
+    Scalars.push_back(std::make_pair(R, &I->second));
+  }
+  std::sort(Scalars.begin(), Scalars.end(),
+            [](const std::pair<ValueRef, const DSNodeHandle*> &A,
+               const std::pair<ValueRef, const DSNodeHandle*> &B) {
+              return A.first < B.first;
+            });
+
+  //
+  // Number every node: first those reachable from the roots, then anything
+  // that is only kept alive by the graph's node list.
+  //
+  for (unsigned i = 0, e = Returns.size(); i != e; ++i)
+    numberNodes(Returns[i].second->getNode());
+  for (unsigned i = 0, e = VANodes.size(); i != e; ++i)
+    numberNodes(VANodes[i].second->getNode());
+  for (unsigned i = 0, e = Scalars.size(); i != e; ++i)
+    numberNodes(Scalars[i].second->getNode());
+  for (DSGraph::fc_iterator I = G.fc_begin(), E = G.fc_end(); I != E; ++I)
+    numberCallSite(*I);
+  for (DSGraph::afc_const_iterator I = G.afc_begin(), E = G.afc_end();
+       I != E; ++I)
+    numberCallSite(*I);
+  for (DSGraph::node_const_iterator I = G.node_begin(), E = G.node_end();
+       I != E; ++I)
+    numberNodes(&*I);
+
+  //
+  // Node headers come first so that the sizes of all nodes are known before
+  // any handle into them is rebuilt.
+  //
+  writeVBR(Body, Nodes.size());
+  for (unsigned i = 0, e = Nodes.size(); i != e; ++i) {
+    writeVBR(Body, Nodes[i]->getNodeFlags());
+    writeVBR(Body, Nodes[i]->getSize());
+  }
+  for (unsigned i = 0, e = Nodes.size(); i != e && !Failed; ++i)
+    writeNode(*Nodes[i]);
+
+  writeVBR(Body, Returns.size());
+  for (unsigned i = 0, e = Returns.size(); i != e; ++i) {
+    writeVBR(Body, getStringID(Returns[i].first));
+    writeHandle(*Returns[i].second);
+  }
+  writeVBR(Body, VANodes.size());
+  for (unsigned i = 0, e = VANodes.size(); i != e; ++i) {
+    writeVBR(Body, getStringID(VANodes[i].first));
+    writeHandle(*VANodes[i].second);
+  }
+  writeVBR(Body, Scalars.size());
+  for (unsigned i = 0, e = Scalars.size(); i != e; ++i) {
+    writeRef(Scalars[i].first);
+    writeHandle(*Scalars[i].second);
+  }
+  writeCalls(G.getFunctionCalls());
+  writeCalls(G.getAuxFunctionCalls());
+  if (Failed)
+    return false;
+
+  Out.clear();
+  writeVBR(Out, Strings.size());
+  for (unsigned i = 0, e = Strings.size(); i != e; ++i)
+    writeBlob(Out, Strings[i]);
+  Out += Body;
+  return true;
+}
+
+//===----------------------------------------------------------------------===//
+// DSSummaryCache Implementation
+//===----------------------------------------------------------------------===//
+
+DSSummaryCache::DSSummaryCache(Module &Mod, const std::string &Dir,
+                               const char *PassName)
+  : M(Mod), CacheDir(Dir), TypeTableBuilt(false) {
+  if (std::error_code EC = sys::fs::create_directories(CacheDir))
+    DEBUG(errs() << "dsa-cache: cannot create " << CacheDir << ": "
+                 << EC.message() << "\n");
+
+  //
+  // The base salt covers everything outside of a function body that can
+  // change the graphs: the options of the DSA passes (and the magic sections
+  // file they name), the target, the globals and their initializers, and the
+  // external functions.
+  //
+  std::string Env;
+  raw_string_ostream OS(Env);
+  OS << Magic << FormatVersion << "\n" << PassName << "\n"
+     << noDSACallConv << noDSACallNumArgs << noDSACallVA << noDSACallFP
+     << noStdLibFold << DisableStdLib << TypeInferenceOptimize << "\n"
+     << hasMagicSections << "\n";
+  if (!hasMagicSections.empty()) {
+    ErrorOr<std::unique_ptr<MemoryBuffer> > Sections =
+      MemoryBuffer::getFile(hasMagicSections);
+    if (Sections)
+      OS << (*Sections)->getBuffer();
+  }
+  OS << M.getDataLayoutStr() << "\n" << M.getTargetTriple() << "\n";
+  for (Module::global_iterator I = M.global_begin(), E = M.global_end();
+       I != E; ++I)
+    I->print(OS);
+  for (Module::alias_iterator I = M.alias_begin(), E = M.alias_end();
+       I != E; ++I)
+    I->print(OS);
+  for (Module::iterator I = M.begin(), E = M.end(); I != E; ++I)
+    if (I->isDeclaration())
+      I->print(OS);
+  Salt = hashString(OS.str());
+
+  computeFunctionKeys();
+
+  //
+  // Any address-taken function may be resolved as the target of an indirect
+  // call, and then its graph and those of everything it calls are inlined.
+  // Fold their keys, which cover their callees transitively, into the salt.
+  //
+  std::vector<std::string> Targets;
+  for (Module::iterator I = M.begin(), E = M.end(); I != E; ++I)
+    if (!I->isDeclaration() && I->hasAddressTaken())
+      Targets.push_back(I->getName().str() + ":" + FunctionKeys[I]);
+  std::sort(Targets.begin(), Targets.end());
+  std::string Combined = Salt;
+  for (unsigned i = 0, e = Targets.size(); i != e; ++i)
+    Combined += Targets[i] + "\n";
+  Salt = hashString(Combined);
+}
+
+//
+// Method: computeFunctionKeys()
+//
+// Description:
+//  Compute the content key of every defined function.  Functions are grouped
+//  into the SCCs of the direct call graph; every function in an SCC gets a
+//  key derived from the bodies of the SCC and the keys of its callee SCCs.
+//
+void DSSummaryCache::computeFunctionKeys() {
+  std::map<const Function*, std::string> Bodies;
+  std::map<const Function*, std::vector<const Function*> > Callees;
+  for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F) {
+    if (F->isDeclaration())
+      continue;
+    std::string Text;
+    raw_string_ostream OS(Text);
+    F->print(OS);
+    Bodies[F] = hashString(OS.str());
+
+    std::vector<const Function*> &CalleeList = Callees[F];
+    for (inst_iterator I = inst_begin(F), IE = inst_end(F); I != IE; ++I) {
+      CallSite CS(&*I);
+      if (!CS)
+        continue;
+      const Function *Callee =
+        dyn_cast<Function>(CS.getCalledValue()->stripPointerCasts());
+      if (Callee && !Callee->isDeclaration())
+        CalleeList.push_back(Callee);
+    }
+  }
+
+  //
+  // Tarjan's algorithm over the direct call graph, using an explicit stack
+  // of (function, next callee) pairs.
+  //
+  std::map<const Function*, unsigned> Index, LowLink;
+  std::set<const Function*> OnStack;
+  std::vector<const Function*> SCCStack;
+  unsigned NextIndex = 0;
+
+  for (Module::iterator Root = M.begin(), RE = M.end(); Root != RE; ++Root) {
+    if (Root->isDeclaration() || Index.count(Root))
+      continue;
+
+    std::vector<std::pair<const Function*, unsigned> > Visit;
+    Visit.push_back(std::make_pair((const Function*)Root, 0u));
+    Index[Root] = LowLink[Root] = NextIndex++;
+    SCCStack.push_back(Root);
+    OnStack.insert(Root);
+
+    while (!Visit.empty()) {
+      const Function *F = Visit.back().first;
+      std::vector<const Function*> &CalleeList = Callees[F];
+      if (Visit.back().second < CalleeList.size()) {
+        const Function *Callee = CalleeList[Visit.back().second++];
+        if (!Index.count(Callee)) {
+          Index[Callee] = LowLink[Callee] = NextIndex++;
+          SCCStack.push_back(Callee);
+          OnStack.insert(Callee);
+          Visit.push_back(std::make_pair(Callee, 0u));
+        } else if (OnStack.count(Callee)) {
+          LowLink[F] = std::min(LowLink[F], Index[Callee]);
+        }
+        continue;
+      }
+
+      Visit.pop_back();
+      if (!Visit.empty())
+        LowLink[Visit.back().first] =
+          std::min(LowLink[Visit.back().first], LowLink[F]);
+      if (LowLink[F] != Index[F])
+        continue;
+
+      // F is the root of an SCC: pop it and hash it.
+      std::vector<const Function*> Members;
+      const Function *Member;
+      do {
+        Member = SCCStack.back();
+        SCCStack.pop_back();
+        OnStack.erase(Member);
+        Members.push_back(Member);
+      } while (Member != F);
+
+      std::set<const Function*> MemberSet(Members.begin(), Members.end());
+      std::vector<std::string> Parts;
+      for (unsigned i = 0, e = Members.size(); i != e; ++i) {
+        Parts.push_back("B" + Bodies[Members[i]]);
+        std::vector<const Function*> &CL = Callees[Members[i]];
+        for (unsigned c = 0, ce = CL.size(); c != ce; ++c)
+          if (!MemberSet.count(CL[c]))
+            Parts.push_back("K" + FunctionKeys[CL[c]]);
+      }
+      std::sort(Parts.begin(), Parts.end());
+      Parts.erase(std::unique(Parts.begin(), Parts.end()), Parts.end());
+
+      std::string Combined = Salt;
+      for (unsigned i = 0, e = Parts.size(); i != e; ++i)
+        Combined += Parts[i];
+      std::string Key = hashString(Combined);
+      for (unsigned i = 0, e = Members.size(); i != e; ++i)
+        FunctionKeys[Members[i]] = Key;
+    }
+  }
+}
+
+std::string
+DSSummaryCache::getKey(const std::vector<const Function*> &Functions) const {
+  std::vector<std::string> Parts;
+  for (unsigned i = 0, e = Functions.size(); i != e; ++i) {
+    std::map<const Function*, std::string>::const_iterator I =
+      FunctionKeys.find(Functions[i]);
+    Parts.push_back(Functions[i]->getName().str() + ":" +
+                    (I == FunctionKeys.end() ? std::string() : I->second));
+  }
+  std::sort(Parts.begin(), Parts.end());
+
+  std::string Combined = Salt;
+  for (unsigned i = 0, e = Parts.size(); i != e; ++i)
+    Combined += Parts[i] + "\n";
+  return hashString(Combined);
+}
+
+std::string DSSummaryCache::getPath(const std::string &Key) const {
+  SmallString<256> Path(CacheDir);
+  sys::path::append(Path, Key + ".dsbu");
+  return Path.str();
+}
+
+void DSSummaryCache::numberInstructions(const Function &F) {
+  if (InstTable.count(&F))
+    return;
+  std::vector<Instruction*> &Table = InstTable[&F];
+  for (const_inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    InstNumbers[&*I] = Table.size();
+    Table.push_back(const_cast<Instruction*>(&*I));
+  }
+}
+
+bool DSSummaryCache::getValueRef(const Value *V, unsigned &Kind,
+                                 std::string &Name, unsigned &Index) {
+  if (const GlobalValue *GV = dyn_cast<GlobalValue>(V)) {
+    if (!GV->hasName())
+      return false;
+    Kind = GlobalRef;
+    Name = GV->getName();
+    Index = 0;
+    return true;
+  }
+
+  if (const Argument *A = dyn_cast<Argument>(V)) {
+    if (!A->getParent()->hasName())
+      return false;
+    Kind = ArgumentRef;
+    Name = A->getParent()->getName();
+    Index = A->getArgNo();
+    return true;
+  }
+
+  if (const Instruction *I = dyn_cast<Instruction>(V)) {
+    const Function *F = I->getParent()->getParent();
+    if (!F->hasName())
+      return false;
+    numberInstructions(*F);
+    Kind = InstructionRef;
+    Name = F->getName();
+    Index = InstNumbers[I];
+    return true;
+  }
+
+  // Constant expressions and the like cannot be named reliably.
+  return false;
+}
+
+//
+// Method: buildTypeTable()
+//
+// Description:
+//  Record every type used in the module under its printed name so that the
+//  type records of cached nodes can be mapped back to Type objects.
+//
+void DSSummaryCache::buildTypeTable() {
+  TypeTableBuilt = true;
+
+  std::set<Type*> Types;
+  std::set<const Value*> VisitedConstants;
+  std::vector<Type*> TypeWorklist;
+  std::vector<const Value*> ValueWorklist;
+
+  for (Module::global_iterator I = M.global_begin(), E = M.global_end();
+       I != E; ++I)
+    ValueWorklist.push_back(I);
+  for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F) {
+    ValueWorklist.push_back(F);
+    for (Function::arg_iterator A = F->arg_begin(), AE = F->arg_end();
+         A != AE; ++A)
+      TypeWorklist.push_back(A->getType());
+    for (inst_iterator I = inst_begin(F), IE = inst_end(F); I != IE; ++I) {
+      TypeWorklist.push_back(I->getType());
+      if (AllocaInst *AI = dyn_cast<AllocaInst>(&*I))
+        TypeWorklist.push_back(AI->getAllocatedType());
+      for (User::op_iterator OI = I->op_begin(), OE = I->op_end();
+           OI != OE; ++OI)
+        ValueWorklist.push_back(*OI);
+    }
+  }
+
+  //
+  // Walk global initializers and constant operands, which may mention types
+  // that no instruction produces directly.
+  //
+  while (!ValueWorklist.empty()) {
+    const Value *V = ValueWorklist.back();
+    ValueWorklist.pop_back();
+    if (!V || !VisitedConstants.insert(V).second)
+      continue;
+    TypeWorklist.push_back(V->getType());
+    if (const GlobalVariable *GV = dyn_cast<GlobalVariable>(V)) {
+      if (GV->hasInitializer())
+        ValueWorklist.push_back(GV->getInitializer());
+    } else if (isa<Constant>(V) && !isa<GlobalValue>(V)) {
+      const User *U = cast<User>(V);
+      for (User::const_op_iterator OI = U->op_begin(), OE = U->op_end();
+           OI != OE; ++OI)
+        ValueWorklist.push_back(*OI);
+    }
+  }
+
+  while (!TypeWorklist.empty()) {
+    Type *Ty = TypeWorklist.back();
+    TypeWorklist.pop_back();
+    if (!Ty || !Types.insert(Ty).second)
+      continue;
+    TypeWorklist.insert(TypeWorklist.end(), Ty->subtype_begin(),
+                        Ty->subtype_end());
+  }
+
+  for (std::set<Type*>::iterator I = Types.begin(), E = Types.end();
+       I != E; ++I) {
+    std::string Str;
+    raw_string_ostream OS(Str);
+    (*I)->print(OS);
+    TypeTable[OS.str()] = *I;
+  }
+}
+
+//
+// Method: decodeGraph()
+//
+// Description:
+//  Rebuild a graph from the encoding produced by GraphEncoder::encode().
+//  This needs direct access to the type records of the new nodes, which is
+//  why it is a member of DSSummaryCache rather than of a helper class.
+//
+DSGraph *
+DSSummaryCache::decodeGraph(StringRef Data,
+                            EquivalenceClasses<const GlobalValue*> &ECs,
+                            const DataLayout &TD, SuperSet<Type*> &TypeSS,
+                            DSGraph *GlobalsGraph) {
+  if (!TypeTableBuilt)
+    buildTypeTable();
+
+  Reader R(Data);
+  std::vector<StringRef> Strings(R.readVBR());
+  for (unsigned i = 0, e = Strings.size(); i != e && !R.failed(); ++i)
+    Strings[i] = R.readBlob();
+
+  uint64_t NumNodes = R.readVBR();
+  if (R.failed() || NumNodes > Data.size())
+    return 0;
+
+  DSGraph *G = new DSGraph(ECs, TD, TypeSS, GlobalsGraph);
+  std::vector<DSNode*> Nodes;
+  bool OK = true;
+
+  for (uint64_t i = 0; i != NumNodes; ++i) {
+    DSNode *N = new DSNode(G);
+    N->NodeType = R.readVBR() & ~DSNode::DeadNode;
+    N->Size = R.readVBR();
+    Nodes.push_back(N);
+  }
+
+  // Helpers for reading strings, handles and value references.
+#define READ_STRING(S)                                                        \
+  do {                                                                        \
+    uint64_t ID = R.readVBR();                                                \
+    if (R.failed() || ID >= Strings.size()) { OK = false; goto done; }       \
+    S = Strings[ID];                                                          \
+  } while (0)
+
+#define READ_HANDLE(NH)                                                       \
+  do {                                                                        \
+    uint64_t ID = R.readVBR();                                                \
+    if (ID) {                                                                 \
+      uint64_t Off = R.readVBR();                                             \
+      if (R.failed() || ID > Nodes.size() ||                                  \
+          (Off && Off >= Nodes[ID - 1]->getSize())) {                         \
+        OK = false; goto done;                                                \
+      }                                                                       \
+      NH.setTo(Nodes[ID - 1], Off);                                           \
+    }                                                                         \
+  } while (0)
+
+#define READ_VALUE(V)                                                         \
+  do {                                                                        \
+    unsigned Kind = R.readVBR();                                              \
+    StringRef Name;                                                           \
+    READ_STRING(Name);                                                        \
+    unsigned Index = R.readVBR();                                             \
+    V = 0;                                                                    \
+    if (Kind == GlobalRef) {                                                  \
+      V = M.getNamedValue(Name);                                              \
+    } else if (Function *F = M.getFunction(Name)) {                           \
+      if (Kind == ArgumentRef && Index < F->arg_size()) {                     \
+        Function::arg_iterator A = F->arg_begin();                            \
+        std::advance(A, Index);                                               \
+        V = A;                                                                \
+      } else if (Kind == InstructionRef && !F->isDeclaration()) {             \
+        numberInstructions(*F);                                               \
+        if (Index < InstTable[F].size())                                      \
+          V = InstTable[F][Index];                                            \
+      }                                                                       \
+    }                                                                         \
+    if (R.failed() || !V) { OK = false; goto done; }                          \
+  } while (0)
+
+  {
+    //
+    // Node bodies: type records, links and globals.
+    //
+    for (unsigned i = 0, e = Nodes.size(); i != e; ++i) {
+      DSNode *N = Nodes[i];
+      uint64_t NumTypes = R.readVBR();
+      for (uint64_t t = 0; t != NumTypes && !R.failed(); ++t) {
+        unsigned Offset = R.readVBR();
+        uint64_t Count = R.readVBR();
+        svset<Type*> TypeSet;
+        for (uint64_t c = 0; c != Count; ++c) {
+          StringRef Name;
+          READ_STRING(Name);
+          StringMap<Type*>::iterator TI = TypeTable.find(Name);
+          if (TI == TypeTable.end()) { OK = false; goto done; }
+          TypeSet.insert(TI->second);
+        }
+        N->TyMap[Offset] = TypeSS.getOrCreate(TypeSet);
+      }
+
+      uint64_t NumLinks = R.readVBR();
+      for (uint64_t l = 0; l != NumLinks && !R.failed(); ++l) {
+        unsigned Offset = R.readVBR();
+        DSNodeHandle NH;
+        READ_HANDLE(NH);
+        N->Links[Offset] = NH;
+      }
+
+      uint64_t NumGlobals = R.readVBR();
+      for (uint64_t g = 0; g != NumGlobals && !R.failed(); ++g) {
+        StringRef Name;
+        READ_STRING(Name);
+        GlobalValue *GV = M.getNamedValue(Name);
+        if (!GV) { OK = false; goto done; }
+        N->Globals.insert(GV);
+      }
+    }
+
+    //
+    // Return and var-arg nodes.
+    //
+    for (unsigned Pass = 0; Pass != 2; ++Pass) {
+      uint64_t Count = R.readVBR();
+      for (uint64_t i = 0; i != Count && !R.failed(); ++i) {
+        StringRef Name;
+        READ_STRING(Name);
+        Function *F = M.getFunction(Name);
+        if (!F) { OK = false; goto done; }
+        DSNodeHandle NH;
+        READ_HANDLE(NH);
+        if (Pass == 0)
+          G->getOrCreateReturnNodeFor(*F) = NH;
+        else
+          G->getOrCreateVANodeFor(*F) = NH;
+      }
+    }
+
+    //
+    // Scalar map.
+    //
+    uint64_t NumScalars = R.readVBR();
+    for (uint64_t i = 0; i != NumScalars && !R.failed(); ++i) {
+      Value *V;
+      READ_VALUE(V);
+      DSNodeHandle NH;
+      READ_HANDLE(NH);
+      G->getScalarMap().getRawEntryRef(V) = NH;
+    }
+
+    //
+    // Call sites, then auxiliary call sites.
+    //
+    for (unsigned Pass = 0; Pass != 2; ++Pass) {
+      DSGraph::FunctionListTy &Calls =
+        Pass == 0 ? G->getFunctionCalls() : G->getAuxFunctionCalls();
+      uint64_t Count = R.readVBR();
+      for (uint64_t i = 0; i != Count && !R.failed(); ++i) {
+        Value *V;
+        READ_VALUE(V);
+        CallSite CS(V);
+        if (!CS) { OK = false; goto done; }
+
+        bool IsDirect = R.readVBR();
+        const Function *CalleeF = 0;
+        DSNodeHandle CalleeNH, RetNH, VANH;
+        if (IsDirect) {
+          StringRef Name;
+          READ_STRING(Name);
+          CalleeF = M.getFunction(Name);
+          if (!CalleeF) { OK = false; goto done; }
+        } else {
+          READ_HANDLE(CalleeNH);
+          if (CalleeNH.isNull()) { OK = false; goto done; }
+        }
+        READ_HANDLE(RetNH);
+        READ_HANDLE(VANH);
+
+        std::vector<DSNodeHandle> Args(R.readVBR());
+        for (unsigned a = 0, ae = Args.size(); a != ae && !R.failed(); ++a)
+          READ_HANDLE(Args[a]);
+
+        if (IsDirect)
+          Calls.push_back(DSCallSite(CS, RetNH, VANH, CalleeF, Args));
+        else
+          Calls.push_back(DSCallSite(CS, RetNH, VANH, CalleeNH.getNode(),
+                                     Args));
+
+        uint64_t NumMapped = R.readVBR();
+        for (uint64_t m = 0; m != NumMapped && !R.failed(); ++m) {
+          Value *MV;
+          READ_VALUE(MV);
+          CallSite MCS(MV);
+          if (!MCS) { OK = false; goto done; }
+          Calls.back().addMappedSite(MCS);
+        }
+      }
+    }
+  }
+
+#undef READ_VALUE
+#undef READ_HANDLE
+#undef READ_STRING
+
+done:
+  if (!OK || R.failed() || !R.atEnd()) {
+    delete G;
+    return 0;
+  }
+  G->setUseAuxCalls();
+  return G;
+}
+
+DSGraph *
+DSSummaryCache::load(const std::string &Key,
+                     const std::vector<const Function*> &Functions,
+                     EquivalenceClasses<const GlobalValue*> &ECs,
+                     const DataLayout &TD, SuperSet<Type*> &TypeSS,
+                     DSGraph *GlobalsGraph, DSGraph *&Contribution) {
+  ErrorOr<std::unique_ptr<MemoryBuffer> > Buffer =
+    MemoryBuffer::getFile(getPath(Key));
+  if (!Buffer)
+    return 0;
+
+  Reader R((*Buffer)->getBuffer());
+  if (R.readBlob() != Magic || R.readVBR() != FormatVersion)
+    return 0;
+  StringRef GraphData = R.readBlob();
+  StringRef ContributionData = R.readBlob();
+  if (R.failed())
+    return 0;
+
+  DSGraph *G = decodeGraph(GraphData, ECs, TD, TypeSS, GlobalsGraph);
+  if (!G)
+    return 0;
+
+  // The entry must describe exactly the functions we asked for.
+  std::set<const Function*> Expected(Functions.begin(), Functions.end());
+  std::set<const Function*> Found;
+  for (DSGraph::retnodes_iterator I = G->retnodes_begin(),
+       E = G->retnodes_end(); I != E; ++I)
+    Found.insert(I->first);
+  if (Found != Expected) {
+    delete G;
+    return 0;
+  }
+
+  Contribution = decodeGraph(ContributionData, ECs, TD, TypeSS, 0);
+  if (!Contribution) {
+    delete G;
+    return 0;
+  }
+  return G;
+}
+
+bool DSSummaryCache::store(const std::string &Key, const DSGraph &G,
+                           const DSGraph &Contribution) {
+  std::string GraphData, ContributionData;
+  if (!GraphEncoder(*this).encode(G, GraphData) ||
+      !GraphEncoder(*this).encode(Contribution, ContributionData))
+    return false;
+
+  std::string Data;
+  writeBlob(Data, Magic);
+  writeVBR(Data, FormatVersion);
+  writeBlob(Data, GraphData);
+  writeBlob(Data, ContributionData);
+
+  //
+  // Write to a temporary file and rename it into place so that concurrent
+  // compilations sharing the cache never see a partial entry.
+  //
+  std::string Path = getPath(Key);
+  SmallString<256> TmpPath;
+  int FD;
+  if (sys::fs::createUniqueFile(Path + ".%%%%%%.tmp", FD, TmpPath))
+    return false;
+  {
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Data;
+    if (OS.has_error()) {
+      OS.clear_error();
+      sys::fs::remove(TmpPath);
+      return false;
+    }
+  }
+  if (sys::fs::rename(TmpPath, Path)) {
+    sys::fs::remove(TmpPath);
+    return false;
+  }
+  return true;
+}
+
+void DSSummaryCache::remove(const std::string &Key) {
+  sys::fs::remove(getPath(Key));
+}
+
+bool DSSummaryCache::isEquivalent(const DSGraph &G1, const DSGraph &G2) {
+  std::string Data1, Data2;
+  if (!GraphEncoder(*this).encode(G1, Data1) ||
+      !GraphEncoder(*this).encode(G2, Data2))
+    return false;
+  return Data1 == Data2;
+}
@@ -471,9 +471,8 @@ void DSNode::mergeTypeInfo(const TyMapTy::mapped_type TyIt, unsigned Offset) {
         growSize(Offset + TD.getTypeAllocSize(*ni));
     }
   } else if (TyIt) {
-    svset<Type*> S(*TyMap[Offset]);
-    S.insert(TyIt->begin(), TyIt->end());
-    TyMap[Offset] = getParentGraph()->getTypeSS().getOrCreate(S);
+    TyMap[Offset] = getParentGraph()->getTypeSS().getOrCreateUnion(TyMap[Offset],
+                                                                  TyIt);
   }
   assert(TyMap[Offset]);
 }
@@ -505,7 +504,7 @@ void DSNode::addEdgeTo(unsigned Offset, const DSNodeHandle &NH) {
 }
 
 void DSNode::mergeGlobals(const DSNode &RHS) {
-  Globals.insert(RHS.Globals.begin(), RHS.Globals.end());
+  Globals.insert(RHS.Globals);
 }
 
 // MergeNodes - Helper function for DSNode::mergeWith().
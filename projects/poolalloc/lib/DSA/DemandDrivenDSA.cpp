@@ -0,0 +1,479 @@
+//===- DemandDrivenDSA.cpp - Answer DSA queries on demand -------------------//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a pass that answers DSA queries by analyzing slices of
+// the module.  A slice is a copy of the module in which only the functions
+// that can affect the queried function keep their bodies; it is analyzed by
+// a pass manager of its own.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "dsa-demand"
+
+#include "dsa/DemandDrivenDSA.h"
+#include "dsa/TypeSafety.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ValueSymbolTable.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+static RegisterPass<dsa::DemandDrivenDSA>
+X ("dsa-demand", "Answer DSA queries on demand", false, true);
+
+// Pass Statistics
+namespace {
+  STATISTIC (NumSlices,         "Number of slices analyzed");
+  STATISTIC (NumSliceFunctions, "Number of functions analyzed in slices");
+  STATISTIC (NumQueries,        "Number of DSA queries answered");
+  STATISTIC (NumCachedQueries,  "Number of DSA queries answered from cache");
+
+  cl::opt<double>
+  MaxSliceRatio ("dsa-demand-max-slice",
+                 cl::desc("Fraction of the functions of the module above which "
+                          "a slice analyzes the whole module"),
+                 cl::init(0.5));
+
+  // Values whose DSNode flags -analyze prints, as function:value
+  cl::list<std::string>
+  PrintQueries ("dsa-demand-print",
+                cl::CommaSeparated, cl::ReallyHidden);
+}
+
+namespace dsa {
+
+char DemandDrivenDSA::ID = 0;
+
+//
+// Pass: SliceAnalysis
+//
+// Description:
+//  This pass runs within the pass manager of a slice and records the results
+//  of the DSA passes for the slice.
+//
+struct SliceAnalysis : public ModulePass {
+  static char ID;
+  SliceAnalysis() : ModulePass(ID), DS(0), TS(0) {}
+
+  virtual bool runOnModule (Module & M) {
+    DS = &getAnalysis<EQTDDataStructures>();
+    TS = &getAnalysis<TypeSafety<EQTDDataStructures> >();
+    return false;
+  }
+
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+    AU.addRequired<EQTDDataStructures>();
+    AU.addRequired<TypeSafety<EQTDDataStructures> >();
+    AU.setPreservesAll();
+  }
+
+  EQTDDataStructures * DS;
+  TypeSafety<EQTDDataStructures> * TS;
+};
+
+char SliceAnalysis::ID = 0;
+
+//
+// Structure: Slice
+//
+// Description:
+//  A copy of the module in which the functions of the slice keep their
+//  bodies, along with the results of DSA for it.
+//
+struct DemandDrivenDSA::Slice {
+  std::set<const Function *> Functions;
+  ValueToValueMapTy VMap;
+  Module * M;
+  legacy::PassManager * Passes;
+  SliceAnalysis * Analysis;
+
+  Slice() : M(0), Passes(0), Analysis(0) {}
+  ~Slice() {
+    delete Passes;
+    delete M;
+  }
+};
+
+//
+// Method: runOnModule()
+//
+// Description:
+//  Record the direct calls of the module, the functions with indirect calls,
+//  and the functions whose address is taken.  Nothing is analyzed until a
+//  client asks a question.
+//
+bool
+DemandDrivenDSA::runOnModule (Module & Module) {
+  M = &Module;
+  NumDefined = 0;
+
+  for (Module::iterator F = M->begin(); F != M->end(); ++F) {
+    if (F->isDeclaration())
+      continue;
+    ++NumDefined;
+    if (F->hasAddressTaken())
+      AddressTaken.insert (F);
+
+    for (Function::iterator BB = F->begin(); BB != F->end(); ++BB) {
+      for (BasicBlock::iterator I = BB->begin(); I != BB->end(); ++I) {
+        CallSite CS (I);
+        if (!CS || isa<InlineAsm>(CS.getCalledValue()))
+          continue;
+        const Function * Callee = dyn_cast<Function>(
+          CS.getCalledValue()->stripPointerCasts());
+        if (!Callee) {
+          IndirectCallers.insert (F);
+        } else if (!Callee->isDeclaration()) {
+          Callees[F].push_back (Callee);
+          Callers[Callee].push_back (F);
+        }
+      }
+    }
+  }
+
+  return false;
+}
+
+void
+DemandDrivenDSA::releaseMemory () {
+  for (unsigned index = 0; index < Slices.size(); ++index)
+    delete Slices[index];
+  Slices.clear();
+  Answers.clear();
+  Callers.clear();
+  Callees.clear();
+  IndirectCallers.clear();
+  AddressTaken.clear();
+}
+
+//
+// Method: findSlice()
+//
+// Description:
+//  Find the functions whose DSGraphs the top-down graph of a function depends
+//  upon: the functions that can call it, and the functions that any of those
+//  or the function itself can call.  Indirect calls are assumed to reach
+//  every function whose address is taken.
+//
+// Outputs:
+//  Functions - The functions of the slice.
+//
+void
+DemandDrivenDSA::findSlice (const Function * F,
+                            std::set<const Function *> & Functions) {
+  std::vector<const Function *> Worklist;
+  Functions.insert (F);
+  Worklist.push_back (F);
+  while (!Worklist.empty()) {
+    const Function * G = Worklist.back();
+    Worklist.pop_back();
+    std::vector<const Function *> & C = Callers[G];
+    for (unsigned index = 0; index < C.size(); ++index)
+      if (Functions.insert (C[index]).second)
+        Worklist.push_back (C[index]);
+
+    if (AddressTaken.count (G)) {
+      std::set<const Function *>::iterator I = IndirectCallers.begin();
+      for (; I != IndirectCallers.end(); ++I)
+        if (Functions.insert (*I).second)
+          Worklist.push_back (*I);
+    }
+  }
+
+  Worklist.assign (Functions.begin(), Functions.end());
+  while (!Worklist.empty()) {
+    const Function * G = Worklist.back();
+    Worklist.pop_back();
+    std::vector<const Function *> & C = Callees[G];
+    for (unsigned index = 0; index < C.size(); ++index)
+      if (Functions.insert (C[index]).second)
+        Worklist.push_back (C[index]);
+
+    if (IndirectCallers.count (G)) {
+      std::set<const Function *>::iterator I = AddressTaken.begin();
+      for (; I != AddressTaken.end(); ++I)
+        if (Functions.insert (*I).second)
+          Worklist.push_back (*I);
+    }
+  }
+}
+
+//
+// Method: isUsedOutside()
+//
+// Description:
+//  Determine whether a value may be used by code that is not in the slice.
+//  Uses within the initializers of global variables are conservatively
+//  assumed to be.
+//
+bool
+DemandDrivenDSA::isUsedOutside (const Value * V,
+                                const std::set<const Function *> & Functions) {
+  for (Value::const_user_iterator U = V->user_begin(); U != V->user_end();
+       ++U) {
+    if (const Instruction * I = dyn_cast<Instruction>(*U)) {
+      if (!Functions.count (I->getParent()->getParent()))
+        return true;
+    } else if (isa<GlobalValue>(*U)) {
+      return true;
+    } else if (isUsedOutside (*U, Functions)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+//
+// Method: buildSlice()
+//
+// Description:
+//  Copy the module, drop the bodies of the functions outside of the slice, and
+//  run DSA on the copy.  Functions and global variables of the slice that the
+//  dropped code may use are made externally visible, so that DSA does not
+//  assume that it sees all of their uses.
+//
+DemandDrivenDSA::Slice *
+DemandDrivenDSA::buildSlice (const std::set<const Function *> & Functions) {
+  Slice * S = new Slice;
+  S->Functions = Functions;
+  S->M = CloneModule (M, S->VMap);
+
+  bool Whole = (Functions.size() == NumDefined);
+  if (!Whole) {
+    for (Module::iterator F = M->begin(); F != M->end(); ++F) {
+      if (F->isDeclaration())
+        continue;
+
+      Function * Copy = cast<Function>(S->VMap[F]);
+      if (!Functions.count (F))
+        Copy->deleteBody();
+      else if (Copy->hasLocalLinkage() && isUsedOutside (F, Functions))
+        Copy->setLinkage (GlobalValue::ExternalLinkage);
+    }
+
+    for (Module::global_iterator GV = M->global_begin();
+         GV != M->global_end(); ++GV) {
+      GlobalVariable * Copy = cast<GlobalVariable>(S->VMap[GV]);
+      if (Copy->hasLocalLinkage() && isUsedOutside (GV, Functions))
+        Copy->setLinkage (GlobalValue::ExternalLinkage);
+    }
+  }
+
+  DEBUG (errs() << "DemandDrivenDSA: analyzing " << Functions.size()
+                << " of " << NumDefined << " functions\n");
+
+  S->Analysis = new SliceAnalysis();
+  S->Passes = new legacy::PassManager();
+  S->Passes->add (S->Analysis);
+  S->Passes->run (*S->M);
+
+  ++NumSlices;
+  NumSliceFunctions += Functions.size();
+  Slices.push_back (S);
+  return S;
+}
+
+//
+// Method: getSlice()
+//
+// Description:
+//  Return a slice that can answer queries about the specified function,
+//  analyzing a new one if none of the existing slices holds every function
+//  that the answers depend upon.  If the slice of the function holds most of
+//  the module, analyze the whole module instead so that it answers every later
+//  query.
+//
+DemandDrivenDSA::Slice *
+DemandDrivenDSA::getSlice (const Function * F) {
+  std::set<const Function *> Functions;
+  findSlice (F, Functions);
+
+  for (unsigned index = 0; index < Slices.size(); ++index) {
+    const std::set<const Function *> & Have = Slices[index]->Functions;
+    if (std::includes (Have.begin(), Have.end(),
+                       Functions.begin(), Functions.end()))
+      return Slices[index];
+  }
+
+  if (Functions.size() > MaxSliceRatio * NumDefined) {
+    for (Module::iterator G = M->begin(); G != M->end(); ++G)
+      if (!G->isDeclaration())
+        Functions.insert (G);
+  }
+
+  return buildSlice (Functions);
+}
+
+//
+// Method: getAnswer()
+//
+// Description:
+//  Find what DSA says about the DSNode of a pointer within a function.
+//
+DemandDrivenDSA::Answer
+DemandDrivenDSA::getAnswer (const Value * V, const Function * F) {
+  ++NumQueries;
+  std::pair<const Value *, const Function *> Key (V, F);
+  DenseMap<std::pair<const Value *, const Function *>, Answer>::iterator I;
+  I = Answers.find (Key);
+  if (I != Answers.end()) {
+    ++NumCachedQueries;
+    return I->second;
+  }
+
+  Answer A;
+  A.HasNode = false;
+  A.TypeSafe = false;
+  A.Flags = 0;
+
+  assert (!F->isDeclaration() && "Query about a function without a body!\n");
+  Slice * S = getSlice (F);
+  const Function * SF = cast<Function>(S->VMap[F]);
+  const Value * SV = MapValue (V, S->VMap);
+  if (SV) {
+    EQTDDataStructures * DS = S->Analysis->DS;
+    DSGraph * G = DS->getDSGraph (*SF);
+    DSNodeHandle NH;
+    if (G->hasNodeForValue (SV))
+      NH = G->getNodeForValue (SV);
+
+    //
+    // Globals may only have a DSNode in the globals graph, possibly through
+    // the leader of their equivalence class.
+    //
+    if (NH.isNull() && isa<GlobalValue>(SV) && !isa<GlobalAlias>(SV)) {
+      DSGraph * GG = DS->getGlobalsGraph();
+      const GlobalValue * GV = cast<GlobalValue>(SV);
+      if (GG->hasNodeForValue (GV))
+        NH = GG->getNodeForValue (GV);
+      else
+        NH = GG->getNodeForValue (GG->getGlobalECs().getLeaderValue (GV));
+    }
+
+    if (DSNode * N = NH.getNode()) {
+      A.HasNode = true;
+      A.Flags = N->getNodeFlags();
+      A.TypeSafe = S->Analysis->TS->isTypeSafe (SV, SF);
+    }
+  }
+
+  Answers[Key] = A;
+  return A;
+}
+
+//
+// Method: getNodeFlags()
+//
+// Description:
+//  Find the flags of the DSNode of a pointer within a function.
+//
+// Return value:
+//  true  - The pointer has a DSNode; Flags holds its flags.
+//  false - DSA has no DSNode for the pointer.
+//
+bool
+DemandDrivenDSA::getNodeFlags (const Value * V, const Function * F,
+                               unsigned & Flags) {
+  Answer A = getAnswer (V, F);
+  Flags = A.Flags;
+  return A.HasNode;
+}
+
+//
+// Method: isTypeSafe()
+//
+// Description:
+//  Determine whether a pointer within a function is used in a type-consistent
+//  fashion, as defined by the TypeSafety pass.
+//
+bool
+DemandDrivenDSA::isTypeSafe (const Value * V, const Function * F) {
+  return getAnswer (V, F).TypeSafe;
+}
+
+//
+// Method: isComplete()
+//
+// Description:
+//  Determine whether DSA knows every memory object to which a pointer within a
+//  function can point.
+//
+bool
+DemandDrivenDSA::isComplete (const Value * V, const Function * F) {
+  Answer A = getAnswer (V, F);
+  const unsigned Unknown = DSNode::IncompleteNode | DSNode::UnknownNode |
+                           DSNode::ExternalNode | DSNode::IntToPtrNode;
+  return A.HasNode && !(A.Flags & Unknown);
+}
+
+//
+// Method: isHeapOnly()
+//
+// Description:
+//  Determine whether a pointer within a function can only point to heap
+//  objects.
+//
+bool
+DemandDrivenDSA::isHeapOnly (const Value * V, const Function * F) {
+  if (!isComplete (V, F))
+    return false;
+
+  Answer A = getAnswer (V, F);
+  const unsigned NotHeap = DSNode::AllocaNode | DSNode::GlobalNode;
+  return (A.Flags & DSNode::HeapNode) && !(A.Flags & NotHeap);
+}
+
+//
+// Method: print()
+//
+// Description:
+//  Print the flags of the DSNodes of the values named by -dsa-demand-print,
+//  one line per value, with the letters that -print-only-flags uses for the
+//  DSA passes.  A value without a DSNode prints an empty line.
+//
+void
+DemandDrivenDSA::print (raw_ostream & O, const Module * Mod) const {
+  DemandDrivenDSA * This = const_cast<DemandDrivenDSA *>(this);
+  for (unsigned index = 0; index < PrintQueries.size(); ++index) {
+    StringRef Query = PrintQueries[index];
+    std::pair<StringRef, StringRef> Names = Query.split (':');
+    const Function * F = Mod->getFunction (Names.first.ltrim ("@"));
+    assert (F && !F->isDeclaration() && "Unable to find function specified!");
+    const Value * V = F->getValueSymbolTable().lookup (Names.second);
+    if (!V)
+      V = Mod->getNamedValue (Names.second.ltrim ("@"));
+    assert (V && "Unable to find value specified!");
+
+    unsigned Flags;
+    if (This->getNodeFlags (V, F, Flags)) {
+      if (Flags & DSNode::AllocaNode)     O << "S";
+      if (Flags & DSNode::HeapNode)       O << "H";
+      if (Flags & DSNode::GlobalNode)     O << "G";
+      if (Flags & DSNode::UnknownNode)    O << "U";
+      if (Flags & DSNode::IncompleteNode) O << "I";
+      if (Flags & DSNode::ModifiedNode)   O << "M";
+      if (Flags & DSNode::ReadNode)       O << "R";
+      if (Flags & DSNode::ExternalNode)   O << "E";
+      if (Flags & DSNode::ExternFuncNode) O << "X";
+      if (Flags & DSNode::IntToPtrNode)   O << "P";
+      if (Flags & DSNode::PtrToIntNode)   O << "2";
+      if (Flags & DSNode::VAStartNode)    O << "V";
+    }
+    O << "\n";
+  }
+}
+
+}
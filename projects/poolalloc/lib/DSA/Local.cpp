@@ -55,10 +55,11 @@ STATISTIC(NumIgnoredInst,       "Number of instructions ignored");
 
 RegisterPass<LocalDataStructures>
 X("dsa-local", "Local Data Structure Analysis");
+}
 
+// Not static because the BU summary cache hashes it.
 cl::opt<std::string> hasMagicSections("dsa-magic-sections",
         cl::desc("File with section to global mapping")); //, cl::ReallyHidden);
-}
 cl::opt<bool> TypeInferenceOptimize("enable-type-inference-opts",
                                     cl::desc("Enable Type Inference Optimizations added to DSA."),
                                     cl::Hidden,
@@ -39,16 +39,15 @@ STATISTIC(NumNodesFoldedInStdLib,    "Number of nodes folded in std lib");
 char StdLibDataStructures::ID;
 
 #define numOps 10
-namespace {
-  static cl::opt<bool> noStdLibFold("dsa-stdlib-no-fold",
-         cl::desc("Don't fold nodes in std-lib."),
-         cl::Hidden,
-         cl::init(false));
-  static cl::opt<bool> DisableStdLib("disable-dsa-stdlib",
-         cl::desc("Don't use DSA's stdlib pass."),
-         cl::Hidden,
-         cl::init(false));
-}
+// These are not static because the BU summary cache hashes them.
+cl::opt<bool> noStdLibFold("dsa-stdlib-no-fold",
+       cl::desc("Don't fold nodes in std-lib."),
+       cl::Hidden,
+       cl::init(false));
+cl::opt<bool> DisableStdLib("disable-dsa-stdlib",
+       cl::desc("Don't use DSA's stdlib pass."),
+       cl::Hidden,
+       cl::init(false));
 
 //
 // Structure: libAction
@@ -367,11 +366,21 @@ const struct {
   {"trackGlobal",          {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
   {"trackArray",           {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
   {"trackStoreInst",       {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
+  {"trackStoreInst_1",     {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
+  {"trackStoreInst_2",     {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
+  {"trackStoreInst_4",     {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
+  {"trackStoreInst_8",     {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
+  {"trackStoreInst_16",    {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
   {"trackStringInput",     {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
   {"compareTypeAndNumber", {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
   {"compareVAArgType",     {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
   {"getTypeTag",        {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
   {"checkType",        {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
+  {"checkType_1",     {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
+  {"checkType_2",     {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
+  {"checkType_4",     {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
+  {"checkType_8",     {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
+  {"checkType_16",    {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
   {"trackInitInst",        {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
   {"trackUnInitInst",      {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
   {"copyTypeInfo",         {NRET_NARGS, NRET_NARGS, NRET_NARGS, NRET_NARGS,   false}},
@@ -7,7 +7,17 @@
 // 
 //===----------------------------------------------------------------------===//
 //
-// This file implements the -pointercompress pass.
+// This file implements the -pointercompress pass.  It runs after pool
+// allocation and replaces the pointers into type-safe pools with 32-bit
+// indices from the start of the pool, shrinking the linked data structures in
+// the pools on 64-bit targets.  The run-time (poolinit_pc() and friends)
+// reserves the 4GB of address space that the indices can reach for each pool.
+//
+// The layout of the objects in a pool comes from the types that DSA found at
+// each offset of its DSNode.  A pool is compressed only if there is exactly
+// one type at each offset and the natural layout of those types reproduces
+// the offsets.  Pointer fields that point into compressed pools shrink to
+// 32 bits; all other fields keep their type.
 //
 //===----------------------------------------------------------------------===//
 
@@ -18,12 +28,16 @@
 #include "poolalloc/Heuristic.h"
 #include "poolalloc/PoolAllocate.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/IR/GetElementPtrTypeIterator.h"
 #include "llvm/IR/InstVisitor.h"
 #include "llvm/Support/FormattedStream.h"
@@ -99,12 +113,18 @@ namespace {
   /// PointerCompress - This transformation hacks on type-safe pool allocated
   /// data structures to reduce the size of pointers in the program.
   class PointerCompress : public ModulePass {
+  public:
+    /// PoolLayoutMap - The layout of the objects in each compressed pool.
+    typedef std::map<const DSNode*, Type*> PoolLayoutMap;
+
+  private:
     PoolAllocate *PoolAlloc;
     CompleteBUDataStructures *ECG;
 
     /// ClonedFunctionMap - Every time we clone a function to compress its
-    /// arguments, keep track of the clone and which arguments are compressed.
-    typedef std::pair<Function*, std::set<const DSNode*> > CloneID;
+    /// arguments, keep track of the clone and which arguments are compressed,
+    /// along with the layout of the objects in each compressed pool.
+    typedef std::pair<Function*, PoolLayoutMap> CloneID;
     std::map<CloneID, Function *> ClonedFunctionMap;
 
     std::map<std::pair<Function*, std::vector<unsigned> >,
@@ -119,6 +139,10 @@ namespace {
     /// their pool descriptor is.
     std::map<const DSNode*, GlobalValue*> CompressedGlobalPools;
 
+    /// UncompressiblePools - The pool descriptors of pools that must not be
+    /// compressed even though their nodes are type consistent.
+    std::set<const Value*> UncompressiblePools;
+
   public:
     Constant *PoolInitPC, *PoolDestroyPC, *PoolAllocPC;
     typedef std::map<const DSNode*, CompressedPoolInfo> PoolInfoMap;
@@ -133,6 +157,7 @@ namespace {
     bool runOnModule(Module &M);
 
     void HandleGlobalPools(Module &M);
+    void FindUncompressiblePools(Module &M);
 
 
     void getAnalysisUsage(AnalysisUsage &AU) const;
@@ -152,8 +177,7 @@ namespace {
       return I == ClonedFunctionInfoMap.end() ? 0 : &I->second;
     }
 
-    Function *GetFunctionClone(Function *F, 
-                               std::set<const DSNode*> &PoolsToCompress,
+    Function *GetFunctionClone(Function *F, PoolLayoutMap &PoolsToCompress,
                                PA::FuncInfo &FI, const DSGraph &CG);
     Function *GetExtFunctionClone(Function *F,
                                   const std::vector<unsigned> &Args);
@@ -162,10 +186,11 @@ namespace {
     void InitializePoolLibraryFunctions(Module &M);
     bool CompressPoolsInFunction(Function &F,
                 std::vector<std::pair<Value*, Value*> > *PremappedVals = 0,
-                std::set<const DSNode*> *ExternalPoolsToCompress = 0);
+                PoolLayoutMap *ExternalPoolsToCompress = 0);
 
     void FindPoolsToCompress(std::set<const DSNode*> &Pools,
                              std::map<const DSNode*, Value*> &PreassignedPools,
+                             PoolLayoutMap &Layouts,
                              Function &F, DSGraph* DSG, PA::FuncInfo *FI);
   };
 
@@ -184,12 +209,16 @@ namespace {
   class CompressedPoolInfo {
     const DSNode *Pool;
     Value *PoolDesc;
+    StructType *OldTy;
     Type *NewTy;
+    unsigned OldSize;
     unsigned NewSize;
+    const DataLayout *TD;
     mutable Value *PoolBase;
   public:
-    CompressedPoolInfo(const DSNode *N, Value *PD)
-      : Pool(N), PoolDesc(PD), NewTy(0), PoolBase(0) {}
+    CompressedPoolInfo(const DSNode *N, Value *PD, StructType *Layout = 0)
+      : Pool(N), PoolDesc(PD), OldTy(Layout), NewTy(0), OldSize(0),
+        NewSize(0), TD(0), PoolBase(0) {}
     
     /// Initialize - When we know all of the pools in a function that are going
     /// to be compressed, initialize our state based on that data.
@@ -197,11 +226,21 @@ namespace {
                     const DataLayout &TD);
 
     const DSNode *getNode() const { return Pool; }
+    StructType *getOldType() const { return OldTy; }
     Type *getNewType() const { return NewTy; }
 
     /// getNewSize - Return the size of each node after compression.
     ///
     unsigned getNewSize() const { return NewSize; }
+
+    /// getNewOffset - Return the offset in the compressed pool of the byte at
+    /// the specified offset of the uncompressed pool.
+    int64_t getNewOffset(int64_t Offset) const;
+
+    /// getNewStride - Return the distance in the compressed pool between the
+    /// elements of an array that starts at the specified offset and whose
+    /// elements are Stride bytes apart in the uncompressed pool.
+    uint64_t getNewStride(int64_t Offset, uint64_t Stride) const;
     
     /// getPoolDesc - Return the Value* for the pool descriptor for this pool.
     ///
@@ -221,20 +260,71 @@ namespace {
   };
 }
 
+/// getNodeType - Compute the type of the objects of a DSNode from the types
+/// that DSA found at each of its offsets.  Gaps between the fields that are not
+/// alignment padding become byte arrays.  Return null if the node is not type
+/// consistent: it has several types at one offset, the fields overlap, or the
+/// natural layout of the fields does not put them where DSA found them.
+static StructType *getNodeType(const DSNode *N) {
+  if (N->type_begin() == N->type_end() || N->getSize() == 0)
+    return 0;
+
+  const DataLayout &TD = N->getParentGraph()->getDataLayout();
+  std::vector<Type*> Fields;
+  std::vector<uint64_t> Offsets;
+  uint64_t End = 0;
+  for (DSNode::const_type_iterator I = N->type_begin(), E = N->type_end();
+       I != E; ++I) {
+    if (!I->second || I->second->size() != 1)
+      return 0;
+
+    Type *Ty = *I->second->begin();
+    uint64_t Offset = I->first;
+    if (Offset < End || !Ty->isSized())
+      return 0;
+
+    if (Offset != RoundUpToAlignment(End, TD.getABITypeAlignment(Ty))) {
+      Fields.push_back(ArrayType::get(Int8Type, Offset - End));
+      Offsets.push_back(End);
+    }
+    Fields.push_back(Ty);
+    Offsets.push_back(Offset);
+    End = Offset + TD.getTypeAllocSize(Ty);
+  }
+
+  if (End < N->getSize()) {
+    Fields.push_back(ArrayType::get(Int8Type, N->getSize() - End));
+    Offsets.push_back(End);
+  }
+
+  StructType *STy = StructType::get(Int8Type->getContext(), Fields);
+  const StructLayout *SL = TD.getStructLayout(STy);
+  if (SL->getSizeInBytes() != N->getSize())
+    return 0;
+  for (unsigned i = 0, e = Offsets.size(); i != e; ++i)
+    if (SL->getElementOffset(i) != Offsets[i])
+      return 0;
+  return STy;
+}
+
 /// Initialize - When we know all of the pools in a function that are going
-/// to be compressed, initialize our state based on that data.
+/// to be compressed, initialize our state based on that data.  Pools passed in
+/// from a caller keep the layout that the caller computed for them.
 void CompressedPoolInfo::Initialize(std::map<const DSNode*, 
                                              CompressedPoolInfo> &Nodes,
                                     const DataLayout &TD) {
+  this->TD = &TD;
+  if (!OldTy)
+    OldTy = getNodeType(Pool);
+  assert(OldTy && "Compressing a pool that is not type consistent!");
+
   // First step, compute the type of the compressed node.  This basically
   // replaces all pointers to compressed pools with uints.
-//FIXME: TYPE
-  //  NewTy = ComputeCompressedType(Pool->getType(), 0, Nodes);
-  NewTy = 0;
+  NewTy = ComputeCompressedType(OldTy, 0, Nodes);
 
   // Get the compressed type size.
-  //NewSize = NewTy->isSized() ? TD.getTypeAllocSize(NewTy) : 0;
-  NewSize = 0;
+  OldSize = TD.getTypeAllocSize(OldTy);
+  NewSize = TD.getTypeAllocSize(NewTy);
 }
 
 
@@ -245,8 +335,11 @@ Type *CompressedPoolInfo::
 ComputeCompressedType(Type *OrigTy, unsigned NodeOffset,
                       std::map<const DSNode*, CompressedPoolInfo> &Nodes) {
   if (dyn_cast<PointerType>(OrigTy)) {
+    const DSNode *PointeeNode = 0;
+    if (NodeOffset < getNode()->getSize() && getNode()->hasLink(NodeOffset))
+      PointeeNode = getNode()->getLink(NodeOffset).getNode();
+
     if (ADLFix) {
-      DSNode *PointeeNode = getNode()->getLink(NodeOffset).getNode();
       if (PointeeNode == getNode())
         return MEMUINTTYPE;
       return OrigTy;
@@ -254,8 +347,7 @@ ComputeCompressedType(Type *OrigTy, unsigned NodeOffset,
 
     // Okay, we have a pointer.  Check to see if the node pointed to is actually
     // compressed!
-    //DSNode *PointeeNode = getNode()->getLink(NodeOffset).getNode();
-    //if (PointeeNode && Nodes.count(PointeeNode))
+    if (PointeeNode && Nodes.count(PointeeNode))
       return MEMUINTTYPE;
     // Otherwise, it points to a non-compressed node.
     return OrigTy;
@@ -288,6 +380,90 @@ ComputeCompressedType(Type *OrigTy, unsigned NodeOffset,
   }
 }
 
+/// MapOffset - Return the offset in NewTy, the compressed version of OldTy, of
+/// the byte at the specified offset of OldTy.
+static uint64_t MapOffset(Type *OldTy, Type *NewTy, uint64_t Offset,
+                          const DataLayout &TD) {
+  if (Offset == 0 || OldTy == NewTy)
+    return Offset;
+
+  if (StructType *STy = dyn_cast<StructType>(OldTy)) {
+    StructType *NSTy = cast<StructType>(NewTy);
+    const StructLayout *SL = TD.getStructLayout(STy);
+    unsigned Field = SL->getElementContainingOffset(Offset);
+    return TD.getStructLayout(NSTy)->getElementOffset(Field) +
+           MapOffset(STy->getElementType(Field), NSTy->getElementType(Field),
+                     Offset - SL->getElementOffset(Field), TD);
+  }
+
+  if (ArrayType *ATy = dyn_cast<ArrayType>(OldTy)) {
+    Type *ElTy = ATy->getElementType();
+    Type *NElTy = cast<ArrayType>(NewTy)->getElementType();
+    uint64_t ElSize = TD.getTypeAllocSize(ElTy);
+    return Offset / ElSize * TD.getTypeAllocSize(NElTy) +
+           MapOffset(ElTy, NElTy, Offset % ElSize, TD);
+  }
+
+  // The offset is inside of a scalar field.
+  return Offset;
+}
+
+/// MapStride - Return the distance in NewTy, the compressed version of OldTy,
+/// between the elements of the array at the specified offset of OldTy whose
+/// elements are Stride bytes apart.  Arrays that are not part of the type
+/// (e.g. bytes indexed within a field) keep their stride.
+static uint64_t MapStride(Type *OldTy, Type *NewTy, uint64_t Offset,
+                          uint64_t Stride, const DataLayout &TD) {
+  if (OldTy == NewTy)
+    return Stride;
+
+  if (StructType *STy = dyn_cast<StructType>(OldTy)) {
+    StructType *NSTy = cast<StructType>(NewTy);
+    const StructLayout *SL = TD.getStructLayout(STy);
+    unsigned Field = SL->getElementContainingOffset(Offset);
+    return MapStride(STy->getElementType(Field), NSTy->getElementType(Field),
+                     Offset - SL->getElementOffset(Field), Stride, TD);
+  }
+
+  if (ArrayType *ATy = dyn_cast<ArrayType>(OldTy)) {
+    Type *ElTy = ATy->getElementType();
+    Type *NElTy = cast<ArrayType>(NewTy)->getElementType();
+    uint64_t ElSize = TD.getTypeAllocSize(ElTy);
+    if (ElSize == Stride)
+      return TD.getTypeAllocSize(NElTy);
+    return MapStride(ElTy, NElTy, Offset % ElSize, Stride, TD);
+  }
+
+  return Stride;
+}
+
+/// getNewOffset - Return the offset in the compressed pool of the byte at the
+/// specified offset of the uncompressed pool.  Offsets past the end of the
+/// first object step over whole objects.
+int64_t CompressedPoolInfo::getNewOffset(int64_t Offset) const {
+  int64_t Objects = Offset / (int64_t)OldSize;
+  int64_t Rest = Offset % (int64_t)OldSize;
+  if (Rest < 0) {
+    Rest += OldSize;
+    --Objects;
+  }
+  return Objects * NewSize + MapOffset(OldTy, NewTy, Rest, *TD);
+}
+
+/// getNewStride - Return the distance in the compressed pool between the
+/// elements of an array that starts at the specified offset and whose elements
+/// are Stride bytes apart in the uncompressed pool.
+uint64_t CompressedPoolInfo::getNewStride(int64_t Offset,
+                                          uint64_t Stride) const {
+  if (Stride % OldSize == 0)
+    return Stride / OldSize * NewSize;
+
+  int64_t Rest = Offset % (int64_t)OldSize;
+  if (Rest < 0)
+    Rest += OldSize;
+  return MapStride(OldTy, NewTy, Rest, Stride, *TD);
+}
+
 /// EmitPoolBaseLoad - Emit code to load the pool base value for this pool
 /// before the specified instruction.
 Value *CompressedPoolInfo::EmitPoolBaseLoad(Instruction &I) const {
@@ -323,15 +499,10 @@ Value *CompressedPoolInfo::EmitPoolBaseLoad(Instruction &I) const {
 /// dump - Emit a debugging dump for this pool info.
 ///
 void CompressedPoolInfo::dump() const {
-//  const DataLayout &TD = getNode()->getParentGraph()->getDataLayout();
-//FIXME: type
-  //errs() << "  From size: "
-//            << (getNode()->getType()->isSized() ?
-//                        TD.getTypeAllocSize(getNode()->getType()) : 0)
-//            << "  To size: "
-//            << (NewTy->isSized() ? TD.getTypeAllocSize(NewTy) : 0) << "\n";
-//  errs() << "Node: "; getNode()->dump();
-//  errs() << "New Type: " << *NewTy << "\n";
+  errs() << "  From size: " << OldSize << "  To size: " << NewSize << "\n";
+  errs() << "Node: "; getNode()->dump();
+  errs() << "Old Type: " << *OldTy << "\n";
+  errs() << "New Type: " << *NewTy << "\n";
 }
 
 
@@ -448,6 +619,26 @@ namespace {
       return PoolInfo.count(N) ? N : 0;
     }
 
+    /// EmitPointer - Emit code before the specified instruction to compute
+    /// the address that a pointer into a compressed pool points to.
+    Value *EmitPointer(Value *Ptr, Instruction &I) {
+      Value *BasePtr = getPoolInfo(Ptr)->EmitPoolBaseLoad(I);
+      Value *Addr = GetElementPtrInst::Create(nullptr, BasePtr,
+                                              getTransformedValue(Ptr),
+                                              Ptr->getName() + ".pp", &I);
+      return CastInst::CreatePointerCast(Addr, Ptr->getType(), "", &I);
+    }
+
+    /// isCompressedField - Return true if the specified pointer points to a
+    /// field that holds pointers into a compressed pool.
+    bool isCompressedField(Value *Ptr) {
+      DSNodeHandle NH = getMappedNodeHandle(Ptr);
+      DSNode *N = NH.getNode();
+      if (!N || NH.getOffset() >= N->getSize() || !N->hasLink(NH.getOffset()))
+        return false;
+      return PoolInfo.count(N->getLink(NH.getOffset()).getNode());
+    }
+
     /// getPoolInfo - Return the pool info for the specified compressed pool.
     ///
     const CompressedPoolInfo &getPoolInfo(const DSNode *N) {
@@ -697,62 +888,41 @@ void InstructionRewriter::visitGetElementPtrInst(GetElementPtrInst &GEPI) {
     return;
   }
 
-  // The compressed type for the pool.  FIXME: NOTE: This only works if 'Val'
-  // pointed to the start of a node!
-  Type *NTy = PointerType::getUnqual(PI->getNewType());
-
-  //Check if we have a pointer to an array of Original Types this happens if
-  //you do a malloc of [n x OrigTy] for a pool of Type OrigTy
-  if(isa<PointerType>(GEPI.getOperand(0)->getType())) {
-    Type* PT =
-      cast<PointerType>(GEPI.getOperand(0)->getType())->getElementType();
-    if(isa<ArrayType>(PT)) {
-      //FIXME: TYPE
-//      if (cast<ArrayType>(PT)->getElementType() == PI->getNode()->getType())
-//        NTy = PointerType::getUnqual(ArrayType::get(PI->getNewType(),
-//                                              cast<ArrayType>(PT)->getNumElements()));
-    }
-  }
-
-
+  // Walk the indices over the uncompressed layout, starting at the offset into
+  // the node that DSA found for the base pointer.  Constant indices move the
+  // offset; variable indices are scaled by the compressed size of what they
+  // index, which is found at the offset of the first element they select.
+  int64_t BaseOffset = getMappedNodeHandle(GEPI.getOperand(0)).getOffset();
+  int64_t Offset = BaseOffset;
   gep_type_iterator GTI = gep_type_begin(GEPI);
   for (unsigned i = 1, e = GEPI.getNumOperands(); i != e; ++i, ++GTI) {
     Value *Idx = GEPI.getOperand(i);
     if (StructType *STy = dyn_cast<StructType>(*GTI)) {
-      uint64_t Field = (unsigned)cast<ConstantInt>(Idx)->getZExtValue();
-      if (Field) {
-        uint64_t FieldOffs = TD.getStructLayout(cast<StructType>(NTy))
-          ->getElementOffset(Field);
-        Constant *FieldOffsCst = ConstantInt::get(SCALARUINTTYPE, FieldOffs);
-        Val = BinaryOperator::CreateAdd(Val, FieldOffsCst,
-                                        GEPI.getName(), &GEPI);
-      }
-
-      // If this is a one element struct, NTy may not have the structure type.
-      if (STy->getNumElements() > 1 ||
-          (isa<StructType>(NTy) &&
-           cast<StructType>(NTy)->getNumElements() == 1))
-        NTy = cast<StructType>(NTy)->getElementType(Field);
-    } else {
-      assert(isa<SequentialType>(*GTI) && "Not struct or sequential?");
-      SequentialType *SeqTy = cast<SequentialType>(*GTI);
-      if (!isa<Constant>(Idx) || !cast<Constant>(Idx)->isNullValue()) {
-        // Add Idx*sizeof(NewElementType) to the index.
-        Type *ElTy = cast<SequentialType>(NTy)->getElementType();
-        if (Idx->getType() != SCALARUINTTYPE)
-          Idx = CastInst::CreateSExtOrBitCast(Idx, SCALARUINTTYPE, Idx->getName(), &GEPI);
-
-        Constant *Scale = ConstantInt::get(SCALARUINTTYPE,
-					   TD.getTypeAllocSize(ElTy));
-        Idx = BinaryOperator::CreateMul(Idx, Scale, "fieldidx", &GEPI);
-        Val = BinaryOperator::CreateAdd(Val, Idx, GEPI.getName(), &GEPI);
-      }
+      unsigned Field = (unsigned)cast<ConstantInt>(Idx)->getZExtValue();
+      Offset += TD.getStructLayout(STy)->getElementOffset(Field);
+      continue;
+    }
 
-      // If this is a one element array type, NTy may not reflect the array.
-      if (!isa<ArrayType>(SeqTy) || cast<ArrayType>(SeqTy)->getNumElements() != 1 ||
-          (isa<ArrayType>(NTy) && cast<ArrayType>(NTy)->getNumElements() == 1))
-        NTy = cast<SequentialType>(NTy)->getElementType();
+    uint64_t Stride = TD.getTypeAllocSize(GTI.getIndexedType());
+    if (ConstantInt *CI = dyn_cast<ConstantInt>(Idx)) {
+      Offset += CI->getSExtValue() * (int64_t)Stride;
+      continue;
     }
+
+    // Add Idx*sizeof(NewElementType) to the index.
+    if (Idx->getType() != SCALARUINTTYPE)
+      Idx = CastInst::CreateSExtOrBitCast(Idx, SCALARUINTTYPE, Idx->getName(),
+                                          &GEPI);
+    Constant *Scale = ConstantInt::get(SCALARUINTTYPE,
+                                       PI->getNewStride(Offset, Stride));
+    Idx = BinaryOperator::CreateMul(Idx, Scale, "fieldidx", &GEPI);
+    Val = BinaryOperator::CreateAdd(Val, Idx, GEPI.getName(), &GEPI);
+  }
+
+  int64_t Delta = PI->getNewOffset(Offset) - PI->getNewOffset(BaseOffset);
+  if (Delta) {
+    Constant *DeltaCst = ConstantInt::get(SCALARUINTTYPE, Delta, true);
+    Val = BinaryOperator::CreateAdd(Val, DeltaCst, GEPI.getName(), &GEPI);
   }
 
   setTransformedValue(GEPI, Val);
@@ -837,8 +1007,9 @@ void InstructionRewriter::visitStoreInst(StoreInst &SI) {
       if (SrcVal->getType() != MEMUINTTYPE)
         SrcVal = CastInst::CreateZExtOrBitCast(SrcVal, MEMUINTTYPE, SrcVal->getName(), &SI);
     }
-  } else {
-    // FIXME: This assumes that all null pointers are compressed!
+  } else if (isCompressedField(SI.getOperand(1))) {
+    // Null pointers are stored as indices only into the fields that hold
+    // pointers into compressed pools.
     SrcVal = ConstantInt::get(MEMUINTTYPE, 0);
   }
   
@@ -866,11 +1037,11 @@ void InstructionRewriter::visitStoreInst(StoreInst &SI) {
 void InstructionRewriter::visitPoolInit(CallInst &CI) {
   // Transform to poolinit_pc if this is initializing a pool that we are
   // compressing.
-  const CompressedPoolInfo *PI = getPoolInfoForPoolDesc(CI.getOperand(1));
+  const CompressedPoolInfo *PI = getPoolInfoForPoolDesc(CI.getArgOperand(0));
   if (PI == 0) return;  // Pool isn't compressed.
 
   std::vector<Value*> Ops;
-  Ops.push_back(CI.getOperand(1));
+  Ops.push_back(CI.getArgOperand(0));
   // Transform to pass in the compressed size.
   Ops.push_back(ConstantInt::get(Int32Type, PI->getNewSize()));
 
@@ -882,7 +1053,7 @@ void InstructionRewriter::visitPoolInit(CallInst &CI) {
   Value *PB = CallInst::Create(PtrComp.PoolInitPC, Ops, "", &CI);
 
   if (!DisablePoolBaseASR) { // Load the pool base immediately.
-    PB->setName(CI.getOperand(1)->getName()+".poolbase");
+    PB->setName(CI.getArgOperand(0)->getName()+".poolbase");
     // Remember the pool base for this pool.
     PI->setPoolBase(PB);
   }
@@ -893,10 +1064,10 @@ void InstructionRewriter::visitPoolInit(CallInst &CI) {
 void InstructionRewriter::visitPoolDestroy(CallInst &CI) {
   // Transform to pooldestroy_pc if this is destroying a pool that we are
   // compressing.
-  const CompressedPoolInfo *PI = getPoolInfoForPoolDesc(CI.getOperand(1));
+  const CompressedPoolInfo *PI = getPoolInfoForPoolDesc(CI.getArgOperand(0));
   if (PI == 0) return;  // Pool isn't compressed.
 
-  CallInst::Create(PtrComp.PoolDestroyPC, CI.getOperand(1), "", &CI);
+  CallInst::Create(PtrComp.PoolDestroyPC, CI.getArgOperand(0), "", &CI);
   CI.eraseFromParent();
 }
 
@@ -904,7 +1075,7 @@ void InstructionRewriter::visitPoolAlloc(CallInst &CI) {
   const CompressedPoolInfo *PI = getPoolInfo(&CI);
   if (PI == 0) return;  // Pool isn't compressed.
 
-  Value *Size = CI.getOperand(2);
+  Value *Size = CI.getArgOperand(1);
 
   // If there was a recommended size, shrink it down now.
   if (unsigned OldSizeV = PA::Heuristic::getRecommendedSize(PI->getNode()))
@@ -922,7 +1093,7 @@ void InstructionRewriter::visitPoolAlloc(CallInst &CI) {
       Size = BinaryOperator::CreateMul(Size, NewSize, "newbytes", &CI);
     }
 
-  Value *Opts[2] = {CI.getOperand(1), Size};
+  Value *Opts[2] = {CI.getArgOperand(0), Size};
   Value *NC = CallInst::Create(PtrComp.PoolAllocPC, Opts, CI.getName(), &CI);
   setTransformedValue(CI, NC);
 }
@@ -947,10 +1118,6 @@ void InstructionRewriter::visitCallInst(CallInst &CI) {
   // into a compressed pool.  If so, we will need to transform the callee or use
   // a previously transformed version.
 
-  // PoolsToCompress - Keep track of which pools we are supposed to compress,
-  // with the nodes from the callee's graph.
-  std::set<const DSNode*> PoolsToCompress;
-
   // If this is a direct call, get the information about the callee.
   PA::FuncInfo *FI = 0;
   const DSGraph *CG = 0;
@@ -967,86 +1134,35 @@ void InstructionRewriter::visitCallInst(CallInst &CI) {
     // We don't have a DSG for the callee in this case.  Assume that things will
     // work out if we pass compressed pointers.
     std::vector<Value*> Operands;
-    Operands.reserve(CI.getNumOperands()-1);
+    Operands.reserve(CI.getNumArgOperands());
 
     // If this is one of the functions we know about, just materialize the
-    // compressed pointer as a real pointer, and pass it.
-    if (Callee->getName() == "printf" || Callee->getName() == "sprintf") {
-      for (unsigned i = 1, e = CI.getNumOperands(); i != e; ++i)
-        if (isa<PointerType>(CI.getOperand(i)->getType()) &&
-            getPoolInfo(CI.getOperand(i)))
-          CI.setOperand(i, getTransformedValue(CI.getOperand(i)));
-      return;
-    } else if (Callee->getName() == "read") {
-      if (const CompressedPoolInfo *DestPI = getPoolInfo(CI.getOperand(2))) {
-        Value *BasePtr = DestPI->EmitPoolBaseLoad(CI);
-        Value *SrcPtr = GetElementPtrInst::Create(
-            nullptr, BasePtr, getTransformedValue(CI.getOperand(2)),
-            CI.getOperand(2)->getName() + ".pp", &CI);
-        SrcPtr = CastInst::CreatePointerCast(SrcPtr, CI.getOperand(2)->getType(), "", &CI);
-        CI.setOperand(2, SrcPtr);
-        return;
+    // compressed pointers as real pointers, and pass them.
+    StringRef Name = Callee->getName();
+    if (Name == "printf" || Name == "sprintf" || Name == "read" ||
+        Name == "fwrite" || isa<MemIntrinsic>(CI)) {
+      for (unsigned i = 0, e = CI.getNumArgOperands(); i != e; ++i) {
+        Value *Arg = CI.getArgOperand(i);
+        if (isa<PointerType>(Arg->getType()) && getPoolInfo(Arg))
+          CI.setArgOperand(i, EmitPointer(Arg, CI));
       }
-    } else if (Callee->getName() == "fwrite") {
-      if (const CompressedPoolInfo *DestPI = getPoolInfo(CI.getOperand(1))) {
-        Value *BasePtr = DestPI->EmitPoolBaseLoad(CI);
-        Value *SrcPtr = GetElementPtrInst::Create(
-            nullptr, BasePtr, getTransformedValue(CI.getOperand(1)),
-            CI.getOperand(1)->getName() + ".pp", &CI);
-        SrcPtr = CastInst::CreatePointerCast(SrcPtr, CI.getOperand(1)->getType(), "", &CI);
-        CI.setOperand(1, SrcPtr);
-        return;
-      }
-    } else if (Callee->getName() == "llvm.memset" ||
-               Callee->getName() == "llvm.memset.i32" ||
-               Callee->getName() == "llvm.memset.i64") {
-      if (const CompressedPoolInfo *DestPI = getPoolInfo(CI.getOperand(1))) {
-        Value *BasePtr = DestPI->EmitPoolBaseLoad(CI);
-        Value *SrcPtr = GetElementPtrInst::Create(
-            nullptr, BasePtr, getTransformedValue(CI.getOperand(1)),
-            CI.getOperand(1)->getName() + ".pp", &CI);
-        SrcPtr = CastInst::CreatePointerCast(SrcPtr, CI.getOperand(1)->getType(), "", &CI);
-        CI.setOperand(1, SrcPtr);
-        return;
-      }
-    } else if (Callee->getName() == "llvm.memcpy" ||
-               Callee->getName() == "llvm.memcpy.i32" ||
-               Callee->getName() == "llvm.memcpy.i64") {
-      bool doret = false;
-      if (const CompressedPoolInfo *DestPI = getPoolInfo(CI.getOperand(1))) {
-        Value *BasePtr = DestPI->EmitPoolBaseLoad(CI);
-        Value *SrcPtr = GetElementPtrInst::Create(
-            nullptr, BasePtr, getTransformedValue(CI.getOperand(1)),
-            CI.getOperand(1)->getName() + ".pp", &CI);
-        SrcPtr = CastInst::CreatePointerCast(SrcPtr, CI.getOperand(1)->getType(), "", &CI);
-        CI.setOperand(1, SrcPtr);
-        doret = true;
-      }
-      if (const CompressedPoolInfo *DestPI = getPoolInfo(CI.getOperand(2))) {
-        Value *BasePtr = DestPI->EmitPoolBaseLoad(CI);
-        Value *SrcPtr = GetElementPtrInst::Create(
-            nullptr, BasePtr, getTransformedValue(CI.getOperand(2)),
-            CI.getOperand(2)->getName() + ".pp", &CI);
-        SrcPtr = CastInst::CreatePointerCast(SrcPtr, CI.getOperand(2)->getType(), "", &CI);
-        CI.setOperand(2, SrcPtr);
-        doret = true;
-      }
-      if (doret) return;
+      return;
     }
 
-
+    // Compressed arguments are numbered from one; zero is the return value.
     std::vector<unsigned> CompressedArgs;
     if (isa<PointerType>(CI.getType()) && getPoolInfo(&CI))
       CompressedArgs.push_back(0);  // Compress retval.
   
-    for (unsigned i = 1, e = CI.getNumOperands(); i != e; ++i)
-      if (isa<PointerType>(CI.getOperand(i)->getType()) &&
-          getPoolInfo(CI.getOperand(i))) {
-        CompressedArgs.push_back(i);
-        Operands.push_back(getTransformedValue(CI.getOperand(i)));
+    for (unsigned i = 0, e = CI.getNumArgOperands(); i != e; ++i) {
+      Value *Arg = CI.getArgOperand(i);
+      if (isa<PointerType>(Arg->getType()) && getPoolInfo(Arg)) {
+        CompressedArgs.push_back(i + 1);
+        Operands.push_back(getTransformedValue(Arg));
       } else {
-        Operands.push_back(CI.getOperand(i));
+        Operands.push_back(Arg);
       }
+    }
 
     if (CompressedArgs.empty()) {
       PtrComp.NoArgFunctionsCalled.push_back(Callee);
@@ -1074,29 +1190,36 @@ void InstructionRewriter::visitCallInst(CallInst &CI) {
     DSGraph::computeNodeMapping(CG->getReturnNodeFor(FI->F),
                                 getMappedNodeHandle(&CI), CalleeCallerMap);
     
-  // Find the arguments we need to compress.
+  // Find the arguments we need to compress.  The pool descriptors come first;
+  // only the arguments that match a formal argument are searched.
   unsigned NumPoolArgs = FI ? FI->ArgNodes.size() : 0;
-  //only search non-vararg arguments
-  //FIXME: suspect hack to prevent crashing on user-defined vaarg functions
-  unsigned NumSearch = FI ? FI->F.arg_size() + 1: CI.getNumOperands();
-  for (unsigned i = 1, e = NumSearch; i != e; ++i)
-    if (isa<PointerType>(CI.getOperand(i)->getType()) && i > NumPoolArgs) {
-      Argument *FormalArg = next(FI->F.arg_begin(), i-1-NumPoolArgs);
+  unsigned NumSearch = std::min<unsigned>(CI.getNumArgOperands(),
+                                          NumPoolArgs + FI->F.arg_size());
+  for (unsigned i = NumPoolArgs; i != NumSearch; ++i)
+    if (isa<PointerType>(CI.getArgOperand(i)->getType())) {
+      Argument *FormalArg = std::next(FI->F.arg_begin(), i - NumPoolArgs);
         
       DSGraph::computeNodeMapping(CG->getNodeForValue(FormalArg),
-                                  getMappedNodeHandle(CI.getOperand(i)),
+                                  getMappedNodeHandle(CI.getArgOperand(i)),
                                   CalleeCallerMap);
     }
 
   // Now that we know the basic pools passed/returned through the
   // argument/retval of the call, add the compressed pools that are reachable
   // from them.  The CalleeCallerMap contains a mapping from callee nodes to the
-  // caller nodes they correspond to (a many-to-one mapping).
+  // caller nodes they correspond to (a many-to-one mapping).  The callee uses
+  // the layout that the caller computed for each pool.
+  //
+  // PoolsToCompress - Keep track of which pools we are supposed to compress,
+  // with the nodes from the callee's graph.
+  PointerCompress::PoolLayoutMap PoolsToCompress;
   for (DSGraph::NodeMapTy::iterator I = CalleeCallerMap.begin(),
          E = CalleeCallerMap.end(); I != E; ++I) {
     // If the destination is compressed, so should the source be.
-    if (PoolInfo.count(I->second.getNode()))
-      PoolsToCompress.insert(I->first);
+    PointerCompress::PoolInfoMap::const_iterator PI =
+      PoolInfo.find(I->second.getNode());
+    if (PI != PoolInfo.end())
+      PoolsToCompress[I->first] = PI->second.getOldType();
   }
 
   // If this function doesn't require compression, there is nothing to do!
@@ -1116,20 +1239,24 @@ void InstructionRewriter::visitCallInst(CallInst &CI) {
 
   // Okay, we now have our clone: rewrite the call instruction.
   std::vector<Value*> Operands;
-  Operands.reserve(CI.getNumOperands()-1);
+  Operands.reserve(CI.getNumArgOperands());
 
   Function::arg_iterator AI = FI->F.arg_begin();
   
   // Pass pool descriptors.
-  for (unsigned i = 1; i != NumPoolArgs+1; ++i)
-    Operands.push_back(CI.getOperand(i));
+  for (unsigned i = 0; i != NumPoolArgs; ++i)
+    Operands.push_back(CI.getArgOperand(i));
 
-  for (unsigned i = NumPoolArgs+1, e = CI.getNumOperands(); i != e; ++i, ++AI)
-    if (isa<PointerType>(CI.getOperand(i)->getType()) &&
+  for (unsigned i = NumPoolArgs, e = CI.getNumArgOperands(); i != e; ++i) {
+    Value *Arg = CI.getArgOperand(i);
+    if (AI != FI->F.arg_end() && isa<PointerType>(Arg->getType()) &&
         PoolsToCompress.count(CG->getNodeForValue(AI).getNode()))
-      Operands.push_back(getTransformedValue(CI.getOperand(i)));
+      Operands.push_back(getTransformedValue(Arg));
     else
-      Operands.push_back(CI.getOperand(i));
+      Operands.push_back(Arg);
+    if (AI != FI->F.arg_end())
+      ++AI;
+  }
 
   Value *NC = CallInst::Create(Clone, Operands, CI.getName(), &CI);
   if (NC->getType() != CI.getType())      // Compressing return value?
@@ -1165,6 +1292,16 @@ static bool PoolIsCompressible(const DSNode *N) {
     return false;
   }
 
+  if (N->isIntToPtrNode() || N->isPtrToIntNode() || N->isUnknownNode()) {
+    DEBUG(errs() << "Node has pointers that DSA cannot track:\n");
+    return false;
+  }
+
+  if (!getNodeType(N)) {
+    DEBUG(errs() << "Node does not have one type at each offset:\n");
+    return false;
+  }
+
   // FIXME: If any non-type-safe nodes point to this one, we cannot compress it.
 #if 0
   bool HasFields = false;
@@ -1199,6 +1336,7 @@ static bool PoolIsCompressible(const DSNode *N) {
 void PointerCompress::FindPoolsToCompress(std::set<const DSNode*> &Pools,
                                           std::map<const DSNode*,
                                           Value*> &PreassignedPools,
+                                          PoolLayoutMap &Layouts,
                                           Function &F, DSGraph* DSG,
                                           PA::FuncInfo *FI) {
   DEBUG(errs() << "In function '" << F.getName().str() << "':\n");
@@ -1207,8 +1345,9 @@ void PointerCompress::FindPoolsToCompress(std::set<const DSNode*> &Pools,
 
     // Ignore potential pools that the pool allocation heuristic decided not to
     // pool allocated.
-    if (!isa<ConstantPointerNull>(FI->PoolDescriptors[N])) {
-      if (PoolIsCompressible(N)) {
+    Value *PD = FI->PoolDescriptors[N];
+    if (!isa<ConstantPointerNull>(PD)) {
+      if (PoolIsCompressible(N) && !UncompressiblePools.count(PD)) {
         Pools.insert(N);
         ++NumCompressed;
       } else {
@@ -1236,10 +1375,12 @@ void PointerCompress::FindPoolsToCompress(std::set<const DSNode*> &Pools,
        I != E;++I)
     if (GlobalsGraphNodeMapping.count(I)) {
       // If it is a global pool, set up the pool descriptor appropriately.
+      // Every function uses the layout of the node in the globals graph.
       DSNode *GGN = GlobalsGraphNodeMapping[I].getNode();
       if (CompressedGlobalPools.count(GGN)) {
         Pools.insert(I);
         PreassignedPools[I] = CompressedGlobalPools[GGN];
+        Layouts[I] = getNodeType(GGN);
       }
     }
 }
@@ -1250,7 +1391,7 @@ void PointerCompress::FindPoolsToCompress(std::set<const DSNode*> &Pools,
 bool PointerCompress::
 CompressPoolsInFunction(Function &F,
                         std::vector<std::pair<Value*, Value*> > *PremappedVals,
-                        std::set<const DSNode*> *ExternalPoolsToCompress){
+                        PoolLayoutMap *ExternalPoolsToCompress){
   if (F.isDeclaration()) return false;
 
   // If this is a pointer compressed clone of a pool allocated function, get the
@@ -1285,14 +1426,19 @@ CompressPoolsInFunction(Function &F,
   // Compute the set of compressible pools in this function that are hosted
   // here.
   std::map<const DSNode*, Value*> PreassignedPools;
-  FindPoolsToCompress(PoolsToCompressSet, PreassignedPools, F, DSG, FI);
+  PoolLayoutMap Layouts;
+  FindPoolsToCompress(PoolsToCompressSet, PreassignedPools, Layouts, F, DSG,
+                      FI);
 
   // Handle pools that are passed into the function through arguments or
   // returned by the function.  If this occurs, we must be dealing with a ptr
   // compressed clone of the pool allocated clone of the original function.
   if (ExternalPoolsToCompress)
-    PoolsToCompressSet.insert(ExternalPoolsToCompress->begin(),
-                              ExternalPoolsToCompress->end());
+    for (PoolLayoutMap::iterator I = ExternalPoolsToCompress->begin(),
+           E = ExternalPoolsToCompress->end(); I != E; ++I) {
+      PoolsToCompressSet.insert(I->first);
+      Layouts[I->first] = I->second;
+    }
 
   // If there is nothing that we can compress, exit now.
   if (PoolsToCompressSet.empty()) return false;
@@ -1311,14 +1457,16 @@ CompressPoolsInFunction(Function &F,
       PD = FI->PoolDescriptors[*I];
     assert(PD && "No pool descriptor available for this pool???");
     
-    PoolsToCompress.insert(std::make_pair(*I, CompressedPoolInfo(*I, PD)));
+    StructType *Layout = cast_or_null<StructType>(Layouts[*I]);
+    PoolsToCompress.insert(std::make_pair(*I,
+                                          CompressedPoolInfo(*I, PD, Layout)));
   }
 
   // Use these to compute the closure of compression information.  In
   // particular, if one pool points to another, we need to know if the outgoing
   // pointer is compressed.
   const DataLayout &TD = DSG->getDataLayout();
-  errs() << "In function '" << F.getName().str() << "':\n";
+  DEBUG(errs() << "In function '" << F.getName().str() << "':\n");
   for (std::map<const DSNode*, CompressedPoolInfo>::iterator
          I = PoolsToCompress.begin(), E = PoolsToCompress.end(); I != E; ++I) {
 
@@ -1328,8 +1476,7 @@ CompressPoolsInFunction(Function &F,
     if (isa<AllocaInst>(I->second.getPoolDesc()) ||
         (isa<GlobalValue>(I->second.getPoolDesc()) &&
          F.hasExternalLinkage() && F.getName().str() == "main")) {
-      errs() << "  COMPRESSING POOL:\nPCS:";
-      I->second.dump();
+      DEBUG(errs() << "  COMPRESSING POOL:\nPCS:"; I->second.dump());
     }
   }
   
@@ -1381,7 +1528,7 @@ GetExtFunctionClone(Function *F, const std::vector<unsigned> &ArgsToComp) {
 /// need in compressed form.  This memoizes the functions that have been cloned
 /// to allow only one clone of each function in a desired permutation.
 Function *PointerCompress::
-GetFunctionClone(Function *F, std::set<const DSNode*> &PoolsToCompress,
+GetFunctionClone(Function *F, PoolLayoutMap &PoolsToCompress,
                  PA::FuncInfo &FI, const DSGraph &CG) {
   assert(!PoolsToCompress.empty() && "No clone needed!");
 
@@ -1426,8 +1573,8 @@ GetFunctionClone(Function *F, std::set<const DSNode*> &PoolsToCompress,
     ClonedFunctionInfoMap.insert(std::make_pair(Clone, F)).first->second;
 
   ++NumCloned;
-  errs() << " CLONING FUNCTION: " << F->getName().str() << " -> "
-            << Clone->getName().str() << "\n";
+  DEBUG(errs() << " CLONING FUNCTION: " << F->getName().str() << " -> "
+               << Clone->getName().str() << "\n");
 
   if (F->isDeclaration()) {
     Clone->setLinkage(GlobalValue::ExternalLinkage);
@@ -1502,7 +1649,7 @@ void PointerCompress::HandleGlobalPools(Module &M) {
     // Ignore potential pools that the pool allocation heuristic decided not to
     // pool allocated.
     if (!isa<ConstantPointerNull>(I->second)) {
-      if (PoolIsCompressible(N)) {
+      if (PoolIsCompressible(N) && !UncompressiblePools.count(I->second)) {
         CompressedGlobalPools.insert(std::make_pair(N, 
                                              cast<GlobalValue>(I->second)));
         ++NumCompressed;
@@ -1514,12 +1661,137 @@ void PointerCompress::HandleGlobalPools(Module &M) {
   }
 }
 
+/// getOriginalNodeHandle - Return the node of a value of a pool allocated
+/// function (or of its pool allocated clone) in the graph of the function.
+static DSNodeHandle getOriginalNodeHandle(Value *V, PA::FuncInfo &FI,
+                                          const DSGraph &G) {
+  if (!FI.NewToOldValueMap.empty())
+    if ((V = FI.MapValueToOriginal(V)) == 0)
+      return DSNodeHandle();
+  if (!G.hasNodeForValue(V))
+    return DSNodeHandle();
+  return G.getNodeForValue(V);
+}
+
+/// isByteCopy - Return true if the specified call reads or writes the objects
+/// that its pointer arguments point to as a number of bytes.  Compressing
+/// those objects would change how many bytes they take and where their
+/// fields are.
+static bool isByteCopy(CallInst &CI) {
+  if (isa<MemIntrinsic>(CI))
+    return true;
+  Function *F = CI.getCalledFunction();
+  if (!F)
+    return false;
+  StringRef Name = F->getName();
+  return Name == "memcpy" || Name == "memmove" || Name == "memset" ||
+         Name == "fwrite";
+}
+
+/// FindUncompressiblePools - Find the pools that cannot be compressed because
+/// their objects are passed to memcpy(), memmove(), memset() or fwrite(), or
+/// because a callee sees them at a nonzero offset (which the callee's layout
+/// of the pool cannot describe).  The nodes marked in a callee are mapped into
+/// its callers until nothing changes, so that the function that owns the pool
+/// (or the global pool) finds them.
+void PointerCompress::FindUncompressiblePools(Module &M) {
+  std::vector<Function*> Functions;
+  for (Module::iterator F = M.begin(), FE = M.end(); F != FE; ++F) {
+    if (F->isDeclaration()) continue;
+    PA::FuncInfo *FI = PoolAlloc->getFuncInfoOrClone(*F);
+    if (FI && !(FI->Clone && &FI->F == &*F))
+      Functions.push_back(F);
+  }
+
+  // Marked - The nodes of the graph of each function that must not be
+  // compressed.
+  std::map<const Function*, std::set<const DSNode*> > Marked;
+  bool Changed;
+  do {
+    Changed = false;
+    for (unsigned f = 0, fe = Functions.size(); f != fe; ++f) {
+      Function *F = Functions[f];
+      PA::FuncInfo *FI = PoolAlloc->getFuncInfoOrClone(*F);
+      const DSGraph &G = *ECG->getDSGraph(FI->F);
+      std::set<const DSNode*> &Nodes = Marked[F];
+
+      for (inst_iterator I = inst_begin(*F), E = inst_end(*F); I != E; ++I) {
+        CallInst *CI = dyn_cast<CallInst>(&*I);
+        if (!CI) continue;
+
+        // Mark the nodes of all byte-copied objects.
+        if (isByteCopy(*CI)) {
+          for (unsigned i = 0, e = CI->getNumArgOperands(); i != e; ++i)
+            if (isa<PointerType>(CI->getArgOperand(i)->getType())) {
+              DSNodeHandle NH =
+                getOriginalNodeHandle(CI->getArgOperand(i), *FI, G);
+              if (NH.getNode())
+                Changed |= Nodes.insert(NH.getNode()).second;
+            }
+          continue;
+        }
+
+        Function *Callee = CI->getCalledFunction();
+        if (!Callee || Callee->isDeclaration()) continue;
+        PA::FuncInfo *CFI = PoolAlloc->getFuncInfoOrClone(*Callee);
+        if (!CFI) continue;
+        const DSGraph &CG = *getGraphForFunc(CFI);
+
+        // Map the nodes of the callee into this function, as visitCallInst()
+        // does when it rewrites the call.
+        DSGraph::NodeMapTy CalleeCallerMap;
+        if (isa<PointerType>(CI->getType()))
+          DSGraph::computeNodeMapping(CG.getReturnNodeFor(CFI->F),
+                                      getOriginalNodeHandle(CI, *FI, G),
+                                      CalleeCallerMap);
+        unsigned NumPoolArgs = CFI->ArgNodes.size();
+        unsigned NumSearch = std::min<unsigned>(CI->getNumArgOperands(),
+                                                NumPoolArgs +
+                                                CFI->F.arg_size());
+        for (unsigned i = NumPoolArgs; i != NumSearch; ++i)
+          if (isa<PointerType>(CI->getArgOperand(i)->getType())) {
+            Argument *FormalArg = std::next(CFI->F.arg_begin(),
+                                            i - NumPoolArgs);
+            DSNodeHandle ActualNH =
+              getOriginalNodeHandle(CI->getArgOperand(i), *FI, G);
+            DSGraph::computeNodeMapping(CG.getNodeForValue(FormalArg),
+                                        ActualNH, CalleeCallerMap);
+          }
+
+        // Mark the nodes that the callee sees at a nonzero offset or that are
+        // marked in the callee.
+        const std::set<const DSNode*> &CalleeNodes = Marked[Callee];
+        for (DSGraph::NodeMapTy::iterator MI = CalleeCallerMap.begin(),
+               ME = CalleeCallerMap.end(); MI != ME; ++MI)
+          if (MI->second.getNode() &&
+              (MI->second.getOffset() != 0 || CalleeNodes.count(MI->first)))
+            Changed |= Nodes.insert(MI->second.getNode()).second;
+      }
+    }
+  } while (Changed);
+
+  // Record the pool descriptors of the marked nodes.  The function that owns
+  // a pool and every function using a global pool refer to it by them.
+  for (unsigned f = 0, fe = Functions.size(); f != fe; ++f) {
+    PA::FuncInfo *FI = PoolAlloc->getFuncInfoOrClone(*Functions[f]);
+    const std::set<const DSNode*> &Nodes = Marked[Functions[f]];
+    for (std::set<const DSNode*>::const_iterator I = Nodes.begin(),
+           E = Nodes.end(); I != E; ++I) {
+      std::map<const DSNode*, Value*>::iterator PD =
+        FI->PoolDescriptors.find(*I);
+      if (PD != FI->PoolDescriptors.end() &&
+          !isa<ConstantPointerNull>(PD->second))
+        UncompressiblePools.insert(PD->second);
+    }
+  }
+}
+
 
 /// InitializePoolLibraryFunctions - Create the function prototypes for pointer
 /// compress runtime library functions.
 void PointerCompress::InitializePoolLibraryFunctions(Module &M) {
   Type *VoidPtrTy = PointerType::getUnqual(Int8Type);
-  Type *PoolDescPtrTy = PointerType::getUnqual(ArrayType::get(VoidPtrTy, 16));
+  Type *PoolDescPtrTy = PoolAllocate::PoolDescPtrTy;
 
   PoolInitPC = M.getOrInsertFunction("poolinit_pc", VoidPtrTy, PoolDescPtrTy, 
                                      Int32Type, Int32Type, NULL);
@@ -1548,13 +1820,23 @@ bool PointerCompress::runOnModule(Module &M) {
   else 
     MEMUINTTYPE = Int32Type;
 
-  // FIXME: make this IntPtrTy.
-  SCALARUINTTYPE = Int64Type;
+  // Scalars are the size of a pointer.  Compressing pointers that are no
+  // larger than the indices would not save anything.
+  const DataLayout &TD = M.getDataLayout();
+  SCALARUINTTYPE = TD.getIntPtrType(M.getContext());
+  if (SCALARUINTTYPE->getPrimitiveSizeInBits() <=
+      MEMUINTTYPE->getPrimitiveSizeInBits()) {
+    DEBUG(errs() << "Pointers are too small to compress\n");
+    return false;
+  }
 
   // Create the function prototypes for pointer compress runtime library
   // functions.
   InitializePoolLibraryFunctions(M);
 
+  // Find the pools whose layout is visible to code that cannot be rewritten.
+  FindUncompressiblePools(M);
+
   // Handle all pools pointed to by global variables.
   HandleGlobalPools(M);
 
@@ -1579,5 +1861,6 @@ bool PointerCompress::runOnModule(Module &M) {
 
   NoArgFunctionsCalled.clear();
   ClonedFunctionMap.clear();
+  UncompressiblePools.clear();
   return Changed;
 }
@@ -1147,6 +1147,8 @@ PoolAllocate::CreatePools (Function &F, DSGraph* DSG,
       //
       if (!IsMain) {
         PoolDesc = new AllocaInst(PoolDescType, 0, "PD", InsertPoint);
+        LocalPoolSizes[PoolDesc] = std::make_pair(Pool.PoolSize,
+                                                  Pool.PoolAlignment);
 
 #if 0
         //
@@ -1500,10 +1502,17 @@ void PoolAllocate::InitializeAndDestroyPool(Function &F, const DSNode *Node,
 
   DEBUG(errs() << "  Init in blocks: ");
 
-  // Insert the calls to initialize the pool.
+  // Insert the calls to initialize the pool.  Use the element size and
+  // alignment that the heuristic chose for the pool, if any.
   unsigned ElSizeV = Heuristic::getRecommendedSize(Node);
-  Value *ElSize = ConstantInt::get(Int32Type, ElSizeV);
   unsigned AlignV = Heuristic::getRecommendedAlignment(Node);
+  std::map<const Value*, std::pair<unsigned, unsigned> >::iterator Sizes =
+    LocalPoolSizes.find(PD);
+  if (Sizes != LocalPoolSizes.end()) {
+    ElSizeV = Sizes->second.first;
+    AlignV = Sizes->second.second;
+  }
+  Value *ElSize = ConstantInt::get(Int32Type, ElSizeV);
   Value *Align  = ConstantInt::get(Int32Type, AlignV);
 
   for (unsigned i = 0, e = PoolInitPoints.size(); i != e; ++i) {
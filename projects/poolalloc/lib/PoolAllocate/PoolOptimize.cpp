@@ -9,17 +9,38 @@
 //
 // This simple pass optimizes a program that has been through pool allocation.
 //
+// Besides simplifying calls into the pool run-time and turning pools that are
+// never freed into bump pointer pools, it batches the poolalloc calls of
+// loops whose trip count is known or bounded: one poolalloc_n call before the
+// loop carves the nodes for all of its iterations out of one chunk, and each
+// iteration takes the next node with a pointer increment.
+//
+// With -pooloptimize-safecode, it does not batch allocations, which the
+// checks and registrations of SAFECode's debug run-time need one at a time;
+// instead it turns the pools that a function creates and only allocates from
+// itself into regions of the debug run-time, which allocate with a bump
+// pointer and register and release all of their objects at once.
+//
 //===----------------------------------------------------------------------===//
 
 #define DEBUG_TYPE "pa-opt"
 
 #include "llvm/Pass.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpander.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include <map>
 #include <set>
 using namespace llvm;
 
@@ -29,15 +50,59 @@ static Type * Int32Type = 0;
 
 namespace {
   STATISTIC (NumBumpPtr, "Number of bump pointer pools");
+  STATISTIC (NumBatched, "Number of poolallocs in loops that were batched");
+  STATISTIC (NumRegions, "Number of pools turned into regions");
+
+  cl::opt<bool>
+  SAFECodeMode("pooloptimize-safecode",
+               cl::desc("Optimize a program pool allocated for SAFECode"),
+               cl::init(false));
+
+  cl::opt<bool>
+  BatchAllocs("pooloptimize-batch",
+              cl::desc("Batch the pool allocations of loops"),
+              cl::init(true));
+
+  cl::opt<bool>
+  MakeRegions("pooloptimize-regions",
+              cl::desc("Turn the pools of a function into regions under "
+                       "SAFECode"),
+              cl::init(true));
+
+  cl::opt<unsigned>
+  MaxBoundedBatch("pooloptimize-max-bounded-batch",
+                  cl::desc("Largest batch for loops whose trip count is only "
+                           "bounded"),
+                  cl::init(1024));
 
   struct PoolOptimize : public ModulePass {
     static char ID;
     bool SAFECodeEnabled;
 
-    PoolOptimize(bool SAFECode = true) : ModulePass(ID) {
-      SAFECodeEnabled = SAFECode;
+    PoolOptimize(bool SAFECode = false) : ModulePass(ID) {
+      SAFECodeEnabled = SAFECode || SAFECodeMode;
     }
     bool runOnModule(Module &M);
+    void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.addRequired<DominatorTreeWrapperPass>();
+      AU.addRequired<LoopInfoWrapperPass>();
+      AU.addRequired<ScalarEvolution>();
+    }
+
+  private:
+    void makeRegions(Module &M, Type *PoolDescPtrTy,
+                     Constant *PoolInit, Constant *PoolDestroy,
+                     Constant *PoolAlloc, Constant *PoolFree);
+    void batchAllocs(Function &F, std::vector<CallInst*> &Allocs,
+                     Constant *PoolInit, Constant *PoolDestroy);
+
+    // The batch allocation functions of the run-time
+    Constant *PoolAllocN;
+    Constant *PoolAllocRefill;
+    Constant *PoolFreeN;
+
+    // PoolBatchTy - The type of the run-time's PoolBatch structure.
+    StructType *PoolBatchTy;
   };
 
   char PoolOptimize::ID = 0;
@@ -72,8 +137,16 @@ bool PoolOptimize::runOnModule(Module &M) {
   // Create LLVM types used by the pool allocation passes.
   //
   Type *VoidPtrTy = PointerType::getUnqual(Int8Type);
+  //
+  // The pool descriptors of the module are as large as the pool allocator
+  // made them, which does not depend on whether this pass optimizes for
+  // SAFECode; use the type of the existing poolinit() if there is one.
+  //
   Type *PoolDescPtrTy;
-  if (SAFECodeEnabled)
+  Function *OldPoolInit = M.getFunction("poolinit");
+  if (OldPoolInit && OldPoolInit->arg_size() == 3)
+    PoolDescPtrTy = OldPoolInit->arg_begin()->getType();
+  else if (SAFECodeEnabled)
     PoolDescPtrTy = PointerType::getUnqual(ArrayType::get(VoidPtrTy, 92));
   else
     PoolDescPtrTy = PointerType::getUnqual(ArrayType::get(VoidPtrTy, 16));
@@ -275,5 +348,369 @@ bool PoolOptimize::runOnModule(Module &M) {
       }
     }
   }
+
+  // Turn the pools of functions into regions.
+  if (SAFECodeEnabled && MakeRegions)
+    makeRegions(M, PoolDescPtrTy, PoolInit, PoolDestroy, PoolAlloc, PoolFree);
+
+  // Batch the poolallocs that remain in loops.  Under SAFECode, the checks
+  // and registrations of the debug run-time need one poolalloc per object.
+  if (BatchAllocs && !SAFECodeEnabled) {
+    PoolBatchTy = StructType::get(VoidPtrTy, VoidPtrTy, Int32Type, Int32Type,
+                                  NULL);
+    Type *PoolBatchPtrTy = PointerType::getUnqual(PoolBatchTy);
+    PoolAllocN = M.getOrInsertFunction("poolalloc_n", VoidType,
+                                       PoolDescPtrTy, Int32Type, Int32Type,
+                                       PoolBatchPtrTy, NULL);
+    PoolAllocRefill = M.getOrInsertFunction("poolalloc_refill", VoidPtrTy,
+                                            PoolDescPtrTy, Int32Type,
+                                            PoolBatchPtrTy, NULL);
+    PoolFreeN = M.getOrInsertFunction("poolfree_n", VoidType, PoolDescPtrTy,
+                                      PoolBatchPtrTy, NULL);
+
+    std::map<Function*, std::vector<CallInst*> > AllocsByFunction;
+    getCallsOf(PoolAlloc, Calls);
+    for (unsigned i = 0, e = Calls.size(); i != e; ++i)
+      AllocsByFunction[Calls[i]->getParent()->getParent()].push_back(Calls[i]);
+
+    for (std::map<Function*, std::vector<CallInst*> >::iterator
+           I = AllocsByFunction.begin(), E = AllocsByFunction.end();
+         I != E; ++I)
+      batchAllocs(*I->first, I->second, PoolInit, PoolDestroy);
+  }
   return true;
 }
+
+//
+// Function: isRegionUse()
+//
+// Description:
+//  Determine whether all uses of a pool descriptor (or of a cast of it) permit
+//  making the pool a region, and collect the calls of the pool run-time that
+//  use it.
+//
+//  The descriptor may only be passed to poolinit, pooldestroy, poolalloc and
+//  poolfree, and to the checks and registration functions of the SAFECode
+//  run-time, whose names start with "pool_", "poolcheck" or "boundscheck".
+//  Any other function could allocate objects in the pool or resize them, and
+//  the objects of a region can only be allocated by poolalloc_region.
+//
+static bool
+isRegionUse(Value *PD, Value *V, std::vector<CallInst*> &PoolCalls,
+            Constant *PoolInit, Constant *PoolDestroy,
+            Constant *PoolAlloc, Constant *PoolFree) {
+  for (Value::user_iterator UI = V->user_begin(), E = V->user_end();
+       UI != E; ++UI) {
+    if (isa<BitCastInst>(*UI) ||
+        (isa<ConstantExpr>(*UI) && cast<ConstantExpr>(*UI)->isCast())) {
+      if (!isRegionUse(PD, *UI, PoolCalls, PoolInit, PoolDestroy, PoolAlloc,
+                       PoolFree))
+        return false;
+      continue;
+    }
+
+    CallInst *CI = dyn_cast<CallInst>(*UI);
+    if (!CI)
+      return false;
+
+    Value *Callee = CI->getCalledValue()->stripPointerCasts();
+    if (Callee == PoolInit->stripPointerCasts() ||
+        Callee == PoolDestroy->stripPointerCasts() ||
+        Callee == PoolAlloc->stripPointerCasts() ||
+        Callee == PoolFree->stripPointerCasts()) {
+      if (CI->getArgOperand(0)->stripPointerCasts() != PD)
+        return false;
+      PoolCalls.push_back(CI);
+      continue;
+    }
+
+    Function *F = dyn_cast<Function>(Callee);
+    if (!F || !F->isDeclaration())
+      return false;
+    StringRef Name = F->getName();
+    if (Name.startswith("pool_reregister"))
+      return false;
+    if (!Name.startswith("pool_") && !Name.startswith("poolcheck") &&
+        !Name.startswith("boundscheck"))
+      return false;
+  }
+  return true;
+}
+
+//
+// Method: makeRegions()
+//
+// Description:
+//  Turn the pools that functions create for themselves and that meet the
+//  conditions of isRegionUse() into regions.  Their poolinit, poolalloc and
+//  pooldestroy calls become poolinit_region, poolalloc_region and
+//  pooldestroy_region, and their poolfree calls are deleted; the objects of a
+//  region live until the function destroys it.  Pools freed inside a loop are
+//  left alone: the loop may reuse the memory it frees, and as a region it
+//  would instead grow with every iteration.  The checks and registrations
+//  of the pool are left alone; the run-time ignores the registrations of heap
+//  objects in regions and registers the memory of the region instead.
+//
+void
+PoolOptimize::makeRegions(Module &M, Type *PoolDescPtrTy,
+                          Constant *PoolInit, Constant *PoolDestroy,
+                          Constant *PoolAlloc, Constant *PoolFree) {
+  Type *VoidPtrTy = PointerType::getUnqual(Int8Type);
+  Constant *PoolInitRegion = M.getOrInsertFunction("poolinit_region",
+                                                   VoidType, PoolDescPtrTy,
+                                                   Int32Type, Int32Type,
+                                                   NULL);
+  Constant *PoolAllocRegion = M.getOrInsertFunction("poolalloc_region",
+                                                    VoidPtrTy, PoolDescPtrTy,
+                                                    Int32Type, NULL);
+  Constant *PoolDestroyRegion = M.getOrInsertFunction("pooldestroy_region",
+                                                      VoidType,
+                                                      PoolDescPtrTy, NULL);
+
+  std::vector<CallInst*> Calls;
+  getCallsOf(PoolInit, Calls);
+  std::set<Value*> Pools;
+  for (unsigned i = 0, e = Calls.size(); i != e; ++i) {
+    Value *PD = Calls[i]->getArgOperand(0)->stripPointerCasts();
+    if (isa<AllocaInst>(PD))
+      Pools.insert(PD);
+  }
+
+  for (std::set<Value*>::iterator PI = Pools.begin(), E = Pools.end();
+       PI != E; ++PI) {
+    Value *PD = *PI;
+    std::vector<CallInst*> PoolCalls;
+    if (!isRegionUse(PD, PD, PoolCalls, PoolInit, PoolDestroy, PoolAlloc,
+                     PoolFree))
+      continue;
+
+    Function &F = *cast<AllocaInst>(PD)->getParent()->getParent();
+    LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>(F).getLoopInfo();
+    bool FreedInLoop = false;
+    for (unsigned i = 0, e = PoolCalls.size(); i != e; ++i) {
+      Value *Callee = PoolCalls[i]->getCalledValue()->stripPointerCasts();
+      if (Callee == PoolFree->stripPointerCasts() &&
+          LI.getLoopFor(PoolCalls[i]->getParent()))
+        FreedInLoop = true;
+    }
+    if (FreedInLoop)
+      continue;
+
+    for (unsigned i = 0, e = PoolCalls.size(); i != e; ++i) {
+      CallInst *CI = PoolCalls[i];
+      Value *Callee = CI->getCalledValue()->stripPointerCasts();
+      if (Callee == PoolFree->stripPointerCasts()) {
+        CI->eraseFromParent();
+        continue;
+      }
+
+      std::vector<Value*> Args(CI->arg_operands().begin(),
+                               CI->arg_operands().end());
+      if (PD->getType() == PoolDescPtrTy)
+        Args[0] = PD;
+      else
+        Args[0] = new BitCastInst(PD, PoolDescPtrTy, "", CI);
+
+      if (Callee == PoolAlloc->stripPointerCasts()) {
+        Instruction *New = CallInst::Create(PoolAllocRegion, Args, "", CI);
+        New->takeName(CI);
+        if (New->getType() != CI->getType())
+          New = new BitCastInst(New, CI->getType(), "", CI);
+        CI->replaceAllUsesWith(New);
+      } else if (Callee == PoolInit->stripPointerCasts()) {
+        CallInst::Create(PoolInitRegion, Args, "", CI);
+      } else {
+        CallInst::Create(PoolDestroyRegion, Args, "", CI);
+      }
+      CI->eraseFromParent();
+    }
+    ++NumRegions;
+  }
+}
+
+//
+// Function: isInitializedBefore()
+//
+// Description:
+//  Determine whether a pool is initialized and not destroyed while a loop
+//  runs.  Pools passed in as arguments or held in globals are initialized by
+//  the caller or at program start; the pools of the function itself must be
+//  initialized before the loop by a poolinit call outside of it.
+//
+static bool
+isInitializedBefore (Value *PD, Loop *L, DominatorTree &DT,
+                     Constant *PoolInit, Constant *PoolDestroy) {
+  PD = PD->stripPointerCasts();
+  if (isa<Argument>(PD) || isa<GlobalValue>(PD))
+    return true;
+
+  bool Initialized = false;
+  Instruction *Entry = L->getLoopPreheader()->getTerminator();
+  for (Value::user_iterator UI = PD->user_begin(), E = PD->user_end();
+       UI != E; ++UI) {
+    CallInst *CI = dyn_cast<CallInst>(*UI);
+    if (!CI)
+      continue;
+    Value *Callee = CI->getCalledValue()->stripPointerCasts();
+    if (Callee != PoolInit->stripPointerCasts() &&
+        Callee != PoolDestroy->stripPointerCasts())
+      continue;
+    if (L->contains(CI))
+      return false;
+    if (Callee == PoolInit->stripPointerCasts() && DT.dominates(CI, Entry))
+      Initialized = true;
+  }
+  return Initialized;
+}
+
+//
+// Method: batchAllocs()
+//
+// Description:
+//  Batch the poolalloc calls of a function that allocate a loop-invariant
+//  number of bytes from a loop-invariant pool in a loop with a known or
+//  bounded trip count.
+//
+//  The loop's preheader calls poolalloc_n for as many nodes as the loop has
+//  iterations.  The call site takes the next node of the batch inline and
+//  calls poolalloc_refill only if the batch ran out, which happens when the
+//  run-time capped the batch.  Each exit of the loop returns the nodes that
+//  were not used to the pool with poolfree_n, and so does every return of the
+//  function that the pool descriptor reaches.
+//
+void
+PoolOptimize::batchAllocs (Function &F, std::vector<CallInst*> &Allocs,
+                           Constant *PoolInit, Constant *PoolDestroy) {
+  DominatorTree &DT = getAnalysis<DominatorTreeWrapperPass>(F).getDomTree();
+  LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>(F).getLoopInfo();
+  ScalarEvolution &SE = getAnalysis<ScalarEvolution>(F);
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  LLVMContext &Context = F.getContext();
+  Type *Int64Type = Type::getInt64Ty(Context);
+
+  //
+  // Find the calls to batch and start their batches before changing the CFG,
+  // which would invalidate the loop information.
+  //
+  std::vector<std::pair<CallInst*, Value*> > Batches;
+  SCEVExpander Expander(SE, DL, "batch");
+  std::vector<Instruction*> Returns;
+  for (Function::iterator BB = F.begin(), E = F.end(); BB != E; ++BB)
+    if (isa<ReturnInst>(BB->getTerminator()) ||
+        isa<ResumeInst>(BB->getTerminator()))
+      Returns.push_back(BB->getTerminator());
+
+  for (unsigned i = 0, e = Allocs.size(); i != e; ++i) {
+    CallInst *CI = Allocs[i];
+    Value *PD = CI->getArgOperand(0);
+    Value *Size = CI->getArgOperand(1);
+    Loop *L = LI.getLoopFor(CI->getParent());
+    if (!L || !L->getLoopPreheader() || !L->hasDedicatedExits())
+      continue;
+    if (isa<Constant>(PD) && cast<Constant>(PD)->isNullValue())
+      continue;
+    if (!L->isLoopInvariant(PD) || !L->isLoopInvariant(Size))
+      continue;
+    if (!isInitializedBefore(PD, L, DT, PoolInit, PoolDestroy))
+      continue;
+
+    //
+    // The call runs at most once per iteration because it is not in a nested
+    // loop.  Use the exact trip count if there is one; a loop that is only
+    // bounded gets a batch no larger than MaxBoundedBatch, since the nodes it
+    // does not use are held until the loop exits.
+    //
+    const SCEV *BTC = SE.getBackedgeTakenCount(L);
+    uint64_t Limit = (1U << 30) - 1;
+    if (isa<SCEVCouldNotCompute>(BTC)) {
+      BTC = SE.getMaxBackedgeTakenCount(L);
+      if (isa<SCEVCouldNotCompute>(BTC) || MaxBoundedBatch < 2)
+        continue;
+      Limit = MaxBoundedBatch - 1;
+    }
+    if (const SCEVConstant *C = dyn_cast<SCEVConstant>(BTC))
+      if (C->getValue()->isZero() || C->getValue()->getValue().ugt(Limit))
+        continue;
+
+    BTC = SE.getNoopOrZeroExtend(BTC, Int64Type);
+    BTC = SE.getUMinExpr(BTC, SE.getConstant(Int64Type, Limit));
+    const SCEV *Count = SE.getAddExpr(SE.getTruncateExpr(BTC, Int32Type),
+                                      SE.getConstant(Int32Type, 1));
+    Instruction *InsertPt = L->getLoopPreheader()->getTerminator();
+    Value *N = Expander.expandCodeFor(Count, Int32Type, InsertPt);
+
+    //
+    // Start the batch before the loop and free what is left of it on every
+    // exit of the loop.  The batch starts out empty so that releasing it is
+    // harmless on paths that never reach the loop.
+    //
+    IRBuilder<> Builder(F.getEntryBlock().getFirstInsertionPt());
+    AllocaInst *Batch = Builder.CreateAlloca(PoolBatchTy, 0, "batch");
+    Value *Null = ConstantPointerNull::get(PointerType::getUnqual(Int8Type));
+    Builder.CreateStore(Null, Builder.CreateStructGEP(PoolBatchTy, Batch, 0));
+    Builder.CreateStore(Null, Builder.CreateStructGEP(PoolBatchTy, Batch, 1));
+    Builder.SetInsertPoint(InsertPt);
+    Builder.CreateCall(PoolAllocN, {PD, Size, N, Batch});
+
+    SmallVector<BasicBlock*, 4> Exits;
+    L->getUniqueExitBlocks(Exits);
+    for (unsigned j = 0, je = Exits.size(); j != je; ++j) {
+      Builder.SetInsertPoint(Exits[j]->getFirstInsertionPt());
+      Builder.CreateCall(PoolFreeN, {PD, Batch});
+    }
+
+    //
+    // Release the batch again before the function returns, so that no path
+    // out of the function keeps unused nodes whatever the shape of the loop's
+    // exits.  poolfree_n does nothing for a batch that is already empty.
+    //
+    Instruction *PDI = dyn_cast<Instruction>(PD);
+    for (unsigned j = 0, je = Returns.size(); j != je; ++j)
+      if (!PDI || DT.dominates(PDI, Returns[j])) {
+        Builder.SetInsertPoint(Returns[j]);
+        Builder.CreateCall(PoolFreeN, {PD, Batch});
+      }
+
+    Batches.push_back(std::make_pair(CI, Batch));
+  }
+
+  //
+  // Take the nodes from the batches.
+  //
+  MDNode *Unlikely = MDBuilder(Context).createBranchWeights(1, 64);
+  for (unsigned i = 0, e = Batches.size(); i != e; ++i) {
+    CallInst *CI = Batches[i].first;
+    Value *Batch = Batches[i].second;
+    Value *PD = CI->getArgOperand(0);
+    Value *Size = CI->getArgOperand(1);
+
+    IRBuilder<> Builder(CI);
+    Value *NextPtr = Builder.CreateStructGEP(PoolBatchTy, Batch, 0);
+    Value *EndPtr = Builder.CreateStructGEP(PoolBatchTy, Batch, 1);
+    Value *Next = Builder.CreateLoad(NextPtr, "batch.next");
+    Value *End = Builder.CreateLoad(EndPtr, "batch.end");
+    Value *Empty = Builder.CreateICmpEQ(Next, End, "batch.empty");
+
+    TerminatorInst *ThenTerm, *ElseTerm;
+    SplitBlockAndInsertIfThenElse(Empty, CI, &ThenTerm, &ElseTerm, Unlikely);
+
+    Builder.SetInsertPoint(ThenTerm);
+    Value *Refill = Builder.CreateCall(PoolAllocRefill, {PD, Size, Batch});
+
+    Builder.SetInsertPoint(ElseTerm);
+    Value *StridePtr = Builder.CreateStructGEP(PoolBatchTy, Batch, 2);
+    Value *Stride = Builder.CreateLoad(StridePtr, "batch.stride");
+    Value *NewNext = Builder.CreateInBoundsGEP(Next, Stride);
+    Builder.CreateStore(NewNext, NextPtr);
+
+    Builder.SetInsertPoint(CI);
+    PHINode *Node = Builder.CreatePHI(CI->getType(), 2);
+    Node->addIncoming(Refill, ThenTerm->getParent());
+    Node->addIncoming(Next, ElseTerm->getParent());
+    Node->takeName(CI);
+    CI->replaceAllUsesWith(Node);
+    CI->eraseFromParent();
+    ++NumBatched;
+  }
+}
+
@@ -0,0 +1,451 @@
+//===-- SizeClassHeuristic.cpp - Size class aware PA heuristic ------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a heuristic that chooses the kind of each pool from the
+// sizes and the estimated allocation frequencies of the objects in it.
+//
+// The run-time offers three kinds of pools:
+//
+//  o Bump pointer pools (poolinit_bp) never reuse memory and are the cheapest
+//    to allocate from.  The PoolOptimize pass converts pools that are never
+//    freed into bump pointer pools; this heuristic keeps the nodes that are
+//    never freed out of the pools of nodes that are.
+//
+//  o Pools with a fixed node size (poolinit with a non-zero size) allocate
+//    objects of one size from slabs.
+//
+//  o General pools (poolinit with a zero size) handle objects of any size.
+//
+// Each pool costs a poolinit() and a pooldestroy() every time the function
+// creating it runs, along with the slabs it keeps partly filled.  A node whose
+// objects are allocated less often than that cost justifies is merged into a
+// pool shared with the other nodes of its kind and size class.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "poolalloc"
+
+#include "dsa/DSGraphTraits.h"
+#include "poolalloc/Heuristic.h"
+#include "poolalloc/PoolAllocate.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/MathExtras.h"
+
+#include <algorithm>
+
+using namespace llvm;
+using namespace PA;
+
+namespace {
+  STATISTIC (NumBumpPools,    "Number of pools for objects never freed");
+  STATISTIC (NumSlabPools,    "Number of pools with a fixed node size");
+  STATISTIC (NumGeneralPools, "Number of general pools");
+  STATISTIC (NumMergedNodes,  "Number of nodes merged into a shared pool");
+
+  cl::opt<unsigned>
+  MaxSlabSize("paheur-sizeclass-max-slab",
+              cl::desc("Largest object size given a fixed node size pool"),
+              cl::init(512));
+
+  cl::opt<unsigned>
+  PoolCost("paheur-sizeclass-pool-cost",
+           cl::desc("Estimated cost of creating and destroying a pool, in "
+                    "allocations"),
+           cl::init(64));
+
+  //
+  // The cost of sharing a pool, relative to the cost of an allocation: each
+  // allocation from a shared pool interleaves objects of different nodes, and
+  // each byte by which an object is rounded up to its size class is wasted.
+  //
+  const double SharingCost = 0.25;
+  const double WastedByteCost = 1.0 / 64;
+}
+
+//
+// Function: getAllocSize()
+//
+// Description:
+//  Determine the number of bytes allocated by a call to an allocator.
+//
+// Return value:
+//  The constant size of the allocation, or zero if the size is not constant.
+//
+static unsigned
+getAllocSize (CallSite CS, StringRef Name) {
+  if (Name == "malloc") {
+    if (ConstantInt * C = dyn_cast<ConstantInt>(CS.getArgument(0)))
+      return C->getLimitedValue(~0U);
+  } else if (Name == "calloc") {
+    ConstantInt * N = dyn_cast<ConstantInt>(CS.getArgument(0));
+    ConstantInt * S = dyn_cast<ConstantInt>(CS.getArgument(1));
+    if (N && S)
+      return (N->getValue() * S->getValue()).getLimitedValue(~0U);
+  }
+
+  return 0;
+}
+
+//
+// Method: addSite()
+//
+// Description:
+//  Record an allocation or deallocation site of the objects of a DSNode.  The
+//  site is also recorded for the corresponding node in the globals graph.
+//
+// Inputs:
+//  G      - The DSGraph of the function containing the site.
+//  GGMap  - The mapping from the nodes of G to the nodes of the globals graph.
+//  N      - The DSNode of the objects allocated or freed at the site.
+//  Freq   - The estimated number of times the site is executed.
+//  IsFree - Whether the site frees the objects.
+//  Size   - The constant number of bytes allocated at the site, or zero.
+//
+void
+SizeClassHeuristic::addSite (DSGraph * G, DSGraph::NodeMapTy & GGMap,
+                             const DSNode * N, double Freq, bool IsFree,
+                             unsigned Size) {
+  const DSNode * Nodes[2];
+  Nodes[0] = N;
+  Nodes[1] = N ? GGMap[N].getNode() : 0;
+
+  for (unsigned index = 0; index < 2; ++index) {
+    if (!Nodes[index])
+      continue;
+
+    NodeProfile & P = Profiles[Nodes[index]];
+    if (IsFree) {
+      P.Frees += Freq;
+      continue;
+    }
+
+    P.Allocs += Freq;
+    ++P.AllocSites;
+    if (Size == 0 || (P.ObjSize && P.ObjSize != Size))
+      P.VariableSize = true;
+    else
+      P.ObjSize = Size;
+  }
+}
+
+//
+// Method: profileFunction()
+//
+// Description:
+//  Estimate how often the objects of each DSNode of the function are
+//  allocated and freed by the calls to allocators within the function, and
+//  record the other calls that the function makes so that the frees of its
+//  callees can be added in later.
+//
+void
+SizeClassHeuristic::profileFunction (Function & F) {
+  if (F.isDeclaration() || !Graphs->hasDSGraph (F))
+    return;
+
+  DSGraph * G = Graphs->getDSGraph (F);
+  DSGraph::NodeMapTy GGMap;
+  G->computeGToGGMapping (GGMap);
+
+  //
+  // Scale the block frequencies by the number of calls to the function if the
+  // profile provides it.
+  //
+  double Calls = 1;
+  if (Optional<uint64_t> Count = F.getEntryCount())
+    Calls = std::max<uint64_t> (*Count, 1);
+  EntryFreqs[&F] = Calls;
+
+  BlockFrequencyInfo & BFI = getAnalysis<BlockFrequencyInfo>(F);
+  double EntryFreq = std::max<uint64_t> (BFI.getEntryFreq(), 1);
+
+  FreeMapTy & Frees = FuncFrees[&F];
+  CallListTy & CallList = FuncCalls[&F];
+  for (Function::iterator BB = F.begin(); BB != F.end(); ++BB) {
+    double Freq = Calls * BFI.getBlockFreq (BB).getFrequency() / EntryFreq;
+    for (BasicBlock::iterator I = BB->begin(); I != BB->end(); ++I) {
+      CallSite CS (I);
+      if (!CS || isa<IntrinsicInst>(I))
+        continue;
+
+      Function * Callee = CS.getCalledFunction();
+      StringRef Name = Callee ? Callee->getName() : "";
+      bool IsFree = (Name == "free" || Name == "cfree" || Name == "realloc");
+      bool IsAlloc = (Name == "malloc" || Name == "calloc" ||
+                      Name == "realloc" || Name == "strdup");
+      if (!IsFree && !IsAlloc) {
+        CallList.push_back (std::make_pair (&*I, Freq));
+        continue;
+      }
+
+      if (IsFree && G->hasNodeForValue (CS.getArgument (0))) {
+        const DSNode * N = G->getNodeForValue (CS.getArgument (0)).getNode();
+        addSite (G, GGMap, N, Freq, true, 0);
+        if (N)
+          Frees[N] += Freq;
+      }
+      if (IsAlloc && G->hasNodeForValue (I))
+        addSite (G, GGMap, G->getNodeForValue (I).getNode(), Freq, false,
+                 getAllocSize (CS, Name));
+    }
+  }
+}
+
+//
+// Method: propagateFrees()
+//
+// Description:
+//  Add the frees made by the callees of a function, and by their callees, to
+//  the DSNodes of the function that are passed to or returned from them.
+//  Callees are visited first so that a free made several calls away reaches
+//  the function that allocates the objects; the callees of a recursive cycle
+//  share one DSGraph, so the back edges that this skips lose nothing.
+//
+// Inputs:
+//  F       - The function whose calls are processed.
+//  Visited - The functions that have already been processed.
+//
+void
+SizeClassHeuristic::propagateFrees (const Function * F,
+                                    std::set<const Function *> & Visited) {
+  if (!FuncCalls.count (F) || !Visited.insert (F).second)
+    return;
+
+  DSGraph * G = Graphs->getDSGraph (*F);
+  DSGraph::NodeMapTy GGMap;
+  G->computeGToGGMapping (GGMap);
+  const DSCallGraph & CallGraph = Graphs->getCallGraph();
+
+  CallListTy & CallList = FuncCalls[F];
+  for (unsigned index = 0; index < CallList.size(); ++index) {
+    CallSite CS (CallList[index].first);
+    double Freq = CallList[index].second;
+
+    std::vector<const Function *> Callees;
+    if (const Function * Callee = CS.getCalledFunction())
+      Callees.push_back (Callee);
+    else
+      Callees.insert (Callees.end(), CallGraph.callee_begin (CS),
+                                     CallGraph.callee_end (CS));
+
+    for (unsigned c = 0; c < Callees.size(); ++c) {
+      const Function * Callee = Callees[c];
+      propagateFrees (Callee, Visited);
+      if (!FuncFrees.count (Callee) || FuncFrees[Callee].empty())
+        continue;
+
+      DSGraph * CalleeGraph = Graphs->getDSGraph (*Callee);
+      if (CalleeGraph == G)
+        continue;
+
+      //
+      // Map the nodes of the callee's arguments and return value onto the
+      // nodes of the call.  Nodes reachable from globals need no mapping: the
+      // frees of the callee were recorded in the globals graph already.
+      //
+      DSGraph::NodeMapTy NodeMap;
+      Function::const_arg_iterator FAI = Callee->arg_begin();
+      Function::const_arg_iterator FAE = Callee->arg_end();
+      CallSite::arg_iterator AI = CS.arg_begin(), AE = CS.arg_end();
+      for (; FAI != FAE && AI != AE; ++FAI, ++AI)
+        if (CalleeGraph->hasNodeForValue (FAI) && G->hasNodeForValue (*AI))
+          DSGraph::computeNodeMapping (CalleeGraph->getNodeForValue (FAI),
+                                       G->getNodeForValue (*AI),
+                                       NodeMap, false);
+      if (G->hasNodeForValue (CS.getInstruction()))
+        DSGraph::computeNodeMapping (CalleeGraph->getReturnNodeFor (*Callee),
+                                     G->getNodeForValue (CS.getInstruction()),
+                                     NodeMap, false);
+
+      //
+      // The frees of the callee were counted over all of its calls; scale them
+      // to the calls made from this site.
+      //
+      double Scale = Freq / EntryFreqs[Callee];
+      FreeMapTy & CalleeFrees = FuncFrees[Callee];
+      FreeMapTy & Frees = FuncFrees[F];
+      for (FreeMapTy::iterator FI = CalleeFrees.begin();
+           FI != CalleeFrees.end(); ++FI) {
+        DSGraph::NodeMapTy::iterator MI = NodeMap.find (FI->first);
+        if (MI == NodeMap.end() || !MI->second.getNode())
+          continue;
+        const DSNode * N = MI->second.getNode();
+        addSite (G, GGMap, N, FI->second * Scale, true, 0);
+        Frees[N] += FI->second * Scale;
+      }
+    }
+  }
+}
+
+//
+// Method: getPoolKind()
+//
+// Description:
+//  Choose the kind of pool for the objects of a DSNode.
+//
+// Outputs:
+//  Size - The node size for a pool of fixed-size nodes; otherwise, the size of
+//         the objects if it is known or zero.
+//
+SizeClassHeuristic::PoolKind
+SizeClassHeuristic::getPoolKind (const DSNode * N, unsigned & Size) {
+  NodeProfile & P = Profiles[N];
+
+  //
+  // Without allocation sites, rely on the types that DSA found.
+  //
+  if (P.AllocSites == 0) {
+    Size = getRecommendedSize (N);
+    if (Size && Size <= MaxSlabSize)
+      return SlabPool;
+    return GeneralPool;
+  }
+
+  Size = P.VariableSize ? 0 : P.ObjSize;
+  if (P.Frees == 0)
+    return BumpPool;
+  if (Size > 1 && Size <= MaxSlabSize) {
+    unsigned Align = std::max (getRecommendedAlignment (N), 1u);
+    Size = RoundUpToAlignment (Size, Align);
+    return SlabPool;
+  }
+  return GeneralPool;
+}
+
+bool
+SizeClassHeuristic::runOnModule (Module & Module) {
+  //
+  // Remember which module we are analyzing.
+  //
+  M = &Module;
+
+  //
+  // Get the reference to the DSA Graph.
+  //
+  Graphs = &getAnalysis<EQTDDataStructures>();
+
+  //
+  // Estimate the allocation behavior of each DSNode.
+  //
+  for (Module::iterator F = M->begin(); F != M->end(); ++F)
+    profileFunction (*F);
+
+  //
+  // Objects are often freed by a function other than the one allocating
+  // them; add the frees of each function to its callers, callees first.
+  //
+  std::set<const Function *> Visited;
+  for (Module::iterator F = M->begin(); F != M->end(); ++F)
+    propagateFrees (F, Visited);
+
+  //
+  // Find DSNodes which are reachable from globals and should be pool
+  // allocated.
+  //
+  findGlobalPoolNodes (GlobalPoolNodes);
+
+  // We never modify anything in this pass
+  return false;
+}
+
+void
+SizeClassHeuristic::getAnalysisUsage (AnalysisUsage &AU) const {
+  // We require DSA while this pass is still responding to queries
+  AU.addRequiredTransitive<EQTDDataStructures>();
+
+  // The block frequencies estimate how often objects are allocated
+  AU.addRequired<BlockFrequencyInfo>();
+
+  // This pass does not modify anything when it runs
+  AU.setPreservesAll();
+}
+
+void
+SizeClassHeuristic::AssignToPools (const DSNodeList_t & NodesToPA,
+                                   Function * F, DSGraph * G,
+                                   std::vector<OnePool> & ResultPools) {
+  //
+  // Determine how often the pools are created: once for global pools, and on
+  // every call for the pools of a function.
+  //
+  double Calls = 1;
+  if (F) {
+    if (Function * Orig = PA->getOrigFunctionFromClone (F))
+      F = Orig;
+    if (EntryFreqs.count (F))
+      Calls = EntryFreqs[F];
+  }
+
+  //
+  // The shared pools, indexed by kind and size class.
+  //
+  std::map<std::pair<unsigned, unsigned>, unsigned> SharedPools;
+
+  for (unsigned i = 0, e = NodesToPA.size(); i != e; ++i) {
+    const DSNode * N = NodesToPA[i];
+    unsigned Size;
+    PoolKind Kind = getPoolKind (N, Size);
+
+    OnePool Pool (N);
+    Pool.PoolSize = (Kind == SlabPool) ? Size : 0;
+
+    //
+    // Share a pool with the other rarely allocated nodes of the same kind and
+    // size class if creating a pool costs more than sharing one.  Nodes whose
+    // allocation sites were not found are assumed to be allocated often.
+    //
+    unsigned SizeClass = 0;
+    if (Kind == SlabPool)
+      SizeClass = std::max<unsigned> (NextPowerOf2 (Size - 1), 8);
+    double Waste = SizeClass - Pool.PoolSize;
+    double SharedCost = Profiles[N].Allocs *
+                        (SharingCost + Waste * WastedByteCost);
+
+    if (Profiles[N].AllocSites && PoolCost * Calls > SharedCost) {
+      std::pair<unsigned, unsigned> Key (Kind, SizeClass);
+      if (SharedPools.count (Key)) {
+        OnePool & Shared = ResultPools[SharedPools[Key]];
+        Shared.NodesInPool.push_back (N);
+        Shared.PoolAlignment = std::max (Shared.PoolAlignment,
+                                         Pool.PoolAlignment);
+        ++NumMergedNodes;
+        continue;
+      }
+
+      Pool.PoolSize = SizeClass;
+      SharedPools[Key] = ResultPools.size();
+    }
+
+    DEBUG (errs() << "SizeClass: node " << N << " kind " << Kind
+                  << " size " << Pool.PoolSize << "\n");
+    switch (Kind) {
+      case BumpPool:    ++NumBumpPools;    break;
+      case SlabPool:    ++NumSlabPools;    break;
+      case GeneralPool: ++NumGeneralPools; break;
+    }
+    ResultPools.push_back (Pool);
+  }
+}
+
+//
+// Register the heuristic pass.
+//
+static RegisterPass<SizeClassHeuristic>
+H ("paheur-SizeClass", "Pool allocate using the size class cost model");
+
+RegisterAnalysisGroup<Heuristic> Heuristic8(H);
+
+char SizeClassHeuristic::ID = 0;
@@ -1,21 +1,38 @@
+#include <inttypes.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-static unsigned long * Total = 0;
-static unsigned long * Safe = 0;
+static uint64_t * Total = 0;
+static uint64_t * Safe = 0;
+
+/*
+ * Structure: SiteTable
+ *
+ * Description:
+ *  The check site counters of one instrumented module.
+ */
+struct SiteTable {
+  uint64_t * counts;
+  const char ** names;
+  unsigned num;
+  struct SiteTable * next;
+};
+
+static struct SiteTable * Sites = 0;
 
 static void
 printItAll (void) {
   FILE * fp = fopen ("lsstats", "w");
-  fprintf (fp, "%lu Safe \n", *Safe);
-  fprintf (fp, "%lu Total \n", *Total);
+  fprintf (fp, "%" PRIu64 " Safe \n", *Safe);
+  fprintf (fp, "%" PRIu64 " Total \n", *Total);
   fflush (fp);
   fclose (fp);
   return;
 }
 
 void
-DYN_COUNT_setup (unsigned long * total, unsigned long * safe) {
+DYN_COUNT_setup (uint64_t * total, uint64_t * safe) {
   Total = total;
   Safe = safe;
   atexit (printItAll);
@@ -23,3 +40,49 @@ DYN_COUNT_setup (unsigned long * total, unsigned long * safe) {
 }
 
 
+
+/*
+ * Function: printSites()
+ *
+ * Description:
+ *  Append the count of every check site to the check profile.  The file named
+ *  by the SC_CHECK_PROFILE environment variable is used if it is set;
+ *  otherwise, the profile is written to "checkprofile".  Appending lets the
+ *  profiles of several training runs accumulate in one file.
+ */
+static void
+printSites (void) {
+  const char * filename = getenv ("SC_CHECK_PROFILE");
+  FILE * fp = fopen (filename ? filename : "checkprofile", "a");
+  if (!fp)
+    return;
+
+  struct SiteTable * table;
+  for (table = Sites; table; table = table->next) {
+    unsigned index;
+    for (index = 0; index < table->num; ++index)
+      fprintf (fp, "%" PRIu64 " %s\n",
+               table->counts[index], table->names[index]);
+  }
+  fclose (fp);
+  return;
+}
+
+void
+DYN_COUNT_registerSites (uint64_t * counts,
+                         const char ** names,
+                         unsigned num) {
+  struct SiteTable * table = malloc (sizeof (struct SiteTable));
+  if (!table)
+    return;
+
+  if (!Sites)
+    atexit (printSites);
+
+  table->counts = counts;
+  table->names = names;
+  table->num = num;
+  table->next = Sites;
+  Sites = table;
+  return;
+}
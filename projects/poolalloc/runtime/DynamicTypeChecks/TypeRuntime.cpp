@@ -68,6 +68,11 @@ std::map<void *, struct va_info> VA_InfoMap;
 // Pointer to the shadow_memory
 TypeTagTy * const shadow_begin = BASE;
 
+// The geometry of the shadow memory, read by the fast paths that
+// TypeChecksOpt inlines into the program.
+extern "C" TypeTagTy * const TypeShadowBase = BASE;
+extern "C" const uintptr_t TypeShadowSize = SIZE;
+
 // Map from type numbers to type names.
 extern char* typeNames[];
 
@@ -111,6 +116,139 @@ extern "C" {
 
 void trackInitInst(void *ptr, uint64_t size, uint32_t tag);
 
+extern "C" {
+  void trackStoreInst_1(void *ptr, TypeTagTy typeNumber, uint64_t size, uint32_t tag) ;
+  void trackStoreInst_2(void *ptr, TypeTagTy typeNumber, uint64_t size, uint32_t tag) ;
+  void trackStoreInst_4(void *ptr, TypeTagTy typeNumber, uint64_t size, uint32_t tag) ;
+  void trackStoreInst_8(void *ptr, TypeTagTy typeNumber, uint64_t size, uint32_t tag) ;
+  void trackStoreInst_16(void *ptr, TypeTagTy typeNumber, uint64_t size, uint32_t tag) ;
+  void checkType_1(TypeTagTy typeNumber, uint64_t size, TypeTagTy *metadata, void *ptr, uint32_t tag);
+  void checkType_2(TypeTagTy typeNumber, uint64_t size, TypeTagTy *metadata, void *ptr, uint32_t tag);
+  void checkType_4(TypeTagTy typeNumber, uint64_t size, TypeTagTy *metadata, void *ptr, uint32_t tag);
+  void checkType_8(TypeTagTy typeNumber, uint64_t size, TypeTagTy *metadata, void *ptr, uint32_t tag);
+  void checkType_16(TypeTagTy typeNumber, uint64_t size, TypeTagTy *metadata, void *ptr, uint32_t tag);
+}
+
+/*
+ * Shadow encoding: the first byte of a typed object holds its type number and
+ * every following byte holds 0xFE.  Initialized but untyped memory is all
+ * 0xFF, and unknown memory is all 0x00.
+ *
+ * The kernels below read and write the shadow a machine word at a time.  The
+ * pattern for an N-byte object (N <= 8) is built with the same memcpy that
+ * loads the shadow, so it holds the type number followed by N-1 bytes of 0xFE
+ * in memory order on both little- and big-endian hosts.
+ */
+#define TAIL_PATTERN (0xFEFEFEFEFEFEFEFEULL)
+#define INIT_PATTERN (0xFFFFFFFFFFFFFFFFULL)
+
+static inline uint64_t loadShadow(const TypeTagTy *md, unsigned n) {
+  uint64_t v = 0;
+  memcpy(&v, md, n);
+  return v;
+}
+
+static inline void storeShadow(TypeTagTy *md, uint64_t v, unsigned n) {
+  memcpy(md, &v, n);
+}
+
+static inline uint64_t storePattern(TypeTagTy typeNumber, unsigned n) {
+  TypeTagTy bytes[8];
+  bytes[0] = typeNumber;
+  memset(bytes + 1, 0xFE, 7);
+  return loadShadow(bytes, n);
+}
+
+/*
+ * Return true if all size bytes at md hold the given value.
+ */
+static inline bool allBytesAre(const TypeTagTy *md, uint64_t size, TypeTagTy val) {
+  uint64_t word = val * 0x0101010101010101ULL;
+  uint64_t i = 0;
+  for (; i + 8 <= size; i += 8)
+    if (loadShadow(md + i, 8) != word)
+      return false;
+  for (; i < size; ++i)
+    if (md[i] != val)
+      return false;
+  return true;
+}
+
+/*
+ * Return true if every byte after the first of a size-byte object holds val.
+ */
+static inline bool tailBytesAre(const TypeTagTy *md, uint64_t size, TypeTagTy val) {
+  return size <= 1 || allBytesAre(md + 1, size - 1, val);
+}
+
+/*
+ * Fill the shadow for a store of size bytes of the given type.
+ */
+static inline void fillShadow(TypeTagTy *md, TypeTagTy typeNumber, uint64_t size) {
+  switch (size) {
+  case 1: md[0] = typeNumber; return;
+  case 2: storeShadow(md, storePattern(typeNumber, 2), 2); return;
+  case 4: storeShadow(md, storePattern(typeNumber, 4), 4); return;
+  case 8: storeShadow(md, storePattern(typeNumber, 8), 8); return;
+  case 16:
+    storeShadow(md, storePattern(typeNumber, 8), 8);
+    storeShadow(md + 8, TAIL_PATTERN, 8);
+    return;
+  default:
+    md[0] = typeNumber;
+    memset(md + 1, 0xFE, size - 1);
+    return;
+  }
+}
+
+/*
+ * Mismatch reporting.  A check that fails inside a loop would otherwise print
+ * the same message on every iteration, so each (tag, kind) pair is reported
+ * only once and later occurrences are counted.  The count is printed at exit.
+ */
+enum ReportKind {
+  TypeMismatch = 1,
+  AlignmentMismatch = 2,
+  MObMismatch = 3
+};
+
+#define REPORT_TABLE_SIZE 4096
+static volatile uint64_t ReportedTable[REPORT_TABLE_SIZE];
+static volatile uint64_t SuppressedReports = 0;
+
+static void printSuppressedReports() {
+  if (SuppressedReports)
+    fprintf(stderr, "TypeRuntime: %" PRIu64 " duplicate type mismatch reports suppressed\n", SuppressedReports);
+}
+
+/*
+ * Return true if this report is the first one for its tag and kind.  When
+ * the table fills up, everything is reported.  Entries are claimed with a
+ * compare-and-swap, so threads that fail the same check concurrently print
+ * it only once.
+ */
+static bool firstReport(uint32_t tag, ReportKind kind) {
+  uint64_t key = ((uint64_t)tag << 8) | kind;
+  unsigned slot = (unsigned)((key * 0x9E3779B97F4A7C15ULL) >> 52) & (REPORT_TABLE_SIZE - 1);
+  for (unsigned probe = 0; probe < REPORT_TABLE_SIZE; ++probe) {
+    volatile uint64_t *entry = &ReportedTable[(slot + probe) & (REPORT_TABLE_SIZE - 1)];
+    uint64_t old = __sync_val_compare_and_swap(entry, 0, key);
+    if (old == 0)
+      return true;
+    if (old == key) {
+      __sync_fetch_and_add(&SuppressedReports, 1);
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * The out-of-line part of checkType(): report the mismatch or retype
+ * initialized memory.  Only reached when the fast comparison fails.
+ */
+static void checkTypeSlow(TypeTagTy typeNumber, uint64_t size, TypeTagTy *metadata, void *ptr, uint32_t tag) __attribute__((noinline));
+
 inline uintptr_t maskAddress(void *ptr) {
   uintptr_t p = (uintptr_t)ptr;
   if(ptr < BASE)
@@ -132,6 +270,7 @@ void shadowInit() {
     assert(0 && "MAP_FAILED");
   }
   VA_InfoMap.clear();
+  atexit(printSuppressedReports);
 }
 
 /**
@@ -160,8 +299,7 @@ void trackEnvpType(char **envp) {
  */
 void trackGlobal(void *ptr, TypeTagTy typeNumber, uint64_t size, uint32_t tag) {
   uintptr_t p = maskAddress(ptr);
-  shadow_begin[p] = typeNumber;
-  memset(&shadow_begin[p + 1], 0xFE, size - 1);
+  fillShadow(&shadow_begin[p], typeNumber, size);
 #if DEBUG
   cerr << "Global(" << tag << "): " << ptr << "= " << typeNumber << " " << size << "bytes\n";
 #endif
@@ -186,13 +324,28 @@ void trackArray(void *ptr, uint64_t size, uint64_t count, uint32_t tag) {
  */
 void trackStoreInst(void *ptr, TypeTagTy typeNumber, uint64_t size, uint32_t tag) {
   uintptr_t p = maskAddress(ptr);
-  shadow_begin[p] = typeNumber;
-  memset(&shadow_begin[p + 1], 0xFE, size - 1);
+  fillShadow(&shadow_begin[p], typeNumber, size);
 #if DEBUG
   cerr << "Store(" << tag << "): " << ptr << "= " << typeNumber << " " << size << "bytes\n";
 #endif
 }
 
+/*
+ * Size-specialized versions of trackStoreInst.  TypeChecksOpt normally
+ * inlines stores of these sizes into the program and calls these only when
+ * inlining is disabled; the size argument is ignored.
+ */
+#define TRACK_STORE_N(N) \
+void trackStoreInst_##N(void *ptr, TypeTagTy typeNumber, uint64_t size, uint32_t tag) { \
+  fillShadow(&shadow_begin[maskAddress(ptr)], typeNumber, N); \
+}
+TRACK_STORE_N(1)
+TRACK_STORE_N(2)
+TRACK_STORE_N(4)
+TRACK_STORE_N(8)
+TRACK_STORE_N(16)
+#undef TRACK_STORE_N
+
 /**
  * Record that a string is stored at ptr
  */
@@ -204,7 +357,7 @@ void trackStringInput(void *ptr, uint32_t tag) {
  * Check that the two types match
  */
 void compareTypes(TypeTagTy typeNumberSrc, TypeTagTy typeNumberDest, uint32_t tag) {
-  if(typeNumberSrc != typeNumberDest) {
+  if(typeNumberSrc != typeNumberDest && firstReport(tag, TypeMismatch)) {
     printf("Type mismatch(%u): expecting %s, found %s! \n", tag, typeNames[typeNumberSrc], typeNames[typeNumberDest]);
   }
 }
@@ -252,22 +405,58 @@ checkType(TypeTagTy typeNumber, uint64_t size, TypeTagTy *metadata, void *ptr, u
     assert(ptr == NULL);
     return;
   }
+  /* Fast path: the object was stored with the type being read. */
+  if (metadata[0] == typeNumber && tailBytesAre(metadata, size, 0xFE))
+    return;
+  checkTypeSlow(typeNumber, size, metadata, ptr, tag);
+}
+
+/*
+ * Size-specialized versions of checkType, compared with a single load.
+ * TypeChecksOpt inlines the null test and the comparison and calls these
+ * only on a mismatch (or for every check when inlining is disabled).
+ */
+#define CHECK_TYPE_N(N, CMP) \
+void checkType_##N(TypeTagTy typeNumber, uint64_t size, TypeTagTy *metadata, void *ptr, uint32_t tag) { \
+  if (metadata == NULL) { \
+    assert(ptr == NULL); \
+    return; \
+  } \
+  if (CMP) \
+    return; \
+  checkTypeSlow(typeNumber, N, metadata, ptr, tag); \
+}
+CHECK_TYPE_N(1, metadata[0] == typeNumber)
+CHECK_TYPE_N(2, loadShadow(metadata, 2) == storePattern(typeNumber, 2))
+CHECK_TYPE_N(4, loadShadow(metadata, 4) == storePattern(typeNumber, 4))
+CHECK_TYPE_N(8, loadShadow(metadata, 8) == storePattern(typeNumber, 8))
+CHECK_TYPE_N(16, loadShadow(metadata, 8) == storePattern(typeNumber, 8) &&
+                 loadShadow(metadata + 8, 8) == TAIL_PATTERN)
+#undef CHECK_TYPE_N
+
+static void
+checkTypeSlow(TypeTagTy typeNumber, uint64_t size, TypeTagTy *metadata, void *ptr, uint32_t tag) {
   /* Check if this an initialized but untyped memory.*/
   if (typeNumber != metadata[0]) {
     if (metadata[0] != 0xFF) {
       if(metadata[0] == 0xFE) {
-        printf("Type alignment mismatch(%u): %p expecting %s, found MOb!\n",  tag, ptr, typeNames[typeNumber]);
+        if (firstReport(tag, MObMismatch))
+          printf("Type alignment mismatch(%u): %p expecting %s, found MOb!\n",  tag, ptr, typeNames[typeNumber]);
       } else {
-        printf("Type mismatch(%u): %p expecting %s, found %s!\n", tag, ptr, typeNames[typeNumber], typeNames[metadata[0]]);
+        if (firstReport(tag, TypeMismatch))
+          printf("Type mismatch(%u): %p expecting %s, found %s!\n", tag, ptr, typeNames[typeNumber], typeNames[metadata[0]]);
       }
       return;
     } else {
       /* If so, set type to the type being read.
          Check that none of the bytes are typed.*/
-      for (unsigned i = 1; i < size; ++i) {
-        if (0xFF != metadata[i]) {
-          printf("Type alignment mismatch(%u): expecting %s, found %s!\n", tag, typeNames[typeNumber], typeNames[metadata[i]]);
-          break;
+      if (!tailBytesAre(metadata, size, 0xFF)) {
+        for (unsigned i = 1; i < size; ++i) {
+          if (0xFF != metadata[i]) {
+            if (firstReport(tag, AlignmentMismatch))
+              printf("Type alignment mismatch(%u): expecting %s, found %s!\n", tag, typeNames[typeNumber], typeNames[metadata[i]]);
+            break;
+          }
         }
       }
       trackStoreInst(ptr, typeNumber, size, tag);
@@ -275,12 +464,9 @@ checkType(TypeTagTy typeNumber, uint64_t size, TypeTagTy *metadata, void *ptr, u
     }
   }
 
-  for (unsigned i = 1 ; i < size; ++i) {
-    if (0xFE != metadata[i]) {
-      printf("Type alignment mismatch(%u): expecting %s, found %s!\n", tag, typeNames[typeNumber], typeNames[metadata[0]]);
-      break;
-    }
-  }
+  if (!tailBytesAre(metadata, size, 0xFE) &&
+      firstReport(tag, AlignmentMismatch))
+    printf("Type alignment mismatch(%u): expecting %s, found %s!\n", tag, typeNames[typeNumber], typeNames[metadata[0]]);
 }
 
 /**
@@ -290,8 +476,20 @@ checkType(TypeTagTy typeNumber, uint64_t size, TypeTagTy *metadata, void *ptr, u
 void trackInitInst(void *ptr, uint64_t size, uint32_t tag) {
   if(!ptr)
     return;
-  uintptr_t p = maskAddress(ptr);
-  memset(&shadow_begin[p], 0xFF, size);
+  TypeTagTy *md = &shadow_begin[maskAddress(ptr)];
+  switch (size) {
+  case 1: md[0] = 0xFF; break;
+  case 2: storeShadow(md, INIT_PATTERN, 2); break;
+  case 4: storeShadow(md, INIT_PATTERN, 4); break;
+  case 8: storeShadow(md, INIT_PATTERN, 8); break;
+  case 16:
+    storeShadow(md, INIT_PATTERN, 8);
+    storeShadow(md + 8, INIT_PATTERN, 8);
+    break;
+  default:
+    memset(md, 0xFF, size);
+    break;
+  }
 #if DEBUG
   cerr << "Initialize(" << tag << "): " << ptr << " " << size << "bytes\n";
 #endif
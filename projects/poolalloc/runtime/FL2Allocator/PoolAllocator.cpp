@@ -19,6 +19,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 typedef long intptr_t;
 typedef unsigned long uintptr_t;
@@ -27,6 +29,25 @@ typedef unsigned long uintptr_t;
 #define INITIAL_SLAB_SIZE 4096
 #define LARGE_SLAB_SIZE   4096
 
+// Pointer compressed pools reserve the address range that their indices can
+// reach: all of 4GB on 64-bit hosts.  Memory is committed PC_INITIAL_COMMIT
+// bytes at a time when the pool is created, and the committed part doubles
+// as the pool grows.
+#if defined(__LP64__)
+#define PC_RESERVE_SIZE   (1UL << 32)
+#else
+#define PC_RESERVE_SIZE   (256UL*1024*1024)
+#endif
+#define PC_INITIAL_COMMIT (64*1024)
+
+// Reserved ranges are aligned to PC_STAGGER_SIZE bytes, and pools start at
+// most PC_STAGGER_SIZE bytes into their range.
+#define PC_STAGGER_SIZE   (64*1024)
+
+// MAX_BATCH_SIZE - The largest number of bytes that one call to poolalloc_n
+// carves out of a pool.  Loops that allocate more nodes refill their batch.
+#define MAX_BATCH_SIZE    (1024*1024)
+
 #ifndef NDEBUG
 #define NDEBUG
 #endif
@@ -238,6 +259,7 @@ public:
   static void *create_for_bp(PoolTy<PoolTraits> *Pool);
   static void create_for_ptrcomp(PoolTy<PoolTraits> *Pool,
                                  void *Mem, unsigned Size);
+  static bool grow_for_ptrcomp(PoolTy<PoolTraits> *Pool, unsigned NumBytes);
   void destroy();
 
   PoolSlab<PoolTraits> *getNext() const { return Next; }
@@ -352,6 +374,52 @@ void PoolSlab<PoolTraits>::create_for_ptrcomp(PoolTy<PoolTraits> *Pool,
   PS->Next = 0;
 }
 
+/// grow_for_ptrcomp - Commit more of the address range reserved for a pointer
+/// compressed pool, so that an object of NumBytes bytes fits in the new part.
+/// The end marker of the committed part becomes the header of a free node
+/// covering the new memory.  Returns false if the range is exhausted.
+template<typename PoolTraits>
+bool PoolSlab<PoolTraits>::grow_for_ptrcomp(PoolTy<PoolTraits> *Pool,
+                                            unsigned NumBytes) {
+  char *Base = (char*)Pool->Slabs;
+  char *CommitEnd = Base + Pool->CommittedSize;
+  char *RangeEnd = (char*)((uintptr_t)Base & ~(uintptr_t)(PC_STAGGER_SIZE-1)) +
+                   PC_RESERVE_SIZE;
+
+  // Double the committed part, but always make room for the object and the
+  // new end marker.
+  unsigned long PageSize = sysconf(_SC_PAGESIZE);
+  unsigned long Needed = (unsigned long)NumBytes +
+                         sizeof(NodeHeader<PoolTraits>) +
+                         sizeof(FreedNodeHeader<PoolTraits>);
+  unsigned long Growth = Pool->CommittedSize;
+  if (Growth < Needed)
+    Growth = Needed;
+  Growth = (Growth + PageSize - 1) & ~(PageSize - 1);
+  if (Growth > (unsigned long)(RangeEnd - CommitEnd))
+    Growth = RangeEnd - CommitEnd;
+  if (Growth < Needed)
+    return false;
+
+  if (mprotect(CommitEnd, Growth, PROT_READ|PROT_WRITE))
+    return false;
+  DO_IF_TRACE(fprintf(stderr, "COMMITTED ADDR SPACE: %p -> %p\n",
+                      CommitEnd, CommitEnd+Growth));
+
+  FreedNodeHeader<PoolTraits> *NewNode =
+    (FreedNodeHeader<PoolTraits>*)(CommitEnd -
+                                   sizeof(FreedNodeHeader<PoolTraits>));
+  NewNode->Header.Size = Growth - sizeof(NodeHeader<PoolTraits>);
+  AddNodeToFreeList(Pool, NewNode);
+
+  FreedNodeHeader<PoolTraits> *End =
+    (FreedNodeHeader<PoolTraits>*)(CommitEnd + Growth -
+                                   sizeof(FreedNodeHeader<PoolTraits>));
+  End->Header.Size = ~0; // Looks like an allocated chunk
+  Pool->CommittedSize += Growth;
+  return true;
+}
+
 
 template<typename PoolTraits>
 void PoolSlab<PoolTraits>::destroy() {
@@ -560,6 +628,26 @@ void pooldestroy(PoolTy<NormalPoolTraits> *Pool) {
   }
 }
 
+/// getNodeSize - Return the number of bytes that the pool hands out for an
+/// allocation of NumBytes bytes.
+template<typename PoolTraits>
+static unsigned getNodeSize(PoolTy<PoolTraits> *Pool, unsigned NumBytes) {
+  // Objects must be at least 8 bytes to hold the FreedNodeHeader object when
+  // they are freed.  This also handles allocations of 0 bytes.
+  if (NumBytes < (sizeof(FreedNodeHeader<PoolTraits>) - 
+                  sizeof(NodeHeader<PoolTraits>)))
+    NumBytes = sizeof(FreedNodeHeader<PoolTraits>) - 
+               sizeof(NodeHeader<PoolTraits>);
+
+  // Adjust the size so that memory allocated from the pool is always on the
+  // proper alignment boundary.
+  unsigned Alignment = Pool->Alignment;
+  NumBytes = NumBytes+sizeof(FreedNodeHeader<PoolTraits>) + 
+             (Alignment-1);      // Round up
+  return (NumBytes & ~(Alignment-1)) - 
+         sizeof(FreedNodeHeader<PoolTraits>); // Truncate
+}
+
 template<typename PoolTraits>
 static void *poolalloc_internal(PoolTy<PoolTraits> *Pool, unsigned NumBytesA) {
   DO_IF_TRACE(fprintf(stderr, "[%d] poolalloc%s(%d) -> ",
@@ -576,20 +664,7 @@ static void *poolalloc_internal(PoolTy<PoolTraits> *Pool, unsigned NumBytesA) {
   }
   DO_IF_PNP(if (Pool->NumObjects == 0) ++PoolCounter);  // Track # pools.
 
-  // Objects must be at least 8 bytes to hold the FreedNodeHeader object when
-  // they are freed.  This also handles allocations of 0 bytes.
-  if (NumBytes < (sizeof(FreedNodeHeader<PoolTraits>) - 
-                  sizeof(NodeHeader<PoolTraits>)))
-    NumBytes = sizeof(FreedNodeHeader<PoolTraits>) - 
-               sizeof(NodeHeader<PoolTraits>);
-
-  // Adjust the size so that memory allocated from the pool is always on the
-  // proper alignment boundary.
-  unsigned Alignment = Pool->Alignment;
-  NumBytes = NumBytes+sizeof(FreedNodeHeader<PoolTraits>) + 
-             (Alignment-1);      // Round up
-  NumBytes = (NumBytes & ~(Alignment-1)) - 
-             sizeof(FreedNodeHeader<PoolTraits>); // Truncate
+  NumBytes = getNodeSize(Pool, NumBytes);
 
   DO_IF_PNP(CurHeapSize += (NumBytes + sizeof(NodeHeader<PoolTraits>)));
   DO_IF_PNP(if (CurHeapSize > MaxHeapSize) MaxHeapSize = CurHeapSize);
@@ -687,9 +762,12 @@ static void *poolalloc_internal(PoolTy<PoolTraits> *Pool, unsigned NumBytesA) {
       }
     }
 
-    // If we are not allowed to grow this pool, don't.
+    // If we are not allowed to add slabs to this pool, commit more of its
+    // address range instead.
     if (!PoolTraits::CanGrowPool) {
-      DO_IF_TRACE(fprintf(stderr, "Pool Overflow, not growable\n"));
+      if (PoolSlab<PoolTraits>::grow_for_ptrcomp(Pool, NumBytes))
+        continue;
+      DO_IF_TRACE(fprintf(stderr, "Pool Overflow, address range exhausted\n"));
       abort();
       return 0;
     }
@@ -893,6 +971,137 @@ void *poolcalloc(PoolTy<NormalPoolTraits> *Pool,
   return p;
 }
 
+//===----------------------------------------------------------------------===//
+// Batch allocation
+//===----------------------------------------------------------------------===//
+
+/// poolalloc_n_internal - Carve Count nodes of NumBytes bytes each out of one
+/// free chunk of the pool and record them in Batch.  The nodes are laid out
+/// exactly as consecutive calls to poolalloc would lay them out when
+/// splitting the chunk, so each of them can be freed or reallocated on its
+/// own.  Batch is left empty if a batch would not pay off.
+static void poolalloc_n_internal(PoolTy<NormalPoolTraits> *Pool,
+                                 unsigned NumBytes, unsigned Count,
+                                 PoolBatch *Batch) {
+  typedef NormalPoolTraits PT;
+  NumBytes = getNodeSize(Pool, NumBytes);
+  unsigned Stride = NumBytes + sizeof(NodeHeader<PT>);
+
+  Batch->Next = Batch->End = 0;
+  Batch->Stride = Stride;
+  Batch->Count = Count;
+
+  if (Count > MAX_BATCH_SIZE / Stride)
+    Count = MAX_BATCH_SIZE / Stride;
+  if (Count < 2)
+    return;
+
+  // A pool without a declared size has no slabs yet: the first slab it gets
+  // declares the size of the objects that it was created for, rounded as
+  // getNodeSize() rounds it.  Declare the size of the batch's nodes here, as
+  // the first poolalloc() would have, or the slab created below would declare
+  // the size of the whole batch and keep every freed node off ObjFreeList.
+  if (Pool->DeclaredSize == 0)
+    Pool->DeclaredSize = NumBytes;
+
+  // Find the first free chunk that holds all of the nodes, adding a slab to
+  // the pool if there is none.
+  unsigned ChunkSize = Count * Stride - sizeof(NodeHeader<PT>);
+  FreedNodeHeader<PT> *FNH;
+  while (1) {
+    FNH = Pool->OtherFreeList;
+    while (FNH && FNH->Header.Size < ChunkSize)
+      FNH = FNH->Next;
+    if (FNH)
+      break;
+    PoolSlab<PT>::create(Pool, ChunkSize + Pool->Alignment);
+  }
+  UnlinkFreeNode(Pool, FNH);
+
+  char *First = (char*)(&FNH->Header + 1);
+  char *End = First + Count * Stride;
+
+  // Put the rest of the chunk back on the free list if it can hold a free
+  // node; otherwise, the last node of the batch gets it.
+  unsigned Excess = FNH->Header.Size - ChunkSize;
+  if (Excess >= sizeof(FreedNodeHeader<PT>)) {
+    FreedNodeHeader<PT> *Rest =
+      (FreedNodeHeader<PT>*)(End - sizeof(NodeHeader<PT>));
+    Rest->Header.Size = Excess - sizeof(NodeHeader<PT>);
+    AddNodeToFreeList(Pool, Rest);
+    Excess = 0;
+  }
+
+  // Mark every node allocated.  Nothing else about a node has to be set up.
+  for (char *Node = First; Node != End; Node += Stride)
+    ((NodeHeader<PT>*)Node - 1)->Size = NumBytes | 1;
+  ((NodeHeader<PT>*)(End - Stride) - 1)->Size = (NumBytes + Excess) | 1;
+
+  DO_IF_PNP(if (Pool->NumObjects == 0) ++PoolCounter);
+  DO_IF_PNP(CurHeapSize += Count * Stride + Excess);
+  DO_IF_PNP(if (CurHeapSize > MaxHeapSize) MaxHeapSize = CurHeapSize);
+  DO_IF_PNP(Pool->NumObjects += Count);
+  DO_IF_PNP(Pool->BytesAllocated += Count * NumBytes + Excess);
+  DO_IF_TRACE(fprintf(stderr, "[%d] poolalloc_n(%d, %d) -> 0x%X\n",
+                      getPoolNumber(Pool), NumBytes, Count, First));
+
+  Batch->Next = First;
+  Batch->End = End;
+}
+
+void poolalloc_n(PoolTy<NormalPoolTraits> *Pool, unsigned NumBytes,
+                 unsigned Count, PoolBatch *Batch) {
+  Batch->Next = Batch->End = 0;
+  Batch->Stride = 0;
+  Batch->Count = Count;
+
+  // Nodes that come from the system heap must be freed one at a time, so
+  // they are never batched.
+  DO_IF_FORCE_MALLOCFREE(return);
+  if (Pool == 0) return;
+
+  pthread_mutex_lock(&Pool->pool_lock);
+  poolalloc_n_internal(Pool, NumBytes, Count, Batch);
+  pthread_mutex_unlock(&Pool->pool_lock);
+}
+
+void *poolalloc_refill(PoolTy<NormalPoolTraits> *Pool, unsigned NumBytes,
+                       PoolBatch *Batch) {
+  DO_IF_FORCE_MALLOCFREE(return malloc(NumBytes));
+  if (Pool == 0) return poolalloc_internal(Pool, NumBytes);
+
+  // Start a new batch of the size that the code asked for the first time.
+  // Nodes that did not fit into the batch it replaces are taken one at a time.
+  void *Result;
+  pthread_mutex_lock(&Pool->pool_lock);
+  poolalloc_n_internal(Pool, NumBytes, Batch->Count, Batch);
+  if (Batch->Next != Batch->End) {
+    Result = Batch->Next;
+    Batch->Next += Batch->Stride;
+  } else {
+    Result = poolalloc_internal(Pool, NumBytes);
+  }
+  pthread_mutex_unlock(&Pool->pool_lock);
+  return Result;
+}
+
+void poolfree_n(PoolTy<NormalPoolTraits> *Pool, PoolBatch *Batch) {
+  if (Pool == 0 || Batch->Next == Batch->End) return;
+
+  // Turn the nodes that were not handed out into one node and free it.  The
+  // last node of the batch may be larger than the others.
+  typedef NormalPoolTraits PT;
+  NodeHeader<PT> *Last = (NodeHeader<PT>*)(Batch->End - Batch->Stride) - 1;
+  char *Limit = (char*)(Last + 1) + (Last->Size & ~1);
+  NodeHeader<PT> *Rest = (NodeHeader<PT>*)Batch->Next - 1;
+  Rest->Size = (Limit - Batch->Next) | 1;
+
+  pthread_mutex_lock(&Pool->pool_lock);
+  poolfree_internal(Pool, Batch->Next);
+  pthread_mutex_unlock(&Pool->pool_lock);
+  Batch->Next = Batch->End;
+}
+
 void *poolmemalign(PoolTy<NormalPoolTraits> *Pool,
                    unsigned Alignment, unsigned NumBytes) {
   //punt and use pool alloc.
@@ -989,12 +1198,41 @@ int poolalloc_pthread_create(pthread_t* thread,
 // around the normal pool routines.
 //===----------------------------------------------------------------------===//
 
-// For now, use address space reservation of 256MB.
-#define POOLSIZE (256*1024*1024)
+// CompressedRange - An address range reserved for a pointer compressed pool,
+// and the end of the part of it that is committed.
+struct CompressedRange {
+  char *Start;
+  char *CommitEnd;
+};
 
 // Pools - When we are done with a pool, don't munmap it, keep it around for
 // next time.
-static PoolSlab<CompressedPoolTraits> *Pools[4] = { 0, 0, 0, 0 };
+static CompressedRange Pools[4];
+
+// ReserveCompressedRange - Reserve PC_RESERVE_SIZE bytes of address space,
+// aligned to PC_STAGGER_SIZE bytes, without committing any memory.
+static char *ReserveCompressedRange() {
+  int Flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+  Flags |= MAP_NORESERVE;
+#endif
+  char *Mem = (char*)mmap(0, PC_RESERVE_SIZE + PC_STAGGER_SIZE, PROT_NONE,
+                          Flags, -1, 0);
+  if (Mem == (char*)MAP_FAILED) {
+    perror("Can't reserve space for a pointer compressed pool");
+    abort();
+  }
+
+  // Trim the range to its aligned part.
+  char *Start = (char*)(((uintptr_t)Mem + PC_STAGGER_SIZE - 1) &
+                        ~(uintptr_t)(PC_STAGGER_SIZE - 1));
+  if (Start != Mem)
+    munmap(Mem, Start - Mem);
+  munmap(Start + PC_RESERVE_SIZE, Mem + PC_STAGGER_SIZE - Start);
+  DO_IF_TRACE(fprintf(stderr, "RESERVED ADDR SPACE: %p -> %p\n",
+                      Start, Start+PC_RESERVE_SIZE));
+  return Start;
+}
 
 void *poolinit_pc(PoolTy<CompressedPoolTraits> *Pool,
                   unsigned DeclaredSize, unsigned ObjAlignment) {
@@ -1008,40 +1246,49 @@ void *poolinit_pc(PoolTy<CompressedPoolTraits> *Pool,
   // register.
 
   // If we already have a pool mapped, reuse it.
+  CompressedRange Range = { 0, 0 };
   for (unsigned i = 0; i != 4; ++i)
-    if (Pools[i]) {
-      Pool->Slabs = Pools[i];
-      Pools[i] = 0;
+    if (Pools[i].Start) {
+      Range = Pools[i];
+      Pools[i].Start = 0;
       break;
     }
 
+  // Didn't find an existing pool, create one.
+  if (Range.Start == 0) {
+    Range.Start = ReserveCompressedRange();
+    Range.CommitEnd = Range.Start;
+  }
+
   //
-  // Wrap the stagger value back to zero if we're past the size of the pool.
-  // This way, we always reserve less than 2*POOLSIZE of the virtual address
-  // space.
+  // We stagger the beginning of the pool so that pools do not end up starting
+  // on the same page boundary (creating extra cache conflicts).  Wrap the
+  // stagger value back to zero once it moves the pool past PC_STAGGER_SIZE.
   //
-  if ((stagger * DeclaredSize) >= POOLSIZE)
-    stagger = 0;
-
-  if (Pool->Slabs == 0) {
-    //
-    // Didn't find an existing pool, create one.
-    //
-    // To create a pool, we stagger the beginning of the pool so that pools
-    // do not end up starting on the same page boundary (creating extra cache
-    // conflicts).
-    //
-    Pool->Slabs = (PoolSlab<CompressedPoolTraits>*)
-                      AllocateSpaceWithMMAP(POOLSIZE + (DeclaredSize * stagger), true);
-    Pool->Slabs += (DeclaredSize * stagger);
-
-    // Increase the stagger amount by one node.
-    stagger++;
-    DO_IF_TRACE(fprintf(stderr, "RESERVED ADDR SPACE: %p -> %p\n",
-                        Pool->Slabs, (char*)Pool->Slabs+POOLSIZE));
+  unsigned long Offset = (unsigned long)Pool->DeclaredSize * stagger++;
+  if (Offset >= PC_STAGGER_SIZE) {
+    Offset = 0;
+    stagger = 1;
+  }
+  Offset &= ~(unsigned long)(Pool->Alignment - 1);
+  char *Base = Range.Start + Offset;
+
+  // Commit the first part of the pool.
+  unsigned long PageSize = sysconf(_SC_PAGESIZE);
+  char *CommitEnd = (char*)(((uintptr_t)Base + PC_INITIAL_COMMIT +
+                             PageSize - 1) & ~(uintptr_t)(PageSize - 1));
+  if (CommitEnd < Range.CommitEnd)
+    CommitEnd = Range.CommitEnd;
+  else if (mprotect(Range.CommitEnd, CommitEnd - Range.CommitEnd,
+                    PROT_READ|PROT_WRITE)) {
+    perror("Can't commit space for a pointer compressed pool");
+    abort();
   }
+
+  Pool->Slabs = (PoolSlab<CompressedPoolTraits>*)Base;
+  Pool->CommittedSize = CommitEnd - Base;
   PoolSlab<CompressedPoolTraits>::create_for_ptrcomp(Pool, Pool->Slabs,
-                                                     POOLSIZE);
+                                                     Pool->CommittedSize);
   return Pool->Slabs;
 }
 
@@ -1058,17 +1305,34 @@ void pooldestroy_pc(PoolTy<CompressedPoolTraits> *Pool) {
 #endif
   DO_IF_POOLDESTROY_STATS(PrintPoolStats(Pool));
 
-  // If there is space to remember this pool, do so.
+  CompressedRange Range;
+  Range.Start = (char*)((uintptr_t)Pool->Slabs &
+                        ~(uintptr_t)(PC_STAGGER_SIZE - 1));
+  Range.CommitEnd = (char*)Pool->Slabs + Pool->CommittedSize;
+
+  // If there is space to remember this pool, do so.  Release the memory
+  // committed as the pool grew by mapping fresh reserved space over it, so
+  // that the cached range does not hold on to it.
   for (unsigned i = 0; i != 4; ++i)
-    if (Pools[i] == 0) {
-      Pools[i] = Pool->Slabs;
+    if (Pools[i].Start == 0) {
+      char *Keep = Range.Start + PC_STAGGER_SIZE + PC_INITIAL_COMMIT;
+      if (Range.CommitEnd > Keep) {
+        int Flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+#ifdef MAP_NORESERVE
+        Flags |= MAP_NORESERVE;
+#endif
+        if (mmap(Keep, Range.CommitEnd - Keep, PROT_NONE, Flags, -1, 0) !=
+            MAP_FAILED)
+          Range.CommitEnd = Keep;
+      }
+      Pools[i] = Range;
       return;
     }
 
   // Otherwise, just munmap it.
   DO_IF_TRACE(fprintf(stderr, "UNMAPPING ADDR SPACE: %p -> %p\n",
-                      Pool->Slabs, (char*)Pool->Slabs+POOLSIZE));
-  munmap(Pool->Slabs, POOLSIZE);
+                      Range.Start, Range.Start+PC_RESERVE_SIZE));
+  munmap(Range.Start, PC_RESERVE_SIZE);
 }
 
 unsigned long long poolalloc_pc(PoolTy<CompressedPoolTraits> *Pool,
@@ -62,7 +62,9 @@ struct NormalPoolTraits {
 
 // CompressedPoolTraits - This describes a statically pointer compressed pool,
 // which is known to be <= 2^32 bytes in size (even on a 64-bit machine), and is
-// made out of a single contiguous block.  The meta-data to represent the pool
+// made out of a single contiguous block.  The block is a reserved range of the
+// address space; the pool grows by committing more of it rather than by
+// adding slabs.  The meta-data to represent the pool
 // uses 32-bit indexes from the start of the pool instead of full pointers to
 // decrease the minimum object size.
 struct CompressedPoolTraits {
@@ -79,9 +81,12 @@ struct CompressedPoolTraits {
   static const char *getSuffix() { return "_pc"; }
 
   /// DerefFNHPtr - Given an index into the pool, return a pointer to the
-  /// FreeNodeHeader object.
+  /// FreeNodeHeader object.  Index 0 is the slab header, so it is the null
+  /// index that ends the free lists.
   static FreedNodeHeader<CompressedPoolTraits>*
   IndexToFNHPtr(FreeNodeHeaderPtrTy P, void *PoolBase) {
+    if (P == 0)
+      return 0;
     return (FreedNodeHeader<CompressedPoolTraits>*)((char*)PoolBase + P);
   }
 
@@ -181,6 +186,23 @@ struct PoolTy {
 
   // Thread reference count for the pool
   int thread_refcount;
+
+  // CommittedSize - For pointer compressed pools, the number of bytes from the
+  // start of the pool that are backed by memory.  The rest of the address
+  // range reserved for the pool is committed as the pool grows.
+  unsigned long CommittedSize;
+};
+
+// PoolBatch - A run of nodes of one size allocated from a pool by a single
+// call to poolalloc_n.  The nodes are Stride bytes apart; Next is the next one
+// to hand out and End is the end of the run.  Count is the number of nodes
+// requested, which poolalloc_refill uses to size the next batch.  The pool
+// optimizer keeps one of these for each allocation site that it batches.
+struct PoolBatch {
+  char *Next;
+  char *End;
+  unsigned Stride;
+  unsigned Count;
 };
 
 extern "C" {
@@ -196,6 +218,15 @@ extern "C" {
                      unsigned Alignment, unsigned NumBytes);
   void poolfree(PoolTy<NormalPoolTraits> *Pool, void *Node);
 
+  // Batch allocation.  poolalloc_n starts a batch of Count nodes, which the
+  // caller hands out by advancing Batch->Next; poolalloc_refill returns a node
+  // when the batch runs out, and poolfree_n frees the nodes never handed out.
+  void poolalloc_n(PoolTy<NormalPoolTraits> *Pool, unsigned NumBytes,
+                   unsigned Count, PoolBatch *Batch);
+  void *poolalloc_refill(PoolTy<NormalPoolTraits> *Pool, unsigned NumBytes,
+                         PoolBatch *Batch);
+  void poolfree_n(PoolTy<NormalPoolTraits> *Pool, PoolBatch *Batch);
+
   /// poolobjsize - Return the size of the object at the specified address, in
   /// the specified pool.  Note that this cannot be used in normal cases, as it
   /// is completely broken if things land in the system heap.  Perhaps in the
@@ -0,0 +1,52 @@
+; Bottom-up graphs loaded from the -dsa-bu-cache-dir cache must match the
+; graphs computed without it.  The first run fills the cache, the second
+; loads from it, and the third recomputes every SCC and compares.
+
+;RUN: rm -rf %t.cache
+;RUN: dsaopt %s -dsa-bu -dsa-bu-cache-dir=%t.cache -analyze -check-same-node=ping:a,pong:b
+;RUN: dsaopt %s -dsa-bu -dsa-bu-cache-dir=%t.cache -analyze -check-same-node=ping:a,pong:b
+;RUN: dsaopt %s -dsa-bu -dsa-bu-cache-dir=%t.cache -dsa-bu-cache-verify -disable-output 2>&1 | not grep "does not match"
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@G = global i32* null
+@FP = global void (i32*)* @setG
+
+define void @setG(i32* %x) {
+entry:
+  store i32* %x, i32** @G
+  ret void
+}
+
+define void @ping(i32* %a, i32 %n) {
+entry:
+  %c = icmp eq i32 %n, 0
+  br i1 %c, label %done, label %recurse
+
+recurse:
+  %m = sub i32 %n, 1
+  call void @pong(i32* %a, i32 %m)
+  ret void
+
+done:
+  %f = load void (i32*)*, void (i32*)** @FP
+  call void %f(i32* %a)
+  ret void
+}
+
+define void @pong(i32* %b, i32 %n) {
+entry:
+  call void @ping(i32* %b, i32 %n)
+  ret void
+}
+
+define i32 @main() {
+entry:
+  %mem = call i8* @malloc(i64 4)
+  %p = bitcast i8* %mem to i32*
+  call void @ping(i32* %p, i32 3)
+  ret i32 0
+}
+
+declare noalias i8* @malloc(i64)
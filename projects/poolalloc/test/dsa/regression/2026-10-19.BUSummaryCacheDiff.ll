@@ -0,0 +1,50 @@
+; The bottom-up graphs and the globals graph must be the same whether they
+; are computed, computed while filling the -dsa-bu-cache-dir cache, or loaded
+; from it.  @log is called directly from two SCCs and stays unresolved, so
+; the globals graph receives a call site for it from each of them.
+
+;RUN: rm -rf %t.cache
+;RUN: dsaopt %s -dsa-bu -analyze -print-node-for-value=@G,@H,@LogFP,left:a,right:b,main:p,main:q > %t.uncached
+;RUN: dsaopt %s -dsa-bu -dsa-bu-cache-dir=%t.cache -analyze -print-node-for-value=@G,@H,@LogFP,left:a,right:b,main:p,main:q > %t.fill
+;RUN: dsaopt %s -dsa-bu -dsa-bu-cache-dir=%t.cache -analyze -print-node-for-value=@G,@H,@LogFP,left:a,right:b,main:p,main:q > %t.hit
+;RUN: diff %t.uncached %t.fill
+;RUN: diff %t.uncached %t.hit
+;RUN: dsaopt %s -dsa-bu -dsa-bu-cache-dir=%t.cache -dsa-bu-cache-verify -analyze -print-node-for-value=@G,@H,@LogFP,left:a,right:b,main:p,main:q > %t.verify 2> %t.err
+;RUN: diff %t.uncached %t.verify
+;RUN: not grep "does not match" %t.err
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@G = global i32* null
+@H = global i32* null
+@LogFP = global void (i32*)* @log
+
+declare void @log(i32*)
+
+define void @left(i32* %a) {
+entry:
+  store i32* %a, i32** @G
+  call void @log(i32* %a)
+  ret void
+}
+
+define void @right(i32* %b) {
+entry:
+  store i32* %b, i32** @H
+  call void @log(i32* %b)
+  ret void
+}
+
+define i32 @main() {
+entry:
+  %m1 = call i8* @malloc(i64 4)
+  %p = bitcast i8* %m1 to i32*
+  %m2 = call i8* @malloc(i64 4)
+  %q = bitcast i8* %m2 to i32*
+  call void @left(i32* %p)
+  call void @right(i32* %q)
+  ret i32 0
+}
+
+declare noalias i8* @malloc(i64)
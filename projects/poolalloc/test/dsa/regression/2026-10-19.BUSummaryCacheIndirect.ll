@@ -0,0 +1,48 @@
+; The key of an SCC must change when a function that one of its indirect
+; calls may reach changes, even if that function is only a callee of the
+; address-taken target.  @caller calls @target through @FP, and @target calls
+; @helper; the second version of the module only changes @helper, which then
+; stores its argument into @G, so that %p and %g share a node.  A cache
+; filled from the first version must not be used for the second.
+
+;RUN: rm -rf %t.cache
+;RUN: sed -e 's/^;V2 //' %s > %t.v2.ll
+;RUN: dsaopt %s -dsa-bu -dsa-bu-cache-dir=%t.cache -analyze -check-not-same-node=caller:g,caller:p
+;RUN: dsaopt %t.v2.ll -dsa-bu -analyze -check-same-node=caller:g,caller:p
+;RUN: dsaopt %t.v2.ll -dsa-bu -dsa-bu-cache-dir=%t.cache -analyze -check-same-node=caller:g,caller:p
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@G = internal global i32* null
+@FP = internal global void (i32*)* @target
+
+define internal void @helper(i32* %h) {
+entry:
+;V2   store i32* %h, i32** @G
+  ret void
+}
+
+define internal void @target(i32* %t) {
+entry:
+  call void @helper(i32* %t)
+  ret void
+}
+
+define internal void @caller(i32* %p) {
+entry:
+  %f = load void (i32*)*, void (i32*)** @FP
+  call void %f(i32* %p)
+  %g = load i32*, i32** @G
+  ret void
+}
+
+define i32 @main() {
+entry:
+  %m1 = call i8* @malloc(i64 4)
+  %m = bitcast i8* %m1 to i32*
+  call void @caller(i32* %m)
+  ret i32 0
+}
+
+declare noalias i8* @malloc(i64)
@@ -0,0 +1,54 @@
+; The flags that -dsa-demand reports for a value must agree with the flags of
+; EQTD on the whole module.  @sink is only called indirectly, so its slice
+; must hold @caller, which passes it heap memory.  @G is stored to by @other,
+; which is not in the slice of @reader, so the node loaded from @G in @reader
+; stays incomplete.  -dsa-demand-max-slice=1 keeps the slices from covering
+; the whole module.
+
+;RUN: dsaopt %s -dsa-demand -dsa-demand-max-slice=1 -analyze -dsa-demand-print=sink:p,caller:p,reader:v | FileCheck %s
+;RUN: dsaopt %s -dsa-eqtd -analyze -print-node-for-value=sink:p,caller:p,reader:v -print-only-flags | FileCheck %s
+
+; CHECK: {{^H[^I]*$}}
+; CHECK-NEXT: {{^H[^I]*$}}
+; CHECK-NEXT: {{^[^H]*I}}
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@G = internal global i32* null
+
+declare noalias i8* @malloc(i64)
+
+define internal void @sink(i32* %p) {
+entry:
+  store i32 1, i32* %p
+  ret void
+}
+
+define internal void @drain(i32* %q) {
+entry:
+  store i32 2, i32* %q
+  ret void
+}
+
+define void @caller(i1 %c) {
+entry:
+  %m = call noalias i8* @malloc(i64 4)
+  %p = bitcast i8* %m to i32*
+  %fp = select i1 %c, void (i32*)* @sink, void (i32*)* @drain
+  call void %fp(i32* %p)
+  ret void
+}
+
+define void @other(i32* %x) {
+entry:
+  store i32* %x, i32** @G
+  ret void
+}
+
+define i32 @reader() {
+entry:
+  %v = load i32*, i32** @G
+  %r = load i32, i32* %v
+  ret i32 %r
+}
@@ -0,0 +1,87 @@
+; The targets of an indirect call site must be ordered by their number of calls
+; in the profile and then by name, never by their addresses.  Without a profile
+; all three call sites share one bounce function comparing the targets by name.
+; RUN: echo "90 dispatch:0 gamma" > %t.prof
+; RUN: echo "5 dispatch:0 beta" >> %t.prof
+; RUN: echo "5 dispatch:0 alpha" >> %t.prof
+; RUN: echo "10 dispatch:1 beta" >> %t.prof
+; RUN: echo "9 dispatch:1 gamma" >> %t.prof
+; RUN: echo "9 dispatch:1 alpha" >> %t.prof
+; RUN: adsaopt -devirt -devirt-profile-file=%t.prof %s -S | FileCheck %s
+; RUN: adsaopt -devirt %s -S | FileCheck %s --check-prefix=NOPROF
+target datalayout = "e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-f80:128:128-n8:16:32:64"
+target triple = "x86_64-unknown-linux-gnu"
+
+@table = internal constant [3 x i32 (i32)*] [i32 (i32)* @gamma, i32 (i32)* @beta, i32 (i32)* @alpha]
+
+define internal i32 @gamma(i32 %x) {
+entry:
+  ret i32 %x
+}
+
+define internal i32 @beta(i32 %x) {
+entry:
+  %y = add i32 %x, 1
+  ret i32 %y
+}
+
+define internal i32 @alpha(i32 %x) {
+entry:
+  %y = add i32 %x, 2
+  ret i32 %y
+}
+
+; Site 0 calls gamma 90% of the time and calls it directly.  Site 1 has no
+; dominant target; alpha and gamma tie and keep their name order.
+; CHECK-LABEL: define i32 @dispatch(
+; CHECK: %hot = icmp eq i8* %{{.*}}, bitcast (i32 (i32)* @gamma to i8*)
+; CHECK: call i32 @gamma(i32 %x)
+; CHECK: call i32 @devirtbounce(i32 (i32)* %fp, i32 %x)
+; CHECK: call i32 @devirtbounce1(i32 (i32)* %fp, i32 %r0.dv)
+; NOPROF-LABEL: define i32 @dispatch(
+; NOPROF: call i32 @devirtbounce(i32 (i32)* %fp, i32 %x)
+; NOPROF: call i32 @devirtbounce(i32 (i32)* %fp, i32 %r0.dv)
+define i32 @dispatch(i32 %i, i32 %x) {
+entry:
+  %slot = getelementptr [3 x i32 (i32)*], [3 x i32 (i32)*]* @table, i32 0, i32 %i
+  %fp = load i32 (i32)*, i32 (i32)** %slot
+  %r0 = call i32 %fp(i32 %x)
+  %r1 = call i32 %fp(i32 %r0)
+  ret i32 %r1
+}
+
+; The profile has no calls for this site, so its targets are ordered by name.
+; CHECK-LABEL: define i32 @noprofile(
+; CHECK: call i32 @devirtbounce2(i32 (i32)* %fp, i32 %x)
+; NOPROF-LABEL: define i32 @noprofile(
+; NOPROF: call i32 @devirtbounce(i32 (i32)* %fp, i32 %x)
+define i32 @noprofile(i32 %i, i32 %x) {
+entry:
+  %slot = getelementptr [3 x i32 (i32)*], [3 x i32 (i32)*]* @table, i32 0, i32 %i
+  %fp = load i32 (i32)*, i32 (i32)** %slot
+  %r = call i32 %fp(i32 %x)
+  ret i32 %r
+}
+
+; CHECK-LABEL: define internal i32 @devirtbounce(
+; CHECK: {{^}}gamma:
+; CHECK: {{^}}alpha:
+; CHECK: {{^}}beta:
+; CHECK: {{^}}fail:
+; CHECK-LABEL: define internal i32 @devirtbounce1(
+; CHECK: {{^}}beta:
+; CHECK: {{^}}alpha:
+; CHECK: {{^}}gamma:
+; CHECK: {{^}}fail:
+; CHECK-LABEL: define internal i32 @devirtbounce2(
+; CHECK: {{^}}alpha:
+; CHECK: {{^}}beta:
+; CHECK: {{^}}gamma:
+; CHECK: {{^}}fail:
+
+; NOPROF-LABEL: define internal i32 @devirtbounce(
+; NOPROF: {{^}}alpha:
+; NOPROF: {{^}}beta:
+; NOPROF: {{^}}gamma:
+; NOPROF: {{^}}fail:
+; NOPROF-NOT: @devirtbounce1
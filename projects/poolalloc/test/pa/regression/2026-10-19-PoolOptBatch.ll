@@ -0,0 +1,275 @@
+; Without -pooloptimize-safecode, -pooloptimize batches the poolallocs of a
+; loop whose trip count is known or bounded: @known and @bounded get one
+; poolalloc_n before the loop and take their nodes from the batch.  Every
+; other function shows one reason to leave a poolalloc alone.  SAFECode's
+; run-time needs its allocations one at a time and gets no batches.
+;RUN: paopt %s -pooloptimize -S -o - | FileCheck %s
+;RUN: paopt %s -pooloptimize -pooloptimize-safecode -S -o - \
+;RUN:   | FileCheck %s --check-prefix=SC
+
+; SC-NOT: poolalloc_n
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+declare void @poolinit([16 x i8*]*, i32, i32)
+declare void @pooldestroy([16 x i8*]*)
+declare i8* @poolalloc([16 x i8*]*, i32)
+declare void @poolfree([16 x i8*]*, i8*)
+
+; The trip count is 100.
+; CHECK-LABEL: define void @known(
+; CHECK: %batch = alloca
+; CHECK: call void @poolalloc_n([16 x i8*]* %pd, i32 16, i32 100, {{.*}}%batch)
+; CHECK: %batch.next = load
+; CHECK: %batch.empty = icmp eq i8* %batch.next, %batch.end
+; CHECK: call i8* @poolalloc_refill([16 x i8*]* %pd, i32 16, {{.*}}%batch)
+; CHECK: call void @poolfree_n([16 x i8*]* %pd, {{.*}}%batch)
+; CHECK: ret void
+define void @known([16 x i8*]* %pd) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %p = call i8* @poolalloc([16 x i8*]* %pd, i32 16)
+  call void @poolfree([16 x i8*]* %pd, i8* %p)
+  %i.next = add nuw nsw i32 %i, 1
+  %done = icmp eq i32 %i.next, 100
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
+
+; The loop may leave early, but runs at most 64 times.
+; CHECK-LABEL: define void @bounded(
+; CHECK: call void @poolalloc_n([16 x i8*]* %pd, i32 16, i32 64,
+; CHECK: call i8* @poolalloc_refill(
+; CHECK: call void @poolfree_n(
+define void @bounded([16 x i8*]* %pd, i32* %flag) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %latch ]
+  %p = call i8* @poolalloc([16 x i8*]* %pd, i32 16)
+  call void @poolfree([16 x i8*]* %pd, i8* %p)
+  %v = load volatile i32, i32* %flag
+  %stop = icmp ne i32 %v, 0
+  br i1 %stop, label %exit, label %latch
+
+latch:
+  %i.next = add nuw nsw i32 %i, 1
+  %done = icmp eq i32 %i.next, 64
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
+
+; A pool that the function initializes is batched once poolinit has run.
+; CHECK-LABEL: define void @localPool(
+; CHECK: call void @poolinit(
+; CHECK: call void @poolalloc_n([16 x i8*]* %pd, i32 16, i32 8,
+define void @localPool() {
+entry:
+  %pd = alloca [16 x i8*]
+  call void @poolinit([16 x i8*]* %pd, i32 16, i32 8)
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %p = call i8* @poolalloc([16 x i8*]* %pd, i32 16)
+  call void @poolfree([16 x i8*]* %pd, i8* %p)
+  %i.next = add nuw nsw i32 %i, 1
+  %done = icmp eq i32 %i.next, 8
+  br i1 %done, label %exit, label %loop
+
+exit:
+  call void @pooldestroy([16 x i8*]* %pd)
+  ret void
+}
+
+; Nothing bounds the trip count.
+; CHECK-LABEL: define void @unbounded(
+; CHECK-NOT: @poolalloc_n
+; CHECK: call i8* @poolalloc(
+; CHECK: ret void
+define void @unbounded([16 x i8*]* %pd, i32* %flag) {
+entry:
+  br label %loop
+
+loop:
+  %p = call i8* @poolalloc([16 x i8*]* %pd, i32 16)
+  call void @poolfree([16 x i8*]* %pd, i8* %p)
+  %v = load volatile i32, i32* %flag
+  %stop = icmp ne i32 %v, 0
+  br i1 %stop, label %exit, label %loop
+
+exit:
+  ret void
+}
+
+; The loop runs once.
+; CHECK-LABEL: define void @once(
+; CHECK-NOT: @poolalloc_n
+; CHECK: call i8* @poolalloc(
+; CHECK: ret void
+define void @once([16 x i8*]* %pd) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %p = call i8* @poolalloc([16 x i8*]* %pd, i32 16)
+  call void @poolfree([16 x i8*]* %pd, i8* %p)
+  %i.next = add nuw nsw i32 %i, 1
+  %done = icmp eq i32 %i.next, 1
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
+
+; The size of the nodes changes from one iteration to the next.
+; CHECK-LABEL: define void @variantSize(
+; CHECK-NOT: @poolalloc_n
+; CHECK: call i8* @poolalloc(
+; CHECK: ret void
+define void @variantSize([16 x i8*]* %pd) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %p = call i8* @poolalloc([16 x i8*]* %pd, i32 %i)
+  call void @poolfree([16 x i8*]* %pd, i8* %p)
+  %i.next = add nuw nsw i32 %i, 1
+  %done = icmp eq i32 %i.next, 100
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
+
+; The pool changes from one iteration to the next.
+; CHECK-LABEL: define void @variantPool(
+; CHECK-NOT: @poolalloc_n
+; CHECK: call i8* @poolalloc(
+; CHECK: ret void
+define void @variantPool([16 x i8*]* %pd1, [16 x i8*]* %pd2) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %pd = phi [16 x i8*]* [ %pd1, %entry ], [ %pd2, %loop ]
+  %p = call i8* @poolalloc([16 x i8*]* %pd, i32 16)
+  call void @poolfree([16 x i8*]* %pd, i8* %p)
+  %i.next = add nuw nsw i32 %i, 1
+  %done = icmp eq i32 %i.next, 100
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
+
+; Allocations from the null pool come from the system heap.
+; CHECK-LABEL: define void @nullPool(
+; CHECK-NOT: @poolalloc_n
+; CHECK: call i8* @poolalloc(
+; CHECK: ret void
+define void @nullPool() {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %p = call i8* @poolalloc([16 x i8*]* null, i32 16)
+  call void @poolfree([16 x i8*]* null, i8* %p)
+  %i.next = add nuw nsw i32 %i, 1
+  %done = icmp eq i32 %i.next, 100
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
+
+; The pool is not initialized on every path to the loop.
+; CHECK-LABEL: define void @notInitialized(
+; CHECK-NOT: @poolalloc_n
+; CHECK: call i8* @poolalloc(
+; CHECK: ret void
+define void @notInitialized(i1 %c) {
+entry:
+  %pd = alloca [16 x i8*]
+  br i1 %c, label %init, label %preheader
+
+init:
+  call void @poolinit([16 x i8*]* %pd, i32 16, i32 8)
+  br label %preheader
+
+preheader:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %preheader ], [ %i.next, %loop ]
+  %p = call i8* @poolalloc([16 x i8*]* %pd, i32 16)
+  call void @poolfree([16 x i8*]* %pd, i8* %p)
+  %i.next = add nuw nsw i32 %i, 1
+  %done = icmp eq i32 %i.next, 100
+  br i1 %done, label %exit, label %loop
+
+exit:
+  call void @pooldestroy([16 x i8*]* %pd)
+  ret void
+}
+
+; The pool is destroyed inside the loop.
+; CHECK-LABEL: define void @destroyedInLoop(
+; CHECK-NOT: @poolalloc_n
+; CHECK: call i8* @poolalloc(
+; CHECK: ret void
+define void @destroyedInLoop() {
+entry:
+  %pd = alloca [16 x i8*]
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  call void @poolinit([16 x i8*]* %pd, i32 16, i32 8)
+  %p = call i8* @poolalloc([16 x i8*]* %pd, i32 16)
+  call void @poolfree([16 x i8*]* %pd, i8* %p)
+  call void @pooldestroy([16 x i8*]* %pd)
+  %i.next = add nuw nsw i32 %i, 1
+  %done = icmp eq i32 %i.next, 100
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
+
+; The exit block of the loop is also reached from outside of it.
+; CHECK-LABEL: define void @sharedExit(
+; CHECK-NOT: @poolalloc_n
+; CHECK: call i8* @poolalloc(
+; CHECK: ret void
+define void @sharedExit([16 x i8*]* %pd, i1 %c) {
+entry:
+  br i1 %c, label %exit, label %preheader
+
+preheader:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %preheader ], [ %i.next, %loop ]
+  %p = call i8* @poolalloc([16 x i8*]* %pd, i32 16)
+  call void @poolfree([16 x i8*]* %pd, i8* %p)
+  %i.next = add nuw nsw i32 %i, 1
+  %done = icmp eq i32 %i.next, 100
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
@@ -0,0 +1,169 @@
+; With -pooloptimize-safecode, -pooloptimize turns a pool into a region only
+; when the function that creates it is its only user, when it reaches nothing
+; but pool calls and the checks and registrations of the run-time, and when
+; it is not freed inside a loop.  @region and @allocInLoop are converted;
+; every other function shows one reason to leave a pool alone.  Without the
+; option, no pool becomes a region: the other run-times have none.
+;RUN: paopt %s -pooloptimize -pooloptimize-safecode -S -o - | FileCheck %s
+;RUN: paopt %s -pooloptimize -S -o - | FileCheck %s --check-prefix=PA
+
+; PA-NOT: _region
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@gpd = internal global [92 x i8*] zeroinitializer
+
+declare void @poolinit([92 x i8*]*, i32, i32)
+declare void @pooldestroy([92 x i8*]*)
+declare i8* @poolalloc([92 x i8*]*, i32)
+declare void @poolfree([92 x i8*]*, i8*)
+declare i8* @poolrealloc([92 x i8*]*, i8*, i32)
+declare void @poolcheck([92 x i8*]*, i8*)
+declare void @pool_register([92 x i8*]*, i8*, i32)
+declare void @pool_reregister([92 x i8*]*, i8*, i8*, i32)
+
+; CHECK-LABEL: define void @region(
+; CHECK: call void @poolinit_region(
+; CHECK: call i8* @poolalloc_region(
+; CHECK: call void @pool_register(
+; CHECK: call void @poolcheck(
+; CHECK-NOT: @poolfree
+; CHECK: call void @pooldestroy_region(
+define void @region() {
+entry:
+  %pd = alloca [92 x i8*]
+  call void @poolinit([92 x i8*]* %pd, i32 0, i32 8)
+  %p = call i8* @poolalloc([92 x i8*]* %pd, i32 16)
+  call void @pool_register([92 x i8*]* %pd, i8* %p, i32 16)
+  call void @poolcheck([92 x i8*]* %pd, i8* %p)
+  call void @poolfree([92 x i8*]* %pd, i8* %p)
+  call void @pooldestroy([92 x i8*]* %pd)
+  ret void
+}
+
+; CHECK-LABEL: define void @allocInLoop(
+; CHECK: call void @poolinit_region(
+; CHECK: call i8* @poolalloc_region(
+; CHECK: call void @pooldestroy_region(
+define void @allocInLoop(i32 %n) {
+entry:
+  %pd = alloca [92 x i8*]
+  call void @poolinit([92 x i8*]* %pd, i32 0, i32 8)
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %p = call i8* @poolalloc([92 x i8*]* %pd, i32 16)
+  call void @poolcheck([92 x i8*]* %pd, i8* %p)
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  call void @pooldestroy([92 x i8*]* %pd)
+  ret void
+}
+
+; CHECK-LABEL: define void @freeInLoop(
+; CHECK-NOT: _region
+; CHECK: call void @poolinit(
+; CHECK: call i8* @poolalloc(
+; CHECK: call void @poolfree(
+; CHECK: call void @pooldestroy(
+define void @freeInLoop(i32 %n) {
+entry:
+  %pd = alloca [92 x i8*]
+  call void @poolinit([92 x i8*]* %pd, i32 0, i32 8)
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %p = call i8* @poolalloc([92 x i8*]* %pd, i32 16)
+  call void @poolfree([92 x i8*]* %pd, i8* %p)
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  call void @pooldestroy([92 x i8*]* %pd)
+  ret void
+}
+
+define void @helper([92 x i8*]* %pd) {
+entry:
+  %p = call i8* @poolalloc([92 x i8*]* %pd, i32 16)
+  call void @poolfree([92 x i8*]* %pd, i8* %p)
+  ret void
+}
+
+; CHECK-LABEL: define void @passedToCallee(
+; CHECK-NOT: _region
+; CHECK: call void @poolinit(
+; CHECK: call void @helper(
+; CHECK: call void @pooldestroy(
+define void @passedToCallee() {
+entry:
+  %pd = alloca [92 x i8*]
+  call void @poolinit([92 x i8*]* %pd, i32 0, i32 8)
+  call void @helper([92 x i8*]* %pd)
+  call void @pooldestroy([92 x i8*]* %pd)
+  ret void
+}
+
+; CHECK-LABEL: define void @indirectCall(
+; CHECK-NOT: _region
+; CHECK: call void @poolinit(
+; CHECK: call void %fp(
+; CHECK: call void @pooldestroy(
+define void @indirectCall(void ([92 x i8*]*)* %fp) {
+entry:
+  %pd = alloca [92 x i8*]
+  call void @poolinit([92 x i8*]* %pd, i32 0, i32 8)
+  call void %fp([92 x i8*]* %pd)
+  call void @pooldestroy([92 x i8*]* %pd)
+  ret void
+}
+
+; CHECK-LABEL: define i8* @realloc(
+; CHECK-NOT: _region
+; CHECK: call void @poolinit(
+; CHECK: call i8* @poolrealloc(
+; CHECK: call void @pooldestroy(
+define i8* @realloc(i8* %q) {
+entry:
+  %pd = alloca [92 x i8*]
+  call void @poolinit([92 x i8*]* %pd, i32 0, i32 8)
+  %p = call i8* @poolrealloc([92 x i8*]* %pd, i8* %q, i32 32)
+  call void @pooldestroy([92 x i8*]* %pd)
+  ret i8* %p
+}
+
+; CHECK-LABEL: define void @reregister(
+; CHECK-NOT: _region
+; CHECK: call void @poolinit(
+; CHECK: call void @pool_reregister(
+; CHECK: call void @pooldestroy(
+define void @reregister(i8* %q) {
+entry:
+  %pd = alloca [92 x i8*]
+  call void @poolinit([92 x i8*]* %pd, i32 0, i32 8)
+  %p = call i8* @poolalloc([92 x i8*]* %pd, i32 16)
+  call void @pool_reregister([92 x i8*]* %pd, i8* %p, i8* %q, i32 16)
+  call void @pooldestroy([92 x i8*]* %pd)
+  ret void
+}
+
+; CHECK-LABEL: define void @globalPool(
+; CHECK-NOT: _region
+; CHECK: call void @poolinit(
+; CHECK: call i8* @poolalloc(
+; CHECK: call void @pooldestroy(
+define void @globalPool() {
+entry:
+  call void @poolinit([92 x i8*]* @gpd, i32 0, i32 8)
+  %p = call i8* @poolalloc([92 x i8*]* @gpd, i32 16)
+  call void @poolcheck([92 x i8*]* @gpd, i8* %p)
+  call void @pooldestroy([92 x i8*]* @gpd)
+  ret void
+}
@@ -0,0 +1,87 @@
+; Pointer compression changes the size and layout of the objects in a pool,
+; so it must leave alone pools whose objects reach memcpy(), memmove(),
+; memset() or fwrite(), directly or through a callee, and pools that a
+; callee sees at a nonzero offset.  The list in @compressed is the control.
+;RUN: paopt %s -pointercompress -S -o - | FileCheck %s
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%node = type { %node*, i64 }
+
+declare noalias i8* @malloc(i64)
+declare void @llvm.memset.p0i8.i64(i8*, i8, i64, i32, i1)
+
+define %node* @build(i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %head = phi %node* [ null, %entry ], [ %new, %loop ]
+  %mem = call i8* @malloc(i64 16)
+  %new = bitcast i8* %mem to %node*
+  %next = getelementptr %node, %node* %new, i64 0, i32 0
+  store %node* %head, %node** %next
+  %val = getelementptr %node, %node* %new, i64 0, i32 1
+  store i64 %i, i64* %val
+  %i.next = add i64 %i, 1
+  %done = icmp eq i64 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret %node* %new
+}
+
+define void @clear(%node* %n) {
+entry:
+  %p = bitcast %node* %n to i8*
+  call void @llvm.memset.p0i8.i64(i8* %p, i8 0, i64 16, i32 8, i1 false)
+  ret void
+}
+
+define i64 @value(i64* %v) {
+entry:
+  %x = load i64, i64* %v
+  ret i64 %x
+}
+
+; CHECK-LABEL: define void @compressed(
+; CHECK: poolinit_pc
+; CHECK: ret void
+define void @compressed() {
+entry:
+  %l = call %node* @build(i64 10)
+  %next = getelementptr %node, %node* %l, i64 0, i32 0
+  %second = load %node*, %node** %next
+  ret void
+}
+
+; CHECK-LABEL: define void @cleared(
+; CHECK-NOT: poolinit_pc
+; CHECK: ret void
+define void @cleared() {
+entry:
+  %l = call %node* @build(i64 10)
+  call void @clear(%node* %l)
+  ret void
+}
+
+; CHECK-LABEL: define void @offset(
+; CHECK-NOT: poolinit_pc
+; CHECK: ret void
+define void @offset() {
+entry:
+  %l = call %node* @build(i64 10)
+  %val = getelementptr %node, %node* %l, i64 0, i32 1
+  %x = call i64 @value(i64* %val)
+  ret void
+}
+
+define i32 @main() {
+entry:
+  call void @compressed()
+  call void @cleared()
+  call void @offset()
+  ret i32 0
+}
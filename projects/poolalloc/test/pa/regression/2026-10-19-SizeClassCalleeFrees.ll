@@ -0,0 +1,60 @@
+; The size class heuristic gives a bump pointer pool to the objects that are
+; never freed.  Objects freed or reallocated by a callee, even two calls away
+; from the function that allocates them, are freed and get a pool of fixed
+; size nodes; @leak, whose objects are never freed, is the control.
+;RUN: paopt %s -paheur-SizeClass -poolalloc -S -o - | FileCheck %s
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+declare noalias i8* @malloc(i64)
+declare noalias i8* @realloc(i8*, i64)
+declare void @free(i8*)
+
+define internal void @release2(i8* %p) {
+entry:
+  call void @free(i8* %p)
+  ret void
+}
+
+define internal void @release(i8* %p) {
+entry:
+  call void @release2(i8* %p)
+  ret void
+}
+
+define internal void @grow(i8* %p) {
+entry:
+  %q = call i8* @realloc(i8* %p, i64 16)
+  store i8 2, i8* %q
+  ret void
+}
+
+; CHECK-LABEL: define void @freedByCallee(
+; CHECK: call void @poolinit({{.*}}, i32 16,
+define void @freedByCallee() {
+entry:
+  %p = call i8* @malloc(i64 16)
+  store i8 1, i8* %p
+  call void @release(i8* %p)
+  ret void
+}
+
+; CHECK-LABEL: define void @reallocatedByCallee(
+; CHECK: call void @poolinit({{.*}}, i32 16,
+define void @reallocatedByCallee() {
+entry:
+  %p = call i8* @malloc(i64 16)
+  store i8 1, i8* %p
+  call void @grow(i8* %p)
+  ret void
+}
+
+; CHECK-LABEL: define void @leak(
+; CHECK: call void @poolinit({{.*}}, i32 0,
+define void @leak() {
+entry:
+  %p = call i8* @malloc(i64 16)
+  store i8 1, i8* %p
+  ret void
+}
@@ -0,0 +1,100 @@
+; TypeChecksOpt inlines the checks and stores of 1, 2, 4, 8 and 16 bytes.
+; A check skips null metadata, compares the shadow with one load and calls
+; checkType_N only on a mismatch; a store or an initialization writes the
+; shadow with one store, through the shadow base and size exported by the
+; runtime.  Other sizes still call the runtime.
+; RUN: adsaopt -typechecks-opt %s -S | FileCheck %s
+target datalayout = "e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-f80:128:128-n8:16:32:64"
+target triple = "x86_64-unknown-linux-gnu"
+
+; CHECK: @TypeShadowBase = external constant i8*
+; CHECK: @TypeShadowSize = external constant i64
+
+declare void @trackStoreInst(i8*, i8, i64, i32)
+declare void @checkType(i8, i64, i8*, i8*, i32)
+declare void @trackInitInst(i8*, i64, i32)
+
+; The pattern of type 5 in 4 bytes is 0xFEFEFE05.
+; CHECK-LABEL: @check4(
+; CHECK: [[NOTNULL:%.*]] = icmp ne i8* %md, null
+; CHECK: br i1 [[NOTNULL]], label %typecheck, label %typecheck.done, !prof
+; CHECK: typecheck:
+; CHECK: %shadow.type = load i32, i32* {{.*}}, align 1
+; CHECK: [[BAD:%.*]] = icmp ne i32 %shadow.type, -16843259
+; CHECK: br i1 [[BAD]], label %typecheck.fail, label %typecheck.merge, !prof
+; CHECK: typecheck.fail:
+; CHECK-NEXT: call void @checkType_4(i8 5, i64 4, i8* %md, i8* %p, i32 8)
+; CHECK: typecheck.done:
+; CHECK-NEXT: ret void
+define void @check4(i8* %p, i8* %md) {
+entry:
+  call void @checkType(i8 5, i64 4, i8* %md, i8* %p, i32 8)
+  ret void
+}
+
+; A type number that is not a constant is merged into the pattern.
+; CHECK-LABEL: @checkVariable(
+; CHECK: [[TYPE:%.*]] = zext i8 %t to i32
+; CHECK: [[PATTERN:%.*]] = or i32 [[TYPE]], -16843264
+; CHECK: icmp ne i32 %shadow.type, [[PATTERN]]
+; CHECK: call void @checkType_4(i8 %t, i64 4, i8* %md, i8* %p, i32 9)
+define void @checkVariable(i8 %t, i8* %p, i8* %md) {
+entry:
+  call void @checkType(i8 %t, i64 4, i8* %md, i8* %p, i32 9)
+  ret void
+}
+
+; CHECK-LABEL: @checkSizes(
+; CHECK: icmp ne i8 %shadow.type, 7
+; CHECK: call void @checkType_1(
+; CHECK: icmp ne i16 %shadow.type{{.*}}, -503
+; CHECK: call void @checkType_2(
+; CHECK: icmp ne i128 %shadow.type{{.*}}, -1334440654591915542993625911497130489
+; CHECK: call void @checkType_16(
+define void @checkSizes(i8* %p, i8* %md) {
+entry:
+  call void @checkType(i8 7, i64 1, i8* %md, i8* %p, i32 10)
+  call void @checkType(i8 9, i64 2, i8* %md, i8* %p, i32 11)
+  call void @checkType(i8 7, i64 16, i8* %md, i8* %p, i32 12)
+  ret void
+}
+
+; The pattern of type 6 in 8 bytes is 0xFEFEFEFEFEFEFE06.
+; CHECK-LABEL: @store8(
+; CHECK: %shadow.base = load i8*, i8** @TypeShadowBase
+; CHECK: %shadow.size = load i64, i64* @TypeShadowSize
+; CHECK: select i1
+; CHECK: %shadow = getelementptr i8, i8* %shadow.base
+; CHECK: store i64 -72340172838076922, i64* {{.*}}, align 1
+; CHECK-NOT: call
+; CHECK: ret void
+define void @store8(i8* %p) {
+entry:
+  call void @trackStoreInst(i8* %p, i8 6, i64 8, i32 2)
+  ret void
+}
+
+; CHECK-LABEL: @init8(
+; CHECK: [[NOTNULL:%.*]] = icmp ne i8* %p, null
+; CHECK: br i1 [[NOTNULL]], label %typeinit, label %typeinit.done
+; CHECK: typeinit:
+; CHECK: store i64 -1, i64* {{.*}}, align 1
+; CHECK-NOT: call
+; CHECK: ret void
+define void @init8(i8* %p) {
+entry:
+  call void @trackInitInst(i8* %p, i64 8, i32 3)
+  ret void
+}
+
+; CHECK-LABEL: @oddSizes(
+; CHECK: call void @trackStoreInst(i8* %p, i8 5, i64 3, i32 4)
+; CHECK: call void @checkType(i8 5, i64 12, i8* %md, i8* %p, i32 5)
+; CHECK: call void @trackInitInst(i8* %p, i64 12, i32 6)
+define void @oddSizes(i8* %p, i8* %md) {
+entry:
+  call void @trackStoreInst(i8* %p, i8 5, i64 3, i32 4)
+  call void @checkType(i8 5, i64 12, i8* %md, i8* %p, i32 5)
+  call void @trackInitInst(i8* %p, i64 12, i32 6)
+  ret void
+}
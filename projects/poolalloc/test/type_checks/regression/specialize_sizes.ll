@@ -0,0 +1,35 @@
+; Calls to trackStoreInst and checkType with a constant size of 1, 2, 4, 8 or
+; 16 bytes must be redirected to the version specialized for that size.  The
+; size is argument 2 of trackStoreInst and argument 1 of checkType; the tags
+; below are chosen so that reading any other argument picks the wrong callee.
+; RUN: adsaopt -typechecks-opt -typechecks-inline-fast-paths=false %s -S \
+; RUN:   | FileCheck %s
+target datalayout = "e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-f80:128:128-n8:16:32:64"
+target triple = "x86_64-unknown-linux-gnu"
+
+declare void @trackStoreInst(i8*, i8, i64, i32)
+declare void @checkType(i8, i64, i8*, i8*, i32)
+
+; CHECK-LABEL: @storeThenLoad(
+define void @storeThenLoad(i8* %p, i8* %md) {
+entry:
+; CHECK: call void @trackStoreInst_4(i8* %p, i8 5, i64 4, i32 1)
+  call void @trackStoreInst(i8* %p, i8 5, i64 4, i32 1)
+; CHECK: call void @checkType_4(i8 5, i64 4, i8* %md, i8* %p, i32 8)
+  call void @checkType(i8 5, i64 4, i8* %md, i8* %p, i32 8)
+; CHECK: call void @trackStoreInst_16(i8* %p, i8 6, i64 16, i32 2)
+  call void @trackStoreInst(i8* %p, i8 6, i64 16, i32 2)
+; CHECK: call void @checkType_8(i8 7, i64 8, i8* %md, i8* %p, i32 16)
+  call void @checkType(i8 7, i64 8, i8* %md, i8* %p, i32 16)
+  ret void
+}
+
+; CHECK-LABEL: @oddSizes(
+define void @oddSizes(i8* %p, i8* %md) {
+entry:
+; CHECK: call void @trackStoreInst(i8* %p, i8 5, i64 3, i32 4)
+  call void @trackStoreInst(i8* %p, i8 5, i64 3, i32 4)
+; CHECK: call void @checkType(i8 5, i64 12, i8* %md, i8* %p, i32 1)
+  call void @checkType(i8 5, i64 12, i8* %md, i8* %p, i32 1)
+  ret void
+}
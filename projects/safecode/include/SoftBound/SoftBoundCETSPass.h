@@ -67,6 +67,7 @@
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Operator.h"
 #include "llvm/Support/CommandLine.h"
@@ -77,6 +78,7 @@
 #include "llvm/Support/MathExtras.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Pass.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include <algorithm>
 #include <cstdarg>
 #include <queue>
@@ -121,6 +123,11 @@ class SoftBoundCETSPass: public ModulePass {
    * for a given pointer
    */
   Function* m_store_base_bound_func;
+
+  /* Calls to the metadata load and store functions whose fast path is
+   * expanded inline
+   */
+  std::vector<CallInst*> m_metadata_calls;
   
   /* void pointer type, used many times in the Softboundcets pass */
   Type* m_void_ptr_type;
@@ -377,6 +384,8 @@ class SoftBoundCETSPass: public ModulePass {
   Value* castToVoidPtr(Value*, Instruction*);
   bool checkGEPOfInterestSB(GetElementPtrInst*);
   void handleReturnInst(ReturnInst*);    
+  void inlineMetadataAccess(CallInst*);
+  void inlinePackedMetadataAccess(CallInst*, Value*, Value*, Instruction*);
   
  public:
   static char ID;
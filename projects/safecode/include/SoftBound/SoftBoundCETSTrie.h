@@ -0,0 +1,39 @@
+//=== SoftBound/SoftBoundCETSTrie.h - Layout of the SoftBound metadata trie ===//
+//
+// This header is shared by the SoftBound+CETS run-time, which is written in
+// C, and by the SoftBoundCETS pass, which expands metadata loads and stores
+// inline with -softboundcets_inline_metadata.  Both take the geometry of the
+// metadata trie from here.
+//
+// The run-time exports its primary table a second time under a name that
+// spells out the layout of its entries: the number of bits of the secondary
+// index, whether the entries are packed, and whether the run-time counts
+// metadata accesses.  Inlined accesses use that name, so a program whose
+// accesses were expanded for another layout than the run-time's fails to
+// link instead of reading the wrong entries.
+//
+//===---------------------------------------------------------------------===//
+
+#ifndef SOFTBOUNDCETSTRIE_H
+#define SOFTBOUNDCETSTRIE_H
+
+/* log2 of the number of entries of a secondary table */
+#ifndef __SOFTBOUNDCETS_TRIE_SECONDARY_BITS
+#define __SOFTBOUNDCETS_TRIE_SECONDARY_BITS 18
+#endif
+
+#define __SOFTBOUNDCETS_TRIE_MIN_SECONDARY_BITS 12
+#define __SOFTBOUNDCETS_TRIE_MAX_SECONDARY_BITS 26
+
+/* Packed entries: the number of bits of an address and of a lock index */
+#define __SOFTBOUNDCETS_TRIE_PACKED_ADDRESS_BITS 48
+#define __SOFTBOUNDCETS_TRIE_PACKED_LOCK_BITS 26
+
+/* Prefix and suffixes of the layout-specific name of the primary table,
+ * e.g. __softboundcets_trie_primary_table_18_packed_stats
+ */
+#define __SOFTBOUNDCETS_TRIE_LAYOUT_PREFIX "__softboundcets_trie_primary_table_"
+#define __SOFTBOUNDCETS_TRIE_LAYOUT_PACKED "_packed"
+#define __SOFTBOUNDCETS_TRIE_LAYOUT_STATS "_stats"
+
+#endif
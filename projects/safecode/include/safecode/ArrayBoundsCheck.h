@@ -16,6 +16,8 @@
 
 #include "safecode/AllocatorInfo.h"
 
+#include "dsa/DemandDrivenDSA.h"
+
 #include "llvm/Analysis/PostDominators.h"
 #include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/IR/DataLayout.h"
@@ -89,6 +91,38 @@ private:
   std::set<GetElementPtrInst *> SafeGEPs;
 };
 
+
+/// ArrayBoundsCheckStruct - It proves that GEPs which only index into the
+/// fields of type-known structures are safe.  The DSNodes of the indexed
+/// pointers are found with demand-driven DSA, so only the functions whose
+/// GEPs are queried (and the functions that affect them) are analyzed.  GEPs
+/// that it cannot prove safe are passed on to the next array bounds checking
+/// pass.
+class ArrayBoundsCheckStruct : public FunctionPass,
+                               public ArrayBoundsCheckGroup {
+public:
+  static char ID;
+  ArrayBoundsCheckStruct() : FunctionPass(ID), abcPass(0) {}
+  virtual bool isGEPSafe(GetElementPtrInst * GEP);
+  virtual void getAnalysisUsage(AnalysisUsage & AU) const {
+    AU.addRequired<dsa::DemandDrivenDSA>();
+    AU.addRequired<ArrayBoundsCheckGroup>();
+    AU.setPreservesAll();
+  }
+  virtual bool runOnFunction(Function & F);
+
+  /// When chaining analyses, changing the pointer to the correct pass
+  virtual void *getAdjustedAnalysisPointer(const void * ID) {
+      if (ID == (&ArrayBoundsCheckGroup::ID))
+        return (ArrayBoundsCheckGroup*)this;
+      return this;
+  }
+
+private:
+  // The array bounds checking pass to ask about GEPs that we cannot prove safe
+  ArrayBoundsCheckGroup * abcPass;
+};
+
 }
 
 #endif
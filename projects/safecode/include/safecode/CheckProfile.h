@@ -0,0 +1,129 @@
+//===- CheckProfile.h - Per-site execution counts of run-time checks -------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines passes that instrument run-time checks with execution
+// counters and that read the resulting profile back into the compiler.
+//
+// A check site is named by the function containing it, the position of the
+// check among the run-time checks of that function, and the name of the check.
+// Both passes must therefore run at the same point of the pass pipeline.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SAFECODE_CHECKPROFILE_H_
+#define _SAFECODE_CHECKPROFILE_H_
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ValueMap.h"
+#include "llvm/Pass.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+//
+// Function: getCheckSites()
+//
+// Description:
+//  Find the calls to run-time checks within the function and append them to
+//  the list in the order in which they appear within the function.
+//
+void getCheckSites (Function & F, std::vector<CallInst *> & Sites);
+
+//
+// Function: getCheckSiteName()
+//
+// Description:
+//  Return the name under which the profile records the specified check site.
+//
+std::string getCheckSiteName (const CallInst * CI, unsigned Index);
+
+//
+// Pass: CheckProfileInstrument
+//
+// Description:
+//  This pass gives every run-time check in the module a counter that is
+//  incremented each time the check executes.  The counters are registered
+//  with the counting run-time (libcount), which writes them into a profile
+//  when the program exits.
+//
+struct CheckProfileInstrument : public ModulePass {
+  public:
+    static char ID;
+    CheckProfileInstrument () : ModulePass (ID) { }
+    const char *getPassName() const {
+      return "Count executions of SAFECode run-time checks";
+    }
+    virtual bool runOnModule (Module & M);
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.setPreservesCFG();
+    }
+
+  private:
+    void instrumentSite (GlobalVariable * Counters, unsigned Index,
+                         CallInst * CI);
+    void registerSites (Module & M,
+                        GlobalVariable * Counters,
+                        GlobalVariable * Names,
+                        unsigned NumSites);
+};
+
+//
+// Pass: CheckProfile
+//
+// Description:
+//  This pass reads a profile written by code instrumented with
+//  CheckProfileInstrument and tells other passes which run-time checks are
+//  hot.  Checks that the profile does not mention, including checks created
+//  after the profile was loaded, are neither hot nor cold.
+//
+struct CheckProfile : public ImmutablePass {
+  public:
+    static char ID;
+    CheckProfile (const std::string & Filename = "");
+    const char *getPassName() const {
+      return "SAFECode Run-time Check Profile";
+    }
+    virtual void initializePass ();
+
+    // Determine whether a profile was loaded
+    bool hasProfile (void) const {
+      return !Counts.empty();
+    }
+
+    // Methods for querying the profile
+    bool getCount (const CallInst * CI, uint64_t & Count);
+    bool isHot (const CallInst * CI);
+    bool isCold (const CallInst * CI);
+
+  private:
+    // Name of the profile file
+    std::string Filename;
+
+    // Execution count of each check site named in the profile
+    StringMap<uint64_t> Counts;
+
+    // Sum of the execution counts of all check sites
+    uint64_t TotalCount;
+
+    // Execution counts of the check sites found so far
+    ValueMap<const CallInst *, uint64_t> SiteCounts;
+
+    // Functions whose check sites have been looked up
+    std::set<const Function *> Numbered;
+
+    void numberFunction (const Function * F);
+};
+
+}
+#endif
@@ -0,0 +1,159 @@
+//===- CheckReport.h - Per-function report of run-time checks --------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines passes that record how many run-time checks of each kind
+// every function holds as the SAFECode passes run and write a JSON report of
+// them, along with the estimated cost of the checks that remain.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SAFECODE_CHECKREPORT_H_
+#define _SAFECODE_CHECKREPORT_H_
+
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+//
+// Pass: CheckReport
+//
+// Description:
+//  This pass holds the report while the passes below fill it in.  The report
+//  is written to the specified file.
+//
+struct CheckReport : public ImmutablePass {
+  public:
+    //
+    // Structure: StageCounts
+    //
+    // Description:
+    //  The checks and registrations in a function after a stage of the
+    //  pipeline.
+    //
+    struct StageCounts {
+      // The name of the stage
+      std::string Stage;
+
+      // The number of checks of each kind
+      std::map<std::string, unsigned> Kinds;
+
+      // The number of checks that look up the object and that do not
+      unsigned Slow;
+      unsigned Fast;
+
+      // The number of object registrations
+      unsigned Registrations;
+    };
+
+    //
+    // Structure: HotCheck
+    //
+    // Description:
+    //  A check remaining in a function and how often it runs.
+    //
+    struct HotCheck {
+      std::string Site;
+      std::string Kind;
+      std::string Location;
+      double Frequency;
+      double Cost;
+    };
+
+    //
+    // Structure: FunctionReport
+    //
+    // Description:
+    //  Everything the report says about one function.
+    //
+    struct FunctionReport {
+      std::vector<StageCounts> Stages;
+      double Cost;
+      std::vector<HotCheck> Hottest;
+      FunctionReport () : Cost (0) { }
+    };
+
+    static char ID;
+    CheckReport (const std::string & Filename = "");
+    const char *getPassName() const {
+      return "SAFECode Run-time Check Report";
+    }
+
+    // Determine whether a report is to be written
+    bool isEnabled (void) const {
+      return !Filename.empty();
+    }
+
+    // Methods for filling in and writing the report
+    void recordStage (Module & M, const std::string & Stage);
+    FunctionReport & getFunctionReport (const Function & F);
+    bool write (Module & M);
+
+  private:
+    // Name of the report file
+    std::string Filename;
+
+    // The stages recorded so far, in order
+    std::vector<std::string> Stages;
+
+    // The report of each function that has held checks or registrations
+    std::map<std::string, FunctionReport> Functions;
+};
+
+//
+// Pass: CheckReportStage
+//
+// Description:
+//  This pass records the checks of every function at its position in the
+//  pipeline under the given stage name.
+//
+struct CheckReportStage : public ModulePass {
+  public:
+    static char ID;
+    CheckReportStage (const char * Stage = "stage") :
+      ModulePass (ID), Stage (Stage) { }
+    const char *getPassName() const {
+      return "Record SAFECode run-time checks";
+    }
+    virtual bool runOnModule (Module & M);
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.addRequired<CheckReport>();
+      AU.setPreservesAll();
+    }
+
+  private:
+    std::string Stage;
+};
+
+//
+// Pass: CheckReportWriter
+//
+// Description:
+//  This pass records the final stage of the report, estimates the dynamic
+//  cost of the remaining checks of each function from block frequencies, and
+//  writes the report.
+//
+struct CheckReportWriter : public ModulePass {
+  public:
+    static char ID;
+    CheckReportWriter () : ModulePass (ID) { }
+    const char *getPassName() const {
+      return "Write SAFECode run-time check report";
+    }
+    virtual bool runOnModule (Module & M);
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const;
+};
+
+}
+#endif
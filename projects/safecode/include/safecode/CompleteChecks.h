@@ -43,8 +43,8 @@ struct CompleteChecks : public ModulePass {
       AU.addRequired<CallGraphWrapperPass>();
       AU.addRequired<EQTDDataStructures>();
 
-      // Preserved passes
-      AU.setPreservesCFG();
+      // Preserved passes: none.  Checks on indirect calls with few targets
+      // are split into inline compares and a failure block.
     };
 
   protected:
@@ -55,6 +55,14 @@ struct CompleteChecks : public ModulePass {
     void makeFSParameterCallsComplete(Module &M);
     void fixupCFIChecks (Module & M, std::string name);
     void getFunctionTargets (CallSite CS, std::vector<const Function *> & T);
+    void inlineTargetCompares (CallInst * CI,
+                               const std::vector<Constant *> & Targets);
+    void useTargetSet (Module & M, CallInst * CI, GlobalVariable * Table,
+                       unsigned NumTargets);
+    void initTargetSets (Module & M);
+
+    // Target sets created for the module that still need to be initialized
+    std::vector<GlobalVariable *> TargetSets;
 };
 
 }
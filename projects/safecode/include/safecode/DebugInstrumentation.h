@@ -15,6 +15,7 @@
 #ifndef DEBUG_INSTRUMENTATION_H
 #define DEBUG_INSTRUMENTATION_H
 
+#include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Value.h"
@@ -23,6 +24,7 @@
 #include <map>
 #include <string>
 #include <utility>
+#include <vector>
 
 namespace llvm {
 
@@ -83,6 +85,55 @@ struct DebugInstrument : public ModulePass {
     void transformFunction (Function * F, GetSourceInfo & SI);
 };
 
+//
+// Pass: DebugSiteTable
+//
+// Description:
+//  This pass replaces the tag, source file, and line number arguments of
+//  calls to the debug versions of run-time checks with a pointer into a single
+//  read-only table of source locations for the module.  The run-time only
+//  reads the table entry when it reports an error.  It must run after all
+//  passes that look for the "_debug" versions of the checks.
+//
+struct DebugSiteTable : public ModulePass {
+  public:
+    static char ID;
+
+    virtual bool runOnModule(Module &M);
+    DebugSiteTable () : ModulePass (ID) {
+      return;
+    }
+
+    const char *getPassName() const {
+      return "SAFECode Debug Site Table Pass";
+    }
+
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.setPreservesCFG();
+    };
+
+  private:
+    // LLVM type for void pointers (void *)
+    Type * VoidPtrTy;
+
+    // The type of one table entry: { tag, line number, source file }
+    StructType * SiteTy;
+
+    // The table entries, in the order in which they were created
+    std::vector<Constant *> Sites;
+
+    // Calls to rewrite once the table exists, paired with their entry number
+    std::vector<std::pair<CallInst *, unsigned> > SiteCalls;
+
+    // Map from (tag, source file, line number) to the entry number
+    std::map<std::pair<Constant *, std::pair<Constant *, Constant *> >,
+             unsigned> SiteMap;
+
+    // Private methods
+    void collectCalls (Function * F);
+    void rewriteCalls (Module & M, GlobalVariable * Table);
+};
+
 }
 
 #endif
@@ -15,6 +15,8 @@
 #ifndef FORMAT_STRINGS_H
 #define FORMAT_STRINGS_H
 
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CallSite.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
 
@@ -34,6 +36,30 @@ namespace llvm
 {
   class FormatStringTransform : public ModulePass
   {
+  public:
+    // The kinds of format string functions
+    enum FormatStringFuncKind
+    {
+      // scanf() style functions; these always use the run-time wrappers
+      ScanFunc,
+      // printf() style functions writing to a stream
+      PrintFunc,
+      // printf() style functions writing to the buffer in their first argument
+      PrintToBufferFunc
+    };
+
+    // A format string function and its secured replacement
+    struct FormatStringFuncEntry
+    {
+      const char *name;
+      unsigned fargc;
+      Statistic *stat;
+      const char *replacement;
+      FormatStringFuncKind kind;
+      // The argument limiting the size of the output buffer, or -1
+      int sizeArg;
+    };
+
   private:
     // The fsparameter function.
     Value *FSParameter;
@@ -41,6 +67,9 @@ namespace llvm
     Value *FSCallInfo;
     // The type for the pointer_info structure.
     Type *PointerInfoType;
+    // The run-time checks for calls with constant format strings.
+    Value *PoolCheckUI;
+    Value *PoolCheckStrUI;
     // A map from a function to the instruction where the call_info structure
     // allocated for that function.
     map<Function *, Instruction *> CallInfoStructures;
@@ -74,9 +103,10 @@ namespace llvm
     // the proper size.
     void fillArraySizes(Module &M);
     // Transform all calls of the given function.
-    bool transform(
-      Module &M, const char *name, unsigned argc, const char *to, Statistic &st
-    );
+    bool transform(Module &M, const FormatStringFuncEntry &entry);
+    // Checks a call with a constant format string without using a run-time
+    // wrapper.
+    bool specializeCall(CallSite &call, const FormatStringFuncEntry &entry);
     // Adds intrinsic declarations to the module.
     void addFormatStringIntrinsics(Module &M);
     // Adds a call to fsparameter for the given (instruction, pointer value)
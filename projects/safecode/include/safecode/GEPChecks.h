@@ -44,7 +44,7 @@ struct InsertGEPChecks : public FunctionPass, InstVisitor<InsertGEPChecks> {
     virtual bool runOnFunction(Function &F);
     virtual void getAnalysisUsage(AnalysisUsage &AU) const {
       // Required passes
-      AU.addRequired<ArrayBoundsCheckLocal>();
+      AU.addRequired<ArrayBoundsCheckGroup>();
 
       // Preserved passes
       AU.setPreservesCFG();
@@ -56,7 +56,7 @@ struct InsertGEPChecks : public FunctionPass, InstVisitor<InsertGEPChecks> {
   protected:
     // Pointers to required passes
     const DataLayout * TD;
-    ArrayBoundsCheckLocal * abcPass;
+    ArrayBoundsCheckGroup * abcPass;
 
     // Pointer to GEP run-time check function
     Function * PoolCheckArrayUI;
@@ -7,8 +7,9 @@
 // 
 //===----------------------------------------------------------------------===//
 //
-// This pass replaces calls to fastlscheck within inline code to perform the
-// check.  It is designed to provide the advantage of libLTO without libLTO.
+// This pass replaces calls to fastlscheck and exactcheck2 within inline code
+// to perform the check.  It is designed to provide the advantage of libLTO
+// without libLTO.
 //
 //===----------------------------------------------------------------------===//
 #include "llvm/ADT/Statistic.h"
@@ -20,13 +21,17 @@
 #include "llvm/Pass.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 
+#include <vector>
 
 namespace llvm {
   //
   // Pass: InlineFastChecks
   //
   // Description:
-  //  This pass inlines fast checks to make them faster.
+  //  This pass inlines fast checks to make them faster.  The inlined checks
+  //  use one branch to the failure code per check, and adjacent load/store
+  //  checks within a basic block are merged into a single check of a vector of
+  //  accesses.
   //
   struct InlineFastChecks : public ModulePass {
    public:
@@ -46,7 +51,15 @@ namespace llvm {
      bool inlineCheck (Function * F);
      bool createBodyFor (Function * F);
      bool createDebugBodyFor (Function * F);
+     Function * createFastBodyFor (Function * F);
+     bool mergeChecks (Function * F);
+     Function * getBatchFor (Function * F, unsigned Count);
+     bool flushBatch (Function * F, std::vector<CallInst *> & Batch);
      Value * castToInt (Value * Pointer, BasicBlock * BB);
-     Value * addComparisons (BasicBlock *, Value *, Value *, Value *);
+     Value * addBoundsCheck (BasicBlock *, Value *, Value *, Value *);
+     Value * addAccessCheck (BasicBlock *, Value *, Value *, Value *, Value *);
+
+     // The functions created to check batches of load/store checks
+     std::vector<Function *> BatchFunctions;
   };
 }
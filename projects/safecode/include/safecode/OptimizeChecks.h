@@ -15,12 +15,14 @@
 #define SAFECODE_OPTIMIZECHECKS_H
 
 #include "llvm/ADT/DenseSet.h"
+#include "llvm/Analysis/LoopInfo.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
 
 #include "safecode/CheckInfo.h"
 #include "safecode/AllocatorInfo.h"
+#include "safecode/CheckProfile.h"
 
 namespace llvm {
 
@@ -75,6 +77,41 @@ struct GlobalRegisterOpt : public ModulePass {
     }
 };
 
+//
+// Pass: HoistHotChecks
+//
+// Description:
+//  This pass uses a run-time check profile to move hot checks with
+//  loop-invariant operands out of the loops containing them.  Checks that the
+//  profile shows to be cold are left where they are.
+//
+struct HoistHotChecks : public FunctionPass {
+  private:
+    // Analysis passes used by this pass
+    LoopInfo * LI;
+    DominatorTree * DT;
+
+    // Private methods
+    bool isSafeToHoistFrom (Loop * L);
+    bool alwaysExecutes (BasicBlock * BB, Loop * L);
+    bool hoistChecks (Loop * L, CheckProfile & Profile);
+
+  public:
+    static char ID;
+    HoistHotChecks() : FunctionPass(ID) {}
+    virtual bool runOnFunction (Function & F);
+
+    const char *getPassName() const {
+      return "Hoist Hot SAFECode Run-time Checks";
+    }
+
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.addRequired<LoopInfoWrapperPass>();
+      AU.addRequired<DominatorTreeWrapperPass>();
+      AU.setPreservesCFG();
+    }
+};
+
 }
 
 #endif
@@ -1,4 +1,4 @@
-//===- PromoteArrayAlloca.h - Promote array alloca instructions to malloc ----//
+//===- PromoteArrayAlloca.h - Move array allocas to the secondary stack -----//
 //
 //                          The SAFECode Compiler
 //
@@ -7,8 +7,8 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// This file implements a pass that promotes array alloca instuction to malloc
-// allocations.
+// This file implements a pass that moves variable-sized array allocas to the
+// baggy bounds secondary stack.
 //
 //===----------------------------------------------------------------------===//
 
@@ -27,6 +27,7 @@
 #include "llvm/IR/Dominators.h"
 #include "llvm/Pass.h"
 #include <set>
+#include <vector>
 
 namespace llvm {
 
@@ -34,8 +35,9 @@ namespace llvm {
 // Pass: PromoteArrayAllocas
 //
 // Description:
-//  This pass promotes array allocations to malloc allocations if necessary to
-//  provide bbac runtime check support.
+//  This pass moves variable-sized array allocations to the secondary stack of
+//  the baggy bounds run-time, which aligns them to their power-of-two size.
+//  Fixed-size allocations are padded by InsertBaggyBoundsChecks instead.
 //
 
 class PromoteArrayAllocas : public ModulePass,
@@ -51,14 +53,19 @@ class PromoteArrayAllocas : public ModulePass,
 
     void visitAllocaInst(AllocaInst &A);
   protected:
-    Constant *malloc;
-    Constant *free;
+    Constant *StackAlloc;
+    Constant *StackSave;
+    Constant *StackRestore;
     void createProtos(Module & M);
     Instruction * transformArrayAlloca (AllocaInst & A);
-    bool insertFreeBeforeLeavingFunction(Instruction * Inst, bool LoadInstInsertion);
-    Instruction * installMallocHelper(Instruction * MallocInst);
+    void restoreStackOnStackRestore (Function & F);
+    void restoreStackBeforeLeavingFunction (Function & F, Instruction * Mark);
+    bool promoteAllocas (Function & F);
     const DataLayout * TD;
 
+    // Array allocas of the current function to be moved
+    std::vector<AllocaInst *> ArrayAllocas;
+
     Type * VoidType;
     Type * Int64Type;
 };
@@ -148,6 +148,11 @@ extern "C" {
   void * __sc_bb_poolstrdup_debug (PPOOL, const char * Node, TAG, SRC_INFO);
   void * __sc_bb_poolmemalign(PPOOL, unsigned Alignment, unsigned NumBytes);
 
+  // Secondary stack for variable-sized stack objects
+  void * __sc_bb_stack_alloc (size_t size);
+  void * __sc_bb_stack_save (void);
+  void __sc_bb_stack_restore (void * mark);
+
   void bb_poolcheck(PPOOL, void *Node);
   void bb_poolcheckui(PPOOL, void *Node);
   void bb_poolcheck_debug (PPOOL, void * Node, unsigned length, TAG, SRC_INFO);
@@ -11,22 +11,20 @@
 // type-safety information from points-to analysis to prove whether GEPs are
 // safe (they do not create a pointer outside of the memory object).  It is
 // primarily designed to alleviate run-time checks on GEPs used for structure
-// indexing (hence the clever name).
+// indexing (hence the clever name).  The points-to results come from
+// demand-driven DSA, so only the functions containing the GEPs queried are
+// analyzed.
 //
 //===----------------------------------------------------------------------===//
 
 #define DEBUG_TYPE "abc-struct"
 
-#include "SCUtils.h"
 #include "safecode/ArrayBoundsCheck.h"
-#include "safecode/SAFECodeConfig.h"
-#include "safecode/Support/AllocatorInfo.h"
+#include "safecode/Utility.h"
 
-#include "dsa/DSGraph.h"
 #include "dsa/DSNode.h"
 
 #include "llvm/ADT/Statistic.h"
-#include "llvm/Analysis/ScalarEvolutionExpressions.h"
 
 using namespace llvm;
 
@@ -36,81 +34,14 @@ namespace {
   STATISTIC (safeGEPs , "Number of GEPs on Structures Proven Safe Statically");
 }
 
-NAMESPACE_SC_BEGIN
+static RegisterPass<ArrayBoundsCheckStruct>
+X ("abc-struct", "Structure Indexing Array Bounds Check pass");
 
-namespace {
-  RegisterPass<ArrayBoundsCheckStruct>
-  X ("abc-struct", "Structure Indexing Array Bounds Check pass");
-
-  RegisterAnalysisGroup<ArrayBoundsCheckGroup> ABCGroup(X);
-}
+static RegisterAnalysisGroup<ArrayBoundsCheckGroup>
+ABCGroup (X);
 
 char ArrayBoundsCheckStruct::ID = 0;
 
-//
-// Method: getDSNodeHandle()
-//
-// Description:
-//  This method looks up the DSNodeHandle for a given LLVM value.  The context
-//  of the value is the specified function, although if it is a global value,
-//  the DSNodeHandle may exist within the global DSGraph.
-//
-// Return value:
-//  A DSNodeHandle for the value is returned.  This DSNodeHandle could either
-//  be in the function's DSGraph or from the GlobalsGraph.  Note that the
-//  DSNodeHandle may represent a NULL DSNode.
-//
-DSNodeHandle
-ArrayBoundsCheckStruct::getDSNodeHandle (const Value * V, const Function * F) {
-  //
-  // Get access to the points-to results.
-  //
-  EQTDDataStructures & dsaPass = getAnalysis<EQTDDataStructures>();
-
-  //
-  // Ensure that the function has a DSGraph
-  //
-  assert (dsaPass.hasDSGraph(*F) && "No DSGraph for function!\n");
-
-  //
-  // Lookup the DSNode for the value in the function's DSGraph.
-  //
-  DSGraph * TDG = dsaPass.getDSGraph(*F);
-  DSNodeHandle DSH = TDG->getNodeForValue(V);
-
-  //
-  // If the value wasn't found in the function's DSGraph, then maybe we can
-  // find the value in the globals graph.
-  //
-  if ((DSH.isNull()) && (isa<GlobalValue>(V))) {
-    //
-    // Try looking up this DSNode value in the globals graph.  Note that
-    // globals are put into equivalence classes; we may need to first find the
-    // equivalence class to which our global belongs, find the global that
-    // represents all globals in that equivalence class, and then look up the
-    // DSNode Handle for *that* global.
-    //
-    DSGraph * GlobalsGraph = TDG->getGlobalsGraph ();
-    DSH = GlobalsGraph->getNodeForValue(V);
-    if (DSH.isNull()) {
-      //
-      // DSA does not currently handle global aliases.
-      //
-      if (!isa<GlobalAlias>(V)) {
-        //
-        // We have to dig into the globalEC of the DSGraph to find the DSNode.
-        //
-        const GlobalValue * GV = dyn_cast<GlobalValue>(V);
-        const GlobalValue * Leader;
-        Leader = GlobalsGraph->getGlobalECs().getLeaderValue(GV);
-        DSH = GlobalsGraph->getNodeForValue(Leader);
-      }
-    }
-  }
-
-  return DSH;
-}
-
 //
 // Method: runOnFunction()
 //
@@ -173,26 +104,23 @@ ArrayBoundsCheckStruct::isGEPSafe (GetElementPtrInst * GEP) {
   Value * PointerOperand = GEP->getPointerOperand();
 
   //
-  // Determine whether the pointer is for a type-known object.
+  // Determine whether the pointer is for a type-known object.  If DSA says
+  // that the object is type-known but not an array node, then we know that
+  // this is just structure indexing.  We can therefore declare it safe.
   //
   Function * F = GEP->getParent()->getParent();
-  DSNode * N = getDSNodeHandle (PointerOperand, F).getNode();
-  if (N) {
-    //
-    // If DSA says that the object is type-known but not an array node, then
-    // we know that this is just structure indexing.  We can therefore declare
-    // it safe.
-    //
-    if ((!N->isNodeCompletelyFolded()) &&
-        (!(N->isArrayNode())) &&
-        (!(N->isIncompleteNode())) &&
-        (!(N->isUnknownNode())) &&
-        (!(N->isIntToPtrNode())) &&
-        (!(N->isExternalNode()))) {
-      if (indexesStructsOnly (GEP)) {
-        ++safeGEPs;
-        return true;
-      }
+  const unsigned Unsafe = DSNode::CollapsedNode  |
+                          DSNode::ArrayNode      |
+                          DSNode::IncompleteNode |
+                          DSNode::UnknownNode    |
+                          DSNode::IntToPtrNode   |
+                          DSNode::ExternalNode;
+  unsigned Flags;
+  dsa::DemandDrivenDSA & DDA = getAnalysis<dsa::DemandDrivenDSA>();
+  if (DDA.getNodeFlags (PointerOperand, F, Flags) && !(Flags & Unsafe)) {
+    if (indexesStructsOnly (GEP)) {
+      ++safeGEPs;
+      return true;
     }
   }
 
@@ -203,5 +131,3 @@ ArrayBoundsCheckStruct::isGEPSafe (GetElementPtrInst * GEP) {
   return abcPass->isGEPSafe(GEP);
 }
 
-
-NAMESPACE_SC_END
@@ -15,6 +15,7 @@
 #define DEBUG_TYPE "inline_bbac_runtime_functions"
 
 #include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/Triple.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Module.h"
@@ -187,6 +188,55 @@ castToPtr (Value * Integer, BasicBlock * BB) {
   return new IntToPtrInst (Integer, getVoidPtrType(*(BB->getModule())), "tmpp", BB);
 }
 
+//
+// Function: hasTaggedOOBPointers()
+//
+// Description:
+//  Determine whether the run-time encodes out-of-bounds pointers by setting
+//  the high bits of the pointer (see runtime/include/BBTaggedPtr.h).  The
+//  run-time does this on x86-64, where bit 63 marks every such pointer.
+//
+static bool
+hasTaggedOOBPointers (const Module & M) {
+  return Triple (M.getTargetTriple()).getArch() == Triple::x86_64;
+}
+
+//
+// Function: insertIsTaggedPtr()
+//
+// Description:
+//  Create instructions to check whether the input pointer V is a tagged
+//  out-of-bounds pointer.  If it is, jump to TaggedBB, otherwise jump to
+//  NotTaggedBB.  All the instructions are inserted to BB.
+//
+// Inputs:
+//  V - The pointer to be checked
+//  BB - The basic block to be inserted
+//  NotTaggedBB - The basic block to be jumped when V is not a tagged pointer
+//  TaggedBB - The basic block to be jumped when V is a tagged pointer
+//
+static void
+insertIsTaggedPtr (Value *V,
+                   BasicBlock *BB,
+                   BasicBlock *NotTaggedBB,
+                   BasicBlock *TaggedBB) {
+  //
+  // Assert that the caller is giving us a casted integer value.
+  //
+  assert (isa<IntegerType>(V->getType()));
+
+  //
+  // The tag bit is the sign bit of the pointer.
+  //
+  ICmpInst * Compare = new ICmpInst (*BB,
+                                     CmpInst::ICMP_SLT,
+                                     V,
+                                     ConstantInt::get (V->getType(), 0, false),
+                                     "is_tagged");
+
+  BranchInst::Create (TaggedBB, NotTaggedBB, Compare, BB);
+}
+
 //
 // Function: insertIsRewrittenPtr()
 //
@@ -238,6 +288,22 @@ insertIsRewrittenPtr (Value *V,
                                             "and",
                                             BB);
 
+  //
+  // Tagged OOB pointers lie outside of the rewrite pointer range.
+  //
+  if (hasTaggedOOBPointers (*(BB->getModule()))) {
+    ICmpInst * Tagged = new ICmpInst (*BB,
+                                      CmpInst::ICMP_SLT,
+                                      V,
+                                      ConstantInt::get (V->getType(), 0, false),
+                                      "is_tagged");
+    Compare = BinaryOperator::Create (Instruction::Or,
+                                      Compare,
+                                      Tagged,
+                                      "or",
+                                      BB);
+  }
+
   BranchInst::Create (FaultBB, PassRewrittenCheckBB, Compare, BB);
 }
 
@@ -387,17 +453,24 @@ insertGetBBACLength (Value *Ptr,
                                      ConstantInt::get (LLength->getType(), 0, false),
                                      "cmp_eq_zero");
 
-  ICmpInst * CompareGtTwelve = new ICmpInst (*BB,
-                                             CmpInst::ICMP_UGT,
-                                             LLength,
-                                             ConstantInt::get (LLength->getType(), 12, false),
-                                             "cmp_gt_twelve");
+  //
+  // The size table of targets with tagged OOB pointers covers objects of any
+  // size, so only unregistered memory is skipped there.
+  //
+  Value *BLenCheck = CompareEqZero;
+  if (!hasTaggedOOBPointers (*M)) {
+    ICmpInst * CompareGtTwelve = new ICmpInst (*BB,
+                                               CmpInst::ICMP_UGT,
+                                               LLength,
+                                               ConstantInt::get (LLength->getType(), 12, false),
+                                               "cmp_gt_twelve");
 
-  BinaryOperator *BLenCheck = BinaryOperator::Create (Instruction::Or,
-                                                      CompareEqZero,
-                                                      CompareGtTwelve,
-                                                      "cmp_len_check",
-                                                      BB);
+    BLenCheck = BinaryOperator::Create (Instruction::Or,
+                                        CompareEqZero,
+                                        CompareGtTwelve,
+                                        "cmp_len_check",
+                                        BB);
+  }
 
   // Cast the slot size to i64 for furthur calculation.
   Value *LCasted = castTo(LLength, Type::getInt64Ty(M->getContext()),
@@ -841,6 +914,14 @@ llvm::InlineBBACRuntimeFunctions<isRewriteOOBDisabled>
 
     insertIsRewrittenPtr (Node, NotPassZeroLenCheckBB, PassRewrittenCheckBB, FaultBB);
     insertBBPoolCheck(Node, Length, PassRewrittenCheckBB, GoodBB, FaultBB);
+  } else if (hasTaggedOOBPointers (*(F->getParent()))) {
+    //
+    // The run-time may still create tagged OOB pointers; they must not be
+    // used to index the size table.
+    //
+    BasicBlock *NotTaggedBB = BasicBlock::Create (Context, "not_tagged", F);
+    insertIsTaggedPtr (Node, NotPassZeroLenCheckBB, NotTaggedBB, FaultBB);
+    insertBBPoolCheck(Node, Length, NotTaggedBB, GoodBB, FaultBB);
   } else
     insertBBPoolCheck(Node, Length, NotPassZeroLenCheckBB, GoodBB, FaultBB);
 
@@ -901,8 +982,19 @@ llvm::InlineBBACRuntimeFunctions<T>::createBoundsCheckUIBodyFor (Function * F) {
 
   ReturnInst::Create (F->getContext(), DestPtr, GoodBB);
   insertIsSrcDstEqualCheck (Source, Dest, EntryBB, GoodBB, NotPassIsSrcDstEqualCheckBB);
+
+  //
+  // A tagged OOB source cannot be looked up in the size table; the run-time
+  // finds its object from the tag.
+  //
+  BasicBlock *LookupBB = NotPassIsSrcDstEqualCheckBB;
+  if (hasTaggedOOBPointers (*M)) {
+    LookupBB = BasicBlock::Create (Context, "source_not_tagged", F);
+    insertIsTaggedPtr (Source, NotPassIsSrcDstEqualCheckBB, LookupBB,
+                       NotPassIsPointerInBoundsBB);
+  }
   insertIsPointerInBounds (Source, Dest,
-                           NotPassIsSrcDstEqualCheckBB,
+                           LookupBB,
                            GoodBB,
                            NotPassIsPointerInBoundsBB);
 
@@ -16,6 +16,7 @@
 #define DEBUG_TYPE "inline_get_actual_value_functions"
 
 #include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/Triple.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Module.h"
@@ -147,17 +148,46 @@ llvm::InlineGetActualValue::createGetActualValueBodyFor (Function * F) {
   BasicBlock *NotPassRewrittenCheckBB = BasicBlock::Create (Context,
                                                             "not_pass_rewritten_check", F);
 
+  //
+  // On x86-64, the run-time may tag out-of-bounds pointers instead of
+  // rewriting them (see runtime/include/BBTaggedPtr.h).  The actual value of
+  // a tagged pointer is its low 48 bits.
+  //
+  BasicBlock *RangeBB = EntryBB;
+  if (Triple (F->getParent()->getTargetTriple()).getArch() == Triple::x86_64) {
+    BasicBlock *TaggedBB = BasicBlock::Create (Context, "tagged", F);
+    RangeBB = BasicBlock::Create (Context, "not_tagged", F);
+
+    ICmpInst * IsTagged = new ICmpInst (*EntryBB,
+                                        CmpInst::ICMP_SLT,
+                                        PtrInt,
+                                        ConstantInt::get (PtrInt->getType(), 0),
+                                        "is_tagged");
+    BranchInst::Create (TaggedBB, RangeBB, IsTagged, EntryBB);
+
+    Value * Address =
+      BinaryOperator::Create (Instruction::And,
+                              PtrInt,
+                              ConstantInt::get (PtrInt->getType(),
+                                                (UINT64_C(1) << 48) - 1),
+                              "address",
+                              TaggedBB);
+    Value * Actual = new IntToPtrInst (Address, Ptr->getType(), "actual",
+                                       TaggedBB);
+    ReturnInst::Create (Context, Actual, TaggedBB);
+  }
+
   GlobalVariable *GVL = F->getParent()->getGlobalVariable("_ZN8safecode12InvalidLowerE");
   GlobalVariable *GVU = F->getParent()->getGlobalVariable("_ZN8safecode12InvalidUpperE");
-  LoadInst *InvalidLowerC = new LoadInst(GVL, "il", EntryBB);
-  LoadInst *InvalidUpperC = new LoadInst(GVU, "iu", EntryBB);
+  LoadInst *InvalidLowerC = new LoadInst(GVL, "il", RangeBB);
+  LoadInst *InvalidUpperC = new LoadInst(GVU, "iu", RangeBB);
 
-  ICmpInst * Compare1 = new ICmpInst (*EntryBB,
+  ICmpInst * Compare1 = new ICmpInst (*RangeBB,
                                       CmpInst::ICMP_UGT,
                                       PtrInt,
                                       InvalidLowerC,
                                       "cmp1");
-  ICmpInst * Compare2 = new ICmpInst (*EntryBB,
+  ICmpInst * Compare2 = new ICmpInst (*RangeBB,
                                       CmpInst::ICMP_ULT,
                                       PtrInt,
                                       InvalidUpperC,
@@ -167,7 +197,7 @@ llvm::InlineGetActualValue::createGetActualValueBodyFor (Function * F) {
                                             Compare1,
                                             Compare2,
                                             "and",
-                                            EntryBB);
+                                            RangeBB);
 
   Constant *FGetActualValue =
       F->getParent()->getOrInsertFunction("__sc_bb_getActualValue",
@@ -187,7 +217,7 @@ llvm::InlineGetActualValue::createGetActualValueBodyFor (Function * F) {
 
   ReturnInst::Create (Context, CallGetActualValue, NotPassRewrittenCheckBB);
 
-  BranchInst::Create (NotPassRewrittenCheckBB, GoodBB, Compare, EntryBB);
+  BranchInst::Create (NotPassRewrittenCheckBB, GoodBB, Compare, RangeBB);
   F->setLinkage (GlobalValue::InternalLinkage);
   return true;
 }
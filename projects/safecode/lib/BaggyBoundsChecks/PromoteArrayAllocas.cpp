@@ -1,4 +1,4 @@
-//===- PromoteArrayAlloca.cpp - Promote array alloca instructions to malloc --//
+//===- PromoteArrayAlloca.cpp - Move array allocas to the secondary stack ---//
 //
 //                          The SAFECode Compiler
 //
@@ -7,8 +7,15 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// This file implements a pass that promotes array alloca instuction to malloc
-// allocations.
+// This file implements a pass that moves variable-sized array allocas to the
+// secondary stack of the baggy bounds run-time.  Baggy bounds needs every
+// object aligned to its power-of-two size; the secondary stack provides this
+// with a pointer bump instead of a heap allocation.
+//
+// Each function with such allocas saves the top of the secondary stack on
+// entry and restores it before every return and resume.  Restoring also
+// removes all objects of the frame from the size table at once, so the
+// objects are not unregistered one at a time.
 //
 //===----------------------------------------------------------------------===//
 
@@ -21,14 +28,15 @@
 #include "llvm/IR/Dominators.h"
 #include "llvm/Analysis/DominanceFrontier.h"
 #include "llvm/IR/Instruction.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/LLVMContext.h"
 
-#include <list>
+#include <map>
 
 namespace llvm {
 
 STATISTIC (promoteArrayAllocas,  "Number of converted array allocas");
-STATISTIC (missingFrees, "Number of frees that we didn't insert");
+STATISTIC (missingRestores, "Number of secondary stack frames never popped");
 
 namespace {
 static RegisterPass<PromoteArrayAllocas> paa
@@ -41,7 +49,8 @@ char PromoteArrayAllocas::ID = 0;
 // Method: createProtos()
 //
 // Description:
-//  Insert free and malloc function prototypes in a module.
+//  Insert the prototypes of the secondary stack run-time functions in a
+//  module.
 //
 // Input:
 //  M - module to be inserted
@@ -49,33 +58,56 @@ char PromoteArrayAllocas::ID = 0;
 void
 PromoteArrayAllocas::createProtos (Module & M) {
   ArrayRef<Type *> Arg (Int64Type);
-  FunctionType *mallocTy = FunctionType::get (getVoidPtrType(M), Arg, false);
-  malloc = M.getOrInsertFunction ("malloc", mallocTy);
+  FunctionType *allocTy = FunctionType::get (getVoidPtrType(M), Arg, false);
+  StackAlloc = M.getOrInsertFunction ("__sc_bb_stack_alloc", allocTy);
+
+  FunctionType *saveTy = FunctionType::get (getVoidPtrType(M), false);
+  StackSave = M.getOrInsertFunction ("__sc_bb_stack_save", saveTy);
+
+  ArrayRef<Type *> RestoreArgs (getVoidPtrType(M));
+  FunctionType *restoreTy = FunctionType::get (VoidType, RestoreArgs, false);
+  StackRestore = M.getOrInsertFunction ("__sc_bb_stack_restore", restoreTy);
+
+  assert ((StackAlloc != 0) && "No secondary stack allocator found!\n");
+  assert ((StackSave != 0) && "No secondary stack save found!\n");
+  assert ((StackRestore != 0) && "No secondary stack restore found!\n");
+}
+
+//
+// Function: isStackUnregister()
+//
+// Description:
+//  Determine whether the value is a call that unregisters the stack object A.
+//
+static bool
+isStackUnregister (Value * V, AllocaInst & A) {
+  CallInst * CI = dyn_cast<CallInst>(V);
+  if (!CI)
+    return false;
 
-  ArrayRef<Type *> FreeArgs (getVoidPtrType(M));
-  FunctionType *freeTy = FunctionType::get (Type::getVoidTy(M.getContext()), FreeArgs, false);
-  free = M.getOrInsertFunction ("free", freeTy);
+  Function * F = CI->getCalledFunction();
+  if (!F || F->getName() != "pool_unregister_stack")
+    return false;
 
-  assert ((malloc != 0) && "No malloc function found!\n");
-  assert ((free   != 0) && "No free   function found!\n");
+  return CI->getArgOperand(1)->stripPointerCasts() == &A;
 }
 
 //
 // Function: transformArrayAlloca()
 //
 // Description:
-//  Rewrite Array Allocation to Malloc.
+//  Rewrite Array Allocation to an allocation on the secondary stack.
 //
 // Input:
 //  A - Alloca Instruction to be transformed.
 //
 // Output:
-//  The transformed malloc instruction.
+//  The call allocating the memory on the secondary stack.
 //
 Instruction *
 PromoteArrayAllocas::transformArrayAlloca (AllocaInst & A) {
   Value *TypeSize = ConstantInt::get (Int64Type, TD->getTypeAllocSize (A.getAllocatedType()));
-  Instruction * MallocInsertPt = &A;
+  Instruction * AllocInsertPt = &A;
   Value *ArrayLength = A.getOperand(0);
 
   // If the type of ArrayLength is not i64, cast it to i64.
@@ -83,7 +115,7 @@ PromoteArrayAllocas::transformArrayAlloca (AllocaInst & A) {
     ArrayLength = castTo (ArrayLength,
                           Int64Type,
                           ArrayLength->getName()+".casted",
-                          MallocInsertPt);
+                          AllocInsertPt);
   }
 
   //
@@ -94,155 +126,125 @@ PromoteArrayAllocas::transformArrayAlloca (AllocaInst & A) {
                                                      TypeSize,
                                                      ArrayLength,
                                                      "actualsize",
-                                                     MallocInsertPt);
+                                                     AllocInsertPt);
+
+  // Insert the allocation
+  ArrayRef<Value *> AllocArgs (ActualSize);
+  CallInst *AllocCall = CallInst::Create (StackAlloc, AllocArgs, "", AllocInsertPt);
 
-  // Insert the malloc call
-  ArrayRef<Value *> MallocArgs (ActualSize);
-  CallInst *MallocCall = CallInst::Create (malloc, MallocArgs, "", MallocInsertPt);
+  //
+  // The object is removed from the size table when the frame is popped, so
+  // drop the calls that unregister it.
+  //
+  std::vector<Instruction *> Unregisters;
+  for (Value::user_iterator U = A.user_begin(); U != A.user_end(); ++U) {
+    if (isStackUnregister (*U, A))
+      Unregisters.push_back (cast<Instruction>(*U));
+    else if (BitCastInst * BCI = dyn_cast<BitCastInst>(*U)) {
+      for (Value::user_iterator BU = BCI->user_begin();
+           BU != BCI->user_end(); ++BU) {
+        if (isStackUnregister (*BU, A))
+          Unregisters.push_back (cast<Instruction>(*BU));
+      }
+    }
+  }
+  for (unsigned index = 0; index < Unregisters.size(); ++index)
+    Unregisters[index]->eraseFromParent();
 
-  // Cast the output of malloc to fit the original alloca type.
-  Instruction * CastedMallocCall = castTo (MallocCall,
-                                           A.getType(),
-                                           MallocCall->getName()+".casted",
-                                           MallocInsertPt);
+  // Cast the result of the allocation to fit the original alloca type.
+  Instruction * CastedAllocCall = castTo (AllocCall,
+                                          A.getType(),
+                                          AllocCall->getName()+".casted",
+                                          AllocInsertPt);
 
-  // Replace all uses of alloca with casted malloc return value.
-  A.replaceAllUsesWith (CastedMallocCall);
+  // Replace all uses of alloca with casted allocation.
+  A.replaceAllUsesWith (CastedAllocCall);
 
   promoteArrayAllocas ++;
-  return MallocCall;
+  return AllocCall;
 }
 
 //
-// Function: insertFreeBeforeLeavingFunction()
+// Function: restoreStackOnStackRestore()
 //
 // Description:
-//  Find all of the return/resume points of the function. Insert a free on each
-//  point. If LoadInstInsertion is set to true, then a load instruction is inserted
-//  to get the actual pointer.
+//  Variable-sized allocas in a nested scope are released by a call to
+//  llvm.stackrestore when the scope ends.  Save the top of the secondary
+//  stack wherever the program stack is saved and restore it along with the
+//  program stack so that objects allocated in a loop do not pile up.
 //
 // Input:
-//  Inst - The instruction to be freed
-//  LoadInstInsertion - If true, then a MallocHelper is passed as Inst, a load instruction
-//                      is inserted to get the actual address of the allocated memory. If
-//                      false, then directly pass Inst as argument of free.
-// Output:
-//  0 - No free instruction inserted
-//  1 - One or more free instruction inserted
+//  F - The function to be processed
 //
-bool
-PromoteArrayAllocas::insertFreeBeforeLeavingFunction (Instruction * Inst,
-                                                      bool LoadInstInsertion) {
-  bool isInserted = false;
-  BasicBlock *CurrentBlock = Inst->getParent();
-  Function * F = CurrentBlock->getParent();
-
-  // Iterate each basic blocks in the function, collect all free insertion points.
-  std::vector<Instruction*> FreePoints;
-  for (Function::iterator BB = F->begin(), E = F->end(); BB != E; ++BB)
-    if (isa<ReturnInst>(BB->getTerminator()) ||
-        isa<ResumeInst>(BB->getTerminator()))
-      FreePoints.push_back(BB->getTerminator());
-
-  std::vector<Instruction*>::iterator fpI = FreePoints.begin(),
-                                      fpE = FreePoints.end();
-  for (; fpI != fpE ; ++ fpI) {
-    Instruction *InsertPt = *fpI;
-    if(LoadInstInsertion)
-      //
-      // If MallocHelper is installed, then we need to insert a load instruction to
-      // get the actual free pointer.
-      //
-      Inst = new LoadInst (Inst, Inst->getName() + ".loaded", InsertPt);
-
-    ArrayRef<Value *> args(Inst);
-    CallInst::Create (free, args, "", InsertPt);
-    isInserted = true;
+void
+PromoteArrayAllocas::restoreStackOnStackRestore (Function & F) {
+  std::map<Value *, Instruction *> Marks;
+  std::vector<IntrinsicInst *> Restores;
+  for (Function::iterator BB = F.begin(); BB != F.end(); ++BB) {
+    for (BasicBlock::iterator I = BB->begin(); I != BB->end(); ++I) {
+      if (IntrinsicInst * II = dyn_cast<IntrinsicInst>(I)) {
+        if (II->getIntrinsicID() == Intrinsic::stacksave) {
+          Instruction * Mark = CallInst::Create (StackSave, "sc.stack_mark");
+          Mark->insertAfter (II);
+          Marks[II] = Mark;
+        } else if (II->getIntrinsicID() == Intrinsic::stackrestore) {
+          Restores.push_back (II);
+        }
+      }
+    }
+  }
+
+  for (unsigned index = 0; index < Restores.size(); ++index) {
+    Value * Saved = Restores[index]->getArgOperand(0)->stripPointerCasts();
+    std::map<Value *, Instruction *>::iterator Mark = Marks.find (Saved);
+    if (Mark != Marks.end()) {
+      Value * MarkValue = Mark->second;
+      CallInst::Create (StackRestore, MarkValue, "", Restores[index]);
+    }
   }
-  return isInserted;
 }
 
 //
-// Function: installMallocHelper()
+// Function: restoreStackBeforeLeavingFunction()
 //
 // Description:
-//  This function installs the malloc helper instructions to the mallocs which is not
-//  in the entry blocks. The malloc helper is the stack memory to help store the return
-//  value of a malloc call.
-//
-//  A piece of stack memory will be allocated for each of not-in-entryblock malloc calls.
-//  At the entry block, these memory are initialized to NULL pointer. Each of the stack
-//  memory will store the result of corresponding malloc return value if that malloc is
-//  called on the execution, or leave it blank if that malloc is not called. If malloc is
-//  called, then the address of malloc allocated memory must be stored, so we can load
-//  the alloca, pass the result to free and release the allocated memory. If malloc is not
-//  called, then the stored address is not modified. Since free a NULL pointer will cause no
-//  actions according to C standard, 7.20.3.2/2 from ISO-IEC 9899. We can also load the
-//  alloca, pass the NULL pointer to free and do nothing.
-//
-//  Three instructions are inserted in this function.
-//
-//  1. A alloca instruction. This will allocate the stack memory which is used to store
-//     the result of malloc.
-//  2. A store instruction. This instruction will be inserted to the very beginning of
-//     the entry block. This instruction is used to initialize the alloca to NULL pointer.
-//  3. A store instruction. This instruction will be inserted just after the malloc call.
-//     We use this instruction to store the result pointer of malloc call.
+//  Find all of the return/resume points of the function and pop the frame of
+//  the secondary stack at each of them.
 //
 // Input:
-//  MallocInst - The malloc result value to be stored.
+//  F    - The function to be processed
+//  Mark - The top of the secondary stack when the function was entered
 //
-// Output:
-//  The MallocHelper.
-//
-Instruction *
-PromoteArrayAllocas::installMallocHelper (Instruction * MallocInst) {
-  BasicBlock * CurrentBlock = MallocInst->getParent();
-  Function   * F = CurrentBlock->getParent();
-  Module     * M = CurrentBlock->getModule();
-  BasicBlock & EntryBlock = F->getEntryBlock();
-
-  AllocaInst * MallocHelper = new AllocaInst (getVoidPtrType(*M),
-                                              "mallochelper",
-                                              EntryBlock.getFirstInsertionPt());
-
-  // Initialize MallocHelper with a NULL pointer
-  Instruction * insertPt = ++EntryBlock.getFirstInsertionPt();
-  new StoreInst(ConstantPointerNull::get(getVoidPtrType(*M)),
-                MallocHelper,
-                false,
-                insertPt);
-
-  // Store the malloc return value to MallocHelper
-  (new StoreInst (MallocInst,
-                  MallocHelper,
-                  false))->insertAfter(MallocInst);
-
-  return MallocHelper;
+void
+PromoteArrayAllocas::restoreStackBeforeLeavingFunction (Function & F,
+                                                        Instruction * Mark) {
+  // Iterate each basic blocks in the function, collect all restore points.
+  std::vector<Instruction*> RestorePoints;
+  for (Function::iterator BB = F.begin(), E = F.end(); BB != E; ++BB)
+    if (isa<ReturnInst>(BB->getTerminator()) ||
+        isa<ResumeInst>(BB->getTerminator()))
+      RestorePoints.push_back(BB->getTerminator());
+
+  Value * MarkValue = Mark;
+  for (unsigned index = 0; index < RestorePoints.size(); ++index) {
+    CallInst::Create (StackRestore, MarkValue, "", RestorePoints[index]);
+  }
+
+  //
+  // A frame that is never popped here is popped by a caller, or not at all
+  // if the function never returns.
+  //
+  if (RestorePoints.empty()) missingRestores ++;
 }
 
 //
 // Method: visitAllocaInst()
 //
 // Description:
-//
-//  Visit all alloca instructions in a module. Ignore all single element allocas and allocas
-//  whose length can be determined.
-//
-//  Then for the rest of allocas, we check if it is in entry blocks.
-//
-//  For the allocas in the entry block, since entry block dominates all the blocks in the
-//  function, we simply insert a free at each return and resume instruction.
-//
-//  For the allocas which is not in the entry block,
-//  1. Insert an alloca in the entry basic block that allocates a pointer on the stack.
-//  2. Add a store instruction at the end of the entry basic block that initializes that
-//     pointer to a null pointer.
-//  3. After the new malloc call, insert a store instruction to store the return value
-//     of malloc on the stack.
-//  4. Before every ret and unwind instruction, insert code to load the pointer from
-//     the stack and free it.
-//  Step 1-3 is done by calling installMallocHelper function.
+//  Visit all alloca instructions in a function.  Ignore all single element
+//  allocas and allocas whose length can be determined; InsertBaggyBoundsChecks
+//  pads those.  Record the rest so that they can be moved to the secondary
+//  stack.
 //
 // Input:
 //  A - the alloca to be processed
@@ -253,32 +255,51 @@ PromoteArrayAllocas::visitAllocaInst(AllocaInst &A)
   if(!A.isArrayAllocation() || isa<ConstantInt>(A.getOperand(0)))
     return;
 
-  Instruction * I = transformArrayAlloca(A);
-  BasicBlock * Parent = A.getParent();
-  bool isInserted = false;
-  // Check whether current block is in entry block or not.
-  if(Parent == &Parent->getParent()->front())
-    // Current block is entry block. Insert free at each return/resume point.
-    isInserted = insertFreeBeforeLeavingFunction(I, false);
-  else
-  {
-    // Current block is not entry block. Install a Malloc Helper to this malloc.
-    Instruction * MallocReturnVal = installMallocHelper (I);
-    // Set LoadInstInsertion to true. At the return/resume point, we first insert a load
-    // instruction to get the malloc return value, then insert a free call to it.
-    isInserted = insertFreeBeforeLeavingFunction (MallocReturnVal, true);
+  ArrayAllocas.push_back (&A);
+}
+
+//
+// Method: promoteAllocas()
+//
+// Description:
+//  Move the variable-sized array allocas of the function to a frame on the
+//  secondary stack.  The frame is pushed on entry to the function and popped
+//  before every return/resume point.
+//
+// Return value:
+//  true  - The function was modified.
+//  false - The function has no variable-sized array allocas.
+//
+bool
+PromoteArrayAllocas::promoteAllocas (Function & F) {
+  ArrayAllocas.clear();
+  visit (F);
+  if (ArrayAllocas.empty())
+    return false;
+
+  BasicBlock & EntryBlock = F.getEntryBlock();
+  Instruction * Mark = CallInst::Create (StackSave,
+                                         "sc.stack_frame",
+                                         EntryBlock.getFirstInsertionPt());
+
+  for (unsigned index = 0; index < ArrayAllocas.size(); ++index) {
+    AllocaInst * A = ArrayAllocas[index];
+    transformArrayAlloca (*A);
+    A->eraseFromParent();
   }
-  if (!isInserted) missingFrees ++;
 
-  Parent->getInstList().erase(A);
+  restoreStackOnStackRestore (F);
+  restoreStackBeforeLeavingFunction (F, Mark);
+  return true;
 }
 
 //
 // Function runOnModule()
 //
 // Description:
-//  Prepare the Data Layout information. Initialize VoidType and Int64Type. Prepare the
-//  malloc/free prototype. Call the InstVisitor to promote the allocas.
+//  Prepare the Data Layout information. Initialize VoidType and Int64Type.
+//  Prepare the secondary stack prototypes.  Move the array allocas of each
+//  function.
 //
 bool
 PromoteArrayAllocas::runOnModule (Module & M) {
@@ -290,9 +311,12 @@ PromoteArrayAllocas::runOnModule (Module & M) {
   // Add protype for run-time functions.
   createProtos(M);
 
-  visit(M);
-  return true;
+  bool modified = false;
+  for (Module::iterator F = M.begin(); F != M.end(); ++F) {
+    if (!F->isDeclaration())
+      modified |= promoteAllocas (*F);
+  }
+  return modified;
 }
 
 } //end namespace llvm
-
@@ -37,6 +37,7 @@
 #include "safecode/Utility.h"
 
 #include <cstdlib>
+#include <cstring>
 #include <vector>
 
 using namespace llvm;
@@ -45,11 +46,17 @@ namespace llvm {
 
 char DebugInstrument::ID = 0;
 
+char DebugSiteTable::ID = 0;
+
 // Register the pass
 static
 RegisterPass<DebugInstrument> X ("debuginstrument",
                                  "Add Debug Data to SAFECode Run-Time Checks");
 
+static
+RegisterPass<DebugSiteTable> Y ("debugsitetable",
+                                "Pass SAFECode Debug Data as a Table Entry");
+
 static int tagCounter = 0;
 
 //
@@ -64,13 +71,36 @@ static Type * Int32Type = 0;
 ///////////////////////////////////////////////////////////////////////////
 
 namespace {
+  cl::opt<bool> EnableSiteTable ("sc-debug-site-table",
+                                 cl::desc("Pass a source location table entry "
+                                          "to run-time checks instead of a "
+                                          "tag, file name, and line number"),
+                                 cl::init(false));
+
   ///////////////////////////////////////////////////////////////////////////
   // Pass Statistics
   ///////////////////////////////////////////////////////////////////////////
   STATISTIC (FoundSrcInfo,   "Number of Source Information Locations Found");
   STATISTIC (QueriedSrcInfo, "Number of Source Information Locations Queried");
+  STATISTIC (SiteTableCalls, "Number of checks passed a site table entry");
+  STATISTIC (SiteTableSize,  "Number of entries in the site table");
+  STATISTIC (SiteTableArgs,  "Number of call arguments removed by the site table");
 }
 
+//
+// The run-time checks whose debug versions have a site table version.  The
+// run-time library must provide "<name>_site" for each of them.
+//
+static const char * SiteCheckNames[] = {
+  "poolcheck", "poolcheckui", "poolcheckalign",
+  "boundscheck", "boundscheckui",
+  "exactcheck2", "fastlscheck",
+  "funccheck", "funccheckui",
+  "poolcheck_free", "poolcheck_freeui",
+  "poolcheckstr", "poolcheckstrui",
+  0
+};
+
 ///////////////////////////////////////////////////////////////////////////
 // Static Functions
 ///////////////////////////////////////////////////////////////////////////
@@ -529,5 +559,159 @@ DebugInstrument::runOnModule (Module &M) {
   return true;
 }
 
+//
+// Method: collectCalls()
+//
+// Description:
+//  Find the calls to the specified debug version of a run-time check whose
+//  debug arguments are all constants, and give each distinct location an
+//  entry in the site table.
+//
+// Inputs:
+//  F - The debug version of a run-time check.  This *can* be NULL.
+//
+void
+DebugSiteTable::collectCalls (Function * F) {
+  //
+  // Only external run-time functions are rewritten.  Checks which have been
+  // given a body (e.g., to be inlined) keep their debug arguments.
+  //
+  if (!F || !F->isDeclaration() || F->isVarArg())
+    return;
+  if (F->getFunctionType()->getNumParams() < 3)
+    return;
+
+  for (Function::user_iterator i = F->user_begin(), e = F->user_end();
+       i != e; ++i) {
+    CallInst * CI = dyn_cast<CallInst>(*i);
+    if (!CI || CI->getCalledFunction() != F)
+      continue;
+
+    unsigned NumArgs = CI->getNumArgOperands();
+    Constant * Tag  = dyn_cast<ConstantInt>(CI->getArgOperand (NumArgs - 3));
+    Constant * File = dyn_cast<Constant>(CI->getArgOperand (NumArgs - 2));
+    Constant * Line = dyn_cast<ConstantInt>(CI->getArgOperand (NumArgs - 1));
+    if (!Tag || !File || !Line)
+      continue;
+
+    std::pair<Constant *, std::pair<Constant *, Constant *> >
+      Key (Tag, std::make_pair (File, Line));
+    std::map<std::pair<Constant *, std::pair<Constant *, Constant *> >,
+             unsigned>::iterator It = SiteMap.find (Key);
+    unsigned Index;
+    if (It != SiteMap.end()) {
+      Index = It->second;
+    } else {
+      Constant * Fields[] = {
+        Tag,
+        Line,
+        ConstantExpr::getPointerCast (File, VoidPtrTy)
+      };
+      Index = Sites.size();
+      Sites.push_back (ConstantStruct::get (SiteTy, Fields));
+      SiteMap[Key] = Index;
+    }
+    SiteCalls.push_back (std::make_pair (CI, Index));
+  }
 }
 
+//
+// Method: rewriteCalls()
+//
+// Description:
+//  Replace each collected call to "<name>_debug" with a call to
+//  "<name>_site" that passes a pointer to its entry in the site table.
+//
+void
+DebugSiteTable::rewriteCalls (Module & M, GlobalVariable * Table) {
+  Type * Int64Type = IntegerType::getInt64Ty (M.getContext());
+  PointerType * SitePtrTy = PointerType::getUnqual (SiteTy);
+
+  for (unsigned index = 0; index < SiteCalls.size(); ++index) {
+    CallInst * CI = SiteCalls[index].first;
+    Function * F = CI->getCalledFunction();
+
+    //
+    // The site version takes the same arguments as the original check
+    // followed by the table entry.
+    //
+    FunctionType * FuncType = F->getFunctionType();
+    std::vector<Type *> ParamTypes (FuncType->param_begin(),
+                                    FuncType->param_end() - 3);
+    ParamTypes.push_back (SitePtrTy);
+    FunctionType * SiteFuncType = FunctionType::get (FuncType->getReturnType(),
+                                                     ParamTypes,
+                                                     false);
+    StringRef Name = F->getName();
+    std::string SiteName = Name.drop_back (strlen ("_debug")).str() + "_site";
+    Constant * FSite = M.getOrInsertFunction (SiteName, SiteFuncType);
+
+    Constant * Idx[] = {
+      ConstantInt::get (Int64Type, 0),
+      ConstantInt::get (Int64Type, SiteCalls[index].second)
+    };
+    Constant * Entry = ConstantExpr::getInBoundsGetElementPtr (
+        Table->getType()->getElementType(), Table, Idx);
+
+    std::vector<Value *> args (CI->arg_operands().begin(),
+                               CI->arg_operands().end() - 3);
+    args.push_back (Entry);
+    CallInst * NewCall = CallInst::Create (FSite, args, CI->getName(), CI);
+    NewCall->setDebugLoc (CI->getDebugLoc());
+    CI->replaceAllUsesWith (NewCall);
+    CI->eraseFromParent();
+
+    ++SiteTableCalls;
+    SiteTableArgs += 2;
+  }
+}
+
+//
+// Method: runOnModule()
+//
+// Description:
+//  This is where the pass begin execution.
+//
+// Return value:
+//  true  - The module was modified.
+//  false - The module was left unmodified.
+//
+bool
+DebugSiteTable::runOnModule (Module &M) {
+  if (!EnableSiteTable)
+    return false;
+
+  VoidPtrTy = getVoidPtrType(M);
+  Int32Type = IntegerType::getInt32Ty(M.getContext());
+  Type * Fields[] = { Int32Type, Int32Type, VoidPtrTy };
+  SiteTy = StructType::get (M.getContext(), Fields);
+
+  Sites.clear();
+  SiteCalls.clear();
+  SiteMap.clear();
+
+  for (unsigned index = 0; SiteCheckNames[index]; ++index) {
+    std::string Name = std::string (SiteCheckNames[index]) + "_debug";
+    collectCalls (M.getFunction (Name));
+  }
+
+  if (Sites.empty())
+    return false;
+
+  //
+  // Create the read-only table of source locations and point the calls at it.
+  //
+  ArrayType * TableTy = ArrayType::get (SiteTy, Sites.size());
+  GlobalVariable * Table = new GlobalVariable (M,
+                                               TableTy,
+                                               true,
+                                               GlobalValue::InternalLinkage,
+                                               ConstantArray::get (TableTy,
+                                                                   Sites),
+                                               "__sc_debug_sites");
+  SiteTableSize += Sites.size();
+  rewriteCalls (M, Table);
+  return true;
+}
+
+}
@@ -10,14 +10,22 @@
 // This file implements a pass to insert calls to runtime wrapper functions for
 // printf(), scanf(), and related format string functions.
 //
+// Calls to printf() style functions with constant format strings are instead
+// checked at compile time: the pass parses the format string, emits only the
+// run-time checks that its conversions need, and leaves the call to the real
+// library function in place.  The run-time wrappers remain the fallback for
+// calls the pass cannot check this way.
+//
 //===----------------------------------------------------------------------===//
 
 #define DEBUG_TYPE "formatstrings"
 
 #include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/CallSite.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/CommandLine.h"
 
 #include "safecode/FormatStrings.h"
 #include "safecode/Utility.h"
@@ -62,6 +70,233 @@ ADD_STATISTIC_FOR(__isoc99_scanf);
 ADD_STATISTIC_FOR(__isoc99_fscanf);
 ADD_STATISTIC_FOR(__isoc99_sscanf);
 
+STATISTIC(stat_specialized,
+          "Number of calls with constant formats checked at compile time");
+
+namespace
+{
+  cl::opt<bool> SpecializeFormatStrings("sc-specialize-format-strings",
+    cl::Hidden,
+    cl::init(true),
+    cl::desc("Check calls with constant format strings at compile time"));
+
+  // The kinds of arguments consumed by a printf() conversion
+  enum FormatArgKind
+  {
+    IntegerArg,
+    FloatArg,
+    PointerArg,
+    // A pointer to a string which must be terminated (%s)
+    StringArg,
+    // A pointer to the integer that receives the output length (%n)
+    WrittenArg
+  };
+
+  struct FormatArg
+  {
+    FormatArgKind kind;
+    // The size of the integer written through a WrittenArg
+    unsigned size;
+
+    FormatArg(FormatArgKind k, unsigned s = 0) : kind(k), size(s) { }
+  };
+}
+
+//
+// Function: parseFormatString()
+//
+// Description:
+//  Parse a printf() style format string.
+//
+// Inputs:
+//  fmt     - The format string.
+//  ptrSize - The size of a pointer (and of long and size_t) on the target.
+//
+// Outputs:
+//  args    - The arguments that the conversions of the format string consume,
+//            in order.
+//  exact   - Set to true if the length of the output does not depend on the
+//            arguments.
+//  length  - The length of the output if exact is true.
+//
+// Return value:
+//  true  - The format string was parsed.
+//  false - The format string uses features (positional arguments, wide
+//          strings, precision-limited strings, unknown conversions) that only
+//          the run-time wrappers handle.
+//
+static bool
+parseFormatString(StringRef fmt,
+                  unsigned ptrSize,
+                  vector<FormatArg> &args,
+                  bool &exact,
+                  uint64_t &length)
+{
+  exact = true;
+  length = 0;
+
+  size_t i = 0, end = fmt.size();
+  while (i < end)
+  {
+    if (fmt[i] != '%')
+    {
+      ++length;
+      ++i;
+      continue;
+    }
+    ++i;
+
+    //
+    // A conversion without flags, width, precision, or length modifier has
+    // an output of known length for %% and %c.
+    //
+    bool plain = true;
+
+    while (i < end && StringRef("-+ #0'I").find(fmt[i]) != StringRef::npos)
+    {
+      plain = false;
+      ++i;
+    }
+
+    //
+    // Parse the field width.  Digits followed by a '$' select a positional
+    // argument.
+    //
+    if (i < end && fmt[i] == '*')
+    {
+      plain = false;
+      args.push_back(FormatArg(IntegerArg));
+      ++i;
+      if (i < end && isdigit(fmt[i]))
+        return false;
+    }
+    else
+    {
+      while (i < end && isdigit(fmt[i]))
+      {
+        plain = false;
+        ++i;
+      }
+      if (i < end && fmt[i] == '$')
+        return false;
+    }
+
+    bool hasPrecision = false;
+    if (i < end && fmt[i] == '.')
+    {
+      plain = false;
+      hasPrecision = true;
+      ++i;
+      if (i < end && fmt[i] == '*')
+      {
+        args.push_back(FormatArg(IntegerArg));
+        ++i;
+        if (i < end && isdigit(fmt[i]))
+          return false;
+      }
+      else
+      {
+        while (i < end && isdigit(fmt[i]))
+          ++i;
+      }
+    }
+
+    //
+    // Parse the length modifier, recording the size of the integer it
+    // selects for %n.
+    //
+    unsigned size = 4;
+    bool isLong = false;
+    if (i < end && StringRef("hlqLjzZt").find(fmt[i]) != StringRef::npos)
+    {
+      plain = false;
+      switch (fmt[i])
+      {
+        case 'h':
+          size = 2;
+          if (i + 1 < end && fmt[i + 1] == 'h')
+          {
+            size = 1;
+            ++i;
+          }
+          break;
+        case 'l':
+          size = ptrSize;
+          isLong = true;
+          if (i + 1 < end && fmt[i + 1] == 'l')
+          {
+            size = 8;
+            isLong = false;
+            ++i;
+          }
+          break;
+        case 'z':
+        case 'Z':
+        case 't':
+          size = ptrSize;
+          break;
+        default:
+          size = 8;
+          break;
+      }
+      ++i;
+    }
+
+    if (i == end)
+      return false;
+
+    switch (fmt[i++])
+    {
+      case '%':
+        if (plain)
+          ++length;
+        else
+          exact = false;
+        break;
+      case 'c':
+        args.push_back(FormatArg(IntegerArg));
+        if (plain)
+          ++length;
+        else
+          exact = false;
+        break;
+      case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+        args.push_back(FormatArg(IntegerArg));
+        exact = false;
+        break;
+      case 'e': case 'E': case 'f': case 'F':
+      case 'g': case 'G': case 'a': case 'A':
+        args.push_back(FormatArg(FloatArg));
+        exact = false;
+        break;
+      case 'p':
+        args.push_back(FormatArg(PointerArg));
+        exact = false;
+        break;
+      case 's':
+        //
+        // A string printed with a precision need not be terminated, and wide
+        // strings are terminated by a wide null character.
+        //
+        if (hasPrecision || isLong)
+          return false;
+        args.push_back(FormatArg(StringArg));
+        exact = false;
+        break;
+      case 'n':
+        args.push_back(FormatArg(WrittenArg, size));
+        break;
+      case 'm':
+        exact = false;
+        break;
+      default:
+        return false;
+    }
+  }
+
+  return true;
+}
+
 char FormatStringTransform::ID = 0;
 
 
@@ -102,51 +337,65 @@ FormatStringTransform::runOnModule(Module &M)
   PointerInfoType = makePointerInfoType(M.getContext());
 
   FSCallInfo = FSParameter = 0;
+  PoolCheckUI = PoolCheckStrUI = 0;
 
   bool changed = false;
 
-  struct FormatStringFuncEntry
+  FormatStringFuncEntry Entries[] =
   {
-    const char *name;
-    unsigned fargc;
-    Statistic *stat;
-    const char *replacement;
-  } Entries[] =
-  {
-    { "printf",          1, &stat_printf,          "pool_printf"              },
-    { "fprintf",         2, &stat_fprintf,         "pool_fprintf"             },
-    { "sprintf",         2, &stat_sprintf,         "pool_sprintf"             },
-    { "snprintf",        3, &stat_snprintf,        "pool_snprintf"            },
-    { "err",             2, &stat_err,             "pool_err"                 },
-    { "errx",            2, &stat_errx,            "pool_errx"                },
-    { "warn",            1, &stat_warn,            "pool_warn"                },
-    { "warnx",           1, &stat_warnx,           "pool_warnx"               },
-    { "syslog",          2, &stat_syslog,          "pool_syslog"              },
-    { "scanf",           1, &stat_scanf,           "pool_scanf"               },
-    { "fscanf",          2, &stat_fscanf,          "pool_fscanf"              },
-    { "sscanf",          2, &stat_sscanf,          "pool_sscanf"              },
+    { "printf",          1, &stat_printf,          "pool_printf",
+      PrintFunc,         -1 },
+    { "fprintf",         2, &stat_fprintf,         "pool_fprintf",
+      PrintFunc,         -1 },
+    { "sprintf",         2, &stat_sprintf,         "pool_sprintf",
+      PrintToBufferFunc, -1 },
+    { "snprintf",        3, &stat_snprintf,        "pool_snprintf",
+      PrintToBufferFunc,  1 },
+    { "err",             2, &stat_err,             "pool_err",
+      PrintFunc,         -1 },
+    { "errx",            2, &stat_errx,            "pool_errx",
+      PrintFunc,         -1 },
+    { "warn",            1, &stat_warn,            "pool_warn",
+      PrintFunc,         -1 },
+    { "warnx",           1, &stat_warnx,           "pool_warnx",
+      PrintFunc,         -1 },
+    { "syslog",          2, &stat_syslog,          "pool_syslog",
+      PrintFunc,         -1 },
+    { "scanf",           1, &stat_scanf,           "pool_scanf",
+      ScanFunc,          -1 },
+    { "fscanf",          2, &stat_fscanf,          "pool_fscanf",
+      ScanFunc,          -1 },
+    { "sscanf",          2, &stat_sscanf,          "pool_sscanf",
+      ScanFunc,          -1 },
     //
     // The __printf_chk() family is like printf(), but it attempts to make sure
     // the stack isn't accessed improperly. The SAFECode runtime also does this
     // (and more) so we can transform calls to this function.
     //
-    { "__printf_chk",    2, &stat___printf_chk,    "pool___printf_chk"        },
-    { "__fprintf_chk",   3, &stat___fprintf_chk,   "pool___fprintf_chk"       },
-    { "__sprintf_chk",   4, &stat___sprintf_chk,   "pool___sprintf_chk"       },
-    { "__snprintf_chk",  5, &stat___snprintf_chk,  "pool___snprintf_chk"      },
+    { "__printf_chk",    2, &stat___printf_chk,    "pool___printf_chk",
+      PrintFunc,         -1 },
+    { "__fprintf_chk",   3, &stat___fprintf_chk,   "pool___fprintf_chk",
+      PrintFunc,         -1 },
+    { "__sprintf_chk",   4, &stat___sprintf_chk,   "pool___sprintf_chk",
+      PrintToBufferFunc, -1 },
+    { "__snprintf_chk",  5, &stat___snprintf_chk,  "pool___snprintf_chk",
+      PrintToBufferFunc,  1 },
     //
     // The __isoc99_scanf() family is found in glibc and is like scanf() without
     // GNU extensions, which is the same functionality as the SAFECode version.
     //
-    { "__isoc99_scanf",  1, &stat___isoc99_scanf,  "pool_scanf"               },
-    { "__isoc99_fscanf", 2, &stat___isoc99_fscanf, "pool_fscanf"              },
-    { "__isoc99_sscanf", 2, &stat___isoc99_sscanf, "pool_sscanf"              }
+    { "__isoc99_scanf",  1, &stat___isoc99_scanf,  "pool_scanf",
+      ScanFunc,          -1 },
+    { "__isoc99_fscanf", 2, &stat___isoc99_fscanf, "pool_fscanf",
+      ScanFunc,          -1 },
+    { "__isoc99_sscanf", 2, &stat___isoc99_sscanf, "pool_sscanf",
+      ScanFunc,          -1 }
   };
 
   for (size_t i = 0; i < sizeof(Entries) / sizeof(FormatStringFuncEntry); i++)
   {
     FormatStringFuncEntry &e = Entries[i];
-    changed |= transform(M, e.name, e.fargc, e.replacement, *e.stat);
+    changed |= transform(M, e);
   }
 
   //
@@ -218,25 +467,26 @@ FormatStringTransform::addFormatStringIntrinsics(Module &M)
 // be wrapped around a pointer_info structure. The space for the call_info
 // and pointer_info structures is allocated on the stack.
 //
+// Calls with constant format strings that specializeCall() can check are left
+// in place instead.
+//
 // Inputs:
-//  M           - a reference to the current Module
-//  name        - the name of the function to transform
-//  argc        - the number of (fixed) arguments to the function
-//  replacement - the name of the resulting function
-//  stat        - a statistic pertaining to the number of transfomations
-//                that have been performed
+//  M     - a reference to the current Module
+//  entry - the function to transform: its name, the number of (fixed)
+//          arguments it takes, the name of the resulting function, and a
+//          statistic pertaining to the number of transformations that have
+//          been performed
 //
 // Returns:
 //  This function returns true if the module was modified, false otherwise.
 //
 bool
-FormatStringTransform::transform(Module &M,
-                                 const char *name,
-                                 unsigned argc,
-                                 const char *replacement,
-                                 Statistic &stat)
+FormatStringTransform::transform(Module &M, const FormatStringFuncEntry &entry)
 {
-  Function *f = M.getFunction(name);
+  const char *replacement = entry.replacement;
+  Statistic &stat = *entry.stat;
+
+  Function *f = M.getFunction(entry.name);
   if (f == 0)
     return false;
 
@@ -244,10 +494,10 @@ FormatStringTransform::transform(Module &M,
   // Ensure the function is of the expected type. If not, skip over it.
   //
   FunctionType *fType = f->getFunctionType();
-  if (!fType->isVarArg() || fType->getNumParams() != argc)
+  if (!fType->isVarArg() || fType->getNumParams() != entry.fargc)
     return false;
 
-  vector<CallSite> Calls;
+  vector<CallSite> Found;
 
   //
   // Locate all the instructions which call the named function.
@@ -257,11 +507,29 @@ FormatStringTransform::transform(Module &M,
     CallSite C(*i);
     if (!C || C.getCalledFunction() != f)
       continue;
-    Calls.push_back(C);
+    Found.push_back(C);
+  }
+
+  //
+  // Check the calls with constant format strings in place; the others are
+  // transformed into calls to the run-time wrapper.
+  //
+  bool specialized = false;
+  vector<CallSite> Calls;
+  for (vector<CallSite>::iterator i = Found.begin(); i != Found.end(); ++i)
+  {
+    if (SpecializeFormatStrings && specializeCall(*i, entry))
+    {
+      specialized = true;
+      ++stat_specialized;
+      ++stat;
+    }
+    else
+      Calls.push_back(*i);
   }
 
   if (Calls.empty())
-    return false;
+    return specialized;
 
   FunctionType *rType = xfrmFType(fType, f->getContext());
 #ifndef NDEBUG
@@ -311,6 +579,167 @@ FormatStringTransform::transform(Module &M,
   return true;
 }
 
+//
+// Method: specializeCall()
+//
+// Description:
+//  Check a call to a printf() style function with a constant format string
+//  without using the run-time wrapper.  The format string is parsed here, and
+//  run-time checks are inserted before the call for only those arguments that
+//  the conversions access through pointers:
+//
+//   - strings printed with %s must be terminated within their objects;
+//   - the integers written by %n must fit within their objects;
+//   - the output buffer of sprintf() style functions must hold the output.
+//
+//  The output buffer is only checked when the length of the output does not
+//  depend on the arguments, as a check using the maximum length would reject
+//  correct programs.  Calls whose format strings cannot be fully analyzed are
+//  left to the run-time wrapper.
+//
+// Inputs:
+//  call  - The call to the format string function.
+//  entry - The format string function that is called.
+//
+// Return value:
+//  true  - The call was checked and should be left in place.
+//  false - The call was not modified and must be transformed.
+//
+bool
+FormatStringTransform::specializeCall(CallSite &call,
+                                      const FormatStringFuncEntry &entry)
+{
+  if (entry.kind == ScanFunc)
+    return false;
+
+  StringRef fmt;
+  if (!getConstantStringInfo(call.getArgument(entry.fargc - 1), fmt))
+    return false;
+
+  Instruction *I = call.getInstruction();
+  Module &M = *(I->getParent()->getParent()->getParent());
+  const DataLayout &DL = M.getDataLayout();
+
+  vector<FormatArg> fmtArgs;
+  bool exact;
+  uint64_t length;
+  if (!parseFormatString(fmt, DL.getPointerSize(), fmtArgs, exact, length))
+    return false;
+
+  //
+  // Leave calls with missing or mismatched arguments to the run-time wrapper,
+  // which reports them.
+  //
+  if (call.arg_size() < entry.fargc + fmtArgs.size())
+    return false;
+
+  for (unsigned index = 0; index < fmtArgs.size(); ++index)
+  {
+    Type *argType = call.getArgument(entry.fargc + index)->getType();
+    switch (fmtArgs[index].kind)
+    {
+      case IntegerArg:
+        if (!argType->isIntegerTy())
+          return false;
+        break;
+      case FloatArg:
+        if (!argType->isFloatingPointTy())
+          return false;
+        break;
+      default:
+        if (!argType->isPointerTy())
+          return false;
+        break;
+    }
+  }
+
+  //
+  // Determine how much of the output buffer is written: the whole output and
+  // its terminator, up to the size given to snprintf() style functions.
+  //
+  uint64_t bufferSize = 0;
+  if (entry.kind == PrintToBufferFunc)
+  {
+    if (!exact)
+      return false;
+    bufferSize = length + 1;
+    if (entry.sizeArg >= 0)
+    {
+      ConstantInt *n = dyn_cast<ConstantInt>(call.getArgument(entry.sizeArg));
+      if (n == 0)
+        return false;
+      bufferSize = std::min(bufferSize, n->getZExtValue());
+    }
+    if (bufferSize > UINT32_MAX)
+      return false;
+  }
+
+  //
+  // Declare the run-time checks.
+  //
+  LLVMContext &ctx = M.getContext();
+  Type *VoidTy    = Type::getVoidTy(ctx);
+  Type *Int32Ty   = Type::getInt32Ty(ctx);
+  Type *VoidPtrTy = Type::getInt8PtrTy(ctx);
+  if (PoolCheckUI == 0)
+  {
+    Type *ArgTys[] = { VoidPtrTy, VoidPtrTy, Int32Ty };
+    PoolCheckUI =
+      M.getOrInsertFunction("poolcheckui",
+                            FunctionType::get(VoidTy, ArgTys, false));
+  }
+  if (PoolCheckStrUI == 0)
+  {
+    Type *ArgTys[] = { VoidPtrTy, VoidPtrTy };
+    PoolCheckStrUI =
+      M.getOrInsertFunction("poolcheckstrui",
+                            FunctionType::get(VoidPtrTy, ArgTys, false));
+  }
+
+  //
+  // Insert the checks before the call.
+  //
+  IRBuilder<> Builder(I);
+  Value *NullPool = ConstantPointerNull::get(cast<PointerType>(VoidPtrTy));
+  vector<CallInst *> Checks;
+
+  if (bufferSize)
+  {
+    Value *Dest = Builder.CreateBitCast(call.getArgument(0), VoidPtrTy);
+    Value *Args[] = { NullPool, Dest, Builder.getInt32(bufferSize) };
+    Checks.push_back(Builder.CreateCall(PoolCheckUI, Args));
+  }
+
+  for (unsigned index = 0; index < fmtArgs.size(); ++index)
+  {
+    const FormatArg &arg = fmtArgs[index];
+    if (arg.kind != StringArg && arg.kind != WrittenArg)
+      continue;
+
+    Value *Ptr = call.getArgument(entry.fargc + index);
+    Ptr = Builder.CreateBitCast(Ptr, VoidPtrTy);
+    if (arg.kind == StringArg)
+    {
+      Value *Args[] = { NullPool, Ptr };
+      Checks.push_back(Builder.CreateCall(PoolCheckStrUI, Args));
+    }
+    else
+    {
+      Value *Args[] = { NullPool, Ptr, Builder.getInt32(arg.size) };
+      Checks.push_back(Builder.CreateCall(PoolCheckUI, Args));
+    }
+  }
+
+  //
+  // Add to the checks any debugging metadata that the call has.
+  //
+  if (MDNode *DebugNode = I->getMetadata("dbg"))
+    for (unsigned index = 0; index < Checks.size(); ++index)
+      Checks[index]->setMetadata("dbg", DebugNode);
+
+  return true;
+}
+
 //
 // Goes over all the arrays that were allocated as helpers to the intrinsics
 // and makes them the proper size.
@@ -21,8 +21,13 @@
 
 #include "llvm/ADT/Statistic.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
 
+#include <set>
 #include <stdint.h>
 
 namespace llvm {
@@ -35,6 +40,18 @@ X ("compchecks", "Make run-time checks complete");
 // Pass Statistics
 namespace {
   STATISTIC (CompLSChecks, "Complete Load/Store Checks");
+  STATISTIC (InlineCFIChecks, "Indirect Call Checks Compared Inline");
+  STATISTIC (HashedCFIChecks, "Indirect Call Checks Using Hashed Target Sets");
+}
+
+// Command line options
+namespace {
+  cl::opt<unsigned>
+  CFIInlineLimit ("sc-cfi-inline-limit",
+                  cl::desc("Compare the targets of indirect calls with at most "
+                           "this many targets inline; calls with more targets "
+                           "use a hashed target set"),
+                  cl::init(4));
 }
 
 //
@@ -556,63 +573,232 @@ CompleteChecks::fixupCFIChecks (Module & M, std::string name) {
   if (!FuncCheck) return;
 
   //
-  // Scan through all uses of the funccheck() function.
+  // Find all of the calls to the funccheck() function first; some of them are
+  // replaced by calls to other run-time checks below.
   //
-  PointerType * VoidPtrType = getVoidPtrType(M.getContext());
+  std::vector<CallInst *> Checks;
   Value::user_iterator UI = FuncCheck->user_begin();
   Value::user_iterator  E = FuncCheck->user_end();
   for (; UI != E; ++UI) {
     if (CallInst * CI = dyn_cast<CallInst>(*UI)) {
       if (CI->getCalledValue()->stripPointerCasts() == FuncCheck) {
-        //
-        // Get the call instruction following this call instruction.
-        //
-        BasicBlock::iterator I = CI;
-        CallInst * ICI;
-        do {
-          ++I;
-          assert (!isa<TerminatorInst>(I));
-        } while ((ICI = dyn_cast<CallInst>(I)) == 0);
+        Checks.push_back (CI);
+      }
+    }
+  }
 
-        //
-        // Get the list of potential function targets.  Note that we have to
-        // do some silly things to get rid of the "const"-ness of the functions
-        // that we find.
-        //
-        //
-        std::vector<const Function *> Targets;
-        getFunctionTargets (ICI, Targets);
-        std::vector<Constant *> GoodTargets;
-        for (unsigned index = 0; index < Targets.size(); ++index) {
-          Constant * C = M.getFunction (Targets[index]->getName());
-          GoodTargets.push_back(ConstantExpr::getZExtOrBitCast(C, VoidPtrType));
-        }
-        GoodTargets.push_back (ConstantPointerNull::get (VoidPtrType));
+  PointerType * VoidPtrType = getVoidPtrType(M.getContext());
+  for (unsigned index = 0; index < Checks.size(); ++index) {
+    CallInst * CI = Checks[index];
 
-        //
-        // Create a new global variable containing the list of targets.
-        //
-        ArrayType * AT = ArrayType::get (VoidPtrType, GoodTargets.size());
-        Constant * TargetArray = ConstantArray::get (AT, GoodTargets);
-        Value * NewTable = new GlobalVariable (M,
-                                               AT,
-                                               true,
-                                               GlobalValue::InternalLinkage,
-                                               TargetArray,
-                                               "TargetList");
+    //
+    // Get the call instruction following this call instruction.
+    //
+    BasicBlock::iterator I = CI;
+    CallInst * ICI;
+    do {
+      ++I;
+      assert (!isa<TerminatorInst>(I));
+    } while ((ICI = dyn_cast<CallInst>(I)) == 0);
 
-        //
-        // Install the new target list into the check.
-        //
-        NewTable = castTo (NewTable, VoidPtrType, ICI);
-        CI->setArgOperand (1, NewTable);
-      }
+    //
+    // Get the list of potential function targets.  Note that we have to
+    // do some silly things to get rid of the "const"-ness of the functions
+    // that we find.  A function may be found more than once; each target is
+    // placed into the list only once.
+    //
+    std::vector<const Function *> Targets;
+    getFunctionTargets (ICI, Targets);
+    std::set<const Function *> Seen;
+    std::vector<Constant *> GoodTargets;
+    for (unsigned t = 0; t < Targets.size(); ++t) {
+      if (!Seen.insert (Targets[t]).second)
+        continue;
+      Constant * C = M.getFunction (Targets[t]->getName());
+      GoodTargets.push_back(ConstantExpr::getZExtOrBitCast(C, VoidPtrType));
+    }
+    unsigned NumTargets = GoodTargets.size();
+    GoodTargets.push_back (ConstantPointerNull::get (VoidPtrType));
+
+    //
+    // Create a new global variable containing the list of targets.
+    //
+    ArrayType * AT = ArrayType::get (VoidPtrType, GoodTargets.size());
+    Constant * TargetArray = ConstantArray::get (AT, GoodTargets);
+    GlobalVariable * Table = new GlobalVariable (M,
+                                                 AT,
+                                                 true,
+                                                 GlobalValue::InternalLinkage,
+                                                 TargetArray,
+                                                 "TargetList");
+
+    //
+    // Pick the cheapest way of checking the call for the number of targets it
+    // has.  Calls with a few targets compare against them inline; all others
+    // get a hashed set so that no check scans a list.  The list of targets
+    // stays in the set so that a failing check can still report it.
+    //
+    if (NumTargets > CFIInlineLimit) {
+      useTargetSet (M, CI, Table, NumTargets);
+      continue;
+    }
+
+    //
+    // Install the new target list into the check.  A call without any known
+    // target keeps calling funccheck(), which reports every call it checks.
+    //
+    Value * NewTable = castTo (Table, VoidPtrType, ICI);
+    CI->setArgOperand (1, NewTable);
+
+    if (NumTargets > 0) {
+      GoodTargets.pop_back();
+      inlineTargetCompares (CI, GoodTargets);
     }
   }
 
   return;
 }
 
+//
+// Method: inlineTargetCompares()
+//
+// Description:
+//  Compare the function pointer checked by the specified funccheck() call
+//  against each of its targets inline.  The call to funccheck() is moved into
+//  a block that only executes if none of the targets match so that it only
+//  runs to report the failure.
+//
+void
+CompleteChecks::inlineTargetCompares (CallInst * CI,
+                                      const std::vector<Constant *> & Targets) {
+  Value * F = CI->getArgOperand (0);
+  Value * Match = 0;
+  for (unsigned index = 0; index < Targets.size(); ++index) {
+    Value * Equal = new ICmpInst (CI,
+                                  ICmpInst::ICMP_EQ,
+                                  F,
+                                  Targets[index],
+                                  "cfi.match");
+    Match = Match ? BinaryOperator::CreateOr (Match, Equal, "cfi.match", CI)
+                  : Equal;
+  }
+
+  Value * Mismatch = BinaryOperator::CreateNot (Match, "cfi.mismatch", CI);
+  MDBuilder MDB (CI->getContext());
+  TerminatorInst * Fail = SplitBlockAndInsertIfThen (
+    Mismatch, CI, false, MDB.createBranchWeights (1, 1 << 20));
+  CI->moveBefore (Fail);
+  ++InlineCFIChecks;
+  return;
+}
+
+//
+// Method: useTargetSet()
+//
+// Description:
+//  Replace the specified funccheck() call with a call that looks the function
+//  pointer up in a hashed set of its targets.  The slots of the set are
+//  filled at program start-up by initTargetSets(); the layout of the set must
+//  match struct FuncTargetSet in the run-time.
+//
+void
+CompleteChecks::useTargetSet (Module & M,
+                              CallInst * CI,
+                              GlobalVariable * Table,
+                              unsigned NumTargets) {
+  LLVMContext & Context = M.getContext();
+  const DataLayout & DL = M.getDataLayout();
+  Type * IntPtrTy = DL.getIntPtrType (Context);
+  PointerType * VoidPtrType = getVoidPtrType (Context);
+  PointerType * VoidPtrPtrType = PointerType::getUnqual (VoidPtrType);
+
+  //
+  // Keep the load factor at or below one half so that lookups stay short.
+  //
+  uint64_t NumSlots = NextPowerOf2 (2 * NumTargets - 1);
+  ArrayType * SlotsTy = ArrayType::get (VoidPtrType, NumSlots);
+  GlobalVariable * Slots = new GlobalVariable (M,
+                                               SlotsTy,
+                                               false,
+                                               GlobalValue::InternalLinkage,
+                                               ConstantAggregateZero::get (SlotsTy),
+                                               "TargetSlots");
+
+  StructType * SetTy = StructType::get (IntPtrTy,
+                                        VoidPtrPtrType,
+                                        IntPtrTy,
+                                        VoidPtrPtrType,
+                                        IntPtrTy,
+                                        NULL);
+  Constant * Fields[] = {
+    ConstantInt::get (IntPtrTy, NumSlots - 1),
+    ConstantExpr::getPointerCast (Slots, VoidPtrPtrType),
+    ConstantInt::get (IntPtrTy, NumTargets),
+    ConstantExpr::getPointerCast (Table, VoidPtrPtrType),
+    ConstantInt::get (IntPtrTy, 0)
+  };
+  GlobalVariable * Set = new GlobalVariable (M,
+                                             SetTy,
+                                             false,
+                                             GlobalValue::InternalLinkage,
+                                             ConstantStruct::get (SetTy, Fields),
+                                             "TargetSet");
+  TargetSets.push_back (Set);
+
+  //
+  // Call the hashed version of the check.  It takes the same arguments as
+  // the check it replaces with the set in place of the list of targets.
+  //
+  Function * FuncCheck = CI->getCalledFunction();
+  std::string HashedName = (FuncCheck->getName() == "funccheck_debug")
+                           ? "funccheck_hashed_debug"
+                           : "funccheck_hashed";
+  Constant * HashedCheck = M.getOrInsertFunction (HashedName,
+                                                  FuncCheck->getFunctionType());
+  CI->setCalledFunction (HashedCheck);
+  CI->setArgOperand (1, ConstantExpr::getPointerCast (Set, VoidPtrType));
+  ++HashedCFIChecks;
+  return;
+}
+
+//
+// Method: initTargetSets()
+//
+// Description:
+//  Create a constructor that fills the slots of every target set created by
+//  useTargetSet() before main() runs.
+//
+void
+CompleteChecks::initTargetSets (Module & M) {
+  if (TargetSets.empty())
+    return;
+
+  LLVMContext & Context = M.getContext();
+  Type * VoidTy = Type::getVoidTy (Context);
+  PointerType * VoidPtrType = getVoidPtrType (Context);
+  Constant * Init = M.getOrInsertFunction ("funccheck_hashed_init",
+                                           VoidTy,
+                                           VoidPtrType,
+                                           NULL);
+
+  FunctionType * CtorTy = FunctionType::get (VoidTy, false);
+  Function * Ctor = Function::Create (CtorTy,
+                                      GlobalValue::InternalLinkage,
+                                      "sc.init_target_sets",
+                                      &M);
+  Ctor->setDoesNotThrow();
+  BasicBlock * BB = BasicBlock::Create (Context, "entry", Ctor);
+  for (unsigned index = 0; index < TargetSets.size(); ++index) {
+    Value * Set = ConstantExpr::getPointerCast (TargetSets[index], VoidPtrType);
+    CallInst::Create (Init, Set, "", BB);
+  }
+  ReturnInst::Create (Context, BB);
+
+  appendToGlobalCtors (M, Ctor, 65535);
+  TargetSets.clear();
+  return;
+}
+
 bool
 CompleteChecks::runOnModule (Module & M) {
   //
@@ -670,6 +856,7 @@ CompleteChecks::runOnModule (Module & M) {
   //
   fixupCFIChecks(M, "funccheck");
   fixupCFIChecks(M, "funccheck_debug");
+  initTargetSets(M);
   return true;
 }
 
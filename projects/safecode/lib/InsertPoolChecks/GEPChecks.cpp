@@ -255,7 +255,7 @@ InsertGEPChecks::runOnFunction (Function & F) {
   // Get pointers to required analysis passes.
   //
   TD      = &F.getParent()->getDataLayout();
-  abcPass = &getAnalysis<ArrayBoundsCheckLocal>();
+  abcPass = &getAnalysis<ArrayBoundsCheckGroup>();
 
   //
   // Get a pointer to the run-time check function.
@@ -0,0 +1,173 @@
+//===- HoistHotChecks.cpp - Move hot SAFECode checks out of loops --------- --//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass moves run-time checks that a profile shows to be hot out of the
+// loops containing them.  A check is moved into the loop preheader if all of
+// its operands are loop-invariant and it executes on every iteration of the
+// loop; the check then executes once per entry into the loop instead of once
+// per iteration.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "opt-safecode"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/IntrinsicInst.h"
+
+#include "safecode/OptimizeChecks.h"
+
+char llvm::HoistHotChecks::ID = 0;
+
+namespace {
+  STATISTIC (Hoisted, "Number of hot run-time checks hoisted out of loops");
+  STATISTIC (LeftCold, "Number of cold run-time checks left in loops");
+}
+
+namespace llvm {
+
+static RegisterPass<HoistHotChecks>
+X ("sc-hoist-hot-checks", "Hoist hot run-time checks out of loops", true);
+
+//
+// Method: isSafeToHoistFrom()
+//
+// Description:
+//  Determine whether checks may be moved out of the specified loop.  The loop
+//  must not call any function other than run-time checks and intrinsics: such
+//  a call could free or register memory objects (changing the outcome of a
+//  check) or could leave the loop before a hoisted check would have run.
+//
+bool
+HoistHotChecks::isSafeToHoistFrom (Loop * L) {
+  if (!L->getLoopPreheader() || !L->getLoopLatch())
+    return false;
+
+  for (Loop::block_iterator BB = L->block_begin(); BB != L->block_end(); ++BB) {
+    for (BasicBlock::iterator I = (*BB)->begin(); I != (*BB)->end(); ++I) {
+      CallSite CS (&*I);
+      if (!CS)
+        continue;
+
+      if (isa<IntrinsicInst>(I))
+        continue;
+
+      Function * F = CS.getCalledFunction();
+      if (!(F && isRuntimeCheck (F) && isa<CallInst>(I)))
+        return false;
+    }
+  }
+
+  return true;
+}
+
+//
+// Method: alwaysExecutes()
+//
+// Description:
+//  Determine whether the basic block executes on every iteration of the loop,
+//  including the iteration that leaves it.
+//
+bool
+HoistHotChecks::alwaysExecutes (BasicBlock * BB, Loop * L) {
+  if (!DT->dominates (BB, L->getLoopLatch()))
+    return false;
+
+  SmallVector<BasicBlock *, 8> ExitingBlocks;
+  L->getExitingBlocks (ExitingBlocks);
+  for (unsigned index = 0; index < ExitingBlocks.size(); ++index) {
+    if (!DT->dominates (BB, ExitingBlocks[index]))
+      return false;
+  }
+
+  return true;
+}
+
+//
+// Method: hoistChecks()
+//
+// Description:
+//  Move the hot, loop-invariant checks of the loop into its preheader.
+//
+bool
+HoistHotChecks::hoistChecks (Loop * L, CheckProfile & Profile) {
+  if (!isSafeToHoistFrom (L))
+    return false;
+
+  //
+  // Find the checks to move.  Only blocks that execute on each iteration are
+  // considered so that no check executes that would not have executed before.
+  //
+  std::vector<CallInst *> ToHoist;
+  for (Loop::block_iterator BB = L->block_begin(); BB != L->block_end(); ++BB) {
+    if (!alwaysExecutes (*BB, L))
+      continue;
+
+    for (BasicBlock::iterator I = (*BB)->begin(); I != (*BB)->end(); ++I) {
+      CallInst * CI = dyn_cast<CallInst>(I);
+      if (!CI || !CI->getCalledFunction())
+        continue;
+      if (!isRuntimeCheck (CI->getCalledFunction()))
+        continue;
+
+      if (!Profile.isHot (CI)) {
+        if (Profile.isCold (CI))
+          ++LeftCold;
+        continue;
+      }
+
+      bool Invariant = true;
+      for (unsigned arg = 0; arg < CI->getNumArgOperands(); ++arg)
+        Invariant &= L->isLoopInvariant (CI->getArgOperand (arg));
+      if (Invariant)
+        ToHoist.push_back (CI);
+    }
+  }
+
+  Instruction * InsertPt = L->getLoopPreheader()->getTerminator();
+  for (unsigned index = 0; index < ToHoist.size(); ++index) {
+    ToHoist[index]->moveBefore (InsertPt);
+    ++Hoisted;
+  }
+
+  return !ToHoist.empty();
+}
+
+//
+// Method: runOnFunction()
+//
+// Description:
+//  Entry point for this pass.  Inner loops are visited first so that a check
+//  moved into the preheader of an inner loop may then leave the outer loop.
+//
+bool
+HoistHotChecks::runOnFunction (Function & F) {
+  CheckProfile * Profile = getAnalysisIfAvailable<CheckProfile>();
+  if (!Profile || !Profile->hasProfile())
+    return false;
+
+  LI = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+  DT = &getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+
+  std::vector<Loop *> Worklist;
+  for (LoopInfo::iterator L = LI->begin(); L != LI->end(); ++L) {
+    for (df_iterator<Loop *> SubL = df_begin (*L); SubL != df_end (*L); ++SubL)
+      Worklist.push_back (*SubL);
+  }
+
+  bool modified = false;
+  while (!Worklist.empty()) {
+    modified |= hoistChecks (Worklist.back(), *Profile);
+    Worklist.pop_back();
+  }
+
+  return modified;
+}
+
+}
@@ -7,28 +7,44 @@
 // 
 //===----------------------------------------------------------------------===//
 //
-// This pass replaces calls to fastlscheck within inline code to perform the
-// check.  It is designed to provide the advantage of libLTO without libLTO.
+// This pass replaces calls to fastlscheck and exactcheck2 within inline code
+// to perform the check.  It is designed to provide the advantage of libLTO
+// without libLTO.
 //
 //===----------------------------------------------------------------------===//
 
 #define DEBUG_TYPE "inline-fastchecks"
 
 #include "safecode/InlineFastChecks.h"
+
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Support/CommandLine.h"
+
+#include <set>
 #include <vector>
 
+using namespace llvm;
+
 namespace {
   STATISTIC (Inlined, "Number of Fast Checks Inlined");
+  STATISTIC (Batches, "Number of Batches of Fast Checks Created");
+  STATISTIC (Batched, "Number of Fast Checks Merged into Batches");
+
+  cl::opt<unsigned>
+  BatchSize ("fastcheck-batch-size",
+             cl::desc ("Maximum number of adjacent load/store checks merged "
+                       "into one vector check (0 disables merging)"),
+             cl::init (4));
 }
 
-
-using namespace llvm;
-
 //
-// Method: findChecks()
+// Method: inlineCheck()
 //
 // Description:
-//  Find the checks that need to be inlined and inline them.
+//  Find the calls to the check and inline them.
 //
 // Inputs:
 //  F - A pointer to the function.  Calls to this function will be inlined.
@@ -47,9 +63,7 @@ llvm::InlineFastChecks::inlineCheck (Function * F) {
   if (!F) return false;
 
   //
-  // Iterate though all calls to the function and search for pointers that are
-  // checked but only used in comparisons.  If so, then schedule the check
-  // (i.e., the call) for removal.
+  // Iterate though all uses of the function and find the calls to it.
   //
   bool modified = false;
   std::vector<CallInst *> CallsToInline;
@@ -59,10 +73,7 @@ llvm::InlineFastChecks::inlineCheck (Function * F) {
     // no interest to the organization.
     //
     if (CallInst * CI = dyn_cast<CallInst>(*FU)) {
-      //
-      // If the call instruction has no uses, we can remove it.
-      //
-      if (CI->use_begin() == CI->use_end())
+      if (CI->getCalledFunction() == F)
         CallsToInline.push_back (CI);
     }
   }
@@ -78,7 +89,6 @@ llvm::InlineFastChecks::inlineCheck (Function * F) {
   //
   // Inline all of the fast calls we found.
   //
-  const DataLayout & TD = F->getParent()->getDataLayout();
   InlineFunctionInfo IFI;
   for (unsigned index = 0; index < CallsToInline.size(); ++index) {
     InlineFunction (CallsToInline[index], IFI);
@@ -198,61 +208,113 @@ llvm::InlineFastChecks::castToInt (Value * Pointer, BasicBlock * BB) {
 }
 
 //
-// Method: addComparisons()
+// Function: castToIntType()
+//
+// Description:
+//  Zero-extend an unsigned integer to the integer type of the given value.
+//
+static Value *
+castToIntType (Value * V, Type * IntType, BasicBlock * BB) {
+  if (V->getType() == IntType)
+    return V;
+  return CastInst::CreateZExtOrBitCast (V, IntType, "size", BB);
+}
+
+//
+// Function: createCheckBranch()
+//
+// Description:
+//  Terminate the basic block with a branch to the success block when the check
+//  passes and to the failure block otherwise.  The failure block is marked as
+//  unlikely so that code generation keeps it off of the fall-through path.
+//
+static void
+createCheckBranch (BasicBlock * BB, Value * Passed,
+                   BasicBlock * goodBB, BasicBlock * faultBB) {
+  BranchInst * BI = BranchInst::Create (goodBB, faultBB, Passed, BB);
+  MDBuilder MDB (BB->getContext());
+  BI->setMetadata (LLVMContext::MD_prof, MDB.createBranchWeights (2000, 1));
+}
+
+//
+// Method: addBoundsCheck()
 //
 // Description:
-//  This function adds the comparisons needs for load/store checks.
+//  This function adds the comparison needed for an exact check.  Subtracting
+//  the base of the object from the pointer wraps around for pointers below
+//  the object, so one unsigned comparison checks both bounds.
 //
 // Return value:
-//  A pointer to an LLVM boolean value representing the logical AND of the two
-//  comparisons is returned.  If the value is true, then the pointer is within
-//  bounds.  Otherwise, it is out of bounds.
+//  A pointer to an LLVM boolean value is returned.  If the value is true, then
+//  the pointer is within bounds.  Otherwise, it is out of bounds.  Base,
+//  Result, and Size may be scalars or vectors.
 //
 Value *
-llvm::InlineFastChecks::addComparisons (BasicBlock * BB,
+llvm::InlineFastChecks::addBoundsCheck (BasicBlock * BB,
                                         Value * Base,
                                         Value * Result,
                                         Value * Size) {
-  //
-  // Compare the base of the object to the pointer being checked.
-  //
-  ICmpInst * Compare1 = new ICmpInst (*BB,
-                                      CmpInst::ICMP_ULE,
-                                      Base,
-                                      Result,
-                                      "cmp1");
-
-  //
-  // Calculate the address of the first byte beyond the memory object
-  //
-  const DataLayout & TD = BB->getModule()->getDataLayout();
-  Value * SizeInt = Size;
-  if (SizeInt->getType() != TD.getIntPtrType(BB->getContext())) {
-    SizeInt = new ZExtInst (Size, TD.getIntPtrType(BB->getContext()), "size", BB);
-  }
-  Value * LastByte = BinaryOperator::Create (Instruction::Add,
-                                             Base,
-                                             SizeInt,
-                                             "lastbyte",
-                                             BB);
+  Value * Offset = BinaryOperator::Create (Instruction::Sub,
+                                           Result,
+                                           Base,
+                                           "offset",
+                                           BB);
+  return new ICmpInst (*BB, CmpInst::ICMP_ULT, Offset, Size, "inbounds");
+}
 
-  //
-  // Compare the pointer to the first byte beyond the end of the memory object
-  //
-  Value * Compare2 = new ICmpInst (*BB,
+//
+// Method: addAccessCheck()
+//
+// Description:
+//  This function adds the comparisons needed for a load/store check.  The
+//  access is within bounds if its first byte is within the object and the
+//  bytes left in the object after it are at least as many as the length of
+//  the access.  Accesses of zero bytes (which can happen with load/store
+//  checks on memcpy()/memset() calls) always pass.
+//
+// Return value:
+//  A pointer to an LLVM boolean value is returned.  If the value is true, then
+//  the access is within bounds.  Otherwise, it is out of bounds.  The operands
+//  may be scalars or vectors; all of them must be of the integer type of a
+//  pointer.
+//
+Value *
+llvm::InlineFastChecks::addAccessCheck (BasicBlock * BB,
+                                        Value * Base,
+                                        Value * Result,
+                                        Value * Size,
+                                        Value * Length) {
+  Value * Offset = BinaryOperator::Create (Instruction::Sub,
+                                           Result,
+                                           Base,
+                                           "offset",
+                                           BB);
+  Value * InObject = new ICmpInst (*BB,
                                    CmpInst::ICMP_ULT,
-                                   Result,
-                                   LastByte,
-                                   "cmp2");
-
-  //
-  // Combine the results of both comparisons.
-  //
-  return (BinaryOperator::Create (Instruction::And,
-                                  Compare1,
-                                  Compare2,
-                                  "and",
-                                  BB));
+                                   Offset,
+                                   Size,
+                                   "inobject");
+  Value * Left = BinaryOperator::Create (Instruction::Sub,
+                                         Size,
+                                         Offset,
+                                         "left",
+                                         BB);
+  Value * Fits = new ICmpInst (*BB, CmpInst::ICMP_ULE, Length, Left, "fits");
+  Value * Empty = new ICmpInst (*BB,
+                                CmpInst::ICMP_EQ,
+                                Length,
+                                Constant::getNullValue (Length->getType()),
+                                "empty");
+
+  //
+  // Combine the comparisons with logical operators instead of branches.
+  //
+  Value * InBounds = BinaryOperator::Create (Instruction::And,
+                                             InObject,
+                                             Fits,
+                                             "and",
+                                             BB);
+  return BinaryOperator::Create (Instruction::Or, InBounds, Empty, "or", BB);
 }
 
 //
@@ -295,53 +357,22 @@ llvm::InlineFastChecks::createBodyFor (Function * F) {
   BasicBlock * faultBB = createFaultBlock (*F);
 
   //
-  // Add instructions to the entry block to compare the first dereferenced
-  // address.
+  // Add instructions to the entry block to check that the memory accessed is
+  // within the bounds of the object.
   // 
+  const DataLayout & TD = F->getParent()->getDataLayout();
+  Type * IntPtrType = TD.getIntPtrType (Context);
   Function::arg_iterator arg = F->arg_begin();
   Value * Base = castToInt (arg++, entryBB);
   Value * Result = castToInt (arg++, entryBB);
-  Value * Size = arg++;
-  Value * MemSize = arg++;
-  Value * Sum1 = addComparisons (entryBB, Base, Result, Size);
-
-  //
-  // Now add instructions to compare the last byte dereferenced with the
-  // memory object's bounds.
-  //
-  const DataLayout & TD = F->getParent()->getDataLayout();
-  Value * SizeInt = MemSize;
-  if (SizeInt->getType() != TD.getIntPtrType(entryBB->getContext())) {
-    SizeInt = new ZExtInst (MemSize, TD.getIntPtrType(entryBB->getContext()), "size", entryBB);
-  }
-  Value * LastByte = BinaryOperator::Create (Instruction::Add,
-                                             Result,
-                                             SizeInt,
-                                             "lastbyte",
-                                             entryBB);
-  Constant * MinusOne = ConstantInt::getSigned (TD.getIntPtrType(entryBB->getContext()), -1);
-  LastByte = BinaryOperator::Create (Instruction::Add,
-                                     LastByte,
-                                     MinusOne,
-                                     "lastbyte",
-                                     entryBB);
-  Value * Sum2 = addComparisons (entryBB, Base, LastByte, Size);
-
-  //
-  // The check only passes if both the first and last byte accessed are within
-  // bounds.
-  //
-  Value * Sum = BinaryOperator::Create (Instruction::And,
-                                        Sum1,
-                                        Sum2,
-                                        "and",
-                                        entryBB);
-
+  Value * Size = castToIntType (arg++, IntPtrType, entryBB);
+  Value * MemSize = castToIntType (arg++, IntPtrType, entryBB);
+  Value * Passed = addAccessCheck (entryBB, Base, Result, Size, MemSize);
 
   //
   // Create the branch instruction.
   //
-  BranchInst::Create (goodBB, faultBB, Sum, entryBB);
+  createCheckBranch (entryBB, Passed, goodBB, faultBB);
 
   //
   // Make the function internal.
@@ -390,61 +421,420 @@ llvm::InlineFastChecks::createDebugBodyFor (Function * F) {
   BasicBlock * faultBB = createDebugFaultBlock (*F);
 
   //
-  // Add instructions to the entry block to compare the first dereferenced
-  // address.
+  // Add instructions to the entry block to check that the memory accessed is
+  // within the bounds of the object.
   // 
+  const DataLayout & TD = F->getParent()->getDataLayout();
+  Type * IntPtrType = TD.getIntPtrType (Context);
   Function::arg_iterator arg = F->arg_begin();
   Value * Base = castToInt (arg++, entryBB);
   Value * Result = castToInt (arg++, entryBB);
-  Value * Size = arg++;
-  Value * MemSize = arg++;
-  Value * Sum1 = addComparisons (entryBB, Base, Result, Size);
+  Value * Size = castToIntType (arg++, IntPtrType, entryBB);
+  Value * MemSize = castToIntType (arg++, IntPtrType, entryBB);
+  Value * Passed = addAccessCheck (entryBB, Base, Result, Size, MemSize);
 
   //
-  // Now add instructions to compare the last byte dereferenced with the
-  // memory object's bounds.
+  // Create the branch instruction.
   //
-  const DataLayout & TD = F->getParent()->getDataLayout();
-  Value * SizeInt = MemSize;
-  if (SizeInt->getType() != TD.getIntPtrType(entryBB->getContext())) {
-    SizeInt = new ZExtInst (MemSize, TD.getIntPtrType(entryBB->getContext()), "size", entryBB);
+  createCheckBranch (entryBB, Passed, goodBB, faultBB);
+
+  //
+  // Make the function internal.
+  //
+  F->setLinkage (GlobalValue::InternalLinkage);
+  return true;
+}
+
+//
+// Method: createFastBodyFor()
+//
+// Description:
+//  Create a function that performs the fast path of an exactcheck2() or
+//  exactcheck2_debug() call inline and only calls the run-time's version of
+//  the check when the pointer is out of bounds, and make the calls to the
+//  check use it.  The run-time's version handles pointer rewriting and error
+//  reporting.
+//
+// Inputs:
+//  F - A pointer to the declaration of the run-time check.  This pointer can
+//      be NULL.
+//
+// Return value:
+//  NULL      - No function was created.
+//  Otherwise - The function that now performs the calls to the check.
+//
+Function *
+llvm::InlineFastChecks::createFastBodyFor (Function * F) {
+  //
+  // If the function does not exist or the run-time is part of the module,
+  // do nothing.
+  //
+  if (!F) return 0;
+  if (!(F->isDeclaration())) return 0;
+
+  Module * M = F->getParent();
+  LLVMContext & Context = F->getContext();
+  Function * Fast = Function::Create (F->getFunctionType(),
+                                      GlobalValue::InternalLinkage,
+                                      F->getName() + "_fast",
+                                      M);
+
+  //
+  // Create an entry block that compares the pointer with the bounds of the
+  // object, a block that returns the pointer, and a block that calls the
+  // run-time's version of the check.
+  //
+  BasicBlock * entryBB = BasicBlock::Create (Context, "entry", Fast);
+  BasicBlock * goodBB = BasicBlock::Create (Context, "pass", Fast);
+  BasicBlock * slowBB = BasicBlock::Create (Context, "slow", Fast);
+
+  const DataLayout & TD = M->getDataLayout();
+  std::vector<Value *> args;
+  for (Function::arg_iterator arg = Fast->arg_begin();
+       arg != Fast->arg_end();
+       ++arg) {
+    args.push_back (&*arg);
+  }
+  Value * Base = castToInt (args[1], entryBB);
+  Value * Result = castToInt (args[2], entryBB);
+  Value * Size = castToIntType (args[3], TD.getIntPtrType (Context), entryBB);
+  Value * Passed = addBoundsCheck (entryBB, Base, Result, Size);
+  createCheckBranch (entryBB, Passed, goodBB, slowBB);
+
+  Type * ReturnType = F->getReturnType();
+  CallInst * SlowCall = CallInst::Create (F, args, "", slowBB);
+  if (ReturnType->isVoidTy()) {
+    ReturnInst::Create (Context, goodBB);
+    ReturnInst::Create (Context, slowBB);
+  } else {
+    Value * Ret = args[2];
+    if (Ret->getType() != ReturnType)
+      Ret = CastInst::CreatePointerCast (Ret, ReturnType, "result", goodBB);
+    ReturnInst::Create (Context, Ret, goodBB);
+    ReturnInst::Create (Context, SlowCall, slowBB);
   }
-  Value * LastByte = BinaryOperator::Create (Instruction::Add,
-                                             Result,
-                                             SizeInt,
-                                             "lastbyte",
-                                             entryBB);
-  Constant * MinusOne = ConstantInt::getSigned (TD.getIntPtrType(entryBB->getContext()), -1);
-  LastByte = BinaryOperator::Create (Instruction::Add,
-                                     LastByte,
-                                     MinusOne,
-                                     "lastbyte",
-                                     entryBB);
-  Value * Sum2 = addComparisons (entryBB, Base, LastByte, Size);
 
   //
-  // The check only passes if both the first and last byte accessed are within
-  // bounds.
+  // Make the calls to the check call the new function instead.
   //
-  Value * Sum = BinaryOperator::Create (Instruction::And,
-                                        Sum1,
-                                        Sum2,
-                                        "and",
-                                        entryBB);
+  std::vector<CallInst *> Calls;
+  for (Value::user_iterator FU = F->user_begin(); FU != F->user_end(); ++FU) {
+    if (CallInst * CI = dyn_cast<CallInst>(*FU))
+      if ((CI->getCalledFunction() == F) && (CI != SlowCall))
+        Calls.push_back (CI);
+  }
+  for (unsigned index = 0; index < Calls.size(); ++index)
+    Calls[index]->setCalledFunction (Fast);
 
+  return Fast;
+}
+
+//
+// Function: canHoistBefore()
+//
+// Description:
+//  Determine whether a value used by a load/store check can be computed
+//  before the first check of a batch.
+//
+// Inputs:
+//  V       - The value used by the check.
+//  Between - The instructions between the first check of the batch and the
+//            check.
+//  Depth   - The number of instructions that may still be followed.
+//
+static bool
+canHoistBefore (Value * V, const std::set<Instruction *> & Between,
+                unsigned Depth) {
   //
-  // Create the branch instruction.  Both comparisons must return true for the
-  // pointer to be within bounds.
+  // Values that are not computed between the checks are already available.
   //
-  BranchInst::Create (goodBB, faultBB, Sum, entryBB);
+  Instruction * I = dyn_cast<Instruction>(V);
+  if (!I || !Between.count (I))
+    return true;
 
   //
-  // Make the function internal.
+  // Do not move loads or anything that can trap or have side-effects.
   //
-  F->setLinkage (GlobalValue::InternalLinkage);
+  if ((!Depth) || (I->mayReadFromMemory()) ||
+      (!isSafeToSpeculativelyExecute (I)))
+    return false;
+
+  for (unsigned index = 0; index < I->getNumOperands(); ++index)
+    if (!canHoistBefore (I->getOperand (index), Between, Depth - 1))
+      return false;
   return true;
 }
 
+//
+// Function: hoistBefore()
+//
+// Description:
+//  Move the computation of a value used by a load/store check before the first
+//  check of a batch.  canHoistBefore() must have returned true for it.
+//
+static void
+hoistBefore (Value * V, Instruction * Pos, std::set<Instruction *> & Between) {
+  Instruction * I = dyn_cast<Instruction>(V);
+  if (!I || !Between.count (I))
+    return;
+
+  for (unsigned index = 0; index < I->getNumOperands(); ++index)
+    hoistBefore (I->getOperand (index), Pos, Between);
+  I->moveBefore (Pos);
+  Between.erase (I);
+}
+
+//
+// Function: endsBatch()
+//
+// Description:
+//  Determine whether a load/store check after the instruction may not be
+//  performed before it.  Loads and stores of the memory being checked may be
+//  between the checks of a batch; calls, volatile or atomic accesses, and
+//  other instructions with side-effects may not.
+//
+static bool
+endsBatch (Instruction * I) {
+  if (isa<DbgInfoIntrinsic>(I))
+    return false;
+
+  if (isa<CallInst>(I) || isa<InvokeInst>(I))
+    return true;
+
+  if (LoadInst * LI = dyn_cast<LoadInst>(I))
+    return !(LI->isSimple());
+
+  if (StoreInst * SI = dyn_cast<StoreInst>(I))
+    return !(SI->isSimple());
+
+  return I->mayHaveSideEffects();
+}
+
+//
+// Method: getBatchFor()
+//
+// Description:
+//  Create a function that performs several load/store checks at once.  It
+//  takes the arguments of each of the checks in turn and compares vectors
+//  of the pointers and sizes so that all of the checks share one branch.  If
+//  any of them fails, it calls the checks one by one so that the failures are
+//  handled as if the checks had not been merged.
+//
+// Inputs:
+//  F     - The load/store check.
+//  Count - The number of checks to perform.
+//
+Function *
+llvm::InlineFastChecks::getBatchFor (Function * F, unsigned Count) {
+  Module * M = F->getParent();
+  std::string Name = (F->getName() + ".batch" + Twine (Count)).str();
+  if (Function * Batch = M->getFunction (Name))
+    return Batch;
+
+  //
+  // The function takes the arguments of each of the checks.
+  //
+  FunctionType * FT = F->getFunctionType();
+  unsigned NumParams = FT->getNumParams();
+  std::vector<Type *> ParamTypes;
+  for (unsigned index = 0; index < Count; ++index)
+    ParamTypes.insert (ParamTypes.end(), FT->param_begin(), FT->param_end());
+  FunctionType * BatchType = FunctionType::get (FT->getReturnType(),
+                                                ParamTypes,
+                                                false);
+  Function * Batch = Function::Create (BatchType,
+                                       GlobalValue::InternalLinkage,
+                                       Name,
+                                       M);
+  BatchFunctions.push_back (Batch);
+
+  LLVMContext & Context = F->getContext();
+  BasicBlock * entryBB = BasicBlock::Create (Context, "entry", Batch);
+  BasicBlock * goodBB = BasicBlock::Create (Context, "pass", Batch);
+  BasicBlock * faultBB = BasicBlock::Create (Context, "fault", Batch);
+  ReturnInst::Create (Context, goodBB);
+
+  std::vector<Value *> args;
+  for (Function::arg_iterator arg = Batch->arg_begin();
+       arg != Batch->arg_end();
+       ++arg) {
+    args.push_back (&*arg);
+  }
+
+  //
+  // Gather the base, pointer, object size, and access length of each check
+  // into vectors.
+  //
+  const DataLayout & TD = M->getDataLayout();
+  Type * IntPtrType = TD.getIntPtrType (Context);
+  Type * Int32Type = IntegerType::getInt32Ty (Context);
+  Value * Vectors[4];
+  for (unsigned field = 0; field < 4; ++field)
+    Vectors[field] = UndefValue::get (VectorType::get (IntPtrType, Count));
+  for (unsigned index = 0; index < Count; ++index) {
+    for (unsigned field = 0; field < 4; ++field) {
+      Value * V = args[index * NumParams + field];
+      if (isa<PointerType>(V->getType()))
+        V = castToInt (V, entryBB);
+      else
+        V = castToIntType (V, IntPtrType, entryBB);
+      Vectors[field] = InsertElementInst::Create (Vectors[field],
+                                                  V,
+                                                  ConstantInt::get (Int32Type,
+                                                                    index),
+                                                  "",
+                                                  entryBB);
+    }
+  }
+
+  //
+  // Check all of the accesses at once and branch to the failure block if any
+  // of them is out of bounds.
+  //
+  Value * Passed = addAccessCheck (entryBB,
+                                   Vectors[0],
+                                   Vectors[1],
+                                   Vectors[2],
+                                   Vectors[3]);
+  Type * MaskType = IntegerType::get (Context, Count);
+  Value * Mask = new BitCastInst (Passed, MaskType, "mask", entryBB);
+  Value * AllPassed = new ICmpInst (*entryBB,
+                                    CmpInst::ICMP_EQ,
+                                    Mask,
+                                    Constant::getAllOnesValue (MaskType),
+                                    "passed");
+  createCheckBranch (entryBB, AllPassed, goodBB, faultBB);
+
+  //
+  // Perform the checks one at a time when one of them fails.
+  //
+  for (unsigned index = 0; index < Count; ++index) {
+    ArrayRef<Value *> CheckArgs (&args[index * NumParams], NumParams);
+    CallInst::Create (F, CheckArgs, "", faultBB);
+  }
+  ReturnInst::Create (Context, faultBB);
+
+  return Batch;
+}
+
+//
+// Method: flushBatch()
+//
+// Description:
+//  Replace a batch of adjacent load/store checks with one call that performs
+//  all of them.  The call is placed where the first check was; the values
+//  used by the other checks must already be available there.
+//
+// Return value:
+//  true  - The checks were merged.
+//  false - There were not enough checks to merge.
+//
+bool
+llvm::InlineFastChecks::flushBatch (Function * F,
+                                    std::vector<CallInst *> & Batch) {
+  bool merged = (Batch.size() > 1);
+  if (merged) {
+    std::vector<Value *> args;
+    for (unsigned index = 0; index < Batch.size(); ++index)
+      args.insert (args.end(),
+                   Batch[index]->arg_operands().begin(),
+                   Batch[index]->arg_operands().end());
+
+    Function * BatchF = getBatchFor (F, Batch.size());
+    CallInst * CI = CallInst::Create (BatchF, args, "", Batch[0]);
+    CI->setDebugLoc (Batch[0]->getDebugLoc());
+    for (unsigned index = 0; index < Batch.size(); ++index)
+      Batch[index]->eraseFromParent();
+
+    ++Batches;
+    Batched += Batch.size();
+  }
+
+  Batch.clear();
+  return merged;
+}
+
+//
+// Method: mergeChecks()
+//
+// Description:
+//  Merge load/store checks that are close together within a basic block
+//  (such as the checks of an unrolled loop) into batches.  The checks of a
+//  batch are performed where the first of them was.
+//
+// Inputs:
+//  F - The load/store check.  This pointer can be NULL.
+//
+// Return value:
+//  true  - One or more batches were created.
+//  false - The module was not modified.
+//
+bool
+llvm::InlineFastChecks::mergeChecks (Function * F) {
+  if ((!F) || (BatchSize < 2))
+    return false;
+
+  //
+  // Find the basic blocks containing more than one check.
+  //
+  std::vector<BasicBlock *> Blocks;
+  std::set<BasicBlock *> Seen;
+  std::set<BasicBlock *> Found;
+  for (Value::user_iterator FU = F->user_begin(); FU != F->user_end(); ++FU) {
+    if (CallInst * CI = dyn_cast<CallInst>(*FU)) {
+      BasicBlock * BB = CI->getParent();
+      if ((CI->getCalledFunction() == F) && (!Seen.insert (BB).second))
+        if (Found.insert (BB).second)
+          Blocks.push_back (BB);
+    }
+  }
+
+  bool modified = false;
+  for (unsigned index = 0; index < Blocks.size(); ++index) {
+    std::vector<CallInst *> Batch;
+    std::set<Instruction *> Between;
+    BasicBlock * BB = Blocks[index];
+    for (BasicBlock::iterator I = BB->begin(); I != BB->end(); ) {
+      //
+      // Hoisting only moves instructions that were already visited, so the
+      // iterator stays valid.
+      //
+      Instruction * Inst = &*I++;
+      CallInst * CI = dyn_cast<CallInst>(Inst);
+      if (CI && (CI->getCalledFunction() == F)) {
+        bool Fits = (Batch.size() < BatchSize);
+        for (unsigned arg = 0; Fits && arg < CI->getNumArgOperands(); ++arg)
+          Fits = canHoistBefore (CI->getArgOperand (arg), Between, 8);
+
+        if (!Fits) {
+          modified |= flushBatch (F, Batch);
+          Between.clear();
+        }
+
+        if (!Batch.empty())
+          for (unsigned arg = 0; arg < CI->getNumArgOperands(); ++arg)
+            hoistBefore (CI->getArgOperand (arg), Batch[0], Between);
+        Batch.push_back (CI);
+        continue;
+      }
+
+      if (Batch.empty())
+        continue;
+
+      if (endsBatch (Inst)) {
+        modified |= flushBatch (F, Batch);
+        Between.clear();
+      } else {
+        Between.insert (Inst);
+      }
+    }
+
+    modified |= flushBatch (F, Batch);
+  }
+
+  return modified;
+}
+
 bool
 llvm::InlineFastChecks::runOnModule (Module & M) {
   //
@@ -453,11 +843,35 @@ llvm::InlineFastChecks::runOnModule (Module & M) {
   createBodyFor (M.getFunction ("fastlscheck"));
   createDebugBodyFor (M.getFunction ("fastlscheck_debug"));
 
+  //
+  // Merge adjacent load/store checks into batches and inline the batches.
+  // The checks that a batch performs when one of them fails are inlined
+  // below.
+  //
+  mergeChecks (M.getFunction ("fastlscheck"));
+  mergeChecks (M.getFunction ("fastlscheck_debug"));
+  for (unsigned index = 0; index < BatchFunctions.size(); ++index) {
+    inlineCheck (BatchFunctions[index]);
+    BatchFunctions[index]->eraseFromParent();
+  }
+  BatchFunctions.clear();
+
   //
   // Search for call sites to the function and forcibly inline them.
   //
   inlineCheck (M.getFunction ("fastlscheck"));
   inlineCheck (M.getFunction ("fastlscheck_debug"));
+
+  //
+  // Inline the fast path of the exact checks.
+  //
+  const char * ExactChecks[] = {"exactcheck2", "exactcheck2_debug"};
+  for (unsigned index = 0; index < 2; ++index) {
+    Function * Fast = createFastBodyFor (M.getFunction (ExactChecks[index]));
+    inlineCheck (Fast);
+    if (Fast && Fast->use_empty())
+      Fast->eraseFromParent();
+  }
   return true;
 }
 
@@ -40,6 +40,7 @@
 #define DEBUG_TYPE "safecode-softboundCETS"
 
 #include "SoftBound/SoftBoundCETSPass.h"
+#include "SoftBound/SoftBoundCETSTrie.h"
 
 static cl::opt<bool>
 spatial_safety
@@ -175,6 +176,30 @@ unsafe_byval_opt
  cl::desc("Unbound byval attributed pointers so that check always succeeds"),
  cl::init(false));
 
+static cl::opt<bool>
+INLINEMETADATA
+("softboundcets_inline_metadata",
+ cl::desc("expand the trie lookup of metadata loads and stores inline"),
+ cl::init(false));
+
+static cl::opt<unsigned>
+TRIESECONDARYBITS
+("softboundcets_trie_secondary_bits",
+ cl::desc("log2 of the number of entries of the secondary trie tables"),
+ cl::init(__SOFTBOUNDCETS_TRIE_SECONDARY_BITS));
+
+static cl::opt<bool>
+PACKEDMETADATA
+("softboundcets_packed_metadata",
+ cl::desc("expand metadata accesses for the packed trie entries"),
+ cl::init(false));
+
+static cl::opt<bool>
+INLINEMETADATASTATS
+("softboundcets_inline_metadata_stats",
+ cl::desc("count the metadata accesses expanded inline"),
+ cl::init(false));
+
 char SoftBoundCETSPass:: ID = 0;
 
 static RegisterPass<SoftBoundCETSPass> P ("SoftBoundCETSPass",
@@ -1067,7 +1092,12 @@ void SoftBoundCETSPass::addStoreBaseBoundFunc(Value* pointer_dest,
     args.push_back(pointer_key);
     args.push_back(pointer_lock);
   }
-  CallInst::Create(m_store_base_bound_func, args, "", insert_at);
+  CallInst* store_call = 
+    CallInst::Create(m_store_base_bound_func, args, "", insert_at);
+
+  if (INLINEMETADATA && m_is_64_bit) {
+    m_metadata_calls.push_back(store_call);
+  }
 }
 
 //
@@ -4198,7 +4228,12 @@ void SoftBoundCETSPass::handleLoad(LoadInst* load_inst) {
     args.push_back(lock_alloca);
   }
   
-  CallInst::Create(m_load_base_bound_func, args, "", insert_at);
+  CallInst* load_call = 
+    CallInst::Create(m_load_base_bound_func, args, "", insert_at);
+
+  if (INLINEMETADATA && m_is_64_bit) {
+    m_metadata_calls.push_back(load_call);
+  }
       
   if(spatial_safety){
     Instruction* base_load = new LoadInst(base_alloca, "base.load", insert_at);
@@ -4216,6 +4251,281 @@ void SoftBoundCETSPass::handleLoad(LoadInst* load_inst) {
 
 
 
+//
+// Method: inlineMetadataAccess()
+//
+// Description:
+//
+// This function expands a call to __softboundcets_metadata_load or
+// __softboundcets_metadata_store into an inline lookup of the trie of
+// the run-time: the primary table gives the secondary table of the
+// address, and the fields of the entry are loaded or stored
+// directly. The call is kept for the rare case where the secondary
+// table has not been allocated yet; it then returns null metadata or
+// allocates the table.
+//
+// The layout must match the run-time: by default, entries with a
+// pointer-sized field for each of base, bound, key and lock being
+// tracked; with softboundcets_packed_metadata, the two words of the
+// entries of __SOFTBOUNDCETS_PACKED_METADATA. The primary table is
+// reached through the name that SoftBoundCETSTrie.h derives from the
+// layout, so a run-time built for another layout does not link. With
+// softboundcets_inline_metadata_stats, the inline lookup counts the
+// accesses like the run-time built with __SOFTBOUNDCETS_STATISTICS_MODE
+// does; the calls left for missing tables count themselves.
+//
+void SoftBoundCETSPass::inlineMetadataAccess(CallInst* call) {
+
+  Module* module = call->getParent()->getParent()->getParent();
+  LLVMContext& context = module->getContext();
+  Type* int64_ty = Type::getInt64Ty(context);
+  Type* table_ty = PointerType::getUnqual(m_void_ptr_type);
+
+  /* Each entry holds one field per argument after the address */
+  uint64_t num_fields = call->getNumArgOperands() - 1;
+  bool is_load = (call->getCalledFunction() == m_load_base_bound_func);
+
+  /* Packed entries only exist with both spatial and temporal metadata */
+  if (PACKEDMETADATA && num_fields != 4)
+    return;
+
+  std::string layout = __SOFTBOUNDCETS_TRIE_LAYOUT_PREFIX;
+  layout += utostr(TRIESECONDARYBITS);
+  if (PACKEDMETADATA)
+    layout += __SOFTBOUNDCETS_TRIE_LAYOUT_PACKED;
+  if (INLINEMETADATASTATS)
+    layout += __SOFTBOUNDCETS_TRIE_LAYOUT_STATS;
+
+  Constant* primary_table = module->getOrInsertGlobal(layout, table_ty);
+
+  Value* addr = new PtrToIntInst(call->getArgOperand(0), int64_ty, 
+                                 "md.addr", call);
+  Value* primary_index = 
+    BinaryOperator::CreateLShr(addr, 
+                               ConstantInt::get(int64_ty, 
+                                                3 + TRIESECONDARYBITS), 
+                               "md.pidx", call);
+  Value* primary = new LoadInst(primary_table, "md.primary", call);
+  Value* slot = GetElementPtrInst::Create(m_void_ptr_type, primary, 
+                                          primary_index, "md.slot", call);
+  Value* secondary = new LoadInst(slot, "md.secondary", call);
+  Value* missing = new ICmpInst(call, CmpInst::ICMP_EQ, secondary, 
+                                m_void_null_ptr, "md.missing");
+
+  TerminatorInst* then_term;
+  TerminatorInst* else_term;
+  MDNode* weights = MDBuilder(context).createBranchWeights(1, 1000);
+  SplitBlockAndInsertIfThenElse(missing, call, &then_term, &else_term, 
+                                weights);
+  call->moveBefore(then_term);
+
+  if (INLINEMETADATASTATS) {
+    const char* counter_name = is_load ? 
+      "__softboundcets_statistics_metadata_loads" : 
+      "__softboundcets_statistics_metadata_stores";
+    Constant* counter = module->getOrInsertGlobal(counter_name, int64_ty);
+    Value* count = new LoadInst(counter, "md.count", else_term);
+    count = BinaryOperator::CreateAdd(count, ConstantInt::get(int64_ty, 1), 
+                                      "md.count", else_term);
+    new StoreInst(count, counter, else_term);
+  }
+
+  uint64_t secondary_mask = (UINT64_C(1) << TRIESECONDARYBITS) - 1;
+
+  Value* secondary_index = 
+    BinaryOperator::CreateLShr(addr, ConstantInt::get(int64_ty, 3), 
+                               "md.sidx", else_term);
+  secondary_index = 
+    BinaryOperator::CreateAnd(secondary_index, 
+                              ConstantInt::get(int64_ty, secondary_mask), 
+                              "md.sidx", else_term);
+
+  if (PACKEDMETADATA) {
+    Value* words = new BitCastInst(secondary, 
+                                   PointerType::getUnqual(int64_ty), 
+                                   "md.words", else_term);
+    inlinePackedMetadataAccess(call, words, secondary_index, else_term);
+    return;
+  }
+
+  Value* entry_index = 
+    BinaryOperator::CreateMul(secondary_index, 
+                              ConstantInt::get(int64_ty, num_fields), 
+                              "md.entry", else_term);
+  Value* entry = new BitCastInst(secondary, table_ty, "md.fields", 
+                                 else_term);
+
+  for (unsigned field = 0; field < num_fields; ++field) {
+    Value* arg = call->getArgOperand(field + 1);
+    Value* field_index = 
+      BinaryOperator::CreateAdd(entry_index, 
+                                ConstantInt::get(int64_ty, field), 
+                                "md.fidx", else_term);
+    Value* field_ptr = GetElementPtrInst::Create(m_void_ptr_type, entry, 
+                                                 field_index, "md.fptr", 
+                                                 else_term);
+    Type* field_ty = is_load ? 
+      cast<PointerType>(arg->getType())->getElementType() : arg->getType();
+
+    field_ptr = new BitCastInst(field_ptr, PointerType::getUnqual(field_ty), 
+                                "md.fptr", else_term);
+    if (is_load) {
+      Value* field_value = new LoadInst(field_ptr, "md.field", else_term);
+      new StoreInst(field_value, arg, else_term);
+    } else {
+      new StoreInst(arg, field_ptr, else_term);
+    }
+  }
+}
+
+//
+// Method: inlinePackedMetadataAccess()
+//
+// Description:
+//
+// This function emits, before insert_at, the inline load or store of
+// the packed entry secondary_index of the secondary table words for
+// the metadata call.  It encodes and decodes the entries like
+// __softboundcets_pack_address() and __softboundcets_metadata_load()
+// do: the low 48 bits of the two words hold the base and the bound,
+// saturated to the 48-bit address space, and their high 16 bits the
+// low and high halves of the key. The lock is computed from the key.
+//
+void 
+SoftBoundCETSPass::inlinePackedMetadataAccess(CallInst* call, Value* words,
+                                              Value* secondary_index,
+                                              Instruction* insert_at) {
+
+  LLVMContext& context = call->getContext();
+  Type* int64_ty = Type::getInt64Ty(context);
+  bool is_load = (call->getCalledFunction() == m_load_base_bound_func);
+
+  uint64_t packed_address_mask = 
+    (UINT64_C(1) << __SOFTBOUNDCETS_TRIE_PACKED_ADDRESS_BITS) - 1;
+  Constant* address_mask = ConstantInt::get(int64_ty, packed_address_mask);
+  Constant* key_shift = 
+    ConstantInt::get(int64_ty, __SOFTBOUNDCETS_TRIE_PACKED_ADDRESS_BITS);
+  Constant* half_key_mask = ConstantInt::get(int64_ty, 0xffff);
+  Constant* half_key_bits = ConstantInt::get(int64_ty, 16);
+
+  Value* entry_index = 
+    BinaryOperator::CreateShl(secondary_index, ConstantInt::get(int64_ty, 1), 
+                              "md.entry", insert_at);
+  Value* base_key_ptr = GetElementPtrInst::Create(int64_ty, words, 
+                                                  entry_index, "md.bkptr",
+                                                  insert_at);
+  Value* bound_key_ptr = 
+    GetElementPtrInst::Create(int64_ty, base_key_ptr, 
+                              ConstantInt::get(int64_ty, 1), 
+                              "md.bdkptr", insert_at);
+
+  Value* base_arg = call->getArgOperand(1);
+  Value* bound_arg = call->getArgOperand(2);
+  Value* key_arg = call->getArgOperand(3);
+  Value* lock_arg = call->getArgOperand(4);
+
+  if (!is_load) {
+    Value* values[3] = { base_arg, bound_arg, key_arg };
+    for (unsigned i = 0; i < 3; ++i) {
+      if (values[i]->getType()->isPointerTy())
+        values[i] = new PtrToIntInst(values[i], int64_ty, "md.value", 
+                                     insert_at);
+      else
+        values[i] = CastInst::CreateIntegerCast(values[i], int64_ty, false, 
+                                                "md.value", insert_at);
+    }
+
+    /* Bounds beyond the 48-bit address space saturate */
+    for (unsigned i = 0; i < 2; ++i) {
+      Value* above = new ICmpInst(insert_at, CmpInst::ICMP_UGT, values[i], 
+                                  address_mask, "md.above");
+      values[i] = SelectInst::Create(above, address_mask, values[i], 
+                                     "md.addr", insert_at);
+    }
+
+    Value* key_low = 
+      BinaryOperator::CreateAnd(values[2], half_key_mask, "md.keylo", 
+                                insert_at);
+    Value* key_high = 
+      BinaryOperator::CreateLShr(values[2], half_key_bits, "md.keyhi", 
+                                 insert_at);
+    key_high = BinaryOperator::CreateAnd(key_high, half_key_mask, 
+                                         "md.keyhi", insert_at);
+    key_low = BinaryOperator::CreateShl(key_low, key_shift, "md.keylo", 
+                                        insert_at);
+    key_high = BinaryOperator::CreateShl(key_high, key_shift, "md.keyhi", 
+                                         insert_at);
+
+    Value* base_key = BinaryOperator::CreateOr(values[0], key_low, 
+                                               "md.basekey", insert_at);
+    Value* bound_key = BinaryOperator::CreateOr(values[1], key_high, 
+                                                "md.boundkey", insert_at);
+    new StoreInst(base_key, base_key_ptr, insert_at);
+    new StoreInst(bound_key, bound_key_ptr, insert_at);
+    return;
+  }
+
+  Value* base_key = new LoadInst(base_key_ptr, "md.basekey", insert_at);
+  Value* bound_key = new LoadInst(bound_key_ptr, "md.boundkey", insert_at);
+
+  Value* key_low = BinaryOperator::CreateLShr(base_key, key_shift, 
+                                              "md.keylo", insert_at);
+  Value* key_high = BinaryOperator::CreateLShr(bound_key, key_shift, 
+                                               "md.keyhi", insert_at);
+  key_high = BinaryOperator::CreateShl(key_high, half_key_bits, "md.keyhi", 
+                                       insert_at);
+  Value* key = BinaryOperator::CreateOr(key_low, key_high, "md.key", 
+                                        insert_at);
+
+  Value* base = BinaryOperator::CreateAnd(base_key, address_mask, 
+                                          "md.base", insert_at);
+  Value* bound = BinaryOperator::CreateAnd(bound_key, address_mask, 
+                                           "md.bound", insert_at);
+
+  /* A saturated bound stands for the whole address space */
+  Value* saturated = new ICmpInst(insert_at, CmpInst::ICMP_EQ, bound, 
+                                  address_mask, "md.saturated");
+  Value* carry = new ZExtInst(saturated, int64_ty, "md.carry", insert_at);
+  bound = BinaryOperator::CreateAdd(bound, carry, "md.bound", insert_at);
+
+  /* Key 0 has no lock; any other key indexes the temporal space */
+  Constant* temporal_space = 
+    call->getParent()->getParent()->getParent()->
+    getOrInsertGlobal("__softboundcets_temporal_space_begin", 
+                      PointerType::getUnqual(int64_ty));
+  Value* locks = new LoadInst(temporal_space, "md.locks", insert_at);
+  uint64_t lock_mask = 
+    (UINT64_C(1) << __SOFTBOUNDCETS_TRIE_PACKED_LOCK_BITS) - 1;
+  Value* lock_index = 
+    BinaryOperator::CreateAnd(key, ConstantInt::get(int64_ty, lock_mask), 
+                              "md.lidx", insert_at);
+  Value* lock = GetElementPtrInst::Create(int64_ty, locks, lock_index, 
+                                          "md.lock", insert_at);
+  Value* has_lock = new ICmpInst(insert_at, CmpInst::ICMP_NE, key, 
+                                 ConstantInt::get(int64_ty, 0), 
+                                 "md.haslock");
+  lock = new BitCastInst(lock, m_void_ptr_type, "md.lock", insert_at);
+  lock = SelectInst::Create(has_lock, lock, m_void_null_ptr, "md.lock", 
+                            insert_at);
+
+  Value* results[4] = { base, bound, key, lock };
+  Value* args[4] = { base_arg, bound_arg, key_arg, lock_arg };
+  for (unsigned i = 0; i < 4; ++i) {
+    Type* field_ty = cast<PointerType>(args[i]->getType())->getElementType();
+    Value* result = results[i];
+    if (result->getType() != field_ty) {
+      if (field_ty->isPointerTy() && result->getType()->isPointerTy())
+        result = new BitCastInst(result, field_ty, "md.field", insert_at);
+      else if (field_ty->isPointerTy())
+        result = new IntToPtrInst(result, field_ty, "md.field", insert_at);
+      else
+        result = CastInst::CreateIntegerCast(result, field_ty, false, 
+                                             "md.field", insert_at);
+    }
+    new StoreInst(result, args[i], insert_at);
+  }
+}
+
 /* Identify the initial globals present in the program before we add
  * extra base and bound for all globals
  */
@@ -4403,6 +4713,20 @@ bool SoftBoundCETSPass::runOnModule(Module& module) {
     addDereferenceChecks(func_ptr);            
   }
 
+  /* Expand the metadata accesses once the checks no longer need the
+   * dominator trees of the original control flow 
+   */
+  if (!m_metadata_calls.empty() &&
+      (TRIESECONDARYBITS < __SOFTBOUNDCETS_TRIE_MIN_SECONDARY_BITS ||
+       TRIESECONDARYBITS > __SOFTBOUNDCETS_TRIE_MAX_SECONDARY_BITS)) {
+    report_fatal_error("softboundcets_trie_secondary_bits out of the range "
+                       "supported by the run-time");
+  }
+  for (unsigned i = 0; i < m_metadata_calls.size(); ++i) {
+    inlineMetadataAccess(m_metadata_calls[i]);
+  }
+  m_metadata_calls.clear();
+
   renameFunctions(module);
   DEBUG(errs()<<"Done with SoftBoundCETSPass\n");
   
@@ -0,0 +1,366 @@
+//===- CheckProfile.cpp - Per-site execution counts of run-time checks -----===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements passes that count how often each run-time check
+// executes and that load the resulting profile for use by the optimizer.
+//
+// The profile is a text file with one line per check site:
+//
+//    <count> <site name>
+//
+// Lines naming the same site are summed so that the profiles of several
+// training runs can simply be concatenated.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "sc-check-profile"
+
+#include "safecode/CheckInfo.h"
+#include "safecode/CheckProfile.h"
+#include "safecode/Utility.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <cstdlib>
+
+namespace llvm {
+
+char CheckProfileInstrument::ID = 0;
+char CheckProfile::ID = 0;
+
+static RegisterPass<CheckProfileInstrument>
+X ("sc-check-profile-instrument", "Count executions of run-time checks");
+
+static RegisterPass<CheckProfile>
+Y ("sc-check-profile", "Run-time check execution profile", false, true);
+
+namespace {
+  cl::opt<std::string>
+  ProfileFile ("sc-check-profile-file",
+               cl::desc("Read run-time check counts from this file"),
+               cl::init(""));
+
+  cl::opt<double>
+  HotRatio ("sc-check-profile-hot-ratio",
+            cl::desc("Fraction of all check executions above which a check "
+                     "is hot"),
+            cl::init(0.001));
+
+  STATISTIC (InstrumentedSites, "Number of check sites given counters");
+  STATISTIC (ProfiledSites, "Number of check sites found in the profile");
+}
+
+//
+// Function: getCheckSites()
+//
+// Description:
+//  Find the calls to run-time checks within the function and append them to
+//  the list in the order in which they appear within the function.
+//
+void
+getCheckSites (Function & F, std::vector<CallInst *> & Sites) {
+  for (Function::iterator BB = F.begin(); BB != F.end(); ++BB) {
+    for (BasicBlock::iterator I = BB->begin(); I != BB->end(); ++I) {
+      if (CallInst * CI = dyn_cast<CallInst>(I)) {
+        Function * Callee = CI->getCalledFunction();
+        if (Callee && isRuntimeCheck (Callee))
+          Sites.push_back (CI);
+      }
+    }
+  }
+}
+
+//
+// Function: getCheckSiteName()
+//
+// Description:
+//  Return the name under which the profile records the specified check site.
+//  Functions with internal linkage are qualified with the module name so that
+//  static functions of different source files do not collide.
+//
+std::string
+getCheckSiteName (const CallInst * CI, unsigned Index) {
+  const Function * F = CI->getParent()->getParent();
+  std::string Name;
+  raw_string_ostream OS (Name);
+  if (F->hasLocalLinkage())
+    OS << F->getParent()->getModuleIdentifier() << ":";
+  OS << F->getName() << ":" << Index << ":"
+     << CI->getCalledFunction()->getName();
+  return OS.str();
+}
+
+//
+// Method: instrumentSite()
+//
+// Description:
+//  Increment the specified counter right before the run-time check executes.
+//
+void
+CheckProfileInstrument::instrumentSite (GlobalVariable * Counters,
+                                        unsigned Index,
+                                        CallInst * CI) {
+  LLVMContext & Context = CI->getContext();
+  Type * Int64Ty = Type::getInt64Ty (Context);
+  Value * Indices[] = {
+    ConstantInt::get (Int64Ty, 0),
+    ConstantInt::get (Int64Ty, Index)
+  };
+  Constant * Counter = ConstantExpr::getInBoundsGetElementPtr (
+    Counters->getType()->getElementType(), Counters, Indices);
+
+  LoadInst * OldValue = new LoadInst (Counter, "count", CI);
+  Instruction * NewValue = BinaryOperator::Create (BinaryOperator::Add,
+                                                   OldValue,
+                                                   ConstantInt::get (Int64Ty, 1),
+                                                   "count",
+                                                   CI);
+  new StoreInst (NewValue, Counter, CI);
+  return;
+}
+
+//
+// Method: registerSites()
+//
+// Description:
+//  Create a constructor that hands the counters and the site names of this
+//  module to the counting run-time before main() runs.
+//
+void
+CheckProfileInstrument::registerSites (Module & M,
+                                       GlobalVariable * Counters,
+                                       GlobalVariable * Names,
+                                       unsigned NumSites) {
+  LLVMContext & Context = M.getContext();
+  Type * VoidTy  = Type::getVoidTy (Context);
+  Type * Int32Ty = Type::getInt32Ty (Context);
+  Type * Int64PtrTy = Type::getInt64PtrTy (Context);
+  Type * NamesTy = PointerType::getUnqual (getVoidPtrType (Context));
+
+  Constant * Register = M.getOrInsertFunction ("DYN_COUNT_registerSites",
+                                               VoidTy,
+                                               Int64PtrTy,
+                                               NamesTy,
+                                               Int32Ty,
+                                               NULL);
+
+  FunctionType * CtorTy = FunctionType::get (VoidTy, false);
+  Function * Ctor = Function::Create (CtorTy,
+                                      GlobalValue::InternalLinkage,
+                                      "sc.register_check_sites",
+                                      &M);
+  Ctor->setDoesNotThrow();
+  BasicBlock * BB = BasicBlock::Create (Context, "entry", Ctor);
+
+  Value * Args[] = {
+    ConstantExpr::getPointerCast (Counters, Int64PtrTy),
+    ConstantExpr::getPointerCast (Names, NamesTy),
+    ConstantInt::get (Int32Ty, NumSites)
+  };
+  CallInst::Create (Register, Args, "", BB);
+  ReturnInst::Create (Context, BB);
+
+  appendToGlobalCtors (M, Ctor, 65535);
+  return;
+}
+
+//
+// Method: runOnModule()
+//
+// Description:
+//  Entry point for this pass.
+//
+bool
+CheckProfileInstrument::runOnModule (Module & M) {
+  //
+  // Collect the check sites of every function and name them.
+  //
+  std::vector<CallInst *> Sites;
+  std::vector<Constant *> SiteNames;
+  for (Module::iterator F = M.begin(); F != M.end(); ++F) {
+    if (F->isDeclaration())
+      continue;
+
+    unsigned First = Sites.size();
+    getCheckSites (*F, Sites);
+    for (unsigned index = First; index < Sites.size(); ++index) {
+      std::string Name = getCheckSiteName (Sites[index], index - First);
+      Constant * Init = ConstantDataArray::getString (M.getContext(), Name);
+      GlobalVariable * GV = new GlobalVariable (M,
+                                                Init->getType(),
+                                                true,
+                                                GlobalValue::PrivateLinkage,
+                                                Init,
+                                                "sc.check_site_name");
+      GV->setUnnamedAddr (true);
+      SiteNames.push_back (ConstantExpr::getPointerCast (GV,
+                                                         getVoidPtrType (M)));
+    }
+  }
+
+  if (Sites.empty())
+    return false;
+
+  //
+  // Create the counters and the table of site names.
+  //
+  ArrayType * CountersTy = ArrayType::get (Type::getInt64Ty (M.getContext()),
+                                           Sites.size());
+  GlobalVariable * Counters =
+    new GlobalVariable (M,
+                        CountersTy,
+                        false,
+                        GlobalValue::InternalLinkage,
+                        ConstantAggregateZero::get (CountersTy),
+                        "sc.check_counts");
+
+  ArrayType * NamesTy = ArrayType::get (getVoidPtrType (M), SiteNames.size());
+  GlobalVariable * Names =
+    new GlobalVariable (M,
+                        NamesTy,
+                        true,
+                        GlobalValue::InternalLinkage,
+                        ConstantArray::get (NamesTy, SiteNames),
+                        "sc.check_sites");
+
+  for (unsigned index = 0; index < Sites.size(); ++index) {
+    instrumentSite (Counters, index, Sites[index]);
+    ++InstrumentedSites;
+  }
+
+  registerSites (M, Counters, Names, Sites.size());
+  return true;
+}
+
+CheckProfile::CheckProfile (const std::string & Filename) :
+  ImmutablePass (ID), Filename (Filename), TotalCount (0) {
+  if (this->Filename.empty())
+    this->Filename = ProfileFile;
+}
+
+//
+// Method: initializePass()
+//
+// Description:
+//  Read the profile.  A missing or malformed profile is reported and treated
+//  as empty so that the compilation proceeds as if no profile was given.
+//
+void
+CheckProfile::initializePass () {
+  if (Filename.empty())
+    return;
+
+  ErrorOr<std::unique_ptr<MemoryBuffer> > Buffer =
+    MemoryBuffer::getFile (Filename);
+  if (!Buffer) {
+    errs() << "SAFECode: cannot read check profile " << Filename << ": "
+           << Buffer.getError().message() << "\n";
+    return;
+  }
+
+  SmallVector<StringRef, 64> Lines;
+  (*Buffer)->getBuffer().split (Lines, "\n", -1, false);
+  for (unsigned index = 0; index < Lines.size(); ++index) {
+    std::pair<StringRef, StringRef> Fields = Lines[index].trim().split (' ');
+    uint64_t Count;
+    if (Fields.second.empty() || Fields.first.getAsInteger (10, Count)) {
+      errs() << "SAFECode: ignoring malformed line " << (index + 1)
+             << " of check profile " << Filename << "\n";
+      continue;
+    }
+
+    Counts[Fields.second.trim()] += Count;
+    TotalCount += Count;
+  }
+}
+
+//
+// Method: numberFunction()
+//
+// Description:
+//  Look up the execution counts of all check sites of the function.  This is
+//  done once per function, before any pass using the profile moves checks
+//  around, so that the site numbering matches the instrumented program.
+//
+void
+CheckProfile::numberFunction (const Function * F) {
+  if (!Numbered.insert (F).second)
+    return;
+
+  std::vector<CallInst *> Sites;
+  getCheckSites (*const_cast<Function *>(F), Sites);
+  for (unsigned index = 0; index < Sites.size(); ++index) {
+    StringMap<uint64_t>::iterator i = Counts.find (getCheckSiteName (Sites[index],
+                                                                     index));
+    if (i != Counts.end()) {
+      SiteCounts[Sites[index]] = i->second;
+      ++ProfiledSites;
+    }
+  }
+}
+
+//
+// Method: getCount()
+//
+// Description:
+//  Find how often the specified run-time check executed in the profiled runs.
+//
+// Return value:
+//  true  - The profile records the check; Count holds its execution count.
+//  false - The profile does not mention the check.
+//
+bool
+CheckProfile::getCount (const CallInst * CI, uint64_t & Count) {
+  if (!hasProfile())
+    return false;
+
+  numberFunction (CI->getParent()->getParent());
+  ValueMap<const CallInst *, uint64_t>::iterator i = SiteCounts.find (CI);
+  if (i == SiteCounts.end())
+    return false;
+
+  Count = i->second;
+  return true;
+}
+
+//
+// Method: isHot()
+//
+// Description:
+//  Determine whether the check accounts for at least the -sc-check-profile-
+//  hot-ratio fraction of all check executions in the profile.
+//
+bool
+CheckProfile::isHot (const CallInst * CI) {
+  uint64_t Count;
+  if (!getCount (CI, Count) || !Count)
+    return false;
+  return Count >= HotRatio * TotalCount;
+}
+
+//
+// Method: isCold()
+//
+// Description:
+//  Determine whether the profile records the check and the check is not hot.
+//
+bool
+CheckProfile::isCold (const CallInst * CI) {
+  uint64_t Count;
+  if (!getCount (CI, Count))
+    return false;
+  return !isHot (CI);
+}
+
+}
@@ -0,0 +1,416 @@
+//===- CheckReport.cpp - Per-function report of run-time checks ------------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements passes that report, for every function, how many
+// run-time checks of each kind it holds after each stage of the SAFECode
+// pipeline, how many objects it registers, and the estimated cost of the
+// checks that remain.  The report is a JSON file:
+//
+//  {"module":"foo.c","stages":["instrumented",...],"functions":[
+//    {"name":"main","stages":[{"stage":"instrumented","checks":12,
+//      "fast":4,"slow":8,"registrations":3,"kinds":{"exactcheck2":4,...}},
+//      ...],
+//     "cost":812.5,
+//     "hottest":[{"site":"main:3:poolcheck_debug","kind":"poolcheck",
+//       "location":"foo.c:17","frequency":64,"cost":640},...]},
+//    ...]}
+//
+// The cost of a check is its execution frequency relative to one invocation
+// of the function, as estimated by BlockFrequencyInfo, times a rough relative
+// cost of its kind: checks that compare against known bounds cost 1, indirect
+// call checks 2, and checks that look up the object in the run-time's object
+// registry 10.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "sc-check-report"
+
+#include "safecode/CheckInfo.h"
+#include "safecode/CheckProfile.h"
+#include "safecode/CheckReport.h"
+
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+namespace llvm {
+
+char CheckReport::ID = 0;
+char CheckReportStage::ID = 0;
+char CheckReportWriter::ID = 0;
+
+static RegisterPass<CheckReport>
+X ("sc-check-report", "Run-time check report", false, true);
+
+static RegisterPass<CheckReportStage>
+Y ("sc-check-report-stage", "Record run-time checks for the report");
+
+static RegisterPass<CheckReportWriter>
+Z ("sc-check-report-write", "Write the run-time check report");
+
+namespace {
+  cl::opt<std::string>
+  ReportFile ("sc-check-report-file",
+              cl::desc("Write a report of the run-time checks to this file"),
+              cl::init(""));
+
+  cl::opt<unsigned>
+  NumHottest ("sc-check-report-hottest",
+              cl::desc("Number of hottest checks to report per function"),
+              cl::init(5));
+}
+
+//
+// The prefixes of the names of the run-time functions that register objects.
+//
+static const char * RegistrationPrefixes[] = {
+  "pool_register",
+  "pool_reregister",
+  "__pool_register",
+  "poolargvregister",
+  "__sc_bb_src_poolregister",
+  0
+};
+
+//
+// Function: isRegistration()
+//
+// Description:
+//  Determine whether the function registers objects with the run-time.
+//
+static bool
+isRegistration (const Function * F) {
+  StringRef Name = F->getName();
+  for (unsigned index = 0; RegistrationPrefixes[index]; ++index)
+    if (Name.startswith (RegistrationPrefixes[index]))
+      return true;
+  return false;
+}
+
+//
+// Function: getCheckKind()
+//
+// Description:
+//  Return the kind of a run-time check: the name of the check without the
+//  suffix of its debug version.
+//
+static StringRef
+getCheckKind (const CallInst * CI) {
+  StringRef Name = CI->getCalledFunction()->getName();
+  if (Name.endswith ("_debug"))
+    Name = Name.drop_back (strlen ("_debug"));
+  return Name;
+}
+
+//
+// Function: isFastCheck()
+//
+// Description:
+//  Determine whether a check compares the pointer against bounds that the
+//  code passes to it instead of looking the object up.
+//
+static bool
+isFastCheck (StringRef Kind) {
+  return (Kind == "exactcheck2") || (Kind == "fastlscheck");
+}
+
+//
+// Function: getCheckCost()
+//
+// Description:
+//  Return the cost of one execution of a check of the given kind relative to
+//  the cost of a fast check.
+//
+static double
+getCheckCost (const CallInst * CI) {
+  StringRef Kind = getCheckKind (CI);
+  if (isFastCheck (Kind))
+    return 1;
+
+  const CheckInfo * Info = findRuntimeCheck (CI->getCalledFunction());
+  if (Info && Info->checkType == funccheck)
+    return 2;
+  return 10;
+}
+
+//
+// Function: getLocation()
+//
+// Description:
+//  Return the source location of an instruction as "file:line", or an empty
+//  string if it has no debug information.
+//
+static std::string
+getLocation (const Instruction * I) {
+  const DILocation * Loc = I->getDebugLoc();
+  if (!Loc)
+    return "";
+
+  std::string Location;
+  raw_string_ostream OS (Location);
+  OS << Loc->getFilename() << ":" << Loc->getLine();
+  return OS.str();
+}
+
+//
+// Function: writeString()
+//
+// Description:
+//  Write a string as a quoted JSON string.
+//
+static void
+writeString (raw_ostream & OS, StringRef S) {
+  OS << '"';
+  for (unsigned index = 0; index < S.size(); ++index) {
+    unsigned char C = S[index];
+    if ((C == '"') || (C == '\\'))
+      OS << '\\' << C;
+    else if (C == '\n')
+      OS << "\\n";
+    else if (C < 0x20)
+      OS << format ("\\u%04x", C);
+    else
+      OS << C;
+  }
+  OS << '"';
+}
+
+CheckReport::CheckReport (const std::string & Filename) :
+  ImmutablePass (ID), Filename (Filename) {
+  if (this->Filename.empty())
+    this->Filename = ReportFile;
+}
+
+//
+// Method: getFunctionReport()
+//
+// Description:
+//  Return the report of the specified function, creating it if needed.
+//
+CheckReport::FunctionReport &
+CheckReport::getFunctionReport (const Function & F) {
+  return Functions[F.getName()];
+}
+
+//
+// Method: recordStage()
+//
+// Description:
+//  Count the checks and registrations of every function of the module and
+//  record them under the given stage.  Functions are recorded once they have
+//  held a check or a registration, so that their counts dropping to zero
+//  shows up in later stages.
+//
+void
+CheckReport::recordStage (Module & M, const std::string & Stage) {
+  if (!isEnabled())
+    return;
+
+  Stages.push_back (Stage);
+  for (Module::iterator F = M.begin(); F != M.end(); ++F) {
+    if (F->isDeclaration())
+      continue;
+
+    StageCounts Counts;
+    Counts.Stage = Stage;
+    Counts.Slow = Counts.Fast = Counts.Registrations = 0;
+    for (Function::iterator BB = F->begin(); BB != F->end(); ++BB) {
+      for (BasicBlock::iterator I = BB->begin(); I != BB->end(); ++I) {
+        CallInst * CI = dyn_cast<CallInst>(I);
+        Function * Callee = CI ? CI->getCalledFunction() : 0;
+        if (!Callee)
+          continue;
+
+        if (isRuntimeCheck (Callee)) {
+          StringRef Kind = getCheckKind (CI);
+          ++Counts.Kinds[Kind];
+          if (isFastCheck (Kind))
+            ++Counts.Fast;
+          else
+            ++Counts.Slow;
+        } else if (isRegistration (Callee)) {
+          ++Counts.Registrations;
+        }
+      }
+    }
+
+    bool Empty = Counts.Kinds.empty() && !Counts.Registrations;
+    if (Empty && !Functions.count (F->getName()))
+      continue;
+    Functions[F->getName()].Stages.push_back (Counts);
+  }
+}
+
+//
+// Method: write()
+//
+// Description:
+//  Write the report to its file.
+//
+// Return value:
+//  true  - The report was written.
+//  false - The file could not be written; the error has been reported.
+//
+bool
+CheckReport::write (Module & M) {
+  std::error_code EC;
+  raw_fd_ostream OS (Filename, EC, sys::fs::F_Text);
+  if (EC) {
+    errs() << "SAFECode: cannot write check report " << Filename << ": "
+           << EC.message() << "\n";
+    return false;
+  }
+
+  OS << "{\"module\":";
+  writeString (OS, M.getModuleIdentifier());
+  OS << ",\"stages\":[";
+  for (unsigned index = 0; index < Stages.size(); ++index) {
+    if (index) OS << ",";
+    writeString (OS, Stages[index]);
+  }
+  OS << "],\"functions\":[";
+
+  bool FirstFunction = true;
+  std::map<std::string, FunctionReport>::iterator F;
+  for (F = Functions.begin(); F != Functions.end(); ++F) {
+    OS << (FirstFunction ? "\n" : ",\n") << " {\"name\":";
+    FirstFunction = false;
+    writeString (OS, F->first);
+
+    OS << ",\"stages\":[";
+    const std::vector<StageCounts> & Counts = F->second.Stages;
+    for (unsigned index = 0; index < Counts.size(); ++index) {
+      if (index) OS << ",";
+      OS << "\n  {\"stage\":";
+      writeString (OS, Counts[index].Stage);
+      OS << ",\"checks\":" << (Counts[index].Fast + Counts[index].Slow)
+         << ",\"fast\":" << Counts[index].Fast
+         << ",\"slow\":" << Counts[index].Slow
+         << ",\"registrations\":" << Counts[index].Registrations
+         << ",\"kinds\":{";
+      std::map<std::string, unsigned>::const_iterator K;
+      for (K = Counts[index].Kinds.begin();
+           K != Counts[index].Kinds.end();
+           ++K) {
+        if (K != Counts[index].Kinds.begin()) OS << ",";
+        writeString (OS, K->first);
+        OS << ":" << K->second;
+      }
+      OS << "}}";
+    }
+
+    OS << "],\n  \"cost\":" << format ("%.2f", F->second.Cost)
+       << ",\"hottest\":[";
+    const std::vector<HotCheck> & Hottest = F->second.Hottest;
+    for (unsigned index = 0; index < Hottest.size(); ++index) {
+      if (index) OS << ",";
+      OS << "\n  {\"site\":";
+      writeString (OS, Hottest[index].Site);
+      OS << ",\"kind\":";
+      writeString (OS, Hottest[index].Kind);
+      OS << ",\"location\":";
+      writeString (OS, Hottest[index].Location);
+      OS << ",\"frequency\":" << format ("%.2f", Hottest[index].Frequency)
+         << ",\"cost\":" << format ("%.2f", Hottest[index].Cost) << "}";
+    }
+    OS << "]}";
+  }
+  OS << "]}\n";
+  return true;
+}
+
+//
+// Method: runOnModule()
+//
+// Description:
+//  Entry point for this pass.
+//
+bool
+CheckReportStage::runOnModule (Module & M) {
+  getAnalysis<CheckReport>().recordStage (M, Stage);
+  return false;
+}
+
+void
+CheckReportWriter::getAnalysisUsage (AnalysisUsage & AU) const {
+  AU.addRequired<CheckReport>();
+  AU.addRequired<BlockFrequencyInfo>();
+  AU.setPreservesAll();
+}
+
+//
+// Function: isHotter()
+//
+// Description:
+//  Order checks from the most to the least costly.
+//
+static bool
+isHotter (const CheckReport::HotCheck & A, const CheckReport::HotCheck & B) {
+  return A.Cost > B.Cost;
+}
+
+//
+// Method: runOnModule()
+//
+// Description:
+//  Entry point for this pass.
+//
+bool
+CheckReportWriter::runOnModule (Module & M) {
+  CheckReport & Report = getAnalysis<CheckReport>();
+  if (!Report.isEnabled())
+    return false;
+
+  Report.recordStage (M, "final");
+
+  //
+  // Estimate the cost of the checks remaining in each function.
+  //
+  for (Module::iterator F = M.begin(); F != M.end(); ++F) {
+    if (F->isDeclaration())
+      continue;
+
+    std::vector<CallInst *> Sites;
+    getCheckSites (*F, Sites);
+    if (Sites.empty())
+      continue;
+
+    BlockFrequencyInfo & BFI = getAnalysis<BlockFrequencyInfo>(*F);
+    double EntryFreq = BFI.getEntryFreq();
+    CheckReport::FunctionReport & FR = Report.getFunctionReport (*F);
+    std::vector<CheckReport::HotCheck> Checks;
+    for (unsigned index = 0; index < Sites.size(); ++index) {
+      CallInst * CI = Sites[index];
+      CheckReport::HotCheck Check;
+      Check.Site = getCheckSiteName (CI, index);
+      Check.Kind = getCheckKind (CI);
+      Check.Location = getLocation (CI);
+      Check.Frequency = BFI.getBlockFreq (CI->getParent()).getFrequency() /
+                        EntryFreq;
+      Check.Cost = Check.Frequency * getCheckCost (CI);
+      FR.Cost += Check.Cost;
+      Checks.push_back (Check);
+    }
+
+    std::stable_sort (Checks.begin(), Checks.end(), isHotter);
+    if (Checks.size() > NumHottest)
+      Checks.resize (NumHottest);
+    FR.Hottest = Checks;
+  }
+
+  Report.write (M);
+  return false;
+}
+
+}
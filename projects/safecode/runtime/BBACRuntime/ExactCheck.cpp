@@ -21,6 +21,7 @@
 #include "safecode/Runtime/BBRuntime.h"
 #include "safecode/Runtime/BBMetaData.h"
 #include "../include/CWE.h"
+#include "../include/ExactCheck.h"
 
 #include <stdint.h>
 
@@ -86,7 +87,7 @@ bb_exactcheck2 (char *source, char *base, char *result, unsigned size) {
    * If the pointer is within the object, the check passes.  Return the checked
    * pointer.
    */
-  if ((result >= base) && (result < (base + size))) {
+  if (__builtin_expect (isInBounds (base, result, size), 1)) {
     return (void*)result;
   }
 
@@ -132,7 +133,7 @@ exactcheck2_debug (char *source,
    * If the pointer is within the object, the check passes.  Return the checked
    * pointer.
    */
-  if ((result >= base) && (result < (base + size))) {
+  if (__builtin_expect (isInBounds (base, result, size), 1)) {
     return (void*) result;
   }
 
@@ -26,6 +26,7 @@
 #include "safecode/Runtime/BBRuntime.h"
 
 #include "../include/CWE.h"
+#include "../include/FuncTargetSet.h"
 
 #include <map>
 #include <cstdarg>
@@ -64,20 +65,26 @@ _barebone_pointers_in_bounds(uintptr_t Source, uintptr_t Dest) {
   //
   // Look for the bounds in the table.
   //
+#ifdef SC_BB_TAGGED_OOB
+  // A tagged OOB pointer is never in bounds.
+  if (isTaggedPtr(Source)) return 1;
+#endif
   unsigned char e;
   e = __baggybounds_size_table_begin[Source >> SLOT_SIZE];
   // The object is not registed, so it cannot be checked.
   if (e == 0) return 0; 
   //
   // Currently we does not support alignment that is larger than one page size
-  // in 32bit Linux
+  // in 32bit Linux.  The size table on x86-64 covers objects of any size.
   //
+#ifndef SC_BB_TAGGED_OOB
   if (e > 12) return 0;
+#endif
   //
   // Get the bounds for the object in which Source was found.
   //
-  uintptr_t begin = Source & ~((1<<e)-1);
-  BBMetaData *data = (BBMetaData*)(begin + (1<<e) - sizeof(BBMetaData));
+  uintptr_t begin = Source & ~(((uintptr_t)1<<e)-1);
+  BBMetaData *data = (BBMetaData*)(begin + ((uintptr_t)1<<e) - sizeof(BBMetaData));
   if (data->size == 0) return 0;
   uintptr_t end = begin + data->size;
   //
@@ -88,39 +95,58 @@ _barebone_pointers_in_bounds(uintptr_t Source, uintptr_t Dest) {
 }
 
 //
-// Function: _barebone_boundscheck()
+// Function: _barebone_make_oob()
 //
 // Description:
-//  Perform an accurate bounds check for the given pointer.  This function
-//  encapsulates the logic necessary to do the check.
+//  Create an OOB pointer for an address outside of the object in which Source
+//  was found.  Where possible, the object is encoded into the pointer itself;
+//  otherwise, the pointer is rewritten.
+//
+static inline void *
+_barebone_make_oob (uintptr_t Source, uintptr_t Dest) {
+#ifdef SC_BB_TAGGED_OOB
+  unsigned char e = __baggybounds_size_table_begin[Source >> SLOT_SIZE];
+  uintptr_t Tagged;
+  if (tagPointer (Dest, Source & ~(((uintptr_t)1 << e) - 1), e, Tagged))
+    return (void *) Tagged;
+#endif
+  return rewrite_ptr(NULL, (void *)Dest, 0, 0, 0, 0);
+}
+
+//
+// Function: _barebone_recheck()
+//
+// Description:
+//  Finish a bounds check that failed the fast path: either Dest is outside of
+//  the object in which Source was found, or Source is an OOB pointer.
 //
 // Return value:
-//  The dest pointer if it is in bounds, else an OOB pointer.
-//  
+//  The real dest pointer if it is in bounds, else an OOB pointer.
 //
 static inline void*
-_barebone_boundscheck (uintptr_t Source, uintptr_t Dest) {
-
+_barebone_recheck (uintptr_t Source, uintptr_t Dest) {
   uintptr_t val = 1 ;
   void * RealSrc = (void *)Source;
   void * RealDest = (void *)Dest;
+  if (!isRewritePtr((void *)Source)) {
+    // Dest is not within the valid object in which Source was found.
+    return _barebone_make_oob(Source, Dest);
+  }
 
+#ifdef SC_BB_TAGGED_OOB
   //
-  // Check the bounds of the pointers.
-  //
-  val = _barebone_pointers_in_bounds(Source, Dest);
-  if(!val) return RealDest;
-
-  //
-  // Either:
-  //  1) Dest is not within the valid object in which Source was found or
-  //  2) Source is an OOB pointer.
+  // A tagged OOB pointer names the object from which it came.  Check the
+  // real result pointer against that object rather than against whatever
+  // object the OOB address happens to fall into.
   //
-  if (!isRewritePtr((void *)Source)) {
-    // Dest is not within the valid object in which Source was found.
-    RealDest = rewrite_ptr(NULL, RealDest, 0, 0, 0, 0);
-    return RealDest;
+  if (isTaggedPtr(Source)) {
+    uintptr_t ObjStart = getTaggedObject(Source);
+    uintptr_t RealDestAddr = getTaggedAddress(Source) + (Dest - Source);
+    if (!_barebone_pointers_in_bounds(ObjStart, RealDestAddr))
+      return (void *)RealDestAddr;
+    return _barebone_make_oob(ObjStart, RealDestAddr);
   }
+#endif
 
   //
   // This means that Source is an OOB pointer. Compute the original source.
@@ -135,35 +161,40 @@ _barebone_boundscheck (uintptr_t Source, uintptr_t Dest) {
   //
   val = _barebone_pointers_in_bounds((uintptr_t)RealSrc, (uintptr_t)RealDest);
   if (!val) return RealDest;
-   
+
   RealDest = rewrite_ptr(NULL, RealDest, 0, 0, 0, 0);
   return RealDest;
 }
 
-extern "C" void*
-__sc_bb_getActualValueAndCheckAgain (uintptr_t Source, uintptr_t Dest) {
-  uintptr_t val = 1 ;
-  void * RealSrc = (void *)Source;
-  void * RealDest = (void *)Dest;
-  if (!isRewritePtr((void *)Source)) {
-    // Dest is not within the valid object in which Source was found.
-    RealDest = rewrite_ptr(NULL, RealDest, 0, 0, 0, 0);
-    return RealDest;
-  }
-
-  RealSrc = pchk_getActualValue(NULL, (void *)Source);
+//
+// Function: _barebone_boundscheck()
+//
+// Description:
+//  Perform an accurate bounds check for the given pointer.  This function
+//  encapsulates the logic necessary to do the check.
+//
+// Return value:
+//  The dest pointer if it is in bounds, else an OOB pointer.
+//  
+//
+static inline void*
+_barebone_boundscheck (uintptr_t Source, uintptr_t Dest) {
   //
-  // Compute the real result pointer.
+  // Check the bounds of the pointers.
   //
-  RealDest = (void *)((intptr_t) RealSrc + Dest - Source);
+  if (!_barebone_pointers_in_bounds(Source, Dest)) return (void *)Dest;
+
   //
-  // Re-check the real result pointer.
+  // Either:
+  //  1) Dest is not within the valid object in which Source was found or
+  //  2) Source is an OOB pointer.
   //
-  val = _barebone_pointers_in_bounds((uintptr_t)RealSrc, (uintptr_t)RealDest);
-  if (!val) return RealDest;
+  return _barebone_recheck(Source, Dest);
+}
 
-  RealDest = rewrite_ptr(NULL, RealDest, 0, 0, 0, 0);
-  return RealDest;
+extern "C" void*
+__sc_bb_getActualValueAndCheckAgain (uintptr_t Source, uintptr_t Dest) {
+  return _barebone_recheck(Source, Dest);
 }
 
 //
@@ -217,8 +248,8 @@ bb_poolcheck_debug (DebugPoolTy *Pool,
   e = __baggybounds_size_table_begin[(uintptr_t)Node >> SLOT_SIZE];
   if (e == 0) return;
 
-  uintptr_t ObjStart = (uintptr_t)Node & ~((1<<e)-1);
-  BBMetaData *data = (BBMetaData*)(ObjStart + (1<<e) - sizeof(BBMetaData));
+  uintptr_t ObjStart = (uintptr_t)Node & ~(((uintptr_t)1 << e) - 1);
+  BBMetaData *data = (BBMetaData*)(ObjStart + ((uintptr_t)1 << e) - sizeof(BBMetaData));
   uintptr_t ObjEnd = ObjStart + data->size - 1;
 
   uintptr_t NodeEnd = (uintptr_t)Node + length -1;
@@ -281,8 +312,8 @@ bb_poolcheckui_debug (DebugPoolTy *Pool,
   e = __baggybounds_size_table_begin[(uintptr_t)Node >> SLOT_SIZE];
   if (e == 0) return;
 
-  uintptr_t ObjStart = (uintptr_t)Node & ~((1<<e)-1);
-  BBMetaData *data = (BBMetaData*)(ObjStart + (1<<e) - sizeof(BBMetaData));
+  uintptr_t ObjStart = (uintptr_t)Node & ~(((uintptr_t)1 << e) - 1);
+  BBMetaData *data = (BBMetaData*)(ObjStart + ((uintptr_t)1 << e) - sizeof(BBMetaData));
   uintptr_t ObjEnd = ObjStart + data->size - 1;
 
   uintptr_t NodeEnd = (uintptr_t)Node + length -1;
@@ -631,6 +662,27 @@ bb_poolcheck_freeui_debug (DebugPoolTy *Pool,
   if (ptr == NULL)
     return;
 
+#ifdef SC_BB_TAGGED_OOB
+  //
+  // A tagged OOB pointer never points to the beginning of an object, and its
+  // high bits would index far past the end of the size table.  Report the
+  // object that the tag names.
+  //
+  if (isTaggedPtr ((uintptr_t)ptr)) {
+    OutOfBoundsViolation v;
+    v.type = ViolationInfo::FAULT_INVALID_FREE,
+      v.faultPC = __builtin_return_address(0),
+      v.faultPtr = (void *)getTaggedAddress ((uintptr_t)ptr),
+      v.CWE = CWEFreeNotStart,
+      v.SourceFile = SourceFilep,
+      v.lineNo = lineno,
+      v.objStart = (void *)getTaggedObject ((uintptr_t)ptr);
+      v.objLen = (uintptr_t)1 << getTaggedSize ((uintptr_t)ptr);
+    ReportMemoryViolation(&v);
+    return;
+  }
+#endif
+
   //
   // Retrieve the bounds information for the object.  Use the pool that tracks
   // debug information since we're in debug mode.
@@ -638,8 +690,14 @@ bb_poolcheck_freeui_debug (DebugPoolTy *Pool,
   unsigned char e;
   e = __baggybounds_size_table_begin[(uintptr_t)ptr >> SLOT_SIZE];
 
-  uintptr_t ObjStart = (uintptr_t)ptr & ~((1<<e)-1);
-  BBMetaData *data = (BBMetaData*)(ObjStart + (1<<e) - sizeof(BBMetaData));
+  //
+  // The object is not registered, so there is no meta-data to read.
+  //
+  if (e == 0)
+    return;
+
+  uintptr_t ObjStart = (uintptr_t)ptr & ~(((uintptr_t)1 << e) - 1);
+  BBMetaData *data = (BBMetaData*)(ObjStart + ((uintptr_t)1 << e) - sizeof(BBMetaData));
   uintptr_t ObjLen = data->size;
 
   //
@@ -761,6 +819,55 @@ funccheck_debug (void *f,
   return;
 }
 
+//
+// Function: funccheck_hashed_init()
+//
+// Description:
+//  Build the hash index of a target set.  The compiler calls this from a
+//  constructor for every target set that it creates.
+//
+extern "C" void
+funccheck_hashed_init (FuncTargetSet * set) {
+  initTargetSet (set);
+  return;
+}
+
+//
+// Function: funccheck_hashed()
+//
+// Description:
+//  Determine whether the specified function pointer is one of the functions
+//  in the given target set.  On failure, the target list is handed to
+//  __sc_bb_funccheck() to report the error.
+//
+// Inputs:
+//  f   - The function pointer that we are testing.
+//  set - The set of potential targets.
+//
+extern "C" void
+funccheck_hashed (void *f, FuncTargetSet * set) {
+  if (!isInTargetSet (f, set))
+    __sc_bb_funccheck(f, set->targets, 0, NULL, 0);
+  return;
+}
+
+//
+// Function: funccheck_hashed_debug()
+//
+// Description:
+//  This is the debug version of funccheck_hashed().
+//
+extern "C" void
+funccheck_hashed_debug (void *f,
+                        FuncTargetSet * set,
+                        TAG,
+                        const char * SourceFilep,
+                        unsigned lineno) {
+  if (!isInTargetSet (f, set))
+    __sc_bb_funccheck(f, set->targets, 0, SourceFilep, lineno);
+  return;
+}
+
 //
 // Function: funccheckui()
 //
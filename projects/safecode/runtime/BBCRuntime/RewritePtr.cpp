@@ -129,6 +129,15 @@ using namespace safecode;
 //
 void *
 pchk_getActualValue (DebugPoolTy * Pool, void * p) {
+#ifdef SC_BB_TAGGED_OOB
+  //
+  // A tagged OOB pointer carries its actual value in its low bits.
+  //
+  if (isTaggedPtr ((uintptr_t) p)) {
+    return (void *) getTaggedAddress ((uintptr_t) p);
+  }
+#endif
+
   //
   // If the pointer is not within the rewrite pointer range, then it is not a
   // rewritten pointer.  Simply return its current value.
@@ -14,6 +14,8 @@
 #ifndef _SC_REWRITEPTR_H
 #define _SC_REWRITEPTR_H
 
+#include "../include/BBTaggedPtr.h"
+
 NAMESPACE_SC_BEGIN
 
 //
@@ -50,7 +52,8 @@ extern llvm::DenseMap<void *,
 //
 // Description:
 //  Determines whether the specified pointer value is a rewritten value for an
-//  Out-of-Bounds pointer value.
+//  Out-of-Bounds pointer value.  This includes tagged OOB pointers on targets
+//  that use them.
 //
 // Return value:
 //  true  - The pointer value is an OOB pointer rewrite value.
@@ -60,6 +63,11 @@ static inline bool
 isRewritePtr (void * p) {
   uintptr_t ptr = (uintptr_t) p;
 
+#ifdef SC_BB_TAGGED_OOB
+  if (isTaggedPtr (ptr))
+    return true;
+#endif
+
   if ((InvalidLower < ptr ) && (ptr < InvalidUpper))
     return true;
   return false;
@@ -89,6 +97,15 @@ getOOBObject (void * p, void * & start, void * & end) {
   extern llvm::DenseMap<void *, std::pair<void *, void * > >
   RewrittenObjs;
 
+#ifdef SC_BB_TAGGED_OOB
+  if (isTaggedPtr ((uintptr_t) p)) {
+    uintptr_t ObjStart = getTaggedObject ((uintptr_t) p);
+    start = (void *) ObjStart;
+    end   = (void *) (ObjStart + ((uintptr_t) 1 << getTaggedSize ((uintptr_t) p)) - 1);
+    return true;
+  }
+#endif
+
   if (isRewritePtr (p)) {
     // FIXME: the casts are hacks to deal with the C++ type system
     start = const_cast<void*>(RewrittenObjs[p].first);
@@ -0,0 +1,168 @@
+//===- SecondaryStack.cpp - Aligned stack for variable-sized objects -------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a per-thread secondary stack from which the compiler
+// (PromoteArrayAllocas) allocates the variable-sized stack objects of a
+// function.  Objects on it are aligned to their power-of-two slot size as
+// baggy bounds requires, so they need neither a heap allocation nor padding
+// of the program stack.
+//
+// A function saves the top of the secondary stack on entry and restores it
+// on exit.  Restoring clears the size table entries of everything allocated
+// since the save with a single memset(), so objects skipped by longjmp() or
+// by unwinding are released by the next restore further up the call chain.
+// The secondary stack of a thread is unmapped when the thread exits.
+//
+//===----------------------------------------------------------------------===//
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "safecode/Runtime/BBRuntime.h"
+
+#if __FreeBSD__ >= 11
+#define MAP_NORESERVE 0
+#endif
+
+extern unsigned char * __baggybounds_size_table_begin;
+extern unsigned SLOT_SIZE;
+extern unsigned SLOTSIZE;
+
+// Size of the address space reserved for the secondary stack of each thread
+#if defined(_LP64)
+static const size_t SecondaryStackSize = 1UL << 30;
+#else
+static const size_t SecondaryStackSize = 1UL << 26;
+#endif
+
+// Top and end of the secondary stack of this thread
+static __thread uintptr_t StackTop = 0;
+static __thread uintptr_t StackEnd = 0;
+
+// Key whose per-thread value is the base of the thread's secondary stack
+static pthread_key_t SecondaryStackKey;
+static pthread_once_t SecondaryStackKeyOnce = PTHREAD_ONCE_INIT;
+
+//
+// Function: releaseSecondaryStack()
+//
+// Description:
+//  Release the secondary stack of an exiting thread.  Objects that are still
+//  allocated (e.g., because the thread called pthread_exit()) are removed
+//  from the size table before the memory is unmapped.
+//
+static void
+releaseSecondaryStack (void * base) {
+  __sc_bb_stack_restore (base);
+  munmap (base, SecondaryStackSize);
+  StackTop = 0;
+  StackEnd = 0;
+}
+
+static void
+createSecondaryStackKey (void) {
+  if (pthread_key_create (&SecondaryStackKey, releaseSecondaryStack)) {
+    fprintf (stderr, "SAFECode: cannot create secondary stack key\n");
+    fflush (stderr);
+    abort ();
+  }
+}
+
+//
+// Function: initSecondaryStack()
+//
+// Description:
+//  Reserve the secondary stack of the calling thread.  Pages are only backed
+//  by memory once they are used.
+//
+static void
+initSecondaryStack (void) {
+  void * Addr = mmap (0,
+                      SecondaryStackSize,
+                      PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANON | MAP_NORESERVE,
+                      -1,
+                      0);
+  if (Addr == MAP_FAILED) {
+    perror ("SAFECode: cannot reserve secondary stack");
+    abort ();
+  }
+
+  StackTop = (uintptr_t) Addr;
+  StackEnd = (uintptr_t) Addr + SecondaryStackSize;
+
+  //
+  // Register the stack so that it is unmapped when the thread exits.
+  //
+  pthread_once (&SecondaryStackKeyOnce, createSecondaryStackKey);
+  pthread_setspecific (SecondaryStackKey, Addr);
+}
+
+//
+// Function: __sc_bb_stack_save()
+//
+// Description:
+//  Return the current top of the secondary stack so that a later call to
+//  __sc_bb_stack_restore() can release everything allocated after this call.
+//
+void *
+__sc_bb_stack_save (void) {
+  if (__builtin_expect (StackTop == 0, 0))
+    initSecondaryStack ();
+  return (void *) StackTop;
+}
+
+//
+// Function: __sc_bb_stack_alloc()
+//
+// Description:
+//  Allocate an object from the secondary stack.  The object is aligned to
+//  its size rounded up to a power of two.  The caller registers the object
+//  in the size table as it would any other stack object.
+//
+void *
+__sc_bb_stack_alloc (size_t size) {
+  size_t aligned_size = SLOTSIZE;
+  while (aligned_size < size)
+    aligned_size <<= 1;
+
+  uintptr_t Object = (StackTop + aligned_size - 1) & ~(aligned_size - 1);
+  if ((Object < StackTop) || (Object + aligned_size > StackEnd)) {
+    fprintf (stderr, "SAFECode: secondary stack exhausted\n");
+    fflush (stderr);
+    abort ();
+  }
+
+  StackTop = Object + aligned_size;
+  return (void *) Object;
+}
+
+//
+// Function: __sc_bb_stack_restore()
+//
+// Description:
+//  Release all objects allocated from the secondary stack since the call to
+//  __sc_bb_stack_save() that returned mark, removing them from the size
+//  table.
+//
+void
+__sc_bb_stack_restore (void * mark) {
+  uintptr_t Mark = (uintptr_t) mark;
+  if (Mark >= StackTop)
+    return;
+
+  memset (__baggybounds_size_table_begin + (Mark >> SLOT_SIZE),
+          0,
+          (StackTop - Mark) >> SLOT_SIZE);
+  StackTop = Mark;
+}
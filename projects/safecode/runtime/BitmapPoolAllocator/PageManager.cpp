@@ -44,6 +44,16 @@ uintptr_t PageSize = 0;
 
 static unsigned poolmemusage = 0;
 
+#if defined(__linux__)
+//
+// The SAFECode run-time records the memory that the program maps as external
+// objects.  It provides the system's mmap() so that the pages of the pools are
+// not recorded.
+//
+extern "C" void * __sc_system_mmap (void *, size_t, int, int, int, off_t)
+  __attribute__((weak));
+#endif
+
 // Physical page size
 uintptr_t PPageSize;
 
@@ -96,8 +106,10 @@ void *GetPages(unsigned NumPages) {
   //  void *pa = malloc(NumPages * PageSize);
   //  assert(Addr != MAP_FAILED && "MMAP FAILED!");
 #if defined(__linux__)
-  Addr = mmap(0, NumPages * PageSize, PROT_READ|PROT_WRITE,
-                                      MAP_SHARED |MAP_ANONYMOUS, -1, 0);
+  void * (*MapPages) (void *, size_t, int, int, int, off_t) =
+    __sc_system_mmap ? __sc_system_mmap : mmap;
+  Addr = MapPages(0, NumPages * PageSize, PROT_READ|PROT_WRITE,
+                                          MAP_SHARED |MAP_ANONYMOUS, -1, 0);
   if (Addr == MAP_FAILED) {
      perror ("mmap:");
      fflush (stdout);
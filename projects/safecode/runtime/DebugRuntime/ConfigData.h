@@ -31,6 +31,9 @@ struct ConfigData {
 
   // Flags whether we should track external memory allocations
   unsigned TrackExternalMallocs;
+
+  // Microseconds of CPU time between profile samples; zero if not profiling
+  unsigned ProfileInterval;
 };
 
 extern struct ConfigData ConfigData;
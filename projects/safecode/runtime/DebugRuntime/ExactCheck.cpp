@@ -17,6 +17,7 @@
 
 #include "../include/BitmapAllocator.h"
 #include "../include/CWE.h"
+#include "../include/ExactCheck.h"
 
 
 #include "PoolAllocator.h"
@@ -34,7 +35,13 @@ using namespace llvm;
 static void *
 exactcheck_check (void * Source, void * ObjStart, void * ObjEnd,
                   const void * Dest, const char * SourceFile,
-                  unsigned int lineno) __attribute__((noinline));
+                  unsigned int lineno, const void * PC)
+                  __attribute__((noinline));
+
+static void
+reportLSCheck (const char *base, const char *result, unsigned size,
+               const char * SourceFile, unsigned int lineno, const void * PC)
+               __attribute__((noinline));
 
 extern "C"
 void
@@ -44,15 +51,23 @@ failLSCheck (const char *base,
              const char * SourceFile,
              unsigned int lineno) __attribute__((noinline));
 
+//
+// Function: reportLSCheck()
+//
+// Description:
+//  Report a failed load/store check.  PC is the address at which the program
+//  called the run-time and is reported as the faulting program counter.
+//
 void
-failLSCheck (const char *base,
-             const char *result,
-             unsigned size,
-             const char * SourceFile,
-             unsigned int lineno) {
+reportLSCheck (const char *base,
+               const char *result,
+               unsigned size,
+               const char * SourceFile,
+               unsigned int lineno,
+               const void * PC) {
   DebugViolationInfo v;
   v.type = ViolationInfo::FAULT_LOAD_STORE,
-    v.faultPC = __builtin_return_address(0),
+    v.faultPC = PC,
     v.faultPtr = result,
     v.CWE = CWEBufferOverflow,
     v.PoolHandle = 0,
@@ -63,6 +78,23 @@ failLSCheck (const char *base,
   ReportMemoryViolation(&v);
 }
 
+//
+// Function: failLSCheck()
+//
+// Description:
+//  Report a failed load/store check.  Code that performs the bounds
+//  comparison inline calls this function directly.
+//
+void
+failLSCheck (const char *base,
+             const char *result,
+             unsigned size,
+             const char * SourceFile,
+             unsigned int lineno) {
+  reportLSCheck (base, result, size, SourceFile, lineno,
+                 __builtin_return_address(0));
+}
+
 /*
  * Function: fastlscheck()
  *
@@ -80,29 +112,19 @@ void
 fastlscheck (const char *base, const char *result, unsigned size,
              unsigned lslen) {
   /*
-   * If the pointer is within the object, the check passes.  Return the checked
-   * pointer.
-   */
-  const char * end = result + lslen - 1;
-  if ((result >= base) && (result < (base + size))) {
-    if ((end >= base) && (end < (base + size))) {
-      return;
-    }
-  }
-
-  /*
-   * If the memory access accesses zero bytes, don't report an error.  This can
-   * happen with load/store checks on memcpy()/memset() calls.
+   * If the memory accessed is within the object, the check passes.  Accesses
+   * of zero bytes pass as well.
    */
-  if (!lslen)
+  if (__builtin_expect (isAccessInBounds (base, result, size, lslen), 1))
     return;
 
-  failLSCheck (base, result, size, "unknown", 0);
+  reportLSCheck (base, result, size, "unknown", 0,
+                 __builtin_return_address(0));
   return;
 }
 
 /*
- * Function: fastlscheck_debug()
+ * Function: fastlscheck_at()
  *
  * Description:
  *  This function performs a fast load/store check.  If the check fails, it
@@ -112,33 +134,43 @@ fastlscheck (const char *base, const char *result, unsigned size,
  *  base   - The address of the first byte of a memory object.
  *  result - The pointer that is being checked.
  *  size   - The size of the object in bytes.
+ *  PC     - The return address of the run-time entry point called by the
+ *           program; errors are reported at this address.
  */
+static inline void
+fastlscheck_at (const char *base, const char *result, unsigned size,
+                unsigned lslen,
+                unsigned tag,
+                const char * SourceFile,
+                unsigned lineno,
+                const void * PC) {
+  /*
+   * If the memory accessed is within the object, the check passes.  Accesses
+   * of zero bytes pass as well.
+   */
+  if (__builtin_expect (isAccessInBounds (base, result, size, lslen), 1))
+    return;
+
+  reportLSCheck (base, result, size, SourceFile, lineno, PC);
+  return;
+}
+
 void
 fastlscheck_debug (const char *base, const char *result, unsigned size,
                    unsigned lslen,
                    unsigned tag,
                    const char * SourceFile,
                    unsigned lineno) {
-  /*
-   * If the pointer is within the object, the check passes.  Return the checked
-   * pointer.
-   */
-  const char * end = result + lslen - 1;
-  if ((result >= base) && (result < (base + size))) {
-    if ((end >= base) && (end < (base + size))) {
-      return;
-    }
-  }
-
-  /*
-   * If the memory access accesses zero bytes, don't report an error.  This can
-   * happen with load/store checks on memcpy()/memset() calls.
-   */
-  if (!lslen)
-    return;
+  fastlscheck_at (base, result, size, lslen, tag, SourceFile, lineno,
+                  __builtin_return_address(0));
+}
 
-  failLSCheck (base, result, size, SourceFile, lineno);
-  return;
+void
+fastlscheck_site (const char * base, const char * result, unsigned size,
+                  unsigned lsLen, const DebugSiteInfo * Site) {
+  fastlscheck_at (base, result, size, lsLen,
+                  Site->tag, Site->SourceFile, Site->lineno,
+                  __builtin_return_address(0));
 }
 
 /*
@@ -165,14 +197,15 @@ exactcheck2 (char * source, char *base, char *result, unsigned size) {
    * If the pointer is within the object, the check passes.  Return the checked
    * pointer.
    */
-  if ((result >= base) && (result < (base + size))) {
+  if (__builtin_expect (isInBounds (base, result, size), 1)) {
     return (void*)result;
   }
-  return exactcheck_check (source, base, base + size-1, result, NULL, 0);
+  return exactcheck_check (source, base, base + size-1, result, NULL, 0,
+                           __builtin_return_address(0));
 }
 
 /*
- * Function: exactcheck2_debug()
+ * Function: exactcheck2_at()
  *
  * Description:
  *  This function is identical to exactcheck2(), but the caller provides more
@@ -184,12 +217,35 @@ exactcheck2 (char * source, char *base, char *result, unsigned size) {
  *  base   - The address of the first byte of a memory object.
  *  result - The pointer that is being checked.
  *  size   - The size of the object in bytes.
+ *  PC     - The return address of the run-time entry point called by the
+ *           program; errors are reported at this address.
  *
  * Return value:
  *  If there is no bounds check violation, the result pointer is returned.
  *  This forces the call to exactcheck() to be considered live (previous
  *  optimizations dead-code eliminated it).
  */
+static inline void *
+exactcheck2_at (char *source,
+                char *base,
+                char *result,
+                unsigned size,
+                unsigned tag,
+                const char * SourceFile,
+                unsigned lineno,
+                const void * PC) {
+  /*
+   * If the pointer is within the object, the check passes.  Return the checked
+   * pointer.
+   */
+  if (__builtin_expect (isInBounds (base, result, size), 1)) {
+    return (void*) result;
+  }
+
+  return exactcheck_check (source, base, base + size - 1, result, 
+                           SourceFile, lineno, PC);
+}
+
 void *
 exactcheck2_debug (char *source,
                    char *base,
@@ -198,16 +254,16 @@ exactcheck2_debug (char *source,
                    unsigned tag,
                    const char * SourceFile,
                    unsigned lineno) {
-  /*
-   * If the pointer is within the object, the check passes.  Return the checked
-   * pointer.
-   */
-  if ((result >= base) && (result < (base + size))) {
-    return (void*) result;
-  }
+  return exactcheck2_at (source, base, result, size, tag, SourceFile, lineno,
+                         __builtin_return_address(0));
+}
 
-  return exactcheck_check (source, base, base + size - 1, result, 
-                           SourceFile, lineno);
+void *
+exactcheck2_site (char * source, char * base, char * result, unsigned size,
+                  const DebugSiteInfo * Site) {
+  return exactcheck2_at (source, base, result, size,
+                         Site->tag, Site->SourceFile, Site->lineno,
+                         __builtin_return_address(0));
 }
 
 /*
@@ -224,6 +280,7 @@ exactcheck2_debug (char *source,
  *  Dest     - The result pointer of the indexing operation (the GEP).
  *  SourceFile - The name of the file in which the check occurs.
  *  lineno     - The line number within the file in which the check occurs.
+ *  PC         - The address at which the program called the run-time.
  */
 void *
 exactcheck_check (void * Source,
@@ -231,7 +288,8 @@ exactcheck_check (void * Source,
                   void * ObjEnd,
                   const void * Dest,
                   const char * SourceFile,
-                  unsigned int lineno) {
+                  unsigned int lineno,
+                  const void * PC) {
 
   void * RealDest = const_cast<void*>(Dest);
   void * RealObjStart = ObjStart;
@@ -296,7 +354,7 @@ exactcheck_check (void * Source,
     if (logregs) {
       fprintf (ReportLog,
                "exactcheck: rewrite(1): %p %p %p at pc=%p to %p: %s %d\n",
-               RealObjStart, RealObjEnd, RealDest, (void*)__builtin_return_address(0), ptr,
+               RealObjStart, RealObjEnd, RealDest, PC, ptr,
                SourceFile, lineno);
       fflush (ReportLog);
     }
@@ -313,7 +371,7 @@ exactcheck_check (void * Source,
 
     OutOfBoundsViolation v;
     v.type = ViolationInfo::FAULT_OUT_OF_BOUNDS,
-      v.faultPC = __builtin_return_address(0),
+      v.faultPC = PC,
       v.faultPtr = RealDest,
       v.CWE = CWEBufferOverflow,
       v.PoolHandle = 0,
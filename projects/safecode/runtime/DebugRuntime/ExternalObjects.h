@@ -0,0 +1,181 @@
+//===- ExternalObjects.h - Registry of external memory objects --*- C++ -*-===//
+//
+//                            The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the set of memory objects that do not belong to a pool:
+// objects allocated by external code and the objects registered without a
+// pool.
+//
+// The objects are kept in a splay tree protected by a lock.  Every lookup that
+// misses a pool falls through to this set and usually fails, so the set also
+// keeps a page-indexed summary of the tree that answers most lookups without
+// taking the lock.  The entry of each page records the bounds of up to
+// PageSlots objects overlapping the page:
+//
+//  o A lookup finding its object in the entry of its page succeeds.
+//
+//  o A lookup in a page whose entry records all of the objects overlapping it
+//    fails if none of them holds the pointer.
+//
+//  o Lookups in the other pages search the splay tree.  A page is recorded
+//    incompletely once more than PageSlots objects overlap it, until all of
+//    them are gone.
+//
+// Objects spanning more than MaxIndexedPages pages are not recorded in the
+// summary; while there are any, lookups that the summary cannot answer
+// positively search the splay tree.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_EXTERNALOBJECTS_H_
+#define _SC_EXTERNALOBJECTS_H_
+
+#include "../include/SplayTree.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+namespace llvm {
+
+// Nonzero while the thread allocates or frees memory for the run-time itself
+extern __thread unsigned InRuntimeAllocation;
+
+//
+// Class: RuntimeAllocationScope
+//
+// Description:
+//  Mark the memory that the thread allocates and frees for the lifetime of the
+//  object as the run-time's own, so that the allocation hooks do not record it
+//  as external objects.  Scopes may nest.
+//
+class RuntimeAllocationScope {
+  public:
+    RuntimeAllocationScope () { ++InRuntimeAllocation; }
+    ~RuntimeAllocationScope () { --InRuntimeAllocation; }
+};
+
+class ExternalObjectSet {
+  public:
+    ExternalObjectSet ();
+
+    bool insert (void * start, void * end, unsigned type = 0);
+    bool remove (void * key);
+
+    bool find (void * key, void *& start, void *& end) {
+      switch (findInPages (key, start, end)) {
+        case Present: return true;
+        case Absent:  return false;
+        default:      break;
+      }
+      unsigned type;
+      return find (key, start, end, type);
+    }
+
+    bool find (void * key, void *& start, void *& end, unsigned & type);
+
+  private:
+    // Size of the pages of the summary
+    static const unsigned PageShift = 12;
+
+    // Number of pages covered by each table of page entries
+    static const unsigned PageTableShift = 18;
+    static const uintptr_t PageTableEntries = (uintptr_t) 1 << PageTableShift;
+
+    // Number of tables needed to cover the address space
+    static const unsigned AddressBits = (sizeof (void *) == 8) ? 48 : 32;
+    static const uintptr_t PageTables =
+      (uintptr_t) 1 << (AddressBits - PageShift - PageTableShift);
+
+    // Largest object recorded in the summary, in pages
+    static const uintptr_t MaxIndexedPages = (uintptr_t) 1 << 16;
+
+    // Number of objects whose bounds the entry of a page records
+    static const unsigned PageSlots = 4;
+
+    //
+    // Structure: PageEntry
+    //
+    // Description:
+    //  The summary of the objects overlapping one page.  The first Used slots
+    //  hold the bounds of Objects objects or of a subset of them.  Version is
+    //  odd while the entry changes, so that the readers that do not take the
+    //  lock can detect that they raced with a writer.
+    //
+    struct PageEntry {
+      uintptr_t Version;
+      unsigned Objects;
+      unsigned Used;
+      uintptr_t Start[PageSlots];
+      uintptr_t End[PageSlots];
+    };
+
+    enum PageLookup { Absent, Present, Unknown };
+
+    PageLookup findInPages (void * key, void *& start, void *& end) {
+      uintptr_t address = (uintptr_t) key;
+      if (((uint64_t) address >> AddressBits) != 0)
+        return Unknown;
+
+      uintptr_t page = address >> PageShift;
+      PageEntry * Table =
+        __atomic_load_n (&Pages[page >> PageTableShift], __ATOMIC_ACQUIRE);
+      bool Complete = true;
+      if (Table) {
+        PageEntry & Entry = Table[page & (PageTableEntries - 1)];
+        uintptr_t Version = __atomic_load_n (&Entry.Version, __ATOMIC_ACQUIRE);
+        if (Version & 1)
+          return Unknown;
+
+        unsigned Objects = __atomic_load_n (&Entry.Objects, __ATOMIC_RELAXED);
+        unsigned Used = __atomic_load_n (&Entry.Used, __ATOMIC_RELAXED);
+        uintptr_t ObjStart = 0, ObjEnd = 0;
+        for (unsigned slot = 0; (slot < Used) && (slot < PageSlots); ++slot) {
+          uintptr_t S = __atomic_load_n (&Entry.Start[slot], __ATOMIC_RELAXED);
+          uintptr_t E = __atomic_load_n (&Entry.End[slot], __ATOMIC_RELAXED);
+          if ((S <= address) && (address <= E)) {
+            ObjStart = S;
+            ObjEnd = E;
+            break;
+          }
+        }
+
+        __atomic_thread_fence (__ATOMIC_ACQUIRE);
+        if (__atomic_load_n (&Entry.Version, __ATOMIC_RELAXED) != Version)
+          return Unknown;
+        if (ObjEnd) {
+          start = (void *) ObjStart;
+          end = (void *) ObjEnd;
+          return Present;
+        }
+        Complete = (Used == Objects);
+      }
+
+      if (Complete && (__atomic_load_n (&LargeObjects, __ATOMIC_RELAXED) == 0))
+        return Absent;
+      return Unknown;
+    }
+
+    PageEntry * getPageEntry (uintptr_t page);
+    static void beginPageUpdate (PageEntry & Entry);
+    static void endPageUpdate (PageEntry & Entry);
+    void addToPages (void * start, void * end);
+    void removeFromPages (void * start, void * end);
+
+    // The objects and the lock protecting them
+    RangeSplaySet<> Objects;
+    pthread_mutex_t Lock;
+
+    // Tables of page entries, allocated when an object first lands in them
+    PageEntry ** Pages;
+
+    // Number of objects too large to be recorded in the summary
+    unsigned LargeObjects;
+};
+
+}
+#endif
@@ -1,28 +1,317 @@
 //===- MallocHooks.cpp - Implementation of hooks to malloc() functions ----===//
-// 
+//
 //                            The SAFECode Compiler
 //
 // This file was developed by the LLVM research group and is distributed under
 // the University of Illinois Open Source License. See LICENSE.TXT for details.
-// 
+//
 //===----------------------------------------------------------------------===//
 //
 // This file implements functions that interrupt and record allocations created
 // by the system's original memory allocators.  This allows the SAFECode
 // compiler to work with external code.
 //
+// On Darwin, the functions of the default malloc zone are replaced.  On Linux,
+// this file defines the allocation functions of the C library itself and
+// forwards them to the next definitions found by the dynamic linker; they only
+// record allocations once installAllocHooks() is called.
+//
 //===----------------------------------------------------------------------===//
 
-#include "../include/SplayTree.h"
+#include "ExternalObjects.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #if defined(__APPLE__)
 #include <malloc/malloc.h>
+#elif defined(__linux__)
+#include <dlfcn.h>
 #endif
 
 namespace llvm {
 
-// Splay tree for recording external allocations
-RangeSplaySet<> * ExternalObjects;
+// Set of external allocations
+ExternalObjectSet * ExternalObjects;
+
+__thread unsigned InRuntimeAllocation = 0;
+
+//
+// Class: ExternalObjectLock
+//
+// Description:
+//  Hold the lock of the set of external objects for the lifetime of the
+//  object.  The memory allocated for the set itself is not recorded in it.
+//
+class ExternalObjectLock {
+  public:
+    ExternalObjectLock (pthread_mutex_t & Lock) : Lock (Lock) {
+      pthread_mutex_lock (&Lock);
+    }
+
+    ~ExternalObjectLock () {
+      pthread_mutex_unlock (&Lock);
+    }
+
+  private:
+    RuntimeAllocationScope Scope;
+    pthread_mutex_t & Lock;
+};
+
+//
+// Function: allocateIndexMemory()
+//
+// Description:
+//  Reserve zeroed memory for the page-indexed summary of the external objects.
+//  Only the pages of it that are written take up memory.
+//
+static void *
+allocateIndexMemory (size_t size) {
+  void * Mem = mmap (0,
+                     size,
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANON | MAP_NORESERVE,
+                     -1,
+                     0);
+  if (Mem == MAP_FAILED) {
+    fprintf (stderr, "SAFECode: Cannot allocate external object index\n");
+    fflush (stderr);
+    abort();
+  }
+  return Mem;
+}
+
+ExternalObjectSet::ExternalObjectSet () : LargeObjects (0) {
+  pthread_mutex_init (&Lock, 0);
+  Pages = (PageEntry **) allocateIndexMemory (PageTables *
+                                              sizeof (PageEntry *));
+}
+
+//
+// Method: getPageEntry()
+//
+// Description:
+//  Return the summary entry of a page, allocating the table holding it if
+//  needed.  The caller holds the lock.
+//
+ExternalObjectSet::PageEntry *
+ExternalObjectSet::getPageEntry (uintptr_t page) {
+  PageEntry *& Table = Pages[page >> PageTableShift];
+  if (!Table) {
+    void * Mem = allocateIndexMemory (PageTableEntries * sizeof (PageEntry));
+    __atomic_store_n (&Table, (PageEntry *) Mem, __ATOMIC_RELEASE);
+  }
+  return &Table[page & (PageTableEntries - 1)];
+}
+
+//
+// Methods: beginPageUpdate(), endPageUpdate()
+//
+// Description:
+//  Mark a page entry as changing and as changed.  The readers that see an odd
+//  version or a new version search the splay tree instead.
+//
+void
+ExternalObjectSet::beginPageUpdate (PageEntry & Entry) {
+  __atomic_store_n (&Entry.Version, Entry.Version + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+}
+
+void
+ExternalObjectSet::endPageUpdate (PageEntry & Entry) {
+  __atomic_store_n (&Entry.Version, Entry.Version + 1, __ATOMIC_RELEASE);
+}
+
+//
+// Method: addToPages()
+//
+// Description:
+//  Record a new object in the entries of the pages that it overlaps.  The
+//  caller holds the lock.
+//
+void
+ExternalObjectSet::addToPages (void * start, void * end) {
+  uintptr_t first = (uintptr_t) start >> PageShift;
+  uintptr_t last = (uintptr_t) end >> PageShift;
+  if ((((uint64_t) (uintptr_t) end >> AddressBits) != 0) ||
+      (last - first >= MaxIndexedPages)) {
+    __atomic_store_n (&LargeObjects, LargeObjects + 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  for (uintptr_t page = first; page <= last; ++page) {
+    PageEntry & Entry = *getPageEntry (page);
+    beginPageUpdate (Entry);
+
+    //
+    // Only record the bounds if the entry records all of the other objects;
+    // otherwise the page stays incompletely recorded anyway.
+    //
+    if ((Entry.Used == Entry.Objects) && (Entry.Used < PageSlots)) {
+      __atomic_store_n (&Entry.Start[Entry.Used], (uintptr_t) start,
+                        __ATOMIC_RELAXED);
+      __atomic_store_n (&Entry.End[Entry.Used], (uintptr_t) end,
+                        __ATOMIC_RELAXED);
+      __atomic_store_n (&Entry.Used, Entry.Used + 1, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n (&Entry.Objects, Entry.Objects + 1, __ATOMIC_RELAXED);
+    endPageUpdate (Entry);
+  }
+}
+
+//
+// Method: removeFromPages()
+//
+// Description:
+//  Remove an object from the entries of the pages that it overlaps.  The
+//  caller holds the lock.
+//
+void
+ExternalObjectSet::removeFromPages (void * start, void * end) {
+  uintptr_t first = (uintptr_t) start >> PageShift;
+  uintptr_t last = (uintptr_t) end >> PageShift;
+  if ((((uint64_t) (uintptr_t) end >> AddressBits) != 0) ||
+      (last - first >= MaxIndexedPages)) {
+    __atomic_store_n (&LargeObjects, LargeObjects - 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  for (uintptr_t page = first; page <= last; ++page) {
+    PageEntry & Entry = *getPageEntry (page);
+    beginPageUpdate (Entry);
+
+    //
+    // Move the last recorded object into the slot of the removed one.
+    //
+    for (unsigned slot = 0; slot < Entry.Used; ++slot) {
+      if (Entry.Start[slot] == (uintptr_t) start) {
+        unsigned tail = Entry.Used - 1;
+        __atomic_store_n (&Entry.Start[slot], Entry.Start[tail],
+                          __ATOMIC_RELAXED);
+        __atomic_store_n (&Entry.End[slot], Entry.End[tail], __ATOMIC_RELAXED);
+        __atomic_store_n (&Entry.Used, tail, __ATOMIC_RELAXED);
+        break;
+      }
+    }
+
+    __atomic_store_n (&Entry.Objects, Entry.Objects - 1, __ATOMIC_RELAXED);
+    endPageUpdate (Entry);
+  }
+}
+
+bool
+ExternalObjectSet::insert (void * start, void * end, unsigned type) {
+  ExternalObjectLock Guard (Lock);
+  if (!Objects.insert (start, end, type))
+    return false;
+  addToPages (start, end);
+  return true;
+}
+
+bool
+ExternalObjectSet::remove (void * key) {
+  ExternalObjectLock Guard (Lock);
+  void * start;
+  void * end;
+  if (!Objects.find (key, start, end))
+    return false;
+  Objects.remove (key);
+  removeFromPages (start, end);
+  return true;
+}
+
+bool
+ExternalObjectSet::find (void * key,
+                         void *& start,
+                         void *& end,
+                         unsigned & type) {
+  if (findInPages (key, start, end) == Absent)
+    return false;
+
+  ExternalObjectLock Guard (Lock);
+  return Objects.find (key, start, end, type);
+}
+
+//
+// Function: recordObject()
+//
+// Description:
+//  Record an object allocated by external code.
+//
+static inline void
+recordObject (void * objp, size_t size) {
+  if (objp && size && !InRuntimeAllocation)
+    ExternalObjects->insert (objp, (char *) objp + size - 1);
+}
+
+//
+// Function: forgetObject()
+//
+// Description:
+//  Remove an object freed by external code.  This is done before the memory
+//  is released so that another thread cannot reuse it in between.
+//
+static inline void
+forgetObject (void * objp) {
+  if (objp && !InRuntimeAllocation)
+    ExternalObjects->remove (objp);
+}
+
+//
+// Function: forgetReallocatedObject()
+//
+// Description:
+//  Remove an object that realloc() is about to resize, and return its bounds
+//  in start and end.  Returns true if the object was recorded.  As for freed
+//  objects, this is done before the memory is released; if realloc() fails
+//  and keeps the object, restoreReallocatedObject() records it again.
+//
+static inline bool
+forgetReallocatedObject (void * objp, void *& start, void *& end) {
+  if (!objp || InRuntimeAllocation)
+    return false;
+  if (!ExternalObjects->find (objp, start, end))
+    return false;
+  ExternalObjects->remove (objp);
+  return true;
+}
+
+//
+// Function: restoreReallocatedObject()
+//
+// Description:
+//  Record the outcome of a call to realloc(): the new object if it succeeded,
+//  or again the old one if it failed.  realloc() with a size of zero frees the
+//  old object.
+//
+static inline void
+restoreReallocatedObject (void * objp, size_t size, bool forgotten,
+                          void * start, void * end) {
+  if (objp)
+    recordObject (objp, size);
+  else if (forgotten && size)
+    ExternalObjects->insert (start, end);
+}
+
+//
+// Function: arraySize()
+//
+// Description:
+//  Compute the size of an array of num elements of the given size for
+//  calloc().  Returns false if it does not fit in a size_t.
+//
+static inline bool
+arraySize (size_t num, size_t size, size_t & bytes) {
+  if (size && (num > SIZE_MAX / size))
+    return false;
+  bytes = num * size;
+  return true;
+}
 
 #if defined(__APPLE__)
 // The real allocation functions
@@ -78,7 +367,7 @@ track_malloc (malloc_zone_t * zone, size_t size) {
   //
   // Record the allocation and return to the caller.
   //
-  ExternalObjects->insert(objp, objp + size);
+  recordObject (objp, size);
   return objp;
 }
 
@@ -95,7 +384,7 @@ track_valloc (malloc_zone_t * zone, size_t size) {
   //
   // Record the allocation and return to the caller.
   //
-  ExternalObjects->insert(objp, objp + size);
+  recordObject (objp, size);
   return objp;
 }
 
@@ -112,7 +401,9 @@ track_calloc (malloc_zone_t * zone, size_t num, size_t size) {
   //
   // Record the allocation and return to the caller.
   //
-  ExternalObjects->insert(objp, objp + num * size);
+  size_t bytes;
+  if (arraySize (num, size, bytes))
+    recordObject (objp, bytes);
   return objp;
 }
 
@@ -124,28 +415,110 @@ track_realloc (malloc_zone_t * zone, void * oldp, size_t size) {
   //
   // Perform the allocation.
   //
+  void * start;
+  void * end;
+  bool forgotten = forgetReallocatedObject (oldp, start, end);
   objp = (char*) real_realloc (zone, oldp, size);
 
   //
   // Record the allocation and return to the caller.
   //
-  ExternalObjects->insert(objp, objp + size);
+  restoreReallocatedObject (objp, size, forgotten, start, end);
   return objp;
 }
 
 static void
 track_free (malloc_zone_t * zone, void * p) {
   //
-  // Perform the allocation.
+  // Record the deallocation.
   //
-  real_free (zone, p);
+  forgetObject (p);
 
   //
-  // Record the allocation and return to the caller.
+  // Perform the deallocation.
   //
-  ExternalObjects->remove(p);
+  real_free (zone, p);
   return;
 }
+#elif defined(__linux__)
+// The real allocation functions
+static void * (*real_malloc)         (size_t);
+static void * (*real_calloc)         (size_t, size_t);
+static void * (*real_realloc)        (void *, size_t);
+static void   (*real_free)           (void *);
+static void * (*real_memalign)       (size_t, size_t);
+static int    (*real_posix_memalign) (void **, size_t, size_t);
+static void * (*real_valloc)         (size_t);
+static void * (*real_aligned_alloc)  (size_t, size_t);
+static void * (*real_pvalloc)        (size_t);
+static void * (*real_mmap)           (void *, size_t, int, int, int, off_t);
+static int    (*real_munmap)         (void *, size_t);
+
+// Flags whether allocations are recorded
+static bool TrackAllocations = false;
+
+//
+// dlsym() may allocate memory while the real allocation functions are looked
+// up; those allocations are served from a static buffer and never freed.
+//
+static bool ResolvingAllocFunctions = false;
+static char BootstrapHeap[4096] __attribute__((aligned(16)));
+static size_t BootstrapUsed = 0;
+
+static void *
+bootstrapAlloc (size_t size) {
+  size = (size + 15) & ~((size_t) 15);
+  if (size > sizeof (BootstrapHeap) - BootstrapUsed)
+    return 0;
+  void * objp = BootstrapHeap + BootstrapUsed;
+  BootstrapUsed += size;
+  return objp;
+}
+
+static inline bool
+isBootstrapAlloc (void * p) {
+  return ((char *) p >= BootstrapHeap) &&
+         ((char *) p < BootstrapHeap + sizeof (BootstrapHeap));
+}
+
+//
+// Function: resolveAllocFunctions()
+//
+// Description:
+//  Find the allocation functions that the ones defined here replace.
+//
+static void
+resolveAllocFunctions (void) {
+  ResolvingAllocFunctions = true;
+  real_malloc = (void * (*)(size_t)) dlsym (RTLD_NEXT, "malloc");
+  real_calloc = (void * (*)(size_t, size_t)) dlsym (RTLD_NEXT, "calloc");
+  real_realloc = (void * (*)(void *, size_t)) dlsym (RTLD_NEXT, "realloc");
+  real_free = (void (*)(void *)) dlsym (RTLD_NEXT, "free");
+  real_memalign = (void * (*)(size_t, size_t)) dlsym (RTLD_NEXT, "memalign");
+  real_posix_memalign =
+    (int (*)(void **, size_t, size_t)) dlsym (RTLD_NEXT, "posix_memalign");
+  real_valloc = (void * (*)(size_t)) dlsym (RTLD_NEXT, "valloc");
+  real_aligned_alloc =
+    (void * (*)(size_t, size_t)) dlsym (RTLD_NEXT, "aligned_alloc");
+  real_pvalloc = (void * (*)(size_t)) dlsym (RTLD_NEXT, "pvalloc");
+  real_mmap = (void * (*)(void *, size_t, int, int, int, off_t))
+              dlsym (RTLD_NEXT, "mmap");
+  real_munmap = (int (*)(void *, size_t)) dlsym (RTLD_NEXT, "munmap");
+  ResolvingAllocFunctions = false;
+
+  if (!real_malloc || !real_free || !real_mmap) {
+    fprintf (stderr, "SAFECode: Cannot find the system allocator\n");
+    fflush (stderr);
+    abort();
+  }
+}
+
+void
+installAllocHooks (void) {
+  if (!real_malloc)
+    resolveAllocFunctions();
+  TrackAllocations = true;
+}
 #else
 void
 installAllocHooks (void) {
@@ -154,3 +527,187 @@ installAllocHooks (void) {
 #endif
 
 }
+
+#if defined(__linux__)
+using namespace llvm;
+
+//
+// The allocation functions of the program.  Memory is tracked as it is on
+// Darwin: allocations are recorded after they succeed, and objects are
+// forgotten before they are freed, or recorded again when realloc() fails.
+//
+extern "C" void *
+malloc (size_t size) {
+  if (!real_malloc) {
+    if (ResolvingAllocFunctions)
+      return bootstrapAlloc (size);
+    resolveAllocFunctions();
+  }
+
+  void * objp = real_malloc (size);
+  if (TrackAllocations)
+    recordObject (objp, size);
+  return objp;
+}
+
+extern "C" void *
+calloc (size_t num, size_t size) {
+  size_t bytes;
+  bool fits = arraySize (num, size, bytes);
+  if (!real_calloc) {
+    // The bootstrap buffer is never reused, so it is still zeroed.
+    if (ResolvingAllocFunctions) {
+      if (!fits) {
+        errno = ENOMEM;
+        return 0;
+      }
+      return bootstrapAlloc (bytes);
+    }
+    resolveAllocFunctions();
+  }
+
+  void * objp = real_calloc (num, size);
+  if (TrackAllocations && fits)
+    recordObject (objp, bytes);
+  return objp;
+}
+
+extern "C" void *
+realloc (void * oldp, size_t size) {
+  if (isBootstrapAlloc (oldp)) {
+    void * objp = malloc (size);
+    if (objp) {
+      size_t available = BootstrapHeap + sizeof (BootstrapHeap) - (char *) oldp;
+      memcpy (objp, oldp, (size < available) ? size : available);
+    }
+    return objp;
+  }
+  if (!real_realloc)
+    resolveAllocFunctions();
+
+  void * start;
+  void * end;
+  bool forgotten = TrackAllocations &&
+                   forgetReallocatedObject (oldp, start, end);
+  void * objp = real_realloc (oldp, size);
+  if (TrackAllocations)
+    restoreReallocatedObject (objp, size, forgotten, start, end);
+  return objp;
+}
+
+extern "C" void
+free (void * p) {
+  if (!p || isBootstrapAlloc (p))
+    return;
+  if (!real_free)
+    resolveAllocFunctions();
+
+  if (TrackAllocations)
+    forgetObject (p);
+  real_free (p);
+}
+
+extern "C" void *
+memalign (size_t alignment, size_t size) {
+  if (!real_memalign)
+    resolveAllocFunctions();
+
+  void * objp = real_memalign (alignment, size);
+  if (TrackAllocations)
+    recordObject (objp, size);
+  return objp;
+}
+
+extern "C" int
+posix_memalign (void ** objpp, size_t alignment, size_t size) {
+  if (!real_posix_memalign)
+    resolveAllocFunctions();
+
+  int result = real_posix_memalign (objpp, alignment, size);
+  if (TrackAllocations && (result == 0))
+    recordObject (*objpp, size);
+  return result;
+}
+
+extern "C" void *
+valloc (size_t size) {
+  if (!real_valloc)
+    resolveAllocFunctions();
+
+  void * objp = real_valloc (size);
+  if (TrackAllocations)
+    recordObject (objp, size);
+  return objp;
+}
+
+//
+// C11 aligned_alloc() and the page-rounding pvalloc().  Without them in the C
+// library, they are served by memalign().
+//
+extern "C" void *
+aligned_alloc (size_t alignment, size_t size) {
+  if (!real_malloc)
+    resolveAllocFunctions();
+
+  void * objp = real_aligned_alloc ? real_aligned_alloc (alignment, size)
+                                   : real_memalign (alignment, size);
+  if (TrackAllocations)
+    recordObject (objp, size);
+  return objp;
+}
+
+extern "C" void *
+pvalloc (size_t size) {
+  if (!real_malloc)
+    resolveAllocFunctions();
+
+  size_t page = sysconf (_SC_PAGESIZE);
+  size_t rounded = size ? ((size + page - 1) & ~(page - 1)) : page;
+  if (rounded < size) {
+    errno = ENOMEM;
+    return 0;
+  }
+
+  void * objp = real_pvalloc ? real_pvalloc (size)
+                             : real_memalign (page, rounded);
+  if (TrackAllocations)
+    recordObject (objp, rounded);
+  return objp;
+}
+
+extern "C" void *
+mmap (void * addr, size_t length, int prot, int flags, int fd, off_t offset) {
+  if (!real_mmap)
+    resolveAllocFunctions();
+
+  void * objp = real_mmap (addr, length, prot, flags, fd, offset);
+  if (TrackAllocations && (objp != MAP_FAILED))
+    recordObject (objp, length);
+  return objp;
+}
+
+//
+// Map memory for the run-time itself without recording it.
+//
+extern "C" void *
+__sc_system_mmap (void * addr, size_t length, int prot, int flags, int fd,
+                  off_t offset) {
+  if (!real_mmap)
+    resolveAllocFunctions();
+  return real_mmap (addr, length, prot, flags, fd, offset);
+}
+
+//
+// Unmapping part of a mapping forgets all of it; lookups in the rest of it then
+// fail as they do for untracked memory.
+//
+extern "C" int
+munmap (void * addr, size_t length) {
+  if (!real_munmap)
+    resolveAllocFunctions();
+
+  if (TrackAllocations)
+    forgetObject (addr);
+  return real_munmap (addr, length);
+}
+#endif
@@ -12,6 +12,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "ConfigData.h"
+#include "ExternalObjects.h"
 #include "PageManager.h"
 #ifndef _POSIX_MAPPED_FILES
 #define _POSIX_MAPPED_FILES
@@ -246,6 +247,8 @@ RemapPages (void * va, unsigned length) {
 //
 void *
 RemapObject (void * va, unsigned length) {
+  RuntimeAllocationScope Scope;
+
   // Start of the page in which the object lives
   unsigned char * page_start;
 
@@ -320,6 +323,7 @@ RemapObject (void * va, unsigned length) {
 /// AllocatePage - This function returns a chunk of memory with size and
 /// alignment specified by PageSize.
 void *AllocatePage() {
+  RuntimeAllocationScope Scope;
   FreePagesListType &FPL = FreePages;
 
   if (!FPL.empty()) {
@@ -16,6 +16,7 @@
 #define _SC_POOLALLOCATOR_RUNTIME_H_
 
 #include "../include/DebugRuntime.h"
+#include "ExternalObjects.h"
 
 #include "llvm/ADT/DenseMap.h"
 
@@ -25,8 +26,8 @@ namespace llvm {
 
 extern DebugPoolTy dummyPool;
 
-// Splay tree of external objects
-extern RangeSplaySet<> * ExternalObjects;
+// Set of external objects
+extern ExternalObjectSet * ExternalObjects;
 
 // Records Out of Bounds pointer rewrites; also used by OOB rewrites for
 // exactcheck() calls
@@ -38,6 +38,7 @@
 #include "PoolAllocator.h"
 #include "PageManager.h"
 #include "DebugReport.h"
+#include "Profiler.h"
 #include "RewritePtr.h"
 
 #include "../include/CWE.h"
@@ -58,6 +59,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
@@ -85,7 +87,7 @@ namespace llvm {
 DebugPoolTy dummyPool;
 
 // Structure defining configuration data
-struct ConfigData ConfigData = {false, true, false};
+struct ConfigData ConfigData = {false, true, false, 0};
 
 // Invalid address range
 uintptr_t InvalidUpper = 0x00000000;
@@ -148,10 +150,18 @@ static PDebugMetaData createPtrMetaData (unsigned,
 //  Terminate  - Set to non-zero to have SAFECode terminate when an error
 //               occurs.
 //
+// Notes:
+//  Allocations made outside of SAFECode are recorded if the SCTRACKMALLOCS
+//  environment variable is set.  The time spent in the run-time is profiled
+//  if the SCPROFILE environment variable is set (see Profiler.h).
+//
 
 extern "C" void __poolalloc_init();
 void
 pool_init_runtime (unsigned Dangling, unsigned RewriteOOB, unsigned Terminate) {
+  // The memory allocated by the run-time is not an external object
+  RuntimeAllocationScope Scope;
+
   // Flag for whether we've already initialized the run-time
   static int initialized = 0;
 
@@ -168,6 +178,7 @@ pool_init_runtime (unsigned Dangling, unsigned RewriteOOB, unsigned Terminate) {
   //
   ConfigData.RemapObjects = Dangling;
   ConfigData.StrictIndexing = !(RewriteOOB);
+  ConfigData.TrackExternalMallocs = (getenv ("SCTRACKMALLOCS") != 0);
   StopOnError = Terminate;
 
   //
@@ -206,8 +217,10 @@ pool_init_runtime (unsigned Dangling, unsigned RewriteOOB, unsigned Terminate) {
   ErrorLog = &(std::cerr);
 
   //
-  // Install hooks for catching allocations outside the scope of SAFECode.
+  // Initialize the set of external objects and install hooks for catching
+  // allocations outside the scope of SAFECode.
   //
+  ExternalObjects = new ExternalObjectSet;
   if (ConfigData.TrackExternalMallocs) {
     installAllocHooks();
   }
@@ -239,6 +252,11 @@ pool_init_runtime (unsigned Dangling, unsigned RewriteOOB, unsigned Terminate) {
     fflush (stderr);
   }
 
+  //
+  // Start profiling the run-time if requested.
+  //
+  startProfiler ();
+
   //
   // This is only needed once we start using the simple pool allocator.
   //
@@ -247,10 +265,6 @@ pool_init_runtime (unsigned Dangling, unsigned RewriteOOB, unsigned Terminate) {
   __poolalloc_init();
 #endif
 
-  //
-  // Initialize the splay tree of external objects.
-  //
-  ExternalObjects = new RangeSplaySet<>;
   return;
 }
 
@@ -270,6 +284,7 @@ pool_init_runtime (unsigned Dangling, unsigned RewriteOOB, unsigned Terminate) {
 //
 void
 pool_init_logfile (const char * name) {
+  RuntimeAllocationScope Scope;
   extern std::ostream * ErrorLog;
 
   //
@@ -295,6 +310,7 @@ pool_init_logfile (const char * name) {
 //
 void *
 __sc_dbg_newpool(unsigned NodeSize) {
+  RuntimeAllocationScope Scope;
   DebugPoolTy * Pool = new DebugPoolTy();
   poolinit(static_cast<BitmapPoolTy*>(Pool), NodeSize);
   return Pool;
@@ -312,6 +328,7 @@ __sc_dbg_newpool(unsigned NodeSize) {
 //        pooldestroy is called
 void
 __sc_dbg_pooldestroy(DebugPoolTy * Pool) {
+  RuntimeAllocationScope Scope;
   assert(Pool && "Null pool pointer passed in to pooldestroy!\n");
 
   //
@@ -321,6 +338,12 @@ __sc_dbg_pooldestroy(DebugPoolTy * Pool) {
   Pool->OOB.clear();
   Pool->DPTree.clear();
 
+  //
+  // Forget the objects in the cache; they no longer exist.
+  //
+  Pool->objectCache[0].lower = Pool->objectCache[0].upper = 0;
+  Pool->objectCache[1].lower = Pool->objectCache[1].upper = 0;
+
   //
   // Let the pool allocator run-time free all objects allocated within the
   // pool.
@@ -338,8 +361,6 @@ extern char ** environ;
 //
 void *
 poolargvregister (int argc, char ** argv, unsigned AllocType) {
-  printf("Printing from poolargv %d\n", AllocType);
-  fflush(stdout);  
   
   if (logregs) {
     fprintf (stderr, "poolargvregister: %p - %p\n", (void *) argv,
@@ -389,6 +410,91 @@ poolargvregister (int argc, char ** argv, unsigned AllocType) {
   return argv;
 }
 
+//
+// Function: isRegionPool()
+//
+// Description:
+//  Determine whether heap objects of the pool are allocated from a region.
+//  Such objects are neither registered nor freed individually.
+//
+static inline bool
+isRegionPool (DebugPoolTy * Pool) {
+  return Pool && Pool->isRegion;
+}
+
+//
+// Function: insertObject()
+//
+// Description:
+//  Add an object to the splay tree of a pool or to the set of external
+//  objects, resolving its overlaps with the objects already registered.
+//
+template <class ObjectSet>
+static inline void
+insertObject (ObjectSet & Objects,
+              void * allocaptr,
+              unsigned NumBytes,
+              unsigned AllocType,
+              allocType allocationType) {
+  SplayProfileScope Splay;
+
+  //
+  // Add the object to the pool's splay of valid objects.
+  //
+  //
+  if (!(Objects.insert(allocaptr, (char*) allocaptr + NumBytes - 1,
+                      AllocType))) {
+  // Note that the linker
+  // may merge together global objects that are identical (or for which one is
+  // a prefix of another); allow such global objects to be reregistered.
+
+    //
+    // If it's an overlapping global object, register the largest size.
+    //
+    switch (allocationType) {
+      //
+      // The linker may force globals with identical values to overlap (such as
+      // strings in which one string is a substring of the other).  Determine
+      // the largest object that contains the object we are registering and the
+      // already registered object.
+      //
+      case Stack:
+      case Global: {
+        void * start;
+        void * end;
+        unsigned type;
+#ifndef NDEBUG
+        bool fs = Objects.find (allocaptr, start, end, type);
+        assert (fs);
+#else
+        Objects.find (allocaptr, start, end, type);
+#endif
+        Objects.remove (start);
+        void * NewEnd = ((unsigned char *)allocaptr + NumBytes - 1);
+        void * ObjStart = (allocaptr < start) ? allocaptr : start;
+        void * ObjEnd = (NewEnd > end) ? NewEnd : end;
+        Objects.insert(ObjStart, ObjEnd, type);
+        break;
+      }
+
+      //
+      // It is possible that external code or some deallocation function we
+      // failed to recognize freed the object; this will permit the memory
+      // to be reused without the run-time being aware.  In that case, remove
+      // the old memory object and add the new one.
+      //
+      case Heap: {
+        void * start;
+        void * end;
+        Objects.find (allocaptr, start, end);
+        Objects.remove (start);
+        Objects.insert(allocaptr, (char*) allocaptr + NumBytes - 1, AllocType);
+        break;
+      }
+    }
+  }
+}
+
 //
 // Function: poolregister_debug()
 //
@@ -409,6 +515,7 @@ _internal_poolregister (DebugPoolTy *Pool,
                         const char * SourceFilep,
                         unsigned lineno,
                         allocType allocationType) {
+  RuntimeAllocationScope Scope;
   // Do some initial casting for type goodness
   const char * SourceFile = (const char *)(SourceFilep);
 
@@ -450,65 +557,21 @@ _internal_poolregister (DebugPoolTy *Pool,
     return;
 
   //
-  // If there was no pool specified, use the splay tree associated with
-  // externally allocated objects.
+  // The chunks of a region are registered instead of its heap objects.
   //
-  RangeSplaySet<> * SPTree = (Pool ? &(Pool->Objects) : ExternalObjects);
+  if (isRegionPool (Pool) && (allocationType == Heap))
+    return;
 
   //
-  // Add the object to the pool's splay of valid objects.
-  //
+  // If there was no pool specified, use the set of externally allocated
+  // objects.
   //
-  if (!(SPTree->insert(allocaptr, (char*) allocaptr + NumBytes - 1, AllocType))) {
-  // Note that the linker
-  // may merge together global objects that are identical (or for which one is
-  // a prefix of another); allow such global objects to be reregistered.
-
-    //
-    // If it's an overlapping global object, register the largest size.
-    //
-    switch (allocationType) {
-      //
-      // The linker may force globals with identical values to overlap (such as
-      // strings in which one string is a substring of the other).  Determine
-      // the largest object that contains the object we are registering and the
-      // already registered object.
-      //
-      case Stack:
-      case Global: {
-        void * start;
-        void * end;
-        unsigned type;
-#ifndef NDEBUG
-        bool fs = SPTree->find (allocaptr, start, end, type);
-        assert (fs);
-#else
-        SPTree->find (allocaptr, start, end, type);
-#endif
-        SPTree->remove (start);
-        void * NewEnd = ((unsigned char *)allocaptr + NumBytes - 1);
-        void * ObjStart = (allocaptr < start) ? allocaptr : start;
-        void * ObjEnd = (NewEnd > end) ? NewEnd : end;
-        SPTree->insert(ObjStart, ObjEnd, type);
-        break;
-      }
-
-      //
-      // It is possible that external code or some deallocation function we
-      // failed to recognize freed the object; this will permit the memory
-      // to be reused without the run-time being aware.  In that case, remove
-      // the old memory object and add the new one.
-      //
-      case Heap: {
-        void * start;
-        void * end;
-        SPTree->find (allocaptr, start, end);
-        SPTree->remove (start);
-        SPTree->insert(allocaptr, (char*) allocaptr + NumBytes - 1, AllocType);
-        break;
-      }
-    }
-  }
+  if (Pool)
+    insertObject (Pool->Objects, allocaptr, NumBytes, AllocType,
+                  allocationType);
+  else
+    insertObject (*ExternalObjects, allocaptr, NumBytes, AllocType,
+                  allocationType);
 
   return;
 }
@@ -522,9 +585,9 @@ _internal_poolregister (DebugPoolTy *Pool,
 //  the object being registered.
 //
 void
-pool_register (DebugPoolTy *Pool, void * allocaptr, unsigned NumBytes, unsigned AllocType) {\
-printf("Printing from pool_register\n"); 
-fflush(stdout); 
+pool_register (DebugPoolTy *Pool, void * allocaptr, unsigned NumBytes, unsigned AllocType) {
+  PROFILE_OP (ProfileRegister, 0, 0);
+
 #if 0
   //
   // If this is a singleton object within a type-known pool, don't add it to
@@ -571,6 +634,15 @@ pool_register_debug (DebugPoolTy *Pool,
                      unsigned AllocType, TAG,
                      const char * SourceFilep,
                      unsigned lineno) {
+  RuntimeAllocationScope Scope;
+  PROFILE_OP (ProfileRegister, SourceFilep, lineno);
+
+  //
+  // Objects of a region are not registered and have no debug information.
+  //
+  if (isRegionPool (Pool))
+    return;
+
   //
   // Use the common registration function.  Mark the allocation as a heap
   // allocation.  However, only do this if the object is not a singleton object
@@ -580,8 +652,6 @@ pool_register_debug (DebugPoolTy *Pool,
   // FIXME: disabling because the code that does poolcheck for singleton
   // objects, uses SearchForContainingSlab, which assumes it is being called
   // from a poolfree, and does not handle pointers to the middle of an object.
-printf("Printing from pool_register_debug %d %d\n", AllocType, NumBytes);
-fflush(stdout);
 #if 0
   if (Pool && (NumBytes == Pool->NodeSize)) {
     return
@@ -620,6 +690,7 @@ fflush(stdout);
                                         0,
                                         getCanonicalPtr(allocaptr),
                                         (const char *) SourceFilep, lineno);
+  SplayProfileScope Splay;
   dummyPool.DPTree.insert (allocaptr,
                            (char*) allocaptr + NumBytes - 1,
                            debugmetadataPtr);
@@ -639,8 +710,8 @@ pool_reregister (DebugPoolTy *Pool,
                  void * oldptr,
                  unsigned NumBytes,
                  unsigned AllocType) {
-  printf("Printing from pool_reregister %d %d\n", AllocType, NumBytes);
-  fflush(stdout);
+  PROFILE_OP (ProfileRegister, 0, 0);
+
   if (oldptr == NULL) {
     //
     // If the old pointer is NULL, then we know that this is essentially a
@@ -653,6 +724,11 @@ pool_reregister (DebugPoolTy *Pool,
     // memory; treat it as such.
     //
     pool_unregister (Pool, oldptr);
+  } else if (newptr == NULL) {
+    //
+    // The reallocation failed and left the old memory allocated; keep it
+    // registered.
+    //
   } else {
     //
     // Otherwise, this is a true reallocation.  Unregister the old memory and
@@ -673,8 +749,8 @@ pool_reregister_debug (DebugPoolTy *Pool,
                        TAG,
                        const char * SourceFilep,
                        unsigned lineno) {
-  printf("Printing from pool_reregister_debug %d %d\n", AllocType, NumBytes);
-  fflush(stdout);
+  PROFILE_OP (ProfileRegister, SourceFilep, lineno);
+
   if (oldptr == NULL) {
     //
     // If the old pointer is NULL, then we know that this is essentially a
@@ -687,6 +763,11 @@ pool_reregister_debug (DebugPoolTy *Pool,
     // memory; treat it as such.
     //
     pool_unregister_debug (Pool, oldptr, tag, SourceFilep, lineno);
+  } else if (newptr == NULL) {
+    //
+    // The reallocation failed and left the old memory allocated; keep it
+    // registered.
+    //
   } else {
     //
     // Otherwise, this is a true reallocation.  Unregister the old memory and
@@ -712,9 +793,10 @@ pool_register_stack_debug (DebugPoolTy *Pool,
                            unsigned AllocType, TAG,
                            const char * SourceFilep,
                            unsigned lineno) {
+  RuntimeAllocationScope Scope;
+  PROFILE_OP (ProfileRegister, SourceFilep, lineno);
+
   
-  printf("Printing from pool_register_stack_debug %d %d \n", AllocType, NumBytes);
-  fflush(stdout);
   //
   // Use the common registration function.  Mark the allocation as a stack
   // allocation.
@@ -739,6 +821,7 @@ pool_register_stack_debug (DebugPoolTy *Pool,
                                         0,
                                         getCanonicalPtr(allocaptr),
                                         (const char *) SourceFilep, lineno);
+  SplayProfileScope Splay;
   dummyPool.DPTree.insert (allocaptr,
                            (char*) allocaptr + NumBytes - 1,
                            debugmetadataPtr);
@@ -754,9 +837,9 @@ pool_register_stack_debug (DebugPoolTy *Pool,
 //
 void
 pool_register_stack (DebugPoolTy *Pool, void * allocaptr, unsigned NumBytes, unsigned AllocType) {
+  PROFILE_OP (ProfileRegister, 0, 0);
+
   //
-  printf("Printing from pool_register_stack\n");
-  fflush(stdout);
   // Use the common registration function.  Mark the allocation as a stack
   // allocation.
   //
@@ -778,8 +861,8 @@ pool_register_stack (DebugPoolTy *Pool, void * allocaptr, unsigned NumBytes, uns
 //
 void
 pool_register_global (DebugPoolTy *Pool, void * allocaptr, unsigned NumBytes, unsigned AllocType) {
-  printf("Printing from register_global %d %d\n",  AllocType, NumBytes);
-  fflush(stdout);
+  PROFILE_OP (ProfileRegister, 0, 0);
+
 
   //
   // Use the common registration function.  Mark the allocation as a stack
@@ -809,8 +892,9 @@ pool_register_global_debug (DebugPoolTy *Pool,
                             unsigned AllocType, TAG,
                             const char * SourceFilep,
                             unsigned lineno) {
-  printf("Printing from pool_register_global_debug %d %d\n", AllocType, NumBytes);
-  fflush(stdout);
+  RuntimeAllocationScope Scope;
+  PROFILE_OP (ProfileRegister, SourceFilep, lineno);
+
   //
   // Use the common registration function.  Mark the "allocation" as a global
   // object.
@@ -835,6 +919,7 @@ pool_register_global_debug (DebugPoolTy *Pool,
                                         0,
                                         getCanonicalPtr(allocaptr),
                                         (const char *) SourceFilep, lineno);
+  SplayProfileScope Splay;
   dummyPool.DPTree.insert (allocaptr,
                            (char*) allocaptr + NumBytes - 1,
                            debugmetadataPtr);
@@ -842,22 +927,28 @@ pool_register_global_debug (DebugPoolTy *Pool,
 }
 
 //
-// Function: poolcheck_freeui_debug()
+// Function: poolcheck_freeui_at()
 //
 // Description:
 //  Check that freeing the pointer is correct.  Permit incomplete and unknown
 //  pointers.
 //
-void
-poolcheck_freeui_debug (DebugPoolTy *Pool,
-                      void * ptr,
-                      unsigned tag,
-                      const char * SourceFilep,
-                      unsigned lineno) {
+// Inputs:
+//  PC - The return address of the run-time entry point called by the
+//       program; errors are reported at this address.
+//
+static inline void
+poolcheck_freeui_at (DebugPoolTy *Pool,
+                     void * ptr,
+                     unsigned tag,
+                     const char * SourceFilep,
+                     unsigned lineno,
+                     const void * PC) {
   //
-  // Ignore frees of NULL pointers.  These are okay.
+  // Ignore frees of NULL pointers.  These are okay.  Objects of a region are
+  // not freed individually, so freeing them is okay as well.
   //
-  if (ptr == NULL)
+  if ((ptr == NULL) || isRegionPool (Pool))
     return;
 
   //
@@ -894,7 +985,7 @@ poolcheck_freeui_debug (DebugPoolTy *Pool,
   if (debugmetadataptr->allocationType != Heap) {
     OutOfBoundsViolation v;
     v.type = ViolationInfo::FAULT_NOTHEAP_FREE,
-    v.faultPC = __builtin_return_address(0);
+    v.faultPC = PC;
     v.CWE = CWEFreeNotHeap;
     v.PoolHandle = Pool;
     v.dbgMetaData = debugmetadataptr;
@@ -913,7 +1004,7 @@ poolcheck_freeui_debug (DebugPoolTy *Pool,
   if (ptr != ObjStart) {
     OutOfBoundsViolation v;
     v.type = ViolationInfo::FAULT_INVALID_FREE,
-      v.faultPC = __builtin_return_address(0),
+      v.faultPC = PC,
       v.faultPtr = ptr,
       v.CWE = CWEFreeNotStart,
       v.dbgMetaData = debugmetadataptr,
@@ -927,22 +1018,45 @@ poolcheck_freeui_debug (DebugPoolTy *Pool,
   return;
 }
 
+void
+poolcheck_freeui_debug (DebugPoolTy *Pool,
+                        void * ptr,
+                        unsigned tag,
+                        const char * SourceFilep,
+                        unsigned lineno) {
+  poolcheck_freeui_at (Pool, ptr, tag, SourceFilep, lineno,
+                       __builtin_return_address(0));
+}
+
+void
+poolcheck_freeui_site (DebugPoolTy * Pool, void * ptr,
+                       const DebugSiteInfo * Site) {
+  poolcheck_freeui_at (Pool, ptr, Site->tag, Site->SourceFile, Site->lineno,
+                       __builtin_return_address(0));
+}
+
 //
-// Function: poolcheck_free_debug()
+// Function: poolcheck_free_at()
 //
 // Description:
 //  Check that freeing the pointer is correct.
 //
-void
-poolcheck_free_debug (DebugPoolTy *Pool,
-                      void * ptr,
-                      unsigned tag,
-                      const char * SourceFilep,
-                      unsigned lineno) {
+// Inputs:
+//  PC - The return address of the run-time entry point called by the
+//       program; errors are reported at this address.
+//
+static inline void
+poolcheck_free_at (DebugPoolTy *Pool,
+                   void * ptr,
+                   unsigned tag,
+                   const char * SourceFilep,
+                   unsigned lineno,
+                   const void * PC) {
   //
-  // Ignore frees of NULL pointers.  These are okay.
+  // Ignore frees of NULL pointers.  These are okay.  Objects of a region are
+  // not freed individually, so freeing them is okay as well.
   //
-  if (ptr == NULL)
+  if ((ptr == NULL) || isRegionPool (Pool))
     return;
 
   //
@@ -968,7 +1082,7 @@ poolcheck_free_debug (DebugPoolTy *Pool,
   if (!found) {
     DebugViolationInfo v;
     v.type = DebugViolationInfo::FAULT_INVALID_FREE,
-      v.faultPC = __builtin_return_address(0),
+      v.faultPC = PC,
       v.faultPtr = ptr;
       v.CWE = CWEFreeNotHeap;
       v.PoolHandle = Pool;
@@ -987,7 +1101,7 @@ poolcheck_free_debug (DebugPoolTy *Pool,
   if (debugmetadataptr->allocationType != Heap) {
     OutOfBoundsViolation v;
     v.type = ViolationInfo::FAULT_NOTHEAP_FREE,
-    v.faultPC = __builtin_return_address(0);
+    v.faultPC = PC;
     v.CWE = CWEFreeNotHeap;
     v.PoolHandle = Pool;
     v.dbgMetaData = debugmetadataptr;
@@ -1006,7 +1120,7 @@ poolcheck_free_debug (DebugPoolTy *Pool,
   if (ptr != ObjStart) {
     OutOfBoundsViolation v;
     v.type = ViolationInfo::FAULT_INVALID_FREE,
-      v.faultPC = __builtin_return_address(0),
+      v.faultPC = PC,
       v.faultPtr = ptr,
       v.CWE = CWEFreeNotStart,
       v.dbgMetaData = debugmetadataptr,
@@ -1021,6 +1135,23 @@ poolcheck_free_debug (DebugPoolTy *Pool,
   return;
 }
 
+void
+poolcheck_free_debug (DebugPoolTy *Pool,
+                      void * ptr,
+                      unsigned tag,
+                      const char * SourceFilep,
+                      unsigned lineno) {
+  poolcheck_free_at (Pool, ptr, tag, SourceFilep, lineno,
+                     __builtin_return_address(0));
+}
+
+void
+poolcheck_free_site (DebugPoolTy * Pool, void * ptr,
+                     const DebugSiteInfo * Site) {
+  poolcheck_free_at (Pool, ptr, Site->tag, Site->SourceFile, Site->lineno,
+                     __builtin_return_address(0));
+}
+
 //
 // Function: poolcheck_free()
 //
@@ -1030,9 +1161,10 @@ poolcheck_free_debug (DebugPoolTy *Pool,
 void
 poolcheck_free (DebugPoolTy *Pool, void * ptr) {
   //
-  // Ignore frees of NULL pointers.  These are okay.
+  // Ignore frees of NULL pointers.  These are okay.  Objects of a region are
+  // not freed individually, so freeing them is okay as well.
   //
-  if (ptr == NULL)
+  if ((ptr == NULL) || isRegionPool (Pool))
     return;
 
   //
@@ -1104,9 +1236,10 @@ poolcheck_free (DebugPoolTy *Pool, void * ptr) {
 void
 poolcheck_freeui (DebugPoolTy *Pool, void * ptr) {
   //
-  // Ignore frees of NULL pointers.  These are okay.
+  // Ignore frees of NULL pointers.  These are okay.  Objects of a region are
+  // not freed individually, so freeing them is okay as well.
   //
-  if (ptr == NULL)
+  if ((ptr == NULL) || isRegionPool (Pool))
     return;
 
   //
@@ -1175,6 +1308,8 @@ updateMDOnFree (DebugPoolTy *Pool,
                 unsigned tag,
                 const char * SourceFilep,
                 unsigned lineno) {
+  SplayProfileScope Splay;
+
   //
   // Increment the ID number for this deallocation.
   //
@@ -1261,6 +1396,7 @@ _internal_poolunregister (DebugPoolTy *Pool,
                           unsigned tag,
                           const char * SourceFilep,
                           unsigned lineno) {
+  RuntimeAllocationScope Scope;
   if (logregs) {
     fprintf (stderr, "pool_unregister: Start: %p: %s %d\n", allocaptr, SourceFilep, lineno);
     fflush (stderr);
@@ -1272,15 +1408,22 @@ _internal_poolunregister (DebugPoolTy *Pool,
   if (!allocaptr) return;
 
   //
-  // If there was no pool specified, use the splay tree associated with
-  // externally allocated objects.
+  // Heap objects of a region were never registered.
   //
-  RangeSplaySet<> * SPTree = (Pool ? &(Pool->Objects) : ExternalObjects);
+  if (isRegionPool (Pool) && (Type == Heap))
+    return;
 
   //
-  // Remove the object from the pool's splay tree.
+  // Remove the object from the pool's splay tree.  If there was no pool
+  // specified, use the set of externally allocated objects.
   //
-  SPTree->remove (allocaptr);
+  {
+    SplayProfileScope Splay;
+    if (Pool)
+      Pool->Objects.remove (allocaptr);
+    else
+      ExternalObjects->remove (allocaptr);
+  }
 
   //
   // Eject the pointer from the pool's cache if necessary.
@@ -1306,6 +1449,8 @@ _internal_poolunregister (DebugPoolTy *Pool,
 
 void
 pool_unregister (DebugPoolTy *Pool, void * allocaptr) {
+  PROFILE_OP (ProfileUnregister, 0, 0);
+
   _internal_poolunregister (Pool, allocaptr, Heap, 0, "Unknown", 0);
   return;
 }
@@ -1316,6 +1461,10 @@ pool_unregister_debug (DebugPoolTy *Pool,
                        TAG,
                        const char * SourceFilep,
                        unsigned lineno) {
+  PROFILE_OP (ProfileUnregister, SourceFilep, lineno);
+
+  if (isRegionPool (Pool))
+    return;
   updateMDOnFree (Pool, allocaptr, Heap, tag, SourceFilep, lineno);
   _internal_poolunregister (Pool, allocaptr, Heap, tag, SourceFilep, lineno);
   return;
@@ -1323,6 +1472,8 @@ pool_unregister_debug (DebugPoolTy *Pool,
 
 void
 pool_unregister_stack (DebugPoolTy *Pool, void * allocaptr) {
+  PROFILE_OP (ProfileUnregister, 0, 0);
+
   _internal_poolunregister (Pool, allocaptr, Stack, 0, "Unknown", 0);
   return;
 }
@@ -1333,6 +1484,8 @@ pool_unregister_stack_debug (DebugPoolTy *Pool,
                                      TAG,
                                      const char * SourceFilep,
                                      unsigned lineno) {
+  PROFILE_OP (ProfileUnregister, SourceFilep, lineno);
+
   updateMDOnFree (Pool, allocaptr, Stack, tag, SourceFilep, lineno);
   _internal_poolunregister (Pool, allocaptr, Stack, tag, SourceFilep, lineno);
   return;
@@ -1350,6 +1503,7 @@ __sc_dbg_src_poolalloc (DebugPoolTy *Pool,
                         unsigned NumBytes, TAG,
                         const char * SourceFilep,
                         unsigned lineno) {
+  RuntimeAllocationScope Scope;
   //
   // Ensure that we're allocating at least one byte.
   //
@@ -1372,6 +1526,13 @@ __sc_dbg_src_poolfree (DebugPoolTy *Pool,
                        void * Node, TAG,
                        const char * SourceFile,
                        unsigned int lineno) {
+  RuntimeAllocationScope Scope;
+  //
+  // Objects of a region are released when the region is destroyed.
+  //
+  if (isRegionPool (Pool))
+    return;
+
   //
   // Free the object within the pool; the poolunregister() function will
   // detect invalid frees.
@@ -1679,6 +1840,7 @@ getCanonicalPtr (void * ShadowPtr) {
 //
 void *
 pool_shadow (void * CanonPtr, unsigned NumBytes) {
+  RuntimeAllocationScope Scope;
   //
   // Calculate the offset of the object from the beginning of the page.
   //
@@ -1725,6 +1887,7 @@ pool_shadow (void * CanonPtr, unsigned NumBytes) {
 //
 void *
 pool_unshadow (void * Node) {
+  RuntimeAllocationScope Scope;
   // The start and end of the object as registered in the dangling pointer
   // object metapool
   void * start = 0, * end = 0;
@@ -1836,6 +1999,7 @@ __sc_dbg_poolcalloc (DebugPoolTy *Pool, unsigned Number, unsigned NumBytes) {
 
 void *
 poolrealloc (DebugPoolTy *Pool, void *Node, unsigned NumBytes) {
+  RuntimeAllocationScope Scope;
   //
   // If the object has never been allocated before, allocate it now, create a
   // shadow object (if necessary), and register the object as a heap object.
@@ -1903,6 +2067,7 @@ __sc_dbg_poolrealloc_debug (DebugPoolTy *Pool,
                             unsigned AllocType, TAG,
                             const char * SourceFilep,
                             unsigned lineno) {
+  RuntimeAllocationScope Scope;
   //
   // If the object has never been allocated before, allocate it now, create a
   // shadow object (if necessary), and register the object as a heap object.
@@ -2001,6 +2166,7 @@ static void *
 internal_poolstrdup (DebugPoolTy * Pool,
                      char * String,
                      unsigned & length) {
+  RuntimeAllocationScope Scope;
   //
   // First determine the size of the string.  We use pool_strlen() to ensure
   // that we do this safely.  Remember to increment the length by 1 to handle
@@ -2104,6 +2270,7 @@ __sc_dbg_poolstrdup_debug (DebugPoolTy * Pool,
 //
 void *
 __sc_dbg_poolinit(DebugPoolTy *Pool, unsigned NodeSize, unsigned) {
+  RuntimeAllocationScope Scope;
   //
   // Create a record if necessary.
   if (logregs) {
@@ -2141,10 +2308,137 @@ __sc_dbg_poolinit(DebugPoolTy *Pool, unsigned NodeSize, unsigned) {
   Pool->objectCache[1].lower = 0;
   Pool->objectCache[1].upper = 0;
   Pool->cacheIndex = 0;
+  Pool->isRegion = 0;
 
   return Pool;
 }
 
+// The default size of the chunks from which regions allocate objects
+static const unsigned RegionChunkSize = 64 * 1024;
+
+//
+// Function: allocRegionChunk()
+//
+// Description:
+//  Allocate a new chunk for a region from the underlying pool, register it as
+//  one object, and allocate an object of the given size at its start.
+//
+// Inputs:
+//  Pool - The region.
+//  Size - The size of the object, already rounded up to the alignment of the
+//         region.
+//
+// Return value:
+//  NULL      - The chunk could not be allocated.  The region is unchanged.
+//  Otherwise - A pointer to the new object.
+//
+// Notes:
+//  Large objects get a chunk of their own so that the rest of the current
+//  chunk is not wasted.
+//
+static void *
+allocRegionChunk (DebugPoolTy * Pool, uintptr_t Size) {
+  RuntimeAllocationScope Scope;
+  bool Dedicated = (Size > RegionChunkSize / 4);
+  uintptr_t ChunkSize = Dedicated ? Size : RegionChunkSize;
+
+  //
+  // The underlying pool only aligns its objects to the pool's node size, so
+  // align the chunk ourselves.  poolalloc() takes an unsigned size; fail
+  // instead of allocating a truncated chunk.
+  //
+  uintptr_t Mask = Pool->RegionAlign - 1;
+  if (ChunkSize > (uintptr_t) UINT_MAX - Mask)
+    return 0;
+  char * Memory = (char *) poolalloc (Pool, ChunkSize + Mask);
+  if (!Memory)
+    return 0;
+  char * Chunk = (char *) (((uintptr_t) Memory + Mask) & ~Mask);
+
+  {
+    SplayProfileScope Splay;
+    Pool->Objects.insert (Chunk, Chunk + ChunkSize - 1);
+  }
+
+  if (!Dedicated) {
+    Pool->RegionNext = Chunk + Size;
+    Pool->RegionEnd = Chunk + ChunkSize;
+  }
+  return Chunk;
+}
+
+//
+// Function: __sc_dbg_poolinit_region()
+//
+// Description:
+//  Initialize a pool as a region.  The compiler makes regions of the pools of
+//  a function whose heap objects are only allocated and freed by the function
+//  itself, so that they all die when the function destroys the pool.
+//
+//  A region allocates its objects from large chunks with a bump pointer and
+//  registers each chunk as one object.  The registration, deregistration, and
+//  deallocation of its heap objects are ignored; destroying the region
+//  releases and unregisters all of them at once.  Checks on pointers into a
+//  region therefore only ensure that they stay within the memory of the
+//  region, not within one object of it.
+//
+// Inputs:
+//  Pool     - A pointer to the pool to initialize.
+//  NodeSize - The default size of an object allocated within the pool.
+//  Align    - The alignment of the objects of the pool.
+//
+void *
+__sc_dbg_poolinit_region (DebugPoolTy * Pool, unsigned NodeSize,
+                          unsigned Align) {
+  __sc_dbg_poolinit (Pool, NodeSize, Align);
+
+  //
+  // Align objects at least as well as malloc() does.
+  //
+  Pool->isRegion = 1;
+  Pool->RegionAlign = 2 * sizeof (void *);
+  if ((Align > Pool->RegionAlign) && !(Align & (Align - 1)))
+    Pool->RegionAlign = Align;
+  Pool->RegionNext = Pool->RegionEnd = 0;
+  return Pool;
+}
+
+//
+// Function: __sc_dbg_poolalloc_region()
+//
+// Description:
+//  Allocate an object from a region.
+//
+void *
+__sc_dbg_poolalloc_region (DebugPoolTy * Pool, unsigned NumBytes) {
+  //
+  // Allocate at least one byte so that every object has a unique address.
+  //
+  uintptr_t Mask = Pool->RegionAlign - 1;
+  uintptr_t Size = ((uintptr_t) (NumBytes ? NumBytes : 1) + Mask) & ~Mask;
+  if (__builtin_expect (Size <= (uintptr_t) (Pool->RegionEnd -
+                                             Pool->RegionNext), 1)) {
+    void * Object = Pool->RegionNext;
+    Pool->RegionNext += Size;
+    return Object;
+  }
+
+  return allocRegionChunk (Pool, Size);
+}
+
+//
+// Function: __sc_dbg_pooldestroy_region()
+//
+// Description:
+//  Release all objects of a region.
+//
+void
+__sc_dbg_pooldestroy_region (DebugPoolTy * Pool) {
+  Pool->isRegion = 0;
+  Pool->RegionNext = Pool->RegionEnd = 0;
+  __sc_dbg_pooldestroy (Pool);
+}
+
 //
 // Function: nullstrlen()
 //
@@ -2173,11 +2467,11 @@ trace_load(DebugPoolTy *Pool, void *Node, const char * ModName, unsigned int Per
   //  printf("In trace_load! Node: %p %p %d\n", Pool, Node, Perm);
   //  fflush(stdout);
 
-  RangeSplaySet<> *SPTree = (Pool ? &(Pool->Objects) : ExternalObjects);
   void * start;
   void * end;
   unsigned type;
-  bool fs = SPTree->find (Node, start, end, type);
+  bool fs = Pool ? Pool->Objects.find (Node, start, end, type)
+                 : ExternalObjects->find (Node, start, end, type);
   std::string filename;
   int error = -1;
   if(fs){
@@ -2223,11 +2517,11 @@ trace_store(DebugPoolTy *Pool, void *Node, const char * ModName, unsigned int Pe
   //  printf("In trace_store! Node: %p %p %d\n", Pool, Node, Perm);
   //  fflush(stdout);
 
-  RangeSplaySet<> *SPTree = (Pool ? &(Pool->Objects) : ExternalObjects);
   void * start;
   void * end;
   unsigned type;
-  bool fs = SPTree->find (Node, start, end, type);  
+  bool fs = Pool ? Pool->Objects.find (Node, start, end, type)
+                 : ExternalObjects->find (Node, start, end, type);  
   std::string filename;
   int error = -1;
   if(fs){
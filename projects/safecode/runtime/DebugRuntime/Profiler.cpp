@@ -0,0 +1,298 @@
+//===- Profiler.cpp - Sampling profiler for the run-time checks -----------===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the sampling profiler of the run-time.  Samples are
+// counted in a fixed-size hash table keyed by the operation and call site so
+// that the signal handler never allocates memory or takes a lock.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <dlfcn.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <vector>
+
+namespace llvm {
+
+__thread struct ProfileMark CurrentProfileMark;
+
+}
+
+using namespace llvm;
+
+//
+// Structure: ProfileEntry
+//
+// Description:
+//  The samples charged to one operation at one call site.
+//
+struct ProfileEntry {
+  // Hash of the operation and call site; zero if the entry is free
+  uintptr_t Key;
+
+  // Set once the thread that claimed the entry has filled in the fields below
+  bool Ready;
+
+  unsigned Op;
+  void * Site;
+  const char * SourceFile;
+  unsigned lineno;
+
+  // The number of samples and how many of them were inside a splay tree
+  unsigned long Samples;
+  unsigned long SplaySamples;
+};
+
+// The size of the table of samples; must be a power of two
+static const unsigned ProfileTableSize = 4096;
+static ProfileEntry ProfileTable[ProfileTableSize];
+
+// Samples taken in total, outside of the run-time, and not recorded because
+// the table was full
+static unsigned long TotalSamples;
+static unsigned long ProgramSamples;
+static unsigned long DroppedSamples;
+
+static const char * OpNames[ProfileNumOps] = {
+  "program",
+  "poolcheck",
+  "boundscheck",
+  "pool_register",
+  "pool_unregister"
+};
+
+//
+// Function: getProfileKey()
+//
+// Description:
+//  Hash the operation and call site of a sample.  The result is never zero.
+//
+static inline uintptr_t
+getProfileKey (const ProfileMark & Mark) {
+  uintptr_t Key = (uintptr_t) Mark.Site;
+  Key = Key * 31 + (uintptr_t) Mark.SourceFile;
+  Key = Key * 31 + Mark.lineno;
+  Key = Key * 8 + Mark.Op;
+  return Key ? Key : 1;
+}
+
+//
+// Function: isSameSite()
+//
+// Description:
+//  Determine whether an entry holds the samples of the operation and call
+//  site of the given mark.  Different marks may hash to the same key.
+//
+static inline bool
+isSameSite (const ProfileEntry & Entry, const ProfileMark & Mark) {
+  return (Entry.Op == Mark.Op) &&
+         (Entry.Site == Mark.Site) &&
+         (Entry.SourceFile == Mark.SourceFile) &&
+         (Entry.lineno == Mark.lineno);
+}
+
+//
+// Function: recordSample()
+//
+// Description:
+//  Charge a sample to the operation and call site of the given mark.
+//
+static void
+recordSample (const ProfileMark & Mark) {
+  uintptr_t Key = getProfileKey (Mark);
+  unsigned index = (Key ^ (Key >> 12)) & (ProfileTableSize - 1);
+  for (unsigned probe = 0; probe < ProfileTableSize; ++probe) {
+    ProfileEntry & Entry = ProfileTable[(index + probe) &
+                                        (ProfileTableSize - 1)];
+    if (!Entry.Key && __sync_bool_compare_and_swap (&(Entry.Key), 0, Key)) {
+      Entry.Op = Mark.Op;
+      Entry.Site = Mark.Site;
+      Entry.SourceFile = Mark.SourceFile;
+      Entry.lineno = Mark.lineno;
+      __atomic_store_n (&(Entry.Ready), true, __ATOMIC_RELEASE);
+    } else {
+      if (Entry.Key != Key)
+        continue;
+
+      //
+      // Another thread may still be filling in the entry that it claimed.  A
+      // signal handler cannot interrupt itself, so it is not this thread.
+      //
+      while (!__atomic_load_n (&(Entry.Ready), __ATOMIC_ACQUIRE))
+        ;
+      if (!isSameSite (Entry, Mark))
+        continue;
+    }
+
+    __sync_fetch_and_add (&(Entry.Samples), 1);
+    if (Mark.InSplay)
+      __sync_fetch_and_add (&(Entry.SplaySamples), 1);
+    return;
+  }
+
+  __sync_fetch_and_add (&DroppedSamples, 1);
+}
+
+//
+// Function: profile_handler()
+//
+// Description:
+//  Signal handler for the profiling timer.
+//
+static void
+profile_handler (int, siginfo_t *, void *) {
+  __sync_fetch_and_add (&TotalSamples, 1);
+
+  ProfileMark Mark = CurrentProfileMark;
+  if (Mark.Op == ProfileNone)
+    __sync_fetch_and_add (&ProgramSamples, 1);
+  else
+    recordSample (Mark);
+}
+
+//
+// Function: isMoreSampled()
+//
+// Description:
+//  Order entries of the profile from the most to the least sampled.
+//
+static bool
+isMoreSampled (const ProfileEntry * A, const ProfileEntry * B) {
+  return A->Samples > B->Samples;
+}
+
+//
+// Function: dumpProfile()
+//
+// Description:
+//  Stop the profiling timer and print the flat profile.
+//
+static void
+dumpProfile (void) {
+  struct itimerval Timer;
+  memset (&Timer, 0, sizeof (Timer));
+  setitimer (ITIMER_PROF, &Timer, 0);
+
+  FILE * Out = stderr;
+  if (const char * Name = getenv ("SCPROFILEFILE")) {
+    if (!(Out = fopen (Name, "w"))) {
+      perror ("SAFECode: cannot open profile file");
+      Out = stderr;
+    }
+  }
+
+  //
+  // Total the samples of each operation and sort the call sites.
+  //
+  unsigned long OpSamples[ProfileNumOps] = {0};
+  unsigned long OpSplaySamples[ProfileNumOps] = {0};
+  OpSamples[ProfileNone] = ProgramSamples;
+  std::vector<const ProfileEntry *> Entries;
+  for (unsigned index = 0; index < ProfileTableSize; ++index) {
+    const ProfileEntry & Entry = ProfileTable[index];
+    if (!Entry.Ready)
+      continue;
+    OpSamples[Entry.Op] += Entry.Samples;
+    OpSplaySamples[Entry.Op] += Entry.SplaySamples;
+    Entries.push_back (&Entry);
+  }
+  std::stable_sort (Entries.begin(), Entries.end(), isMoreSampled);
+
+  double msPerSample = ConfigData.ProfileInterval / 1000.0;
+  double Total = TotalSamples ? TotalSamples : 1;
+  fprintf (Out, "=== SAFECode run-time profile: %lu samples, %.2f ms ===\n",
+           TotalSamples, TotalSamples * msPerSample);
+  if (DroppedSamples)
+    fprintf (Out, "(%lu samples dropped; profile table full)\n",
+             DroppedSamples);
+
+  fprintf (Out, "\n%-16s %10s %7s %10s %7s\n",
+           "operation", "ms", "%", "splay ms", "%");
+  for (unsigned Op = 0; Op < ProfileNumOps; ++Op) {
+    fprintf (Out, "%-16s %10.2f %6.2f%% %10.2f %6.2f%%\n",
+             OpNames[Op],
+             OpSamples[Op] * msPerSample,
+             100.0 * OpSamples[Op] / Total,
+             OpSplaySamples[Op] * msPerSample,
+             100.0 * OpSplaySamples[Op] / Total);
+  }
+
+  fprintf (Out, "\n%-16s %10s %7s %10s  %s\n",
+           "operation", "ms", "%", "splay ms", "call site");
+  for (unsigned index = 0; index < Entries.size(); ++index) {
+    const ProfileEntry & Entry = *(Entries[index]);
+    fprintf (Out, "%-16s %10.2f %6.2f%% %10.2f  %p",
+             OpNames[Entry.Op],
+             Entry.Samples * msPerSample,
+             100.0 * Entry.Samples / Total,
+             Entry.SplaySamples * msPerSample,
+             Entry.Site);
+
+    Dl_info Info;
+    if (dladdr (Entry.Site, &Info) && Info.dli_sname)
+      fprintf (Out, " %s+0x%lx", Info.dli_sname,
+               (unsigned long) ((char *) Entry.Site -
+                                (char *) Info.dli_saddr));
+    if (Entry.SourceFile && Entry.lineno)
+      fprintf (Out, " (%s:%u)", Entry.SourceFile, Entry.lineno);
+    fprintf (Out, "\n");
+  }
+
+  if (Out != stderr)
+    fclose (Out);
+  else
+    fflush (Out);
+}
+
+//
+// Function: startProfiler()
+//
+// Description:
+//  Start the profiling timer if the SCPROFILE environment variable asks for
+//  it.
+//
+void
+llvm::startProfiler (void) {
+  const char * Interval = getenv ("SCPROFILE");
+  if (!Interval)
+    return;
+
+  int Microseconds = atoi (Interval);
+  ConfigData.ProfileInterval = (Microseconds > 0) ? Microseconds : 1000;
+
+  struct sigaction sa;
+  memset (&sa, 0, sizeof (struct sigaction));
+  sa.sa_sigaction = profile_handler;
+  sa.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset (&sa.sa_mask);
+  if (sigaction (SIGPROF, &sa, NULL) == -1) {
+    perror ("SAFECode: cannot install profiling handler");
+    ConfigData.ProfileInterval = 0;
+    return;
+  }
+
+  struct itimerval Timer;
+  Timer.it_interval.tv_sec = ConfigData.ProfileInterval / 1000000;
+  Timer.it_interval.tv_usec = ConfigData.ProfileInterval % 1000000;
+  Timer.it_value = Timer.it_interval;
+  if (setitimer (ITIMER_PROF, &Timer, 0) == -1) {
+    perror ("SAFECode: cannot start profiling timer");
+    ConfigData.ProfileInterval = 0;
+    return;
+  }
+
+  atexit (dumpProfile);
+}
@@ -0,0 +1,136 @@
+//===- Profiler.h - Sampling profiler for the run-time checks ---*- C++ -*-===//
+//
+//                          The SAFECode Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the interface to a sampling profiler that measures how
+// much time a program spends in the run-time checks and in the object
+// registry.  When the SCPROFILE environment variable is set, a profiling timer
+// interrupts the program every SCPROFILE microseconds of CPU time (1000 by
+// default).  Each run-time entry point marks the operation it performs and
+// its call site in a per-thread record, and the signal handler charges the
+// sample to whatever the record holds at that moment; the code inside the
+// run-time is not otherwise instrumented.  A flat profile is printed at exit
+// to the file named by SCPROFILEFILE or to standard error.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef SAFECODE_PROFILER_H
+#define SAFECODE_PROFILER_H
+
+#include "ConfigData.h"
+
+namespace llvm {
+
+//
+// Enumeration: ProfileOp
+//
+// Description:
+//  The run-time operations to which the profiler charges samples.
+//
+enum ProfileOp {
+  ProfileNone = 0,
+  ProfilePoolcheck,
+  ProfileBoundscheck,
+  ProfileRegister,
+  ProfileUnregister,
+  ProfileNumOps
+};
+
+//
+// Structure: ProfileMark
+//
+// Description:
+//  The operation that a thread is performing in the run-time, if any.
+//
+struct ProfileMark {
+  // The operation and the number of splay tree operations it is inside of
+  unsigned Op;
+  unsigned InSplay;
+
+  // The instrumented code that called into the run-time
+  void * Site;
+  const char * SourceFile;
+  unsigned lineno;
+};
+
+extern __thread struct ProfileMark CurrentProfileMark;
+
+// Start sampling; called once when the run-time is initialized
+void startProfiler (void);
+
+//
+// Structure: ProfileScope
+//
+// Description:
+//  Mark the current thread as performing the given operation until the end
+//  of the enclosing scope.  If the thread is already inside an operation
+//  (e.g., a check that registers an object), the outer operation keeps the
+//  samples.
+//
+struct ProfileScope {
+  bool Active;
+
+  ProfileScope (ProfileOp Op, void * Site,
+                const char * SourceFile = 0, unsigned lineno = 0) {
+    Active = __builtin_expect (ConfigData.ProfileInterval != 0, 0) &&
+             (CurrentProfileMark.Op == ProfileNone);
+    if (Active) {
+      CurrentProfileMark.Site = Site;
+      CurrentProfileMark.SourceFile = SourceFile;
+      CurrentProfileMark.lineno = lineno;
+      __asm__ __volatile__ ("" ::: "memory");
+      CurrentProfileMark.Op = Op;
+    }
+  }
+
+  ~ProfileScope () {
+    if (Active)
+      CurrentProfileMark.Op = ProfileNone;
+  }
+};
+
+//
+// Structure: SplayProfileScope
+//
+// Description:
+//  Mark the current thread as searching or updating a splay tree until the
+//  end of the enclosing scope.
+//
+struct SplayProfileScope {
+  bool Active;
+
+  SplayProfileScope () {
+    Active = __builtin_expect (ConfigData.ProfileInterval != 0, 0);
+    if (Active)
+      ++CurrentProfileMark.InSplay;
+  }
+
+  ~SplayProfileScope () {
+    if (Active)
+      --CurrentProfileMark.InSplay;
+  }
+};
+
+}
+
+//
+// Mark the enclosing run-time entry point as performing the given operation
+// on behalf of its caller.
+//
+#define PROFILE_OP(Op, SourceFile, lineno) \
+  PROFILE_OP_AT (Op, __builtin_return_address (0), SourceFile, lineno)
+
+//
+// The same, in a function that performs a check on behalf of an entry point
+// and is given the return address of that entry point as PC.
+//
+#define PROFILE_OP_AT(Op, PC, SourceFile, lineno) \
+  llvm::ProfileScope ProfileScope_ ((Op), const_cast<void *> (PC), \
+                                    (SourceFile), (lineno))
+
+#endif
@@ -119,6 +119,13 @@ ReportMemoryViolation(const ViolationInfo *v) {
   v->print(*ErrorLog);
   *ErrorLog << std::flush;
 
+  //
+  // If the program is being fuzzed in-process, have the fuzzer save the input
+  // that caused the error; the fuzzer terminates the program.
+  //
+  if (LLVMFuzzerReportCrash && (v->type != ViolationInfo::WARN_LOAD_STORE))
+    LLVMFuzzerReportCrash ("SAFECode memory safety violation");
+
   //
   // If we need to terminate now, do that.
   //
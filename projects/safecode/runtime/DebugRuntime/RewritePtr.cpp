@@ -86,6 +86,21 @@ rewrite_ptr (DebugPoolTy * Pool,
 
   static unsigned char * invalidptr = 0;
 
+  //
+  // If the program is being fuzzed in-process, tell the fuzzer that the check
+  // moved a pointer out of bounds and roughly how far; inputs that do this at
+  // a new check or by a new order of magnitude are worth mutating further.
+  //
+  if (LLVMFuzzerAddFeature) {
+    uintptr_t Distance = (p < ObjStart) ? ((uintptr_t) ObjStart - (uintptr_t) p)
+                                        : ((uintptr_t) p - (uintptr_t) ObjEnd);
+    uintptr_t Magnitude = 0;
+    while (Distance >>= 1)
+      ++Magnitude;
+    uintptr_t Site = (uintptr_t) SourceFile * 31 + lineno;
+    LLVMFuzzerAddFeature (Site * 64 + Magnitude);
+  }
+
   //
   // If this pointer has already been rewritten, do not rewrite it again.
   //
@@ -32,10 +32,12 @@
 #include "PoolAllocator.h"
 #include "PageManager.h"
 #include "ConfigData.h"
+#include "Profiler.h"
 #include "RewritePtr.h"
 
 #include "../include/CWE.h"
 #include "../include/DebugRuntime.h"
+#include "../include/FuncTargetSet.h"
 
 #include <errno.h>
 
@@ -141,6 +143,7 @@ _barebone_poolcheck (DebugPoolTy * Pool, void * Node, unsigned length,
     ObjStart = Pool->objectCache[index].lower;
     ObjEnd = Pool->objectCache[index].upper; 
   } else {
+    SplayProfileScope Splay;
     found = Pool->Objects.find (Node, ObjStart, ObjEnd);
   }
 
@@ -171,19 +174,26 @@ _barebone_poolcheck (DebugPoolTy * Pool, void * Node, unsigned length,
 }
 
 //
-// Function: poolcheck_debug()
+// Function: poolcheck_at()
 //
 // Description:
 //  This function performs a load/store check.  It ensures that the given
 //  pointer points into a valid memory object.
 //
-void
-poolcheck_debug (DebugPoolTy *Pool,
-                 void *Node,
-                 unsigned length,
-                 TAG,
-                 const char * SourceFilep,
-                 unsigned lineno) {
+// Inputs:
+//  PC - The return address of the run-time entry point called by the
+//       program; errors are reported at this address.
+//
+static inline void
+poolcheck_at (DebugPoolTy *Pool,
+              void *Node,
+              unsigned length,
+              TAG,
+              const char * SourceFilep,
+              unsigned lineno,
+              const void * PC) {
+  PROFILE_OP_AT (ProfilePoolcheck, PC, SourceFilep, lineno);
+
   //
   // If the memory access is zero bytes in length, don't report an error.
   // This can happen on memcpy() and memset() calls that are instrumented
@@ -203,7 +213,7 @@ poolcheck_debug (DebugPoolTy *Pool,
     if (!((ObjStart <= NodeEnd) && (NodeEnd <= ObjEnd))) {
       DebugViolationInfo v;
       v.type = ViolationInfo::FAULT_LOAD_STORE,
-        v.faultPC = __builtin_return_address(0),
+        v.faultPC = PC,
         v.faultPtr = NodeEnd,
         v.CWE = CWEBufferOverflow,
         v.SourceFile = SourceFilep,
@@ -218,12 +228,17 @@ poolcheck_debug (DebugPoolTy *Pool,
   //
   // Look for the object within the splay tree of external objects.
   //
-  if (ExternalObjects->find (Node, ObjStart, ObjEnd)) {
+  bool fs;
+  {
+    SplayProfileScope Splay;
+    fs = ExternalObjects->find (Node, ObjStart, ObjEnd);
+  }
+  if (fs) {
     if ((ObjStart <= Node) && (Node <= ObjEnd)) {
       if (!((ObjStart <= NodeEnd) && (NodeEnd <= ObjEnd))) {
         DebugViolationInfo v;
         v.type = ViolationInfo::FAULT_LOAD_STORE,
-          v.faultPC = __builtin_return_address(0),
+          v.faultPC = PC,
           v.faultPtr = NodeEnd,
           v.CWE = CWEBufferOverflow,
           v.SourceFile = SourceFilep,
@@ -261,7 +276,7 @@ poolcheck_debug (DebugPoolTy *Pool,
   //
   DebugViolationInfo v;
   v.type = ViolationInfo::FAULT_LOAD_STORE,
-    v.faultPC = __builtin_return_address(0),
+    v.faultPC = PC,
     v.faultPtr = Node,
     v.CWE = CWEDP,
     v.SourceFile = SourceFilep,
@@ -272,9 +287,27 @@ poolcheck_debug (DebugPoolTy *Pool,
   return;
 }
 
+void
+poolcheck_debug (DebugPoolTy *Pool,
+                 void *Node,
+                 unsigned length,
+                 TAG,
+                 const char * SourceFilep,
+                 unsigned lineno) {
+  poolcheck_at (Pool, Node, length, tag, SourceFilep, lineno,
+                __builtin_return_address(0));
+}
+
+void
+poolcheck_site (DebugPoolTy * Pool, void * Node, unsigned length,
+                const DebugSiteInfo * Site) {
+  poolcheck_at (Pool, Node, length, Site->tag, Site->SourceFile, Site->lineno,
+                __builtin_return_address(0));
+}
+
 
 //
-// Function: poolcheckalign_debug()
+// Function: poolcheckalign_at()
 //
 // Description:
 //  Identical to poolcheckalign() but with additional debug info parameters.
@@ -284,12 +317,16 @@ poolcheck_debug (DebugPoolTy *Pool,
 //  Node   - The pointer to check.
 //  Offset - The offset, in bytes, that the pointer should be to the beginning
 //           of objects found in the pool.
+//  PC     - The return address of the run-time entry point called by the
+//           program.
 //
 // FIXME:
 //  For now, this does nothing, but it should, in fact, do a run-time check.
 //
-void
-poolcheckalign_debug (DebugPoolTy *Pool, void *Node, unsigned Offset, TAG, const char * SourceFile, unsigned lineno) {
+static inline void
+poolcheckalign_at (DebugPoolTy *Pool, void *Node, unsigned Offset, TAG, const char * SourceFile, unsigned lineno, const void * PC) {
+  PROFILE_OP_AT (ProfilePoolcheck, PC, SourceFile, lineno);
+
   //
   // Let null pointers go if the alignment is zero; such pointers are aligned.
   //
@@ -363,7 +400,7 @@ poolcheckalign_debug (DebugPoolTy *Pool, void *Node, unsigned Offset, TAG, const
 
   AlignmentViolation v;
   v.type = ViolationInfo::FAULT_ALIGN,
-    v.faultPC = __builtin_return_address(0),
+    v.faultPC = PC,
     v.faultPtr = Node,
     v.CWE = CWEBufferOverflow,
     v.PoolHandle = Pool,
@@ -378,12 +415,29 @@ poolcheckalign_debug (DebugPoolTy *Pool, void *Node, unsigned Offset, TAG, const
 }
 
 void
-poolcheckui_debug (DebugPoolTy *Pool,
-                   void *Node,
-                   unsigned length,
-                   TAG,
-                   const char * SourceFilep,
-                   unsigned lineno) {
+poolcheckalign_debug (DebugPoolTy *Pool, void *Node, unsigned Offset, TAG, const char * SourceFile, unsigned lineno) {
+  poolcheckalign_at (Pool, Node, Offset, tag, SourceFile, lineno,
+                     __builtin_return_address(0));
+}
+
+void
+poolcheckalign_site (DebugPoolTy * Pool, void * Node, unsigned Offset,
+                     const DebugSiteInfo * Site) {
+  poolcheckalign_at (Pool, Node, Offset,
+                     Site->tag, Site->SourceFile, Site->lineno,
+                     __builtin_return_address(0));
+}
+
+static inline void
+poolcheckui_at (DebugPoolTy *Pool,
+                void *Node,
+                unsigned length,
+                TAG,
+                const char * SourceFilep,
+                unsigned lineno,
+                const void * PC) {
+  PROFILE_OP_AT (ProfilePoolcheck, PC, SourceFilep, lineno);
+
   //
   // If the memory access is zero bytes in length, don't report an error.
   // This can happen on memcpy() and memset() calls that are instrumented
@@ -403,7 +457,7 @@ poolcheckui_debug (DebugPoolTy *Pool,
     if (!((ObjStart <= NodeEnd) && (NodeEnd <= ObjEnd))) {
       DebugViolationInfo v;
       v.type = ViolationInfo::FAULT_LOAD_STORE,
-        v.faultPC = __builtin_return_address(0),
+        v.faultPC = PC,
         v.faultPtr = NodeEnd,
         v.CWE = CWEBufferOverflow,
         v.SourceFile = SourceFilep,
@@ -421,12 +475,16 @@ poolcheckui_debug (DebugPoolTy *Pool,
   // are stored in this splay tree.
   //
   int fs = 0;
-  if ((fs = ExternalObjects->find (Node, ObjStart, ObjEnd))) {
+  {
+    SplayProfileScope Splay;
+    fs = ExternalObjects->find (Node, ObjStart, ObjEnd);
+  }
+  if (fs) {
     if ((ObjStart <= Node) && (Node <= ObjEnd)) {
       if (!((ObjStart <= NodeEnd) && (NodeEnd <= ObjEnd))) {
         DebugViolationInfo v;
         v.type = ViolationInfo::FAULT_LOAD_STORE,
-          v.faultPC = __builtin_return_address(0),
+          v.faultPC = PC,
           v.faultPtr = NodeEnd,
           v.CWE = CWEBufferOverflow,
           v.SourceFile = SourceFilep,
@@ -457,7 +515,7 @@ poolcheckui_debug (DebugPoolTy *Pool,
   //
   if (logregs) {
     fprintf (stderr, "PoolcheckUI failed(%p:%x): %p %p from %p\n", 
-        (void*)Pool, fs, (void*)Node, ObjEnd, __builtin_return_address(0));
+        (void*)Pool, fs, (void*)Node, ObjEnd, PC);
     fflush (stderr);
   }
 
@@ -476,7 +534,7 @@ poolcheckui_debug (DebugPoolTy *Pool,
 
     OutOfBoundsViolation v;
     v.type = ViolationInfo::FAULT_LOAD_STORE,
-      v.faultPC = __builtin_return_address(0),
+      v.faultPC = PC,
       v.faultPtr = Node,
       v.CWE = CWEBufferOverflow,
       v.SourceFile = SourceFilep,
@@ -496,7 +554,7 @@ poolcheckui_debug (DebugPoolTy *Pool,
   if (Node == 0) {
     DebugViolationInfo v;
     v.type = ViolationInfo::FAULT_LOAD_STORE,
-      v.faultPC = __builtin_return_address(0),
+      v.faultPC = PC,
       v.faultPtr = Node,
       v.CWE = CWENull,
       v.SourceFile = SourceFilep,
@@ -508,6 +566,25 @@ poolcheckui_debug (DebugPoolTy *Pool,
   return;
 }
 
+void
+poolcheckui_debug (DebugPoolTy *Pool,
+                   void *Node,
+                   unsigned length,
+                   TAG,
+                   const char * SourceFilep,
+                   unsigned lineno) {
+  poolcheckui_at (Pool, Node, length, tag, SourceFilep, lineno,
+                  __builtin_return_address(0));
+}
+
+void
+poolcheckui_site (DebugPoolTy * Pool, void * Node, unsigned length,
+                  const DebugSiteInfo * Site) {
+  poolcheckui_at (Pool, Node, length,
+                  Site->tag, Site->SourceFile, Site->lineno,
+                  __builtin_return_address(0));
+}
+
 //
 // Function: boundscheck_lookup()
 //
@@ -548,7 +625,12 @@ boundscheck_lookup (DebugPoolTy * Pool, void * & Source, void * & End ) {
     //
     // Search the splay tree.  If we find the object, add it to the cache.
     //
-    if (Pool->Objects.find(Source, Source, End)) {
+    bool found;
+    {
+      SplayProfileScope Splay;
+      found = Pool->Objects.find(Source, Source, End);
+    }
+    if (found) {
       updateCache (Pool, Source, End);
       return true;
     }
@@ -588,6 +670,8 @@ boundscheck_lookup (DebugPoolTy * Pool, void * & Source, void * & End ) {
 //  Source   - The source pointer used in the indexing operation (the GEP).
 //  Dest     - The result pointer of the indexing operation (the GEP).
 //  CanFail  - Flags whether the check can fail (for complete DSNodes).
+//  PC       - The return address of the run-time entry point called by the
+//             program.
 //
 // Note:
 //  If ObjLen is zero, then the lookup says that Source was not found within
@@ -597,7 +681,8 @@ static void *
 boundscheck_check (bool found, void * ObjStart, void * ObjEnd,
                    DebugPoolTy * Pool,
                    void * Source, void * Dest, bool CanFail,
-                   const char * SourceFile, unsigned int lineno) {
+                   const char * SourceFile, unsigned int lineno,
+                   const void * PC) {
   //
   // Determine if this is a rewrite pointer that is being indexed.  If so,
   // compute the original value, re-do the indexing operation, and rewrite the
@@ -659,7 +744,7 @@ boundscheck_check (bool found, void * ObjStart, void * ObjEnd,
       void * ptr = rewrite_ptr (Pool, Dest, ObjStart, ObjEnd, SourceFile, lineno);
       if (logregs) {
         fprintf (ReportLog, "boundscheck: rewrite(1): %p %p %p %p at pc=%p to %p at %s (%d)\n",
-                 ObjStart, ObjEnd, Source, Dest, (void*)__builtin_return_address(0), ptr, SourceFile, lineno);
+                 ObjStart, ObjEnd, Source, Dest, (void*)PC, ptr, SourceFile, lineno);
         fflush (ReportLog);
       }
       return ptr;
@@ -679,7 +764,7 @@ boundscheck_check (bool found, void * ObjStart, void * ObjEnd,
 
       OutOfBoundsViolation v;
       v.type = ViolationInfo::FAULT_OUT_OF_BOUNDS,
-        v.faultPC = __builtin_return_address(0),
+        v.faultPC = PC,
         v.faultPtr = Dest,
         v.CWE = CWEBufferOverflow,
         v.dbgMetaData = debugmetadataptr,
@@ -703,7 +788,7 @@ boundscheck_check (bool found, void * ObjStart, void * ObjEnd,
     if ((((unsigned char *)0) <= Dest) && (Dest < (unsigned char *)(4096))) {
       if (logregs) {
         fprintf (ReportLog, "boundscheck: NULL Index: %x %x %p %p at pc=%p at %s (%d)\n",
-                 0, 4096, (void*)Source, (void*)Dest, (void*)__builtin_return_address(0), SourceFile, lineno);
+                 0, 4096, (void*)Source, (void*)Dest, (void*)PC, SourceFile, lineno);
         fflush (ReportLog);
       }
       return Dest;
@@ -712,7 +797,7 @@ boundscheck_check (bool found, void * ObjStart, void * ObjEnd,
           (((uintptr_t) Dest) == 4096)) {
         if (logregs) {
           fprintf (ReportLog, "boundscheck: rewrite(3): %x %x %p %p at pc=%p at %s (%d)\n",
-                   0, 4096, (void*)Source, (void*)Dest, (void*)__builtin_return_address(0), SourceFile, lineno);
+                   0, 4096, (void*)Source, (void*)Dest, (void*)PC, SourceFile, lineno);
           fflush (ReportLog);
         }
         return rewrite_ptr (Pool,
@@ -724,7 +809,7 @@ boundscheck_check (bool found, void * ObjStart, void * ObjEnd,
       } else {
         OutOfBoundsViolation v;
         v.type = ViolationInfo::FAULT_OUT_OF_BOUNDS,
-          v.faultPC = __builtin_return_address(0),
+          v.faultPC = PC,
           v.faultPtr = Dest,
           v.CWE = CWEBufferOverflow,
           v.dbgMetaData = NULL,
@@ -758,7 +843,7 @@ boundscheck_check (bool found, void * ObjStart, void * ObjEnd,
           if (logregs)
             fprintf (ReportLog,
                      "boundscheck: rewrite(2): %p %p %p %p at pc=%p to %p at %s (%d)\n",
-                     S, end, Source, Dest, (void*)__builtin_return_address(0),
+                     S, end, Source, Dest, (void*)PC,
                      ptr, SourceFile, lineno);
           fflush (ReportLog);
           return ptr;
@@ -766,7 +851,7 @@ boundscheck_check (bool found, void * ObjStart, void * ObjEnd,
         
         OutOfBoundsViolation v;
         v.type = ViolationInfo::FAULT_OUT_OF_BOUNDS,
-          v.faultPC = __builtin_return_address(0),
+          v.faultPC = PC,
           v.faultPtr = Dest,
           v.CWE = CWEBufferOverflow,
           v.dbgMetaData = NULL,
@@ -787,7 +872,7 @@ boundscheck_check (bool found, void * ObjStart, void * ObjEnd,
   if (CanFail) {
     OutOfBoundsViolation v;
     v.type = ViolationInfo::FAULT_OUT_OF_BOUNDS,
-      v.faultPC = __builtin_return_address(0),
+      v.faultPC = PC,
       v.faultPtr = Dest,
       v.CWE = CWEBufferOverflow,
       v.PoolHandle = Pool, 
@@ -828,7 +913,7 @@ boundscheck_check (bool found, void * ObjStart, void * ObjEnd,
       void * ptr = rewrite_ptr (Pool, Dest, ObjStart, ObjEnd, SourceFile, lineno);
       if (logregs) {
         fprintf (ReportLog, "boundscheck: rewrite(4): %p %p %p %p at pc=%p to %p at %s (%d)\n",
-                 ObjStart, ObjEnd, Source, Dest, (void*)__builtin_return_address(0), ptr, SourceFile, lineno);
+                 ObjStart, ObjEnd, Source, Dest, (void*)PC, ptr, SourceFile, lineno);
         fflush (ReportLog);
       }
       return ptr;
@@ -844,7 +929,7 @@ boundscheck_check (bool found, void * ObjStart, void * ObjEnd,
 
       OutOfBoundsViolation v;
       v.type = ViolationInfo::FAULT_OUT_OF_BOUNDS,
-        v.faultPC = __builtin_return_address(0),
+        v.faultPC = PC,
         v.faultPtr = Dest,
         v.CWE = CWEBufferOverflow,
         v.dbgMetaData = debugmetadataptr,
@@ -862,18 +947,17 @@ boundscheck_check (bool found, void * ObjStart, void * ObjEnd,
 }
 
 //
-// Function: boundscheck_debug()
+// Function: boundscheck_at()
 //
 // Description:
 //  Identical to boundscheck() except that it takes additional debug info
-//  parameters.
+//  parameters and the return address PC of the run-time entry point called
+//  by the program.
 //
-// FIXME: this function is marked as noinline due to LLVM bug 4562
-// http://llvm.org/bugs/show_bug.cgi?id=4562
-//
-// the attribute should be taken once the bug is fixed.
-void * __attribute__((noinline))
-boundscheck_debug (DebugPoolTy * Pool, void * Source, void * Dest, TAG, const char * SourceFile, unsigned lineno) {
+static inline void *
+boundscheck_at (DebugPoolTy * Pool, void * Source, void * Dest, TAG, const char * SourceFile, unsigned lineno, const void * PC) {
+  PROFILE_OP_AT (ProfileBoundscheck, PC, SourceFile, lineno);
+
   // This code is inlined at all boundscheck() calls
 
   // Search the splay for Source and return the bounds of the object
@@ -895,12 +979,37 @@ boundscheck_debug (DebugPoolTy * Pool, void * Source, void * Dest, TAG, const ch
     //  1) A valid object was not found in splay tree, or
     //  2) Dest is not within the valid object in which Source was found
     //
-    return boundscheck_check (ret, ObjStart, ObjEnd, Pool, Source, Dest, true, SourceFile, lineno);  
+    return boundscheck_check (ret, ObjStart, ObjEnd, Pool, Source, Dest, true, SourceFile, lineno, PC);
   }
 }
 
 //
-// Function: boundscheckui_debug()
+// Function: boundscheck_debug()
+//
+// Description:
+//  Identical to boundscheck() except that it takes additional debug info
+//  parameters.
+//
+// FIXME: this function is marked as noinline due to LLVM bug 4562
+// http://llvm.org/bugs/show_bug.cgi?id=4562
+//
+// the attribute should be taken once the bug is fixed.
+void * __attribute__((noinline))
+boundscheck_debug (DebugPoolTy * Pool, void * Source, void * Dest, TAG, const char * SourceFile, unsigned lineno) {
+  return boundscheck_at (Pool, Source, Dest, tag, SourceFile, lineno,
+                         __builtin_return_address(0));
+}
+
+void *
+boundscheck_site (DebugPoolTy * Pool, void * Source, void * Dest,
+                  const DebugSiteInfo * Site) {
+  return boundscheck_at (Pool, Source, Dest,
+                         Site->tag, Site->SourceFile, Site->lineno,
+                         __builtin_return_address(0));
+}
+
+//
+// Function: boundscheckui_at()
 //
 // Description:
 //  Identical to boundscheckui() but with debug information.
@@ -913,13 +1022,18 @@ boundscheck_debug (DebugPoolTy * Pool, void * Source, void * Dest, TAG, const ch
 //  SourceFile - The source file in which the check was inserted.
 //  lineno     - The line number of the instruction for which the check was
 //               inserted.
-//
-void *
-boundscheckui_debug (DebugPoolTy * Pool,
-                     void * Source,
-                     void * Dest, TAG,
-                     const char * SourceFile,
-                     unsigned int lineno) {
+//  PC         - The return address of the run-time entry point called by the
+//               program.
+//
+static inline void *
+boundscheckui_at (DebugPoolTy * Pool,
+                  void * Source,
+                  void * Dest, TAG,
+                  const char * SourceFile,
+                  unsigned int lineno,
+                  const void * PC) {
+  PROFILE_OP_AT (ProfileBoundscheck, PC, SourceFile, lineno);
+
   // This code is inlined at all boundscheckui calls
 
   // Search the splay for Source and return the bounds of the object
@@ -949,10 +1063,29 @@ boundscheckui_debug (DebugPoolTy * Pool,
                               Dest,
                               false,
                               SourceFile,
-                              lineno);
+                              lineno,
+                              PC);
   }
 }
 
+void *
+boundscheckui_debug (DebugPoolTy * Pool,
+                     void * Source,
+                     void * Dest, TAG,
+                     const char * SourceFile,
+                     unsigned int lineno) {
+  return boundscheckui_at (Pool, Source, Dest, tag, SourceFile, lineno,
+                           __builtin_return_address(0));
+}
+
+void *
+boundscheckui_site (DebugPoolTy * Pool, void * Source, void * Dest,
+                    const DebugSiteInfo * Site) {
+  return boundscheckui_at (Pool, Source, Dest,
+                           Site->tag, Site->SourceFile, Site->lineno,
+                           __builtin_return_address(0));
+}
+
 //
 // Function: funccheck()
 //
@@ -986,7 +1119,7 @@ funccheck (void *f, void * targets[]) {
 }
 
 //
-// Function: funccheck_debug()
+// Function: funccheck_at()
 //
 // Description:
 //  Determine whether the specified function pointer is one of the functions
@@ -995,13 +1128,16 @@ funccheck (void *f, void * targets[]) {
 // Inputs:
 //  f         - The function pointer that we are testing.
 //  targets   - Pointer to a list of potential targets.
+//  PC        - The return address of the run-time entry point called by the
+//              program.
 //
-void
-funccheck_debug (void *f,
-                 void * targets[],
-                 TAG,
-                 const char * SourceFilep,
-                 unsigned lineno) {
+static inline void
+funccheck_at (void *f,
+              void * targets[],
+              TAG,
+              const char * SourceFilep,
+              unsigned lineno,
+              const void * PC) {
   unsigned index = 0;
   while (targets[index]) {
     if (f == targets[index])
@@ -1009,6 +1145,91 @@ funccheck_debug (void *f,
     ++index;
   }
 
+  DebugViolationInfo v;
+  v.type = ViolationInfo::FAULT_CALL,
+    v.faultPC = PC,
+    v.faultPtr = f,
+    v.CWE = CWEBufferOverflow,
+    v.SourceFile = SourceFilep,
+    v.lineNo = lineno;
+
+  ReportMemoryViolation(&v);
+  return;
+}
+
+void
+funccheck_debug (void *f,
+                 void * targets[],
+                 TAG,
+                 const char * SourceFilep,
+                 unsigned lineno) {
+  funccheck_at (f, targets, tag, SourceFilep, lineno,
+                __builtin_return_address(0));
+}
+
+void
+funccheck_site (void * f, void * targets[], const DebugSiteInfo * Site) {
+  funccheck_at (f, targets, Site->tag, Site->SourceFile, Site->lineno,
+                __builtin_return_address(0));
+}
+
+//
+// Function: funccheck_hashed_init()
+//
+// Description:
+//  Build the hash index of a target set.  The compiler calls this from a
+//  constructor for every target set that it creates.
+//
+void
+funccheck_hashed_init (FuncTargetSet * set) {
+  initTargetSet (set);
+  return;
+}
+
+//
+// Function: funccheck_hashed()
+//
+// Description:
+//  Determine whether the specified function pointer is one of the functions
+//  in the given target set.  This is used instead of funccheck() when the
+//  call has many targets.
+//
+// Inputs:
+//  f   - The function pointer that we are testing.
+//  set - The set of potential targets.
+//
+void
+funccheck_hashed (void * f, FuncTargetSet * set) {
+  if (isInTargetSet (f, set))
+    return;
+
+  DebugViolationInfo v;
+  v.type = ViolationInfo::FAULT_CALL,
+    v.faultPC = __builtin_return_address(0),
+    v.faultPtr = f,
+    v.CWE = CWEBufferOverflow,
+    v.SourceFile = "Unknown",
+    v.lineNo = 0;
+
+  ReportMemoryViolation(&v);
+  return;
+}
+
+//
+// Function: funccheck_hashed_debug()
+//
+// Description:
+//  This is the debug version of funccheck_hashed().
+//
+void
+funccheck_hashed_debug (void * f,
+                        FuncTargetSet * set,
+                        TAG,
+                        const char * SourceFilep,
+                        unsigned lineno) {
+  if (isInTargetSet (f, set))
+    return;
+
   DebugViolationInfo v;
   v.type = ViolationInfo::FAULT_CALL,
     v.faultPC = __builtin_return_address(0),
@@ -1065,10 +1286,16 @@ funccheckui_debug (void *f,
   return;
 }
 
+void
+funccheckui_site (void * f, void * targets[], const DebugSiteInfo * Site) {
+  return;
+}
+
 /// Stubs
 
 void
 poolcheck (DebugPoolTy *Pool, void *Node, unsigned length) {
+  PROFILE_OP (ProfilePoolcheck, 0, 0);
   poolcheck_debug(Pool, Node, length, 0, NULL, 0);
 }
 
@@ -1093,6 +1320,7 @@ poolcheckui (DebugPoolTy *Pool, void *Node, unsigned length) {
 //
 void *
 boundscheck (DebugPoolTy * Pool, void * Source, void * Dest) {
+  PROFILE_OP (ProfileBoundscheck, 0, 0);
   return boundscheck_debug(Pool, Source, Dest, 0, NULL, 0);
 }
 
@@ -1109,6 +1337,7 @@ boundscheck (DebugPoolTy * Pool, void * Source, void * Dest) {
 //
 void *
 boundscheckui (DebugPoolTy * Pool, void * Source, void * Dest) {
+  PROFILE_OP (ProfileBoundscheck, 0, 0);
   return boundscheckui_debug (Pool, Source, Dest, 0, NULL, 0);
 }
 
@@ -1127,5 +1356,6 @@ boundscheckui (DebugPoolTy * Pool, void * Source, void * Dest) {
 //
 void
 poolcheckalign (DebugPoolTy *Pool, void *Node, unsigned Offset) {
+  PROFILE_OP (ProfilePoolcheck, 0, 0);
   poolcheckalign_debug(Pool, Node, Offset, 0, NULL, 0);
 }
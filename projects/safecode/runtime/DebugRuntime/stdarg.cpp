@@ -20,15 +20,9 @@
 #include <cstddef>
 #include <cstdlib>
 #include <cstring>
-#include <map>
-#include <set>
+#include <pthread.h>
 #include <stdint.h>
 #include <syslog.h>
-#include <vector>
-
-using std::map;
-using std::vector;
-using std::set;
 
 // Declare SAFECode intrinsics as C functions.
 extern "C" uint32_t __sc_targetcheck(void *func);
@@ -36,45 +30,116 @@ extern "C" void __sc_varegister(va_list ap, uint32_t id);
 extern "C" void __sc_vacopyregister(va_list dest, va_list src);
 extern "C" void __sc_vacallregister(void *func, uint32_t argc, ...);
 extern "C" void __sc_vacallunregister();
+//
+// The pointer arguments of the vararg calls in progress are kept in a stack of
+// frames, one stack per thread, so that registering a call or a va_list is a
+// few stores.  The pointer arguments of all frames share one stack and the
+// va_lists that refer to a frame are kept in a list beside it; all three grow
+// when needed and are kept for the following calls, so that only the first
+// calls of a thread allocate memory.  They are freed when the thread exits.
+//
+typedef struct {
+  unsigned firstPointer;
+  unsigned numPointers;
+} VarArgFrame;
 
-typedef map<void *, unsigned> VaListToArgIndexMap;
-typedef set<void *> VaListSet;
 typedef struct {
-  VaListSet referrers;
-  vector<void *> pointerList;
-} ArgListEntry;
- 
+  void *list;
+  unsigned frame;
+} VaListReferrer;
+
+static __thread VarArgFrame *varArgFrames = 0;
+static __thread unsigned varArgDepth = 0;
+static __thread unsigned varArgCapacity = 0;
+
+static __thread void **varArgPointers = 0;
+static __thread unsigned numVarArgPointers = 0;
+static __thread unsigned varArgPointersCapacity = 0;
+
+static __thread VaListReferrer *vaListReferrers = 0;
+static __thread unsigned numVaListReferrers = 0;
+static __thread unsigned vaListReferrersCapacity = 0;
+
 // Used for determining if the expected target of a vararg function call is the
 // actual target.
-static void *expectedTarget = 0;
-// This vector contains information about all registered va_lists in the
-// program.
-static vector<ArgListEntry> & argLists (void) {
-  static vector<ArgListEntry> realargLists;
-  return realargLists;
+static __thread void *expectedTarget = 0;
+
+// The key whose destructor frees the stacks of a thread when it exits.
+static pthread_key_t varArgStacksKey;
+static pthread_once_t varArgStacksKeyOnce = PTHREAD_ONCE_INIT;
+
+static void freeVarArgStacks(void *) {
+  free(varArgFrames);
+  free(varArgPointers);
+  free(vaListReferrers);
+  varArgFrames = 0;
+  varArgPointers = 0;
+  vaListReferrers = 0;
+  varArgDepth = varArgCapacity = 0;
+  numVarArgPointers = varArgPointersCapacity = 0;
+  numVaListReferrers = vaListReferrersCapacity = 0;
 }
 
-// A map from a va_list to the index of its registered contents in the argLists
-// vector above.
-static VaListToArgIndexMap & vaListRegistrations (void) {
-  static VaListToArgIndexMap realvaListRegistrations;
-  return realvaListRegistrations;
+static void createVarArgStacksKey() {
+  pthread_key_create(&varArgStacksKey, freeVarArgStacks);
+}
+
+// Make room for one more element at the end of a stack.
+template <typename T>
+static inline void reserveOneMore(T *&stack, unsigned size,
+                                  unsigned &capacity) {
+  if (size < capacity)
+    return;
+  // The frames are allocated first; have them freed with the thread.
+  if (varArgCapacity == 0) {
+    pthread_once(&varArgStacksKeyOnce, createVarArgStacksKey);
+    pthread_setspecific(varArgStacksKey, (void *) &varArgFrames);
+  }
+  unsigned newCapacity = capacity ? 2 * capacity : 16;
+  void *newStack = realloc(stack, newCapacity * sizeof(T));
+  if (newStack == 0) {
+    fprintf(stderr, "SAFECode: out of memory registering vararg call\n");
+    abort();
+  }
+  stack = (T *) newStack;
+  capacity = newCapacity;
+}
+
+// Find the frame to which a va_list refers.  Returns the index of its entry in
+// the referrer list, or numVaListReferrers if there is none.
+static inline unsigned findVaList(va_list ap) {
+  for (unsigned slot = 0; slot < numVaListReferrers; ++slot)
+    if (vaListReferrers[slot].list == (void *) ap)
+      return slot;
+  return numVaListReferrers;
+}
+
+// Remove the entry of the referrer list at the given index.
+static inline void removeReferrer(unsigned slot) {
+  vaListReferrers[slot] = vaListReferrers[--numVaListReferrers];
 }
 
 // Remove all references of a va_list from the internal data structures.
 static inline void clearVaList(va_list ap) {
-  if (!vaListRegistrations().count(ap))
-    return;
-  unsigned idx = vaListRegistrations()[ap];
-  vaListRegistrations().erase(ap);
-  argLists()[idx].referrers.erase(ap);
+  unsigned slot = findVaList(ap);
+  if (slot != numVaListReferrers)
+    removeReferrer(slot);
+}
+
+// Record that a va_list refers to a frame.
+static inline void addReferrer(unsigned frame, va_list ap) {
+  reserveOneMore(vaListReferrers, numVaListReferrers,
+                 vaListReferrersCapacity);
+  VaListReferrer &referrer = vaListReferrers[numVaListReferrers++];
+  referrer.list = (void *) ap;
+  referrer.frame = frame;
 }
 
 // Check if the expected callee is the actual callee.
 // Returns a number under 0xffffffff if this is the case, and otherwise returns
 // 0xffffffff.
 uint32_t __sc_targetcheck(void *func) {
-  uint32_t id = (expectedTarget == func) ? argLists().size() - 1 : 0xffffffffu;
+  uint32_t id = (expectedTarget == func) ? varArgDepth - 1 : 0xffffffffu;
   // Always reset the expected target to NULL.
   // This is needed for correctness, eg. in the case of recursive calls of the
   // same function from external code.
@@ -85,57 +150,83 @@ uint32_t __sc_targetcheck(void *func) {
 // Associate a va_list with an index returned from __sc_targetcheck.
 void __sc_varegister(va_list ap, uint32_t id) {
   // Invalid index
-  if (id == 0xffffffffu)
+  if (id >= varArgDepth)
     return;
   // Remove all prior references of this list.
   clearVaList(ap);
   // Insert the list into the appropriate place.
-  vaListRegistrations()[ap] = id;
-  argLists()[id].referrers.insert(ap);
+  addReferrer(id, ap);
 }
 
 // Associate one va_list with the information from another va_list.
 void __sc_vacopyregister(va_list dest, va_list src) {
   // If the source list is not registered, don't do anything.
-  if (!vaListRegistrations().count(src))
+  unsigned slot = findVaList(src);
+  if (slot == numVaListReferrers)
     return;
+  unsigned frame = vaListReferrers[slot].frame;
   // Remove all references of the destination list.
   clearVaList(dest);
   // Register the destination list with the same information as the source list.
-  unsigned idx = vaListRegistrations()[dest] = vaListRegistrations()[src];
-  argLists()[idx].referrers.insert(dest);
+  addReferrer(frame, dest);
 }
 
 // Add a new entry to the lists of pointer arguments.
 void __sc_vacallregister(void *func, uint32_t argc, ...) {
-  argLists().push_back(ArgListEntry());
-  ArgListEntry &end = argLists().back();
+  reserveOneMore(varArgFrames, varArgDepth, varArgCapacity);
+  VarArgFrame &end = varArgFrames[varArgDepth++];
+  end.firstPointer = numVarArgPointers;
   // Find all the pointer arguments that were passed to this function and put
   // them in the list.
   va_list ap;
   void *arg;
   va_start(ap, argc);
-  for (arg = va_arg(ap, void *); arg != 0; arg = va_arg(ap, void *))
-    end.pointerList.push_back(arg);
+  for (arg = va_arg(ap, void *); arg != 0; arg = va_arg(ap, void *)) {
+    reserveOneMore(varArgPointers, numVarArgPointers, varArgPointersCapacity);
+    varArgPointers[numVarArgPointers++] = arg;
+  }
   va_end(ap);
+  end.numPointers = numVarArgPointers - end.firstPointer;
   // Set the value of the passed function pointer as the expected target.
   expectedTarget = func;
 }
 
-// Unregister the last pointer argument list.
+// Unregister the last pointer argument list, along with the va_lists that
+// refer to it.
 void __sc_vacallunregister() {
-  ArgListEntry &last = argLists().back();
-  VaListSet::iterator idx = last.referrers.begin();
-  VaListSet::iterator end = last.referrers.end();
-  // Remove each va_list associated with this list from the hash table.
-  for (; idx != end; ++idx)
-    vaListRegistrations().erase(*idx);
-  // Now remove the last entry altogether.
-  argLists().pop_back();
+  if (varArgDepth == 0)
+    return;
+  --varArgDepth;
+  numVarArgPointers = varArgFrames[varArgDepth].firstPointer;
+  for (unsigned slot = numVaListReferrers; slot-- > 0;)
+    if (vaListReferrers[slot].frame == varArgDepth)
+      removeReferrer(slot);
 }
 
 //
-// Allocate a call_info structure that describes a call to a format string
+// A call_info structure with room for the whitelists of most calls.  The
+// whitelist of call_info is its last field, so that the entries beyond its
+// first one are stored in the array that follows.  Longer whitelists are
+// allocated from the heap and freed with the buffer.
+//
+static const unsigned InlineWhitelistSize = 16;
+
+struct call_info_buffer {
+  struct {
+    call_info info;
+    void *whitelist[InlineWhitelistSize];
+  } storage;
+  call_info *info;
+
+  call_info_buffer() : info(&storage.info) {}
+  ~call_info_buffer() {
+    if (info != &storage.info)
+      free(info);
+  }
+};
+
+//
+// Initialize the call_info structure that describes a call to a format string
 // function. call_info is defined as:
 //
 // typedef struct {
@@ -147,58 +238,53 @@ void __sc_vacallunregister() {
 // } call_info;
 //
 // Inputs
-//   result   - a reference to a pointer that holds the location of the
-//              allocation
+//   buffer   - the structure to initialize
 //   ap       - the va_list associated with the function call
 //   TAG      - tag information for debugging purposes
 //   SRC_INFO - source and line number information for debugging purposes
 //
 // Returns
-//  On return, result points to allocated memory.
 //  This function returns true if the pointer list associated with the
 //  va_list argument was found, and false if the va_list was not
 //  recognized.
 //
 static inline bool
-build_call_info(call_info *&result, va_list ap, TAG, SRC_INFO) {
-  // Check if the list is registered.
-  VaListToArgIndexMap::iterator idx = vaListRegistrations().find(ap);
-  if (idx == vaListRegistrations().end()) {
-    // If not registered, return a call_info structure without the whitelist.
-    result = (call_info *) malloc(sizeof(call_info));
-    if (result != 0) {
-      // Don't limit the number of arguments to access.
-      result->vargc = 0xffffffffu;
-      result->tag = tag;
-      result->line_no = lineNo;
-      result->source_info = SourceFile;
-      result->whitelist[0] = 0;
+build_call_info(call_info_buffer &buffer, va_list ap, TAG, SRC_INFO) {
+  // Check if the list is registered, and make room for the whitelist of its
+  // call.  If the list is unknown or the whitelist can't be allocated, leave
+  // the whitelist empty.
+  unsigned slot = findVaList(ap);
+  const VarArgFrame *frame = 0;
+  if (slot != numVaListReferrers) {
+    frame = &varArgFrames[vaListReferrers[slot].frame];
+    if (frame->numPointers > InlineWhitelistSize) {
+      size_t size = offsetof(call_info, whitelist) +
+                    (frame->numPointers + 1) * sizeof(void *);
+      call_info *info = (call_info *) malloc(size);
+      if (info != 0)
+        buffer.info = info;
+      else
+        frame = 0;
     }
-    return false;
-  }
-  // Otherwise, allocate and populate a call_info structure with the pointer
-  // whitelist as specified in the corresponding index.
-  else {
-    const unsigned index = idx->second;
-    const vector<void *> &pointerList = argLists()[index].pointerList;
-    const size_t wl_size = pointerList.size();
-    // Allocate enough space so that the structure can hold the whitelist.
-    result =
-      (call_info *) malloc(sizeof(call_info) + wl_size * sizeof(void *));
-    if (result != 0) {
-      // Don't limit the number of arguments to access.
-      result->vargc = 0xffffffffu;
-      result->tag   = tag;
-      result->line_no = lineNo;
-      result->source_info = SourceFile;
-      // Copy over the pointer list for this registration into the whitelist.
-      for (unsigned i = 0; i < wl_size; ++i)
-        result->whitelist[i] = pointerList[i];
-      // End the whitelist with NULL.
-      result->whitelist[wl_size] = 0;
-    }
-    return true;
   }
+
+  call_info &result = *buffer.info;
+  // Don't limit the number of arguments to access.
+  result.vargc = 0xffffffffu;
+  result.tag = tag;
+  result.line_no = lineNo;
+  result.source_info = SourceFile;
+  result.whitelist[0] = 0;
+  if (frame == 0)
+    return false;
+
+  // Otherwise, copy over the pointer list for this registration into the
+  // whitelist and end it with NULL.
+  void **pointers = &varArgPointers[frame->firstPointer];
+  for (unsigned i = 0; i < frame->numPointers; ++i)
+    result.whitelist[i] = pointers[i];
+  result.whitelist[frame->numPointers] = 0;
+  return true;
 }
 
 // Initialize a pointer_info structure around a pointer.
@@ -244,12 +330,10 @@ int pool_vprintf_debug(DebugPoolTy *fmtPool,
                        bv_t complete,
                        TAG,
                        SRC_INFO) {
-  // Create the call_info structure associated with this call.
-  call_info *cinfo;
-  bool vaListFound = build_call_info(cinfo, ap, tag, SRC_INFO_ARGS);
-  // On error creating the structure, just print without runtime checks.
-  if (cinfo == 0)
-    return vprintf(fmt, ap);
+  // Initialize the call_info structure associated with this call.
+  call_info_buffer cbuffer;
+  bool vaListFound = build_call_info(cbuffer, ap, tag, SRC_INFO_ARGS);
+  call_info *cinfo = cbuffer.info;
 
   // Tell the gprintf() function that a) pointers are unwrapped and b) we
   // don't track the size of the vararg list.
@@ -273,9 +357,6 @@ int pool_vprintf_debug(DebugPoolTy *fmtPool,
   int result = gprintf(options, p, *cinfo, fmt_info, ap);
   funlockfile(stdout);
 
-  // Free the allocated call_info structure.
-  free(cinfo);
-
   return result;
 }
 
@@ -318,12 +399,10 @@ int pool_vfprintf_debug(DebugPoolTy *fPool,
                         bv_t complete,
                         TAG,
                         SRC_INFO) {
-  // Create the call_info structure associated with this call.
-  call_info *cinfo;
-  bool vaListFound = build_call_info(cinfo, ap, tag, SRC_INFO_ARGS);
-  // On error creating the structure, just print without runtime checks.
-  if (cinfo == 0)
-    return vfprintf((FILE *) fil, fmt, ap);
+  // Initialize the call_info structure associated with this call.
+  call_info_buffer cbuffer;
+  bool vaListFound = build_call_info(cbuffer, ap, tag, SRC_INFO_ARGS);
+  call_info *cinfo = cbuffer.info;
 
   // Tell the gprintf() function that a) pointers are unwrapped and b) we
   // don't track the size of the vararg list.
@@ -347,9 +426,6 @@ int pool_vfprintf_debug(DebugPoolTy *fPool,
   int result = gprintf(options, p, *cinfo, fmt_info, ap);
   funlockfile((FILE *) fil);
 
-  // Free the allocated call_info structure.
-  free(cinfo);
-
   return result;
 }
 
@@ -392,12 +468,10 @@ int pool_vsprintf_debug(DebugPoolTy *strPool,
                         bv_t complete,
                         TAG,
                         SRC_INFO) {
-  // Create the call_info structure associated with this call.
-  call_info *cinfo;
-  bool vaListFound = build_call_info(cinfo, ap, tag, SRC_INFO_ARGS);
-  // On error creating the structure, just print with no runtime checks.
-  if (cinfo == 0)
-    return vsprintf(str, fmt, ap);
+  // Initialize the call_info structure associated with this call.
+  call_info_buffer cbuffer;
+  bool vaListFound = build_call_info(cbuffer, ap, tag, SRC_INFO_ARGS);
+  call_info *cinfo = cbuffer.info;
 
   // Tell the gprintf() function that a) pointers are unwrapped and b) we
   // don't track the size of the vararg list.
@@ -436,9 +510,6 @@ int pool_vsprintf_debug(DebugPoolTy *strPool,
   // Call the printing function.
   int result = gprintf(options, p, *cinfo, fmt_info, ap);
 
-  // Free the allocated call_info structure.
-  free(cinfo);
-
   // Add the terminator byte (internal_printf() doesn't do this automatically).
   p.output.string.string[p.output.string.pos] = '\0';
 
@@ -487,12 +558,10 @@ int pool_vsnprintf_debug(DebugPoolTy *strPool,
                          bv_t complete,
                          TAG,
                          SRC_INFO) {
-  // Create the call_info structure associated with this call.
-  call_info *cinfo;
-  bool vaListFound = build_call_info(cinfo, ap, tag, SRC_INFO_ARGS);
-  // On error creating the structure, just print with no runtime checks.
-  if (cinfo == 0)
-    return vsnprintf(str, n, fmt, ap);
+  // Initialize the call_info structure associated with this call.
+  call_info_buffer cbuffer;
+  bool vaListFound = build_call_info(cbuffer, ap, tag, SRC_INFO_ARGS);
+  call_info *cinfo = cbuffer.info;
 
   // Tell the gprintf() function that a) pointers are unwrapped and b) we
   // don't track the size of the vararg list.
@@ -532,9 +601,6 @@ int pool_vsnprintf_debug(DebugPoolTy *strPool,
   // Call the printing function.
   int result = gprintf(options, p, *cinfo, fmt_info, ap);
 
-  // Free the allocated call_info structure.
-  free(cinfo);
-
   // Add the terminator byte (internal_printf() doesn't do this automatically).
   // Only add it if n > 0. When n = 0, nothing is written.
   if (n > 0)
@@ -564,11 +630,10 @@ int pool_vscanf_debug(DebugPoolTy *fmtPool,
                       bv_t complete,
                       TAG,
                       SRC_INFO) {
-  // Initialize the call_info structure.
-  call_info *cinfo;
-  bool vaListFound = build_call_info(cinfo, ap, tag, SRC_INFO_ARGS);
-  if (cinfo == 0) // Error creating the structure.
-    return vscanf(fmt, ap);
+  // Initialize the call_info structure associated with this call.
+  call_info_buffer cbuffer;
+  bool vaListFound = build_call_info(cbuffer, ap, tag, SRC_INFO_ARGS);
+  call_info *cinfo = cbuffer.info;
 
   // Create the options. Tell gscanf a) pointers will be unwrapped and
   // b) not to check for reading off the end of the va_list.
@@ -592,9 +657,6 @@ int pool_vscanf_debug(DebugPoolTy *fmtPool,
   int result = gscanf(options, input, *cinfo, fmt_info, ap);
   funlockfile(stdin);
 
-  // Free the allocated call_info structure.
-  free(cinfo);
-
   return result;
 }
 
@@ -627,11 +689,10 @@ int pool_vsscanf_debug(DebugPoolTy *strPool,
   const bool strComplete = ARG1_COMPLETE(complete);
   validStringCheck(str, strPool, strComplete, "vsscanf", SRC_INFO_ARGS);
 
-  // Initialize the call_info structure.
-  call_info *cinfo;
-  bool vaListFound = build_call_info(cinfo, ap, tag, SRC_INFO_ARGS);
-  if (cinfo == 0) // Error creating the structure.
-    return vsscanf(str, fmt, ap);
+  // Initialize the call_info structure associated with this call.
+  call_info_buffer cbuffer;
+  bool vaListFound = build_call_info(cbuffer, ap, tag, SRC_INFO_ARGS);
+  call_info *cinfo = cbuffer.info;
 
   // Create the options. Tell gscanf() a) pointers will be unwrapped and
   // b) not to check for reading off the end of the va_list.
@@ -653,9 +714,6 @@ int pool_vsscanf_debug(DebugPoolTy *strPool,
 
   int result = gscanf(options, input, *cinfo, fmt_info, ap);
 
-  // Free the allocated call_info structure.
-  free(cinfo);
-
   return result;
 }
 
@@ -684,11 +742,10 @@ int pool_vfscanf_debug(DebugPoolTy *filPool,
                        bv_t complete,
                        TAG,
                        SRC_INFO) {
-  // Initialize the call_info structure.
-  call_info *cinfo;
-  bool vaListFound = build_call_info(cinfo, ap, tag, SRC_INFO_ARGS);
-  if (cinfo == 0) // Error creating the structure.
-    return vfscanf((FILE *) fil, fmt, ap);
+  // Initialize the call_info structure associated with this call.
+  call_info_buffer cbuffer;
+  bool vaListFound = build_call_info(cbuffer, ap, tag, SRC_INFO_ARGS);
+  call_info *cinfo = cbuffer.info;
 
   // Create the options. Tell gscanf a) pointers will be unwrapped and
   // b) not to check for reading off the end of the va_list.
@@ -712,9 +769,6 @@ int pool_vfscanf_debug(DebugPoolTy *filPool,
   int result = gscanf(options, input, *cinfo, fmt_info, ap);
   funlockfile((FILE *) fil);
 
-  // Free the allocated call_info structure.
-  free(cinfo);
-
   return result;
 }
 
@@ -754,14 +808,10 @@ void pool_vsyslog_debug(DebugPoolTy *fmtPool,
                         bv_t complete,
                         TAG,
                         SRC_INFO) {
-  // Create the call_info structure associated with this call.
-  call_info *cinfo;
-  bool vaListFound = build_call_info(cinfo, ap, tag, SRC_INFO_ARGS);
-  // On error creating the structure, just print without runtime checks.
-  if (cinfo == 0) {
-    vsyslog(priority, fmt, ap);
-    return;
-  }
+  // Initialize the call_info structure associated with this call.
+  call_info_buffer cbuffer;
+  bool vaListFound = build_call_info(cbuffer, ap, tag, SRC_INFO_ARGS);
+  call_info *cinfo = cbuffer.info;
 
   // Tell the gprintf() function that a) pointers are unwrapped, b) we don't
   // track the size of the vararg list, and c) use the %m directive.
@@ -780,7 +830,6 @@ void pool_vsyslog_debug(DebugPoolTy *fmtPool,
   p.output.alloced_string.string = (char *) malloc(INITIAL_ALLOC_SIZE);
   // On malloc() error, attempt to print without runtime checks.
   if (p.output.alloced_string.string == 0) {
-    free(cinfo);
     vsyslog(priority, fmt, ap);
     return;
   }
@@ -792,9 +841,6 @@ void pool_vsyslog_debug(DebugPoolTy *fmtPool,
   // Call the printing function.
   int sz = gprintf(options, p, *cinfo, fmt_info, ap);
 
-  // Free the allocated call_info structure.
-  free(cinfo);
-
   // Print the resulting string using syslog(), if there was no error in making
   // it.
   if (sz < 0)
@@ -46,6 +46,14 @@ poolcheckstr_debug (DebugPoolTy * Pool, char * str, TAG, SRC_INFO) {
   validStringCheck (str, Pool, true, "Generic", SRC_INFO_ARGS);
 }
 
+void
+poolcheckstr_site (DebugPoolTy * Pool, char * str,
+                   const DebugSiteInfo * Site) {
+  if (str == NULL) return;
+  validStringCheck (str, Pool, true, "Generic",
+                    Site->SourceFile, Site->lineno);
+}
+
 void
 poolcheckstrui (DebugPoolTy * Pool, char * str) {
   if (str == NULL) return;
@@ -58,6 +66,14 @@ poolcheckstrui_debug (DebugPoolTy * Pool, char * str, TAG, SRC_INFO) {
   validStringCheck (str, Pool, false, "Generic", SRC_INFO_ARGS);
 }
 
+void
+poolcheckstrui_site (DebugPoolTy * Pool, char * str,
+                     const DebugSiteInfo * Site) {
+  if (str == NULL) return;
+  validStringCheck (str, Pool, false, "Generic",
+                    Site->SourceFile, Site->lineno);
+}
+
 //
 // pool_memccpy()
 //
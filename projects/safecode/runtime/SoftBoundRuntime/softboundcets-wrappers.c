@@ -42,7 +42,6 @@
 #include <arpa/inet.h>
 
 #if defined(__linux__)
-#include<bits/errno.h>
 #include<sys/wait.h>
 #include <wait.h>
 #include <obstack.h>
@@ -54,6 +54,31 @@
 
 __softboundcets_trie_entry_t** __softboundcets_trie_primary_table;
 
+/* The primary table under the name that spells out the layout of this
+ * run-time's entries; metadata accesses expanded inline by the compiler use
+ * it.  See SoftBound/SoftBoundCETSTrie.h.
+ */
+#define __SOFTBOUNDCETS_STRINGIFY2(x) #x
+#define __SOFTBOUNDCETS_STRINGIFY(x) __SOFTBOUNDCETS_STRINGIFY2(x)
+
+#ifdef __SOFTBOUNDCETS_PACKED_METADATA
+#define __SOFTBOUNDCETS_LAYOUT_PACKED __SOFTBOUNDCETS_TRIE_LAYOUT_PACKED
+#else
+#define __SOFTBOUNDCETS_LAYOUT_PACKED ""
+#endif
+
+#ifdef __SOFTBOUNDCETS_STATISTICS_MODE
+#define __SOFTBOUNDCETS_LAYOUT_STATS __SOFTBOUNDCETS_TRIE_LAYOUT_STATS
+#else
+#define __SOFTBOUNDCETS_LAYOUT_STATS ""
+#endif
+
+extern __softboundcets_trie_entry_t** __softboundcets_trie_primary_table_layout
+  __asm__(__SOFTBOUNDCETS_TRIE_LAYOUT_PREFIX
+          __SOFTBOUNDCETS_STRINGIFY(__SOFTBOUNDCETS_TRIE_SECONDARY_BITS)
+          __SOFTBOUNDCETS_LAYOUT_PACKED __SOFTBOUNDCETS_LAYOUT_STATS)
+  __attribute__((alias("__softboundcets_trie_primary_table")));
+
 size_t* __softboundcets_free_map_table = NULL;
 
 size_t* __softboundcets_shadow_stack_ptr = NULL;
@@ -85,6 +110,76 @@ size_t* __softboundcets_stack_temporal_space_begin = NULL;
 
 void* malloc_address = NULL;
 
+size_t __softboundcets_trie_secondary_tables = 0;
+size_t __softboundcets_trie_huge_secondary_tables = 0;
+
+/* Count the resident pages of a mapping */
+static size_t softboundcets_resident_bytes(void* addr, size_t length) {
+
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t pages = (length + page_size - 1) / page_size;
+  size_t resident = 0;
+  size_t index;
+
+  unsigned char* vec = malloc(pages);
+  if(vec == NULL || mincore(addr, length, vec) != 0) {
+    free(vec);
+    return 0;
+  }
+  for(index = 0; index < pages; index++) {
+    if(vec[index] & 1)
+      resident += page_size;
+  }
+  free(vec);
+  return resident;
+}
+
+/* Compute the memory mapped for the trie and the locks and how much of it
+ * is resident.  Only the pages of the primary table that are resident can
+ * point to secondary tables.
+ */
+void __softboundcets_metadata_footprint(size_t* mapped, size_t* resident) {
+
+  size_t primary_length = 
+    __SOFTBOUNDCETS_TRIE_PRIMARY_TABLE_ENTRIES * sizeof(__softboundcets_trie_entry_t*);
+  size_t lock_length = __SOFTBOUNDCETS_N_TEMPORAL_ENTRIES * sizeof(size_t);
+
+  *mapped = lock_length;
+  *resident = softboundcets_resident_bytes(__softboundcets_temporal_space_begin, 
+                                           lock_length);
+  if(!__SOFTBOUNDCETS_TRIE || __softboundcets_trie_primary_table == NULL)
+    return;
+
+  *mapped += primary_length + 
+    __softboundcets_trie_secondary_tables * __SOFTBOUNDCETS_TRIE_SECONDARY_TABLE_LENGTH;
+  *resident += softboundcets_resident_bytes(__softboundcets_trie_primary_table, 
+                                            primary_length);
+
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t entries_per_page = page_size / sizeof(__softboundcets_trie_entry_t*);
+  size_t pages = primary_length / page_size;
+  size_t page;
+  size_t index;
+
+  unsigned char* vec = malloc(pages);
+  if(vec == NULL || mincore(__softboundcets_trie_primary_table, primary_length, vec) != 0) {
+    free(vec);
+    return;
+  }
+
+  for(page = 0; page < pages; page++) {
+    if(!(vec[page] & 1))
+      continue;
+    for(index = page * entries_per_page; index < (page + 1) * entries_per_page; index++) {
+      __softboundcets_trie_entry_t* secondary = __softboundcets_trie_primary_table[index];
+      if(secondary != NULL)
+        *resident += softboundcets_resident_bytes(secondary, 
+                                                  __SOFTBOUNDCETS_TRIE_SECONDARY_TABLE_LENGTH);
+    }
+  }
+  free(vec);
+}
+
 #ifdef __SOFTBOUNDCETS_STATISTICS_MODE
 
 static __attribute__ ((__destructor__))
@@ -127,6 +222,17 @@ void __softboundcets_statistics_fini() {
           __softboundcets_statistics_stack_deallocations);
   fprintf(statistics_file, "Num_metadata_memcopies:%zd\n",
           __softboundcets_statistics_metadata_memcopies);
+
+  size_t metadata_mapped, metadata_resident;
+  __softboundcets_metadata_footprint(&metadata_mapped, &metadata_resident);
+  fprintf(statistics_file, "Num_trie_secondary_tables:%zd\n",
+          __softboundcets_trie_secondary_tables);
+  fprintf(statistics_file, "Num_trie_huge_secondary_tables:%zd\n",
+          __softboundcets_trie_huge_secondary_tables);
+  fprintf(statistics_file, "metadata_mapped: %lf \n", 
+          metadata_mapped / (1024.0*1024.0));
+  fprintf(statistics_file, "metadata_resident: %lf \n", 
+          metadata_resident / (1024.0*1024.0));
   fprintf(statistics_file, 
           "============================================\n");
   fclose(statistics_file);
@@ -210,6 +316,12 @@ void __softboundcets_init( int is_trie)
                                      SOFTBOUNDCETS_MMAP_FLAGS, -1, 0);
   assert(__softboundcets_global_lock != (void*) -1);
   //  __softboundcets_global_lock =  __softboundcets_lock_new_location++;
+
+#ifdef __SOFTBOUNDCETS_PACKED_METADATA
+  /* The key of the globals, 1, encodes the second lock; key 0 has none */
+  __softboundcets_global_lock = __softboundcets_temporal_space_begin + 1;
+  __softboundcets_lock_new_location = __softboundcets_temporal_space_begin + 2;
+#endif
   *((size_t*)__softboundcets_global_lock) = 1;
 
 
@@ -98,10 +98,19 @@ typedef struct {
 
 #elif __SOFTBOUNDCETS_SPATIAL_TEMPORAL
 
+#ifdef __SOFTBOUNDCETS_PACKED_METADATA
+  /* Packed entry: the low 48 bits hold the base and the bound, the high 16
+   * bits of each the low and high halves of a 32-bit key. The lock is
+   * computed from the key; see __softboundcets_lock_of_key().
+   */
+  size_t base_key;
+  size_t bound_key;
+#else
   void* base;
   void* bound;
   size_t key;
   void* lock;
+#endif
 #define __SOFTBOUNDCETS_METADATA_NUM_FIELDS 4
 
 #define __BASE_INDEX 0
@@ -134,6 +143,32 @@ typedef struct {
 #define SOFTBOUNDCETS_MMAP_FLAGS (MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE)
 #endif
 
+/* Geometry of the trie: each secondary table holds the metadata of
+ * 2^__SOFTBOUNDCETS_TRIE_SECONDARY_BITS pointer-sized words and is mapped
+ * the first time metadata is stored in its range.  Smaller secondaries map
+ * less memory for sparse address spaces; the primary table, which covers the
+ * whole address space, grows accordingly but is only touched where
+ * secondaries exist.
+ *
+ * The secondaries can be backed by huge pages to cut the TLB misses of
+ * metadata accesses: __SOFTBOUNDCETS_TRIE_HUGETLB maps them with MAP_HUGETLB,
+ * falling back to normal pages when no huge page is free, and
+ * __SOFTBOUNDCETS_TRIE_THP asks for transparent huge pages with madvise().
+ * Huge pages are 2MB on x86-64; the default geometry makes each secondary a
+ * multiple of that.
+ */
+#include "SoftBound/SoftBoundCETSTrie.h"
+
+#if __SOFTBOUNDCETS_TRIE_SECONDARY_BITS < __SOFTBOUNDCETS_TRIE_MIN_SECONDARY_BITS || __SOFTBOUNDCETS_TRIE_SECONDARY_BITS > __SOFTBOUNDCETS_TRIE_MAX_SECONDARY_BITS
+#error "__SOFTBOUNDCETS_TRIE_SECONDARY_BITS must be between 12 and 26"
+#endif
+
+#ifdef __SOFTBOUNDCETS_PACKED_METADATA
+#if __WORDSIZE == 32 || !defined(__SOFTBOUNDCETS_SPATIAL_TEMPORAL)
+#error "__SOFTBOUNDCETS_PACKED_METADATA needs 64-bit spatial and temporal metadata"
+#endif
+#endif
+
 
 // Check to make sure at least one and only one metadata representation is defined
 #ifndef __SOFTBOUNDCETS_TRIE
@@ -212,13 +247,10 @@ static const size_t __SOFTBOUNDCETS_N_TEMPORAL_ENTRIES = ((size_t) 4 * (size_t)
 static const size_t __SOFTBOUNDCETS_LOWER_ZERO_POINTER_BITS = 2;
 static const size_t __SOFTBOUNDCETS_N_STACK_TEMPORAL_ENTRIES = ((size_t) 1024 * (size_t) 64);
 static const size_t __SOFTBOUNDCETS_N_GLOBAL_LOCK_SIZE = ((size_t) 1024 * (size_t) 32);
-// 2^23 entries each will be 8 bytes each 
-static const size_t __SOFTBOUNDCETS_TRIE_PRIMARY_TABLE_ENTRIES = ((size_t) 8*(size_t) 1024 * (size_t) 1024);
 static const size_t __SOFTBOUNDCETS_SHADOW_STACK_ENTRIES = ((size_t) 128 * (size_t) 32 );
 /* 256 Million simultaneous objects */
 static const size_t __SOFTBOUNDCETS_N_FREE_MAP_ENTRIES = ((size_t) 32 * (size_t) 1024* (size_t) 1024);
-// each secondary entry has 2^ 22 entries 
-static const size_t __SOFTBOUNDCETS_TRIE_SECONDARY_TABLE_ENTRIES = ((size_t) 4 * (size_t) 1024 * (size_t) 1024); 
+static const size_t __SOFTBOUNDCETS_ADDRESS_BITS = 32;
 
 #else
 
@@ -228,20 +260,37 @@ static const size_t __SOFTBOUNDCETS_LOWER_ZERO_POINTER_BITS = 3;
 static const size_t __SOFTBOUNDCETS_N_STACK_TEMPORAL_ENTRIES = ((size_t) 1024 * (size_t) 64);
 static const size_t __SOFTBOUNDCETS_N_GLOBAL_LOCK_SIZE = ((size_t) 1024 * (size_t) 32);
 
-// 2^23 entries each will be 8 bytes each 
-static const size_t __SOFTBOUNDCETS_TRIE_PRIMARY_TABLE_ENTRIES = ((size_t) 8*(size_t) 1024 * (size_t) 1024);
-
 static const size_t __SOFTBOUNDCETS_SHADOW_STACK_ENTRIES = ((size_t) 128 * (size_t) 32 );
 
 /* 256 Million simultaneous objects */
 static const size_t __SOFTBOUNDCETS_N_FREE_MAP_ENTRIES = ((size_t) 32 * (size_t) 1024* (size_t) 1024);
-// each secondary entry has 2^ 22 entries 
-static const size_t __SOFTBOUNDCETS_TRIE_SECONDARY_TABLE_ENTRIES = ((size_t) 4 * (size_t) 1024 * (size_t) 1024); 
+static const size_t __SOFTBOUNDCETS_ADDRESS_BITS = 48;
+
+#endif
+
+/* Each trie entry describes an 8-byte word */
+static const size_t __SOFTBOUNDCETS_TRIE_PRIMARY_SHIFT = 3 + __SOFTBOUNDCETS_TRIE_SECONDARY_BITS;
+static const size_t __SOFTBOUNDCETS_TRIE_SECONDARY_TABLE_ENTRIES = (size_t) 1 << __SOFTBOUNDCETS_TRIE_SECONDARY_BITS;
+static const size_t __SOFTBOUNDCETS_TRIE_PRIMARY_TABLE_ENTRIES = (size_t) 1 << (__SOFTBOUNDCETS_ADDRESS_BITS - 3 - __SOFTBOUNDCETS_TRIE_SECONDARY_BITS);
+static const size_t __SOFTBOUNDCETS_TRIE_SECONDARY_TABLE_LENGTH = ((size_t) 1 << __SOFTBOUNDCETS_TRIE_SECONDARY_BITS) * sizeof(__softboundcets_trie_entry_t);
 
+#ifdef __SOFTBOUNDCETS_PACKED_METADATA
+/* Keys are 32 bits: the index of the lock in the temporal space and, above
+ * it, the number of times the lock was reused.  The 48 bits left for the base
+ * and the bound cover the user address space of x86-64.
+ */
+static const size_t __SOFTBOUNDCETS_PACKED_ADDRESS_MASK = ((size_t) 1 << __SOFTBOUNDCETS_TRIE_PACKED_ADDRESS_BITS) - 1;
+static const size_t __SOFTBOUNDCETS_PACKED_LOCK_BITS = __SOFTBOUNDCETS_TRIE_PACKED_LOCK_BITS;
+static const size_t __SOFTBOUNDCETS_PACKED_GENERATIONS = (size_t) 1 << (32 - __SOFTBOUNDCETS_TRIE_PACKED_LOCK_BITS);
 #endif
 
 
+/* GCC does not inline weak functions, and rejects always_inline on them */
+#if defined(__clang__)
 #define __WEAK_INLINE __attribute__((__weak__,__always_inline__)) 
+#else
+#define __WEAK_INLINE __attribute__((__weak__))
+#endif
 
 #if __WORDSIZE == 32
 #define __METADATA_INLINE __attribute__((__weak__))
@@ -265,6 +314,11 @@ extern __SOFTBOUNDCETS_NORETURN void __softboundcets_abort();
 extern void __softboundcets_printf(const char* str, ...);
 extern size_t* __softboundcets_global_lock; 
 
+/* Footprint of the metadata */
+extern size_t __softboundcets_trie_secondary_tables;
+extern size_t __softboundcets_trie_huge_secondary_tables;
+extern void __softboundcets_metadata_footprint(size_t* mapped, size_t* resident);
+
 void* __softboundcets_safe_calloc(size_t, size_t);
 void* __softboundcets_safe_malloc(size_t);
 void __softboundcets_safe_free(void*);
@@ -440,16 +494,68 @@ __WEAK_INLINE void __softboundcets_deallocate_shadow_stack_space(){
   }
 }
 
+__WEAK_INLINE size_t __softboundcets_trie_primary_index(size_t ptr){
+  return ptr >> __SOFTBOUNDCETS_TRIE_PRIMARY_SHIFT;
+}
+
+__WEAK_INLINE size_t __softboundcets_trie_secondary_index(size_t ptr){
+  return (ptr >> 3) & (__SOFTBOUNDCETS_TRIE_SECONDARY_TABLE_ENTRIES - 1);
+}
+
 __WEAK_INLINE __softboundcets_trie_entry_t* __softboundcets_trie_allocate(){
   
   __softboundcets_trie_entry_t* secondary_entry;
-  size_t length = (__SOFTBOUNDCETS_TRIE_SECONDARY_TABLE_ENTRIES) * sizeof(__softboundcets_trie_entry_t);
+  size_t length = __SOFTBOUNDCETS_TRIE_SECONDARY_TABLE_LENGTH;
+
+  __softboundcets_trie_secondary_tables++;
+
+#if defined(__SOFTBOUNDCETS_TRIE_HUGETLB) && defined(MAP_HUGETLB)
+  /* Without MAP_NORESERVE the huge pages are reserved by mmap, which fails
+   * instead of the first access faulting when none is free.
+   */
+  secondary_entry = __softboundcets_safe_mmap(0, length, PROT_READ| PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+  if(secondary_entry != MAP_FAILED){
+    __softboundcets_trie_huge_secondary_tables++;
+    return secondary_entry;
+  }
+#endif
+
   secondary_entry = __softboundcets_safe_mmap(0, length, PROT_READ| PROT_WRITE, SOFTBOUNDCETS_MMAP_FLAGS, -1, 0);
-  //assert(secondary_entry != (void*)-1); 
+  if(secondary_entry == MAP_FAILED){
+    __softboundcets_printf("[trie_allocate] out of metadata space\n");
+    __softboundcets_abort();
+  }
+
+#if defined(__SOFTBOUNDCETS_TRIE_THP) && defined(MADV_HUGEPAGE)
+  madvise(secondary_entry, length, MADV_HUGEPAGE);
+#endif
   //printf("snd trie table %p %lx\n", secondary_entry, length);
   return secondary_entry;
 }
 
+#ifdef __SOFTBOUNDCETS_PACKED_METADATA
+
+/* Packed metadata: every lock lives in the temporal space, and the key of an
+ * object encodes the index of its lock.  Key 0 has no lock.
+ */
+__WEAK_INLINE size_t* __softboundcets_lock_of_key(size_t key){
+  if(key == 0)
+    return NULL;
+  return __softboundcets_temporal_space_begin + 
+    (key & (((size_t) 1 << __SOFTBOUNDCETS_PACKED_LOCK_BITS) - 1));
+}
+
+/* Pack an address with 16 bits of a key. Bounds beyond the 48-bit address
+ * space saturate. 
+ */
+__WEAK_INLINE size_t __softboundcets_pack_address(size_t addr, size_t key){
+  if(addr > __SOFTBOUNDCETS_PACKED_ADDRESS_MASK)
+    addr = __SOFTBOUNDCETS_PACKED_ADDRESS_MASK;
+  return addr | ((key & 0xffff) << 48);
+}
+
+#endif
+
 __WEAK_INLINE void __softboundcets_introspect_metadata(void* ptr, void* base, void* bound, int arg_no){
   
   printf("[introspect_metadata]ptr=%p, base=%p, bound=%p, arg_no=%d\n", ptr, base, bound, arg_no);
@@ -482,11 +588,11 @@ __METADATA_INLINE void __softboundcets_copy_metadata(void* dest, void* from, siz
   __softboundcets_trie_entry_t* trie_secondary_table_dest_begin;
   __softboundcets_trie_entry_t* trie_secondary_table_from_begin;
   
-  size_t dest_primary_index_begin = (dest_ptr >> 25);
-  size_t dest_primary_index_end = (dest_ptr_end >> 25);
+  size_t dest_primary_index_begin = __softboundcets_trie_primary_index(dest_ptr);
+  size_t dest_primary_index_end = __softboundcets_trie_primary_index(dest_ptr_end);
 
-  size_t from_primary_index_begin = (from_ptr >> 25);
-  size_t from_primary_index_end =  (from_ptr_end >> 25);
+  size_t from_primary_index_begin = __softboundcets_trie_primary_index(from_ptr);
+  size_t from_primary_index_end =  __softboundcets_trie_primary_index(from_ptr_end);
 
 
   if((from_primary_index_begin != from_primary_index_end) || 
@@ -500,11 +606,11 @@ __METADATA_INLINE void __softboundcets_copy_metadata(void* dest, void* from, siz
 
     for(index=0; index < trie_size; index = index + 8){
       
-      size_t temp_from_pindex = (from_sizet + index) >> 25;
-      size_t temp_to_pindex = (dest_sizet + index) >> 25;
+      size_t temp_from_pindex = __softboundcets_trie_primary_index(from_sizet + index);
+      size_t temp_to_pindex = __softboundcets_trie_primary_index(dest_sizet + index);
 
-      size_t dest_secondary_index = (((dest_sizet + index) >> 3) & 0x3fffff);
-      size_t from_secondary_index = (((from_sizet + index) >> 3) & 0x3fffff);
+      size_t dest_secondary_index = __softboundcets_trie_secondary_index(dest_sizet + index);
+      size_t from_secondary_index = __softboundcets_trie_secondary_index(from_sizet + index);
       
       __softboundcets_trie_entry_t* temp_from_strie = __softboundcets_trie_primary_table[temp_from_pindex];
 
@@ -522,15 +628,7 @@ __METADATA_INLINE void __softboundcets_copy_metadata(void* dest, void* from, siz
       void* dest_entry_ptr = &temp_to_strie[dest_secondary_index];
       void* from_entry_ptr = &temp_from_strie[from_secondary_index];
   
-#ifdef __SOFTBOUNDCETS_SPATIAL
-      memcpy(dest_entry_ptr, from_entry_ptr, 16);
-#elif __SOFTBOUNDCETS_TEMPORAL
-      memcpy(dest_entry_ptr, from_entry_ptr, 16);
-#elif __SOFTBOUNDCETS_SPATIAL_TEMPORAL
-      memcpy(dest_entry_ptr, from_entry_ptr, 32);
-#else
-      memcpy(dest_entry_ptr, from_entry_ptr, 32);
-#endif
+      memcpy(dest_entry_ptr, from_entry_ptr, sizeof(__softboundcets_trie_entry_t));
     }    
     return;
 
@@ -548,8 +646,8 @@ __METADATA_INLINE void __softboundcets_copy_metadata(void* dest, void* from, siz
     //    printf("[copy_metadata] allocating secondary trie for dest_primary_index=%zx, orig_dest=%p, orig_from=%p\n", dest_primary_index_begin, dest, from);
   }
 
-  size_t dest_secondary_index = ((dest_ptr>> 3) & 0x3fffff);
-  size_t from_secondary_index = ((from_ptr>> 3) & 0x3fffff);
+  size_t dest_secondary_index = __softboundcets_trie_secondary_index(dest_ptr);
+  size_t from_secondary_index = __softboundcets_trie_secondary_index(from_ptr);
   
   assert(dest_secondary_index < __SOFTBOUNDCETS_TRIE_SECONDARY_TABLE_ENTRIES);
   assert(from_secondary_index < __SOFTBOUNDCETS_TRIE_SECONDARY_TABLE_ENTRIES);
@@ -557,21 +655,7 @@ __METADATA_INLINE void __softboundcets_copy_metadata(void* dest, void* from, siz
   void* dest_entry_ptr = &trie_secondary_table_dest_begin[dest_secondary_index];
   void* from_entry_ptr = &trie_secondary_table_from_begin[from_secondary_index];
   
-#ifdef __SOFTBOUNDCETS_SPATIAL
-  //  printf("[metadata_copy]dest_meta_ptr=%p, from_meta_ptr=%p, size=%zx, trie_entry_size=%d, dest_primary_index=%zx, dest_secondary_index=%zx, from_primary_index =%zx, from_secondary_index = %zx, orig_dest=%p, orig_from=%p \n", dest_entry_ptr, from_entry_ptr, 16*(size>>3), sizeof(__softboundcets_trie_entry_t), dest_primary_index_begin, dest_secondary_index, from_primary_index_begin, from_secondary_index, dest, from);
-
-  //  printf("[metadata_copy]dest_meta_ptr=%p, from_meta_ptr=%p, size=%zx, trie_entry_size=%d \n", dest_entry_ptr, from_entry_ptr, 16*(size>>3), sizeof(__softboundcets_trie_entry_t));
-  memcpy(dest_entry_ptr, from_entry_ptr, 16* (size>>3));
-#elif __SOFTBOUNDCETS_TEMPORAL
-  //  printf("doing 16 byte temporal metadata\n");
-  memcpy(dest_entry_ptr, from_entry_ptr, 16* (size>>3));
-#elif __SOFTBOUNDCETS_SPATIAL_TEMPORAL
-  //  printf("doing 32 byte metadata\n");
-  memcpy(dest_entry_ptr, from_entry_ptr, 32* (size >> 3));
-#else
-  //  printf("doing 32 byte metadata\n");
-  memcpy(dest_entry_ptr, from_entry_ptr, 32* (size>> 3));
-#endif
+  memcpy(dest_entry_ptr, from_entry_ptr, sizeof(__softboundcets_trie_entry_t) * (size >> 3));
   return;
 }
 
@@ -728,7 +812,7 @@ __METADATA_INLINE void __softboundcets_metadata_store(void* addr_of_ptr, void* b
   //  __softboundcets_trie_entry_t** trie_primary_table = __softboundcets_trie_primary_table;
   
   
-  primary_index = (ptr >> 25);
+  primary_index = __softboundcets_trie_primary_index(ptr);
   trie_secondary_table = __softboundcets_trie_primary_table[primary_index];
  
  
@@ -741,7 +825,7 @@ __METADATA_INLINE void __softboundcets_metadata_store(void* addr_of_ptr, void* b
     assert(trie_secondary_table != NULL);
   }
   
-  size_t secondary_index = ((ptr >> 3) & 0x3fffff);
+  size_t secondary_index = __softboundcets_trie_secondary_index(ptr);
   __softboundcets_trie_entry_t* entry_ptr =&trie_secondary_table[secondary_index];
 
   if(__SOFTBOUNDCETS_DEBUG){
@@ -763,10 +847,18 @@ __METADATA_INLINE void __softboundcets_metadata_store(void* addr_of_ptr, void* b
 
 #elif __SOFTBOUNDCETS_SPATIAL_TEMPORAL
   
+#ifdef __SOFTBOUNDCETS_PACKED_METADATA
+  if(__SOFTBOUNDCETS_DEBUG){
+    assert(lock == __softboundcets_lock_of_key(key));
+  }
+  entry_ptr->base_key = __softboundcets_pack_address((size_t) base, key);
+  entry_ptr->bound_key = __softboundcets_pack_address((size_t) bound, key >> 16);
+#else
   entry_ptr->base = base;
   entry_ptr->bound = bound;
   entry_ptr->key = key;
   entry_ptr->lock = lock;
+#endif
 
 #else
 
@@ -815,7 +907,7 @@ __METADATA_INLINE void __softboundcets_metadata_load(void* addr_of_ptr, void** b
     
     //assert(__softboundcetswithss_trie_primary_table[primary_index] == trie_secondary_table);
 
-    size_t primary_index = ( ptr >> 25);
+    size_t primary_index = __softboundcets_trie_primary_index(ptr);
     trie_secondary_table = __softboundcets_trie_primary_table[primary_index];
 
 
@@ -846,7 +938,7 @@ __METADATA_INLINE void __softboundcets_metadata_load(void* addr_of_ptr, void** b
     } /* PREALLOCATE_ENDS */
 
     /* MAIN SOFTBOUNDCETS LOAD WHICH RUNS ON THE NORMAL MACHINE */
-    size_t secondary_index = ((ptr >> 3) & 0x3fffff);
+    size_t secondary_index = __softboundcets_trie_secondary_index(ptr);
     __softboundcets_trie_entry_t* entry_ptr = &trie_secondary_table[secondary_index];
     
 #ifdef __SOFTBOUNDCETS_SPATIAL
@@ -860,10 +952,26 @@ __METADATA_INLINE void __softboundcets_metadata_load(void* addr_of_ptr, void** b
 
 #elif __SOFTBOUNDCETS_SPATIAL_TEMPORAL
 
+#ifdef __SOFTBOUNDCETS_PACKED_METADATA
+      size_t base_key = entry_ptr->base_key;
+      size_t bound_key = entry_ptr->bound_key;
+      size_t packed_key = (base_key >> 48) | ((bound_key >> 48) << 16);
+      size_t packed_bound = bound_key & __SOFTBOUNDCETS_PACKED_ADDRESS_MASK;
+
+      /* A saturated bound stands for the whole address space */
+      if(packed_bound == __SOFTBOUNDCETS_PACKED_ADDRESS_MASK)
+        packed_bound++;
+
+      *((void**) base) = (void*) (base_key & __SOFTBOUNDCETS_PACKED_ADDRESS_MASK);
+      *((void**) bound) = (void*) packed_bound;
+      *((size_t*) key) = packed_key;
+      *((void**) lock) = (void*) __softboundcets_lock_of_key(packed_key);
+#else
       *((void**) base) = entry_ptr->base;
       *((void**) bound) = entry_ptr->bound;
       *((size_t*) key) = entry_ptr->key;
       *((void**) lock) = (void*) entry_ptr->lock;
+#endif
       
 #else
 
@@ -886,6 +994,62 @@ extern size_t __softboundcets_key_id_counter;
 extern size_t* __softboundcets_lock_next_location;
 extern size_t* __softboundcets_lock_new_location;
 
+#ifdef __SOFTBOUNDCETS_PACKED_METADATA
+
+/* Allocate a lock and return its key. A free lock holds the number of times
+ * it was used above bit 32 and the index of the next free lock below; as the
+ * keys fit in 32 bits, no key matches a free lock.
+ */
+__WEAK_INLINE size_t __softboundcets_allocate_key() {
+
+  size_t* lock = __softboundcets_lock_next_location;
+  size_t key;
+
+  if(lock == NULL) {
+    lock = __softboundcets_lock_new_location++;
+    if(lock >= __softboundcets_temporal_space_begin + __SOFTBOUNDCETS_N_TEMPORAL_ENTRIES){
+      __softboundcets_printf("[lock_allocate] out of temporal free entries \n");
+      __softboundcets_abort();
+    }
+    key = lock - __softboundcets_temporal_space_begin;
+  }
+  else {
+    size_t next = *lock & 0xffffffff;
+    size_t generation = *lock >> 32;
+
+    __softboundcets_lock_next_location = 
+      next ? __softboundcets_temporal_space_begin + next : NULL;
+    key = (generation << __SOFTBOUNDCETS_PACKED_LOCK_BITS) | 
+      (lock - __softboundcets_temporal_space_begin);
+  }
+  *lock = key;
+  return key;
+}
+
+/* Free the lock of a key. A lock used by all the generations a key can
+ * encode is retired rather than reused. 
+ */
+__WEAK_INLINE void __softboundcets_free_key(size_t key) {
+
+  size_t* lock = __softboundcets_lock_of_key(key);
+  if(lock == NULL || *lock != key)
+    return;
+
+  size_t generation = (key >> __SOFTBOUNDCETS_PACKED_LOCK_BITS) + 1;
+  if(generation == __SOFTBOUNDCETS_PACKED_GENERATIONS) {
+    *lock = generation << 32;
+    return;
+  }
+
+  size_t next = 0;
+  if(__softboundcets_lock_next_location)
+    next = __softboundcets_lock_next_location - __softboundcets_temporal_space_begin;
+  *lock = (generation << 32) | next;
+  __softboundcets_lock_next_location = lock;
+}
+
+#endif
+
 #ifdef __SOFTBOUNDCETS_SPATIAL_TEMPORAL
 __WEAK_INLINE void 
 __softboundcets_temporal_load_dereference_check(void* pointer_lock, 
@@ -969,8 +1133,12 @@ __WEAK_INLINE void __softboundcets_stack_memory_deallocation(size_t ptr_key){
   
 #ifndef __SOFTBOUNDCETS_CONSTANT_STACK_KEY_LOCK
 
+#ifdef __SOFTBOUNDCETS_PACKED_METADATA
+  __softboundcets_free_key(ptr_key);
+#else
   __softboundcets_stack_temporal_space_begin--;
   *(__softboundcets_stack_temporal_space_begin) = 0;
+#endif
 
 #endif
 
@@ -990,9 +1158,13 @@ __softboundcets_memory_deallocation(void* ptr_lock, size_t ptr_key) {
                            ptr_lock, *((size_t*) ptr_lock));
   }
   
+#ifdef __SOFTBOUNDCETS_PACKED_METADATA
+  __softboundcets_free_key(ptr_key);
+#else
   *((size_t*)ptr_lock) = 0;
   *((void**) ptr_lock) = __softboundcets_lock_next_location;
   __softboundcets_lock_next_location = ptr_lock;
+#endif
 
 }
 
@@ -1037,10 +1209,10 @@ __softboundcets_allocation_secondary_trie_allocate_range(void* initial_ptr,
 
   void* addr_of_ptr = initial_ptr;
   size_t start_addr_of_ptr = (size_t) addr_of_ptr;
-  size_t start_primary_index = start_addr_of_ptr >> 25;
+  size_t start_primary_index = __softboundcets_trie_primary_index(start_addr_of_ptr);
   
   size_t end_addr_of_ptr = (size_t)((char*) initial_ptr + size);
-  size_t end_primary_index = end_addr_of_ptr >> 25;
+  size_t end_primary_index = __softboundcets_trie_primary_index(end_addr_of_ptr);
   
   for(; start_primary_index <= end_primary_index; start_primary_index++){
     
@@ -1063,8 +1235,7 @@ __softboundcets_allocation_secondary_trie_allocate(void* addr_of_ptr) {
 
 
   size_t ptr = (size_t) addr_of_ptr;
-  size_t primary_index = ( ptr >> 25);
-  //  size_t secondary_index = ((ptr >> 3) & 0x3fffff);
+  size_t primary_index = __softboundcets_trie_primary_index(ptr);
   
   __softboundcets_trie_entry_t* 
     trie_secondary_table = __softboundcets_trie_primary_table[primary_index];
@@ -1096,9 +1267,13 @@ __softboundcets_stack_memory_allocation(void** ptr_lock, size_t* ptr_key) {
   __softboundcets_statistics_stack_allocations++;
 #endif
 
-#ifdef __SOFTBOUNDCETS_CONSTANT_STACK_KEY_LOCK
+#if defined(__SOFTBOUNDCETS_CONSTANT_STACK_KEY_LOCK)
   *((size_t*) ptr_key) = 1;
   *((size_t**) ptr_lock) = __softboundcets_global_lock;
+#elif defined(__SOFTBOUNDCETS_PACKED_METADATA)
+  size_t temp_id = __softboundcets_allocate_key();
+  *((size_t**) ptr_lock) = __softboundcets_lock_of_key(temp_id);
+  *((size_t*)ptr_key) = temp_id;
 #else
   size_t temp_id = __softboundcets_key_id_counter++;
   *((size_t**) ptr_lock) = (size_t*)__softboundcets_stack_temporal_space_begin++;
@@ -1115,11 +1290,18 @@ __softboundcets_memory_allocation(void* ptr, void** ptr_lock, size_t* ptr_key){
   __softboundcets_statistics_heap_allocations++;
 #endif
 
+#ifdef __SOFTBOUNDCETS_PACKED_METADATA
+  size_t temp_id = __softboundcets_allocate_key();
+
+  *((size_t**) ptr_lock) = __softboundcets_lock_of_key(temp_id);
+  *((size_t*) ptr_key) = temp_id;
+#else
   size_t temp_id = __softboundcets_key_id_counter++;
 
   *((size_t**) ptr_lock) = (size_t*)__softboundcets_allocate_lock_location();  
   *((size_t*) ptr_key) = temp_id;
   **((size_t**) ptr_lock) = temp_id;
+#endif
 
   __softboundcets_add_to_free_map(temp_id, ptr);
   //  printf("memory allocation ptr=%zx, ptr_key=%zx\n", ptr, temp_id);
@@ -0,0 +1,140 @@
+//===- BBTaggedPtr.h - Out-of-bounds pointers with tagged high bits -*- C++ -*-//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the encoding of out-of-bounds (OOB) pointers used by the
+// baggy bounds run-times on x86-64.
+//
+// User-space addresses on x86-64 fit in the low 48 bits of a pointer.  An OOB
+// pointer keeps its real address in those bits and records the object from
+// which it came in the high bits:
+//
+//    bit  63     : set on every OOB pointer
+//    bits 57..62 : binary logarithm of the slot size of the object (e)
+//    bits 48..56 : signed distance, in slots, from the object to the address
+//
+// Because objects are aligned to their slot size, the start of the object is
+// the real address rounded down to a multiple of the slot size, minus the
+// distance.  Creating and recovering an OOB pointer is therefore pure
+// arithmetic, and any object in the size table can be the origin of one.
+// The tagged pointer is not a canonical address, so dereferencing it faults.
+//
+// Addresses more than BBMaxTagDistance slots away from their object cannot be
+// tagged; the run-time falls back to rewrite pointers for them.
+//
+// The compiler (InlineBBCRuntimeFunctions and InlineBBACRuntimeFunctions)
+// emits inline code that relies on bit 63 marking OOB pointers.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_BBTAGGEDPTR_H
+#define _SC_BBTAGGEDPTR_H
+
+#include <stdint.h>
+
+#if defined(__x86_64__)
+#define SC_BB_TAGGED_OOB 1
+#endif
+
+#ifdef SC_BB_TAGGED_OOB
+
+static const uintptr_t BBAddressMask    = ((uintptr_t) 1 << 48) - 1;
+static const uintptr_t BBOOBFlag        = (uintptr_t) 1 << 63;
+static const unsigned  BBSizeShift      = 57;
+static const unsigned  BBDistanceShift  = 48;
+static const unsigned  BBDistanceBits   = 9;
+static const intptr_t  BBMaxTagDistance = 255;
+static const intptr_t  BBMinTagDistance = -256;
+
+//
+// Function: isTaggedPtr()
+//
+// Description:
+//  Determine whether the pointer is a tagged OOB pointer.
+//
+static inline bool
+isTaggedPtr (uintptr_t p) {
+  return (p & BBOOBFlag) != 0;
+}
+
+//
+// Function: getTaggedAddress()
+//
+// Description:
+//  Return the address that a tagged OOB pointer really points to.
+//
+static inline uintptr_t
+getTaggedAddress (uintptr_t p) {
+  return p & BBAddressMask;
+}
+
+//
+// Function: getTaggedSize()
+//
+// Description:
+//  Return the binary logarithm of the slot size of the object from which a
+//  tagged OOB pointer came.
+//
+static inline unsigned
+getTaggedSize (uintptr_t p) {
+  return (p >> BBSizeShift) & 0x3f;
+}
+
+//
+// Function: getTaggedObject()
+//
+// Description:
+//  Return the start of the object from which a tagged OOB pointer came.
+//
+static inline uintptr_t
+getTaggedObject (uintptr_t p) {
+  unsigned e = getTaggedSize (p);
+  intptr_t distance = ((intptr_t) (p << (64 - BBDistanceShift - BBDistanceBits)))
+                      >> (64 - BBDistanceBits);
+  uintptr_t slot = getTaggedAddress (p) & ~(((uintptr_t) 1 << e) - 1);
+  return slot - ((uintptr_t) distance << e);
+}
+
+//
+// Function: tagPointer()
+//
+// Description:
+//  Create a tagged OOB pointer for an address outside of an object.
+//
+// Inputs:
+//  Dest     - The address outside of the object.
+//  ObjStart - The start of the object.
+//  e        - The binary logarithm of the slot size of the object.
+//
+// Outputs:
+//  Tagged   - The tagged OOB pointer.
+//
+// Return value:
+//  true  - The address was tagged.
+//  false - The address is too far from the object to be tagged.
+//
+static inline bool
+tagPointer (uintptr_t Dest, uintptr_t ObjStart, unsigned e, uintptr_t & Tagged) {
+  if (Dest & ~BBAddressMask)
+    return false;
+
+  intptr_t distance = (intptr_t) (Dest >> e) - (intptr_t) (ObjStart >> e);
+  if ((distance < BBMinTagDistance) || (distance > BBMaxTagDistance))
+    return false;
+
+  uintptr_t field = (uintptr_t) distance & (((uintptr_t) 1 << BBDistanceBits) - 1);
+  Tagged = BBOOBFlag |
+           ((uintptr_t) e << BBSizeShift) |
+           (field << BBDistanceShift) |
+           Dest;
+  return true;
+}
+
+#endif
+
+#endif
@@ -40,6 +40,8 @@ extern "C"
   void poolcheckstr_debug (PPOOL, char * str, TAG, SRC_INFO);
   void poolcheckstrui (PPOOL, char * str);
   void poolcheckstrui_debug (PPOOL, char * str, TAG, SRC_INFO);
+  void poolcheckstr_site (PPOOL, char * str, const llvm::DebugSiteInfo *);
+  void poolcheckstrui_site (PPOOL, char * str, const llvm::DebugSiteInfo *);
 
   // Functions from <stdio.h>, <stdarg.h>
 
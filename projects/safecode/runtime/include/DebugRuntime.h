@@ -78,6 +78,24 @@ typedef struct DebugMetaData {
 } DebugMetaData;
 typedef DebugMetaData * PDebugMetaData;
 
+//
+// Structure: DebugSiteInfo
+//
+// Description:
+//  One entry of the read-only source location table that the compiler emits
+//  for each module when checks are passed a site instead of debug arguments.
+//
+// Fields:
+//  tag        : The tag of the run-time check.
+//  lineno     : The line number of the check in the source file.
+//  SourceFile : A string containing the source file of the check.
+//
+typedef struct DebugSiteInfo {
+  unsigned tag;
+  unsigned lineno;
+  const char * SourceFile;
+} DebugSiteInfo;
+
 struct DebugPoolTy : public BitmapPoolTy {
   // Splay tree used for object registration
   RangeSplaySet<> Objects;
@@ -95,6 +113,15 @@ struct DebugPoolTy : public BitmapPoolTy {
   } objectCache[2];
 
   unsigned char cacheIndex;
+
+  // Flags whether the pool is a region (see __sc_dbg_poolinit_region())
+  unsigned char isRegion;
+
+  // The alignment of the objects of a region and the part of its current
+  // chunk that is not allocated yet
+  unsigned RegionAlign;
+  char * RegionNext;
+  char * RegionEnd;
 };
 
 void * rewrite_ptr (DebugPoolTy * Pool, const void * p, void * ObjStart,
@@ -103,11 +130,15 @@ void installAllocHooks (void);
 
 }
 
+// Target set of an indirect call check (defined in FuncTargetSet.h)
+struct FuncTargetSet;
+
 // Use macros so that I won't polluate the namespace
 
 #define PPOOL llvm::DebugPoolTy*
 #define TAG unsigned
 #define SRC_INFO const char *, unsigned int
+#define SITE_INFO const llvm::DebugSiteInfo *
 
 extern "C" {
   void pool_init_runtime(unsigned Dangling,
@@ -121,6 +152,10 @@ extern "C" {
   void * __sc_dbg_poolalloc(PPOOL, unsigned NumBytes);
   void * __sc_dbg_src_poolalloc (PPOOL, unsigned Size, TAG, SRC_INFO);
 
+  void * __sc_dbg_poolinit_region (PPOOL, unsigned NodeSize, unsigned Align);
+  void * __sc_dbg_poolalloc_region (PPOOL, unsigned NumBytes);
+  void __sc_dbg_pooldestroy_region (PPOOL);
+
   void * poolargvregister (int argc, char ** argv, unsigned type);
 
   void pool_register       (PPOOL, void *allocaptr, unsigned NumBytes, unsigned AllocType);
@@ -155,14 +190,19 @@ extern "C" {
   void poolcheckui(PPOOL, void *Node, unsigned length);
   void poolcheck_debug (PPOOL, void * Node, unsigned length, TAG, SRC_INFO);
   void poolcheckui_debug (PPOOL, void * Node, unsigned length, TAG, SRC_INFO);
+  void poolcheck_site (PPOOL, void * Node, unsigned length, SITE_INFO);
+  void poolcheckui_site (PPOOL, void * Node, unsigned length, SITE_INFO);
 
   void poolcheckalign(PPOOL, void *Node, unsigned Offset);
   void poolcheckalign_debug (PPOOL, void *Node, unsigned Offset, TAG, SRC_INFO);
+  void poolcheckalign_site (PPOOL, void *Node, unsigned Offset, SITE_INFO);
 
   void * boundscheck   (PPOOL, void * Source, void * Dest);
   void * boundscheckui (PPOOL, void * Source, void * Dest);
   void * boundscheckui_debug (PPOOL, void * S, void * D, TAG, SRC_INFO);
   void * boundscheck_debug (PPOOL, void * S, void * D, TAG, SRC_INFO);
+  void * boundscheckui_site (PPOOL, void * S, void * D, SITE_INFO);
+  void * boundscheck_site (PPOOL, void * S, void * D, SITE_INFO);
 
   // Exact checks
   void * exactcheck2 (char *source, char *base, char *result, unsigned size);
@@ -175,6 +215,10 @@ extern "C" {
                           unsigned tag,
                           const char * SourceFile,
                           unsigned lineno);
+  void * exactcheck2_site (char *source, char *base, char *result,
+                           unsigned size, SITE_INFO);
+  void fastlscheck_site (const char *base, const char *result, unsigned size,
+                         unsigned lsLen, SITE_INFO);
 
   void * pchk_getActualValue (PPOOL, void * src);
 
@@ -183,6 +227,11 @@ extern "C" {
   void funccheckui (void *f, void * targets[]);
   void funccheck_debug   (void *f, void * targets[], TAG, SRC_INFO);
   void funccheckui_debug (void *f, void * targets[], TAG, SRC_INFO);
+  void funccheck_site   (void *f, void * targets[], SITE_INFO);
+  void funccheckui_site (void *f, void * targets[], SITE_INFO);
+  void funccheck_hashed_init (FuncTargetSet * set);
+  void funccheck_hashed (void *f, FuncTargetSet * set);
+  void funccheck_hashed_debug (void *f, FuncTargetSet * set, TAG, SRC_INFO);
 
   // Change memory protections to detect dangling pointers
   void * pool_shadow (void * Node, unsigned NumBytes);
@@ -193,6 +242,8 @@ extern "C" {
   void poolcheck_freeui (PPOOL, void * ptr);
   void poolcheck_free_debug   (PPOOL, void * ptr, TAG, SRC_INFO);
   void poolcheck_freeui_debug (PPOOL, void * ptr, TAG, SRC_INFO);
+  void poolcheck_free_site   (PPOOL, void * ptr, SITE_INFO);
+  void poolcheck_freeui_site (PPOOL, void * ptr, SITE_INFO);
 
 
   // ---------------------- My functions --------------
@@ -206,4 +257,5 @@ extern "C" {
 #undef PPOOL
 #undef TAG
 #undef SRC_INFO
+#undef SITE_INFO
 #endif
@@ -0,0 +1,52 @@
+//===- ExactCheck.h - Fast paths of the exact checks ------------*- C++ -*-===//
+//
+//                       The SAFECode Compiler Project
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the bounds comparisons shared by the exactcheck and
+// fastlscheck functions of the run-times.  They compute the offset of the
+// pointer into the object as an unsigned integer; pointers below the object
+// wrap around to large offsets, so one comparison checks both bounds, and
+// the comparisons are combined without branches.  The InlineFastChecks pass
+// generates the same comparisons when it inlines the checks.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_EXACTCHECK_H_
+#define _SC_EXACTCHECK_H_
+
+#include <stdint.h>
+
+//
+// Function: isInBounds()
+//
+// Description:
+//  Determine whether a pointer points into the object of the given size that
+//  starts at base.
+//
+static inline bool
+isInBounds (const void * base, const void * result, uintptr_t size) {
+  return ((uintptr_t) result - (uintptr_t) base) < size;
+}
+
+//
+// Function: isAccessInBounds()
+//
+// Description:
+//  Determine whether an access of lslen bytes at result lies within the
+//  object of the given size that starts at base.  Accesses of zero bytes are
+//  always within bounds; they can happen with load/store checks on
+//  memcpy()/memset() calls.
+//
+static inline bool
+isAccessInBounds (const void * base, const void * result, uintptr_t size,
+                  uintptr_t lslen) {
+  uintptr_t offset = (uintptr_t) result - (uintptr_t) base;
+  return ((offset < size) & (lslen <= size - offset)) | (lslen == 0);
+}
+
+#endif
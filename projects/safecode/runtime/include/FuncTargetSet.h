@@ -0,0 +1,115 @@
+//===- FuncTargetSet.h - Hashed sets of indirect call targets ---*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the layout of the target sets that the compiler emits for
+// indirect function call checks with many targets, along with the code that
+// indexes and searches them.
+//
+// The compiler emits the list of targets and an empty, power-of-two sized
+// table of slots.  A constructor calls funccheck_hashed_init() on each set
+// before main() runs; this fills the slots with an open-addressing hash of
+// the targets so that a lookup takes constant time regardless of the number
+// of targets.  A set that has not been indexed yet (e.g., because an indirect
+// call happens in an earlier constructor) is searched linearly.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SAFECODE_FUNCTARGETSET_H_
+#define _SAFECODE_FUNCTARGETSET_H_
+
+#include <stdint.h>
+
+//
+// Structure: FuncTargetSet
+//
+// Description:
+//  The set of valid targets of an indirect function call.  The compiler
+//  (CompleteChecks) creates these; the layout must match the one it uses.
+//
+struct FuncTargetSet {
+  // Number of slots minus one; the number of slots is a power of two
+  uintptr_t mask;
+
+  // Hash table of the targets; empty slots are NULL
+  void ** slots;
+
+  // Number of targets
+  uintptr_t count;
+
+  // The targets
+  void ** targets;
+
+  // Nonzero once the slots have been filled
+  uintptr_t ready;
+};
+
+//
+// Function: hashTarget()
+//
+// Description:
+//  Hash a function address.  Function addresses are usually aligned, so the
+//  low bits are dropped before mixing; the high half of the product is folded
+//  into the low bits that select the slot.
+//
+static inline uintptr_t
+hashTarget (const void * f) {
+  uintptr_t h = ((uintptr_t) f) >> 4;
+  h *= (uintptr_t) 0x9E3779B97F4A7C15ULL;
+  return h ^ (h >> (sizeof (uintptr_t) * 4));
+}
+
+//
+// Function: initTargetSet()
+//
+// Description:
+//  Fill the slots of the set with its targets.
+//
+static inline void
+initTargetSet (FuncTargetSet * set) {
+  if (set->ready)
+    return;
+
+  for (uintptr_t index = 0; index < set->count; ++index) {
+    void * f = set->targets[index];
+    uintptr_t slot = hashTarget (f) & set->mask;
+    while (set->slots[slot] && set->slots[slot] != f)
+      slot = (slot + 1) & set->mask;
+    set->slots[slot] = f;
+  }
+
+  set->ready = 1;
+  return;
+}
+
+//
+// Function: isInTargetSet()
+//
+// Description:
+//  Determine whether the function pointer is one of the targets in the set.
+//
+static inline bool
+isInTargetSet (const void * f, const FuncTargetSet * set) {
+  if (set->ready) {
+    uintptr_t slot = hashTarget (f) & set->mask;
+    while (void * target = set->slots[slot]) {
+      if (target == f)
+        return true;
+      slot = (slot + 1) & set->mask;
+    }
+    return false;
+  }
+
+  for (uintptr_t index = 0; index < set->count; ++index) {
+    if (set->targets[index] == f)
+      return true;
+  }
+  return false;
+}
+
+#endif
@@ -17,6 +17,16 @@
 #define _REPORT_H_
 
 #include <iosfwd>
+#include <stdint.h>
+
+//
+// Hooks of the in-process fuzzer in lib/Fuzzer.  They are weak so that the
+// run-time does not need the fuzzer; they are null when it is not linked in.
+//
+extern "C" {
+  void LLVMFuzzerReportCrash (const char * Reason) __attribute__ ((weak));
+  void LLVMFuzzerAddFeature (uintptr_t Feature) __attribute__ ((weak));
+}
 
 namespace llvm {
 
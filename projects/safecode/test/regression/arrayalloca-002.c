@@ -1,4 +1,4 @@
-// RUN: test.sh -e -s "@malloc" -t %t %s
+// RUN: test.sh -e -s "@__sc_bb_stack_alloc" -t %t %s
 //
 // TEST: arrayalloca-002
 //
@@ -0,0 +1,53 @@
+// RUN: clang -target x86_64-unknown-linux-gnu -fmemsafety -bbc -S -emit-llvm %s -o - | FileCheck %s --check-prefix=IR
+// RUN: clang -target x86_64-unknown-linux-gnu -fmemsafety -bbac -S -emit-llvm %s -o - | FileCheck %s --check-prefix=IR
+// RUN: clang -fmemsafety -bbc -fmemsafety-terminate %s -o %t.bbc
+// RUN: %t.bbc 2>&1 | FileCheck %s
+// RUN: not --crash %t.bbc deref 2>&1 | FileCheck %s --check-prefix=DEREF
+// RUN: not --crash %t.bbc free 2>&1 | FileCheck %s --check-prefix=FREE
+// RUN: clang -fmemsafety -bbac -fmemsafety-terminate %s -o %t.bbac
+// RUN: %t.bbac 2>&1 | FileCheck %s
+// RUN: not --crash %t.bbac deref 2>&1 | FileCheck %s --check-prefix=DEREF
+// RUN: not --crash %t.bbac free 2>&1 | FileCheck %s --check-prefix=FREE
+//
+// TEST: bb-tagged-oob-001
+//
+// Description:
+//  Test out-of-bounds pointers of the baggy bounds run-times.  A pointer a
+//  few slots past its object is tagged (on x86-64) and one far from it is
+//  rewritten; both must come back to the real address when indexed back into
+//  the object.  Dereferencing or freeing the tagged pointer is an error.  On
+//  x86-64 the inline checks test the tag bit and check objects of any size.
+//
+
+// IR-NOT: cmp_gt_twelve
+// IR: %is_tagged{{[0-9]*}} = icmp slt i64 %{{[a-z_.0-9]+}}, 0
+// IR-NOT: cmp_gt_twelve
+
+// CHECK-NOT: SAFECODE RUNTIME ALERT
+// CHECK: ab
+// DEREF: Load/Store Error
+// FREE: Invalid Free Error
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int
+main (int argc, char ** argv) {
+  char * p = (char *) malloc (16);
+  char * near = p + 40;
+  char * far = p + 100000;
+  char * fromNear = near - 40;
+  char * fromFar = far - 99999;
+  fromNear[0] = 'a';
+  fromFar[0] = 'b';
+
+  if ((argc > 1) && !strcmp (argv[1], "deref"))
+    near[0] = 'c';
+  if ((argc > 1) && !strcmp (argv[1], "free"))
+    free (near);
+
+  printf ("%c%c\n", p[0], p[1]);
+  free (p);
+  return 0;
+}
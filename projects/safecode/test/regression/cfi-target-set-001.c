@@ -0,0 +1,55 @@
+// RUN: clang -O2 -g -fmemsafety -use-gold-plugin -flto %s -o %t
+// RUN: %t 2>&1 | FileCheck %s --check-prefix=RUN
+// RUN: llvm-nm %t | FileCheck %s
+//
+// TEST: cfi-target-set-001
+//
+// Description:
+//  Test that link-time optimization compares the targets of an indirect call
+//  with a few targets inline and gives a call with more targets a hashed
+//  target set, even when it has fewer than 16, and that the hashed check
+//  accepts every valid target.
+//
+
+// The call through Few compares inline; the call through Many gets the only
+// target set, which a constructor indexes before main() runs.
+// CHECK: {{ }}TargetSet{{$}}
+// CHECK-NOT: {{ }}TargetSet{{[0-9]+$}}
+// CHECK: {{ }}sc.init_target_sets{{$}}
+
+// RUN-NOT: SAFECODE RUNTIME ALERT
+// RUN: sum 21 6
+
+#include <stdio.h>
+
+static int few1 (int x) { return x + 1; }
+static int few2 (int x) { return x + 2; }
+static int few3 (int x) { return x + 3; }
+
+static int many1 (int x) { return x * 1; }
+static int many2 (int x) { return x * 2; }
+static int many3 (int x) { return x * 3; }
+static int many4 (int x) { return x * 4; }
+static int many5 (int x) { return x * 5; }
+static int many6 (int x) { return x * 6; }
+
+static int (* volatile Few[])(int) = { few1, few2, few3 };
+static int (* volatile Many[])(int) = {
+  many1, many2, many3, many4, many5, many6
+};
+
+//
+// The trip counts depend on argc (which is 1) so that the loops, and with
+// them the indirect calls, are not unrolled.
+//
+int
+main (int argc, char ** argv) {
+  int many = 0;
+  int few = 0;
+  for (int i = 0; i < argc + 5; ++i)
+    many += Many[i] (argc);
+  for (int i = 0; i < argc + 2; ++i)
+    few += Few[i] (argc) - argc;
+  printf ("sum %d %d\n", many, few);
+  return 0;
+}
@@ -0,0 +1,68 @@
+// RUN: clang -fmemsafety -fmemsafety-check-profile-generate %s -o %t
+// RUN: rm -f %t.prof
+// RUN: env SC_CHECK_PROFILE=%t.prof %t
+// RUN: FileCheck %s --check-prefix=PROFILE < %t.prof
+// RUN: env SC_CHECK_PROFILE=%t.prof %t
+// RUN: FileCheck %s --check-prefix=APPEND < %t.prof
+// RUN: clang -fmemsafety -fmemsafety-disable-inline -fmemsafety-check-profile-use %t.prof -S -emit-llvm %s -o - | FileCheck %s --check-prefix=USE
+//
+// TEST: check-profile-001
+//
+// Description:
+//  Test that -fmemsafety-check-profile-generate writes the execution count of
+//  each check site, that the profiles of several runs are appended, and that
+//  -fmemsafety-check-profile-use moves the hot loop-invariant check out of its
+//  loop while the cold one stays in its loop.
+//
+
+// PROFILE-DAG: {{^}}5000 hot:0:{{[a-z_]*check[a-z_]*$}}
+// PROFILE-DAG: {{^}}1 cold:0:{{[a-z_]*check[a-z_]*$}}
+// APPEND: {{^}}5000 hot:0:
+// APPEND: {{^}}5000 hot:0:
+
+#include <stdlib.h>
+
+//
+// The check runs on each of the 5000 iterations and is hot; it moves into
+// the block before the loop.
+//
+// USE-LABEL: define i32 @hot(
+// USE: call {{.*}}@{{[a-z_]*check[a-z_]*}}(
+// USE: {{^}}do.body:
+// USE-NOT: call
+// USE: ret i32
+int
+hot (volatile int * p, int n) {
+  int sum = 0;
+  int i = 0;
+  do {
+    sum += *p;
+  } while (++i < n);
+  return sum;
+}
+
+//
+// The check runs once and is cold; it stays in the loop.
+//
+// USE-LABEL: define i32 @cold(
+// USE: {{^}}do.body:
+// USE: call {{.*}}@{{[a-z_]*check[a-z_]*}}(
+// USE: {{^}}do.end:
+int
+cold (volatile int * p, int n) {
+  int sum = 0;
+  int i = 0;
+  do {
+    sum += *p;
+  } while (++i < n);
+  return sum;
+}
+
+int
+main (int argc, char ** argv) {
+  int * p = (int *) malloc (sizeof (int));
+  *p = argc;
+  int sum = hot (p, 5000) + cold (p, argc);
+  free (p);
+  return sum == 0;
+}
@@ -0,0 +1,50 @@
+// RUN: clang -g -O2 -fmemsafety -fmemsafety-report=%t.json -c %s -o %t.o
+// RUN: FileCheck %s < %t.json
+// RUN: clang -g -O2 -fmemsafety -fmemsafety-report=%t.1.json -mllvm -sc-check-report-hottest=1 -c %s -o %t.o
+// RUN: FileCheck %s --check-prefix=HOTTEST1 < %t.1.json
+//
+// TEST: check-report-001
+//
+// Description:
+//  Test that -fmemsafety-report= records the checks of each function after
+//  every stage, splits them into fast and slow checks, and lists the hottest
+//  checks from the most to the least costly.
+//
+
+// CHECK: {"module":"{{.*}}check-report-001.c","stages":["instrumented","exactcheck-opt","implied-fastlscheck-opt","optimize-checks","scalar-opts","final"],"functions":[
+
+//
+// The checks on an argument look the object up and stay slow.  The checks in
+// the loop run more often than the one before it.
+//
+// CHECK-LABEL: {"name":"fill","stages":[
+// CHECK-NEXT: {"stage":"instrumented","checks":[[FILL:[1-9][0-9]*]],"fast":0,"slow":[[FILL]],"registrations":0,
+// CHECK-NEXT: {"stage":"exactcheck-opt","checks":[[FILL]],"fast":0,"slow":[[FILL]],"registrations":0,
+// CHECK: {"stage":"final","checks":{{[1-9][0-9]*}},"fast":0,
+// CHECK: "hottest":[
+// CHECK-NEXT: "frequency":{{([2-9]|[1-9][0-9]+)\.[0-9]+}},"cost":{{[1-9][0-9]+\.[0-9]+}}}
+// HOTTEST1-LABEL: {"name":"fill","stages":[
+// HOTTEST1: "hottest":[
+void
+fill (int * p, int n) {
+// CHECK: "location":"{{.*}}check-report-001.c:[[@LINE+1]]","frequency":1.00,"cost":10.00}]}
+  p[0] = 1;
+  for (int i = 1; i < n; ++i)
+// HOTTEST1-NEXT: {"site":"fill:{{[0-9]+}}:{{[a-z_0-9]+}}","kind":"{{[a-z_0-9]+}}","location":"{{.*}}check-report-001.c:[[@LINE+1]]","frequency":{{([2-9]|[1-9][0-9]+)\.[0-9]+}},"cost":{{[0-9]+\.[0-9]+}}}]}
+    p[i] = 0;
+}
+
+//
+// The checks on a global array become fast checks once exactcheck-opt finds
+// the array.
+//
+// CHECK-LABEL: {"name":"lookup","stages":[
+// CHECK-NEXT: {"stage":"instrumented","checks":[[LOOKUP:[1-9][0-9]*]],"fast":0,"slow":[[LOOKUP]],"registrations":0,
+// CHECK-NEXT: {"stage":"exactcheck-opt","checks":[[LOOKUP]],"fast":[[LOOKUP]],"slow":0,"registrations":0,
+// CHECK-SAME: "exactcheck2":1
+int Table[10] = { 1 };
+
+int
+lookup (int i) {
+  return Table[i];
+}
@@ -0,0 +1,19 @@
+// RUN: test.sh -p -s "@poolcheckstrui" -t %t %s
+//
+// TEST: constformat-001
+//
+// Description:
+//  Test that calls to printf() with constant format strings are checked at
+//  compile time and call the library function directly.
+//
+
+#include <stdio.h>
+
+int
+main (int argc, char ** argv) {
+  char buf[8];
+  int n;
+  printf ("%s: %d args%n\n", argv[0], argc, &n);
+  snprintf (buf, sizeof (buf), "%c%c%%", 'o', 'k');
+  return 0;
+}
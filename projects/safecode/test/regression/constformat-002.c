@@ -0,0 +1,17 @@
+// RUN: test.sh -e -t %t %s
+//
+// TEST: constformat-002
+//
+// Description:
+//  Test that sprintf() with a constant format string of known output length
+//  that overflows its buffer is caught without the run-time wrapper.
+//
+
+#include <stdio.h>
+
+int
+main (int argc, char ** argv) {
+  char buf[4];
+  sprintf (buf, "four");
+  return buf[0];
+}
@@ -0,0 +1,30 @@
+// RUN: clang -g -fmemsafety -fmemsafety-terminate -mllvm -sc-debug-site-table -c %s -o %t.o
+// RUN: llvm-nm %t.o | FileCheck %s --check-prefix=SYMS
+// RUN: clang -g -fmemsafety %t.o -o %t
+// RUN: not --crash %t 2>&1 | FileCheck %s
+// RUN: not --crash %t 2>&1 | grep "Program counter" | grep -o "0x[0-9a-f]*" | addr2line -e %t | FileCheck %s --check-prefix=PC
+//
+// TEST: debug-site-table-001
+//
+// Description:
+//  Test that checks passed an entry of the source location table report the
+//  source location of the check and a program counter within the program
+//  rather than within the run-time.
+//
+
+// SYMS: __sc_debug_sites
+// SYMS: U {{(poolcheck|boundscheck|boundscheckui)_site$}}
+
+// PC: debug-site-table-001.c:{{[0-9]+}}
+
+#include <stdlib.h>
+
+int
+main (int argc, char ** argv) {
+  int * p = (int *) malloc (4 * sizeof (int));
+// CHECK: SAFECODE RUNTIME ALERT
+// CHECK: = Fault PC Source {{ *}}:{{.*}}debug-site-table-001.c:[[@LINE+1]]
+  p[argc + 7] = 1;
+  free (p);
+  return 0;
+}
@@ -0,0 +1,29 @@
+// REQUIRES: libfuzzer
+// RUN: clang -g -fmemsafety -fsanitize-coverage=edge,8bit-counters -c %s -o %t.o
+// RUN: clang++ -fmemsafety %t.o %libfuzzer -o %t
+// RUN: rm -rf %t.dir && mkdir -p %t.dir/corpus
+// RUN: printf 'Hi!' > %t.dir/corpus/Hi
+// RUN: cd %t.dir && not %t corpus 2>&1 | FileCheck %s
+// RUN: ls %t.dir | FileCheck %s --check-prefix=FILES
+//
+// TEST: fuzzer-001
+//
+// Description:
+//  Test that a memory safety error that a run-time check finds in a program
+//  fuzzed with libFuzzer ends the run and saves the input as a crash- file.
+//
+
+// CHECK: ERROR: SAFECode memory safety violation
+// CHECK: CRASHED; file written to crash-
+// CHECK-NEXT: Base64: SGkh
+// FILES: crash-
+
+#include <stdint.h>
+#include <stdlib.h>
+
+void LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
+  char *Buf = malloc(4);
+  if (Size > 2 && Data[0] == 'H' && Data[1] == 'i' && Data[2] == '!')
+    Buf[Size + 1] = 0;
+  free(Buf);
+}
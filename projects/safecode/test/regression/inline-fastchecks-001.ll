@@ -0,0 +1,122 @@
+; RUN: clang -fmemsafety -S -emit-llvm %s -o - | FileCheck %s
+; RUN: clang -fmemsafety -mllvm -fastcheck-batch-size=0 -S -emit-llvm %s -o - | FileCheck %s --check-prefix=NOBATCH
+;
+; TEST: inline-fastchecks-001
+;
+; Description:
+;  Test how InlineFastChecks merges the load/store checks of a basic block
+;  into batches and inlines the checks.  A batch compares vectors of the
+;  pointers and bounds of its checks, branches once, and performs the checks
+;  one by one on the failure path.  Calls, volatile accesses, and checks whose
+;  operands are computed from loads between the checks end a batch.  The fast
+;  path of exactcheck2 is inlined and only calls the run-time when the pointer
+;  is out of bounds.
+;
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@buf = global [64 x i32] zeroinitializer
+@flag = global i32 0
+
+declare void @ext()
+
+; CHECK-LABEL: define i32 @batch(
+; CHECK: icmp ult <4 x i64>
+; CHECK: %mask{{[.0-9a-z]*}} = bitcast <4 x i1> %{{[^ ]*}} to i4
+; CHECK: %passed{{[.0-9a-z]*}} = icmp eq i4 %mask{{[.0-9a-z]*}}, -1
+; CHECK: br i1 %passed{{[.0-9a-z]*}}, label %{{[^,]*}}, label %{{[^,]*}}, !prof
+; CHECK: call void @failLSCheck(
+; CHECK: call void @failLSCheck(
+; CHECK: call void @failLSCheck(
+; CHECK: call void @failLSCheck(
+; CHECK-NOT: call void @fastlscheck_debug
+; NOBATCH-LABEL: define i32 @batch(
+; NOBATCH-NOT: x i1>
+; NOBATCH: icmp ult i64
+define i32 @batch() {
+entry:
+  %v0 = load i32, i32* getelementptr inbounds ([64 x i32], [64 x i32]* @buf, i64 0, i64 0)
+  %v1 = load i32, i32* getelementptr inbounds ([64 x i32], [64 x i32]* @buf, i64 0, i64 1)
+  %v2 = load i32, i32* getelementptr inbounds ([64 x i32], [64 x i32]* @buf, i64 0, i64 2)
+  %v3 = load i32, i32* getelementptr inbounds ([64 x i32], [64 x i32]* @buf, i64 0, i64 3)
+  %s0 = add i32 %v0, %v1
+  %s1 = add i32 %v2, %v3
+  %s2 = add i32 %s0, %s1
+  ret i32 %s2
+}
+
+; CHECK-LABEL: define i32 @calls(
+; CHECK-NOT: {{<[34] x i1>}}
+; CHECK: bitcast <2 x i1> %{{[^ ]*}} to i2
+; CHECK-NOT: {{<[34] x i1>}}
+; CHECK: bitcast <2 x i1> %{{[^ ]*}} to i2
+; CHECK-NOT: {{<[34] x i1>}}
+define i32 @calls() {
+entry:
+  %v0 = load i32, i32* getelementptr inbounds ([64 x i32], [64 x i32]* @buf, i64 0, i64 0)
+  %v1 = load i32, i32* getelementptr inbounds ([64 x i32], [64 x i32]* @buf, i64 0, i64 1)
+  call void @ext()
+  %v2 = load i32, i32* getelementptr inbounds ([64 x i32], [64 x i32]* @buf, i64 0, i64 2)
+  %v3 = load i32, i32* getelementptr inbounds ([64 x i32], [64 x i32]* @buf, i64 0, i64 3)
+  %s0 = add i32 %v0, %v1
+  %s1 = add i32 %v2, %v3
+  %s2 = add i32 %s0, %s1
+  ret i32 %s2
+}
+
+; The check of the volatile load is merged with the checks before it, but the
+; checks after it are not.
+; CHECK-LABEL: define i32 @volatile(
+; CHECK-NOT: <4 x i1>
+; CHECK: bitcast <3 x i1> %{{[^ ]*}} to i3
+; CHECK-NOT: <4 x i1>
+; CHECK: bitcast <2 x i1> %{{[^ ]*}} to i2
+; CHECK-NOT: <4 x i1>
+define i32 @volatile() {
+entry:
+  %v0 = load i32, i32* getelementptr inbounds ([64 x i32], [64 x i32]* @buf, i64 0, i64 0)
+  %v1 = load i32, i32* getelementptr inbounds ([64 x i32], [64 x i32]* @buf, i64 0, i64 1)
+  %v2 = load volatile i32, i32* getelementptr inbounds ([64 x i32], [64 x i32]* @buf, i64 0, i64 2)
+  %v3 = load i32, i32* getelementptr inbounds ([64 x i32], [64 x i32]* @buf, i64 0, i64 3)
+  %v4 = load i32, i32* getelementptr inbounds ([64 x i32], [64 x i32]* @buf, i64 0, i64 4)
+  %s0 = add i32 %v0, %v1
+  %s1 = add i32 %v2, %v3
+  %s2 = add i32 %s0, %s1
+  %s3 = add i32 %s2, %v4
+  ret i32 %s3
+}
+
+; The pointer of the third access depends on a load after the first check, so
+; it cannot be checked with the first two.
+; CHECK-LABEL: define i32 @loaded(
+; CHECK-NOT: {{<[34] x i1>}}
+; CHECK: bitcast <2 x i1> %{{[^ ]*}} to i2
+; CHECK-NOT: {{<[34] x i1>}}
+; CHECK: bitcast <2 x i1> %{{[^ ]*}} to i2
+; CHECK-NOT: {{<[34] x i1>}}
+define i32 @loaded() {
+entry:
+  %v0 = load i32, i32* getelementptr inbounds ([64 x i32], [64 x i32]* @buf, i64 0, i64 0)
+  %f = load i32, i32* @flag
+  %c = icmp ne i32 %f, 0
+  %p = select i1 %c, i32* getelementptr inbounds ([64 x i32], [64 x i32]* @buf, i64 0, i64 1), i32* getelementptr inbounds ([64 x i32], [64 x i32]* @buf, i64 0, i64 2)
+  %v1 = load i32, i32* %p
+  %v2 = load i32, i32* getelementptr inbounds ([64 x i32], [64 x i32]* @buf, i64 0, i64 3)
+  %s0 = add i32 %v0, %v1
+  %s1 = add i32 %s0, %v2
+  ret i32 %s1
+}
+
+; CHECK-LABEL: define i32 @exact(
+; CHECK: %offset{{[.0-9a-z]*}} = sub i64
+; CHECK: %inbounds{{[.0-9a-z]*}} = icmp ult i64 %offset
+; CHECK: br i1 %inbounds{{[.0-9a-z]*}}, label %{{[^,]*}}, label %{{[^,]*}}, !prof
+; CHECK: call i8* @exactcheck2_debug(
+; CHECK-NOT: @exactcheck2_debug_fast
+define i32 @exact(i64 %i) {
+entry:
+  %p = getelementptr inbounds [64 x i32], [64 x i32]* @buf, i64 0, i64 %i
+  %v = load i32, i32* %p
+  ret i32 %v
+}
@@ -0,0 +1,72 @@
+// RUN: clang -O2 -fmemsafety -fmemsafety-terminate -use-gold-plugin -flto -Wl,-plugin-opt,-codegen-partitions=2 %s -o %t
+// RUN: %t 2>&1 | FileCheck %s --check-prefix=OUT
+// RUN: not --crash %t oob 2>&1 | FileCheck %s --check-prefix=OOB
+// RUN: llvm-nm %t | FileCheck %s
+//
+// TEST: lto-partitions-001
+//
+// Description:
+//  Test that link-time optimization with -codegen-partitions=2 links a program
+//  whose functions are split across the partitions: internal globals used from
+//  both partitions are defined once, the aliases keep the definition of the
+//  function they reach, and the pool descriptors of the heap objects passed
+//  between functions are shared, so a bounds error is still caught.
+//
+
+// CHECK: T scale_alias
+// CHECK: T sum_alias
+
+// OUT-NOT: SAFECODE RUNTIME ALERT
+// OUT: total 4950 scaled 9900 count 4
+// OOB: SAFECODE RUNTIME ALERT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int Count;
+static int * Table;
+
+__attribute__((noinline)) static int
+sum (int * values, int n) {
+  int total = 0;
+  int i;
+  ++Count;
+  for (i = 0; i < n; ++i)
+    total += values[i];
+  return total;
+}
+
+__attribute__((noinline)) static int
+scale (int * values, int n, int factor) {
+  int i;
+  ++Count;
+  for (i = 0; i < n; ++i)
+    values[i] *= factor;
+  return sum (values, n);
+}
+
+int sum_alias (int *, int) __attribute__((alias ("sum")));
+int scale_alias (int *, int, int) __attribute__((alias ("scale")));
+
+__attribute__((noinline)) static int *
+fill (int n) {
+  int * values = (int *) malloc (n * sizeof (int));
+  int i;
+  ++Count;
+  for (i = 0; i < n; ++i)
+    values[i] = i;
+  return values;
+}
+
+int
+main (int argc, char ** argv) {
+  Table = fill (100);
+  int total = sum_alias (Table, 100);
+  int scaled = scale_alias (Table, 100, 2);
+  printf ("total %d scaled %d count %d\n", total, scaled, Count);
+
+  if ((argc > 1) && !strcmp (argv[1], "oob"))
+    printf ("%d\n", sum (Table, 100 + argc * 50));
+  return 0;
+}
@@ -0,0 +1,52 @@
+// RUN: clang -fmemsafety -fmemsafety-terminate %s -o %t
+// RUN: env SCTRACKMALLOCS=1 %t 2>&1 | FileCheck %s
+// RUN: env SCTRACKMALLOCS=1 not --crash %t aligned 2>&1 | FileCheck %s --check-prefix=FREE
+// RUN: env SCTRACKMALLOCS=1 not --crash %t pvalloc 2>&1 | FileCheck %s --check-prefix=FREE
+// RUN: env SCTRACKMALLOCS=1 not --crash %t realloc 2>&1 | FileCheck %s --check-prefix=FREE
+//
+// TEST: malloc-hooks-001
+//
+// Description:
+//  Test the hooks that record the allocations of the C library with
+//  SCTRACKMALLOCS set.  Objects from aligned_alloc() and pvalloc(), with its
+//  size rounded up to a page, are recorded, and an object stays recorded when
+//  realloc() fails, so freeing a pointer into any of them is reported.  An
+//  overflowing calloc() fails.
+//
+
+// CHECK-NOT: SAFECODE RUNTIME ALERT
+// CHECK: calloc overflow: null
+// CHECK: done
+// FREE: Invalid Free Error
+
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int
+main (int argc, char ** argv) {
+  char * p = 0;
+  if (argc < 2) {
+    void * q = calloc (SIZE_MAX / 2, 4);
+    printf ("calloc overflow: %s\n", q ? "allocated" : "null");
+    free (aligned_alloc (64, 64));
+    free (pvalloc (100));
+    printf ("done\n");
+    return 0;
+  }
+
+  if (!strcmp (argv[1], "aligned")) {
+    p = (char *) aligned_alloc (64, 64);
+    free (p + 8);
+  } else if (!strcmp (argv[1], "pvalloc")) {
+    p = (char *) pvalloc (100);
+    free (p + 200);
+  } else if (!strcmp (argv[1], "realloc")) {
+    p = (char *) malloc (32);
+    if (realloc (p, SIZE_MAX / 2) == 0)
+      free (p + 8);
+  }
+  return 0;
+}
@@ -0,0 +1,34 @@
+// RUN: clang -fmemsafety %s -o %t
+// RUN: env SCPROFILE=100 SCPROFILEFILE=%t.prof %t
+// RUN: FileCheck %s < %t.prof
+//
+// TEST: profile-001
+//
+// Description:
+//  Test that setting SCPROFILE makes the run-time print a profile that charges
+//  samples to the checks of a program built without debug information.
+//
+
+// CHECK: === SAFECode run-time profile: {{[1-9][0-9]*}} samples
+// CHECK: operation {{ +}}ms
+// CHECK-NEXT: program
+// CHECK-NEXT: poolcheck
+// CHECK-NEXT: boundscheck
+// CHECK-NEXT: pool_register
+// CHECK-NEXT: pool_unregister
+// CHECK: operation {{ +}}ms {{.*}} call site
+// CHECK: {{^(poolcheck|boundscheck) +[0-9]+\.[0-9]+ }}
+
+#include <stdlib.h>
+
+int
+main (int argc, char ** argv) {
+  volatile int sum = 0;
+  int * p = (int *) malloc (64 * sizeof (int));
+  for (int i = 0; i < 64; ++i)
+    p[i] = i;
+  for (long n = 0; n < 5000000; ++n)
+    sum += p[(n + argc) & 63];
+  free (p);
+  return 0;
+}
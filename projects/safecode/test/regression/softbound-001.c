@@ -0,0 +1,49 @@
+// RUN: clang -fsoftbound %s -o %t
+// RUN: %t 2>&1 | FileCheck %s
+// RUN: not --crash %t oob 2>&1 | FileCheck %s --check-prefix=OOB
+//
+// TEST: softbound-001
+//
+// Description:
+//  Smoke test of the SoftBound+CETS run-time: pointers stored to and loaded
+//  back from the heap keep their bounds through the metadata trie, including
+//  pointers far enough apart to use different secondary tables, and an access
+//  past the end of an object is reported.
+//
+
+// CHECK-NOT: Bounds violation
+// CHECK: sum 4950
+// OOB: Bounds violation detected
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int
+main (int argc, char ** argv) {
+  int ** table = (int **) malloc (100 * sizeof (int *));
+  char * big = (char *) malloc (64 << 20);
+  int i;
+  for (i = 0; i < 100; ++i) {
+    table[i] = (int *) malloc (4 * sizeof (int));
+    table[i][0] = i;
+  }
+
+  // Store a pointer at the start and at the end of a 64MB block; the two
+  // slots fall into different secondary tables of the trie.
+  ((int **) big)[0] = table[1];
+  ((int **) (big + (64 << 20)))[-1] = table[2];
+
+  int sum = 0;
+  for (i = 0; i < 100; ++i)
+    sum += table[i][0];
+  sum += ((int **) big)[0][0] - 1;
+  sum += ((int **) (big + (64 << 20)))[-1][0] - 2;
+  printf ("sum %d\n", sum);
+
+  if ((argc > 1) && !strcmp (argv[1], "oob")) {
+    int * p = ((int **) (big + (64 << 20)))[-1];
+    printf ("%d\n", p[argc + 3]);
+  }
+  return 0;
+}
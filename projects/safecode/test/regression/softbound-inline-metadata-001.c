@@ -0,0 +1,67 @@
+// RUN: clang -target x86_64-unknown-linux-gnu -fsoftbound -S -emit-llvm -mllvm -softboundcets_inline_metadata %s -o - | FileCheck %s
+// RUN: clang -target x86_64-unknown-linux-gnu -fsoftbound -S -emit-llvm -mllvm -softboundcets_inline_metadata -mllvm -softboundcets_trie_secondary_bits=20 %s -o - | FileCheck %s --check-prefix=BITS
+// RUN: clang -target x86_64-unknown-linux-gnu -fsoftbound -S -emit-llvm -mllvm -softboundcets_inline_metadata -mllvm -softboundcets_packed_metadata %s -o - | FileCheck %s --check-prefix=PACKED
+// RUN: clang -target x86_64-unknown-linux-gnu -fsoftbound -S -emit-llvm -mllvm -softboundcets_inline_metadata -mllvm -softboundcets_inline_metadata_stats %s -o - | FileCheck %s --check-prefix=STATS
+// RUN: clang -fsoftbound -mllvm -softboundcets_inline_metadata %s -o %t
+// RUN: %t 2>&1 | FileCheck %s --check-prefix=EXEC
+//
+// TEST: softbound-inline-metadata-001
+//
+// Description:
+//  Test that -softboundcets_inline_metadata expands the trie lookup of
+//  metadata loads and stores inline for the layout of the run-time: the
+//  primary table is named after the layout, the secondary index follows
+//  -softboundcets_trie_secondary_bits, packed entries are decoded inline,
+//  and the statistics counters are updated on the inline path.  A program
+//  built with the default layout links with the run-time and runs.
+//
+
+// CHECK: @__softboundcets_trie_primary_table_18 = external global
+// CHECK-LABEL: define {{.*}}@softboundcets_roundtrip(
+// CHECK: %md.pidx = lshr i64 %md.addr, 21
+// CHECK: %md.missing = icmp eq i8* %md.secondary, null
+// CHECK: call void @__softboundcets_metadata_store(
+// CHECK: %md.sidx{{[0-9]*}} = and i64 %md.sidx{{[0-9]*}}, 262143
+// CHECK: %md.entry = mul i64 %md.sidx{{[0-9]*}}, 4
+// CHECK: call void @__softboundcets_metadata_load(
+// CHECK: %md.field = load
+// CHECK-NOT: __softboundcets_statistics_metadata
+
+// BITS: @__softboundcets_trie_primary_table_20 = external global
+// BITS: lshr i64 %md.addr, 23
+// BITS: and i64 %md.sidx{{[0-9]*}}, 1048575
+
+// PACKED: @__softboundcets_trie_primary_table_18_packed = external global
+// PACKED-LABEL: define {{.*}}@softboundcets_roundtrip(
+// PACKED: %md.above = icmp ugt i64 %md.value{{[0-9]*}}, 281474976710655
+// PACKED: %md.basekey = or i64
+// PACKED: %md.boundkey = or i64
+// PACKED: %md.basekey{{[0-9]*}} = load i64
+// PACKED: %md.saturated = icmp eq i64 %md.bound{{[0-9]*}}, 281474976710655
+// PACKED: %md.locks = load i64*, i64** @__softboundcets_temporal_space_begin
+// PACKED: %md.lidx = and i64 %md.key, 67108863
+// PACKED: %md.haslock = icmp ne i64 %md.key, 0
+
+// STATS: @__softboundcets_trie_primary_table_18_stats = external global
+// STATS: load i64, i64* @__softboundcets_statistics_metadata_stores
+// STATS: load i64, i64* @__softboundcets_statistics_metadata_loads
+
+// EXEC: value 42
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int *
+softboundcets_roundtrip (int ** slot, int * p) {
+  *slot = p;
+  return *slot;
+}
+
+int
+main (int argc, char ** argv) {
+  int ** slot = (int **) malloc (sizeof (int *));
+  int * p = (int *) malloc (4 * sizeof (int));
+  p[3] = 42;
+  printf ("value %d\n", softboundcets_roundtrip (slot, p)[3]);
+  return 0;
+}
@@ -0,0 +1,46 @@
+// RUN: clang -fmemsafety -fmemsafety-terminate -fmemsafety-struct-checks %s -o %t
+// RUN: %t 2>&1 | FileCheck %s --check-prefix=OUT
+// RUN: not --crash %t oob 2>&1 | FileCheck %s --check-prefix=OOB
+//
+// TEST: struct-checks-001
+//
+// Description:
+//  Test that -fmemsafety-struct-checks schedules the structure indexing
+//  bounds check with its demand-driven DSA queries ahead of the GEP checks.
+//  The program is compiled and runs, and indexing an array that is reached
+//  through a field of a heap-allocated structure is still checked.
+//
+
+// OUT-NOT: SAFECODE RUNTIME ALERT
+// OUT: sum 45
+// OOB: SAFECODE RUNTIME ALERT
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct table {
+  int count;
+  int * values;
+};
+
+__attribute__((noinline)) static int
+sum (struct table * t, int n) {
+  int total = 0;
+  int i;
+  for (i = 0; i < n; ++i)
+    total += t->values[i];
+  return total;
+}
+
+int
+main (int argc, char ** argv) {
+  struct table * t = (struct table *) malloc (sizeof (struct table));
+  int i;
+  t->count = 10;
+  t->values = (int *) malloc (t->count * sizeof (int));
+  for (i = 0; i < t->count; ++i)
+    t->values[i] = i;
+
+  printf ("sum %d\n", sum (t, t->count + (argc > 1) * 100));
+  return 0;
+}
@@ -0,0 +1,55 @@
+// RUN: clang -fmemsafety %s -o %t
+// RUN: %t 2>&1 | FileCheck %s
+//
+// TEST: vararg-whitelist-001
+//
+// Description:
+//  Test that the whitelist of a vararg call holds all of its pointer
+//  arguments, even when there are more than 16 of them, and that it stays
+//  attached to a va_list copied more than four times.  An integer passed
+//  where the format string expects a string is not in the whitelist and is
+//  printed as "(not a string)" instead of being dereferenced.
+//
+
+// CHECK: many: abcdefghijklmnopqrst (not a string)
+// CHECK: copied: a (not a string)
+
+#include <stdarg.h>
+#include <stdio.h>
+
+static void
+many (const char * fmt, ...) {
+  va_list ap;
+  va_start (ap, fmt);
+  vprintf (fmt, ap);
+  va_end (ap);
+}
+
+static void
+copied (const char * fmt, ...) {
+  va_list ap, c1, c2, c3, c4, c5, c6;
+  va_start (ap, fmt);
+  va_copy (c1, ap);
+  va_copy (c2, ap);
+  va_copy (c3, ap);
+  va_copy (c4, ap);
+  va_copy (c5, ap);
+  va_copy (c6, ap);
+  vprintf (fmt, c1);
+  va_end (c6);
+  va_end (c5);
+  va_end (c4);
+  va_end (c3);
+  va_end (c2);
+  va_end (c1);
+  va_end (ap);
+}
+
+int
+main (void) {
+  many ("many: %s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s %s\n",
+        "a", "b", "c", "d", "e", "f", "g", "h", "i", "j",
+        "k", "l", "m", "n", "o", "p", "q", "r", "s", "t", 1);
+  copied ("copied: %s %s\n", "a", 1);
+  return 0;
+}
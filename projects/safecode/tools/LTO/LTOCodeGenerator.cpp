@@ -35,14 +35,19 @@
 #include "llvm/Target/TargetRegisterInfo.h"
 #include "llvm/Transforms/IPO.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/FormattedStream.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/Host.h"
+#include "llvm/Support/Program.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/system_error.h"
 #include "llvm/ADT/StringExtras.h"
 #include "poolalloc/PoolAllocate.h"
@@ -65,6 +70,11 @@
 #include <iostream>
 #endif
 
+#include <algorithm>
+#include <map>
+#include <thread>
+#include <vector>
+
 using namespace llvm;
 
 static cl::opt<bool>
@@ -75,6 +85,15 @@ static cl::opt<bool>
 DisableGVNLoadPRE("disable-gvn-loadpre", cl::init(false),
   cl::desc("Do not run the GVN load PRE pass"));
 
+static cl::opt<unsigned>
+CodeGenPartitions("codegen-partitions", cl::init(1),
+  cl::desc("Generate code for this many partitions of the module in "
+           "parallel"));
+
+static cl::opt<bool>
+ReportCodeGenTime("report-codegen-time", cl::init(false),
+  cl::desc("Report the time taken to generate code"));
+
 const char* LTOCodeGenerator::getVersionString() {
 #ifdef LLVM_VERSION_INFO
   return PACKAGE_NAME " version " PACKAGE_VERSION ", " LLVM_VERSION_INFO;
@@ -239,6 +258,13 @@ bool LTOCodeGenerator::determineTarget(std::string& errMsg) {
   if (_target != NULL)
     return false;
 
+  _target = createTargetMachine(errMsg);
+  return _target == NULL;
+}
+
+/// createTargetMachine - Create a target machine for the merged modules.  Each
+/// thread generating code needs a target machine of its own.
+TargetMachine *LTOCodeGenerator::createTargetMachine(std::string &errMsg) {
   std::string TripleStr = _linker.getModule()->getTargetTriple();
   if (TripleStr.empty())
     TripleStr = sys::getDefaultTargetTriple();
@@ -247,7 +273,7 @@ bool LTOCodeGenerator::determineTarget(std::string& errMsg) {
   // create target machine from info for merged modules
   const Target *march = TargetRegistry::lookupTarget(TripleStr, errMsg);
   if (march == NULL)
-    return true;
+    return NULL;
 
   // The relocation model is actually a static member of TargetMachine and
   // needs to be set before the TargetMachine is instantiated.
@@ -277,10 +303,9 @@ bool LTOCodeGenerator::determineTarget(std::string& errMsg) {
   }
   TargetOptions Options;
   LTOModule::getTargetOptions(Options);
-  _target = march->createTargetMachine(TripleStr, _mCpu, FeatureStr, Options,
-                                       RelocModel, CodeModel::Default,
-                                       CodeGenOpt::Aggressive);
-  return false;
+  return march->createTargetMachine(TripleStr, _mCpu, FeatureStr, Options,
+                                    RelocModel, CodeModel::Default,
+                                    CodeGenOpt::Aggressive);
 }
 
 void LTOCodeGenerator::
@@ -378,8 +403,11 @@ void LTOCodeGenerator::applyScopeRestrictions() {
 // equivalents.
 //
 struct LowerSafecodeIntrinsic::IntrinsicMappingEntry RuntimeDebug[] = {
-  { "poolinit",          "__sc_dbg_poolinit"          },
-  { "pooldestroy",       "__sc_dbg_pooldestroy"       },
+  { "poolinit",            "__sc_dbg_poolinit"            },
+  { "pooldestroy",         "__sc_dbg_pooldestroy"         },
+  { "poolinit_region",     "__sc_dbg_poolinit_region"     },
+  { "poolalloc_region",    "__sc_dbg_poolalloc_region"    },
+  { "pooldestroy_region",  "__sc_dbg_pooldestroy_region"  },
 };
 #endif
 
@@ -420,18 +448,6 @@ bool LTOCodeGenerator::generateObjectFile(raw_ostream &out,
   // Make sure everything is still good.
   passes.add(createVerifierPass());
 
-  FunctionPassManager *codeGenPasses = new FunctionPassManager(mergedModule);
-
-  codeGenPasses->add(new DataLayout(*_target->getDataLayout()));
-
-  formatted_raw_ostream Out(out);
-
-  if (_target->addPassesToEmitFile(*codeGenPasses, Out,
-                                   TargetMachine::CGFT_ObjectFile)) {
-    errMsg = "target file type not supported";
-    return true;
-  }
-
     bool UsingSAFECode = false;
 
     // Add the SAFECode optimization/finalization passes.
@@ -506,6 +522,24 @@ bool LTOCodeGenerator::generateObjectFile(raw_ostream &out,
 #endif
    }
 
+  if (CodeGenPartitions > 1)
+    return generatePartitionedObjectFile(out, CodeGenPartitions, errMsg);
+
+  double startTime = TimeRecord::getCurrentTime(true).getWallTime();
+
+  FunctionPassManager *codeGenPasses = new FunctionPassManager(mergedModule);
+
+  codeGenPasses->add(new DataLayout(*_target->getDataLayout()));
+
+  formatted_raw_ostream Out(out);
+
+  if (_target->addPassesToEmitFile(*codeGenPasses, Out,
+                                   TargetMachine::CGFT_ObjectFile)) {
+    errMsg = "target file type not supported";
+    delete codeGenPasses;
+    return true;
+  }
+
   // Run the code generator, and write assembly file
   codeGenPasses->doInitialization();
 
@@ -517,6 +551,350 @@ bool LTOCodeGenerator::generateObjectFile(raw_ostream &out,
   codeGenPasses->doFinalization();
   delete codeGenPasses;
 
+  if (ReportCodeGenTime) {
+    double wallTime = TimeRecord::getCurrentTime(false).getWallTime();
+    errs() << "SAFECode LTO: generated code in "
+           << format("%.3f", wallTime - startTime) << "s\n";
+  }
+
+  return false; // success
+}
+
+namespace {
+  //
+  // Structure: CodeGenPartition
+  //
+  // Description:
+  //  A partition of the merged module, stored as bitcode, along with the
+  //  target machine and the object file used to generate code for it.
+  //
+  struct CodeGenPartition {
+    std::string Bitcode;
+    TargetMachine *Target;
+    std::string ObjPath;
+    std::string ErrMsg;
+    double Seconds;
+
+    CodeGenPartition() : Target(0), Seconds(0) { }
+  };
+}
+
+//
+// Function: externalizeLocal()
+//
+// Description:
+//  Give a value with local linkage hidden external linkage, so that the
+//  partitions of the module can refer to the values defined in the others.
+//  This keeps the pool descriptors and the other globals that SAFECode creates
+//  defined exactly once in the linked object file.  The value is renamed so
+//  that it cannot clash with the symbols of the other object files.
+//
+static void externalizeLocal(GlobalValue &GV) {
+  if (!GV.hasLocalLinkage())
+    return;
+
+  if (GV.hasName())
+    GV.setName(GV.getName() + ".sc.lto");
+  else
+    GV.setName("sc.lto.anon");
+  GV.setLinkage(GlobalValue::ExternalLinkage);
+  GV.setVisibility(GlobalValue::HiddenVisibility);
+}
+
+//
+// Function: getFunctionSize()
+//
+// Description:
+//  Return the number of instructions of a function.
+//
+static unsigned getFunctionSize(const Function &F) {
+  unsigned Size = 0;
+  for (Function::const_iterator BB = F.begin(), E = F.end(); BB != E; ++BB)
+    Size += BB->size();
+  return Size;
+}
+
+static bool largerFunction(const std::pair<unsigned, const Function *> &A,
+                           const std::pair<unsigned, const Function *> &B) {
+  return A.first > B.first;
+}
+
+//
+// Function: assignPartitions()
+//
+// Description:
+//  Assign each function defined in the module to a partition, balancing the
+//  number of instructions of the partitions.  The functions that aliases
+//  reach go to partition 0, which defines the aliases.  The others follow,
+//  largest first, each to the partition with the fewest instructions so far.
+//
+static void
+assignPartitions(Module &M, unsigned numPartitions,
+                 std::map<const Function *, unsigned> &Partition) {
+  std::vector<unsigned> Load(numPartitions, 0);
+  for (Module::alias_iterator A = M.alias_begin(), E = M.alias_end();
+       A != E; ++A) {
+    const GlobalValue *Aliasee = A->resolveAliasedGlobal(false);
+    const Function *F = dyn_cast_or_null<Function>(Aliasee);
+    if (F && !F->isDeclaration() && !Partition.count(F)) {
+      Partition[F] = 0;
+      Load[0] += getFunctionSize(*F);
+    }
+  }
+
+  std::vector<std::pair<unsigned, const Function *> > Functions;
+  for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+    if (!F->isDeclaration() && !Partition.count(F))
+      Functions.push_back(std::make_pair(getFunctionSize(*F), &*F));
+  std::stable_sort(Functions.begin(), Functions.end(), largerFunction);
+
+  for (unsigned index = 0; index < Functions.size(); ++index) {
+    unsigned Part = std::min_element(Load.begin(), Load.end()) - Load.begin();
+    Partition[Functions[index].second] = Part;
+    Load[Part] += Functions[index].first;
+  }
+}
+
+//
+// Function: extractPartition()
+//
+// Description:
+//  Create a copy of the module that only defines the functions assigned to a
+//  partition.  Partition 0 also defines the global variables and aliases and
+//  holds the global constructors and the other appending variables; the other
+//  partitions only declare them.  assignPartitions() gives partition 0 the
+//  functions that the aliases reach.  The declarations of the SAFECode
+//  run-time functions are kept in every partition.
+//
+static Module *
+extractPartition(Module &M, unsigned Part,
+                 std::map<const Function *, unsigned> &Partition) {
+  ValueToValueMapTy VMap;
+  Module *P = CloneModule(&M, VMap);
+
+  for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+    if (!F->isDeclaration() && Partition[F] != Part)
+      cast<Function>(VMap[F])->deleteBody();
+
+  if (Part == 0)
+    return P;
+
+  for (Module::global_iterator G = M.global_begin(), E = M.global_end();
+       G != E; ++G) {
+    GlobalVariable *Copy = cast<GlobalVariable>(VMap[G]);
+    if (G->hasAppendingLinkage()) {
+      Copy->eraseFromParent();
+    } else if (!G->isDeclaration()) {
+      Copy->setInitializer(0);
+      Copy->setLinkage(GlobalValue::ExternalLinkage);
+    }
+  }
+
+  for (Module::alias_iterator A = M.alias_begin(), E = M.alias_end();
+       A != E; ++A) {
+    GlobalAlias *Copy = cast<GlobalAlias>(VMap[A]);
+    Type *Ty = Copy->getType()->getElementType();
+    GlobalValue *Decl;
+    if (FunctionType *FTy = dyn_cast<FunctionType>(Ty))
+      Decl = Function::Create(FTy, GlobalValue::ExternalLinkage, "", P);
+    else
+      Decl = new GlobalVariable(*P, Ty, false, GlobalValue::ExternalLinkage, 0);
+    Decl->takeName(Copy);
+    Decl->setVisibility(Copy->getVisibility());
+    Copy->replaceAllUsesWith(Decl);
+    Copy->eraseFromParent();
+  }
+
+  return P;
+}
+
+//
+// Function: compilePartition()
+//
+// Description:
+//  Generate the object file of one partition.  The partition is read from its
+//  bitcode into a context of its own, so that the threads generating code for
+//  the partitions share no state.
+//
+static void compilePartition(CodeGenPartition *Part) {
+  double startTime = TimeRecord::getCurrentTime(true).getWallTime();
+
+  LLVMContext Context;
+  MemoryBuffer *Buffer = MemoryBuffer::getMemBuffer(Part->Bitcode, "", false);
+  OwningPtr<Module> M(ParseBitcodeFile(Buffer, Context, &Part->ErrMsg));
+  delete Buffer;
+  if (!M)
+    return;
+
+  tool_output_file objFile(Part->ObjPath.c_str(), Part->ErrMsg,
+                           raw_fd_ostream::F_Binary);
+  if (!Part->ErrMsg.empty())
+    return;
+
+  {
+    PassManager codeGenPasses;
+    codeGenPasses.add(new DataLayout(*Part->Target->getDataLayout()));
+
+    formatted_raw_ostream Out(objFile.os());
+    if (Part->Target->addPassesToEmitFile(codeGenPasses, Out,
+                                          TargetMachine::CGFT_ObjectFile)) {
+      Part->ErrMsg = "target file type not supported";
+      return;
+    }
+    codeGenPasses.run(*M);
+  }
+
+  objFile.os().close();
+  if (objFile.os().has_error()) {
+    Part->ErrMsg = "could not write object file: " + Part->ObjPath;
+    objFile.os().clear_error();
+    return;
+  }
+  objFile.keep();
+
+  double endTime = TimeRecord::getCurrentTime(false).getWallTime();
+  Part->Seconds = endTime - startTime;
+}
+
+//
+// Function: linkPartitions()
+//
+// Description:
+//  Combine the object files of the partitions into one relocatable object file
+//  with the system linker.
+//
+// Return value:
+//  true  - An error occurred.
+//  false - The object files were combined.
+//
+static bool linkPartitions(const std::vector<CodeGenPartition> &Parts,
+                           const std::string &OutPath, std::string &errMsg) {
+  sys::Path Linker = sys::Program::FindProgramByName("ld");
+  if (Linker.isEmpty()) {
+    errMsg = "could not find ld to combine the code generation partitions";
+    return true;
+  }
+
+  std::vector<const char *> Args;
+  Args.push_back(Linker.c_str());
+  Args.push_back("-r");
+  Args.push_back("-o");
+  Args.push_back(OutPath.c_str());
+  for (unsigned index = 0; index < Parts.size(); ++index)
+    Args.push_back(Parts[index].ObjPath.c_str());
+  Args.push_back(0);
+
+  if (sys::Program::ExecuteAndWait(Linker, &Args[0], 0, 0, 0, 0, &errMsg)) {
+    if (errMsg.empty())
+      errMsg = "ld failed to combine the code generation partitions";
+    return true;
+  }
+  return false;
+}
+
+/// generatePartitionedObjectFile - Split the merged module into partitions,
+/// generate code for them in parallel, and combine their object files.  The
+/// SAFECode passes have already run, so every partition sees the same pool
+/// descriptors and run-time checks.
+bool LTOCodeGenerator::generatePartitionedObjectFile(raw_ostream &out,
+                                                     unsigned numPartitions,
+                                                     std::string &errMsg) {
+  double startTime = TimeRecord::getCurrentTime(true).getWallTime();
+  Module *mergedModule = _linker.getModule();
+
+  // Let the partitions refer to the values defined in the others.
+  for (Module::iterator F = mergedModule->begin(), E = mergedModule->end();
+       F != E; ++F)
+    externalizeLocal(*F);
+  for (Module::global_iterator G = mergedModule->global_begin(),
+         E = mergedModule->global_end(); G != E; ++G)
+    externalizeLocal(*G);
+  for (Module::alias_iterator A = mergedModule->alias_begin(),
+         E = mergedModule->alias_end(); A != E; ++A)
+    externalizeLocal(*A);
+
+  std::map<const Function *, unsigned> Partition;
+  assignPartitions(*mergedModule, numPartitions, Partition);
+
+  std::vector<CodeGenPartition> Parts(numPartitions);
+  bool Failed = false;
+  for (unsigned index = 0; index < numPartitions && !Failed; ++index) {
+    OwningPtr<Module> P(extractPartition(*mergedModule, index, Partition));
+    raw_string_ostream Bitcode(Parts[index].Bitcode);
+    WriteBitcodeToFile(P.get(), Bitcode);
+    Bitcode.flush();
+
+    Parts[index].Target = createTargetMachine(errMsg);
+    sys::Path ObjPath("lto-llvm-part.o");
+    if (!Parts[index].Target || ObjPath.createTemporaryFileOnDisk(false,
+                                                                   &errMsg)) {
+      Failed = true;
+      break;
+    }
+    sys::RemoveFileOnSignal(ObjPath);
+    Parts[index].ObjPath = ObjPath.str();
+  }
+
+  // Generate the code of the partitions in parallel.
+  if (!Failed) {
+    if (!llvm_is_multithreaded())
+      llvm_start_multithreaded();
+
+    std::vector<std::thread> Threads;
+    for (unsigned index = 0; index < numPartitions; ++index)
+      Threads.push_back(std::thread(compilePartition, &Parts[index]));
+    for (unsigned index = 0; index < numPartitions; ++index)
+      Threads[index].join();
+
+    for (unsigned index = 0; index < numPartitions && !Failed; ++index) {
+      if (!Parts[index].ErrMsg.empty()) {
+        errMsg = Parts[index].ErrMsg;
+        Failed = true;
+      }
+    }
+  }
+
+  // Combine the object files and copy the result to the output stream.
+  sys::Path CombinedPath("lto-llvm.o");
+  if (!Failed && CombinedPath.createTemporaryFileOnDisk(false, &errMsg))
+    Failed = true;
+  if (!Failed) {
+    sys::RemoveFileOnSignal(CombinedPath);
+    Failed = linkPartitions(Parts, CombinedPath.str(), errMsg);
+  }
+  if (!Failed) {
+    OwningPtr<MemoryBuffer> Combined;
+    if (error_code ec = MemoryBuffer::getFile(CombinedPath.str(), Combined,
+                                              -1, false)) {
+      errMsg = ec.message();
+      Failed = true;
+    } else {
+      out << Combined->getBuffer();
+    }
+  }
+
+  // Remove the temporary files.
+  double codeGenTime = 0;
+  for (unsigned index = 0; index < numPartitions; ++index) {
+    if (!Parts[index].ObjPath.empty())
+      sys::Path(Parts[index].ObjPath).eraseFromDisk();
+    delete Parts[index].Target;
+    codeGenTime += Parts[index].Seconds;
+  }
+  CombinedPath.eraseFromDisk();
+
+  if (Failed)
+    return true;
+
+  if (ReportCodeGenTime) {
+    double wallTime = TimeRecord::getCurrentTime(false).getWallTime() -
+                      startTime;
+    errs() << "SAFECode LTO: generated code for " << numPartitions
+           << " partitions in " << format("%.3f", wallTime) << "s ("
+           << format("%.3f", codeGenTime) << "s of code generation, "
+           << format("%.2f", codeGenTime / wallTime) << "x speedup)\n";
+  }
+
   return false; // success
 }
 
@@ -56,12 +56,16 @@ struct LTOCodeGenerator {
 
 private:
   bool generateObjectFile(llvm::raw_ostream &out, std::string &errMsg);
+  bool generatePartitionedObjectFile(llvm::raw_ostream &out,
+                                     unsigned numPartitions,
+                                     std::string &errMsg);
   void applyScopeRestrictions();
   void applyRestriction(llvm::GlobalValue &GV,
                         std::vector<const char*> &mustPreserveList,
                         llvm::SmallPtrSet<llvm::GlobalValue*, 8> &asmUsed,
                         llvm::Mangler &mangler);
   bool determineTarget(std::string &errMsg);
+  llvm::TargetMachine *createTargetMachine(std::string &errMsg);
 
   typedef llvm::StringMap<uint8_t> StringSet;
 
@@ -0,0 +1,22 @@
+//===- BBACRuntimeBench.cpp - Microbenchmarks of the BBAC run-time --------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file benchmarks the size table of the baggy bounds run-time with
+// accurate checking.  Each object ends with metadata holding its exact size.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BaggyBench.h"
+
+#include "safecode/Runtime/BBMetaData.h"
+
+int
+main (int argc, char ** argv) {
+  return scbench::runBaggySuite ("bbac", sizeof (BBMetaData), argc, argv);
+}
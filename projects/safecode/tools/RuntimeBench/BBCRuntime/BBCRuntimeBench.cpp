@@ -0,0 +1,19 @@
+//===- BBCRuntimeBench.cpp - Microbenchmarks of the baggy bounds run-time -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file benchmarks the size table of the baggy bounds run-time.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BaggyBench.h"
+
+int
+main (int argc, char ** argv) {
+  return scbench::runBaggySuite ("bbc", 0, argc, argv);
+}
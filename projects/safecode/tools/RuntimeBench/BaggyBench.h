@@ -0,0 +1,172 @@
+//===- BaggyBench.h - Benchmarks of the baggy bounds run-times --*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the benchmarks shared by the baggy bounds (BBC) and the
+// baggy bounds with accurate checking (BBAC) run-times.  Both keep the sizes of
+// objects in a table indexed by slot; they differ in whether each object ends
+// with metadata recording its exact size.
+//
+// Objects are aligned to their slot size, as the compiler and the allocator
+// wrappers of the run-times arrange for real programs.  Every entry of the size
+// table belongs to one object, so threads register objects concurrently.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_BAGGYBENCH_H
+#define _SC_BAGGYBENCH_H
+
+#include "BenchHarness.h"
+
+#include "safecode/Runtime/BBRuntime.h"
+
+#include <stdlib.h>
+
+// Smallest slot size of the run-time
+extern unsigned SLOTSIZE;
+
+namespace scbench {
+
+//
+// Function: getSlotSize()
+//
+// Description:
+//  Return the size of the slot that holds an object of the given size along
+//  with MetaDataSize bytes of metadata.
+//
+static inline unsigned
+getSlotSize (unsigned Size, unsigned MetaDataSize) {
+  unsigned SlotSize = SLOTSIZE;
+  while (SlotSize < Size + MetaDataSize)
+    SlotSize <<= 1;
+  return SlotSize;
+}
+
+//
+// Class: BaggyBenchmark
+//
+// Description:
+//  Base class of the benchmarks of the baggy bounds run-times.  It allocates
+//  the objects of the thread and registers them if they are registered before
+//  the timed operations.
+//
+class BaggyBenchmark : public Benchmark {
+  public:
+    BaggyBenchmark (const char * Name,
+                    unsigned MetaDataSize,
+                    bool RegisteredBefore,
+                    bool RegisteredAfter) :
+      Benchmark (Name),
+      MetaDataSize (MetaDataSize),
+      RegisteredBefore (RegisteredBefore),
+      RegisteredAfter (RegisteredAfter) { }
+
+    virtual void setUp (ThreadState & S) {
+      S.Objects.clear();
+      for (unsigned index = 0; index < S.Sizes.size(); ++index) {
+        void * Object;
+        unsigned SlotSize = getSlotSize (S.Sizes[index], MetaDataSize);
+        if (posix_memalign (&Object, SlotSize, SlotSize)) {
+          fprintf (stderr, "posix_memalign failed for %u bytes\n", SlotSize);
+          abort();
+        }
+        S.Objects.push_back ((char *) Object);
+        if (RegisteredBefore)
+          __sc_bb_poolregister (0, Object, S.Sizes[index]);
+      }
+      shuffledTargets (S);
+    }
+
+    virtual void tearDown (ThreadState & S) {
+      for (unsigned index = 0; index < S.Objects.size(); ++index) {
+        if (RegisteredAfter)
+          __sc_bb_poolunregister (0, S.Objects[index]);
+        free (S.Objects[index]);
+      }
+    }
+
+  private:
+    unsigned MetaDataSize;
+    bool RegisteredBefore;
+    bool RegisteredAfter;
+};
+
+class BaggyRegister : public BaggyBenchmark {
+  public:
+    BaggyRegister (unsigned MetaDataSize) :
+      BaggyBenchmark ("register", MetaDataSize, false, true) { }
+    uint64_t run (ThreadState & S) {
+      for (unsigned index = 0; index < S.Objects.size(); ++index)
+        __sc_bb_poolregister (0, S.Objects[index], S.Sizes[index]);
+      return S.Objects.size();
+    }
+};
+
+class BaggyUnregister : public BaggyBenchmark {
+  public:
+    BaggyUnregister (unsigned MetaDataSize) :
+      BaggyBenchmark ("unregister", MetaDataSize, true, false) { }
+    uint64_t run (ThreadState & S) {
+      for (unsigned index = 0; index < S.Objects.size(); ++index)
+        __sc_bb_poolunregister (0, S.Objects[index]);
+      return S.Objects.size();
+    }
+};
+
+class BaggyPoolCheck : public BaggyBenchmark {
+  public:
+    BaggyPoolCheck (unsigned MetaDataSize) :
+      BaggyBenchmark ("poolcheck", MetaDataSize, true, true) { }
+    uint64_t run (ThreadState & S) {
+      for (unsigned index = 0; index < S.Targets.size(); ++index)
+        bb_poolcheck (0, S.Targets[index]);
+      return S.Targets.size();
+    }
+};
+
+class BaggyBoundsCheck : public BaggyBenchmark {
+  public:
+    BaggyBoundsCheck (unsigned MetaDataSize) :
+      BaggyBenchmark ("boundscheck", MetaDataSize, true, true) { }
+    uint64_t run (ThreadState & S) {
+      for (unsigned index = 0; index < S.Objects.size(); ++index)
+        bb_boundscheck (0,
+                        S.Objects[index],
+                        S.Objects[index] + S.Sizes[index] / 2);
+      return S.Objects.size();
+    }
+};
+
+//
+// Function: runBaggySuite()
+//
+// Description:
+//  Entry point of the tools benchmarking the baggy bounds run-times.
+//
+static inline int
+runBaggySuite (const char * Suite,
+               unsigned MetaDataSize,
+               int argc,
+               char ** argv) {
+  pool_init_runtime (0, 0, 1);
+
+  BaggyRegister R (MetaDataSize);
+  BaggyUnregister U (MetaDataSize);
+  BaggyPoolCheck PC (MetaDataSize);
+  BaggyBoundsCheck BC (MetaDataSize);
+  Benchmark * Benchmarks[] = { &R, &U, &PC, &BC };
+  return runSuite (Suite,
+                   Benchmarks,
+                   sizeof (Benchmarks) / sizeof (Benchmarks[0]),
+                   argc,
+                   argv);
+}
+
+}
+
+#endif
@@ -0,0 +1,442 @@
+//===- BenchHarness.h - Driver for the run-time microbenchmarks -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the driver shared by the microbenchmarks of the
+// SAFECode run-time libraries.  Each run-time is benchmarked by its own tool
+// because the run-times define the same symbols and cannot be linked into
+// one program.
+//
+// A benchmark is run for a number of iterations.  Each iteration, every
+// thread prepares its own set of objects (untimed), waits for the other
+// threads, and then performs the timed operations on its objects.  The sizes
+// of the objects are drawn from a configurable distribution.
+//
+// Results are written as one JSON object per line so that runs can be
+// collected and compared by scripts:
+//
+//  {"suite":"dbg","benchmark":"register","objects":10000,"threads":1,
+//   "sizes":"uniform:16-4096","iterations":10,"ops":10000,
+//   "ns_per_op_min":41.2,"ns_per_op_median":42.9,"mops_per_sec":23.3}
+//
+// ns_per_op is the time a thread spends on one operation; mops_per_sec is
+// the throughput of all threads together during the median iteration.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_BENCHHARNESS_H
+#define _SC_BENCHHARNESS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+
+namespace scbench {
+
+//
+// Structure: SizeDistribution
+//
+// Description:
+//  The distribution from which the sizes of the benchmarked objects are drawn.
+//  It is written on the command line as one of:
+//
+//    fixed:N         - every object is N bytes
+//    uniform:MIN-MAX - sizes are uniformly distributed between MIN and MAX
+//    pow2:MIN-MAX    - sizes are powers of two between MIN and MAX
+//
+struct SizeDistribution {
+  enum Kind { Fixed, Uniform, Pow2 };
+
+  Kind Type;
+  unsigned Min;
+  unsigned Max;
+
+  SizeDistribution () : Type (Uniform), Min (16), Max (4096) { }
+
+  bool parse (const char * Spec) {
+    const char * Range = strchr (Spec, ':');
+    if (!Range)
+      return false;
+
+    std::string Name (Spec, Range - Spec);
+    char * End;
+    unsigned long First = strtoul (Range + 1, &End, 10);
+    unsigned long Last = First;
+    if (*End == '-')
+      Last = strtoul (End + 1, &End, 10);
+    if (*End || !First || Last < First || Last > (1u << 30))
+      return false;
+
+    if (Name == "fixed" && First == Last)
+      Type = Fixed;
+    else if (Name == "uniform")
+      Type = Uniform;
+    else if (Name == "pow2")
+      Type = Pow2;
+    else
+      return false;
+
+    Min = First;
+    Max = Last;
+    return true;
+  }
+
+  unsigned sample (std::mt19937 & Rng) const {
+    switch (Type) {
+      case Fixed:
+        return Min;
+      case Uniform:
+        return std::uniform_int_distribution<unsigned> (Min, Max) (Rng);
+      case Pow2: {
+        unsigned Low = 0, High = 0;
+        while ((1u << Low) < Min) ++Low;
+        while ((2u << High) <= Max) ++High;
+        if (High < Low)
+          return Min;
+        return 1u << std::uniform_int_distribution<unsigned> (Low, High) (Rng);
+      }
+    }
+    return Min;
+  }
+
+  std::string str () const {
+    char Buffer[64];
+    if (Type == Fixed)
+      snprintf (Buffer, sizeof (Buffer), "fixed:%u", Min);
+    else
+      snprintf (Buffer, sizeof (Buffer), "%s:%u-%u",
+                (Type == Uniform) ? "uniform" : "pow2", Min, Max);
+    return Buffer;
+  }
+};
+
+//
+// Structure: Options
+//
+// Description:
+//  The parameters of a benchmark run.
+//
+struct Options {
+  unsigned Objects;
+  unsigned Threads;
+  unsigned Iterations;
+  unsigned Warmup;
+  unsigned Seed;
+  SizeDistribution Sizes;
+  std::string Filter;
+  bool List;
+
+  Options () : Objects (10000), Threads (1), Iterations (10), Warmup (1),
+               Seed (1), List (false) { }
+};
+
+//
+// Structure: ThreadState
+//
+// Description:
+//  The state of one benchmark thread.  The sizes of the objects are drawn
+//  once per thread; the objects themselves belong to the benchmark.
+//
+struct ThreadState {
+  unsigned ID;
+  const Options * Opts;
+  std::mt19937 Rng;
+  std::vector<unsigned> Sizes;
+  std::vector<char *> Objects;
+  std::vector<char *> Targets;
+  void * Data;
+
+  ThreadState () : ID (0), Opts (0), Data (0) { }
+};
+
+//
+// Class: Benchmark
+//
+// Description:
+//  A benchmark of one run-time operation.  setUp() and tearDown() run outside
+//  of the timed region in every iteration; run() performs the timed
+//  operations and returns how many it performed.  Benchmarks of run-time state
+//  that is not thread-safe are not concurrent and always use one thread.
+//
+class Benchmark {
+  public:
+    Benchmark (const char * Name, bool Concurrent = true) :
+      Name (Name), Concurrent (Concurrent) { }
+    virtual ~Benchmark () { }
+
+    const char * getName (void) const { return Name; }
+    bool isConcurrent (void) const { return Concurrent; }
+
+    virtual void setUp (ThreadState & S) { }
+    virtual uint64_t run (ThreadState & S) = 0;
+    virtual void tearDown (ThreadState & S) { }
+
+  private:
+    const char * Name;
+    bool Concurrent;
+};
+
+//
+// Function: shuffledTargets()
+//
+// Description:
+//  Fill the list of targets with one pointer into each object, at a random
+//  offset and in a random order, so that lookups do not simply walk the
+//  objects in the order in which they were registered.
+//
+static inline void
+shuffledTargets (ThreadState & S) {
+  S.Targets.clear();
+  for (unsigned index = 0; index < S.Objects.size(); ++index) {
+    unsigned Offset =
+      std::uniform_int_distribution<unsigned> (0, S.Sizes[index] - 1) (S.Rng);
+    S.Targets.push_back (S.Objects[index] + Offset);
+  }
+  std::shuffle (S.Targets.begin(), S.Targets.end(), S.Rng);
+}
+
+//
+// Function: usage()
+//
+// Description:
+//  Print the command line options of a benchmark tool.
+//
+static inline void
+usage (const char * Program) {
+  fprintf (stderr,
+           "usage: %s [options]\n"
+           "  -objects N        objects per thread (default 10000)\n"
+           "  -threads N        threads (default 1)\n"
+           "  -iterations N     timed iterations (default 10)\n"
+           "  -warmup N         untimed iterations (default 1)\n"
+           "  -sizes SPEC       fixed:N, uniform:MIN-MAX or pow2:MIN-MAX\n"
+           "                    (default uniform:16-4096)\n"
+           "  -seed N           random seed (default 1)\n"
+           "  -filter TEXT      only run benchmarks whose name contains TEXT\n"
+           "  -list             list the benchmarks and exit\n",
+           Program);
+}
+
+//
+// Function: parseOptions()
+//
+// Description:
+//  Parse the command line of a benchmark tool.
+//
+// Return value:
+//  true  - The command line is valid.
+//  false - The command line is invalid; usage information has been printed.
+//
+static inline bool
+parseOptions (int argc, char ** argv, Options & Opts) {
+  for (int index = 1; index < argc; ++index) {
+    const char * Arg = argv[index];
+    const char * Value = (index + 1 < argc) ? argv[index + 1] : 0;
+
+    if (!strcmp (Arg, "-list")) {
+      Opts.List = true;
+      continue;
+    }
+
+    if (!Value) {
+      usage (argv[0]);
+      return false;
+    }
+
+    bool Valid = true;
+    unsigned long Number = strtoul (Value, 0, 10);
+    if (!strcmp (Arg, "-objects"))
+      Valid = (Opts.Objects = Number) != 0;
+    else if (!strcmp (Arg, "-threads"))
+      Valid = (Opts.Threads = Number) != 0;
+    else if (!strcmp (Arg, "-iterations"))
+      Valid = (Opts.Iterations = Number) != 0;
+    else if (!strcmp (Arg, "-warmup"))
+      Opts.Warmup = Number;
+    else if (!strcmp (Arg, "-seed"))
+      Opts.Seed = Number;
+    else if (!strcmp (Arg, "-sizes"))
+      Valid = Opts.Sizes.parse (Value);
+    else if (!strcmp (Arg, "-filter"))
+      Opts.Filter = Value;
+    else
+      Valid = false;
+
+    if (!Valid) {
+      fprintf (stderr, "%s: invalid option: %s %s\n", argv[0], Arg, Value);
+      usage (argv[0]);
+      return false;
+    }
+    ++index;
+  }
+
+  return true;
+}
+
+//
+// Function: runIteration()
+//
+// Description:
+//  Run one iteration of the benchmark on all threads.
+//
+// Outputs:
+//  ThreadNs - The total time, in nanoseconds, that the threads spent on the
+//             timed operations.
+//  WallNs   - The time from the first thread starting to the last thread
+//             finishing.
+//
+// Return value:
+//  The number of operations performed by all threads.
+//
+static inline uint64_t
+runIteration (Benchmark & B,
+              std::vector<ThreadState> & States,
+              uint64_t & ThreadNs,
+              uint64_t & WallNs) {
+  typedef std::chrono::steady_clock Clock;
+
+  unsigned NumThreads = States.size();
+  std::vector<Clock::time_point> Start (NumThreads), End (NumThreads);
+  std::vector<uint64_t> Ops (NumThreads);
+  std::atomic<unsigned> Ready (0);
+
+  auto Body = [&] (unsigned ID) {
+    B.setUp (States[ID]);
+
+    //
+    // Start timing only once every thread has its objects ready.
+    //
+    ++Ready;
+    while (Ready.load() < NumThreads)
+      std::this_thread::yield();
+
+    Start[ID] = Clock::now();
+    Ops[ID] = B.run (States[ID]);
+    End[ID] = Clock::now();
+
+    B.tearDown (States[ID]);
+  };
+
+  std::vector<std::thread> Threads;
+  for (unsigned ID = 1; ID < NumThreads; ++ID)
+    Threads.push_back (std::thread (Body, ID));
+  Body (0);
+  for (unsigned index = 0; index < Threads.size(); ++index)
+    Threads[index].join();
+
+  uint64_t TotalOps = 0;
+  ThreadNs = 0;
+  Clock::time_point First = Start[0], Last = End[0];
+  for (unsigned ID = 0; ID < NumThreads; ++ID) {
+    TotalOps += Ops[ID];
+    ThreadNs += std::chrono::duration_cast<std::chrono::nanoseconds>
+                (End[ID] - Start[ID]).count();
+    First = std::min (First, Start[ID]);
+    Last = std::max (Last, End[ID]);
+  }
+  WallNs = std::chrono::duration_cast<std::chrono::nanoseconds>
+           (Last - First).count();
+  return TotalOps;
+}
+
+//
+// Function: runBenchmark()
+//
+// Description:
+//  Run all iterations of one benchmark and print its result.
+//
+static inline void
+runBenchmark (const char * Suite, Benchmark & B, const Options & Opts) {
+  unsigned NumThreads = B.isConcurrent() ? Opts.Threads : 1;
+
+  std::vector<ThreadState> States (NumThreads);
+  for (unsigned ID = 0; ID < NumThreads; ++ID) {
+    States[ID].ID = ID;
+    States[ID].Opts = &Opts;
+    States[ID].Rng.seed (Opts.Seed + ID);
+    for (unsigned index = 0; index < Opts.Objects; ++index)
+      States[ID].Sizes.push_back (Opts.Sizes.sample (States[ID].Rng));
+  }
+
+  uint64_t ThreadNs, WallNs, Ops = 0;
+  for (unsigned index = 0; index < Opts.Warmup; ++index)
+    runIteration (B, States, ThreadNs, WallNs);
+
+  std::vector<std::pair<double, double> > Results;
+  for (unsigned index = 0; index < Opts.Iterations; ++index) {
+    Ops = runIteration (B, States, ThreadNs, WallNs);
+    if (!Ops || !WallNs)
+      continue;
+    Results.push_back (std::make_pair ((double) ThreadNs / Ops,
+                                       (double) Ops * 1000.0 / WallNs));
+  }
+
+  if (Results.empty()) {
+    fprintf (stderr, "%s: %s: no operations performed\n", Suite, B.getName());
+    return;
+  }
+
+  std::sort (Results.begin(), Results.end());
+  const std::pair<double, double> & Median = Results[Results.size() / 2];
+  printf ("{\"suite\":\"%s\",\"benchmark\":\"%s\",\"objects\":%u,"
+          "\"threads\":%u,\"sizes\":\"%s\",\"iterations\":%u,"
+          "\"ops\":%llu,\"ns_per_op_min\":%.2f,\"ns_per_op_median\":%.2f,"
+          "\"mops_per_sec\":%.2f}\n",
+          Suite, B.getName(), Opts.Objects, NumThreads,
+          Opts.Sizes.str().c_str(), (unsigned) Results.size(),
+          (unsigned long long) Ops, Results[0].first, Median.first,
+          Median.second);
+  fflush (stdout);
+}
+
+//
+// Function: runSuite()
+//
+// Description:
+//  Entry point of a benchmark tool: parse the command line and run the
+//  selected benchmarks of the suite.
+//
+// Return value:
+//  The exit status of the tool.
+//
+static inline int
+runSuite (const char * Suite,
+          Benchmark ** Benchmarks,
+          unsigned NumBenchmarks,
+          int argc,
+          char ** argv) {
+  Options Opts;
+  if (!parseOptions (argc, argv, Opts))
+    return 1;
+
+  for (unsigned index = 0; index < NumBenchmarks; ++index) {
+    Benchmark & B = *Benchmarks[index];
+    if (!Opts.Filter.empty() && !strstr (B.getName(), Opts.Filter.c_str()))
+      continue;
+
+    if (Opts.List)
+      printf ("%s\n", B.getName());
+    else
+      runBenchmark (Suite, B, Opts);
+  }
+
+  return 0;
+}
+
+}
+
+#endif
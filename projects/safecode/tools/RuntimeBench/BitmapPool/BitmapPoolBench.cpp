@@ -0,0 +1,46 @@
+//===- BitmapPoolBench.cpp - Microbenchmarks of the bitmap pool allocator -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file benchmarks the bitmap pool allocator used by the SAFECode
+// run-times.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PoolBench.h"
+
+#include "BitmapAllocator.h"
+
+namespace {
+
+struct BitmapAllocator {
+  typedef llvm::BitmapPoolTy PoolTy;
+
+  static void init (PoolTy * Pool, unsigned NodeSize) {
+    poolinit (Pool, NodeSize);
+  }
+
+  static void destroy (PoolTy * Pool) {
+    pooldestroy (Pool);
+  }
+
+  static void * alloc (PoolTy * Pool, unsigned Size) {
+    return poolalloc (Pool, Size);
+  }
+
+  static void free (PoolTy * Pool, void * Node) {
+    poolfree (Pool, Node);
+  }
+};
+
+}
+
+int
+main (int argc, char ** argv) {
+  return scbench::runPoolSuite<BitmapAllocator> ("bitmap", argc, argv);
+}
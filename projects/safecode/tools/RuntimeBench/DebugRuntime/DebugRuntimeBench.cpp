@@ -0,0 +1,476 @@
+//===- DebugRuntimeBench.cpp - Microbenchmarks of the debug run-time ------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file benchmarks the object registry (the splay trees of the pools) of
+// the debug run-time and the checks and string function wrappers that use it.
+//
+// The splay trees are not thread-safe; each thread therefore uses a pool of
+// its own, which is how instrumented programs with thread-local data behave.
+//
+// The vararg benchmarks register the pointer arguments of each call the way
+// instrumented code does: the caller registers them around the call and the
+// callee associates its va_list with them.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BenchHarness.h"
+
+#include "CStdLibSupport.h"
+#include "DebugRuntime.h"
+#include "FuncTargetSet.h"
+
+#include <stdarg.h>
+
+using namespace llvm;
+using namespace scbench;
+
+extern "C" {
+  uint32_t __sc_targetcheck (void * func);
+  void __sc_varegister (va_list ap, uint32_t id);
+  void __sc_vacallregister (void * func, uint32_t argc, ...);
+  void __sc_vacallunregister ();
+}
+
+namespace {
+
+//
+// Class: RegistryBenchmark
+//
+// Description:
+//  Base class of the benchmarks of the debug run-time.  It allocates the
+//  objects of the thread and a pool for them and registers the objects if
+//  they are registered before the timed operations.
+//
+class RegistryBenchmark : public Benchmark {
+  public:
+    RegistryBenchmark (const char * Name, bool RegisteredBefore,
+                       bool RegisteredAfter) :
+      Benchmark (Name),
+      RegisteredBefore (RegisteredBefore),
+      RegisteredAfter (RegisteredAfter) { }
+
+    virtual void setUp (ThreadState & S) {
+      DebugPoolTy * Pool = (DebugPoolTy *) __sc_dbg_newpool (0);
+      S.Data = Pool;
+      S.Objects.clear();
+      for (unsigned index = 0; index < S.Sizes.size(); ++index) {
+        char * Object = (char *) malloc (S.Sizes[index]);
+        memset (Object, 'a', S.Sizes[index]);
+        Object[S.Sizes[index] - 1] = '\0';
+        S.Objects.push_back (Object);
+        if (RegisteredBefore)
+          pool_register (Pool, Object, S.Sizes[index], 0);
+      }
+      shuffledTargets (S);
+    }
+
+    virtual void tearDown (ThreadState & S) {
+      DebugPoolTy * Pool = (DebugPoolTy *) S.Data;
+      for (unsigned index = 0; index < S.Objects.size(); ++index) {
+        if (RegisteredAfter)
+          pool_unregister (Pool, S.Objects[index]);
+        free (S.Objects[index]);
+      }
+      __sc_dbg_pooldestroy (Pool);
+    }
+
+  private:
+    bool RegisteredBefore;
+    bool RegisteredAfter;
+};
+
+class Register : public RegistryBenchmark {
+  public:
+    Register () : RegistryBenchmark ("register", false, true) { }
+    uint64_t run (ThreadState & S) {
+      DebugPoolTy * Pool = (DebugPoolTy *) S.Data;
+      for (unsigned index = 0; index < S.Objects.size(); ++index)
+        pool_register (Pool, S.Objects[index], S.Sizes[index], 0);
+      return S.Objects.size();
+    }
+};
+
+class Unregister : public RegistryBenchmark {
+  public:
+    Unregister () : RegistryBenchmark ("unregister", true, false) { }
+    uint64_t run (ThreadState & S) {
+      DebugPoolTy * Pool = (DebugPoolTy *) S.Data;
+      for (unsigned index = 0; index < S.Objects.size(); ++index)
+        pool_unregister (Pool, S.Objects[index]);
+      return S.Objects.size();
+    }
+};
+
+class PoolCheck : public RegistryBenchmark {
+  public:
+    PoolCheck () : RegistryBenchmark ("poolcheck", true, true) { }
+    uint64_t run (ThreadState & S) {
+      DebugPoolTy * Pool = (DebugPoolTy *) S.Data;
+      for (unsigned index = 0; index < S.Targets.size(); ++index)
+        poolcheck (Pool, S.Targets[index], 1);
+      return S.Targets.size();
+    }
+};
+
+//
+// The debug versions of the check, passed either the debug arguments or an
+// entry of the source location table (see the DebugSiteTable pass).
+//
+class PoolCheckDebug : public RegistryBenchmark {
+  public:
+    PoolCheckDebug (const char * Name, bool UseSite) :
+      RegistryBenchmark (Name, true, true), UseSite (UseSite) { }
+    uint64_t run (ThreadState & S) {
+      static const DebugSiteInfo Site = { 0, 0, "bench" };
+      DebugPoolTy * Pool = (DebugPoolTy *) S.Data;
+      if (UseSite) {
+        for (unsigned index = 0; index < S.Targets.size(); ++index)
+          poolcheck_site (Pool, S.Targets[index], 1, &Site);
+      } else {
+        for (unsigned index = 0; index < S.Targets.size(); ++index)
+          poolcheck_debug (Pool, S.Targets[index], 1, 0, "bench", 0);
+      }
+      return S.Targets.size();
+    }
+
+  private:
+    bool UseSite;
+};
+
+//
+// The objects of this benchmark are not registered with the pool, so each
+// check searches the external objects.  With SCTRACKMALLOCS set, the run-time
+// records the objects as external allocations.
+//
+class PoolCheckExternal : public RegistryBenchmark {
+  public:
+    PoolCheckExternal () :
+      RegistryBenchmark ("poolcheckui_external", false, false) { }
+    uint64_t run (ThreadState & S) {
+      DebugPoolTy * Pool = (DebugPoolTy *) S.Data;
+      for (unsigned index = 0; index < S.Targets.size(); ++index)
+        poolcheckui_debug (Pool, S.Targets[index], 1, 0, "bench", 0);
+      return S.Targets.size();
+    }
+};
+
+class BoundsCheck : public RegistryBenchmark {
+  public:
+    BoundsCheck () : RegistryBenchmark ("boundscheck", true, true) { }
+    uint64_t run (ThreadState & S) {
+      DebugPoolTy * Pool = (DebugPoolTy *) S.Data;
+      for (unsigned index = 0; index < S.Objects.size(); ++index)
+        boundscheck (Pool,
+                     S.Objects[index],
+                     S.Objects[index] + S.Sizes[index] / 2);
+      return S.Objects.size();
+    }
+};
+
+//
+// Class: AllocationPhase
+//
+// Description:
+//  An allocation-heavy phase of a program, such as a parser building a tree:
+//  a function allocates and registers its nodes in a pool of its own, checks
+//  the previous node as it links each new node to it, and destroys the pool.
+//  The region version allocates from a region instead (see
+//  __sc_dbg_poolinit_region()).
+//
+class AllocationPhase : public Benchmark {
+  public:
+    AllocationPhase (const char * Name, bool Region) :
+      Benchmark (Name), Region (Region) { }
+
+    virtual void setUp (ThreadState & S) {
+      S.Objects.assign (S.Sizes.size(), (char *) 0);
+    }
+
+    uint64_t run (ThreadState & S) {
+      DebugPoolTy Pool;
+      if (Region)
+        __sc_dbg_poolinit_region (&Pool, 0, 0);
+      else
+        __sc_dbg_poolinit (&Pool, 0, 0);
+
+      for (unsigned index = 0; index < S.Sizes.size(); ++index) {
+        char * Node;
+        if (Region)
+          Node = (char *) __sc_dbg_poolalloc_region (&Pool, S.Sizes[index]);
+        else
+          Node = (char *) poolalloc (&Pool, S.Sizes[index]);
+        pool_register_debug (&Pool, Node, S.Sizes[index], 0, 0, "bench", 0);
+        S.Objects[index] = Node;
+
+        if (index && (S.Sizes[index - 1] >= sizeof (char *))) {
+          char * Previous = S.Objects[index - 1];
+          poolcheck (&Pool, Previous, sizeof (char *));
+          *(char **) Previous = Node;
+        }
+      }
+
+      if (Region)
+        __sc_dbg_pooldestroy_region (&Pool);
+      else
+        __sc_dbg_pooldestroy (&Pool);
+      return S.Sizes.size();
+    }
+
+  private:
+    bool Region;
+};
+
+//
+// The exact check benchmarks check a pointer into the middle of each object;
+// they do not use the object registry.
+//
+class ExactCheck2 : public RegistryBenchmark {
+  public:
+    ExactCheck2 () : RegistryBenchmark ("exactcheck2", false, false) { }
+    uint64_t run (ThreadState & S) {
+      for (unsigned index = 0; index < S.Objects.size(); ++index)
+        exactcheck2 (S.Objects[index],
+                     S.Objects[index],
+                     S.Objects[index] + S.Sizes[index] / 2,
+                     S.Sizes[index]);
+      return S.Objects.size();
+    }
+};
+
+class FastLSCheck : public RegistryBenchmark {
+  public:
+    FastLSCheck () : RegistryBenchmark ("fastlscheck", false, false) { }
+    uint64_t run (ThreadState & S) {
+      for (unsigned index = 0; index < S.Objects.size(); ++index)
+        fastlscheck (S.Objects[index],
+                     S.Objects[index] + S.Sizes[index] / 2,
+                     S.Sizes[index],
+                     S.Sizes[index] / 4);
+      return S.Objects.size();
+    }
+};
+
+//
+// The string benchmarks copy each object into the following one; the objects
+// hold strings of their own length minus one.
+//
+//
+// Class: FuncCheck
+//
+// Description:
+//  The check on an indirect call with the specified number of targets, using
+//  either the list of targets (funccheck()) or the hashed target set that the
+//  compiler emits for calls with more than a few targets.  The calls cycle
+//  through the targets, so the list is scanned half way on average.
+//
+class FuncCheck : public Benchmark {
+  public:
+    FuncCheck (const char * Name, unsigned NumTargets, bool Hashed) :
+      Benchmark (Name), NumTargets (NumTargets), Hashed (Hashed) { }
+
+    virtual void setUp (ThreadState & S) {
+      unsigned NumSlots = 1;
+      while (NumSlots < 2 * NumTargets)
+        NumSlots *= 2;
+
+      TargetState * T = new TargetState;
+      T->Code.resize (16 * NumTargets);
+      T->List.resize (NumTargets + 1, 0);
+      T->Slots.resize (NumSlots, 0);
+      for (unsigned index = 0; index < NumTargets; ++index)
+        T->List[index] = &T->Code[16 * index];
+      T->Set.mask = NumSlots - 1;
+      T->Set.slots = &T->Slots[0];
+      T->Set.count = NumTargets;
+      T->Set.targets = &T->List[0];
+      T->Set.ready = 0;
+      funccheck_hashed_init (&T->Set);
+      S.Data = T;
+    }
+
+    uint64_t run (ThreadState & S) {
+      TargetState * T = (TargetState *) S.Data;
+      unsigned Target = 0;
+      for (unsigned index = 0; index < S.Sizes.size(); ++index) {
+        if (Hashed)
+          funccheck_hashed (T->List[Target], &T->Set);
+        else
+          funccheck (T->List[Target], &T->List[0]);
+        if (++Target == NumTargets)
+          Target = 0;
+      }
+      return S.Sizes.size();
+    }
+
+    virtual void tearDown (ThreadState & S) {
+      delete (TargetState *) S.Data;
+    }
+
+  private:
+    struct TargetState {
+      std::vector<char> Code;
+      std::vector<void *> List;
+      std::vector<void *> Slots;
+      FuncTargetSet Set;
+    };
+
+    unsigned NumTargets;
+    bool Hashed;
+};
+
+class StrLen : public RegistryBenchmark {
+  public:
+    StrLen () : RegistryBenchmark ("strlen", true, true) { }
+    uint64_t run (ThreadState & S) {
+      DebugPoolTy * Pool = (DebugPoolTy *) S.Data;
+      volatile size_t Length;
+      for (unsigned index = 0; index < S.Objects.size(); ++index)
+        Length = pool_strlen (Pool, S.Objects[index], 0x1);
+      return S.Objects.size();
+    }
+};
+
+class StrCpy : public RegistryBenchmark {
+  public:
+    StrCpy () : RegistryBenchmark ("strcpy", true, true) { }
+    uint64_t run (ThreadState & S) {
+      DebugPoolTy * Pool = (DebugPoolTy *) S.Data;
+      uint64_t Ops = 0;
+      for (unsigned index = 1; index < S.Objects.size(); ++index) {
+        if (S.Sizes[index - 1] > S.Sizes[index])
+          continue;
+        pool_strcpy (Pool, Pool, S.Objects[index], S.Objects[index - 1], 0x3);
+        ++Ops;
+      }
+      return Ops;
+    }
+};
+
+class MemCpy : public RegistryBenchmark {
+  public:
+    MemCpy () : RegistryBenchmark ("memcpy", true, true) { }
+    uint64_t run (ThreadState & S) {
+      DebugPoolTy * Pool = (DebugPoolTy *) S.Data;
+      for (unsigned index = 1; index < S.Objects.size(); ++index) {
+        size_t Length = std::min (S.Sizes[index - 1], S.Sizes[index]);
+        pool_memcpy (Pool, Pool, S.Objects[index], S.Objects[index - 1],
+                     Length, 0x3);
+      }
+      return S.Objects.size() - 1;
+    }
+};
+
+
+//
+// Function: sumPointers()
+//
+// Description:
+//  A vararg function of the program that reads the pointers passed to it.
+//
+static uintptr_t
+sumPointers (unsigned Count, ...) {
+  va_list ap;
+  va_start (ap, Count);
+  __sc_varegister (ap, __sc_targetcheck ((void *) &sumPointers));
+  uintptr_t Sum = 0;
+  for (unsigned index = 0; index < Count; ++index)
+    Sum += (uintptr_t) va_arg (ap, char *);
+  va_end (ap);
+  return Sum;
+}
+
+//
+// Function: formatObject()
+//
+// Description:
+//  A wrapper of vsnprintf() in the program, as instrumented by SAFECode.
+//
+static int
+formatObject (DebugPoolTy * Pool, char * Str, size_t Size, const char * Fmt,
+              ...) {
+  va_list ap;
+  va_start (ap, Fmt);
+  __sc_varegister (ap, __sc_targetcheck ((void *) &formatObject));
+  int Result = pool_vsnprintf (Pool, Pool, Str, (char *) Fmt, Size, ap, 0x1);
+  va_end (ap);
+  return Result;
+}
+
+class VarArgCall : public RegistryBenchmark {
+  public:
+    VarArgCall () : RegistryBenchmark ("vararg_call", true, true) { }
+    uint64_t run (ThreadState & S) {
+      volatile uintptr_t Sum = 0;
+      for (unsigned index = 2; index < S.Objects.size(); ++index) {
+        char * A = S.Objects[index - 2];
+        char * B = S.Objects[index - 1];
+        char * C = S.Objects[index];
+        __sc_vacallregister ((void *) &sumPointers, 4, A, B, C, (void *) 0);
+        Sum += sumPointers (3, A, B, C);
+        __sc_vacallunregister ();
+      }
+      return S.Objects.size() - 2;
+    }
+};
+
+class VSNPrintf : public RegistryBenchmark {
+  public:
+    VSNPrintf () : RegistryBenchmark ("vsnprintf", true, true) { }
+    uint64_t run (ThreadState & S) {
+      DebugPoolTy * Pool = (DebugPoolTy *) S.Data;
+      for (unsigned index = 1; index < S.Objects.size(); ++index) {
+        char * Str = S.Objects[index];
+        char * Arg = S.Objects[index - 1];
+        size_t Size = std::min<size_t> (S.Sizes[index], 32);
+        __sc_vacallregister ((void *) &formatObject, 6,
+                             Pool, Str, Arg, (void *) 0);
+        formatObject (Pool, Str, Size, "%.8s:%u", Arg, index);
+        __sc_vacallunregister ();
+      }
+      return S.Objects.size() - 1;
+    }
+};
+
+}
+
+int
+main (int argc, char ** argv) {
+  pool_init_runtime (0, 0, 1);
+
+  Register R;
+  Unregister U;
+  PoolCheck PC;
+  PoolCheckExternal PE;
+  PoolCheckDebug PD ("poolcheck_debug", false);
+  PoolCheckDebug PS ("poolcheck_site", true);
+  BoundsCheck BC;
+  ExactCheck2 EC;
+  FastLSCheck FC;
+  FuncCheck FL5 ("funccheck_5", 5, false);
+  FuncCheck FH5 ("funccheck_hashed_5", 5, true);
+  FuncCheck FL16 ("funccheck_16", 16, false);
+  FuncCheck FH16 ("funccheck_hashed_16", 16, true);
+  FuncCheck FL64 ("funccheck_64", 64, false);
+  FuncCheck FH64 ("funccheck_hashed_64", 64, true);
+  StrLen SL;
+  StrCpy SC;
+  MemCpy MC;
+  VarArgCall VC;
+  VSNPrintf VP;
+  AllocationPhase AP ("alloc_phase", false);
+  AllocationPhase AR ("alloc_phase_region", true);
+  Benchmark * Benchmarks[] = { &R, &U, &PC, &PD, &PS, &PE, &BC, &EC, &FC,
+                                 &FL5, &FH5, &FL16, &FH16, &FL64, &FH64,
+                                 &SL, &SC, &MC, &VC, &VP, &AP, &AR };
+  return runSuite ("dbg",
+                   Benchmarks,
+                   sizeof (Benchmarks) / sizeof (Benchmarks[0]),
+                   argc,
+                   argv);
+}
@@ -0,0 +1,274 @@
+//===- FL2PoolBench.cpp - Microbenchmarks of the FL2 pool allocator -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file benchmarks the free list allocator (FL2) of the pool allocation
+// run-time, along with linked lists and binary search trees built in its
+// pools with native pointers, with nodes taken from batches (as the pool
+// optimizer arranges for loops), and with the 32-bit indices of pointer
+// compressed pools.
+//
+// The pointer compressed pools of a process share a few address ranges, so
+// the tree benchmarks are not concurrent.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PoolBench.h"
+
+#include "PoolAllocator.h"
+
+using namespace scbench;
+
+namespace {
+
+struct FL2Allocator {
+  typedef ::PoolTy<NormalPoolTraits> PoolTy;
+
+  static void init (PoolTy * Pool, unsigned NodeSize) {
+    poolinit (Pool, NodeSize, 0);
+  }
+
+  static void destroy (PoolTy * Pool) {
+    pooldestroy (Pool);
+  }
+
+  static void * alloc (PoolTy * Pool, unsigned Size) {
+    return poolalloc (Pool, Size);
+  }
+
+  static void free (PoolTy * Pool, void * Node) {
+    poolfree (Pool, Node);
+  }
+};
+
+//
+// Struct: NativeTree
+//
+// Description:
+//  A binary search tree whose nodes point to their children.
+//
+struct NativeTree {
+  struct Node {
+    long Key;
+    Node * Left;
+    Node * Right;
+  };
+  typedef Node * Ref;
+
+  PoolTy<NormalPoolTraits> Pool;
+
+  void init (void) { poolinit (&Pool, sizeof (Node), 0); }
+  void destroy (void) { pooldestroy (&Pool); }
+  void reserve (unsigned Count) { }
+  void release (void) { }
+  Ref alloc (void) { return (Ref) poolalloc (&Pool, sizeof (Node)); }
+  Node * get (Ref R) { return R; }
+};
+
+//
+// Struct: BatchedTree
+//
+// Description:
+//  A NativeTree whose nodes are taken from a batch started before each loop,
+//  as the pool optimizer rewrites the poolalloc calls of loops.
+//
+struct BatchedTree : public NativeTree {
+  PoolBatch Batch;
+
+  void reserve (unsigned Count) {
+    poolalloc_n (&Pool, sizeof (Node), Count, &Batch);
+  }
+  void release (void) { poolfree_n (&Pool, &Batch); }
+  Ref alloc (void) {
+    if (Batch.Next == Batch.End)
+      return (Ref) poolalloc_refill (&Pool, sizeof (Node), &Batch);
+    Ref R = (Ref) Batch.Next;
+    Batch.Next += Batch.Stride;
+    return R;
+  }
+};
+
+//
+// Struct: CompressedTree
+//
+// Description:
+//  A binary search tree whose nodes record the indices of their children in a
+//  pointer compressed pool, as the PointerCompress pass rewrites NativeTree.
+//
+struct CompressedTree {
+  struct Node {
+    long Key;
+    unsigned Left;
+    unsigned Right;
+  };
+  typedef unsigned Ref;
+
+  PoolTy<CompressedPoolTraits> Pool;
+  char * Base;
+
+  void init (void) { Base = (char *) poolinit_pc (&Pool, sizeof (Node), 0); }
+  void destroy (void) { pooldestroy_pc (&Pool); }
+  void reserve (unsigned Count) { }
+  void release (void) { }
+  Ref alloc (void) { return poolalloc_pc (&Pool, sizeof (Node)); }
+  Node * get (Ref R) { return (Node *) (Base + R); }
+};
+
+//
+// Class: TreeBenchmark
+//
+// Description:
+//  Base class of the list and tree benchmarks.  Each thread inserts one random
+//  key per object into a tree; the tree is built before the timed operations
+//  if they search it.
+//
+template<class Tree>
+class TreeBenchmark : public Benchmark {
+  public:
+    typedef typename Tree::Node Node;
+    typedef typename Tree::Ref Ref;
+
+    struct State {
+      Tree T;
+      Ref Root;
+      std::vector<long> Keys;
+    };
+
+    TreeBenchmark (const char * Name, bool BuiltBefore) :
+      Benchmark (Name, false), BuiltBefore (BuiltBefore) { }
+
+    virtual void setUp (ThreadState & S) {
+      State * TS = new State();
+      TS->T.init();
+      TS->Root = 0;
+      for (unsigned index = 0; index < S.Sizes.size(); ++index)
+        TS->Keys.push_back (S.Rng());
+      S.Data = TS;
+
+      if (BuiltBefore) {
+        build (*TS);
+        std::shuffle (TS->Keys.begin(), TS->Keys.end(), S.Rng);
+      }
+    }
+
+    virtual void tearDown (ThreadState & S) {
+      State * TS = (State *) S.Data;
+      TS->T.destroy();
+      delete TS;
+    }
+
+  protected:
+    static void build (State & TS) {
+      TS.T.reserve (TS.Keys.size());
+      for (unsigned index = 0; index < TS.Keys.size(); ++index) {
+        Ref N = TS.T.alloc();
+        Node * NP = TS.T.get (N);
+        NP->Key = TS.Keys[index];
+        NP->Left = NP->Right = 0;
+
+        Ref * Link = &TS.Root;
+        while (*Link) {
+          Node * Parent = TS.T.get (*Link);
+          Link = (NP->Key < Parent->Key) ? &Parent->Left : &Parent->Right;
+        }
+        *Link = N;
+      }
+      TS.T.release();
+    }
+
+  private:
+    bool BuiltBefore;
+};
+
+template<class Tree>
+class TreeBuild : public TreeBenchmark<Tree> {
+  public:
+    typedef typename TreeBenchmark<Tree>::State State;
+    TreeBuild (const char * Name) : TreeBenchmark<Tree> (Name, false) { }
+    uint64_t run (ThreadState & S) {
+      State * TS = (State *) S.Data;
+      TreeBenchmark<Tree>::build (*TS);
+      return TS->Keys.size();
+    }
+};
+
+//
+// Each key is pushed on the front of a list, which makes building the list
+// little more than allocating its nodes.
+//
+template<class Tree>
+class ListBuild : public TreeBenchmark<Tree> {
+  public:
+    typedef typename TreeBenchmark<Tree>::State State;
+    typedef typename Tree::Node Node;
+    typedef typename Tree::Ref Ref;
+    ListBuild (const char * Name) : TreeBenchmark<Tree> (Name, false) { }
+    uint64_t run (ThreadState & S) {
+      State * TS = (State *) S.Data;
+      TS->T.reserve (TS->Keys.size());
+      for (unsigned index = 0; index < TS->Keys.size(); ++index) {
+        Ref N = TS->T.alloc();
+        Node * NP = TS->T.get (N);
+        NP->Key = TS->Keys[index];
+        NP->Left = TS->Root;
+        NP->Right = 0;
+        TS->Root = N;
+      }
+      TS->T.release();
+      return TS->Keys.size();
+    }
+};
+
+template<class Tree>
+class TreeWalk : public TreeBenchmark<Tree> {
+  public:
+    typedef typename TreeBenchmark<Tree>::State State;
+    typedef typename Tree::Node Node;
+    typedef typename Tree::Ref Ref;
+    TreeWalk (const char * Name) : TreeBenchmark<Tree> (Name, true) { }
+    uint64_t run (ThreadState & S) {
+      State * TS = (State *) S.Data;
+      volatile unsigned Found = 0;
+      for (unsigned index = 0; index < TS->Keys.size(); ++index) {
+        long Key = TS->Keys[index];
+        Ref R = TS->Root;
+        while (R) {
+          Node * N = TS->T.get (R);
+          if (N->Key == Key) {
+            ++Found;
+            break;
+          }
+          R = (Key < N->Key) ? N->Left : N->Right;
+        }
+      }
+      return TS->Keys.size();
+    }
+};
+
+}
+
+int
+main (int argc, char ** argv) {
+  PoolAlloc<FL2Allocator> A;
+  PoolFree<FL2Allocator> F;
+  PoolRealloc<FL2Allocator> AF;
+  ListBuild<NativeTree> LB ("list_build");
+  ListBuild<BatchedTree> LBN ("list_build_n");
+  TreeBuild<NativeTree> TB ("tree_build");
+  TreeBuild<BatchedTree> TBN ("tree_build_n");
+  TreeWalk<NativeTree> TW ("tree_walk");
+  TreeBuild<CompressedTree> TBC ("tree_build_pc");
+  TreeWalk<CompressedTree> TWC ("tree_walk_pc");
+  Benchmark * Benchmarks[] = { &A, &F, &AF, &LB, &LBN, &TB, &TBN, &TW, &TBC,
+                               &TWC };
+  return runSuite ("fl2",
+                   Benchmarks,
+                   sizeof (Benchmarks) / sizeof (Benchmarks[0]),
+                   argc,
+                   argv);
+}
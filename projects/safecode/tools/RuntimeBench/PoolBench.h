@@ -0,0 +1,153 @@
+//===- PoolBench.h - Microbenchmarks of the pool allocators -----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the benchmarks shared by the pool allocators (the FL2
+// allocator of the pool allocation run-time and the bitmap allocator of
+// SAFECode).  The allocators are described by a traits class:
+//
+//  struct Allocator {
+//    typedef ... PoolTy;
+//    static void init (PoolTy * Pool, unsigned NodeSize);
+//    static void destroy (PoolTy * Pool);
+//    static void * alloc (PoolTy * Pool, unsigned Size);
+//    static void free (PoolTy * Pool, void * Node);
+//  };
+//
+// Each thread allocates from a pool of its own.  The node size of the pools is
+// the smallest size of the distribution.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _SC_POOLBENCH_H
+#define _SC_POOLBENCH_H
+
+#include "BenchHarness.h"
+
+namespace scbench {
+
+//
+// Class: PoolBenchmark
+//
+// Description:
+//  Base class of the benchmarks of a pool allocator.  It creates the pool of
+//  the thread and fills it with objects if the objects are allocated before
+//  the timed operations.
+//
+template<class Allocator>
+class PoolBenchmark : public Benchmark {
+  public:
+    typedef typename Allocator::PoolTy PoolTy;
+
+    PoolBenchmark (const char * Name, bool AllocatedBefore, bool AllocatedAfter) :
+      Benchmark (Name),
+      AllocatedBefore (AllocatedBefore),
+      AllocatedAfter (AllocatedAfter) { }
+
+    virtual void setUp (ThreadState & S) {
+      PoolTy * Pool = new PoolTy();
+      Allocator::init (Pool, S.Opts->Sizes.Min);
+      S.Data = Pool;
+
+      S.Objects.clear();
+      if (AllocatedBefore) {
+        for (unsigned index = 0; index < S.Sizes.size(); ++index)
+          S.Objects.push_back ((char *) Allocator::alloc (Pool, S.Sizes[index]));
+        std::shuffle (S.Objects.begin(), S.Objects.end(), S.Rng);
+      }
+    }
+
+    virtual void tearDown (ThreadState & S) {
+      PoolTy * Pool = (PoolTy *) S.Data;
+      if (AllocatedAfter) {
+        for (unsigned index = 0; index < S.Objects.size(); ++index)
+          Allocator::free (Pool, S.Objects[index]);
+      }
+      Allocator::destroy (Pool);
+      delete Pool;
+    }
+
+  private:
+    bool AllocatedBefore;
+    bool AllocatedAfter;
+};
+
+template<class Allocator>
+class PoolAlloc : public PoolBenchmark<Allocator> {
+  public:
+    typedef typename Allocator::PoolTy PoolTy;
+    PoolAlloc () : PoolBenchmark<Allocator> ("alloc", false, true) { }
+    uint64_t run (ThreadState & S) {
+      PoolTy * Pool = (PoolTy *) S.Data;
+      for (unsigned index = 0; index < S.Sizes.size(); ++index)
+        S.Objects.push_back ((char *) Allocator::alloc (Pool, S.Sizes[index]));
+      return S.Sizes.size();
+    }
+};
+
+//
+// Objects are freed in random order, which is harder on the free lists than
+// freeing them in the order in which they were allocated.
+//
+template<class Allocator>
+class PoolFree : public PoolBenchmark<Allocator> {
+  public:
+    typedef typename Allocator::PoolTy PoolTy;
+    PoolFree () : PoolBenchmark<Allocator> ("free", true, false) { }
+    uint64_t run (ThreadState & S) {
+      PoolTy * Pool = (PoolTy *) S.Data;
+      for (unsigned index = 0; index < S.Objects.size(); ++index)
+        Allocator::free (Pool, S.Objects[index]);
+      return S.Objects.size();
+    }
+};
+
+//
+// Each object is replaced by a new object of the size of the next one, so
+// that freed memory is reused for objects of other sizes.
+//
+template<class Allocator>
+class PoolRealloc : public PoolBenchmark<Allocator> {
+  public:
+    typedef typename Allocator::PoolTy PoolTy;
+    PoolRealloc () : PoolBenchmark<Allocator> ("alloc_free", true, true) { }
+    uint64_t run (ThreadState & S) {
+      PoolTy * Pool = (PoolTy *) S.Data;
+      unsigned Count = S.Objects.size();
+      for (unsigned index = 0; index < Count; ++index) {
+        Allocator::free (Pool, S.Objects[index]);
+        S.Objects[index] = (char *) Allocator::alloc (Pool,
+                                                      S.Sizes[(index + 1) % Count]);
+      }
+      return 2 * Count;
+    }
+};
+
+//
+// Function: runPoolSuite()
+//
+// Description:
+//  Entry point of the tools benchmarking the pool allocators.
+//
+template<class Allocator>
+static inline int
+runPoolSuite (const char * Suite, int argc, char ** argv) {
+  PoolAlloc<Allocator> A;
+  PoolFree<Allocator> F;
+  PoolRealloc<Allocator> AF;
+  Benchmark * Benchmarks[] = { &A, &F, &AF };
+  return runSuite (Suite,
+                   Benchmarks,
+                   sizeof (Benchmarks) / sizeof (Benchmarks[0]),
+                   argc,
+                   argv);
+}
+
+}
+
+#endif
@@ -0,0 +1,107 @@
+/*===- SoftBoundOps.c - SoftBound operations for the microbenchmarks ------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The SoftBound+CETS run-time implements its metadata operations as inline
+// functions in a C header.  This file wraps the operations measured by the
+// benchmarks in functions that the C++ benchmark driver can call; the
+// operations themselves are still inlined as they are into instrumented code.
+//
+//===----------------------------------------------------------------------===*/
+
+#include "softboundcets.h"
+
+#include "SoftBoundOps.h"
+
+void
+scbench_metadata_store (void * addr_of_ptr,
+                        void * base,
+                        void * bound,
+                        size_t key,
+                        void * lock) {
+  __softboundcets_metadata_store (addr_of_ptr, base, bound, key, lock);
+}
+
+uintptr_t
+scbench_metadata_load (void * addr_of_ptr) {
+  void * base;
+  void * bound;
+  size_t key;
+  void * lock;
+  __softboundcets_metadata_load (addr_of_ptr, &base, &bound, &key, &lock);
+  return (uintptr_t) base + (uintptr_t) bound + key + (uintptr_t) lock;
+}
+
+/*
+ * The metadata accesses that the SoftBoundCETS pass expands inline with
+ * -softboundcets_inline_metadata: index the trie directly and call the
+ * run-time only when the secondary table is missing.
+ */
+void
+scbench_metadata_store_inline (void * addr_of_ptr,
+                               void * base,
+                               void * bound,
+                               size_t key,
+                               void * lock) {
+  size_t ptr = (size_t) addr_of_ptr;
+  __softboundcets_trie_entry_t * secondary =
+    __softboundcets_trie_primary_table[ptr >> __SOFTBOUNDCETS_TRIE_PRIMARY_SHIFT];
+  __softboundcets_trie_entry_t * entry;
+
+  if (secondary == NULL) {
+    __softboundcets_metadata_store (addr_of_ptr, base, bound, key, lock);
+    return;
+  }
+
+  entry = &secondary[(ptr >> 3) & (__SOFTBOUNDCETS_TRIE_SECONDARY_TABLE_ENTRIES - 1)];
+  entry->base = base;
+  entry->bound = bound;
+  entry->key = key;
+  entry->lock = lock;
+}
+
+uintptr_t
+scbench_metadata_load_inline (void * addr_of_ptr) {
+  size_t ptr = (size_t) addr_of_ptr;
+  __softboundcets_trie_entry_t * secondary =
+    __softboundcets_trie_primary_table[ptr >> __SOFTBOUNDCETS_TRIE_PRIMARY_SHIFT];
+  __softboundcets_trie_entry_t * entry;
+
+  if (secondary == NULL)
+    return scbench_metadata_load (addr_of_ptr);
+
+  entry = &secondary[(ptr >> 3) & (__SOFTBOUNDCETS_TRIE_SECONDARY_TABLE_ENTRIES - 1)];
+  return (uintptr_t) entry->base + (uintptr_t) entry->bound +
+         entry->key + (uintptr_t) entry->lock;
+}
+
+/*
+ * Pass the metadata of two pointer arguments through the shadow stack, as a
+ * call to a function with two pointer arguments does.
+ */
+uintptr_t
+scbench_shadow_stack_call (void * base, void * bound, size_t key, void * lock) {
+  uintptr_t sum = 0;
+  int arg;
+
+  __softboundcets_allocate_shadow_stack_space (2);
+  for (arg = 0; arg < 2; ++arg) {
+    __softboundcets_store_base_shadow_stack (base, arg);
+    __softboundcets_store_bound_shadow_stack (bound, arg);
+    __softboundcets_store_key_shadow_stack (key, arg);
+    __softboundcets_store_lock_shadow_stack (lock, arg);
+  }
+  for (arg = 0; arg < 2; ++arg) {
+    sum += (uintptr_t) __softboundcets_load_base_shadow_stack (arg);
+    sum += (uintptr_t) __softboundcets_load_bound_shadow_stack (arg);
+    sum += __softboundcets_load_key_shadow_stack (arg);
+    sum += (uintptr_t) __softboundcets_load_lock_shadow_stack (arg);
+  }
+  __softboundcets_deallocate_shadow_stack_space ();
+  return sum;
+}
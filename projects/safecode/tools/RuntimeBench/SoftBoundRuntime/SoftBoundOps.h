@@ -0,0 +1,33 @@
+/*===- SoftBoundOps.h - SoftBound operations for the microbenchmarks ------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===*/
+
+#ifndef _SC_SOFTBOUNDOPS_H
+#define _SC_SOFTBOUNDOPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void scbench_metadata_store (void * addr_of_ptr, void * base, void * bound,
+                             size_t key, void * lock);
+uintptr_t scbench_metadata_load (void * addr_of_ptr);
+void scbench_metadata_store_inline (void * addr_of_ptr, void * base,
+                                    void * bound, size_t key, void * lock);
+uintptr_t scbench_metadata_load_inline (void * addr_of_ptr);
+uintptr_t scbench_shadow_stack_call (void * base, void * bound,
+                                     size_t key, void * lock);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+//===- SoftBoundRuntimeBench.cpp - Microbenchmarks of SoftBound+CETS ------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file benchmarks the metadata trie and the shadow stack of the
+// SoftBound+CETS run-time.  The operations are called through the wrappers of
+// SoftBoundOps.c because the header of the run-time is C only.
+//
+// The run-time defines main() and calls softboundcets_pseudo_main() once it
+// has initialized itself.  Its state is global, so the benchmarks always use
+// one thread.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BenchHarness.h"
+
+#include "SoftBoundOps.h"
+
+using namespace scbench;
+
+namespace {
+
+//
+// Class: MetadataBenchmark
+//
+// Description:
+//  Base class of the benchmarks of the metadata trie.  Each object holds a
+//  pointer to the next object; the metadata of that pointer is stored in the
+//  trie if it is stored before the timed operations.
+//
+class MetadataBenchmark : public Benchmark {
+  public:
+    MetadataBenchmark (const char * Name, bool Stored, bool Inline = false) :
+      Benchmark (Name, false), Stored (Stored), Inline (Inline) { }
+
+    virtual void setUp (ThreadState & S) {
+      S.Objects.clear();
+      for (unsigned index = 0; index < S.Sizes.size(); ++index) {
+        unsigned Size = std::max (S.Sizes[index], (unsigned) sizeof (void *));
+        S.Objects.push_back ((char *) malloc (Size));
+      }
+
+      for (unsigned index = 0; index < S.Objects.size(); ++index) {
+        unsigned Next = (index + 1) % S.Objects.size();
+        *((char **) S.Objects[index]) = S.Objects[Next];
+        if (Stored)
+          store (S, index);
+      }
+    }
+
+    virtual void tearDown (ThreadState & S) {
+      for (unsigned index = 0; index < S.Objects.size(); ++index)
+        free (S.Objects[index]);
+    }
+
+  protected:
+    void store (ThreadState & S, unsigned index) {
+      unsigned Next = (index + 1) % S.Objects.size();
+      char * Target = S.Objects[Next];
+      if (Inline)
+        scbench_metadata_store_inline (S.Objects[index],
+                                       Target,
+                                       Target + S.Sizes[Next],
+                                       index + 1,
+                                       Target);
+      else
+        scbench_metadata_store (S.Objects[index],
+                                Target,
+                                Target + S.Sizes[Next],
+                                index + 1,
+                                Target);
+    }
+
+    bool Inline;
+
+  private:
+    bool Stored;
+};
+
+//
+// The metadata benchmarks call the run-time functions, as instrumented code
+// does by default, or use the trie lookup that the compiler expands inline
+// with -softboundcets_inline_metadata.
+//
+class MetadataStore : public MetadataBenchmark {
+  public:
+    MetadataStore (const char * Name, bool Inline) :
+      MetadataBenchmark (Name, false, Inline) { }
+    uint64_t run (ThreadState & S) {
+      for (unsigned index = 0; index < S.Objects.size(); ++index)
+        store (S, index);
+      return S.Objects.size();
+    }
+};
+
+class MetadataLoad : public MetadataBenchmark {
+  public:
+    MetadataLoad (const char * Name, bool Inline) :
+      MetadataBenchmark (Name, true, Inline) { }
+    uint64_t run (ThreadState & S) {
+      volatile uintptr_t Sum;
+      for (unsigned index = 0; index < S.Objects.size(); ++index) {
+        if (Inline)
+          Sum = scbench_metadata_load_inline (S.Objects[index]);
+        else
+          Sum = scbench_metadata_load (S.Objects[index]);
+      }
+      return S.Objects.size();
+    }
+};
+
+class ShadowStack : public MetadataBenchmark {
+  public:
+    ShadowStack () : MetadataBenchmark ("shadow_stack", false) { }
+    uint64_t run (ThreadState & S) {
+      volatile uintptr_t Sum;
+      for (unsigned index = 0; index < S.Objects.size(); ++index) {
+        char * Object = S.Objects[index];
+        Sum = scbench_shadow_stack_call (Object,
+                                         Object + S.Sizes[index],
+                                         index + 1,
+                                         Object);
+      }
+      return S.Objects.size();
+    }
+};
+
+}
+
+extern "C" int
+softboundcets_pseudo_main (int argc, char ** argv) {
+  MetadataStore MS ("metadata_store", false);
+  MetadataLoad ML ("metadata_load", false);
+  MetadataStore MSI ("metadata_store_inline", true);
+  MetadataLoad MLI ("metadata_load_inline", true);
+  ShadowStack SS;
+  Benchmark * Benchmarks[] = { &MS, &ML, &MSI, &MLI, &SS };
+  return runSuite ("softbound",
+                   Benchmarks,
+                   sizeof (Benchmarks) / sizeof (Benchmarks[0]),
+                   argc,
+                   argv);
+}
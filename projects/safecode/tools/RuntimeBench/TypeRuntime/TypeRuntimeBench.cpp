@@ -0,0 +1,259 @@
+//===- TypeRuntimeBench.cpp - Microbenchmarks of the type-check run-time --===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file benchmarks the shadow memory of the dynamic type-check run-time
+// of poolalloc: the generic and size-specialized entry points, and the fast
+// paths that TypeChecksOpt inlines into programs in their place.  The inline
+// versions below follow the code that TypeChecksOpt emits.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BenchHarness.h"
+
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t TypeTagTy;
+
+extern "C" {
+  void shadowInit (void);
+  void trackStoreInst (void *, TypeTagTy, uint64_t, uint32_t);
+  void trackStoreInst_8 (void *, TypeTagTy, uint64_t, uint32_t);
+  void trackInitInst (void *, uint64_t, uint32_t);
+  void checkType (TypeTagTy, uint64_t, TypeTagTy *, void *, uint32_t);
+  void checkType_8 (TypeTagTy, uint64_t, TypeTagTy *, void *, uint32_t);
+
+  extern TypeTagTy * const TypeShadowBase;
+  extern const uintptr_t TypeShadowSize;
+}
+
+// Names of the type numbers, normally emitted by the TypeChecks pass
+char * typeNames[] = {
+  (char *) "unknown", (char *) "i8", (char *) "i16", (char *) "i32",
+  (char *) "i64", (char *) "float", (char *) "double", (char *) "ptr"
+};
+
+using namespace scbench;
+
+namespace {
+
+// Type number stored and checked by the benchmarks
+static const TypeTagTy Type = 4;
+
+//
+// Function: shadowOf()
+//
+// Description:
+//  Return the shadow of an address, as maskAddress() in the run-time and the
+//  inline fast paths of TypeChecksOpt compute it.
+//
+static inline TypeTagTy *
+shadowOf (void * Ptr) {
+  uintptr_t P = (uintptr_t) Ptr;
+  if (P >= (uintptr_t) TypeShadowBase)
+    P -= TypeShadowSize;
+  return TypeShadowBase + P;
+}
+
+//
+// Function: pattern8()
+//
+// Description:
+//  Return the shadow of an 8-byte object of the given type.
+//
+static inline uint64_t
+pattern8 (TypeTagTy TypeNumber) {
+  TypeTagTy Bytes[8];
+  Bytes[0] = TypeNumber;
+  memset (Bytes + 1, 0xFE, 7);
+  uint64_t Pattern;
+  memcpy (&Pattern, Bytes, 8);
+  return Pattern;
+}
+
+//
+// Class: TypeBenchmark
+//
+// Description:
+//  Base class of the benchmarks of the type-check run-time.  It allocates the
+//  objects of the thread and, if Typed is set, stores Type to the first eight
+//  bytes of each one before the timed operations.
+//
+class TypeBenchmark : public Benchmark {
+  public:
+    TypeBenchmark (const char * Name, bool Typed) :
+      Benchmark (Name), Typed (Typed) { }
+
+    virtual void setUp (ThreadState & S) {
+      S.Objects.clear();
+      for (unsigned index = 0; index < S.Sizes.size(); ++index) {
+        char * Object = (char *) malloc (S.Sizes[index]);
+        S.Objects.push_back (Object);
+        trackInitInst (Object, S.Sizes[index], 0);
+        if (Typed)
+          trackStoreInst (Object, Type, 8, 0);
+      }
+    }
+
+    virtual void tearDown (ThreadState & S) {
+      for (unsigned index = 0; index < S.Objects.size(); ++index)
+        free (S.Objects[index]);
+    }
+
+  private:
+    bool Typed;
+};
+
+class StoreGeneric : public TypeBenchmark {
+  public:
+    StoreGeneric () : TypeBenchmark ("trackStoreInst", false) { }
+    uint64_t run (ThreadState & S) {
+      for (unsigned index = 0; index < S.Objects.size(); ++index)
+        trackStoreInst (S.Objects[index], Type, 8, 1);
+      return S.Objects.size();
+    }
+};
+
+class StoreSpecialized : public TypeBenchmark {
+  public:
+    StoreSpecialized () : TypeBenchmark ("trackStoreInst_8", false) { }
+    uint64_t run (ThreadState & S) {
+      for (unsigned index = 0; index < S.Objects.size(); ++index)
+        trackStoreInst_8 (S.Objects[index], Type, 8, 1);
+      return S.Objects.size();
+    }
+};
+
+class StoreInline : public TypeBenchmark {
+  public:
+    StoreInline () : TypeBenchmark ("trackStoreInst_8_inline", false) { }
+    uint64_t run (ThreadState & S) {
+      uint64_t Pattern = pattern8 (Type);
+      for (unsigned index = 0; index < S.Objects.size(); ++index)
+        memcpy (shadowOf (S.Objects[index]), &Pattern, 8);
+      return S.Objects.size();
+    }
+};
+
+class CheckGeneric : public TypeBenchmark {
+  public:
+    CheckGeneric () : TypeBenchmark ("checkType", true) { }
+    uint64_t run (ThreadState & S) {
+      for (unsigned index = 0; index < S.Objects.size(); ++index) {
+        char * Object = S.Objects[index];
+        checkType (Type, 8, shadowOf (Object), Object, 2);
+      }
+      return S.Objects.size();
+    }
+};
+
+class CheckSpecialized : public TypeBenchmark {
+  public:
+    CheckSpecialized () : TypeBenchmark ("checkType_8", true) { }
+    uint64_t run (ThreadState & S) {
+      for (unsigned index = 0; index < S.Objects.size(); ++index) {
+        char * Object = S.Objects[index];
+        checkType_8 (Type, 8, shadowOf (Object), Object, 2);
+      }
+      return S.Objects.size();
+    }
+};
+
+class CheckInline : public TypeBenchmark {
+  public:
+    CheckInline () : TypeBenchmark ("checkType_8_inline", true) { }
+    uint64_t run (ThreadState & S) {
+      uint64_t Pattern = pattern8 (Type);
+      for (unsigned index = 0; index < S.Objects.size(); ++index) {
+        char * Object = S.Objects[index];
+        TypeTagTy * MD = shadowOf (Object);
+        uint64_t Shadow;
+        memcpy (&Shadow, MD, 8);
+        if (Shadow != Pattern)
+          checkType_8 (Type, 8, MD, Object, 2);
+      }
+      return S.Objects.size();
+    }
+};
+
+//
+// Class: CheckRetype
+//
+// Description:
+//  Check initialized but untyped memory, which the run-time retypes on the
+//  slow path of the check.  setUp() resets the objects to untyped.
+//
+class CheckRetype : public TypeBenchmark {
+  public:
+    CheckRetype () : TypeBenchmark ("checkType_8_retype", false) { }
+    uint64_t run (ThreadState & S) {
+      for (unsigned index = 0; index < S.Objects.size(); ++index) {
+        char * Object = S.Objects[index];
+        checkType_8 (Type, 8, shadowOf (Object), Object, 3);
+      }
+      return S.Objects.size();
+    }
+};
+
+class InitObject : public TypeBenchmark {
+  public:
+    InitObject () : TypeBenchmark ("trackInitInst", false) { }
+    uint64_t run (ThreadState & S) {
+      for (unsigned index = 0; index < S.Objects.size(); ++index)
+        trackInitInst (S.Objects[index], S.Sizes[index], 4);
+      return S.Objects.size();
+    }
+};
+
+class InitWord : public TypeBenchmark {
+  public:
+    InitWord () : TypeBenchmark ("trackInitInst_8", false) { }
+    uint64_t run (ThreadState & S) {
+      for (unsigned index = 0; index < S.Objects.size(); ++index)
+        trackInitInst (S.Objects[index], 8, 4);
+      return S.Objects.size();
+    }
+};
+
+class InitWordInline : public TypeBenchmark {
+  public:
+    InitWordInline () : TypeBenchmark ("trackInitInst_8_inline", false) { }
+    uint64_t run (ThreadState & S) {
+      uint64_t Pattern = ~0ULL;
+      for (unsigned index = 0; index < S.Objects.size(); ++index)
+        if (S.Objects[index])
+          memcpy (shadowOf (S.Objects[index]), &Pattern, 8);
+      return S.Objects.size();
+    }
+};
+
+}
+
+int
+main (int argc, char ** argv) {
+  shadowInit();
+
+  StoreGeneric SG;
+  StoreSpecialized SS;
+  StoreInline SI;
+  CheckGeneric CG;
+  CheckSpecialized CS;
+  CheckInline CI;
+  CheckRetype CR;
+  InitObject IO;
+  InitWord IW;
+  InitWordInline IWI;
+  Benchmark * Benchmarks[] = { &SG, &SS, &SI, &CG, &CS, &CI, &CR,
+                               &IO, &IW, &IWI };
+  return runSuite ("type",
+                   Benchmarks,
+                   sizeof (Benchmarks) / sizeof (Benchmarks[0]),
+                   argc,
+                   argv);
+}
@@ -204,6 +204,12 @@ public:
   /// The filename to use for logging memory safety violations
   std::string MemSafetyLogFile;
 
+  /// The check profile used to place memory safety checks
+  std::string MemSafetyCheckProfile;
+
+  /// The file to which the report of memory safety checks is written
+  std::string MemSafetyReportFile;
+
 public:
   // Define accessors/mutators for code generation options of enumeration type.
 #define CODEGENOPT(Name, Bits, Default)
@@ -48,6 +48,8 @@
 #include "safecode/BaggyBoundsChecks.h"
 #include "safecode/CFIChecks.h"
 #include "safecode/CStdLib.h"
+#include "safecode/CheckProfile.h"
+#include "safecode/CheckReport.h"
 #include "safecode/DebugInstrumentation.h"
 #include "safecode/FormatStrings.h"
 #include "safecode/InitAllocas.h"
@@ -470,11 +472,22 @@ void EmitAssemblyHelper::CreatePasses() {
     MPM->add(new SoftBoundCETSPass());
   }
 
+  // Record the run-time checks of each function after the passes that insert
+  // or optimize them (only with -fmemsafety-report=).
+  bool MemSafetyReport = CodeGenOpts.MemSafety &&
+                         !CodeGenOpts.MemSafetyReportFile.empty();
+  auto addReportStage = [&](const char *Stage) {
+    if (MemSafetyReport)
+      MPM->add (new CheckReportStage(Stage));
+  };
+
   // Add the memory safety passes
   if (CodeGenOpts.MemSafety) {
     //
     // Add passes that record information about run-time checks.
     //
+    if (MemSafetyReport)
+      MPM->add (new CheckReport(CodeGenOpts.MemSafetyReportFile));
     MPM->add (createCommonMSCInfoPass());
     MPM->add (createSAFECodeMSCInfoPass());
 
@@ -506,18 +519,41 @@ void EmitAssemblyHelper::CreatePasses() {
     MPM->add (new RegisterRuntimeInitializer(CodeGenOpts.MemSafetyLogFile.c_str()));
     MPM->add (new DebugInstrument());
     MPM->add (createInstrumentMemoryAccessesPass());
+    // Run the module-level query pass before the function passes so that
+    // ArrayBoundsCheckLocal and the passes that chain to it share a manager
+    if (CodeGenOpts.MemSafetyStructChecks)
+      MPM->add (new dsa::DemandDrivenDSA());
     MPM->add (new ScalarEvolution());
     MPM->add (new ArrayBoundsCheckLocal());
+    if (CodeGenOpts.MemSafetyStructChecks)
+      MPM->add (new ArrayBoundsCheckStruct());
     if (!CodeGenOpts.DisableRewriteOOB)
       MPM->add (new InsertGEPChecks());
     MPM->add (createSpecializeCMSCallsPass());
+    addReportStage ("instrumented");
     MPM->add (createExactCheckOptPass());
+    addReportStage ("exactcheck-opt");
 
     MPM->add (new DominatorTreeWrapperPass());
     MPM->add (new ScalarEvolution());
     MPM->add (createOptimizeImpliedFastLSChecksPass());
+    addReportStage ("implied-fastlscheck-opt");
 
     MPM->add (new OptimizeChecks());
+    addReportStage ("optimize-checks");
+
+    // Count executions of the remaining checks, or move the checks that a
+    // profile shows to be hot.  Both must happen at the same point so that
+    // check sites in the profile match the checks in the module.
+    if (CodeGenOpts.MemSafetyCheckProfileGen)
+      MPM->add (new CheckProfileInstrument());
+    if (!CodeGenOpts.MemSafetyCheckProfile.empty()) {
+      MPM->add (new CheckProfile(CodeGenOpts.MemSafetyCheckProfile));
+      MPM->add (createLoopSimplifyPass());
+      MPM->add (new HoistHotChecks());
+      addReportStage ("hoist-hot-checks");
+    }
+
     if (CodeGenOpts.MemSafeTerminate) {
       MPM->add (llvm::createSCTerminatePass ());
     }
@@ -526,7 +562,7 @@ void EmitAssemblyHelper::CreatePasses() {
 
   if (CodeGenOpts.BaggyBounds) {
     MPM->add (new PromoteArrayAllocas());
-    // run mem2reg pass to convert the loads/stores inserted by PromoteArrayAllocas to SSA form.
+    // run mem2reg pass to clean up before the remaining allocas are padded.
     MPM->add (createPromoteMemoryToRegisterPass());
     MPM->add (new InsertBaggyBoundsChecks());
     MPM->add (new RewriteHeapAllocations());
@@ -534,12 +570,18 @@ void EmitAssemblyHelper::CreatePasses() {
 
   MPM->add (new DebugInstrument());
   PMBuilder.populateModulePassManager(*MPM);
+  addReportStage ("scalar-opts");
   // For SAFECode, do the debug instrumentation and OOB rewriting after
   // all optimization is done.
   if (CodeGenOpts.MemSafety) {
     if (!CodeGenOpts.DisableRewriteOOB)
       MPM->add (new RewriteOOB());
 
+    // Write the report before the fast checks are inlined so that it shows
+    // every check that remains.
+    if (MemSafetyReport)
+      MPM->add (new CheckReportWriter());
+
     if(!CodeGenOpts.DisableInline)
     {
       MPM->add (new InlineFastChecks());
@@ -558,6 +600,13 @@ void EmitAssemblyHelper::CreatePasses() {
         }
       }
     }
+
+    // Replace the debug arguments of the remaining run-time checks with
+    // entries in a source location table (only with -sc-debug-site-table).
+    // Link-time optimization still has to find the checks by their "_debug"
+    // names to make them complete, so leave them alone when preparing for it.
+    if (!CodeGenOpts.PrepareForLTO)
+      MPM->add (new DebugSiteTable());
   }
 }
 
@@ -60,6 +60,12 @@ static SanitizerMask parseArgValues(const Driver &D, const llvm::opt::Arg *A,
 /// components. Returns OR of members of \c CoverageFeature enumeration.
 static int parseCoverageFeatures(const Driver &D, const llvm::opt::Arg *A);
 
+/// Add the clang-cc1 flags for the members of \c CoverageFeature enumeration
+/// in \p CoverageFeatures to \p CmdArgs.
+static void addCoverageArgs(int CoverageFeatures,
+                            const llvm::opt::ArgList &Args,
+                            llvm::opt::ArgStringList &CmdArgs);
+
 /// Produce an argument string from ArgList \p Args, which shows how it
 /// provides some sanitizer kind from \p Mask. For example, the argument list
 /// "-fsanitize=thread,vptr -fsanitize=address" with mask \c NeedsUbsanRt
@@ -423,8 +429,10 @@ SanitizerArgs::SanitizerArgs(const ToolChain &TC,
   }
 
   // Parse -f(no-)?sanitize-coverage flags if coverage is supported by the
-  // enabled sanitizers.
-  if (AllAddedKinds & SupportsCoverage) {
+  // enabled sanitizers or SAFECode is enabled; code built with SAFECode can
+  // get its coverage run-time from lib/Fuzzer instead of a sanitizer.
+  if ((AllAddedKinds & SupportsCoverage) ||
+      Args.hasArg(options::OPT_memsafety)) {
     for (const auto *Arg : Args) {
       if (Arg->getOption().matches(options::OPT_fsanitize_coverage)) {
         Arg->claim();
@@ -544,8 +552,12 @@ static std::string toString(const clang::SanitizerSet &Sanitizers) {
 void SanitizerArgs::addArgs(const ToolChain &TC, const llvm::opt::ArgList &Args,
                             llvm::opt::ArgStringList &CmdArgs,
                             types::ID InputType) const {
-  if (Sanitizers.empty())
+  if (Sanitizers.empty()) {
+    // Coverage without a sanitizer is only allowed with -fmemsafety.
+    if (Args.hasArg(options::OPT_memsafety))
+      addCoverageArgs(CoverageFeatures, Args, CmdArgs);
     return;
+  }
   CmdArgs.push_back(Args.MakeArgString("-fsanitize=" + toString(Sanitizers)));
 
   if (!RecoverableSanitizers.empty())
@@ -572,19 +584,7 @@ void SanitizerArgs::addArgs(const ToolChain &TC, const llvm::opt::ArgList &Args,
   if (AsanFieldPadding)
     CmdArgs.push_back(Args.MakeArgString("-fsanitize-address-field-padding=" +
                                          llvm::utostr(AsanFieldPadding)));
-  // Translate available CoverageFeatures to corresponding clang-cc1 flags.
-  std::pair<int, const char *> CoverageFlags[] = {
-    std::make_pair(CoverageFunc, "-fsanitize-coverage-type=1"),
-    std::make_pair(CoverageBB, "-fsanitize-coverage-type=2"),
-    std::make_pair(CoverageEdge, "-fsanitize-coverage-type=3"),
-    std::make_pair(CoverageIndirCall, "-fsanitize-coverage-indirect-calls"),
-    std::make_pair(CoverageTraceBB, "-fsanitize-coverage-trace-bb"),
-    std::make_pair(CoverageTraceCmp, "-fsanitize-coverage-trace-cmp"),
-    std::make_pair(Coverage8bitCounters, "-fsanitize-coverage-8bit-counters")};
-  for (auto F : CoverageFlags) {
-    if (CoverageFeatures & F.first)
-      CmdArgs.push_back(Args.MakeArgString(F.second));
-  }
+  addCoverageArgs(CoverageFeatures, Args, CmdArgs);
 
 
   // MSan: Workaround for PR16386.
@@ -659,6 +659,23 @@ int parseCoverageFeatures(const Driver &D, const llvm::opt::Arg *A) {
   return Features;
 }
 
+void addCoverageArgs(int CoverageFeatures, const llvm::opt::ArgList &Args,
+                     llvm::opt::ArgStringList &CmdArgs) {
+  // Translate available CoverageFeatures to corresponding clang-cc1 flags.
+  std::pair<int, const char *> CoverageFlags[] = {
+    std::make_pair(CoverageFunc, "-fsanitize-coverage-type=1"),
+    std::make_pair(CoverageBB, "-fsanitize-coverage-type=2"),
+    std::make_pair(CoverageEdge, "-fsanitize-coverage-type=3"),
+    std::make_pair(CoverageIndirCall, "-fsanitize-coverage-indirect-calls"),
+    std::make_pair(CoverageTraceBB, "-fsanitize-coverage-trace-bb"),
+    std::make_pair(CoverageTraceCmp, "-fsanitize-coverage-trace-cmp"),
+    std::make_pair(Coverage8bitCounters, "-fsanitize-coverage-8bit-counters")};
+  for (auto F : CoverageFlags) {
+    if (CoverageFeatures & F.first)
+      CmdArgs.push_back(Args.MakeArgString(F.second));
+  }
+}
+
 std::string lastArgumentForMask(const Driver &D, const llvm::opt::ArgList &Args,
                                 SanitizerMask Mask) {
   for (llvm::opt::ArgList::const_reverse_iterator I = Args.rbegin(),
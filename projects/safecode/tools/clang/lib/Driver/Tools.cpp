@@ -2312,6 +2312,23 @@ static void addProfileRT(const ToolChain &TC, const ArgList &Args,
   CmdArgs.push_back(Args.MakeArgString(getCompilerRT(TC, "profile")));
 }
 
+// This adds the SAFECode run-time selected by -bbc/-bbac (the debug run-time
+// by default) and, with the check profile instrumentation, the counter
+// library it writes the profile with.
+static void addSAFECodeRT(const ArgList &Args, ArgStringList &CmdArgs) {
+  if (Args.hasArg(options::OPT_bbac)) {
+    CmdArgs.push_back("-lsc_bbac_rt");
+  } else if (Args.hasArg(options::OPT_bbc)) {
+    CmdArgs.push_back("-lsc_bbc_rt");
+  } else {
+    CmdArgs.push_back("-lsc_dbg_rt");
+    CmdArgs.push_back("-lpoolalloc_bitmap");
+  }
+  CmdArgs.push_back("-lgdtoa");
+  if (Args.hasArg(options::OPT_msCheckProfileGen))
+    CmdArgs.push_back("-lcount");
+}
+
 namespace {
 enum OpenMPRuntimeKind {
   /// An unknown OpenMP runtime. We can't generate effective OpenMP code
@@ -4090,6 +4107,10 @@ void Clang::ConstructJob(Compilation &C, const JobAction &JA,
     CmdArgs.push_back("-fmemsafety-disable-rewrite-oob");
   }
 
+  if (Args.getLastArg(options::OPT_msStructChecks)) {
+    CmdArgs.push_back("-fmemsafety-struct-checks");
+  }
+
   if (Args.getLastArg(options::OPT_disable_inline)) {
     CmdArgs.push_back("-fmemsafety-disable-inline");
   }
@@ -4107,6 +4128,20 @@ void Clang::ConstructJob(Compilation &C, const JobAction &JA,
     CmdArgs.push_back(MemSafetyLogOpt->getValue());
   }
 
+  if (Args.getLastArg(options::OPT_msCheckProfileGen)) {
+    CmdArgs.push_back("-fmemsafety-check-profile-generate");
+  }
+
+  if (Arg *CheckProfileOpt = Args.getLastArg(options::OPT_msCheckProfileUse)) {
+    CmdArgs.push_back("-fmemsafety-check-profile-use");
+    CmdArgs.push_back(CheckProfileOpt->getValue());
+  }
+
+  if (Arg *ReportOpt = Args.getLastArg(options::OPT_msReport)) {
+    CmdArgs.push_back(Args.MakeArgString(Twine("-fmemsafety-report=") +
+                                         ReportOpt->getValue()));
+  }
+
   // --param ssp-buffer-size=
   for (const Arg *A : Args.filtered(options::OPT__param)) {
     StringRef Str(A->getValue());
@@ -6567,15 +6602,7 @@ void darwin::Linker::ConstructJob(Compilation &C, const JobAction &JA,
   }
 
   if (Args.hasArg(options::OPT_memsafety)) {
-    if (Args.hasArg(options::OPT_bbac)) {
-      CmdArgs.push_back("-lsc_bbac_rt");
-    } else if (Args.hasArg(options::OPT_bbc)) {
-      CmdArgs.push_back("-lsc_bbc_rt");
-    } else {
-      CmdArgs.push_back("-lsc_dbg_rt");
-      CmdArgs.push_back("-lpoolalloc_bitmap");
-    }
-    CmdArgs.push_back("-lgdtoa");
+    addSAFECodeRT(Args, CmdArgs);
 
     if (!Args.hasArg(options::OPT_nostdlib) &&
         !Args.hasArg(options::OPT_nodefaultlibs)) {
@@ -6583,6 +6610,7 @@ void darwin::Linker::ConstructJob(Compilation &C, const JobAction &JA,
     }
   }
   Args.ClaimAllArgs (options::OPT_disable_rewrite_oob);
+  Args.ClaimAllArgs (options::OPT_msStructChecks);
 
   const char *Exec = Args.MakeArgString(getToolChain().GetLinkerPath());
   std::unique_ptr<Command> Cmd =
@@ -6943,18 +6971,11 @@ void openbsd::Linker::ConstructJob(Compilation &C, const JobAction &JA,
   }
 
   if (Args.hasArg(options::OPT_memsafety)) {
-    if (Args.hasArg(options::OPT_bbac)) {
-      CmdArgs.push_back("-lsc_bbac_rt");
-    } else if (Args.hasArg(options::OPT_bbc)) {
-      CmdArgs.push_back("-lsc_bbc_rt");
-    } else {
-      CmdArgs.push_back("-lsc_dbg_rt");
-      CmdArgs.push_back("-lpoolalloc_bitmap");
-    }
-    CmdArgs.push_back("-lgdtoa");
+    addSAFECodeRT(Args, CmdArgs);
     getToolChain().AddCXXStdlibLibArgs (Args, CmdArgs);
   }
   Args.ClaimAllArgs (options::OPT_disable_rewrite_oob);
+  Args.ClaimAllArgs (options::OPT_msStructChecks);
   Args.ClaimAllArgs (options::OPT_disable_inline);
 
   if (!Args.hasArg(options::OPT_nostdlib) &&
@@ -7394,19 +7415,12 @@ void freebsd::Linker::ConstructJob(Compilation &C, const JobAction &JA,
   }
 
   if (Args.hasArg(options::OPT_memsafety)) {
-    if (Args.hasArg(options::OPT_bbac)) {
-      CmdArgs.push_back("-lsc_bbac_rt");
-    } else if (Args.hasArg(options::OPT_bbc)) {
-      CmdArgs.push_back("-lsc_bbc_rt");
-    } else {
-      CmdArgs.push_back("-lsc_dbg_rt");
-      CmdArgs.push_back("-lpoolalloc_bitmap");
-    }
-    CmdArgs.push_back("-lgdtoa");
+    addSAFECodeRT(Args, CmdArgs);
     getToolChain().AddCXXStdlibLibArgs (Args, CmdArgs);
     CmdArgs.push_back("-lm");
   }
   Args.ClaimAllArgs (options::OPT_disable_rewrite_oob);
+  Args.ClaimAllArgs (options::OPT_msStructChecks);
   Args.ClaimAllArgs (options::OPT_disable_inline);
 
   if (!Args.hasArg(options::OPT_nostdlib) &&
@@ -7700,18 +7714,11 @@ void netbsd::Linker::ConstructJob(Compilation &C, const JobAction &JA,
   }
 
   if (Args.hasArg(options::OPT_memsafety)) {
-    if (Args.hasArg(options::OPT_bbac)) {
-      CmdArgs.push_back("-lsc_bbac_rt"); 
-    } else if (Args.hasArg(options::OPT_bbc)) {
-      CmdArgs.push_back("-lsc_bbc_rt");
-    } else {
-      CmdArgs.push_back("-lsc_dbg_rt");
-      CmdArgs.push_back("-lpoolalloc_bitmap");
-    }
-    CmdArgs.push_back("-lgdtoa");
+    addSAFECodeRT(Args, CmdArgs);
     getToolChain().AddCXXStdlibLibArgs (Args, CmdArgs);
   }
   Args.ClaimAllArgs (options::OPT_disable_rewrite_oob);
+  Args.ClaimAllArgs (options::OPT_msStructChecks);
   Args.ClaimAllArgs (options::OPT_disable_inline);
 
   if (!Args.hasArg(options::OPT_nostdlib) &&
@@ -8244,18 +8251,11 @@ void gnutools::Linker::ConstructJob(Compilation &C, const JobAction &JA,
   }
 
   if (Args.hasArg(options::OPT_memsafety)) {
-    if (Args.hasArg(options::OPT_bbac)) {
-      CmdArgs.push_back("-lsc_bbac_rt");
-    } else if (Args.hasArg(options::OPT_bbc)) {
-      CmdArgs.push_back("-lsc_bbc_rt");
-    } else {
-      CmdArgs.push_back("-lsc_dbg_rt");
-      CmdArgs.push_back("-lpoolalloc_bitmap");
-    }
-    CmdArgs.push_back("-lgdtoa");
+    addSAFECodeRT(Args, CmdArgs);
     getToolChain().AddCXXStdlibLibArgs (Args, CmdArgs);
   }
   Args.ClaimAllArgs (options::OPT_disable_rewrite_oob);
+  Args.ClaimAllArgs (options::OPT_msStructChecks);
   Args.ClaimAllArgs (options::OPT_disable_inline);
 
   // The profile runtime also needs access to system libraries.
@@ -8578,18 +8578,11 @@ void minix::Linker::ConstructJob(Compilation &C, const JobAction &JA,
     getToolChain().AddCXXStdlibLibArgs (Args, CmdArgs);
   }
   if (Args.hasArg(options::OPT_memsafety)) {
-    if (Args.hasArg(options::OPT_bbac)) {
-      CmdArgs.push_back("-lsc_bbac_rt");
-    } else if (Args.hasArg(options::OPT_bbc)) {
-      CmdArgs.push_back("-lsc_bbc_rt");
-    } else {
-      CmdArgs.push_back("-lsc_dbg_rt");
-      CmdArgs.push_back("-lpoolalloc_bitmap");
-    }
-    CmdArgs.push_back("-lgdtoa");
+    addSAFECodeRT(Args, CmdArgs);
     getToolChain().AddCXXStdlibLibArgs (Args, CmdArgs);
   }
   Args.ClaimAllArgs (options::OPT_disable_rewrite_oob);
+  Args.ClaimAllArgs (options::OPT_msStructChecks);
   Args.ClaimAllArgs (options::OPT_disable_inline);
 
   addProfileRT(getToolChain(), Args, CmdArgs);
@@ -8724,18 +8717,11 @@ void dragonfly::Linker::ConstructJob(Compilation &C, const JobAction &JA,
     getToolChain().AddCXXStdlibLibArgs (Args, CmdArgs);
   }
   if (Args.hasArg(options::OPT_memsafety)) {
-    if (Args.hasArg(options::OPT_bbac)) {
-      CmdArgs.push_back("-lsc_bbac_rt");
-    } else if (Args.hasArg(options::OPT_bbc)) {
-      CmdArgs.push_back("-lsc_bbc_rt");
-    } else {
-      CmdArgs.push_back("-lsc_dbg_rt");
-      CmdArgs.push_back("-lpoolalloc_bitmap");
-    }
-    CmdArgs.push_back("-lgdtoa");
+    addSAFECodeRT(Args, CmdArgs);
     getToolChain().AddCXXStdlibLibArgs (Args, CmdArgs);
   }
   Args.ClaimAllArgs (options::OPT_disable_rewrite_oob);
+  Args.ClaimAllArgs (options::OPT_msStructChecks);
   Args.ClaimAllArgs (options::OPT_disable_inline);
 
   if (!Args.hasArg(options::OPT_nostdlib) &&
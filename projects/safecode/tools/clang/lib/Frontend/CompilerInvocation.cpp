@@ -681,6 +681,7 @@ static bool ParseCodeGenArgs(CodeGenOptions &Opts, ArgList &Args, InputKind IK,
   Opts.BaggyBoundsAccurateChecking = Args.hasArg(OPT_bbac);
   Opts.BaggyBoundsChecking = Args.hasArg(OPT_bbc);
   Opts.DisableRewriteOOB = Args.hasArg(OPT_disable_rewrite_oob);
+  Opts.MemSafetyStructChecks = Args.hasArg(OPT_msStructChecks);
   Opts.DisableInline = Args.hasArg(OPT_disable_inline);
   Opts.SoftBound = Args.hasArg(OPT_softbound);
   Opts.MemSafeTerminate = Args.hasArg(OPT_terminate);
@@ -689,6 +690,11 @@ static bool ParseCodeGenArgs(CodeGenOptions &Opts, ArgList &Args, InputKind IK,
   } else {
     Opts.MemSafetyLogFile = "";
   }
+  Opts.MemSafetyCheckProfileGen = Args.hasArg(OPT_msCheckProfileGen);
+  if (Arg *A = Args.getLastArg(OPT_msCheckProfileUse))
+    Opts.MemSafetyCheckProfile = A->getValue();
+  if (Arg *A = Args.getLastArg(OPT_msReport))
+    Opts.MemSafetyReportFile = A->getValue();
 
   return Success;
 }
@@ -0,0 +1,6 @@
+// RUN: %clang -target x86_64-linux-gnu -fmemsafety -fmemsafety-report=%t.json -c %s -### 2>&1 | FileCheck %s --check-prefix=CHECK-REPORT
+// CHECK-REPORT: "-cc1"
+// CHECK-REPORT: "-fmemsafety-report={{[^"]*}}.json"
+
+// RUN: %clang -target x86_64-linux-gnu -fmemsafety -c %s -### 2>&1 | FileCheck %s --check-prefix=CHECK-NO-REPORT
+// CHECK-NO-REPORT-NOT: -fmemsafety-report
@@ -28,6 +28,10 @@
 // RUN: %clang -target x86_64-linux-gnu                     -fsanitize-coverage=1 %s -### 2>&1 | FileCheck %s --check-prefix=CHECK-SANITIZE-COVERAGE-UNUSED
 // CHECK-SANITIZE-COVERAGE-UNUSED: argument unused during compilation: '-fsanitize-coverage=1'
 
+// RUN: %clang -target x86_64-linux-gnu -fmemsafety -fsanitize-coverage=edge,8bit-counters %s -### 2>&1 | FileCheck %s --check-prefix=CHECK-MEMSAFETY-COVERAGE
+// CHECK-MEMSAFETY-COVERAGE: -fsanitize-coverage-type=3
+// CHECK-MEMSAFETY-COVERAGE: -fsanitize-coverage-8bit-counters
+
 // RUN: %clang -target x86_64-linux-gnu -fsanitize=address -fsanitize-coverage=1 -fno-sanitize=address %s -### 2>&1 | FileCheck %s --check-prefix=CHECK-SANITIZE-COVERAGE-SAN-DISABLED
 // CHECK-SANITIZE-COVERAGE-SAN-DISABLED-NOT: argument unused
 